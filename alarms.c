@@ -60,6 +60,8 @@ void alarms_register (alarm_details_t *details)
 {
     alarms->next = details;
     alarms = details;
+
+    report_settings_schema_invalidate();
 }
 
 alarm_details_t *alarms_get_details (void)
@@ -109,6 +109,56 @@ generate a solution.
 #define SPINDLE_NPWM_PIECES 4 // Number of pieces for spindle RPM linearization, max 4.
 #endif
 
+/*! \def SPINDLE_PWM_TABLE_SIZE
+\brief Number of intervals in the precomputed spindle RPM to PWM lookup table, set to 0 to disable.
+When enabled PWM values are precomputed for equally spaced RPMs between the min and max spindle RPM when spindle
+settings are changed, RPM to PWM conversion is then reduced to a table lookup and a linear interpolation.
+Mainly useful with \ref ENABLE_SPINDLE_LINEARIZATION enabled and for
+laser mode and CSS (G96) where a PWM value is calculated for each step segment.
+<br>__NOTE:__ Each spindle using the core PWM conversion allocates memory for the table.
+*/
+#if !defined SPINDLE_PWM_TABLE_SIZE || defined __DOXYGEN__
+#define SPINDLE_PWM_TABLE_SIZE 0 // Default disabled. Set to > 0, e.g. 64, to enable.
+#endif
+
+/*! \def ADAPTIVE_FEED_ENABLE
+\brief Enable adaptive feed, a realtime feed rate scale input for feed motions.
+When enabled `M52 P1` (or `M52`) enables and `M52 P0` disables adaptive feed, while enabled the scale set by
+st_set_adaptive_feed(), e.g. by a plugin from a spindle load ADC interrupt, is applied by the step segment
+generator to the velocity profile of the executing block without replanning. Deceleration limits computed by the
+planner are honoured and a change takes effect on the next step segment prepared.
+Rapids, system motions and spindle synchronized motions are not affected.
+*/
+#if !defined ADAPTIVE_FEED_ENABLE || defined __DOXYGEN__
+#define ADAPTIVE_FEED_ENABLE Off
+#endif
+
+/*! \def LASER_RASTER_ENABLE
+\brief Enable laser raster mode, per-pixel power streamed with G1 motions.
+When enabled a `(RASTER,<base64 data>)` comment on a G1 line in laser mode attaches a row of pixels to the motion,
+each decoded byte is a power level from 0 (off) to 255 (programmed S value). The pixels are spread evenly along
+the line and output by the stepper interrupt at the step position they belong to, the laser is switched off
+after the last pixel.
+<br>__NOTE:__ Requires a spindle with PWM output. Lines that are split into several motions by kinematics
+only output the pixels for the first part of the motion. Spindle overrides are applied when the line is
+loaded into the step segment buffer.
+*/
+#if !defined LASER_RASTER_ENABLE || defined __DOXYGEN__
+#define LASER_RASTER_ENABLE Off
+#endif
+
+/*! \def LASER_PPI_STEPPER_ENABLE
+\brief Enable laser PPI (Pulses Per Inch) pulse generation by the stepper interrupt.
+When enabled and PPI mode is not handled by the driver or a plugin a fixed length laser pulse is fired for every
+1/PPI inch travelled along the path, the pulse positions are derived from the step events executed so that
+placement does not depend on the segment timing or the feed rate. The distance to the next pulse is carried over
+between blocks.
+<br>__NOTE:__ Requires a spindle that implements the optional \a pulse_on handler.
+*/
+#if !defined LASER_PPI_STEPPER_ENABLE || defined __DOXYGEN__
+#define LASER_PPI_STEPPER_ENABLE Off
+#endif
+
 #include "nuts_bolts.h"
 
 #define KINEMATICS_API // Uncomment to add HAL entry points for custom kinematics
@@ -144,6 +194,15 @@ Experimental - testing required and homing needs to be worked out.
 #define MINIMUM_FEED_RATE 0.1f // (radians/min)
 #endif
 
+/*! \def DELTA_SEGMENT_MERGE_TOLERANCE
+\brief
+Maximum joint space deviation in radians allowed when merging consecutive delta kinematics segments into one,
+reducing the number of planner blocks for long straight moves. Set to 0 to disable merging.
+*/
+#if !defined DELTA_SEGMENT_MERGE_TOLERANCE || defined __DOXYGEN__
+#define DELTA_SEGMENT_MERGE_TOLERANCE 0.0f // Default disabled. Set to e.g. 0.0002f to enable.
+#endif
+
 /*! \def POLAR_ROBOT
 \brief Enable polar kinematics.
 Experimental - testing required and homing needs to be worked out.
@@ -175,6 +234,30 @@ DEFAULT_X_STEPS_PER_MM and DEFAULT_Y_STEPS_PER_MM are now steps per degree
 #define SCARA On
 #endif
 
+/*! \def KINEMATICS_STATIC
+\brief
+Set to \ref On or 1 to bind the kinematics transform and line segmentation functions at compile time.
+mc_line() and the homing code then call them directly, allowing the compiler to inline them.
+Currently only supported for \ref COREXY and only when no other kinematics is enabled, other
+kinematics always use the runtime kinematics API pointers.
+<br>__NOTE:__ Plugins that override the kinematics segment_line, transform_from_cartesian or
+limits_get_axis_mask pointers are bypassed when enabled.
+*/
+#if !defined KINEMATICS_STATIC || defined __DOXYGEN__
+#define KINEMATICS_STATIC Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def KINEMATICS_FAST_TRIG
+\brief
+Set to \ref On or 1 to use table interpolated sine, cosine, arctangent and arccosine in the \ref SCARA and
+\ref POLAR_ROBOT transforms. The tables are rebuilt on settings changes with a spacing that keeps the error
+well below the resolution of one step, the size can be limited by defining KINEMATICS_FAST_TRIG_SIZE.
+<br>__NOTE:__ Uses up to 2 * (KINEMATICS_FAST_TRIG_SIZE + 1) floats of RAM, 4 KB by default.
+*/
+#if !defined KINEMATICS_FAST_TRIG || defined __DOXYGEN__
+#define KINEMATICS_FAST_TRIG Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
 /*! \def CHECK_MODE_DELAY
 \brief
 Add a short delay for each block processed in Check Mode to
@@ -198,7 +281,32 @@ or EMI triggering the related interrupt falsely or too many times.
 // ---------------------------------------------------------------------------------------
 // ADVANCED CONFIGURATION OPTIONS:
 
-#define ENABLE_PATH_BLENDING Off // Do NOT enable unless working on adding this feature!
+/*! \def ENABLE_PATH_BLENDING
+\brief
+Adds support for the G64 P<tolerance> path blending mode and the G61 and G61.1 exact path modes.
+In G64 mode with a tolerance > 0 a tangent arc that deviates no more than the tolerance from the
+programmed corner is inserted between consecutive feed motions, allowing higher corner speeds.
+The end of each motion is held back until the next motion is known. Rapid, inverse time and
+spindle synchronized motions are not blended, and neither are corners where the spindle, coolant
+or overrides change or where output commands or messages are attached.
+G64 without a P word, G61 and G61.1 plan corners by junction deviation only.
+__NOTE:__ Blend arcs are segmented by the arc tolerance setting, $12.
+*/
+#if !defined ENABLE_PATH_BLENDING || defined __DOXYGEN__
+#define ENABLE_PATH_BLENDING Off
+#endif
+
+/*! \def CANNED_CYCLE_RAPID_REENTRY
+\brief
+When enabled the G83 peck drilling cycle rapids back down to the previous peck depth plus the G73 retract
+distance setting ($28) after each full retract, only the new depth is drilled at the feed rate. By default
+each peck is fed from the retract plane, which spends most of the cycle time feeding through air.
+__NOTE:__ Enable \ref PLANNER_DWELL_ENABLE as well to avoid the planner buffer being drained by the dwell
+after each peck.
+*/
+#if !defined CANNED_CYCLE_RAPID_REENTRY || defined __DOXYGEN__
+#define CANNED_CYCLE_RAPID_REENTRY Off
+#endif
 
 // Enables code for debugging purposes. Not for general use and always in constant flux.
 //#define DEBUG // Uncomment to enable. Default disabled.
@@ -230,6 +338,19 @@ to be refreshed very often, on the order of a several seconds.
 #endif
 ///@}
 
+/*! \def REPORT_DELTA_FULL_INTERVAL
+\brief
+Set to a value > 0 to add the `$RD` command for toggling change-only real-time reports.
+When enabled the position, buffer state, line number and feed/speed elements are only included when
+changed since the previous report, a full report is sent every REPORT_DELTA_FULL_INTERVAL report
+and on requests for a complete report.
+<br>__NOTE:__ The mode is enabled for the current stream and ended when the stream changes. The real-time report is shared
+between connected streams, these get the change-only reports as well.
+*/
+#if !defined REPORT_DELTA_FULL_INTERVAL || defined __DOXYGEN__
+#define REPORT_DELTA_FULL_INTERVAL 0 // Default disabled. Set to 1-255 to enable.
+#endif
+
 /*! \def ACCELERATION_TICKS_PER_SECOND
 \brief The temporal resolution of the acceleration management subsystem.
 A higher number gives smoother
@@ -311,6 +432,18 @@ bogged down by too many trig calculations.
 #define N_ARC_CORRECTION 12 // Integer (1-255)
 #endif
 
+/*! \def ARC_RECURRENCE_ROTATION
+\brief
+Set to \ref On or 1 to generate arc segments by an exact rotation recurrence. The rotation matrix for
+the segment angle is computed once per arc and applied in double precision to every segment, replacing the
+small angle approximation and the periodic sin() and cos() corrections set by \ref N_ARC_CORRECTION.
+This gives a constant per segment cost with no trigonometric calls inside the segment loop.
+The number of segments is still derived from the radius and the arc tolerance setting.
+*/
+#if !defined ARC_RECURRENCE_ROTATION || defined __DOXYGEN__
+#define ARC_RECURRENCE_ROTATION Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
 /*! \def ARC_ANGULAR_TRAVEL_EPSILON
 \brief
 The arc G2/3 g-code standard is problematic by definition. Radius-based arcs have horrible numerical
@@ -327,7 +460,9 @@ much greater than this. The default setting should capture most, if not all, ful
 #endif
 
 /*! @name Default constants for G5 Cubic splines
-//
+The number of line segments a spline is divided into is calculated from its curvature so that the
+maximum distance from the segments to the spline does not exceed BEZIER_SIGMA (mm). The segment length
+is limited to between BEZIER_MIN_STEP and BEZIER_MAX_STEP of the spline parameter range (0 - 1).
 */
 ///@{
 #if !defined BEZIER_MIN_STEP || defined __DOXYGEN__
@@ -366,6 +501,466 @@ before having to come back and refill this buffer, currently at ~50msec of step
 #define SEGMENT_BUFFER_SIZE 20 // Uncomment to override default in stepper.h.
 #endif
 
+/*! \def SEGMENT_BUFFER_MONITOR
+\brief
+Set to \ref On or 1 to enable step segment buffer starvation monitoring.
+Records the minimum number of segments found in the buffer when the foreground process comes back
+to refill it during motion, the number of underruns (buffer drained by the stepper ISR while
+motion is still pending) and the time of the last underrun. The data is added to the real time
+report when running or holding as `|SB:<min fill>,<underruns>,<ms since last underrun>`.
+Values are kept from the first cycle start after a program end until the next program end or a soft reset.
+*/
+#if !defined SEGMENT_BUFFER_MONITOR || defined __DOXYGEN__
+#define SEGMENT_BUFFER_MONITOR Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def REPORT_AXIS_VELOCITY
+\brief
+Set to \ref On or 1 to add the velocity of each axis and the distance remaining in the planner buffer to
+the real time report when running or holding as `|AV:<x>,<y>,<z>...|LA:<distance>`.
+Axis velocities are signed and derived from the reported feed rate and the executing block, for non cartesian
+kinematics they are motor velocities. A short look-ahead distance indicates slowdowns caused by the planner
+running out of blocks rather than by axis limits.
+*/
+#if !defined REPORT_AXIS_VELOCITY || defined __DOXYGEN__
+#define REPORT_AXIS_VELOCITY Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def STEP_FIDELITY_MONITOR
+\brief
+Set to \ref On or 1 to enable step timing fidelity statistics, output with <i>$STF</i>.
+For each segment prepared the step period executed by the stepper interrupt, after rounding to step timer
+cycles and AMASS scaling, is compared to the ideal periods at the velocity profile speeds at the segment start
+and end. The larger deviation thus includes the error from running each segment at its average rate.
+Maximum and mean deviation in ppm, AMASS level use and transitions and the maximum rate change at segment
+boundaries are recorded.
+Use for quantifying the effect of changes to \ref ACCELERATION_TICKS_PER_SECOND and \ref SEGMENT_BUFFER_SIZE.
+*/
+#if !defined STEP_FIDELITY_MONITOR || defined __DOXYGEN__
+#define STEP_FIDELITY_MONITOR Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def VFS_MOUNT_CACHE_SIZE
+\brief
+Number of recently resolved absolute paths to cache in the VFS mount lookup, set to 0 to disable.
+Saves walking the mount list on each vfs_open(), vfs_stat() and vfs_opendir() call, e.g. for macro heavy jobs
+repeatedly opening the same files. The cache is cleared on mount, unmount and change of directory.
+*/
+#if !defined VFS_MOUNT_CACHE_SIZE || defined __DOXYGEN__
+#define VFS_MOUNT_CACHE_SIZE 0 // Default disabled. Set to e.g. 4 to enable.
+#endif
+
+/*! \def VFS_READAHEAD_BUFFERS
+\brief
+Number of read-ahead buffers to use for files attached via vfs_readahead_attach(), typically the file
+streamed by the SD card plugin. Buffers are refilled from the foreground realtime loop while the parser
+consumes the current buffer, hiding file system latency from the parser. Set to 0 to disable.
+Refill statistics can be reported by the `$VFSRA` command.
+*/
+#if !defined VFS_READAHEAD_BUFFERS || defined __DOXYGEN__
+#define VFS_READAHEAD_BUFFERS 0 // Default disabled. Set to 2 or more to enable.
+#endif
+
+/*! \def VFS_READAHEAD_BUFFER_SIZE
+\brief
+Size of each read-ahead buffer in bytes, should preferably be a multiple of the file system sector size.
+*/
+#if !defined VFS_READAHEAD_BUFFER_SIZE || defined __DOXYGEN__
+#define VFS_READAHEAD_BUFFER_SIZE 512
+#endif
+
+/*! \def VFS_LOG_BUFFER_SIZE
+\brief
+Size in bytes of the write-behind log sink buffer, set to 0 to disable.
+When a log file is opened with vfs_log_open() strings appended by vfs_log_write() and vfs_log_message(),
+from any context, are buffered and written to the file from the foreground process. The buffer is drained
+when idle or when more than half full. Messages and alarms reported by the core are logged as well.
+*/
+#if !defined VFS_LOG_BUFFER_SIZE || defined __DOXYGEN__
+#define VFS_LOG_BUFFER_SIZE 0 // Default disabled. Set to e.g. 2048 to enable.
+#endif
+
+/*! \def INPUT_EVENT_LOG_SIZE
+\brief
+Number of entries in the input event log, must be a power of 2. Set to 0 to disable.
+Control signal, limit switch, probe and aux input interrupts are logged with a timestamp, the signal state
+and the machine position. The log is output by the `$EVL` command, `$EVL=ON` streams new events as they occur.
+*/
+#if !defined INPUT_EVENT_LOG_SIZE || defined __DOXYGEN__
+#define INPUT_EVENT_LOG_SIZE 0 // Default disabled. Set to e.g. 32 to enable.
+#endif
+
+/*! \def IOPORTS_DIRECT_OUTPUT_ENABLE
+\brief
+Set to \ref On or 1 to link digital aux outputs directly to the pin _set_value_ handlers provided by the driver.
+The pin information of the outputs is read once on startup, and again when an output is claimed, and
+\a hal.port.digital_out is replaced by a handler that calls the pin handler without further lookups.
+This makes the latency of M62 - M65 outputs deterministic.
+<br>__NOTE:__ Requires a driver that provides the _get_pin_info_ handler and a _set_value_ handler for the pins.
+*/
+#if !defined IOPORTS_DIRECT_OUTPUT_ENABLE || defined __DOXYGEN__
+#define IOPORTS_DIRECT_OUTPUT_ENABLE Off
+#endif
+
+/*! \def STREAM_TX_QUEUE_SIZE
+\brief
+Size in bytes of the transmit queue allocated for each connection of output shared between several streams,
+set to 0 to disable. Output to all connections, such as real-time reports and messages, is queued and fed
+to the stream drivers without blocking so a slow connection does not stall output to the others.
+When a queue is full the oldest queued real-time reports are dropped, or the output is blocked if the
+connection policy is set to #StreamTxPolicy_Block by stream_set_tx_policy().
+Queue usage and drop counts can be reported by the `$TXQ` command.
+<br>__NOTE:__ Only streams providing the _get_tx_buffer_count_ handler are queued.
+*/
+#if !defined STREAM_TX_QUEUE_SIZE || defined __DOXYGEN__
+#define STREAM_TX_QUEUE_SIZE 0 // Default disabled. Set to e.g. 512 to enable.
+#endif
+
+/*! \def STREAM_MUX_ENABLE
+\brief
+Set to \ref On or 1 to enable the stream multiplexer API. Streams added by stream_mux_subscribe() receive
+output sent to all streams, such as real-time reports and messages, but only status report requests are
+accepted from them, any other input is discarded on reception. A subscriber may become the stream owning
+input by a call to stream_mux_takeover() when the controller is idle or in alarm state, the previous owner
+is then demoted to a subscriber.
+*/
+#if !defined STREAM_MUX_ENABLE || defined __DOXYGEN__
+#define STREAM_MUX_ENABLE Off
+#endif
+
+/*! \def PREFLIGHT_ENABLE
+\brief
+Enable the `$PRE=<filename>` command that validates a file by reading it directly from the file system
+and running it through the parser in check mode at full speed. Soft limits are checked for all motions and
+a summary with the bounding box, the estimated run time and the first error is output.
+Run time is estimated from the acceleration profiles planned by the planner. When the validated file is run
+the estimated time remaining is added to the real time report as `|ETR:<seconds>`.
+*/
+#if !defined PREFLIGHT_ENABLE || defined __DOXYGEN__
+#define PREFLIGHT_ENABLE Off
+#endif
+
+/*! \def PROGRAM_CACHE_ENABLE
+\brief
+Set to \ref On or 1 to enable the program cache for programs that are run repeatedly.
+`$PGC=<filename>` validates the file as `$PRE` does and records the parsed motions, dwells and spindle and coolant
+changes to `/program.pgc` in a compact binary form. `$PGR=<filename>` then runs the program from the cache
+without parsing it, bypassing the sender. The cache is not valid after a restart, after any setting change, if the
+file has changed or if position, modal state, offsets or the tool table differ from when it was recorded.
+<br>__NOTE:__ Programs that probe, change tools, pause, use user defined M-codes, I/O or spindle synchronized
+motion, CSS or feed per revolution modes or that change coordinate systems or G92 offsets are not cached.
+Requires \ref PREFLIGHT_ENABLE.
+*/
+#if !defined PROGRAM_CACHE_ENABLE || defined __DOXYGEN__
+#define PROGRAM_CACHE_ENABLE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def DELAYED_TASK_POOL_SIZE
+\brief
+Set to the maximum number of pending tasks to add protocol_enqueue_delayed_task() and protocol_cancel_delayed_task()
+for calling functions once from the foreground process after a delay given in milliseconds.
+Delayed tasks are held in a timer wheel with 1 ms resolution, tasks may be enqueued from interrupt context.
+<br>__NOTE:__ Requires the driver to provide the \a hal.get_elapsed_ticks handler.
+*/
+#if !defined DELAYED_TASK_POOL_SIZE || defined __DOXYGEN__
+#define DELAYED_TASK_POOL_SIZE 0 // Default disabled. Set to e.g. 16 to enable.
+#endif
+
+/*! \def MEM_ACCOUNTING_ENABLE
+\brief
+Set to \ref On or 1 to account for heap allocations made by the core, tagged per subsystem.
+`$MEM` outputs current and peak use per subsystem, the planner buffer size allocated versus the size set by `$398`,
+free heap, the lowest free heap seen, the largest free block and the fragmentation. `$MEM=RESET` clears the peak values.
+<br>__NOTE:__ Each allocation is prefixed by an 8 byte header. Free heap is only reported if the driver provides \a hal.get_free_mem.
+Blocks allocated by mem_alloc() must be released by mem_free(), messages and output commands are not accounted as they may be allocated by plugins.
+*/
+#if !defined MEM_ACCOUNTING_ENABLE || defined __DOXYGEN__
+#define MEM_ACCOUNTING_ENABLE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def JOB_STATS_ENABLE
+\brief
+Set to \ref On or 1 to collect per job statistics: time spent in each state, feed and rapid distance,
+blocks not reaching nominal speed, planner and step segment buffer fill histograms and override use.
+Statistics are reset on cycle start after the previous job ended and reported on M2 or M30 and by <i>$JOB</i>.
+*/
+#if !defined JOB_STATS_ENABLE || defined __DOXYGEN__
+#define JOB_STATS_ENABLE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def FLOW_CREDITS_ENABLE
+\brief
+Set to \ref On or 1 to add credit based flow control, enabled by senders with <i>$CRD=1</i>.
+In credit mode each ok response carries the number of free planner blocks and RX buffer bytes as
+<i>ok|Bf:<blocks>,<bytes></i> and unsolicited <i>[Bf:<blocks>,<bytes>]</i> updates are sent when free
+space has increased enough since last reported, allowing senders to keep the buffers full without polling.
+*/
+#if !defined FLOW_CREDITS_ENABLE || defined __DOXYGEN__
+#define FLOW_CREDITS_ENABLE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def IDLE_WAIT_ENABLE
+\brief
+Set to \ref On or 1 to let the main loop sleep via the driver provided \a hal.idle_wait handler instead of busy polling
+when there is no input, no pending realtime commands or foreground tasks and the step segment buffer is full
+or there is no motion pending. The sleep is limited to 10 ms and ends early when a periodic realtime hook is due.
+Plugins that need continuous polling can inhibit sleep with protocol_idle_inhibit().
+*/
+#if !defined IDLE_WAIT_ENABLE || defined __DOXYGEN__
+#define IDLE_WAIT_ENABLE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def SPINDLE_COMMAND_CACHE
+\brief
+Set to \ref On or 1 to suppress redundant spindle commands. The last state and RPM sent to each spindle is
+recorded and commands that do not change the state or changes the RPM by less than a per spindle type
+deadband are not sent. Mainly useful for VFD spindles where each command is a bus transaction,
+e.g. when S words are repeated on every line or for CSS updates below the VFD resolution.
+*/
+#if !defined SPINDLE_COMMAND_CACHE || defined __DOXYGEN__
+#define SPINDLE_COMMAND_CACHE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def PROBE_SCAN_LOG_SIZE
+\brief
+Set to a power of 2 to enable continuous digitising probe mode, the value is the number of samples held by the log.
+When started with <i>$SCAN=<rate></i> the probe state, an optional analog probe value and the machine position are
+sampled at the given rate in interrupt context while motion is executing. Samples are streamed out with <i>$SCAN</i>
+or appended to a file with <i>$SCANW=<file></i>. Requires a driver timer calling probe_scan_sample() or the
+\a hal.get_micros handler, the rate is limited by the step rate in the latter case.
+*/
+#if !defined PROBE_SCAN_LOG_SIZE || defined __DOXYGEN__
+#define PROBE_SCAN_LOG_SIZE 0 // Default disabled. Set to e.g. 1024 to enable.
+#endif
+
+/*! \def HEIGHTMAP_ENABLE
+\brief
+Enable grid probing and Z-height compensation. The `$HMP=X0,Y0,X1,Y1,NX,NY,Zclear,depth,feed` command probes a grid
+of points and `$HM=ON` enables bilinear interpolated Z compensation of all feed and rapid motions.
+Jog and system motions are not compensated. Cartesian machines only.
+*/
+#if !defined HEIGHTMAP_ENABLE || defined __DOXYGEN__
+#define HEIGHTMAP_ENABLE Off
+#endif
+
+/*! \def CONTINUOUS_JOG_ENABLE
+\brief
+Enable continuous jogging for pendants and joysticks. `$JV=X<x>Y<y>...F<rate>` starts a jog in the direction of the
+vector given by the axis words that continues until the soft limits are reached or it is cancelled.
+Subsequent commands with the same direction change the rate of the motion being executed, respecting acceleration,
+without adding planner blocks. A new direction stops the current jog before starting a new one, F0 stops it.
+*/
+#if !defined CONTINUOUS_JOG_ENABLE || defined __DOXYGEN__
+#define CONTINUOUS_JOG_ENABLE Off
+#endif
+
+/*! \def PROBE_REPROBE_FEED_DIVISOR
+\brief
+Two-stage probing is performed when a G38.x block contains a R word: the probe moves toward the target at the
+programmed feed rate, backs off by R on contact and reprobes at the feed rate given by the Q word.
+When the Q word is omitted the reprobe feed rate is the programmed feed rate divided by this value.
+*/
+#if !defined PROBE_REPROBE_FEED_DIVISOR || defined __DOXYGEN__
+#define PROBE_REPROBE_FEED_DIVISOR 10.0f
+#endif
+
+/*! \def HOMING_POSITION_LATCH
+\brief
+Set to \ref On or 1 to let the stepper interrupt latch the position and lock out the axis as soon as
+its home switch triggers during the seek and locate phases of homing, instead of when the foreground process
+notices the switch change. This removes the feed rate dependent overshoot so that locate passes may run faster,
+the latched position is available in \a sys.homing_latch.
+<br>__NOTE:__ Adds a home switch read to every step interrupt while homing. Auto squared axes and axes
+driven by more than one motor via kinematics are handled by the foreground process as before.
+*/
+#if !defined HOMING_POSITION_LATCH || defined __DOXYGEN__
+#define HOMING_POSITION_LATCH Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def JOB_RESUME_ENABLE
+\brief
+Set to \ref On or 1 to enable checkpointing of jobs streamed from a file.
+Every 20 blocks the file offset of the next block, the modal state, feed rate, spindle speed and position is recorded.
+The newest checkpoint for which all motion has been executed is written to `/job.rsm` at most every 5 seconds,
+the file is removed on program end. A resume command can load it with job_resume_load() and call job_resume_restore()
+to restore modal state and seek the job file before streaming is restarted. `$RSM` outputs the saved checkpoint.
+__NOTE:__ No checkpoints are recorded while a loop, conditional or subroutine call is executing.
+*/
+#if !defined JOB_RESUME_ENABLE || defined __DOXYGEN__
+#define JOB_RESUME_ENABLE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def PROFILING_ENABLE
+\brief
+Set to \ref On or 1 to enable execution time profiling of the main hot path functions: protocol_execute_realtime(),
+st_prep_buffer(), plan_buffer_line(), planner_recalculate(), gc_execute_block(), report_realtime_status() and
+the stepper interrupt handler. Call count and min/avg/max execution times are reported by the `$PROF` command,
+`$PROF=RESET` clears the data.
+Latencies of the feed hold, reset, stop, cycle start, safety door, jog cancel and status report realtime commands
+are tracked from receipt of the character to the flag being set in sys.rt_exec_state, the flag being read by
+protocol_exec_rt_system() and the command being handled, for feed hold this is when deceleration starts.
+Min/max values are reported by the `$LAT` command, `$LAT=RESET` clears them.
+Times are in microseconds unless the driver defines `PROFILE_TIMESTAMP()` to read a cycle counter,
+e.g. DWT->CYCCNT on Cortex-M. Requires the driver to provide hal.get_micros() if not defined.
+*/
+#if !defined PROFILING_ENABLE || defined __DOXYGEN__
+#define PROFILING_ENABLE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def SEGMENT_BUFFER_PREFILL_LEVEL
+\brief
+When > 0 the step segment buffer is also refilled from the \ref grbl.on_execute_realtime event chain whenever
+the number of segments in it drops below this level. This event is raised from more places than the
+normal refill points, e.g. while output is blocking, and helps to avoid starvation during long running
+foreground tasks. Must be less than \ref SEGMENT_BUFFER_SIZE.
+*/
+#if !defined SEGMENT_BUFFER_PREFILL_LEVEL || defined __DOXYGEN__
+#define SEGMENT_BUFFER_PREFILL_LEVEL 0 // Default disabled. Set to > 0 to enable.
+#endif
+
+/*! \def STEP_TIMELINE_ENABLE
+\brief
+Set to \ref On or 1 to add support for drivers that output step and direction signals by DMA from a timeline buffer
+instead of from the stepper interrupt. The driver calls st_timeline_init() with the output rate and st_timeline_render()
+from its DMA transfer interrupt, the stepper interrupt handler is then run from the renderer once per part of the buffer
+filled. Allows higher step rates on MCUs with GPIO capable DMA. Since the interrupt handler runs ahead of the output
+by up to one buffer length probe and homing switch positions are latched with that much uncertainty.
+<br>__NOTE:__ Requires driver support.
+*/
+#if !defined STEP_TIMELINE_ENABLE || defined __DOXYGEN__
+#define STEP_TIMELINE_ENABLE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def PLANNER_RECALC_MAX_BLOCKS
+\brief
+Limits the number of blocks the planner reverse pass visits each time a new block is added.
+With a large planner buffer (\ref DEFAULT_PLANNER_BUFFER_BLOCKS) filled with short segments that never reach
+nominal speed the full reverse pass may take a long time and stall the main loop. When set > 0
+the reverse pass is stopped after this many blocks and the blocks behind it are frozen as planned,
+bounding the time spent in plan_buffer_line() at the cost of a slightly conservative plan.
+Use the `$PLS` command to check the worst case recalculation time.
+<br>__NOTE:__ Should not be set lower than the number of blocks needed to decelerate from full speed to a stop.
+*/
+#if !defined PLANNER_RECALC_MAX_BLOCKS || defined __DOXYGEN__
+#define PLANNER_RECALC_MAX_BLOCKS 0 // Default disabled. Set to > 0 to enable.
+#endif
+
+/*! \def PLANNER_DIRECTION_CACHE_SIZE
+\brief
+Number of entries in the planner direction and junction caches, must be a power of 2.
+Toolpaths such as adaptive clearing repeat the same few move directions many times, the caches
+keep the axis-limited acceleration and rate for recently seen unit vectors and the maximum junction
+speed for recently seen unit vector pairs. This saves a number of float divisions per block, useful
+for MCUs without a FPU. Hit and miss counters are reported by the `$PLS` command.
+Set to 0 to disable.
+*/
+#if !defined PLANNER_DIRECTION_CACHE_SIZE || defined __DOXYGEN__
+#define PLANNER_DIRECTION_CACHE_SIZE 0 // Default disabled. Set to 8, 16, 32 or 64 to enable.
+#endif
+
+/*! \def PLANNER_SEGMENT_MERGE_ENABLE
+\brief
+Merges runs of short, nearly colinear line segments, typically output by CAM software for 3D surfaces,
+into a single planner block. A segment is merged into the last block in the buffer when the end points of
+all segments merged stay within PLANNER_MERGE_TOLERANCE (default 0.002 mm) of the resulting line and
+the feed rate, spindle, coolant and line number are the same. Segments with messages or output commands
+are never merged. This increases the look-ahead distance for a given planner buffer size.
+The number of merged segments is reported by the `$PLS` command.
+<br>__NOTE:__ Not available for machines with non-cartesian kinematics.
+*/
+#if !defined PLANNER_SEGMENT_MERGE_ENABLE || defined __DOXYGEN__
+#define PLANNER_SEGMENT_MERGE_ENABLE Off
+#endif
+
+/*! \def PLANNER_DWELL_ENABLE
+\brief
+Buffers G4 dwells in the planner instead of waiting for the buffer to empty before the dwell is started.
+The stepper module executes the dwell as a timed stop, the parser continues to fill the buffer meanwhile
+so motion resumes immediately when the dwell is completed. Feed holds are delayed until the end of the dwell.
+Useful for drilling jobs with many short dwells.
+*/
+#if !defined PLANNER_DWELL_ENABLE || defined __DOXYGEN__
+#define PLANNER_DWELL_ENABLE Off
+#endif
+
+/*! \def THREADING_PIPELINE_ENABLE
+\brief
+Executes G76 threading passes without waiting for the planner buffer to empty before each cut.
+The cut is preceded by a planner block that holds motion in the stepper module until the spindle
+passes the index and the start angle, the retract, return and infeed of the next pass are buffered meanwhile.
+Adds the G76 D word for the number of starts, each start is cut at an index offset of 1/D revolution
+with the P word as the lead. An alarm is raised if the index is not seen within 5 seconds.
+<br>__NOTE:__ Requires \ref PLANNER_DWELL_ENABLE and a spindle encoder with index pulse.
+*/
+#if !defined THREADING_PIPELINE_ENABLE || defined __DOXYGEN__
+#define THREADING_PIPELINE_ENABLE Off
+#endif
+
+/*! \def SYNCED_STATE_CHANGES_ENABLE
+\brief
+Performs coolant changes (M7, M8 and M9) and spindle stop (M5) when the preceding motion is completed
+by the stepper module instead of waiting for the planner buffer to empty. Motion continues without
+the deceleration to a stop otherwise required. Spindle start and speed changes are still synchronized
+since the spindle needs time to spin up. A change is synchronized as before when less than two
+motions are buffered.
+*/
+#if !defined SYNCED_STATE_CHANGES_ENABLE || defined __DOXYGEN__
+#define SYNCED_STATE_CHANGES_ENABLE Off
+#endif
+
+/*! \def GC_OUTPUT_COMMAND_POOL_SIZE
+\brief
+Number of preallocated slots for motion synchronized output commands (M62-M65, M67) attached to planner blocks.
+When > 0 the commands are claimed from a fixed size pool instead of being allocated from the heap,
+avoiding heap fragmentation when running programs with many synchronized output commands.
+The heap is still used if the pool is exhausted. Pool usage is reported by the `$GCPOOL` command.
+Set to 0 to disable.
+*/
+#if !defined GC_OUTPUT_COMMAND_POOL_SIZE || defined __DOXYGEN__
+#define GC_OUTPUT_COMMAND_POOL_SIZE 0 // Default disabled. Set to > 0 to enable.
+#endif
+
+/*! \def GC_MESSAGE_POOL_SIZE
+\brief
+Number of preallocated slots for `(MSG,...)` and `(DEBUG,...)` messages attached to planner blocks,
+each of \ref GC_MESSAGE_POOL_LENGTH bytes. Longer messages and messages arriving when the pool is exhausted
+are allocated from the heap. Pool usage is reported by the `$GCPOOL` command.
+Set to 0 to disable.
+*/
+#if !defined GC_MESSAGE_POOL_SIZE || defined __DOXYGEN__
+#define GC_MESSAGE_POOL_SIZE 0 // Default disabled. Set to > 0 to enable.
+#endif
+
+/*! \def GC_MESSAGE_POOL_LENGTH
+\brief
+Size in bytes of each message pool slot, including the terminating null character.
+*/
+#if !defined GC_MESSAGE_POOL_LENGTH || defined __DOXYGEN__
+#define GC_MESSAGE_POOL_LENGTH 64
+#endif
+
+/*! \def MOTION_FRAMES_ENABLE
+\brief
+Set to \ref On or 1 to enable compact motion frames, pre-parsed linear motions that bypass the g-code parser.
+Acceptance of frames is toggled by the #CMD_MOTION_FRAMES_TOGGLE real-time command, ordinary lines are
+still accepted interleaved. A frame is a line starting with a colon followed by hexadecimal encoded data,
+see gc_execute_motion_frame() for details. Current state is reported by the \a |MF: element in
+the complete real-time report.
+*/
+#if !defined MOTION_FRAMES_ENABLE || defined __DOXYGEN__
+#define MOTION_FRAMES_ENABLE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
+/*! \def SETTINGS_LOOKUP_INDEX
+\brief
+Set to \ref On or 1 to maintain an index of all settings sorted by id, used for binary search lookup and
+for sorted outputs such as `$$` and `$ES`. The index is allocated from the heap and is rebuilt on
+first use after a settings structure is registered, it takes 8 bytes per setting on 32-bit processors.
+*/
+#if !defined SETTINGS_LOOKUP_INDEX || defined __DOXYGEN__
+#define SETTINGS_LOOKUP_INDEX Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
 /*! \def SET_CHECK_MODE_PROBE_TO_START
 \brief
 Configures the position after a probing cycle during grblHAL's check mode. Disabled sets
@@ -494,6 +1089,18 @@ non-volatile storage until the controller is in IDLE state.
 #define NVSDATA_BUFFER_ENABLE On // Default on, set to \ref off or 0 to disable.
 #endif
 
+/*! \def NVS_JOURNAL_ENABLE
+\brief Enable wear-levelled journaled storage of the NVS buffer for flash based storage.
+When the driver provides the \a hal.nvs.journal handlers changes are appended as small checksummed records
+to the active flash sector instead of rewriting the whole image. When a sector is full the image is compacted
+into the next sector, sectors are used in rotation. The next sector is erased, and nearly full sectors compacted,
+in the background when the controller is idle.
+<br>__NOTE:__ Only used when \ref NVSDATA_BUFFER_ENABLE is enabled. Sectors must be large enough to hold the full image.
+*/
+#if !defined NVS_JOURNAL_ENABLE || defined __DOXYGEN__
+#define NVS_JOURNAL_ENABLE Off // Default disabled. Set to \ref On or 1 to enable.
+#endif
+
 /*! \def TOOLSETTER_RADIUS
 \brief
 The grbl.on_probe_fixture event handler is called by the default tool change algorithm when probing at G59.3.
@@ -511,6 +1118,44 @@ by a driver or a plugin.
 #define ENABLE_BACKLASH_COMPENSATION Off
 #endif
 
+/*! \def DEFAULT_BACKLASH_TAKEUP
+\brief
+Default value for the `$652` backlash take-up distance setting, in mm.
+When set to 0 backlash is compensated by separate rapid motions inserted on direction reversals.
+When set to a distance the take-up steps are instead added to the step events of the motions following a reversal,
+spread over at least this distance. No planner blocks are used and the velocity profile is kept.
+<br>__NOTE:__ Only used when \ref ENABLE_BACKLASH_COMPENSATION is enabled. Parking motions are not compensated in this mode.
+*/
+#if !defined DEFAULT_BACKLASH_TAKEUP || defined __DOXYGEN__
+#define DEFAULT_BACKLASH_TAKEUP 0.0f // mm
+#endif
+
+/*! \def ENABLE_JERK_ACCELERATION
+\brief
+Enable jerk limited (S-curve) acceleration and deceleration ramps in the step segment generator,
+adds the `$29x` per axis jerk settings.
+Ramps are planned with the trapezoidal profile of the planner so block distances and junction speeds are unchanged,
+the generator then ramps the acceleration up and down at the jerk limit within the planned ramp time.
+The axis acceleration settings are the average acceleration of a ramp, peak acceleration is up to twice that.
+Speed changes too small to reach the jerk limit within the ramp time are ramped with a triangular acceleration profile.
+*/
+#if !defined ENABLE_JERK_ACCELERATION || defined __DOXYGEN__
+#define ENABLE_JERK_ACCELERATION Off
+#endif
+
+/*! \def ENABLE_INPUT_SHAPING
+\brief
+Enable input shaping of acceleration and deceleration ramps in the step segment generator, adds the `$651` shaper type
+setting and the `$27x` and `$28x` per axis shaper frequency and damping ratio settings.
+The acceleration of each ramp is convolved with the ZV, ZVD or MZV impulse sequence of the axis with the largest motion
+component of the block, the ramp is stretched so that the distance covered is the same as planned.
+Ramps too short to be shaped and corners are not shaped. Since the segment velocity is constant over a segment
+\ref ACCELERATION_TICKS_PER_SECOND should be set high enough for several segments per shaper period.
+*/
+#if !defined ENABLE_INPUT_SHAPING || defined __DOXYGEN__
+#define ENABLE_INPUT_SHAPING Off
+#endif
+
 #if COMPATIBILITY_LEVEL == 0 || defined __DOXYGEN__
 /*! \def N_TOOLS
 \brief
@@ -521,6 +1166,26 @@ Number of tools in tool table, edit to enable (max. 32 allowed)
 #endif
 #endif
 
+/*! \def TOOL_TABLE_ENABLE
+\brief
+Set to \ref On or 1 to enable the sparse tool table, an alternative to \ref N_TOOLS for large tool libraries.
+Only tools that are referenced or defined are kept in RAM, they are indexed by tool number via hash buckets.
+Tools defined by `G10L1` are stored in a file on the virtual file system, the file is loaded on first access
+after the file system is mounted. There is no fixed slot per tool in non-volatile storage.
+<br>__NOTE:__ Cannot be combined with \ref N_TOOLS, requires a file system for the tool table to be persistent.
+*/
+#if !defined TOOL_TABLE_ENABLE || defined __DOXYGEN__
+#define TOOL_TABLE_ENABLE Off
+#endif
+
+/*! \def TOOL_TABLE_MAX_TOOL_NUMBER
+\brief
+Highest tool number accepted by the sparse tool table.
+*/
+#if !defined TOOL_TABLE_MAX_TOOL_NUMBER || defined __DOXYGEN__
+#define TOOL_TABLE_MAX_TOOL_NUMBER 9999
+#endif
+
 /*! \def NGC_EXPRESSIONS_ENABLE
 \brief
 Set to \ref On or 1 to enable experimental support for parameters and expressions.
@@ -550,6 +1215,16 @@ Allow use of UVW axis words for non-modal relative lathe motion.
 // Max number of entries in log for PID data reporting, to be used for tuning
 //#define PID_LOG 1000 // Default disabled. Uncomment to enable.
 
+/*! \def SPINDLE_SYNC_LOG_SIZE
+\brief
+Number of entries in the spindle sync control loop log ring buffer, must be a power of 2.
+Samples of position error and PID output are logged by spindle_sync_update() and can be streamed out
+with the `$SSL` command while a spindle synchronized motion is executing, to be used for tuning.
+*/
+#if !defined SPINDLE_SYNC_LOG_SIZE || defined __DOXYGEN__
+#define SPINDLE_SYNC_LOG_SIZE 0 // Default disabled. Set to e.g. 1024 to enable.
+#endif
+
 // End compile time only default configuration
 
 // ---------------------------------------------------------------------------------------
@@ -1852,6 +2527,52 @@ Timezone offset from UTC in hours, allowed range is -12.0 - 12.0.
 #endif
 ///@}
 
+/*! @name 29x - Setting_AxisJerk
+__NOTE:__ Only used when \ref ENABLE_JERK_ACCELERATION is enabled.
+*/
+///@{
+#if !defined DEFAULT_X_JERK || defined __DOXYGEN__
+#define DEFAULT_X_JERK 100.0f // mm/sec^3
+#endif
+#if !defined DEFAULT_Y_JERK || defined __DOXYGEN__
+#define DEFAULT_Y_JERK 100.0f // mm/sec^3
+#endif
+#if !defined DEFAULT_Z_JERK || defined __DOXYGEN__
+#define DEFAULT_Z_JERK 100.0f // mm/sec^3
+#endif
+#if (defined A_AXIS && !defined DEFAULT_A_JERK) || defined __DOXYGEN__
+#define DEFAULT_A_JERK 100.0f // mm/sec^3
+#endif
+#if (defined B_AXIS && !defined DEFAULT_B_JERK) || defined __DOXYGEN__
+#define DEFAULT_B_JERK 100.0f // mm/sec^3
+#endif
+#if (defined C_AXIS && !defined DEFAULT_C_JERK) || defined __DOXYGEN__
+#define DEFAULT_C_JERK 100.0f // mm/sec^3
+#endif
+#if (defined U_AXIS && !defined DEFAULT_U_JERK) || defined __DOXYGEN__
+#define DEFAULT_U_JERK 100.0f // mm/sec^3
+#endif
+#if (defined V_AXIS && !defined DEFAULT_V_JERK) || defined __DOXYGEN__
+#define DEFAULT_V_JERK 100.0f // mm/sec^3
+#endif
+///@}
+
+/*! @name 27x, 28x and 651 - Setting_AxisShaperFrequency, Setting_AxisShaperDamping and Setting_InputShaper
+__NOTE:__ Only used when \ref ENABLE_INPUT_SHAPING is enabled. Default values are used for all axes,
+a frequency of 0 disables shaping for the axis. Shaper types: 0 - off, 1 - ZV, 2 - ZVD, 3 - MZV.
+*/
+///@{
+#if !defined DEFAULT_SHAPER_FREQUENCY || defined __DOXYGEN__
+#define DEFAULT_SHAPER_FREQUENCY 0.0f // Hz
+#endif
+#if !defined DEFAULT_SHAPER_DAMPING || defined __DOXYGEN__
+#define DEFAULT_SHAPER_DAMPING 0.1f
+#endif
+#if !defined DEFAULT_INPUT_SHAPER || defined __DOXYGEN__
+#define DEFAULT_INPUT_SHAPER 0
+#endif
+///@}
+
 /*! @name 13x - Setting_AxisMaxTravel
 __NOTE:__ Must be a positive values.
 */
@@ -1924,6 +2645,14 @@ __NOTE:__ Must be a positive values.
 #define N_TOOLS 32
 #endif
 
+#if defined(N_TOOLS) && TOOL_TABLE_ENABLE
+#error "N_TOOLS and TOOL_TABLE_ENABLE cannot be combined!"
+#endif
+
+#if THREADING_PIPELINE_ENABLE && !PLANNER_DWELL_ENABLE
+#error "THREADING_PIPELINE_ENABLE requires PLANNER_DWELL_ENABLE!"
+#endif
+
 #if N_SYS_SPINDLE > N_SPINDLE
 #undef N_SYS_SPINDLE
 #define N_SYS_SPINDLE N_SPINDLE
@@ -27,6 +27,7 @@
 #include "protocol.h"
 #include "coolant_control.h"
 #include "state_machine.h"
+#include "program_cache.h"
 
 // Main program only. Immediately sets flood coolant running state and also mist coolant,
 // if enabled. Also sets a flag to report an update to a coolant state.
@@ -49,6 +50,10 @@ bool coolant_sync (coolant_state_t mode)
         if((ok = protocol_buffer_synchronize())) // Ensure coolant changes state when specified in program.
             coolant_set_state(mode);
     }
+#if PROGRAM_CACHE_ENABLE
+    else
+        program_cache_coolant(mode);
+#endif
 
     return ok;
 }
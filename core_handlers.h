@@ -109,6 +109,7 @@ typedef bool (*on_probe_start_ptr)(axes_signals_t axes, float *target, plan_line
 typedef void (*on_probe_completed_ptr)(void);
 typedef void (*on_tool_selected_ptr)(tool_data_t *tool);
 typedef void (*on_tool_changed_ptr)(tool_data_t *tool);
+typedef void (*on_tool_preselect_ptr)(tool_data_t *tool);
 typedef void (*on_toolchange_ack_ptr)(void);
 typedef void (*on_reset_ptr)(void);
 typedef void (*on_jog_cancel_ptr)(sys_state_t state);
@@ -127,13 +128,15 @@ typedef void (*on_macro_return_ptr)(void);
 typedef bool (*write_tool_data_ptr)(tool_data_t *tool_data);
 typedef bool (*read_tool_data_ptr)(tool_id_t tool_id, tool_data_t *tool_data);
 typedef bool (*clear_tool_data_ptr)(void);
+typedef tool_data_t *(*get_tool_data_ptr)(tool_id_t tool_id, bool add);
 
 typedef struct {
     uint32_t n_tools;
-    tool_data_t *tool;          //!< Array of tool data, size _must_ be n_tools + 1
+    tool_data_t *tool;          //!< Array of tool data, size _must_ be n_tools + 1 unless get() is provided, then only the first entry is used.
     read_tool_data_ptr read;
     write_tool_data_ptr write;
     clear_tool_data_ptr clear;
+    get_tool_data_ptr get;      //!< Optional, returns pointer to data for a tool, for sparse tool tables. If add is false NULL is returned for tools not in the table.
 } tool_table_t;
 
 typedef struct {
@@ -177,6 +180,7 @@ typedef struct {
     on_gcode_message_ptr on_gcode_comment;              //!< Called when a plain gcode comment has been parsed.
     on_tool_selected_ptr on_tool_selected;              //!< Called prior to executing M6 or after executing M61.
     on_tool_changed_ptr on_tool_changed;                //!< Called after executing M6 or M61.
+    on_tool_preselect_ptr on_tool_preselect;            //!< Called from the foreground when a T word for the next tool change has been parsed, before preceding motions are completed.
     on_toolchange_ack_ptr on_toolchange_ack;            //!< Called from interrupt context.
     on_jog_cancel_ptr on_jog_cancel;                    //!< Called from interrupt context.
     on_laser_ppi_enable_ptr on_laser_ppi_enable;
@@ -118,6 +118,8 @@ void errors_register (error_details_t *details)
 {
     errors->next = details;
     errors = details;
+
+    report_settings_schema_invalidate();
 }
 
 error_details_t *errors_get_details (void)
@@ -93,6 +93,7 @@ typedef enum {
     Status_SDFailedOpenDir = 62,
     Status_SDDirNotFound = 63,
     Status_SDFileEmpty = 64,
+    Status_SDWriteError = 65,
 
     Status_BTInitError = 70,
 
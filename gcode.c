@@ -27,8 +27,12 @@
 
 #include "hal.h"
 #include "motion_control.h"
+#include "mem_stats.h"
 #include "protocol.h"
 #include "state_machine.h"
+#include "profile.h"
+#include "job_resume.h"
+#include "program_cache.h"
 
 #if NGC_EXPRESSIONS_ENABLE
 #include "ngc_expr.h"
@@ -111,6 +115,21 @@ parser_state_t gc_state, *saved_state = NULL;
 
 static gc_thread_data thread;
 static output_command_t *output_commands = NULL; // Linked list
+static bool tool_preselect_pending = false;
+#if GC_OUTPUT_COMMAND_POOL_SIZE
+static output_command_t output_command_pool[GC_OUTPUT_COMMAND_POOL_SIZE];
+static volatile bool output_command_used[GC_OUTPUT_COMMAND_POOL_SIZE];
+#endif
+#if GC_MESSAGE_POOL_SIZE
+static char message_pool[GC_MESSAGE_POOL_SIZE][GC_MESSAGE_POOL_LENGTH];
+static volatile bool message_used[GC_MESSAGE_POOL_SIZE];
+#endif
+#if GC_OUTPUT_COMMAND_POOL_SIZE || GC_MESSAGE_POOL_SIZE
+static gc_pool_stats_t pool_stats = {
+    .output_commands = GC_OUTPUT_COMMAND_POOL_SIZE,
+    .messages = GC_MESSAGE_POOL_SIZE
+};
+#endif
 static scale_factor_t scale_factor = {
     .ijk[X_AXIS] = 1.0f,
     .ijk[Y_AXIS] = 1.0f,
@@ -283,11 +302,9 @@ void gc_init (void)
 #endif
 
     // Clear any pending output commands
-    while(output_commands) {
-        output_command_t *next = output_commands->next;
-        free(output_commands);
-        output_commands = next;
-    }
+    gc_output_commands_free(output_commands);
+    output_commands = NULL;
+    tool_preselect_pending = false; // Foreground task queue is cleared on reset.
 
     // Load default override status
     gc_state.modal.override_ctrl = sys.override.control;
@@ -295,6 +312,8 @@ void gc_init (void)
 
     set_scaling(1.0f);
 
+    settings_load_coord_data();
+
     // Load default G54 coordinate system.
     if (!settings_read_coord_data(gc_state.modal.coord_system.id, &gc_state.modal.coord_system.xyz))
         grbl.report.status_message(Status_SettingReadFail);
@@ -325,7 +344,15 @@ bool gc_laser_ppi_enable (uint_fast16_t ppi, uint_fast16_t pulse_length)
 {
     gc_state.is_laser_ppi_mode = ppi > 0 && pulse_length > 0;
 
-    return grbl.on_laser_ppi_enable && grbl.on_laser_ppi_enable(ppi, pulse_length);
+    if(grbl.on_laser_ppi_enable && grbl.on_laser_ppi_enable(ppi, pulse_length))
+        return true;
+
+#if LASER_PPI_STEPPER_ENABLE
+    // Pulses are fired by the stepper ISR at step positions along the path.
+    return st_laser_ppi_enable(gc_state.is_laser_ppi_mode ? ppi : 0, pulse_length);
+#else
+    return false;
+#endif
 }
 
 void gc_spindle_off (void)
@@ -349,12 +376,23 @@ spindle_ptrs_t *gc_spindle_get (void)
     return gc_state.spindle.hal;
 }
 
+// Returns pointer to tool table entry, tools not in a sparse tool table are added on first reference.
+static tool_data_t *tool_get (tool_id_t tool_id)
+{
+    tool_data_t *tool;
+
+    if(grbl.tool_table.get)
+        return tool_id && (tool = grbl.tool_table.get(tool_id, true)) ? tool : &grbl.tool_table.tool[0];
+
+    return &grbl.tool_table.tool[tool_id];
+}
+
 static tool_data_t *tool_get_pending (tool_id_t tool_id)
 {
     static tool_data_t tool_data = {0};
 
     if(grbl.tool_table.n_tools)
-        return &grbl.tool_table.tool[tool_id];
+        return tool_get(tool_id);
 
     memcpy(&tool_data, gc_state.tool, sizeof(tool_data_t));
     tool_data.tool_id = tool_id;
@@ -362,6 +400,15 @@ static tool_data_t *tool_get_pending (tool_id_t tool_id)
     return &tool_data;
 }
 
+// Notify the tool changer of the tool for the next M6 so that it may be staged while motion is ongoing.
+static void tool_preselect (void *data)
+{
+    tool_preselect_pending = false;
+
+    if(grbl.on_tool_preselect && gc_state.tool_pending != gc_state.tool->tool_id)
+        grbl.on_tool_preselect(tool_get_pending(gc_state.tool_pending));
+}
+
 static inline void tool_set (tool_data_t *tool)
 {
     if(grbl.tool_table.n_tools)
@@ -370,12 +417,122 @@ static inline void tool_set (tool_data_t *tool)
         gc_state.tool->tool_id = tool->tool_id;
 }
 
+#if GC_OUTPUT_COMMAND_POOL_SIZE || GC_MESSAGE_POOL_SIZE
+
+// Claim a free pool slot, returns -1 if none available.
+// NOTE: slots are only claimed by the foreground process, they may be released from interrupt context.
+static int_fast16_t pool_claim (volatile bool *used, uint_fast16_t size, uint16_t *max_used)
+{
+    int_fast16_t idx = -1;
+    uint_fast16_t n_used = 1;
+
+    do {
+        if(used[--size])
+            n_used++;
+        else if(idx < 0)
+            idx = size;
+    } while(size);
+
+    if(idx >= 0) {
+        used[idx] = true;
+        if(n_used > *max_used)
+            *max_used = n_used;
+    }
+
+    return idx;
+}
+
+static uint16_t pool_count (volatile bool *used, uint_fast16_t size)
+{
+    uint16_t n_used = 0;
+
+    do {
+        if(used[--size])
+            n_used++;
+    } while(size);
+
+    return n_used;
+}
+
+gc_pool_stats_t *gc_pool_get_stats (void)
+{
+#if GC_OUTPUT_COMMAND_POOL_SIZE
+    pool_stats.output_commands_used = pool_count(output_command_used, GC_OUTPUT_COMMAND_POOL_SIZE);
+#endif
+#if GC_MESSAGE_POOL_SIZE
+    pool_stats.messages_used = pool_count(message_used, GC_MESSAGE_POOL_SIZE);
+#endif
+
+    return &pool_stats;
+}
+
+#endif // GC_OUTPUT_COMMAND_POOL_SIZE || GC_MESSAGE_POOL_SIZE
+
+static output_command_t *output_command_alloc (void)
+{
+#if GC_OUTPUT_COMMAND_POOL_SIZE
+    int_fast16_t idx;
+
+    if((idx = pool_claim(output_command_used, GC_OUTPUT_COMMAND_POOL_SIZE, &pool_stats.output_commands_max)) >= 0)
+        return &output_command_pool[idx];
+
+    pool_stats.heap_fallbacks++;
+#endif
+
+    return malloc(sizeof(output_command_t)); // Not accounted, commands may be allocated by plugins.
+}
+
+// Release a linked list of output commands
+void gc_output_commands_free (output_command_t *command)
+{
+    output_command_t *next;
+
+    while(command) {
+        next = command->next;
+#if GC_OUTPUT_COMMAND_POOL_SIZE
+        if(command >= output_command_pool && command < &output_command_pool[GC_OUTPUT_COMMAND_POOL_SIZE])
+            output_command_used[command - output_command_pool] = false;
+        else
+#endif
+        free(command);
+        command = next;
+    }
+}
+
+// Allocate memory for a message, size includes the terminating null character.
+char *gc_message_alloc (size_t size)
+{
+#if GC_MESSAGE_POOL_SIZE
+    int_fast16_t idx;
+
+    if(size <= GC_MESSAGE_POOL_LENGTH && (idx = pool_claim(message_used, GC_MESSAGE_POOL_SIZE, &pool_stats.messages_max)) >= 0)
+        return message_pool[idx];
+
+    pool_stats.heap_fallbacks++;
+#endif
+
+    return malloc(size); // Not accounted, messages may be allocated by plugins.
+}
+
+// Release message memory, may be called from interrupt context.
+void gc_message_free (char *message)
+{
+#if GC_MESSAGE_POOL_SIZE
+    if(message >= message_pool[0] && message < message_pool[GC_MESSAGE_POOL_SIZE]) {
+        message_used[(message - message_pool[0]) / GC_MESSAGE_POOL_LENGTH] = false;
+        return;
+    }
+#endif
+
+    free(message);
+}
+
 // Add output command to linked list
 static bool add_output_command (output_command_t *command)
 {
     output_command_t *add_cmd;
 
-    if((add_cmd = malloc(sizeof(output_command_t)))) {
+    if((add_cmd = output_command_alloc())) {
 
         memcpy(add_cmd, command, sizeof(output_command_t));
 
@@ -430,7 +587,7 @@ void gc_output_message (char *message)
         if(*message)
             report_message(message, Message_Plain);
 
-        free(message);
+        gc_message_free(message);
     }
 }
 
@@ -483,14 +640,71 @@ static status_code_t read_parameter (char *line, uint_fast8_t *char_counter, flo
 
 #endif // NGC_EXPRESSIONS_ENABLE
 
+#if LASER_RASTER_ENABLE
+
+static raster_data_t *raster = NULL;
+static bool raster_invalid = false;
+
+static inline int_fast8_t base64_value (char c)
+{
+    if(c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if(c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if(c >= '0' && c <= '9')
+        return c - '0' + 52;
+
+    return c == '+' ? 62 : (c == '/' ? 63 : -1);
+}
+
+// Decode base64 encoded raster data, each byte is the power level of a pixel.
+// Data is allocated dynamically and the pixel power levels are stored in the pwm array for conversion later.
+static void raster_decode (char *data)
+{
+    int_fast8_t value;
+    uint_fast8_t bits = 0;
+    uint32_t acc = 0;
+    size_t len;
+
+    while(*data == ' ')
+        data++;
+
+    len = strlen(data);
+
+    if(raster || len == 0 || !(raster = mem_alloc(MemTag_Parser, sizeof(raster_data_t) + (len * 3 / 4) * sizeof(uint_fast16_t)))) {
+        raster_invalid = true;
+        return;
+    }
+
+    raster->length = 0;
+
+    while(*data && *data != '=') {
+        if((value = base64_value(*data++)) < 0) {
+            raster_invalid = true;
+            break;
+        }
+        acc = (acc << 6) | value;
+        if((bits += 6) >= 8) {
+            bits -= 8;
+            raster->pwm[raster->length++] = (acc >> bits) & 0xFF;
+        }
+    }
+
+    if(raster->length == 0)
+        raster_invalid = true;
+}
+
+#endif // LASER_RASTER_ENABLE
+
 // Remove whitespace, control characters, comments and if block delete is active block delete lines
 // else the block delete character. Remaining characters are converted to upper case.
 // If the driver handles message comments then the first is extracted and returned in a dynamically
-// allocated memory block, the caller must free this after the message has been processed.
+// allocated memory block, the caller must release this with gc_message_free() after the message has been processed.
 
 char *gc_normalize_block (char *block, char **message)
 {
     char c, *s1, *s2, *comment = NULL;
+    size_t idx;
 
     // Remove leading whitespace & control characters
     while(*block && *block <= ' ')
@@ -506,115 +720,130 @@ char *gc_normalize_block (char *block, char **message)
 
     s1 = s2 = block;
 
-    while((c = *s1) != '\0') {
+    while((c = *s1++) != '\0') {
 
-        if(c > ' ') switch(c) {
+        // Strip whitespace and control characters, upper case and copy everything outside comments.
+        if(c <= ' ' || c == ')') // Unmatched right parenthesis is dropped
+            continue;
 
-            case ';':
-                if(!comment) {
-                    *s1 = '\0';
-                    continue;
-                }
-                break;
+        if(c == ';') // Semicolon comment, ignore the rest of the line
+            break;
+
+        if(c != '(') {
+            *s2++ = CAPS(c);
+            continue;
+        }
 
-            case '(':
-                // TODO: generate error if a left parenthesis is found inside a comment...
+        // Scan to end of comment, a left parenthesis inside a comment restarts it.
+        comment = s1 - 1;
+        while((c = *s1) && c != ')') {
+            if(c == '(')
                 comment = s1;
-                break;
+            s1++;
+        }
+
+        if(c == '\0') // Unterminated comment is ignored
+            break;
 
-            case ')':
-                if(comment && !gc_state.skip_blocks) {
-                    *s1 = '\0';
-                    if(!hal.driver_cap.no_gcode_message_handling) {
+        // Upper case comment keyword.
+        for(idx = 0; idx < 5 && comment + idx < s1; idx++)
+            comment[idx] = CAPS(comment[idx]);
+#if NGC_EXPRESSIONS_ENABLE
+        if(!strncmp(comment, "(DEBU", 5)) // (DEBUG,
+            for(; idx < 7 && comment + idx < s1; idx++)
+                comment[idx] = CAPS(comment[idx]);
+#endif
+#if LASER_RASTER_ENABLE
+        if(!strncmp(comment, "(RAST", 5)) // (RASTER,
+            for(; idx < 8 && comment + idx < s1; idx++)
+                comment[idx] = CAPS(comment[idx]);
+#endif
 
-                        size_t len = s1 - comment - 4;
+        if(!gc_state.skip_blocks) {
+            *s1 = '\0';
+            if(!hal.driver_cap.no_gcode_message_handling) {
 
-                        if(message && *message == NULL && !strncmp(comment, "(MSG,", 5) && (*message = malloc(len))) {
-                            comment += 5;
-                            // Trim leading spaces
-                            while(*comment == ' ') {
-                                comment++;
-                                len--;
-                            }
-                            memcpy(*message, comment, len);
-                        }
+                size_t len = s1 - comment - 4;
 
-#if NGC_EXPRESSIONS_ENABLE
-                        // Debug message string substitution
-                        if(message && *message == NULL && !strncmp(comment, "(DEBUG,", 7)) {
-
-                            if(settings.flags.ngc_debug_out) {
-
-                                float value;
-                                char *s3;
-                                uint_fast8_t char_counter = 0;
-
-                                len = 0;
-                                comment += 7;
-
-                                // Trim leading spaces
-                                while(*comment == ' ')
-                                    comment++;
-
-                                // Calculate length of substituted string
-                                while((c = comment[char_counter++])) {
-                                    if(c == '#') {
-                                        char_counter--;
-                                        if(read_parameter(comment, &char_counter, &value) == Status_OK)
-                                            len += strlen(ftoa(value, 6));
-                                        else
-                                            len += 3; // "N/A"
-                                    } else
-                                        len++;
-                                }
+                if(message && *message == NULL && !strncmp(comment, "(MSG,", 5) && (*message = gc_message_alloc(len))) {
+                    comment += 5;
+                    // Trim leading spaces
+                    while(*comment == ' ') {
+                        comment++;
+                        len--;
+                    }
+                    memcpy(*message, comment, len);
+                }
 
-                                // Perform substitution
-                                if((s3 = *message = malloc(len + 1))) {
+#if NGC_EXPRESSIONS_ENABLE
+                // Debug message string substitution
+                if(message && *message == NULL && !strncmp(comment, "(DEBUG,", 7)) {
+
+                    if(settings.flags.ngc_debug_out) {
+
+                        float value;
+                        char *s3;
+                        uint_fast8_t char_counter = 0;
+
+                        len = 0;
+                        comment += 7;
+
+                        // Trim leading spaces
+                        while(*comment == ' ')
+                            comment++;
+
+                        // Calculate length of substituted string
+                        while((c = comment[char_counter++])) {
+                            if(c == '#') {
+                                char_counter--;
+                                if(read_parameter(comment, &char_counter, &value) == Status_OK)
+                                    len += strlen(ftoa(value, 6));
+                                else
+                                    len += 3; // "N/A"
+                            } else
+                                len++;
+                        }
 
+                        // Perform substitution
+                        if((s3 = *message = gc_message_alloc(len + 1))) {
+
+                            *s3 = '\0';
+                            char_counter = 0;
+
+                            while((c = comment[char_counter++])) {
+                                if(c == '#') {
+                                    char_counter--;
+                                    if(read_parameter(comment, &char_counter, &value) == Status_OK)
+                                        strcat(s3, ftoa(value, 6));
+                                    else
+                                        strcat(s3, "N/A");
+                                    s3 = strchr(s3, '\0');
+                                } else {
+                                    *s3++ = c;
                                     *s3 = '\0';
-                                    char_counter = 0;
-
-                                    while((c = comment[char_counter++])) {
-                                        if(c == '#') {
-                                            char_counter--;
-                                            if(read_parameter(comment, &char_counter, &value) == Status_OK)
-                                                strcat(s3, ftoa(value, 6));
-                                            else
-                                                strcat(s3, "N/A");
-                                            s3 = strchr(s3, '\0');
-                                        } else {
-                                            *s3++ = c;
-                                            *s3 = '\0';
-                                        }
-                                    }
                                 }
                             }
-
-                            *comment = '\0'; // Do not generate grbl.on_gcode_comment event!
                         }
-#endif // NGC_EXPRESSIONS_ENABLE
                     }
 
-                    if(*comment && *message == NULL && grbl.on_gcode_comment)
-                        grbl.on_gcode_comment(comment);
+                    *comment = '\0'; // Do not generate grbl.on_gcode_comment event!
                 }
-                comment = NULL;
-                break;
+#endif // NGC_EXPRESSIONS_ENABLE
+            }
 
-            default:
-                if(comment == NULL)
-                    *s2++ = CAPS(c);
-                break;
+#if LASER_RASTER_ENABLE
+            if(message && !strncmp(comment, "(RASTER,", 8)) {
+                raster_decode(comment + 8);
+                *comment = '\0'; // Do not generate grbl.on_gcode_comment event!
+            }
+#endif
+
+            if(*comment && *message == NULL && grbl.on_gcode_comment)
+                grbl.on_gcode_comment(comment);
         }
 
-#if NGC_EXPRESSIONS_ENABLE
-        if(comment && s1 - comment < (strncmp(comment, "(DEBU,", 5) ? 5 : 7))
-            *s1 = CAPS(c);
-#else
-        if(comment && s1 - comment < 5)
-            *s1 = CAPS(c);
-#endif
         s1++;
+        comment = NULL;
     }
 
     *s2 = '\0';
@@ -622,11 +851,47 @@ char *gc_normalize_block (char *block, char **message)
     return block;
 }
 
+#if SYNCED_STATE_CHANGES_ENABLE
+
+// Adds state changes to be performed when the preceding motion is completed,
+// returns false if the change has to be synchronized or in check mode.
+static bool add_state_change (plan_state_change_t change)
+{
+    if(state_get() == STATE_CHECK_MODE)
+        return false;
+
+#if ENABLE_PATH_BLENDING
+    if(!mc_blend_flush()) // Queue the end of a held back motion.
+        return false;
+#endif
+
+    return plan_add_state_change(&change);
+}
+
+#endif
+
 // Parses and executes one block (line) of 0-terminated G-Code.
 // In this function, all units and positions are converted and exported to internal functions
 // in terms of (mm, mm/min) and absolute machine coordinates, respectively.
 
+#if PROFILING_ENABLE
+
+static status_code_t execute_block (char *block);
+
 status_code_t gc_execute_block (char *block)
+{
+    uint32_t t = profile_start();
+    status_code_t status = execute_block(block);
+
+    profile_end(Profile_GcExecuteBlock, t);
+
+    return status;
+}
+
+static status_code_t execute_block (char *block)
+#else
+status_code_t gc_execute_block (char *block)
+#endif
 {
     static const parameter_words_t axis_words_mask = {
         .x = On,
@@ -683,6 +948,70 @@ status_code_t gc_execute_block (char *block)
 
     static parser_block_t gc_block;
 
+    // Plain value words indexed by letter - 'A', words needing additional validation are handled by the parameter letter switch.
+    static const struct {
+        parameter_words_t word; // Word bit
+        uint8_t axis;           // Axis word bit
+        uint8_t ijk;            // Arc offset word bit
+        float *value;           // Value storage, NULL if not a plain value word
+    } value_words['Z' - 'A' + 1] = {
+#ifdef A_AXIS
+  #if !AXIS_REMAP_ABC2UVW
+        ['A' - 'A'] = { .word = { .a = On }, .axis = bit(A_AXIS), .value = &gc_block.values.xyz[A_AXIS] },
+  #else
+        ['U' - 'A'] = { .word = { .a = On }, .axis = bit(A_AXIS), .value = &gc_block.values.xyz[A_AXIS] },
+  #endif
+#else
+        ['A' - 'A'] = { .word = { .a = On }, .value = &gc_block.values.a },
+#endif
+#ifdef B_AXIS
+  #if !AXIS_REMAP_ABC2UVW
+        ['B' - 'A'] = { .word = { .b = On }, .axis = bit(B_AXIS), .value = &gc_block.values.xyz[B_AXIS] },
+  #else
+        ['V' - 'A'] = { .word = { .b = On }, .axis = bit(B_AXIS), .value = &gc_block.values.xyz[B_AXIS] },
+  #endif
+#else
+        ['B' - 'A'] = { .word = { .b = On }, .value = &gc_block.values.b },
+#endif
+#ifdef C_AXIS
+  #if !AXIS_REMAP_ABC2UVW
+        ['C' - 'A'] = { .word = { .c = On }, .axis = bit(C_AXIS), .value = &gc_block.values.xyz[C_AXIS] },
+  #else
+        ['W' - 'A'] = { .word = { .c = On }, .axis = bit(C_AXIS), .value = &gc_block.values.xyz[C_AXIS] },
+  #endif
+#else
+        ['C' - 'A'] = { .word = { .c = On }, .value = &gc_block.values.c },
+#endif
+        ['D' - 'A'] = { .word = { .d = On }, .value = &gc_block.values.d },
+        ['E' - 'A'] = { .word = { .e = On }, .value = &gc_block.values.e },
+        ['F' - 'A'] = { .word = { .f = On }, .value = &gc_block.values.f },
+        ['I' - 'A'] = { .word = { .i = On }, .ijk = 0b001, .value = &gc_block.values.ijk[I_VALUE] },
+        ['J' - 'A'] = { .word = { .j = On }, .ijk = 0b010, .value = &gc_block.values.ijk[J_VALUE] },
+        ['K' - 'A'] = { .word = { .k = On }, .ijk = 0b100, .value = &gc_block.values.ijk[K_VALUE] },
+        ['P' - 'A'] = { .word = { .p = On }, .value = &gc_block.values.p }, // NOTE: For certain commands, P value must be an integer, but none of these commands are supported.
+        ['Q' - 'A'] = { .word = { .q = On }, .value = &gc_block.values.q }, // may be used for user defined mcodes or G61,G76
+        ['R' - 'A'] = { .word = { .r = On }, .value = &gc_block.values.r },
+        ['S' - 'A'] = { .word = { .s = On }, .value = &gc_block.values.s },
+#if !LATHE_UVW_OPTION
+  #ifdef U_AXIS
+        ['U' - 'A'] = { .word = { .u = On }, .axis = bit(U_AXIS), .value = &gc_block.values.xyz[U_AXIS] },
+  #elif !AXIS_REMAP_ABC2UVW
+        ['U' - 'A'] = { .word = { .u = On }, .value = &gc_block.values.u },
+  #endif
+  #ifdef V_AXIS
+        ['V' - 'A'] = { .word = { .v = On }, .axis = bit(V_AXIS), .value = &gc_block.values.xyz[V_AXIS] },
+  #elif !AXIS_REMAP_ABC2UVW
+        ['V' - 'A'] = { .word = { .v = On }, .value = &gc_block.values.v },
+  #endif
+  #if !AXIS_REMAP_ABC2UVW
+        ['W' - 'A'] = { .word = { .w = On }, .value = &gc_block.values.w },
+  #endif
+#endif
+        ['X' - 'A'] = { .word = { .x = On }, .axis = bit(X_AXIS), .value = &gc_block.values.xyz[X_AXIS] },
+        ['Y' - 'A'] = { .word = { .y = On }, .axis = bit(Y_AXIS), .value = &gc_block.values.xyz[Y_AXIS] },
+        ['Z' - 'A'] = { .word = { .z = On }, .axis = bit(Z_AXIS), .value = &gc_block.values.xyz[Z_AXIS] }
+    };
+
 #if NGC_EXPRESSIONS_ENABLE
 
     static const parameter_words_t o_label = {
@@ -744,13 +1073,30 @@ status_code_t gc_execute_block (char *block)
 
 #endif
 
-    char *message = NULL;
+    static char *message = NULL;
+
+    // Release any message left over from a block that failed before it was handed over
+    if(message) {
+        gc_message_free(message);
+        message = NULL;
+    }
+
+#if LASER_RASTER_ENABLE
+    // Release any raster data left over from a block that failed or did not consume it
+    if(raster) {
+        mem_free(raster);
+        raster = NULL;
+    }
+    raster_invalid = false;
+#endif
 
     block = gc_normalize_block(block, &message);
 
     if(block[0] == '\0') {
-        if(message)
+        if(message) {
             gc_output_message(message);
+            message = NULL;
+        }
         return Status_OK;
     }
 
@@ -762,8 +1108,10 @@ status_code_t gc_execute_block (char *block)
     // functions that empty the planner buffer to execute its task on-time.
     if (block[0] == CMD_PROGRAM_DEMARCATION && block[1] == '\0') {
         gc_state.file_run = !gc_state.file_run;
-        if(message)
+        if(message) {
             gc_output_message(message);
+            message = NULL;
+        }
         return Status_OK;
     }
 
@@ -899,6 +1247,25 @@ status_code_t gc_execute_block (char *block)
 
 #endif
 
+        // Plain value words: check for repeats and negative values, then store the value.
+        if(letter != '$' && value_words[letter - 'A'].value) {
+
+            const parameter_words_t word = value_words[letter - 'A'].word;
+
+            if(gc_block.words.mask & word.mask)
+                FAIL(Status_GcodeWordRepeated); // [Word repeated]
+
+            if((word.mask & positive_only_words.mask) && value < 0.0f)
+                FAIL(Status_NegativeValue); // [Word value cannot be negative]
+
+            *value_words[letter - 'A'].value = value;
+            axis_words.mask |= value_words[letter - 'A'].axis;
+            ijk_words.mask |= value_words[letter - 'A'].ijk;
+            gc_block.words.mask |= word.mask;
+
+            continue;
+        }
+
         // Convert values to smaller uint8 significand and mantissa values for parsing this word.
         // NOTE: Mantissa is multiplied by 100 to catch non-integer command values. This is more
         // accurate than the NIST gcode requirement of x10 when used for commands, but not quite
@@ -1090,7 +1457,7 @@ status_code_t gc_execute_block (char *block)
 #if ENABLE_PATH_BLENDING
                     case 61:
                         word_bit.modal_group.G13 = On;
-                        if (mantissa != 0 || mantissa != 10)
+                        if (mantissa != 0 && mantissa != 10)
                             FAIL(Status_GcodeUnsupportedCommand);
                         gc_block.modal.control = mantissa == 0 ? ControlMode_ExactPath : ControlMode_ExactStop;
                         break;
@@ -1228,6 +1595,9 @@ status_code_t gc_execute_block (char *block)
                         if(!settings.parking.flags.enable_override_control) // TODO: check if enabled?
                             FAIL(Status_GcodeUnsupportedCommand); // [Unsupported M command]
                         // no break;
+#if ADAPTIVE_FEED_ENABLE
+                    case 52:
+#endif
                     case 48: case 49: case 50: case 51: case 53:
                         word_bit.modal_group.M9 = On;
                         gc_block.override_command = (override_mode_t)int_value;
@@ -1265,7 +1635,7 @@ status_code_t gc_execute_block (char *block)
 /*
                     case 70:
                         if(!saved_state)
-                            saved_state = malloc(sizeof(parser_state_t));
+                            saved_state = mem_alloc(MemTag_Parser, sizeof(parser_state_t));
                         if(!saved_state)
                             FAIL(Status_GcodeUnsupportedCommand); // [Unsupported M command]
                         memcpy(saved_state, &gc_state, sizeof(parser_state_t));
@@ -1273,7 +1643,7 @@ status_code_t gc_execute_block (char *block)
 
                     case 71: // Invalidate saved state
                         if(saved_state) {
-                            free(saved_state);
+                            mem_free(saved_state);
                             saved_state = NULL;
                         }
                         return Status_OK; // Should fail if no state is saved...
@@ -1281,7 +1651,7 @@ status_code_t gc_execute_block (char *block)
                     case 72:
                         if(saved_state) {
                             // TODO: restore state, need to split out execution part of parser to separate functions first?
-                            free(saved_state);
+                            mem_free(saved_state);
                             saved_state = NULL;
                         }
                         return Status_OK;
@@ -1314,79 +1684,13 @@ status_code_t gc_execute_block (char *block)
             default:
 
                 /* Non-Command Words: This initial parsing phase only checks for repeats of the remaining
-                legal g-code words and stores their value. Error-checking is performed later since some
+                legal g-code words and stores their value. Plain value words are handled by the value_words table above. Error-checking is performed later since some
                 words (I,J,K,L,P,R) have multiple connotations and/or depend on the issued commands. */
 
                 word_bit.parameter.mask = 0;
 
                 switch(letter) {
 
-#ifdef A_AXIS
-  #if !AXIS_REMAP_ABC2UVW
-                    case 'A':
-  #else
-                    case 'U':
-  #endif
-                        axis_words.a = On;
-                        word_bit.parameter.a = On;
-                        gc_block.values.xyz[A_AXIS] = value;
-                        break;
-#else
-                    case 'A':
-                        word_bit.parameter.a = On;
-                        gc_block.values.a = value;
-                        break;
-#endif
-
-#ifdef B_AXIS
-  #if !AXIS_REMAP_ABC2UVW
-                    case 'B':
-  #else
-                    case 'V':
-  #endif
-                        axis_words.b = On;
-                        word_bit.parameter.b = On;
-                        gc_block.values.xyz[B_AXIS] = value;
-                        break;
-#else
-                    case 'B':
-                        word_bit.parameter.b = On;
-                        gc_block.values.b = value;
-                        break;
-#endif
-
-#ifdef C_AXIS
-  #if !AXIS_REMAP_ABC2UVW
-                  case 'C':
-  #else
-                  case 'W':
-  #endif
-                        axis_words.c = On;
-                        word_bit.parameter.c = On;
-                        gc_block.values.xyz[C_AXIS] = value;
-                        break;
-#else
-                    case 'C':
-                        word_bit.parameter.c = On;
-                        gc_block.values.c = value;
-                        break;
-#endif
-
-                    case 'D':
-                        word_bit.parameter.d = On;
-                        gc_block.values.d = value;
-                        break;
-
-                    case 'E':
-                        word_bit.parameter.e = On;
-                        gc_block.values.e = value;
-                        break;
-
-                    case 'F':
-                        word_bit.parameter.f = On;
-                        gc_block.values.f = value;
-                        break;
-
                     case 'H':
                         if (mantissa > 0)
                             FAIL(Status_GcodeCommandValueNotInteger);
@@ -1394,24 +1698,6 @@ status_code_t gc_execute_block (char *block)
                         gc_block.values.h = isnan(value) ? 0xFFFFFFFF : int_value;
                         break;
 
-                    case 'I':
-                        ijk_words.i = On;
-                        word_bit.parameter.i = On;
-                        gc_block.values.ijk[I_VALUE] = value;
-                        break;
-
-                    case 'J':
-                        ijk_words.j = On;
-                        word_bit.parameter.j = On;
-                        gc_block.values.ijk[J_VALUE] = value;
-                        break;
-
-                    case 'K':
-                        ijk_words.k = On;
-                        word_bit.parameter.k = On;
-                        gc_block.values.ijk[K_VALUE] = value;
-                        break;
-
                     case 'L':
                         if (mantissa > 0)
                             FAIL(Status_GcodeCommandValueNotInteger);
@@ -1431,26 +1717,6 @@ status_code_t gc_execute_block (char *block)
                         gc_block.values.o = isnan(value) ? 0xFFFFFFFF : int_value;
                         break;
 
-                    case 'P': // NOTE: For certain commands, P value must be an integer, but none of these commands are supported.
-                        word_bit.parameter.p = On;
-                        gc_block.values.p = value;
-                        break;
-
-                    case 'Q': // may be used for user defined mcodes or G61,G76
-                        word_bit.parameter.q = On;
-                        gc_block.values.q = value;
-                        break;
-
-                    case 'R':
-                        word_bit.parameter.r = On;
-                        gc_block.values.r = value;
-                        break;
-
-                    case 'S':
-                        word_bit.parameter.s = On;
-                        gc_block.values.s = value;
-                        break;
-
                     case 'T':
                         if(mantissa > 0)
                             FAIL(Status_GcodeCommandValueNotInteger);
@@ -1477,60 +1743,7 @@ status_code_t gc_execute_block (char *block)
                         word_bit.parameter.z = word_bit.parameter.w = On;
                         gc_block.values.uvw[Z_AXIS] = value;
                         break;
-
-#else
-
-#ifdef U_AXIS
-                    case 'U':
-                        axis_words.u = On;
-                        word_bit.parameter.u = On;
-                        gc_block.values.xyz[U_AXIS] = value;
-                        break;
-#elif !AXIS_REMAP_ABC2UVW
-                    case 'U':
-                        word_bit.parameter.u = On;
-                        gc_block.values.u = value;
-                        break;
 #endif
-
-#ifdef V_AXIS
-                    case 'V':
-                        axis_words.v = On;
-                        word_bit.parameter.v = On;
-                        gc_block.values.xyz[V_AXIS] = value;
-                        break;
-#elif !AXIS_REMAP_ABC2UVW
-                    case 'V':
-                        word_bit.parameter.v = On;
-                        gc_block.values.v = value;
-                        break;
-#endif
-#endif // LATHE_UVW_OPTION
-
-#if !AXIS_REMAP_ABC2UVW
-                    case 'W':
-                        word_bit.parameter.w = On;
-                        gc_block.values.w = value;
-                        break;
-#endif
-                    case 'X':
-                        axis_words.x = On;
-                        word_bit.parameter.x = On;
-                        gc_block.values.xyz[X_AXIS] = value;
-                        break;
-
-                    case 'Y':
-                        axis_words.y = On;
-                        word_bit.parameter.y = On;
-                        gc_block.values.xyz[Y_AXIS] = value;
-                        break;
-
-                    case 'Z':
-                        axis_words.z = On;
-                        word_bit.parameter.z = On;
-                        gc_block.values.xyz[Z_AXIS] = value;
-                        break;
-
                     case '$':
                         if(mantissa > 0)
                             FAIL(Status_GcodeCommandValueNotInteger);
@@ -1899,6 +2112,10 @@ status_code_t gc_execute_block (char *block)
                 gc_block.modal.override_ctrl.feed_hold_disable = gc_block.values.p == 0.0f;
                 break;
 
+            case Override_AdaptiveFeed:
+                gc_block.modal.override_ctrl.adaptive_feed = gc_block.values.p != 0.0f;
+                break;
+
             case Override_Parking:
                 if(settings.parking.flags.enable_override_control)
                     gc_block.modal.override_ctrl.parking_disable = gc_block.values.p == 0.0f;
@@ -2116,12 +2333,18 @@ status_code_t gc_execute_block (char *block)
             FAIL(Status_SettingReadFail);
     }
 
-    // [16. Set path control mode ]: N/A. Only G61. G61.1 and G64 NOT SUPPORTED.
+    // [16. Set path control mode ]: G61, G61.1 and G64 P- Q-. Only G64 P- is acted upon.
 #if ENABLE_PATH_BLENDING
     if(command_words.G13) { // Check if called in block
         if(gc_block.modal.control == ControlMode_PathBlending) {
+            if((gc_block.words.p && gc_block.values.p < 0.0f) || (gc_block.words.q && gc_block.values.q < 0.0f))
+                FAIL(Status_NegativeValue); // [Word value cannot be negative]
             gc_state.path_tolerance = gc_block.words.p ? gc_block.values.p : 0.0f;
             gc_state.cam_tolerance = gc_block.words.q ? gc_block.values.q : 0.0f;
+            if(gc_block.modal.units_imperial) {
+                gc_state.path_tolerance *= MM_PER_INCH;
+                gc_state.cam_tolerance *= MM_PER_INCH;
+            }
             gc_block.words.p = gc_block.words.q = Off;
         } else
             gc_state.path_tolerance = gc_state.cam_tolerance = 0.0f;
@@ -2206,10 +2429,15 @@ status_code_t gc_execute_block (char *block)
                         if(p_value == 0 || p_value > grbl.tool_table.n_tools)
                            FAIL(Status_GcodeIllegalToolTableEntry); // [Greater than max allowed tool number]
 
-                        grbl.tool_table.tool[p_value].tool_id = (tool_id_t)p_value;
+                        tool_data_t *tool;
+
+                        if((tool = tool_get((tool_id_t)p_value)) == grbl.tool_table.tool)
+                           FAIL(Status_GcodeIllegalToolTableEntry); // [Out of tool table memory]
+
+                        tool->tool_id = (tool_id_t)p_value;
 
                         if(gc_block.words.r) {
-                            grbl.tool_table.tool[p_value].radius = gc_block.values.r;
+                            tool->radius = gc_block.values.r;
                             gc_block.words.r = Off;
                         }
 
@@ -2220,29 +2448,29 @@ status_code_t gc_execute_block (char *block)
 #endif
 
                         if(gc_block.values.l == 1)
-                            grbl.tool_table.read(p_value, &grbl.tool_table.tool[p_value]);
+                            grbl.tool_table.read(p_value, tool);
 
                         idx = N_AXIS;
                         do {
                             if(bit_istrue(axis_words.mask, bit(--idx))) {
                                 if(gc_block.values.l == 1)
-                                    grbl.tool_table.tool[p_value].offset[idx] = gc_block.values.xyz[idx];
+                                    tool->offset[idx] = gc_block.values.xyz[idx];
                                 else if(gc_block.values.l == 10)
-                                    grbl.tool_table.tool[p_value].offset[idx] = gc_state.position[idx] - gc_state.modal.coord_system.xyz[idx] - gc_state.g92_coord_offset[idx] - gc_block.values.xyz[idx];
+                                    tool->offset[idx] = gc_state.position[idx] - gc_state.modal.coord_system.xyz[idx] - gc_state.g92_coord_offset[idx] - gc_block.values.xyz[idx];
 #if COMPATIBILITY_LEVEL <= 1
                                 else if(gc_block.values.l == 11)
-                                    grbl.tool_table.tool[p_value].offset[idx] = g59_3_offset[idx] - gc_block.values.xyz[idx];
+                                    tool->offset[idx] = g59_3_offset[idx] - gc_block.values.xyz[idx];
 #endif
     //                            if(gc_block.values.l != 1)
     //                                tool_table[p_value].offset[idx] -= gc_state.tool_length_offset[idx];
                             } else if(gc_block.values.l == 10 || gc_block.values.l == 11)
-                                grbl.tool_table.tool[p_value].offset[idx] = gc_state.tool_length_offset[idx];
+                                tool->offset[idx] = gc_state.tool_length_offset[idx];
 
                             // else, keep current stored value.
                         } while(idx);
 
                         if(gc_block.values.l == 1)
-                            grbl.tool_table.write(&grbl.tool_table.tool[p_value]);
+                            grbl.tool_table.write(tool);
                     } else
                         FAIL(Status_GcodeUnsupportedCommand);
                     break;
@@ -2434,6 +2662,11 @@ status_code_t gc_execute_block (char *block)
                 if(!gc_state.spindle.hal->get_data)
                     FAIL(Status_GcodeUnsupportedCommand); // [G76 not supported]
 
+#if THREADING_PIPELINE_ENABLE
+                if(!hal.driver_cap.spindle_sync)
+                    FAIL(Status_GcodeUnsupportedCommand); // [Spindle index wait not supported]
+#endif
+
                 if(gc_block.modal.plane_select != PlaneSelect_ZX)
                     FAIL(Status_GcodeIllegalPlane); // [Plane not ZX]
 
@@ -2458,9 +2691,17 @@ status_code_t gc_execute_block (char *block)
                 if(gc_state.spindle.rpm < gc_state.spindle.hal->rpm_min || gc_state.spindle.rpm > gc_state.spindle.hal->rpm_max)
                     FAIL(Status_GcodeRPMOutOfRange);
 
+#if THREADING_PIPELINE_ENABLE
+                if(gc_block.words.d && (gc_block.values.d < 1.0f || !isintf(gc_block.values.d)))
+                    FAIL(Status_GcodeValueOutOfRange); // [Number of starts not a positive integer]
+#endif
+
                 if(gc_block.modal.motion != gc_state.modal.motion) {
                     memset(&thread, 0, sizeof(gc_thread_data));
                     thread.depth_degression = 1.0f;
+#if THREADING_PIPELINE_ENABLE
+                    thread.starts = 1;
+#endif
                 }
 
                 thread.pitch = gc_block.values.p;
@@ -2514,6 +2755,13 @@ status_code_t gc_execute_block (char *block)
                 if(gc_block.words.q)
                     thread.infeed_angle = gc_block.values.q;
 
+#if THREADING_PIPELINE_ENABLE
+                if(gc_block.words.d) {
+                    thread.starts = (uint_fast16_t)gc_block.values.d;
+                    gc_block.words.d = Off;
+                }
+#endif
+
                 // Ensure spindle speed is at 100% - any override will be disabled on execute.
                 gc_parser_flags.spindle_force_sync = On;
 
@@ -2900,6 +3148,19 @@ status_code_t gc_execute_block (char *block)
                         FAIL(Status_GcodeNoAxisWords); // [No axis words]
                     if (isequal_position_vector(gc_state.position, gc_block.values.xyz))
                         FAIL(Status_GcodeInvalidTarget); // [Invalid target]
+                    // Two-stage probing: R is the retract distance after the first contact, Q the optional reprobe feed rate.
+                    if(gc_block.words.r) {
+                        if(gc_block.values.r <= 0.0f || (gc_block.words.q && gc_block.values.q <= 0.0f))
+                            FAIL(Status_NegativeValue); // [Retract distance or feed rate not positive]
+                        if(gc_block.modal.units_imperial) {
+                            gc_block.values.r *= MM_PER_INCH;
+                            gc_block.values.q *= MM_PER_INCH;
+                        }
+                        if(!gc_block.words.q)
+                            gc_block.values.q = gc_block.values.f / PROBE_REPROBE_FEED_DIVISOR;
+                        gc_parser_flags.probe_reprobe = On;
+                        gc_block.words.r = gc_block.words.q = Off;
+                    }
                     break;
 
                 default:
@@ -2961,6 +3222,16 @@ status_code_t gc_execute_block (char *block)
         return (status_code_t)int_value;
     }
 
+#if LASER_RASTER_ENABLE
+    // Raster data is only valid for G1 motions with axis words in laser mode, PWM output is required.
+    if(raster_invalid)
+        FAIL(Status_InvalidStatement);
+
+    if(raster && !(gc_block.modal.motion == MotionMode_Linear && axis_command == AxisCommand_MotionMode && axis_words.mask &&
+                    gc_state.spindle.hal->cap.laser && gc_state.spindle.hal->get_pwm && gc_state.spindle.hal->update_pwm))
+        FAIL(Status_GcodeUnsupportedCommand);
+#endif
+
     // If in laser mode, setup laser power based on current and past parser conditions.
     if(gc_state.spindle.hal->cap.laser) {
 
@@ -2992,9 +3263,30 @@ status_code_t gc_execute_block (char *block)
 
     bool check_mode = state_get() == STATE_CHECK_MODE;
 
+#if PROGRAM_CACHE_ENABLE
+    // Commands that depend on the machine at run time or have side effects not replayed from the program cache.
+    if(check_mode && program_cache_recording() &&
+        (message || port_command || command_words.M6 || gc_block.user_mcode || sys.flags.single_block ||
+          gc_block.modal.program_flow == ProgramFlow_Paused || gc_block.modal.program_flow == ProgramFlow_OptionalStop ||
+           gc_block.modal.program_flow == ProgramFlow_CompletedM60 || gc_block.modal.program_flow == ProgramFlow_Return ||
+            gc_block.modal.motion == MotionMode_SpindleSynchronized || gc_block.modal.motion == MotionMode_RigidTapping ||
+             gc_block.modal.motion == MotionMode_Threading || gc_block.modal.motion >= MotionMode_ProbeToward ||
+              gc_block.modal.feed_mode == FeedMode_UnitsPerRev || gc_block.modal.spindle.rpm_mode == SpindleSpeedMode_CSS ||
+               gc_block.non_modal_command == NonModal_SetCoordinateData || gc_block.non_modal_command == NonModal_SetHome_0 ||
+                gc_block.non_modal_command == NonModal_SetHome_1 || gc_block.non_modal_command == NonModal_MacroCall ||
+                 gc_block.non_modal_command >= NonModal_SetCoordinateOffset))
+        program_cache_reject();
+#endif
+
+#if JOB_RESUME_ENABLE
+    plan_data.job_block = check_mode ? 0 : job_resume_next_block();
+#endif
+
     // [1. Comments feedback ]: Extracted in protocol.c if HAL entry point provided
-    if(message && !check_mode && (plan_data.message = malloc(strlen(message) + 1)))
-        strcpy(plan_data.message, message);
+    if(message && !check_mode) {
+        plan_data.message = message; // Hand over message, it is released after output.
+        message = NULL;
+    }
 
     // [2. Set feed rate mode ]:
     gc_state.modal.feed_mode = gc_block.modal.feed_mode;
@@ -3073,6 +3365,10 @@ status_code_t gc_execute_block (char *block)
             hal.tool.select(pending_tool, !set_tool);
         else
             system_add_rt_report(Report_Tool);
+
+        // Look-ahead notification, delivered from the foreground so that the parser is not held up.
+        if(grbl.on_tool_preselect && !set_tool && !tool_preselect_pending)
+            tool_preselect_pending = protocol_enqueue_foreground_task(tool_preselect, NULL);
     }
 
     // [5a. HAL pin I/O ]: M62 - M68. (Modal group M10)
@@ -3165,7 +3461,14 @@ status_code_t gc_execute_block (char *block)
         // NOTE: All spindle state changes are synced, even in laser mode. Also, plan_data,
         // rather than gc_state, is used to manage laser state for non-laser motions.
         if(gc_block.spindle) {
-            if((spindle_programmed = spindle_sync(gc_block.spindle, gc_block.modal.spindle.state, plan_data.spindle.rpm)))
+#if SYNCED_STATE_CHANGES_ENABLE
+            // Spindle stop is performed when the preceding motion is completed, start is synced to allow for spin up.
+            if(!gc_block.modal.spindle.state.on && add_state_change((plan_state_change_t){ .spindle_off = gc_block.spindle }))
+                spindle_programmed = true;
+            else
+#endif
+            spindle_programmed = spindle_sync(gc_block.spindle, gc_block.modal.spindle.state, plan_data.spindle.rpm);
+            if(spindle_programmed)
                 gc_block.spindle->param->state = gc_block.modal.spindle.state;
         } else {
             idx = N_SYS_SPINDLE;
@@ -3197,6 +3500,11 @@ status_code_t gc_execute_block (char *block)
     if (gc_parser_flags.set_coolant && gc_state.modal.coolant.value != gc_block.modal.coolant.value) {
     // NOTE: Coolant M-codes are modal. Only one command per line is allowed. But, multiple states
     // can exist at the same time, while coolant disable clears all states.
+#if SYNCED_STATE_CHANGES_ENABLE
+        if(add_state_change((plan_state_change_t){ .set_coolant = true, .coolant = gc_block.modal.coolant }))
+            gc_state.modal.coolant = gc_block.modal.coolant;
+        else
+#endif
         if(coolant_sync(gc_block.modal.coolant))
             gc_state.modal.coolant = gc_block.modal.coolant;
     }
@@ -3250,6 +3558,8 @@ status_code_t gc_execute_block (char *block)
     if (command_words.G8) { // Indicates a change.
 
         bool tlo_changed = false;
+        tool_data_t *tool = gc_block.modal.tool_offset_mode == ToolLengthOffset_Enable ||
+                             gc_block.modal.tool_offset_mode == ToolLengthOffset_ApplyAdditional ? tool_get(gc_block.values.h) : NULL;
 
         idx = N_AXIS;
         gc_state.modal.tool_offset_mode = gc_block.modal.tool_offset_mode;
@@ -3266,15 +3576,15 @@ status_code_t gc_execute_block (char *block)
                     break;
 
                 case ToolLengthOffset_Enable: // G43
-                    if (gc_state.tool_length_offset[idx] != grbl.tool_table.tool[gc_block.values.h].offset[idx]) {
+                    if (gc_state.tool_length_offset[idx] != tool->offset[idx]) {
                         tlo_changed = true;
-                        gc_state.tool_length_offset[idx] = grbl.tool_table.tool[gc_block.values.h].offset[idx];
+                        gc_state.tool_length_offset[idx] = tool->offset[idx];
                     }
                     break;
 
                 case ToolLengthOffset_ApplyAdditional: // G43.2
-                    tlo_changed |= grbl.tool_table.tool[gc_block.values.h].offset[idx] != 0.0f;
-                    gc_state.tool_length_offset[idx] += grbl.tool_table.tool[gc_block.values.h].offset[idx];
+                    tlo_changed |= tool->offset[idx] != 0.0f;
+                    gc_state.tool_length_offset[idx] += tool->offset[idx];
                     break;
 
                 case ToolLengthOffset_EnableDynamic: // G43.1
@@ -3417,7 +3727,14 @@ status_code_t gc_execute_block (char *block)
                 //??    gc_state.distance_per_rev = plan_data.feed_rate;
                     // check initial feed rate - fail if zero?
                 }
+#if LASER_RASTER_ENABLE
+                plan_data.raster = raster; // Hand over raster data, it is released by the planner or stepper module.
+                mc_line(gc_block.values.xyz, &plan_data);
+                raster = plan_data.raster; // Not NULL if not consumed by the planner, released on next call.
+                plan_data.raster = NULL;
+#else
                 mc_line(gc_block.values.xyz, &plan_data);
+#endif
                 break;
 
             case MotionMode_Seek:
@@ -3511,7 +3828,10 @@ status_code_t gc_execute_block (char *block)
                 // NOTE: gc_block.values.xyz is returned from mc_probe_cycle with the updated position value. So
                 // upon a successful probing cycle, the machine position and the returned value should be the same.
                 plan_data.condition.no_feed_override = !settings.probe.allow_feed_override;
-                gc_update_pos = (pos_update_t)mc_probe_cycle(gc_block.values.xyz, &plan_data, gc_parser_flags);
+                if(gc_parser_flags.probe_reprobe)
+                    gc_update_pos = (pos_update_t)mc_probe_reprobe(gc_block.values.xyz, &plan_data, gc_parser_flags, gc_block.values.r, gc_block.values.q);
+                else
+                    gc_update_pos = (pos_update_t)mc_probe_cycle(gc_block.values.xyz, &plan_data, gc_parser_flags);
                 break;
 
             default:
@@ -3523,11 +3843,8 @@ status_code_t gc_execute_block (char *block)
             gc_update_pos = GCUpdatePos_None;
 
         //  Clean out any remaining output commands (may linger on error)
-        while(plan_data.output_commands) {
-            output_command_t *next = plan_data.output_commands;
-            free(plan_data.output_commands);
-            plan_data.output_commands = next;
-        }
+        gc_output_commands_free(plan_data.output_commands);
+        plan_data.output_commands = NULL;
 
         // As far as the parser is concerned, the position is now == target. In reality the
         // motion control system might still be processing the action and the real tool position
@@ -3588,6 +3905,7 @@ status_code_t gc_execute_block (char *block)
             gc_state.modal.coolant = (coolant_state_t){0};
             gc_state.modal.override_ctrl.feed_rate_disable = Off;
             gc_state.modal.override_ctrl.spindle_rpm_disable = Off;
+            gc_state.modal.override_ctrl.adaptive_feed = Off;
 
             idx = N_SYS_SPINDLE;
             spindle_ptrs_t *spindle;
@@ -3629,15 +3947,27 @@ status_code_t gc_execute_block (char *block)
                 system_add_rt_report(Report_Coolant); // immediately.
             }
 
+#if SEGMENT_BUFFER_MONITOR
+            if(!check_mode)
+                st_get_buffer_stats()->restart = true; // Restart step segment buffer statistics on next cycle start.
+#endif
+
             if(grbl.on_program_completed)
                 grbl.on_program_completed(gc_state.modal.program_flow, check_mode);
 
+#if JOB_RESUME_ENABLE
+            if(!check_mode)
+                job_resume_job_completed();
+#endif
+
+#if NGC_EXPRESSIONS_ENABLE
+            ngc_flowctrl_init(); // Release subroutine definitions.
+            ngc_params_free();   // Release read/write parameters.
+#endif
+
             // Clear any pending output commands
-            while(output_commands) {
-                output_command_t *next = output_commands->next;
-                free(output_commands);
-                output_commands = next;
-            }
+            gc_output_commands_free(output_commands);
+            output_commands = NULL;
 
             grbl.report.feedback_message(Message_ProgramEnd);
         }
@@ -3651,7 +3981,183 @@ status_code_t gc_execute_block (char *block)
     } while(ngc_param_count);
 #endif
 
+#if JOB_RESUME_ENABLE
+    if(!check_mode)
+        job_resume_block_executed();
+#endif
+
     // TODO: % to denote start of program.
 
     return Status_OK;
 }
+
+#if MOTION_FRAMES_ENABLE
+
+static inline int_fast8_t hex_nibble (char c)
+{
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+
+    return -1;
+}
+
+// Decodes len bytes from hexadecimal input, returns false on invalid characters.
+static bool hex_decode (const char *s, uint8_t *data, uint_fast8_t len)
+{
+    int_fast8_t hi, lo;
+
+    while(len--) {
+        if((hi = hex_nibble(*s++)) < 0 || (lo = hex_nibble(*s++)) < 0)
+            return false;
+        *data++ = (uint8_t)((hi << 4) | lo);
+    }
+
+    return true;
+}
+
+static inline float frame_get_float (const uint8_t *data)
+{
+    union {
+        uint32_t u;
+        float f;
+    } value;
+
+    value.u = data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+
+    return value.f;
+}
+
+/*! \brief Executes a compact motion frame: a pre-parsed linear motion executed as a G0 or G1 block
+in the current modal state without going through the g-code parser.
+
+Frame data follows the leading colon as hexadecimal encoded bytes, multi-byte values are little-endian:
++ flags (1 byte): bit 0 set for rapid motion (G0), bit 1 set if feed rate is present, bit 2 set if spindle speed is present.
++ axes (1 byte): bitmask of axis targets present, bit 0 is the X-axis.
++ targets (4 bytes each): IEEE 754 single precision target position in mm in the current work coordinate system.
++ feed rate (4 bytes): IEEE 754 single precision feed rate in mm/min, if flagged.
++ spindle speed (4 bytes): IEEE 754 single precision spindle speed in RPM, if flagged.
++ checksum (1 byte): two's complement of the sum of all preceding bytes.
+
+The parser state is updated as for the equivalent g-code block. Frames are rejected if the
+feed rate mode is not units per minute, if in constant surface speed mode or if scaling is active.
+\param frame pointer to null terminated frame, including the leading colon.
+\returns #Status_OK if successfully executed, an error code otherwise.
+*/
+status_code_t gc_execute_motion_frame (char *frame)
+{
+    uint8_t data[2 + (N_AXIS + 2) * sizeof(float) + 1], *value, sum = 0;
+    uint_fast8_t idx, len = 3, flags, axes;
+    size_t frame_len = strlen(++frame);
+
+    if(frame_len < 6 || !hex_decode(frame, data, 2))
+        return Status_InvalidStatement;
+
+    flags = data[0];
+    axes = data[1];
+
+    if(axes == 0)
+        return Status_GcodeNoAxisWords;
+
+    if((flags & ~0x07) || (axes & ~AXES_BITMASK))
+        return Status_GcodeUnsupportedCommand;
+
+    len += ((flags >> 1) & 0x01) * sizeof(float) + ((flags >> 2) & 0x01) * sizeof(float);
+    idx = N_AXIS;
+    do {
+        if(bit_istrue(axes, bit(--idx)))
+            len += sizeof(float);
+    } while(idx);
+
+    if(frame_len != len * 2 || !hex_decode(frame, data, len))
+        return Status_InvalidStatement;
+
+    idx = len;
+    do {
+        sum += data[--idx];
+    } while(idx);
+
+    if(sum)
+        return Status_InvalidStatement;
+
+    if(gc_state.modal.feed_mode != FeedMode_UnitsPerMin || gc_state.spindle.css || gc_get_g51_state().mask)
+        return Status_GcodeUnsupportedCommand;
+
+    bool rapid = !!(flags & 0x01), laser_disable = false;
+    float target[N_AXIS], feed_rate = gc_state.feed_rate, rpm = gc_state.spindle.rpm;
+
+    memcpy(target, gc_state.position, sizeof(target));
+
+    value = &data[2];
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(bit_istrue(axes, bit(idx))) {
+            target[idx] = frame_get_float(value) + gc_get_offset(idx);
+            value += sizeof(float);
+        }
+    }
+
+    if(flags & 0x02) {
+        feed_rate = frame_get_float(value);
+        value += sizeof(float);
+    }
+
+    if(flags & 0x04)
+        rpm = frame_get_float(value);
+
+    if(!rapid && feed_rate <= 0.0f)
+        return Status_GcodeUndefinedFeedRate;
+
+    if(rpm < 0.0f)
+        return Status_NegativeValue;
+
+    // Update parser state as for the equivalent G0 or G1 block.
+    gc_state.line_number = 0;
+    gc_state.feed_rate = feed_rate;
+    gc_state.modal.motion = rapid ? MotionMode_Seek : MotionMode_Linear;
+
+    if(gc_state.spindle.hal->cap.laser) {
+        laser_disable = rapid;
+        gc_state.is_rpm_rate_adjusted = gc_state.modal.spindle.state.ccw && !laser_disable;
+    }
+
+    if(gc_state.spindle.rpm != rpm) {
+        // NOTE: In laser mode the new speed is passed to the planner with the motion.
+        if(gc_state.modal.spindle.state.on && !gc_state.spindle.hal->cap.laser) {
+            gc_state.spindle.hal->param->rpm = rpm;
+            spindle_sync(gc_state.spindle.hal, gc_state.modal.spindle.state, rpm);
+        }
+        gc_state.spindle.rpm = rpm;
+    }
+
+    plan_line_data_t plan_data;
+
+    memset(&plan_data, 0, sizeof(plan_line_data_t));
+    plan_data.condition.target_validated = plan_data.condition.target_valid = sys.soft_limits.mask == 0;
+    plan_data.feed_rate = gc_state.feed_rate;
+    if(laser_disable)
+        plan_data.spindle.hal = gc_state.spindle.hal;
+    else
+        memcpy(&plan_data.spindle, &gc_state.spindle, sizeof(spindle_t));
+    plan_data.spindle.state = gc_state.modal.spindle.state;
+    plan_data.condition.is_rpm_rate_adjusted = gc_state.is_rpm_rate_adjusted;
+    plan_data.condition.is_laser_ppi_mode = gc_state.is_rpm_rate_adjusted && gc_state.is_laser_ppi_mode;
+    plan_data.condition.coolant = gc_state.modal.coolant;
+    plan_data.condition.rapid_motion = rapid;
+    plan_data.output_commands = output_commands;
+#if ENABLE_PATH_BLENDING
+    plan_data.cam_tolerance = gc_state.cam_tolerance;
+    plan_data.path_tolerance = gc_state.path_tolerance;
+#endif
+    output_commands = NULL;
+
+    mc_line(target, &plan_data);
+
+    memcpy(gc_state.position, target, sizeof(gc_state.position));
+
+    return Status_OK;
+}
+
+#endif // MOTION_FRAMES_ENABLE
@@ -199,6 +199,7 @@ typedef enum {
     Override_FeedSpeedDisable = 49, //!< 49 - M49
     Override_FeedRate = 50,         //!< 50 - M50
     Override_SpindleSpeed = 51,     //!< 51 - M51
+    Override_AdaptiveFeed = 52,     //!< 52 - M52
     Override_FeedHold = 53,         //!< 53 - M53
     Override_Parking = 56           //!< 56 - M56
 } override_mode_t;
@@ -263,6 +264,17 @@ typedef struct output_command {
     struct output_command *next;
 } output_command_t;
 
+//! Block attachment pool statistics, only available when \ref GC_OUTPUT_COMMAND_POOL_SIZE or \ref GC_MESSAGE_POOL_SIZE is > 0.
+typedef struct {
+    uint16_t output_commands;       //!< Number of output command slots.
+    uint16_t output_commands_used;  //!< Number of output command slots in use.
+    uint16_t output_commands_max;   //!< Maximum number of output command slots ever in use.
+    uint16_t messages;              //!< Number of message slots.
+    uint16_t messages_used;         //!< Number of message slots in use.
+    uint16_t messages_max;          //!< Maximum number of message slots ever in use.
+    uint32_t heap_fallbacks;        //!< Number of allocations served from the heap due to the pool being exhausted or the message being too long.
+} gc_pool_stats_t;
+
 //! M66 Allowed L-parameter values
 typedef enum {
     WaitMode_Immediate = 0, //!< 0 - This is the only mode allowed for analog inputs
@@ -310,7 +322,8 @@ typedef union {
                  laser_is_motion     :1,
                  set_coolant         :1,
                  motion_mode_changed :1,
-                 reserved            :6;
+                 probe_reprobe       :1,
+                 reserved            :5;
     };
 } gc_parser_flags_t;
 
@@ -322,7 +335,8 @@ typedef union {
                 feed_hold_disable   :1,
                 spindle_rpm_disable :1,
                 parking_disable     :1,
-                reserved            :3,
+                adaptive_feed       :1, //!< M52, set when adaptive feed is enabled.
+                reserved            :2,
                 sync                :1;
     };
 } gc_override_flags_t;
@@ -488,7 +502,7 @@ typedef struct {
     program_flow_t program_flow;         //!< {M0,M1,M2,M30,M60}
     coolant_state_t coolant;             //!< {M7,M8,M9}
     spindle_mode_t spindle;              //!< {M3,M4,M5 and G96,G97}
-    gc_override_flags_t override_ctrl;   //!< {M48,M49,M50,M51,M53,M56}
+    gc_override_flags_t override_ctrl;   //!< {M48,M49,M50,M51,M52,M53,M56}
     cc_retract_mode_t retract_mode;      //!< {G98,G99}
     bool scaling_active;                 //!< {G50,G51}
     bool canned_cycle_active;
@@ -527,6 +541,9 @@ typedef struct {
     float infeed_angle;
     float cut_direction;
     uint_fast16_t spring_passes;
+#if THREADING_PIPELINE_ENABLE
+    uint_fast16_t starts;
+#endif
     gc_taper_type end_taper_type;
 } gc_thread_data;
 
@@ -610,6 +627,9 @@ char *gc_normalize_block (char *block, char **message);
 
 // Execute one block of rs275/ngc/g-code
 status_code_t gc_execute_block (char *block);
+#if MOTION_FRAMES_ENABLE
+status_code_t gc_execute_motion_frame (char *frame);
+#endif
 
 // Sets g-code parser position in mm. Input in steps. Called by the system abort and hard
 // limit pull-off routines.
@@ -638,4 +658,12 @@ void gc_coolant_off (void);
 void gc_set_tool_offset (tool_offset_mode_t mode, uint_fast8_t idx, int32_t offset);
 plane_t *gc_get_plane_data (plane_t *plane, plane_select_t select);
 
+// Allocate and release memory for messages and output commands attached to planner blocks.
+char *gc_message_alloc (size_t size);
+void gc_message_free (char *message);
+void gc_output_commands_free (output_command_t *command);
+#if GC_OUTPUT_COMMAND_POOL_SIZE || GC_MESSAGE_POOL_SIZE
+gc_pool_stats_t *gc_pool_get_stats (void);
+#endif
+
 #endif
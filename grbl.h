@@ -110,6 +110,7 @@
 #define CMD_OVERRIDE_FAN0_TOGGLE 0x8A       // Toggle Fan 0 on/off, not implemented by the core.
 #define CMD_MPG_MODE_TOGGLE 0x8B            // Toggle MPG mode on/off, not implemented by the core.
 #define CMD_AUTO_REPORTING_TOGGLE 0x8C      // Toggle auto real time reporting if configured.
+#define CMD_MOTION_FRAMES_TOGGLE 0x8D       // Toggle acceptance of compact motion frames if configured.
 #define CMD_OVERRIDE_FEED_RESET 0x90        // Restores feed override value to 100%.
 #define CMD_OVERRIDE_FEED_COARSE_PLUS 0x91
 #define CMD_OVERRIDE_FEED_COARSE_MINUS 0x92
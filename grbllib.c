@@ -35,6 +35,15 @@
 #include "state_machine.h"
 #include "nvs_buffer.h"
 #include "stream.h"
+#if INPUT_EVENT_LOG_SIZE
+#include "input_events.h"
+#endif
+#if JOB_STATS_ENABLE
+#include "job_stats.h"
+#endif
+#if PROBE_SCAN_LOG_SIZE
+#include "probe_scan.h"
+#endif
 #if ENABLE_BACKLASH_COMPENSATION
 #include "motion_control.h"
 #endif
@@ -204,6 +213,19 @@ int grbl_enter (void)
 #endif
 
     driver.init = driver_init();
+    protocol_boot_phase("driver init");
+
+#if INPUT_EVENT_LOG_SIZE
+    input_events_init();
+#endif
+
+#if JOB_STATS_ENABLE
+    job_stats_init();
+#endif
+
+#if PROBE_SCAN_LOG_SIZE
+    probe_scan_init();
+#endif
 
 #ifdef DEBUGOUT
     debug_stream_init();
@@ -241,6 +263,7 @@ int grbl_enter (void)
     nvs_buffer_init();
   #endif
     settings_init(); // Load settings from non-volatile storage
+    protocol_boot_phase("settings");
 
     memset(sys.position, 0, sizeof(sys.position)); // Clear machine position.
 
@@ -266,11 +289,18 @@ int grbl_enter (void)
     if(driver.ok == 0xFF)
         driver.setup = hal.driver_setup(&settings);
 
+    protocol_boot_phase("driver setup");
+
+#if IOPORTS_DIRECT_OUTPUT_ENABLE
+    ioports_link_outputs();
+#endif
+
     if((driver.spindle = spindle_select(settings.spindle.flags.type))) {
         spindle_ptrs_t *spindle = spindle_get(0);
         driver.spindle = spindle->get_pwm == NULL || spindle->update_pwm != NULL;
     } else
         driver.spindle = spindle_select(spindle_add_null());
+    protocol_boot_phase("spindle");
 
     if(driver.ok != 0xFF) {
         sys.alarm = Alarm_SelftestFailed;
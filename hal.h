@@ -83,6 +83,15 @@ typedef void (*driver_reset_ptr)(void);
 /*! \brief Pointer to function for getting free memory (as sum of all free blocks in the heap). */
 typedef uint32_t (*get_free_mem_ptr)(void);
 
+/*! \brief Pointer to function for sleeping until woken by an interrupt or an event, or until the timeout expires.
+
+Typically implemented with WFI on bare metal or an event or notification wait for RTOS based drivers.
+Called with interrupts enabled, stream RX, realtime command and timer interrupts must wake the processor.
+Drivers should return immediately if input arrived since the last stream read.
+\param timeout_ms maximum time to sleep in milliseconds.
+*/
+typedef void (*idle_wait_ptr)(uint32_t timeout_ms);
+
 /*! \brief Pointer to function for registering information about a peripheral pin.
 \param pin as periph_pin_t struct containing pin information.
 */
@@ -297,6 +306,15 @@ __NOTE:__ this function will be called from an interrupt context.
 */
 typedef void (*stepper_output_step_ptr)(axes_signals_t step_outbits, axes_signals_t dir_outbits);
 
+/*! \brief Pointer to function for claiming or releasing the lock shared by the planner and the step segment generator.
+
+Required when the driver executes the step segment generator on a separate core by calling st_prep_core_poll()
+continuously from there, the core then no longer calls st_prep_buffer() from the foreground process.
+Typically implemented with a hardware spinlock, claims must nest when made from the same core.
+\param lock \a true to claim the lock, \a false to release it.
+*/
+typedef void (*stepper_prep_lock_ptr)(bool lock);
+
 /*! \brief Pointer to function for getting which axes are configured for auto squaring.
 
 \returns which axes are configured for ganging or auto squaring in an \a axes_signals_t union.
@@ -321,6 +339,7 @@ typedef struct {
     stepper_get_ganged_ptr get_ganged;                  //!< Optional handler getting which axes are configured for ganging or auto squaring.
     stepper_output_step_ptr output_step;                //!< Optional handler for outputting a single step pulse. _Experimental._ Called from interrupt context.
     motor_iterator_ptr motor_iterator;                  //!< Optional handler iteration over motor vs. axis mappings. Required for the motors plugin (Trinamic drivers).
+    stepper_prep_lock_ptr prep_lock;                    //!< Optional handler for locking the planner and step segment generator data, set when the generator is executed on a separate core.
 } stepper_ptrs_t;
 
 
@@ -539,6 +558,9 @@ typedef struct {
     /*! \brief Optional pointer to function for getting free memory (as sum of all free blocks in the heap). */
     get_free_mem_ptr get_free_mem;
 
+    /*! \brief Optional handler for sleeping when the foreground process has nothing to do, requires \ref IDLE_WAIT_ENABLE. */
+    idle_wait_ptr idle_wait;
+
     /*! \brief Driver setup handler.
     Called once by the core after settings has been loaded. The driver should enable MCU peripherals in the provided function.
     \param settings pointer to settings_t structure.
@@ -0,0 +1,321 @@
+/*
+  heightmap.c - grid probing and bilinear Z-height compensation
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "hal.h"
+
+#if HEIGHTMAP_ENABLE
+
+#include "heightmap.h"
+#include "vfs.h"
+#include "system.h"
+#include "protocol.h"
+#include "motion_control.h"
+#include "planner.h"
+#include "report.h"
+
+#ifndef HEIGHTMAP_FILE
+#define HEIGHTMAP_FILE "/heightmap.dat"
+#endif
+
+static bool enabled = false, probing = false;
+static heightmap_t map = {0};
+
+static uint32_t map_checksum (void)
+{
+    return calc_checksum((uint8_t *)&map, offsetof(heightmap_t, checksum));
+}
+
+//! Returns true if compensation is enabled and a valid map is loaded.
+bool heightmap_is_active (void)
+{
+    return enabled && map.valid && !probing;
+}
+
+//! Returns pointer to the height map.
+heightmap_t *heightmap_get (void)
+{
+    return &map;
+}
+
+//! Returns bilinear interpolated Z offset at a XY position, positions outside the map are clamped to the edge.
+float heightmap_get_z (float x, float y)
+{
+    uint_fast16_t ix, iy;
+    float fx = (x - map.x0) / map.dx, fy = (y - map.y0) / map.dy, *z;
+
+    fx = fx < 0.0f ? 0.0f : (fx > (float)(map.nx - 1) ? (float)(map.nx - 1) : fx);
+    fy = fy < 0.0f ? 0.0f : (fy > (float)(map.ny - 1) ? (float)(map.ny - 1) : fy);
+
+    ix = min((uint_fast16_t)fx, map.nx - 2);
+    iy = min((uint_fast16_t)fy, map.ny - 2);
+    fx -= (float)ix;
+    fy -= (float)iy;
+    z = &map.z[iy * map.nx + ix];
+
+    return (z[0] * (1.0f - fx) + z[1] * fx) * (1.0f - fy) + (z[map.nx] * (1.0f - fx) + z[map.nx + 1] * fx) * fy;
+}
+
+/*! \brief Split a line motion into segments no longer than the grid spacing and apply the height map to the Z-axis of each.
+Called by mc_line() for all feed and rapid motions except system and jog motions.
+__NOTE:__ The start position is taken from the planner, so only cartesian machines are supported.
+\param target pointer to float array with target position, uncompensated.
+\param pl_data pointer to \a plan_line_data_t structure.
+\param line pointer to function to be called for each compensated segment, typically mc_line().
+\returns false if aborted.
+*/
+bool heightmap_line (float *target, plan_line_data_t *pl_data, bool (*line)(float *target, plan_line_data_t *pl_data))
+{
+    bool ok = true;
+    uint_fast16_t n_segments, idx;
+    float start[N_AXIS], segment[N_AXIS], length, feed_rate = pl_data->feed_rate;
+
+    memcpy(start, plan_get_position(), sizeof(start));
+    start[Z_AXIS] -= heightmap_get_z(start[X_AXIS], start[Y_AXIS]);
+
+    length = sqrtf((target[X_AXIS] - start[X_AXIS]) * (target[X_AXIS] - start[X_AXIS]) + (target[Y_AXIS] - start[Y_AXIS]) * (target[Y_AXIS] - start[Y_AXIS]));
+    n_segments = max(1, (uint_fast16_t)ceilf(length / min(map.dx, map.dy)));
+
+    pl_data->condition.target_validated = Off; // Z is changed, force soft limits check.
+    if(pl_data->condition.inverse_time)
+        pl_data->feed_rate *= (float)n_segments;
+
+    for(idx = 1; ok && idx <= n_segments; idx++) {
+
+        uint_fast8_t axis = N_AXIS;
+
+        if(idx == n_segments)
+            memcpy(segment, target, sizeof(segment));
+        else do {
+            axis--;
+            segment[axis] = start[axis] + (target[axis] - start[axis]) * (float)idx / (float)n_segments;
+        } while(axis);
+
+        segment[Z_AXIS] += heightmap_get_z(segment[X_AXIS], segment[Y_AXIS]);
+
+        ok = line(segment, pl_data);
+    }
+
+    pl_data->feed_rate = feed_rate;
+
+    return ok;
+}
+
+static bool map_save (void)
+{
+    vfs_file_t *file;
+    bool ok = false;
+
+    if((file = vfs_open(HEIGHTMAP_FILE, "w"))) {
+        map.checksum = map_checksum();
+        ok = vfs_write(&map, sizeof(heightmap_t), 1, file) == 1;
+        vfs_close(file);
+    }
+
+    return ok;
+}
+
+static bool map_load (void)
+{
+    vfs_file_t *file;
+    bool ok = false;
+
+    if((file = vfs_open(HEIGHTMAP_FILE, "r"))) {
+        ok = vfs_read(&map, sizeof(heightmap_t), 1, file) == 1 && map.checksum == map_checksum() && map.valid;
+        vfs_close(file);
+    }
+
+    if(!ok)
+        memset(&map, 0, sizeof(heightmap_t));
+
+    return ok;
+}
+
+static void map_report (void)
+{
+    uint_fast16_t x, y;
+
+    hal.stream.write("[HM:");
+    hal.stream.write(uitoa(map.nx));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(map.ny));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(map.x0, N_DECIMAL_COORDVALUE_MM));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(map.y0, N_DECIMAL_COORDVALUE_MM));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(map.dx, N_DECIMAL_COORDVALUE_MM));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(map.dy, N_DECIMAL_COORDVALUE_MM));
+    hal.stream.write(enabled ? ",1]" ASCII_EOL : ",0]" ASCII_EOL);
+
+    if(map.valid) for(y = 0; y < map.ny; y++) {
+        hal.stream.write("[HMZ:");
+        hal.stream.write(uitoa(y));
+        for(x = 0; x < map.nx; x++) {
+            hal.stream.write(",");
+            hal.stream.write(ftoa(map.z[y * map.nx + x], N_DECIMAL_COORDVALUE_MM));
+        }
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+/*! \brief $HM command handler.
+No argument outputs the map, ON and OFF enables and disables compensation, SAVE and LOAD stores and loads the map to/from the file system.
+*/
+status_code_t heightmap_command (sys_state_t state, char *args)
+{
+    status_code_t status = Status_OK;
+
+    if(args == NULL)
+        map_report();
+    else if(!strcmp(args, "ON")) {
+        if(map.valid) {
+            enabled = true;
+            plan_sync_position(); // Planner position is used as start of the next motion.
+        } else
+            status = Status_InvalidStatement;
+    } else if(!strcmp(args, "OFF"))
+        enabled = false;
+    else if(!strcmp(args, "SAVE"))
+        status = map.valid && map_save() ? Status_OK : Status_SDReadError;
+    else if(!strcmp(args, "LOAD")) {
+        enabled = false;
+        status = map_load() ? Status_OK : Status_SDReadError;
+    } else if(!strcmp(args, "CLEAR")) {
+        enabled = false;
+        memset(&map, 0, sizeof(heightmap_t));
+    } else
+        status = Status_InvalidStatement;
+
+    return status;
+}
+
+/*! \brief $HMP command handler, probes a grid.
+Arguments are X0,Y0,X1,Y1,NX,NY,Zclear,depth,feed in the current work coordinate system and millimeters.
+The probe is moved at rapid rate to Zclear above each point and probes down by Zclear + depth at the feed rate.
+The map is relative to the first point probed.
+*/
+status_code_t heightmap_probe_command (sys_state_t state, char *args)
+{
+    uint_fast8_t cc = 0, idx;
+    uint_fast16_t x, y, nx, ny;
+    float values[9], z_clear, target[N_AXIS];
+    plan_line_data_t plan_data;
+    gc_parser_flags_t flags = {0};
+
+    flags.probe_is_no_error = On;
+
+    if(args == NULL)
+        return Status_InvalidStatement;
+
+    for(idx = 0; idx < 9; idx++) {
+        if(!read_float(args, &cc, &values[idx]))
+            return Status_BadNumberFormat;
+        if(idx < 8 && args[cc++] != ',')
+            return Status_InvalidStatement;
+    }
+
+    if(args[cc] != '\0')
+        return Status_InvalidStatement;
+
+    nx = (uint_fast16_t)values[4];
+    ny = (uint_fast16_t)values[5];
+
+    if(nx < 2 || ny < 2 || nx * ny > HEIGHTMAP_MAX_POINTS || values[2] <= values[0] || values[3] <= values[1] || values[8] <= 0.0f)
+        return Status_GcodeValueOutOfRange;
+
+    enabled = false;
+    memset(&map, 0, sizeof(heightmap_t));
+    map.nx = nx;
+    map.ny = ny;
+    map.x0 = values[0] + gc_get_offset(X_AXIS);
+    map.y0 = values[1] + gc_get_offset(Y_AXIS);
+    map.dx = (values[2] - values[0]) / (float)(nx - 1);
+    map.dy = (values[3] - values[1]) / (float)(ny - 1);
+    z_clear = values[6] + gc_get_offset(Z_AXIS);
+
+    probing = true;
+    system_convert_array_steps_to_mpos(target, sys.position);
+
+    for(y = 0; y < ny && map.nx; y++) {
+        for(idx = 0; idx < nx; idx++) {
+
+            x = y & 1 ? nx - 1 - idx : idx; // Serpentine path.
+
+            plan_data_init(&plan_data);
+            plan_data.condition.rapid_motion = On;
+
+            // Move to clearance height, then to the point.
+            target[Z_AXIS] = z_clear;
+            if(!mc_line(target, &plan_data)) {
+                map.nx = 0;
+                break;
+            }
+            target[X_AXIS] = map.x0 + map.dx * (float)x;
+            target[Y_AXIS] = map.y0 + map.dy * (float)y;
+            if(!mc_line(target, &plan_data)) {
+                map.nx = 0;
+                break;
+            }
+
+            plan_data.condition.rapid_motion = Off;
+            plan_data.feed_rate = values[8];
+            target[Z_AXIS] = z_clear - values[6] - values[7];
+
+            if(mc_probe_cycle(target, &plan_data, flags) != GCProbe_Found) {
+                map.nx = 0;
+                break;
+            }
+
+            float pos[N_AXIS];
+            system_convert_array_steps_to_mpos(pos, sys.probe_position);
+            map.z[y * nx + x] = pos[Z_AXIS];
+            memcpy(target, pos, sizeof(target));
+        }
+    }
+
+    probing = false;
+
+    if(map.nx == 0) {
+        memset(&map, 0, sizeof(heightmap_t));
+        gc_sync_position();
+        return sys.abort ? Status_Reset : Status_GcodeInvalidTarget; // Probing failed or aborted.
+    }
+
+    // Retract to clearance height.
+    plan_data_init(&plan_data);
+    plan_data.condition.rapid_motion = On;
+    target[Z_AXIS] = z_clear;
+    mc_line(target, &plan_data);
+    protocol_buffer_synchronize();
+    gc_sync_position();
+
+    for(idx = nx * ny; idx > 0; idx--)
+        map.z[idx - 1] -= map.z[0];
+
+    map.valid = true;
+
+    return Status_OK;
+}
+
+#endif // HEIGHTMAP_ENABLE
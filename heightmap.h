@@ -0,0 +1,53 @@
+/*
+  heightmap.h - grid probing and bilinear Z-height compensation
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _HEIGHTMAP_H_
+#define _HEIGHTMAP_H_
+
+#include "hal.h"
+
+#if HEIGHTMAP_ENABLE
+
+#ifndef HEIGHTMAP_MAX_POINTS
+#define HEIGHTMAP_MAX_POINTS 256
+#endif
+
+//! Height map, Z values are relative to the first (lower left) point.
+typedef struct {
+    float x0;                           //!< X position of first column, machine coordinates.
+    float y0;                           //!< Y position of first row, machine coordinates.
+    float dx;                           //!< Column spacing.
+    float dy;                           //!< Row spacing.
+    uint16_t nx;                        //!< Number of columns.
+    uint16_t ny;                        //!< Number of rows.
+    bool valid;                         //!< Set when all points have been probed.
+    float z[HEIGHTMAP_MAX_POINTS];      //!< Z offsets, row major.
+    uint32_t checksum;                  //!< Checksum of the above, used for file storage.
+} heightmap_t;
+
+bool heightmap_is_active (void);
+float heightmap_get_z (float x, float y);
+bool heightmap_line (float *target, plan_line_data_t *pl_data, bool (*line)(float *target, plan_line_data_t *pl_data));
+heightmap_t *heightmap_get (void);
+status_code_t heightmap_command (sys_state_t state, char *args);
+status_code_t heightmap_probe_command (sys_state_t state, char *args);
+
+#endif
+
+#endif
@@ -0,0 +1,153 @@
+/*
+  input_events.c - timestamped log of input signal events
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "hal.h"
+
+#if INPUT_EVENT_LOG_SIZE
+
+#include "input_events.h"
+#include "protocol.h"
+#include "report.h"
+
+#if INPUT_EVENT_LOG_SIZE & (INPUT_EVENT_LOG_SIZE - 1)
+#error "INPUT_EVENT_LOG_SIZE must be a power of 2!"
+#endif
+
+#ifndef INPUT_EVENT_AUX_PORTS
+#define INPUT_EVENT_AUX_PORTS 8 // Number of aux input ports that events can be logged for.
+#endif
+
+static struct {
+    volatile uint32_t head;     // Sequence number of the next event, incremented with interrupts disabled.
+    uint32_t streamed;          // Sequence number of the next event to be streamed.
+    bool stream;
+    bool hooked;
+    input_event_t event[INPUT_EVENT_LOG_SIZE];
+} events = {0};
+
+static ioport_register_interrupt_handler_ptr register_interrupt_handler;
+static ioport_interrupt_callback_ptr aux_callback[INPUT_EVENT_AUX_PORTS];
+
+/*! \brief Add an event to the log, may be called from interrupt context.
+\param source a \a input_event_source_t enum value.
+\param port aux input port number for #InputEvent_Aux events, 0 otherwise.
+\param signals signal state.
+*/
+ISR_CODE void ISR_FUNC(input_event_log)(input_event_source_t source, uint8_t port, input_event_signals_t signals)
+{
+    input_event_t *event;
+
+    hal.irq_disable();
+
+    event = &events.event[events.head++ & (INPUT_EVENT_LOG_SIZE - 1)];
+    event->time = hal.get_micros ? (uint32_t)hal.get_micros() : (hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0);
+    event->source = source;
+    event->port = port;
+    event->signals = signals;
+    memcpy(event->position, sys.position, sizeof(sys.position));
+
+    hal.irq_enable();
+}
+
+/*! \brief Get a logged event.
+\param seq pointer to the sequence number of the event to get, it is advanced to the oldest event still in the log
+if older and incremented on return.
+\returns pointer to the event, NULL if no more events are logged.
+__NOTE:__ The event may be overwritten by new events unless it is copied out with interrupts disabled.
+*/
+const input_event_t *input_events_get (uint32_t *seq)
+{
+    uint32_t head = events.head;
+
+    if(head - *seq > INPUT_EVENT_LOG_SIZE)
+        *seq = head - INPUT_EVENT_LOG_SIZE;
+
+    return *seq == head ? NULL : &events.event[(*seq)++ & (INPUT_EVENT_LOG_SIZE - 1)];
+}
+
+ISR_CODE static void ISR_FUNC(aux_interrupt)(uint8_t port, bool state)
+{
+    input_event_log(InputEvent_Aux, port, (input_event_signals_t){ .state = state });
+
+    if(aux_callback[port])
+        aux_callback[port](port, state);
+}
+
+// Inserts the logging handler for aux input interrupts for ports that can be logged.
+static bool register_aux_interrupt (uint8_t port, pin_irq_mode_t irq_mode, ioport_interrupt_callback_ptr interrupt_callback)
+{
+    bool ok;
+
+    if(port >= INPUT_EVENT_AUX_PORTS)
+        return register_interrupt_handler(port, irq_mode, interrupt_callback);
+
+    if((ok = register_interrupt_handler(port, irq_mode, interrupt_callback ? aux_interrupt : NULL)))
+        aux_callback[port] = interrupt_callback;
+
+    return ok;
+}
+
+static void stream_events (sys_state_t state)
+{
+    const input_event_t *event;
+
+    if(events.stream) while((event = input_events_get(&events.streamed)))
+        report_input_event(events.streamed - 1, event);
+}
+
+/*! \brief $EVL command handler.
+No argument outputs the logged events, CLEAR clears the log, ON and OFF enables and disables streaming of new events.
+*/
+status_code_t input_events_command (sys_state_t state, char *args)
+{
+    uint32_t seq = 0;
+    const input_event_t *event;
+
+    if(args == NULL) {
+        while((event = input_events_get(&seq)))
+            report_input_event(seq - 1, event);
+    } else if(!strcmp(args, "CLEAR")) {
+        hal.irq_disable();
+        events.head = events.streamed = 0;
+        hal.irq_enable();
+    } else if(!strcmp(args, "ON")) {
+        events.streamed = events.head;
+        if(!events.hooked)
+            events.hooked = protocol_register_realtime_hook("input events", stream_events, 0, false);
+        events.stream = events.hooked;
+    } else if(!strcmp(args, "OFF"))
+        events.stream = false;
+    else
+        return Status_InvalidStatement;
+
+    return Status_OK;
+}
+
+//! Hooks into aux input interrupt registration, called on startup after the driver is initialized.
+void input_events_init (void)
+{
+    if(hal.port.register_interrupt_handler && register_interrupt_handler == NULL) {
+        register_interrupt_handler = hal.port.register_interrupt_handler;
+        hal.port.register_interrupt_handler = register_aux_interrupt;
+    }
+}
+
+#endif // INPUT_EVENT_LOG_SIZE
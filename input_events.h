@@ -0,0 +1,57 @@
+/*
+  input_events.h - timestamped log of input signal events
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _INPUT_EVENTS_H_
+#define _INPUT_EVENTS_H_
+
+#include "hal.h"
+
+#if INPUT_EVENT_LOG_SIZE
+
+typedef enum {
+    InputEvent_Control = 0,
+    InputEvent_Limit,
+    InputEvent_Probe,
+    InputEvent_Aux
+} __attribute__ ((__packed__)) input_event_source_t;
+
+typedef union {
+    uint32_t value;
+    control_signals_t control;          //!< Control signals, for #InputEvent_Control events.
+    limit_signals_t limits;             //!< Limit signals, for #InputEvent_Limit events.
+    bool state;                         //!< Input state, for #InputEvent_Aux events.
+} input_event_signals_t;
+
+//! Input event log entry.
+typedef struct input_event {
+    uint32_t time;                      //!< Timestamp in microseconds if \a hal.get_micros is available, milliseconds otherwise.
+    input_event_source_t source;        //!< Source of the event.
+    uint8_t port;                       //!< Aux input port number, for #InputEvent_Aux events.
+    input_event_signals_t signals;      //!< Signal state.
+    int32_t position[N_AXIS];           //!< Machine position in steps.
+} input_event_t;
+
+void input_events_init (void);
+void input_event_log (input_event_source_t source, uint8_t port, input_event_signals_t signals);
+const input_event_t *input_events_get (uint32_t *seq);
+status_code_t input_events_command (sys_state_t state, char *args);
+
+#endif
+
+#endif
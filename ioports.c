@@ -28,8 +28,10 @@
  */
 
 #include <math.h>
+#include <string.h>
 
 #include "hal.h"
+#include "mem_stats.h"
 
 typedef struct {
     io_ports_detail_t *ports;
@@ -42,25 +44,61 @@ typedef struct {
     ioport_bus_t outx;
 } io_ports_cfg_t;
 
+#define IOPORTS_N_AUX 8      // Number of aux pin functions per type and direction, Input_Aux0 - Input_Aux7 etc.
+#define IOPORTS_NO_PORT 0xFF
+
 static driver_settings_load_ptr on_settings_loaded = NULL;
 static setting_changed_ptr on_setting_changed = NULL;
 static io_ports_cfg_t analog, digital;
 static int16_t digital_in = -1, digital_out = -1, analog_in = -1, analog_out = -1;
+static uint8_t aux_port[2][2][IOPORTS_N_AUX]; // Port number by type, direction and aux number, built when ports are counted.
+
+#if IOPORTS_DIRECT_OUTPUT_ENABLE
+
+static struct {
+    uint8_t n_ports;
+    digital_out_ptr digital_out;    // Driver handler, used for ports not linked.
+    xbar_t pin[IOPORTS_N_AUX];      // Copies of the pin info for digital outputs providing a set_value handler.
+} direct_out = {0};
+
+#endif
 
+static inline uint8_t aux_base (io_port_type_t type, io_port_direction_t dir)
+{
+    return type == Port_Digital
+            ? (dir == Port_Input ? Input_Aux0 : Output_Aux0)
+            : (dir == Port_Input ? Input_Analog_Aux0 : Output_Analog_Aux0);
+}
+
+// Counts the ports and builds the aux number to port number map.
 static uint8_t ioports_count (io_port_type_t type, io_port_direction_t dir)
 {
     xbar_t *port;
-    uint8_t n_ports = 0;
+    uint8_t n_ports = 0, base = aux_base(type, dir);
+
+    memset(aux_port[type][dir], IOPORTS_NO_PORT, IOPORTS_N_AUX);
 
     // determine how many ports, including claimed ports, that are available
     do {
-        if((port = hal.port.get_pin_info(type, dir, n_ports)))
+        if((port = hal.port.get_pin_info(type, dir, n_ports))) {
+            if(port->function >= base && port->function < base + IOPORTS_N_AUX)
+                aux_port[type][dir][port->function - base] = n_ports;
             n_ports++;
+        }
     } while(port != NULL);
 
     return n_ports;
 }
 
+// Invalidates the cached port counts and maps, they are rebuilt on next use.
+static void ioports_invalidate (io_port_type_t type)
+{
+    if(type == Port_Digital)
+        digital_in = digital_out = -1;
+    else
+        analog_in = analog_out = -1;
+}
+
 /*! \brief Get number of digital or analog ports available.
 \param type as an \a #io_port_type_t enum value.
 \param dir as an \a #io_port_direction_t enum value.
@@ -104,22 +142,21 @@ bool ioport_claim (io_port_type_t type, io_port_direction_t dir, uint8_t *port,
 {
     bool ok = false;
     uint8_t n_ports = ioports_available(type, dir);
-    uint8_t base = type == Port_Digital
-                    ? (dir == Port_Input ? Input_Aux0 : Output_Aux0)
-                    : (dir == Port_Input ? Input_Analog_Aux0 : Output_Analog_Aux0);
 
     if(hal.port.claim != NULL) {
 
         xbar_t *portinfo;
 
-        if(n_ports > 0) do {
-            n_ports--;
-            portinfo = hal.port.get_pin_info(type, dir, n_ports);
-            if((ok = portinfo && !portinfo->mode.claimed && (portinfo->function - base) == *port)) {
-                ok = hal.port.claim(type, dir, port, description);
-                break;
-            }
-        } while(n_ports && !ok);
+        // Port numbers may change when a port is claimed, the map is rebuilt on next use.
+        if(n_ports > 0 && *port < IOPORTS_N_AUX && (n_ports = aux_port[type][dir][*port]) != IOPORTS_NO_PORT &&
+            (portinfo = hal.port.get_pin_info(type, dir, n_ports)) && !portinfo->mode.claimed &&
+             (ok = hal.port.claim(type, dir, port, description))) {
+            ioports_invalidate(type);
+#if IOPORTS_DIRECT_OUTPUT_ENABLE
+            if(type == Port_Digital && dir == Port_Output)
+                ioports_link_outputs();
+#endif
+        }
 
     } else if((ok = n_ports > 0)) {
 
@@ -158,6 +195,48 @@ bool ioports_enumerate (io_port_type_t type, io_port_direction_t dir, pin_cap_t
     return ok;
 }
 
+#if IOPORTS_DIRECT_OUTPUT_ENABLE
+
+ISR_CODE static void ISR_FUNC(digital_out_direct)(uint8_t port, bool on)
+{
+    if(port < direct_out.n_ports && direct_out.pin[port].set_value)
+        direct_out.pin[port].set_value(&direct_out.pin[port], on ? 1.0f : 0.0f);
+    else
+        direct_out.digital_out(port, on);
+}
+
+/*! \brief Link digital output ports directly to the pin set_value handlers.
+
+Copies the pin info of all unclaimed digital outputs and replaces the \a hal.port.digital_out handler with
+one that calls the pin set_value handler directly, ports without a set_value handler are passed to the driver handler.
+Called on startup after the driver and plugins are initialized and when a digital output is claimed.
+*/
+void ioports_link_outputs (void)
+{
+    xbar_t *portinfo;
+    uint_fast8_t port;
+
+    if(direct_out.digital_out == NULL) {
+        if(hal.port.digital_out == NULL || hal.port.get_pin_info == NULL)
+            return;
+        direct_out.digital_out = hal.port.digital_out;
+    }
+
+    direct_out.n_ports = 0; // Disable links while updating.
+
+    for(port = 0; port < min(hal.port.num_digital_out, IOPORTS_N_AUX); port++) {
+        if((portinfo = hal.port.get_pin_info(Port_Digital, Port_Output, port)) && !portinfo->mode.claimed)
+            memcpy(&direct_out.pin[port], portinfo, sizeof(xbar_t));
+        else
+            direct_out.pin[port].set_value = NULL;
+    }
+
+    direct_out.n_ports = port;
+    hal.port.digital_out = digital_out_direct;
+}
+
+#endif // IOPORTS_DIRECT_OUTPUT_ENABLE
+
 /* experimental code follows */
 
 static char *get_pnum (io_ports_data_t *ports, uint8_t port)
@@ -172,41 +251,41 @@ bool ioports_add (io_ports_data_t *ports, io_port_type_t type, uint8_t n_in, uin
 
     ports->get_pnum = get_pnum;
 
+    ioports_invalidate(type);
+
     if(type == Port_Digital) {
 
         cfg = &digital;
-        digital_in = digital_out = -1;
 
         if(n_in) {
             ports->in.n_start = hal.port.num_digital_in;
             hal.port.num_digital_in += (ports->in.n_ports = n_in);
-            ports->in.map = malloc(ports->in.n_ports * sizeof(ports->in.n_ports));
+            ports->in.map = mem_alloc(MemTag_IOPorts, ports->in.n_ports * sizeof(ports->in.n_ports));
             digital.in.ports = &ports->in;
         }
 
         if(n_out) {
             ports->out.n_start = hal.port.num_digital_out;
             hal.port.num_digital_out += (ports->out.n_ports = n_out);
-            ports->out.map = malloc(ports->out.n_ports * sizeof(ports->out.n_ports));
+            ports->out.map = mem_alloc(MemTag_IOPorts, ports->out.n_ports * sizeof(ports->out.n_ports));
             digital.out.ports = &ports->out;
         }
 
     } else {
 
         cfg = &analog;
-        analog_in = analog_out = -1;
 
         if(n_in) {
             ports->in.n_start = hal.port.num_analog_in;
             hal.port.num_analog_in += (ports->in.n_ports = n_in);
-            ports->in.map = malloc(ports->in.n_ports * sizeof(ports->in.n_ports));
+            ports->in.map = mem_alloc(MemTag_IOPorts, ports->in.n_ports * sizeof(ports->in.n_ports));
             analog.in.ports = &ports->in;
         }
 
         if(n_out) {
             ports->out.n_start = hal.port.num_analog_out;
             hal.port.num_analog_out += (ports->out.n_ports = n_out);
-            ports->out.map = malloc(ports->out.n_ports * sizeof(ports->out.n_ports));
+            ports->out.map = mem_alloc(MemTag_IOPorts, ports->out.n_ports * sizeof(ports->out.n_ports));
             analog.out.ports = &ports->out;
         }
     }
@@ -216,7 +295,7 @@ bool ioports_add (io_ports_data_t *ports, io_port_type_t type, uint8_t n_in, uin
         char *pn;
         uint_fast8_t i;
 
-        if((ports->pnum = pn = malloc((3 * n_ports + (n_ports > 9 ? n_ports - 10 : 0)) + 1)))
+        if((ports->pnum = pn = mem_alloc(MemTag_IOPorts, (3 * n_ports + (n_ports > 9 ? n_ports - 10 : 0)) + 1)))
           for(i = 0; i < n_ports; i++) {
 
             if(pn) {
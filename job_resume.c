@@ -0,0 +1,270 @@
+/*
+  job_resume.c - checkpointing of file jobs for resume after an interruption
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stddef.h>
+
+#include "hal.h"
+
+#if JOB_RESUME_ENABLE
+
+#include "job_resume.h"
+#include "protocol.h"
+#include "planner.h"
+#include "ngc_flowctrl.h"
+
+#ifndef JOB_RESUME_INTERVAL
+#define JOB_RESUME_INTERVAL 20          // Number of blocks between checkpoints.
+#endif
+#ifndef JOB_RESUME_CHECKPOINTS
+#define JOB_RESUME_CHECKPOINTS 8        // Number of pending checkpoints, JOB_RESUME_INTERVAL * JOB_RESUME_CHECKPOINTS should exceed the planner buffer size.
+#endif
+#ifndef JOB_RESUME_PERSIST_PERIOD
+#define JOB_RESUME_PERSIST_PERIOD 5000  // Minimum time in ms between writes of the checkpoint file.
+#endif
+#ifndef JOB_RESUME_FILE
+#define JOB_RESUME_FILE "/job.rsm"
+#endif
+
+static struct {
+    bool hooked;
+    vfs_file_t *file;           // File job being checkpointed.
+    uint32_t block;             // Number of blocks executed from the file.
+    uint_fast8_t head;          // Next free checkpoint.
+    uint_fast8_t count;         // Number of pending checkpoints.
+    uint32_t persisted;         // Block number of last persisted checkpoint.
+    job_checkpoint_t pending[JOB_RESUME_CHECKPOINTS];
+} job = {0};
+
+static job_checkpoint_t checkpoint;
+
+static uint32_t checkpoint_checksum (job_checkpoint_t *cp)
+{
+    return calc_checksum((uint8_t *)cp, offsetof(job_checkpoint_t, checksum));
+}
+
+// Persists the newest pending checkpoint for which all blocks have been executed by the stepper module.
+static void job_persist (sys_state_t state)
+{
+    uint_fast8_t idx, oldest;
+    uint32_t completed;
+    vfs_file_t *file;
+    plan_block_t *block;
+    job_checkpoint_t *cp = NULL;
+
+    if(job.count == 0)
+        return;
+
+    if((block = plan_get_current_block())) {
+        if(block->job_block == 0) // Not from the file job, e.g. a tool change macro.
+            return;
+        completed = block->job_block - 1;
+    } else
+        completed = job.block;
+
+    // Find newest completed checkpoint, it and older ones are released.
+    oldest = (job.head + JOB_RESUME_CHECKPOINTS - job.count) % JOB_RESUME_CHECKPOINTS;
+    idx = job.count;
+    while(idx) {
+        if(job.pending[(oldest + idx - 1) % JOB_RESUME_CHECKPOINTS].block <= completed) {
+            cp = &job.pending[(oldest + idx - 1) % JOB_RESUME_CHECKPOINTS];
+            break;
+        }
+        idx--;
+    }
+
+    if(cp == NULL)
+        return;
+
+    job.count -= idx;
+
+    if((file = vfs_open(JOB_RESUME_FILE, "w"))) {
+        cp->checksum = checkpoint_checksum(cp);
+        vfs_write(cp, sizeof(job_checkpoint_t), 1, file);
+        vfs_close(file);
+        job.persisted = cp->block;
+    }
+}
+
+//! Returns the block number to be assigned to the block being executed, 0 if not executing a file job.
+uint32_t job_resume_next_block (void)
+{
+    return hal.stream.file ? (hal.stream.file == job.file ? job.block : 0) + 1 : 0;
+}
+
+//! Called by the parser when a block from a file job has been successfully executed.
+void job_resume_block_executed (void)
+{
+    if(hal.stream.file == NULL)
+        return;
+
+    if(hal.stream.file != job.file) {
+        job.file = hal.stream.file;
+        job.block = job.persisted = 0;
+        job.head = job.count = 0;
+        if(!job.hooked)
+            job.hooked = protocol_register_realtime_hook("job resume", job_persist, JOB_RESUME_PERSIST_PERIOD, false);
+    }
+
+    job.block++;
+
+    // Loops, conditionals and subroutine calls cannot be resumed from a file offset.
+    // Scaling (G51), constant surface speed (G96) and canned cycle or threading parameters are not checkpointed,
+    // the previous checkpoint is kept while active.
+    if(job.block % JOB_RESUME_INTERVAL || gc_state.skip_blocks || gc_state.modal.scaling_active ||
+        gc_state.modal.spindle.rpm_mode == SpindleSpeedMode_CSS || gc_state.modal.canned_cycle_active ||
+         gc_state.modal.motion == MotionMode_Threading)
+        return;
+
+#if NGC_EXPRESSIONS_ENABLE
+    if(ngc_flowctrl_active())
+        return;
+#endif
+
+    job_checkpoint_t *cp = &job.pending[job.head];
+
+    cp->block = job.block;
+    cp->offset = vfs_tell(job.file);
+    cp->size = job.file->size;
+    memcpy(&cp->modal, &gc_state.modal, sizeof(gc_modal_t));
+    cp->feed_rate = gc_state.feed_rate;
+    cp->rpm = gc_state.spindle.rpm;
+    memcpy(cp->position, gc_state.position, sizeof(gc_state.position));
+    memcpy(cp->g92_offset, gc_state.g92_coord_offset, sizeof(gc_state.g92_coord_offset));
+    cp->g92_offset_applied = gc_state.g92_coord_offset_applied;
+    memcpy(cp->tool_length_offset, gc_state.tool_length_offset, sizeof(gc_state.tool_length_offset));
+    cp->tool = gc_state.tool ? gc_state.tool->tool_id : 0;
+
+    job.head = (job.head + 1) % JOB_RESUME_CHECKPOINTS;
+    if(job.count < JOB_RESUME_CHECKPOINTS)
+        job.count++;
+}
+
+//! Called by the parser on program end, removes the checkpoint file.
+void job_resume_job_completed (void)
+{
+    if(job.file && job.file == hal.stream.file) {
+        job.file = NULL;
+        job.count = 0;
+        vfs_unlink(JOB_RESUME_FILE);
+    }
+}
+
+/*! \brief Load the last persisted checkpoint.
+\returns pointer to the checkpoint, NULL if none available or it is invalid.
+*/
+job_checkpoint_t *job_resume_load (void)
+{
+    bool ok = false;
+    vfs_file_t *file;
+
+    if((file = vfs_open(JOB_RESUME_FILE, "r"))) {
+        ok = vfs_read(&checkpoint, sizeof(job_checkpoint_t), 1, file) == 1 && checkpoint.checksum == checkpoint_checksum(&checkpoint);
+        vfs_close(file);
+    }
+
+    return ok ? &checkpoint : NULL;
+}
+
+/*! \brief Restore parser modal state from a checkpoint and seek the job file to the next block.
+Spindle and coolant are restarted, motion is not. The tool should be positioned by the operator,
+or by the caller, at or above the checkpoint position before the job is continued.
+\param file pointer to the \a vfs_file_t structure of the job file, must be the file the checkpoint was created for.
+\param checkpoint pointer to a \a job_checkpoint_t structure, typically returned by job_resume_load().
+\returns status code.
+*/
+status_code_t job_resume_restore (vfs_file_t *file, job_checkpoint_t *checkpoint)
+{
+    status_code_t status;
+    char line[LINE_BUFFER_SIZE];
+    gc_modal_t *modal = &checkpoint->modal;
+
+    if(file->size != checkpoint->size || checkpoint->offset > file->size)
+        return Status_InvalidStatement;
+
+    // Scaling, constant surface speed, canned cycle and threading state cannot be restored.
+    if(modal->scaling_active || modal->spindle.rpm_mode == SpindleSpeedMode_CSS ||
+        modal->canned_cycle_active || modal->motion == MotionMode_Threading)
+        return Status_InvalidStatement;
+
+    // Feed rate is stored in mm/min, set it before units are restored.
+    strcpy(line, "G21G94F");
+    strcat(line, ftoa(checkpoint->feed_rate, 3));
+    if((status = gc_execute_block(line)) != Status_OK)
+        return status;
+
+    strcpy(line, modal->units_imperial ? "G20" : "G21");
+    strcat(line, modal->distance_incremental ? "G91" : "G90");
+    strcat(line, modal->plane_select == PlaneSelect_ZX ? "G18" : (modal->plane_select == PlaneSelect_YZ ? "G19" : "G17"));
+    if(modal->coord_system.id < CoordinateSystem_G59_1) {
+        strcat(line, "G");
+        strcat(line, uitoa(54 + modal->coord_system.id));
+    } else {
+        strcat(line, "G59.");
+        strcat(line, uitoa(modal->coord_system.id - CoordinateSystem_G59));
+    }
+    if((status = gc_execute_block(line)) != Status_OK)
+        return status;
+
+    if(checkpoint->tool) {
+        strcpy(line, "M61Q");
+        strcat(line, uitoa(checkpoint->tool));
+        if((status = gc_execute_block(line)) != Status_OK)
+            return status;
+    }
+
+    if(modal->spindle.state.on) {
+        strcpy(line, modal->spindle.state.ccw ? "M4S" : "M3S");
+        strcat(line, ftoa(checkpoint->rpm, 1));
+        if((status = gc_execute_block(line)) != Status_OK)
+            return status;
+    }
+
+    if(modal->coolant.mist && (status = gc_execute_block(strcpy(line, "M7"))) != Status_OK)
+        return status;
+
+    if(modal->coolant.flood && (status = gc_execute_block(strcpy(line, "M8"))) != Status_OK)
+        return status;
+
+    if(modal->feed_mode != FeedMode_UnitsPerMin &&
+        (status = gc_execute_block(strcpy(line, modal->feed_mode == FeedMode_InverseTime ? "G93" : "G95"))) != Status_OK)
+        return status;
+
+    // Restore offsets and modes that are set by commands with side effects (motion or offsets persisted).
+    memcpy(gc_state.g92_coord_offset, checkpoint->g92_offset, sizeof(gc_state.g92_coord_offset));
+    gc_state.g92_coord_offset_applied = checkpoint->g92_offset_applied;
+    memcpy(gc_state.tool_length_offset, checkpoint->tool_length_offset, sizeof(gc_state.tool_length_offset));
+    gc_state.modal.tool_offset_mode = modal->tool_offset_mode;
+    gc_state.modal.diameter_mode = modal->diameter_mode;
+    gc_state.modal.retract_mode = modal->retract_mode;
+    gc_state.modal.motion = modal->motion;
+    system_add_rt_report(Report_ToolOffset);
+    system_flag_wco_change();
+
+    if(vfs_seek(file, checkpoint->offset) != 0)
+        return Status_SDReadError;
+
+    job.file = file;
+    job.block = job.persisted = checkpoint->block;
+    job.head = job.count = 0;
+
+    return Status_OK;
+}
+
+#endif // JOB_RESUME_ENABLE
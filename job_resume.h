@@ -0,0 +1,51 @@
+/*
+  job_resume.h - checkpointing of file jobs for resume after an interruption
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _JOB_RESUME_H_
+#define _JOB_RESUME_H_
+
+#include "hal.h"
+
+#if JOB_RESUME_ENABLE
+
+//! Job checkpoint, the state of the parser after the block at \a offset - 1 was executed.
+typedef struct {
+    uint32_t block;                 //!< Number of blocks executed from the file.
+    uint32_t offset;                //!< File offset of the next block.
+    uint32_t size;                  //!< File size, used to validate the checkpoint against the file on resume.
+    gc_modal_t modal;               //!< Modal state.
+    float feed_rate;                //!< Feed rate, mm/min.
+    float rpm;                      //!< Spindle speed.
+    float position[N_AXIS];         //!< Target position of the last completed block, machine coordinates.
+    float g92_offset[N_AXIS];       //!< G92 coordinate offset.
+    bool g92_offset_applied;        //!< True when the G92 offset is applied.
+    float tool_length_offset[N_AXIS]; //!< Tool length offset, G43.
+    tool_id_t tool;                 //!< Current tool number.
+    uint32_t checksum;              //!< Checksum of the above.
+} job_checkpoint_t;
+
+uint32_t job_resume_next_block (void);
+void job_resume_block_executed (void);
+void job_resume_job_completed (void);
+job_checkpoint_t *job_resume_load (void);
+status_code_t job_resume_restore (vfs_file_t *file, job_checkpoint_t *checkpoint);
+
+#endif
+
+#endif
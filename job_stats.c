@@ -0,0 +1,213 @@
+/*
+  job_stats.c - per job runtime statistics
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// A job starts on the first cycle start after the previous job is completed by M2 or M30, or aborted
+// by a soft reset or an alarm, and statistics are reset then. Buffer fill levels are sampled at a fixed interval while running.
+//
+
+#include <string.h>
+
+#include "hal.h"
+
+#if JOB_STATS_ENABLE
+
+#include "job_stats.h"
+#include "report.h"
+
+#ifndef JOB_STATS_SAMPLE_INTERVAL
+#define JOB_STATS_SAMPLE_INTERVAL 10 // ms, interval between buffer fill samples.
+#endif
+
+static job_stats_t stats = {0};
+static sys_state_t state = STATE_IDLE;
+static uint32_t state_entered, last_sample;
+static on_state_change_ptr on_state_change;
+static on_override_changed_ptr on_override_changed;
+static on_program_completed_ptr on_program_completed;
+static on_execute_realtime_ptr on_execute_realtime;
+static on_reset_ptr on_reset;
+
+static const char *const state_names[JOB_STATS_STATES] = {
+    "Idle", "Alarm", "Check", "Home", "Run", "Hold", "Jog", "Door", "Sleep", "EStop", "Tool"
+};
+
+static uint_fast8_t state_index (sys_state_t state)
+{
+    uint_fast8_t idx = 0;
+
+    while(state && idx < JOB_STATS_STATES - 1) {
+        idx++;
+        if(state & 1)
+            break;
+        state >>= 1;
+    }
+
+    return state ? idx : 0;
+}
+
+static void account_state_time (uint32_t now)
+{
+    stats.state_time[state_index(state)] += now - state_entered;
+    state_entered = now;
+}
+
+static void job_start (uint32_t now)
+{
+    memset(&stats, 0, sizeof(job_stats_t));
+    stats.active = true;
+    stats.started = state_entered = last_sample = now;
+    stats.feed_override_min = stats.feed_override_max = sys.override.feed_rate;
+}
+
+// Ends the job, the statistics are kept until the next job starts. May be called from interrupt context.
+static void job_end (void)
+{
+    job_stats_get();
+    stats.active = false;
+}
+
+static void on_state_changed (sys_state_t new_state)
+{
+    uint32_t now = hal.get_elapsed_ticks();
+
+    if(new_state == STATE_CYCLE && !stats.active)
+        job_start(now);
+    else if(stats.active) {
+        account_state_time(now);
+        if(new_state & (STATE_ALARM|STATE_ESTOP))
+            job_end(); // Job aborted.
+    }
+
+    state = new_state;
+
+    if(on_state_change)
+        on_state_change(new_state);
+}
+
+static void on_overrides_changed (override_changed_t override)
+{
+    if(stats.active) {
+        stats.override_changes++;
+        stats.feed_override_min = min(stats.feed_override_min, sys.override.feed_rate);
+        stats.feed_override_max = max(stats.feed_override_max, sys.override.feed_rate);
+    }
+
+    if(on_override_changed)
+        on_override_changed(override);
+}
+
+static void on_job_completed (program_flow_t program_flow, bool check_mode)
+{
+    if(stats.active && !check_mode) {
+        job_end();
+        report_job_stats();
+    }
+
+    if(on_program_completed)
+        on_program_completed(program_flow, check_mode);
+}
+
+// Soft reset aborts the job, called from interrupt context.
+static void on_soft_reset (void)
+{
+    if(stats.active)
+        job_end();
+
+    if(on_reset)
+        on_reset();
+}
+
+static void sample_buffers (sys_state_t sys_state)
+{
+    uint32_t now;
+
+    if(stats.active && sys_state == STATE_CYCLE && (now = hal.get_elapsed_ticks()) - last_sample >= JOB_STATS_SAMPLE_INTERVAL) {
+
+        uint_fast16_t size = plan_get_buffer_size();
+
+        stats.planner_fill[(size - plan_get_block_buffer_available()) * JOB_STATS_BINS / (size + 1)]++;
+        stats.segment_fill[st_get_segment_buffer_fill() * JOB_STATS_BINS / SEGMENT_BUFFER_SIZE]++;
+
+        if(sys.override.feed_rate != DEFAULT_FEED_OVERRIDE || sys.override.rapid_rate != DEFAULT_RAPID_OVERRIDE)
+            stats.override_time += now - last_sample;
+
+        last_sample = now;
+    }
+
+    on_execute_realtime(sys_state);
+}
+
+/*! \brief Account for a planner block, to be called by the step segment generator when a new block is loaded.
+\param block pointer to the planner block.
+\param limited \a true if the velocity profile does not reach the nominal speed of the block.
+*/
+void job_stats_block (plan_block_t *block, bool limited)
+{
+    if(stats.active && !block->condition.system_motion) {
+        if(block->condition.rapid_motion)
+            stats.distance_rapid += block->millimeters;
+        else {
+            stats.distance_feed += block->millimeters;
+            stats.blocks++;
+            if(limited)
+                stats.blocks_limited++;
+        }
+    }
+}
+
+//! Returns pointer to the statistics of the running or last job, with times updated if running.
+job_stats_t *job_stats_get (void)
+{
+    if(stats.active) {
+        uint32_t now = hal.get_elapsed_ticks();
+        account_state_time(now);
+        stats.duration = now - stats.started;
+    }
+
+    return &stats;
+}
+
+const char *job_stats_state_name (uint_fast8_t idx)
+{
+    return idx < JOB_STATS_STATES ? state_names[idx] : "?";
+}
+
+void job_stats_init (void)
+{
+    if(hal.get_elapsed_ticks == NULL)
+        return;
+
+    on_state_change = grbl.on_state_change;
+    grbl.on_state_change = on_state_changed;
+
+    on_override_changed = grbl.on_override_changed;
+    grbl.on_override_changed = on_overrides_changed;
+
+    on_program_completed = grbl.on_program_completed;
+    grbl.on_program_completed = on_job_completed;
+
+    on_execute_realtime = grbl.on_execute_realtime;
+    grbl.on_execute_realtime = sample_buffers;
+
+    on_reset = grbl.on_reset;
+    grbl.on_reset = on_soft_reset;
+}
+
+#endif // JOB_STATS_ENABLE
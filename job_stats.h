@@ -0,0 +1,54 @@
+/*
+  job_stats.h - per job runtime statistics
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _JOB_STATS_H_
+#define _JOB_STATS_H_
+
+#include "hal.h"
+
+#if JOB_STATS_ENABLE
+
+#define JOB_STATS_BINS 8    // Number of histogram bins, each covers 1/8 of the buffer size.
+#define JOB_STATS_STATES 11 // Idle and one for each state flag.
+
+typedef struct {
+    bool active;                                //!< Job is running, set on first cycle start after the previous job completed or was aborted.
+    uint32_t started;                           //!< Start time in ms.
+    uint32_t duration;                          //!< Run time in ms.
+    uint32_t state_time[JOB_STATS_STATES];      //!< Time spent in each state in ms, index 0 is idle, n is for state flag bit n - 1.
+    float distance_feed;                        //!< Distance of feed motions in mm.
+    float distance_rapid;                       //!< Distance of rapid motions in mm.
+    uint32_t blocks;                            //!< Number of feed motion blocks executed.
+    uint32_t blocks_limited;                    //!< Number of feed motion blocks that did not reach nominal speed.
+    uint32_t planner_fill[JOB_STATS_BINS];      //!< Planner buffer fill histogram, samples taken while running.
+    uint32_t segment_fill[JOB_STATS_BINS];      //!< Step segment buffer fill histogram, samples taken while running.
+    uint32_t override_changes;                  //!< Number of override changes.
+    uint32_t override_time;                     //!< Time in ms spent running with feed or rapid override not at 100%.
+    override_t feed_override_min;               //!< Lowest feed override used.
+    override_t feed_override_max;               //!< Highest feed override used.
+} job_stats_t;
+
+void job_stats_init (void);
+void job_stats_block (plan_block_t *block, bool limited);
+job_stats_t *job_stats_get (void);
+const char *job_stats_state_name (uint_fast8_t idx);
+
+#endif
+
+#endif
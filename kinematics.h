@@ -35,4 +35,17 @@ typedef struct {
 
 extern kinematics_t kinematics;
 
+// Calls made for every motion are bound at compile time when KINEMATICS_STATIC is enabled and
+// CoreXY is the only kinematics selected, otherwise they go through the kinematics_t pointers.
+#if KINEMATICS_STATIC && COREXY && !(WALL_PLOTTER || DELTA_ROBOT || POLAR_ROBOT || SCARA || MASLOW_ROUTER)
+#include "kinematics/corexy.h"
+#define kinematics_segment_line corexy_segment_line
+#define kinematics_transform_from_cartesian corexy_transform_from_cartesian
+#define kinematics_limits_get_axis_mask corexy_limits_get_axis_mask
+#else
+#define kinematics_segment_line kinematics.segment_line
+#define kinematics_transform_from_cartesian kinematics.transform_from_cartesian
+#define kinematics_limits_get_axis_mask kinematics.limits_get_axis_mask
+#endif
+
 #endif
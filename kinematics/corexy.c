@@ -30,11 +30,7 @@
 #include "../settings.h"
 #include "../planner.h"
 #include "../kinematics.h"
-
-// CoreXY motor assignments. DO NOT ALTER.
-// NOTE: If the A and B motor axis bindings are changed, this effects the CoreXY equations.
-#define A_MOTOR X_AXIS // Must be X_AXIS
-#define B_MOTOR Y_AXIS // Must be Y_AXIS
+#include "corexy.h"
 
 static on_report_options_ptr on_report_options;
 
@@ -63,25 +59,6 @@ static float *corexy_convert_array_steps_to_mpos (float *position, int32_t *step
     return position;
 }
 
-// Transform position from cartesian coordinate system to corexy coordinate system
-static inline float *transform_from_cartesian (float *target, float *position)
-{
-    uint_fast8_t idx;
-
-    target[X_AXIS] = position[X_AXIS] + position[Y_AXIS];
-    target[Y_AXIS] = position[X_AXIS] - position[Y_AXIS];
-
-    for(idx = Z_AXIS; idx < N_AXIS; idx++)
-        target[idx] = position[idx];
-
-    return target;
-}
-
-static uint_fast8_t corexy_limits_get_axis_mask (uint_fast8_t idx)
-{
-    return ((idx == A_MOTOR) || (idx == B_MOTOR)) ? (bit(X_AXIS) | bit(Y_AXIS)) : bit(idx);
-}
-
 
 static void corexy_limits_set_target_pos (uint_fast8_t idx) // fn name?
 {
@@ -150,48 +127,6 @@ static void corexy_limits_set_machine_positions (axes_signals_t cycle)
     } while(idx);
 }
 
-static inline float get_distance (float *p0, float *p1)
-{
-    uint_fast8_t idx = N_AXIS;
-    float distance = 0.0f;
-
-    do {
-        idx--;
-        distance += (p0[idx] - p1[idx]) * (p0[idx] - p1[idx]);
-    } while(idx);
-
-    return sqrtf(distance);
-}
-
-// called from mc_line() to segment lines if not overridden, default implementation for pass-through
-static float *kinematics_segment_line (float *target, float *position, plan_line_data_t *pl_data, bool init)
-{
-    static uint_fast8_t iterations;
-    static float trsf[N_AXIS];
-
-    if(init) {
-
-        iterations = 2;
-
-        transform_from_cartesian(trsf, target);
-
-        if(!pl_data->condition.rapid_motion) {
-
-            uint_fast8_t idx;
-            float cpos[N_AXIS];
-
-            cpos[X_AXIS] = (position[X_AXIS] + position[Y_AXIS]) * .5f;
-            cpos[Y_AXIS] = (position[X_AXIS] - position[Y_AXIS]) * .5f;
-            for(idx = Z_AXIS; idx < N_AXIS; idx++)
-                cpos[idx] = position[idx];
-
-            pl_data->feed_rate *= get_distance(trsf, position) / get_distance(target, cpos);
-        }
-    }
-
-    return iterations-- == 0 ? NULL : trsf;
-}
-
 static bool homing_cycle_validate (axes_signals_t cycle)
 {
     return (cycle.mask & (X_AXIS_BIT|Y_AXIS_BIT)) == 0 || cycle.mask < 3;
@@ -216,9 +151,9 @@ void corexy_init (void)
     kinematics.limits_set_target_pos = corexy_limits_set_target_pos;
     kinematics.limits_get_axis_mask = corexy_limits_get_axis_mask;
     kinematics.limits_set_machine_positions = corexy_limits_set_machine_positions;
-    kinematics.transform_from_cartesian = transform_from_cartesian;
+    kinematics.transform_from_cartesian = corexy_transform_from_cartesian;
     kinematics.transform_steps_to_cartesian = corexy_convert_array_steps_to_mpos;
-    kinematics.segment_line = kinematics_segment_line;
+    kinematics.segment_line = corexy_segment_line;
     kinematics.homing_cycle_validate = homing_cycle_validate;
     kinematics.homing_cycle_get_feedrate = homing_cycle_get_feedrate;
 
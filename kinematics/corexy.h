@@ -23,6 +23,77 @@
 #ifndef _COREXY_H_
 #define _COREXY_H_
 
+#include <math.h>
+
+// CoreXY motor assignments. DO NOT ALTER.
+// NOTE: If the A and B motor axis bindings are changed, this effects the CoreXY equations.
+#define A_MOTOR X_AXIS // Must be X_AXIS
+#define B_MOTOR Y_AXIS // Must be Y_AXIS
+
+// The functions below are called for every motion, they are defined here so that they can be
+// inlined in mc_line() and the homing code when KINEMATICS_STATIC is enabled.
+
+// Transform position from cartesian coordinate system to corexy coordinate system
+static inline float *corexy_transform_from_cartesian (float *target, float *position)
+{
+    uint_fast8_t idx;
+
+    target[X_AXIS] = position[X_AXIS] + position[Y_AXIS];
+    target[Y_AXIS] = position[X_AXIS] - position[Y_AXIS];
+
+    for(idx = Z_AXIS; idx < N_AXIS; idx++)
+        target[idx] = position[idx];
+
+    return target;
+}
+
+static inline uint_fast8_t corexy_limits_get_axis_mask (uint_fast8_t idx)
+{
+    return ((idx == A_MOTOR) || (idx == B_MOTOR)) ? (bit(X_AXIS) | bit(Y_AXIS)) : bit(idx);
+}
+
+static inline float corexy_get_distance (float *p0, float *p1)
+{
+    uint_fast8_t idx = N_AXIS;
+    float distance = 0.0f;
+
+    do {
+        idx--;
+        distance += (p0[idx] - p1[idx]) * (p0[idx] - p1[idx]);
+    } while(idx);
+
+    return sqrtf(distance);
+}
+
+// called from mc_line() to segment lines if not overridden, default implementation for pass-through
+static inline float *corexy_segment_line (float *target, float *position, plan_line_data_t *pl_data, bool init)
+{
+    static uint_fast8_t iterations;
+    static float trsf[N_AXIS];
+
+    if(init) {
+
+        iterations = 2;
+
+        corexy_transform_from_cartesian(trsf, target);
+
+        if(!pl_data->condition.rapid_motion) {
+
+            uint_fast8_t idx;
+            float cpos[N_AXIS];
+
+            cpos[X_AXIS] = (position[X_AXIS] + position[Y_AXIS]) * .5f;
+            cpos[Y_AXIS] = (position[X_AXIS] - position[Y_AXIS]) * .5f;
+            for(idx = Z_AXIS; idx < N_AXIS; idx++)
+                cpos[idx] = position[idx];
+
+            pl_data->feed_rate *= corexy_get_distance(trsf, position) / corexy_get_distance(target, cpos);
+        }
+    }
+
+    return iterations-- == 0 ? NULL : trsf;
+}
+
 // Initialize HAL pointers for CoreXY kinematics
 void corexy_init (void);
 
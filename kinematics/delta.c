@@ -42,6 +42,11 @@
 #define B_MOTOR Y_AXIS
 #define C_MOTOR Z_AXIS
 
+// Number of segment end points transformed per call to delta_calcInverse_batch().
+#ifndef DELTA_IK_BATCH_SIZE
+#define DELTA_IK_BATCH_SIZE 8
+#endif
+
 // Define step segment generator state flags.
 typedef union {
     uint8_t mask;
@@ -103,6 +108,18 @@ static arc_limits_ptr check_arc_travel_limits;
 static settings_changed_ptr settings_changed;
 static nvs_address_t nvs_address;
 
+typedef struct {
+    uint_fast8_t n;                         // Number of points in batch
+    uint_fast8_t n_valid;                   // Number of leading points with a valid solution
+    uint_fast8_t idx;                       // Next point to consume
+    float x[DELTA_IK_BATCH_SIZE];           // Cartesian segment end points,
+    float y[DELTA_IK_BATCH_SIZE];           // kept in SoA layout so that the
+    float z[DELTA_IK_BATCH_SIZE];           // transform loops may be vectorized.
+    float theta[3][DELTA_IK_BATCH_SIZE];    // Motor angles per end point
+} ik_batch_t;
+
+static ik_batch_t batch;
+
 // inverse kinematics
 // helper functions, calculates angle position[X_AXIS] (for YZ-pane)
 static bool delta_calcAngleYZ (float x0, float y0, float z0, float *theta)
@@ -116,7 +133,7 @@ static bool delta_calcAngleYZ (float x0, float y0, float z0, float *theta)
     if (d < 0.0f)
         return false; // non-existing point
 
-    float yj = (machine.y1 - a * b - sqrt(d)) / (b * b + 1); // choosing outer point
+    float yj = (machine.y1 - a * b - sqrtf(d)) / (b * b + 1.0f); // choosing outer point
     float zj = a + b * yj;
  //   *theta = 180.0f * atanf(-zj / (y1 - yj)) / M_PI + ((yj > y1) ? 180.0f : 0.0f);
     *theta = atanf(-zj / (machine.y1 - yj)) + ((yj > machine.y1) ? M_PI : 0.0f);
@@ -135,6 +152,48 @@ static bool delta_calcInverse (coord_data_t *pos, float *target)
              delta_calcAngleYZ(pos->x * COS120 - pos->y * SIN120, pos->y * COS120 + pos->x * SIN120, pos->z, &target[C_MOTOR]);  // rotate coords to -120 deg
 }
 
+// inverse kinematics for all end points in batch, same as delta_calcInverse() but with the
+// loops over the points innermost and all machine data loaded to locals outside of them.
+// returns the number of leading points with a valid solution
+static uint_fast8_t delta_calcInverse_batch (ik_batch_t *batch)
+{
+    static const float rot_cos[3] = { 1.0f, COS120, COS120 }, rot_sin[3] = { 0.0f, SIN120, -SIN120 };
+
+    const float y1 = machine.y1, fe = machine.fe, rf = machine.cfg.rf, k = machine.rf_sqr - machine.re_sqr - machine.y1_sqr;
+    uint_fast8_t i, arm, n = batch->n, n_valid = batch->n;
+    float d[DELTA_IK_BATCH_SIZE];
+
+    for(arm = 0; arm < 3; arm++) {
+
+        const float c = rot_cos[arm], s = rot_sin[arm];
+        float *theta = batch->theta[arm];
+
+        for(i = 0; i < n; i++) {
+            float x0 = batch->x[i] * c + batch->y[i] * s;
+            float y0 = batch->y[i] * c - batch->x[i] * s - fe; // rotate coords and shift center to edge
+            float z0 = batch->z[i];
+            float a = (x0 * x0 + y0 * y0 + z0 * z0 + k) / (2.0f * z0);
+            float b = (y1 - y0) / z0;
+            float ab = a + b * y1;
+            float yj, zj;
+
+            d[i] = -ab * ab + rf * (b * b * rf + rf);
+            yj = (y1 - a * b - sqrtf(d[i] < 0.0f ? 0.0f : d[i])) / (b * b + 1.0f); // choosing outer point
+            zj = a + b * yj;
+            theta[i] = atanf(-zj / (y1 - yj)) + ((yj > y1) ? (float)M_PI : 0.0f);
+        }
+
+        for(i = 0; i < n_valid; i++) {
+            if(d[i] < 0.0f) {
+                n_valid = i; // non-existing point
+                break;
+            }
+        }
+    }
+
+    return n_valid;
+}
+
 // Returns machine position in mm converted from system position.
 static float *transform_to_cartesian (float *target, float *position)
 {
@@ -216,11 +275,34 @@ static inline float get_distance (float *p0, float *p1)
     return sqrtf(distance);
 }
 
-// Delta robots needs long lines divided up
+// Returns true if the motor angles of the batch points from batch.idx up to but not including end
+// are within tolerance of the linear interpolation between the last position and the end point.
+static bool delta_segments_mergeable (uint_fast8_t end)
+{
+    uint_fast8_t i, arm;
+    float steps = (float)(end - batch.idx + 1);
+
+    if(DELTA_SEGMENT_MERGE_TOLERANCE <= 0.0f)
+        return false;
+
+    for(i = batch.idx; i < end; i++) {
+        float f = (float)(i - batch.idx + 1) / steps;
+        for(arm = 0; arm < 3; arm++) {
+            float theta = machine.last_pos.values[arm] + (batch.theta[arm][end] - machine.last_pos.values[arm]) * f;
+            if(fabsf(batch.theta[arm][i] - theta) > DELTA_SEGMENT_MERGE_TOLERANCE)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// Delta robots needs long lines divided up.
+// Segment end points are transformed in batches, consecutive segments are merged into
+// one if the motion in joint space is close to linear.
 static float *delta_segment_line (float *target, float *position, plan_line_data_t *pl_data, bool init)
 {
-    static uint_fast16_t iterations;
-    static bool segmented;
+    static uint_fast16_t iterations, next_point, remaining;
     static float distance;
     static coord_data_t delta, segment_target, final_target, mpos;
 
@@ -229,6 +311,8 @@ static float *delta_segment_line (float *target, float *position, plan_line_data
     if(init) {
 
         jog_cancel = false;
+        batch.n = batch.idx = 0;
+        next_point = 1;
         memcpy(final_target.values, target, sizeof(final_target));
 
         if(delta_calcInverse((coord_data_t *)target, mpos.values)) {
@@ -246,7 +330,7 @@ static float *delta_segment_line (float *target, float *position, plan_line_data
 
             distance = sqrtf(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z);
 
-            if((segmented = distance > machine.cfg.sl)) {
+            if(distance > machine.cfg.sl) {
 
                 idx = N_AXIS;
                 iterations = (uint_fast16_t)ceilf(distance / machine.cfg.sl);
@@ -256,10 +340,8 @@ static float *delta_segment_line (float *target, float *position, plan_line_data
                     delta.values[idx] = delta.values[idx] / (float)iterations;
                 } while(idx);
 
-            } else {
+            } else
                 iterations = 1;
-                memcpy(&segment_target, &final_target, sizeof(coord_data_t));
-            }
 
             distance /= (float)iterations;
 
@@ -270,33 +352,66 @@ static float *delta_segment_line (float *target, float *position, plan_line_data
             memcpy(&final_target, position, sizeof(coord_data_t));
         }
 
-        iterations++; // return at least one iteration
+        remaining = iterations;
 
     } else {
 
-        iterations--;
+        uint_fast8_t end;
+
+        if(remaining == 0 || jog_cancel)
+            return NULL;
+
+        if(batch.idx == batch.n) {
+
+            // Fill batch with the next segment end points, the last is always the final target.
+            batch.idx = batch.n = 0;
 
-        if(segmented && iterations > 1) {
             do {
-                idx--;
-                segment_target.values[idx] += delta.values[idx];
-            } while(idx);
-        } else
-            memcpy(&segment_target, &final_target, sizeof(coord_data_t));
+                if(next_point == iterations) {
+                    batch.x[batch.n] = final_target.x;
+                    batch.y[batch.n] = final_target.y;
+                    batch.z[batch.n] = final_target.z;
+                } else {
+                    batch.x[batch.n] = segment_target.x + delta.x * (float)next_point;
+                    batch.y[batch.n] = segment_target.y + delta.y * (float)next_point;
+                    batch.z[batch.n] = segment_target.z + delta.z * (float)next_point;
+                }
+                next_point++;
+            } while(++batch.n < DELTA_IK_BATCH_SIZE && next_point <= iterations);
+
+            batch.n_valid = delta_calcInverse_batch(&batch);
+        }
 
-        if(!delta_calcInverse(&segment_target, mpos.values)) {
+        if(batch.idx == batch.n_valid) { // non-existing point, stop motion
             memcpy(&mpos, &machine.last_pos, sizeof(coord_data_t));
-            iterations = 0;
-        } else if(!pl_data->condition.rapid_motion && distance != 0.0f) {
-            float rate_multiplier = get_distance(mpos.values, machine.last_pos.values) / distance;
+            remaining = 0;
+            return NULL;
+        }
+
+        // Extend the segment as long as the skipped points are close to the joint space line.
+        end = batch.idx;
+        while(end + 1 < batch.n_valid && delta_segments_mergeable(end + 1))
+            end++;
+
+        mpos.values[A_MOTOR] = batch.theta[A_MOTOR][end];
+        mpos.values[B_MOTOR] = batch.theta[B_MOTOR][end];
+        mpos.values[C_MOTOR] = batch.theta[C_MOTOR][end];
+
+        if(!pl_data->condition.rapid_motion && distance != 0.0f) {
+            float rate_multiplier = get_distance(mpos.values, machine.last_pos.values) / (distance * (float)(end - batch.idx + 1));
             pl_data->feed_rate *= rate_multiplier;
             pl_data->rate_multiplier = 1.0 / rate_multiplier;
         }
 
+        remaining -= end - batch.idx + 1;
+        batch.idx = end + 1;
+
         memcpy(&machine.last_pos, &mpos, sizeof(coord_data_t));
+
+        return jog_cancel ? NULL : mpos.values;
     }
 
-    return iterations == 0 || jog_cancel ? NULL : mpos.values;
+    return mpos.values;
 }
 
 static void get_cuboid_envelope (void)
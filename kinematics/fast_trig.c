@@ -0,0 +1,135 @@
+/*
+  fast_trig.c - table based trigonometric functions for kinematics
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Sine is interpolated from a table covering the first quadrant, arctangent from a table covering [0, 1].
+// The linear interpolation error is bounded by h^2/8 * max|f''| where h is the table spacing,
+// the number of entries used is calculated from the requested maximum error.
+//
+
+#include "../grbl.h"
+
+#if KINEMATICS_FAST_TRIG
+
+#include <math.h>
+
+#include "fast_trig.h"
+
+#ifndef KINEMATICS_FAST_TRIG_SIZE
+#define KINEMATICS_FAST_TRIG_SIZE 512   // Maximum number of table intervals, memory used is 2 * (size + 1) floats.
+#endif
+
+#define HALF_PI (M_PI / 2.0f)
+
+static struct {
+    uint_fast16_t n;                    // Number of intervals in use.
+    float sin_scale;                    // Intervals per radian.
+    float sin[KINEMATICS_FAST_TRIG_SIZE + 1];
+    float atan[KINEMATICS_FAST_TRIG_SIZE + 1];
+} lut = {0};
+
+/*! \brief Build the tables.
+\param max_error maximum absolute error in radians (for atan2 and acos) or fraction of unit length (for sin and cos).
+The tables are built with the full size if the error cannot be met.
+*/
+void fast_trig_init (float max_error)
+{
+    uint_fast16_t idx, n = KINEMATICS_FAST_TRIG_SIZE;
+
+    // Sine has the larger interpolation error, |f''| <= 1 with spacing pi/2/n.
+    if(max_error > 0.0f)
+        n = (uint_fast16_t)min(ceilf(HALF_PI / sqrtf(8.0f * max_error)), (float)KINEMATICS_FAST_TRIG_SIZE);
+
+    lut.n = max(n, 16);
+    lut.sin_scale = (float)lut.n / HALF_PI;
+
+    for(idx = 0; idx <= lut.n; idx++) {
+        lut.sin[idx] = sinf((float)idx * HALF_PI / (float)lut.n);
+        lut.atan[idx] = atanf((float)idx / (float)lut.n);
+    }
+
+    lut.sin[lut.n] = 1.0f;
+}
+
+// Returns sine of an angle given in table intervals.
+static float sin_intervals (float a)
+{
+    float f = floorf(a), v;
+    int32_t i = (int32_t)f, n4 = (int32_t)lut.n * 4;
+    uint_fast16_t idx;
+
+    f = a - f;
+    if((i %= n4) < 0)
+        i += n4;
+
+    idx = (uint_fast16_t)i % lut.n;
+
+    if(((uint_fast16_t)i / lut.n) & 1) {
+        idx = lut.n - idx;
+        v = lut.sin[idx] + (lut.sin[idx - 1] - lut.sin[idx]) * f;
+    } else
+        v = lut.sin[idx] + (lut.sin[idx + 1] - lut.sin[idx]) * f;
+
+    return (uint_fast16_t)i >= lut.n * 2 ? -v : v;
+}
+
+float fast_sinf (float x)
+{
+    return sin_intervals(x * lut.sin_scale);
+}
+
+float fast_cosf (float x)
+{
+    return sin_intervals(x * lut.sin_scale + (float)lut.n);
+}
+
+float fast_atan2f (float y, float x)
+{
+    bool swap;
+    uint_fast16_t idx;
+    float ax = fabsf(x), ay = fabsf(y), a;
+
+    if(ax == 0.0f && ay == 0.0f)
+        return 0.0f;
+
+    // Reduce to the first octant.
+    if((swap = ay > ax))
+        a = ax / ay * (float)lut.n;
+    else
+        a = ay / ax * (float)lut.n;
+
+    idx = min((uint_fast16_t)a, lut.n - 1);
+    a -= (float)idx;
+    a = lut.atan[idx] + (lut.atan[idx + 1] - lut.atan[idx]) * a;
+
+    if(swap)
+        a = HALF_PI - a;
+    if(x < 0.0f)
+        a = M_PI - a;
+
+    return y < 0.0f ? -a : a;
+}
+
+//! Returns NAN if the argument is outside [-1, 1], as acosf() does.
+float fast_acosf (float x)
+{
+    return x >= -1.0f && x <= 1.0f ? fast_atan2f(sqrtf(1.0f - x * x), x) : NAN;
+}
+
+#endif // KINEMATICS_FAST_TRIG
@@ -0,0 +1,47 @@
+/*
+  fast_trig.h - table based trigonometric functions for kinematics
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FAST_TRIG_H_
+#define _FAST_TRIG_H_
+
+#include <math.h>
+
+#if KINEMATICS_FAST_TRIG
+
+void fast_trig_init (float max_error);
+float fast_sinf (float x);
+float fast_cosf (float x);
+float fast_atan2f (float y, float x);
+float fast_acosf (float x);
+
+#define kin_sinf fast_sinf
+#define kin_cosf fast_cosf
+#define kin_atan2f fast_atan2f
+#define kin_acosf fast_acosf
+
+#else
+
+#define kin_sinf sinf
+#define kin_cosf cosf
+#define kin_atan2f atan2f
+#define kin_acosf acosf
+
+#endif
+
+#endif
@@ -32,14 +32,20 @@
 #include "../settings.h"
 #include "../planner.h"
 #include "../kinematics.h"
+#include "fast_trig.h"
 
 #define RADIUS_AXIS X_AXIS
 #define POLAR_AXIS Y_AXIS
+#ifndef MAX_SEG_LENGTH_MM
 #define MAX_SEG_LENGTH_MM 0.5f
+#endif
 
 static bool jog_cancel = false;
 static coord_data_t last_pos = {0};
 static on_report_options_ptr on_report_options;
+#if KINEMATICS_FAST_TRIG
+static settings_changed_ptr settings_changed;
+#endif
 
 // Simple hypotenuse computation function.
 inline static float hypot_f (float x, float y)
@@ -58,8 +64,8 @@ inline static float abs_angle (float ang)
 // Returns machine position in mm converted from system position steps.
 static float *transform_to_cartesian (float *target, float *position)
 {
-    target[X_AXIS] = cosf(position[POLAR_AXIS] * RADDEG) * position[RADIUS_AXIS];
-    target[Y_AXIS] = sinf(position[POLAR_AXIS] * RADDEG) * position[RADIUS_AXIS];
+    target[X_AXIS] = kin_cosf(position[POLAR_AXIS] * RADDEG) * position[RADIUS_AXIS];
+    target[Y_AXIS] = kin_sinf(position[POLAR_AXIS] * RADDEG) * position[RADIUS_AXIS];
     target[Z_AXIS] = position[Z_AXIS];  // unchanged
 
     return target;
@@ -95,7 +101,7 @@ static float *transform_from_cartesian (float *target, float *position)
     if (target[RADIUS_AXIS] == 0.0f) {
         target[POLAR_AXIS] = last_pos.values[POLAR_AXIS];  // don't care about angle at center
     } else {
-        target[POLAR_AXIS] = atan2f(position[Y_AXIS], position[X_AXIS]) * DEGRAD;
+        target[POLAR_AXIS] = kin_atan2f(position[Y_AXIS], position[X_AXIS]) * DEGRAD;
         // no negative angles...we want the absolute angle not -90, use 270
         target[POLAR_AXIS] = abs_angle(target[POLAR_AXIS]);
     }
@@ -238,6 +244,25 @@ static bool polar_homing_cycle (axes_signals_t cycle, axes_signals_t auto_square
     return false;
 }
 
+#if KINEMATICS_FAST_TRIG
+
+// Rebuild trig tables for an error below a quarter of the polar step angle and of the radius step at max travel.
+static void core_settings_changed (settings_t *settings, settings_changed_flags_t changed)
+{
+    float max_error = RADDEG / settings->axis[POLAR_AXIS].steps_per_mm,
+          max_radius = fabsf(settings->axis[RADIUS_AXIS].max_travel);
+
+    if(settings_changed)
+        settings_changed(settings, changed);
+
+    if(max_radius > 0.0f)
+        max_error = min(max_error, 1.0f / (settings->axis[RADIUS_AXIS].steps_per_mm * max_radius));
+
+    fast_trig_init(0.25f * max_error);
+}
+
+#endif
+
 // Initialize API pointers for Wall Plotter kinematics
 void polar_init (void)
 {
@@ -253,6 +278,13 @@ void polar_init (void)
 
     on_report_options = grbl.on_report_options;
     grbl.on_report_options = report_options;
+
+#if KINEMATICS_FAST_TRIG
+    fast_trig_init(0.0f);
+
+    settings_changed = hal.settings_changed;
+    hal.settings_changed = core_settings_changed;
+#endif
 }
 
 #endif
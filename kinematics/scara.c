@@ -35,9 +35,12 @@
 #include "../report.h"
 #include "../system.h"
 #include "../protocol.h"
+#include "fast_trig.h"
 
 // some config stuff
+#ifndef MAX_SEG_LENGTH_MM
 #define MAX_SEG_LENGTH_MM 2.0f // segmenting long lines due to non-linear motions [mm]
+#endif
 
 #define A_MOTOR X_AXIS // Lower motor (l1)
 #define B_MOTOR Y_AXIS // Upper motor (l2)
@@ -81,6 +84,9 @@ static on_homing_completed_ptr on_homing_completed;
 static homing_get_feedrate_ptr get_feedrate;
 static homing_mode_t homing_mode;
 static nvs_address_t nvs_address;
+#if KINEMATICS_FAST_TRIG
+static settings_changed_ptr settings_changed;
+#endif
 
 
 // ************************ Kinematics Calculations ****************************//
@@ -88,8 +94,8 @@ static nvs_address_t nvs_address;
 // forward kinematics: (absolute) joint angles to cartesian XY
 static xy_t q_to_xy(float q1, float q2) {
     xy_t xy;
-    xy.x = machine.l1*cosf(q1*RADDEG) + machine.l2*cosf(q2*RADDEG);
-    xy.y = machine.l1*sinf(q1*RADDEG) + machine.l2*sinf(q2*RADDEG);
+    xy.x = machine.l1*kin_cosf(q1*RADDEG) + machine.l2*kin_cosf(q2*RADDEG);
+    xy.y = machine.l1*kin_sinf(q1*RADDEG) + machine.l2*kin_sinf(q2*RADDEG);
     return xy;
 }
 
@@ -101,14 +107,14 @@ static q_t xy_to_q(float x, float y) {
         q.q1 = q.q2 = NAN;
     } else {
         float cos_q12 = (r_sq - machine.l1*machine.l1 - machine.l2*machine.l2) / (2.0f * machine.l1 * machine.l2);
-        float q12 = acosf(cos_q12); //relative angle between l1 and l2
-        float beta = atan2f(machine.l2*sinf(q12), machine.l1+machine.l2*cos_q12); //angle between l1 and r
+        float q12 = kin_acosf(cos_q12); //relative angle between l1 and l2
+        float beta = kin_atan2f(machine.l2*kin_sinf(q12), machine.l1+machine.l2*cos_q12); //angle between l1 and r
 
         if (bit_istrue(machine.config, ABSOLUTE_JOINT_ANGLES_BIT)) {
-            q.q1 = atan2f(y, x) + beta;
+            q.q1 = kin_atan2f(y, x) + beta;
             q12 = -q12;
         } else {
-            q.q1 = atan2f(y, x) - beta;
+            q.q1 = kin_atan2f(y, x) - beta;
         }
 
         if (bit_istrue(machine.config, ELBOW_UP_CONFIGURATION_BIT)) {
@@ -528,6 +534,19 @@ static void scara_settings_changed (settings_t *settings, settings_changed_flags
     scara_get_rectangular_workspace();
 }
 
+#if KINEMATICS_FAST_TRIG
+
+// Rebuild trig tables for an error below a quarter of the smallest joint step angle.
+static void core_settings_changed (settings_t *settings, settings_changed_flags_t changed)
+{
+    if(settings_changed)
+        settings_changed(settings, changed);
+
+    fast_trig_init(0.25f * RADDEG / max(settings->axis[A_MOTOR].steps_per_mm, settings->axis[B_MOTOR].steps_per_mm));
+}
+
+#endif
+
 static void scara_settings_save(void)
 {
     hal.nvs.memcpy_to_nvs(nvs_address, (uint8_t *)&scara_settings, sizeof(scara_settings_t), true);
@@ -639,6 +658,13 @@ void scara_init(void)
         on_realtime_report = grbl.on_realtime_report;
         grbl.on_realtime_report = report_angles;
 
+#if KINEMATICS_FAST_TRIG
+        fast_trig_init(0.0f);
+
+        settings_changed = hal.settings_changed;
+        hal.settings_changed = core_settings_changed;
+#endif
+
         // add scara settings
         settings_register(&setting_details);
         
@@ -38,7 +38,12 @@
 
 #define A_MOTOR X_AXIS // Must be X_AXIS
 #define B_MOTOR Y_AXIS // Must be Y_AXIS
-#define MAX_SEG_LENGTH_MM 2.0f
+#ifndef MAX_SEG_LENGTH_MM
+#define MAX_SEG_LENGTH_MM 25.0f // Upper limit of adaptive segment length [mm]
+#endif
+#ifndef MIN_SEG_LENGTH_MM
+#define MIN_SEG_LENGTH_MM 0.1f  // Lower limit of adaptive segment length [mm]
+#endif
 
 typedef struct {
     int32_t width;
@@ -125,77 +130,84 @@ static float *transform_from_cartesian (float *target, float *position)
 }
 
 
-static inline float get_distance (float *p0, float *p1)
+// Returns the length of the segment starting at x, y in the direction of the unit vector ux, uy for which the
+// cartesian deviation from the straight line is within the arc tolerance when the cord lengths are interpolated linearly.
+// The cord length deviation at the midpoint of a segment of length s is s^2 * sin^2(angle to the cord) / (8 * cord length),
+// it is scaled to cartesian space by the smallest singular value of the Jacobian, sqrt(1 - |cos(angle between cords)|).
+// Half the arc tolerance is used since the estimate is only first order.
+static float wp_segment_length (float x, float y, float ux, float uy)
 {
-    uint_fast8_t idx = Z_AXIS;
-    float distance = 0.0f;
+    float la = sqrtf(x * x + y * y), lb, ca, cb, k, sigma;
 
-    do {
-        idx--;
-        distance += (p0[idx] - p1[idx]) * (p0[idx] - p1[idx]);
-    } while(idx);
+    x -= machine.width_mm;
+    lb = sqrtf(x * x + y * y);
+
+    if(la < MIN_SEG_LENGTH_MM || lb < MIN_SEG_LENGTH_MM)
+        return MIN_SEG_LENGTH_MM;
 
-    return sqrtf(distance);
+    ca = (ux * (x + machine.width_mm) + uy * y) / la;
+    cb = (ux * x + uy * y) / lb;
+    k = max((1.0f - ca * ca) / la, (1.0f - cb * cb) / lb);
+    sigma = sqrtf(1.0f - fabsf(((x + machine.width_mm) * x + y * y) / (la * lb)));
+
+    if(k <= 0.0f)
+        return MAX_SEG_LENGTH_MM;
+
+    return max(min(sqrtf(4.0f * settings.arc_tolerance * sigma / k), MAX_SEG_LENGTH_MM), MIN_SEG_LENGTH_MM);
 }
 
-// Wall plotter is circular in motion, so long lines must be divided up
+// Wall plotter is circular in motion, so long lines must be divided up.
+// Segment lengths are adapted to the local curvature, moves in the center of the work area get few segments.
 static float *wp_segment_line (float *target, float *position, plan_line_data_t *pl_data, bool init)
 {
-    static uint_fast16_t iterations;
-    static bool segmented;
-    static coord_data_t delta, segment_target, final_target, cpos;
-//    static plan_line_data_t plan;
+    static bool segmented, completed;
+    static float distance, travelled;
+    static coord_data_t delta, start, segment_target, final_target, cpos;
 
     uint_fast8_t idx = N_AXIS;
 
     if(init) {
 
         jog_cancel = false;
+        completed = false;
+        travelled = 0.0f;
 
         memcpy(final_target.values, target, sizeof(final_target));
 
-        transform_to_cartesian(segment_target.values, position);
-
-        delta.x = target[X_AXIS] - segment_target.x;
-        delta.y = target[Y_AXIS] - segment_target.y;
-        delta.z = target[Z_AXIS] - segment_target.z;
-
-        float distance = sqrtf(delta.x * delta.x + delta.y * delta.y);
+        transform_to_cartesian(start.values, position);
+        memcpy(&segment_target, &start, sizeof(coord_data_t));
 
-        if((segmented = !pl_data->condition.rapid_motion && distance > MAX_SEG_LENGTH_MM && !(delta.x == 0.0f && delta.y == 0.0f))) {
+        do {
+            idx--;
+            delta.values[idx] = target[idx] - start.values[idx];
+        } while(idx);
 
-            idx = N_AXIS;
-            iterations = (uint_fast16_t)ceilf(distance / MAX_SEG_LENGTH_MM);
+        distance = sqrtf(delta.x * delta.x + delta.y * delta.y);
 
-            do {
-                --idx;
-                delta.values[idx] = delta.values[idx] / (float)iterations;
-            } while(idx);
+        segmented = !pl_data->condition.rapid_motion && distance > MIN_SEG_LENGTH_MM;
 
-        } else {
-            iterations = 1;
-            memcpy(&segment_target, &final_target, sizeof(coord_data_t));
-        }
+    } else if(completed)
+        return NULL;
 
-        iterations++; // return at least one iteration
+    else {
 
-    } else {
+        float length;
 
-        iterations--;
-
-        if(segmented && iterations > 1) {
+        if(segmented && (length = wp_segment_length(segment_target.x, segment_target.y, delta.x / distance, delta.y / distance)) < distance - travelled) {
+            travelled += length;
             do {
                 idx--;
-                segment_target.values[idx] += delta.values[idx];
+                segment_target.values[idx] = start.values[idx] + delta.values[idx] * travelled / distance;
             } while(idx);
-
-        } else
+        } else {
             memcpy(&segment_target, &final_target, sizeof(coord_data_t));
+            completed = true;
+        }
 
         transform_from_cartesian(cpos.values, segment_target.values);
     }
 
-    return iterations == 0 || jog_cancel ? NULL : cpos.values;
+    return jog_cancel ? NULL : cpos.values;
 }
 
 
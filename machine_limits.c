@@ -32,6 +32,9 @@
 #include "machine_limits.h"
 #include "tool_change.h"
 #include "state_machine.h"
+#if INPUT_EVENT_LOG_SIZE
+#include "input_events.h"
+#endif
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
@@ -94,6 +97,10 @@ ISR_CODE void ISR_FUNC(limit_interrupt_handler)(limit_signals_t state) // DEFAUL
 
     memcpy(&sys.last_event.limits, &state, sizeof(limit_signals_t));
 
+#if INPUT_EVENT_LOG_SIZE
+    input_event_log(InputEvent_Limit, 0, (input_event_signals_t){ .limits = state });
+#endif
+
     if (!(state_get() & (STATE_ALARM|STATE_ESTOP)) && !sys.rt_exec_alarm) {
 
       #if HARD_LIMIT_FORCE_STATE_CHECK
@@ -197,7 +204,7 @@ static bool limits_pull_off (axes_signals_t axis, float distance)
 
 #ifdef KINEMATICS_API
     coord_data_t k_target;
-    plan_buffer_line(kinematics.transform_from_cartesian(k_target.values, target.values), &plan_data);    // Bypass mc_line(). Directly plan homing motion.;
+    plan_buffer_line(kinematics_transform_from_cartesian(k_target.values, target.values), &plan_data);    // Bypass mc_line(). Directly plan homing motion.;
 #else
     plan_buffer_line(target.values, &plan_data);    // Bypass mc_line(). Directly plan homing motion.
 #endif
@@ -269,6 +276,9 @@ static bool homing_cycle (axes_signals_t cycle, axes_signals_t auto_square)
     float max_travel = 0.0f, homing_rate;
     homing_mode_t mode = HomingMode_Seek;
     axes_signals_t axislock, homing_state;
+#if HOMING_POSITION_LATCH
+    axes_signals_t latch_axes = {0};
+#endif
     home_signals_t signals_state;
     squaring_mode_t squaring_mode = SquaringMode_Both;
     coord_data_t target;
@@ -288,7 +298,7 @@ static bool homing_cycle (axes_signals_t cycle, axes_signals_t auto_square)
         idx--;
         // Initialize step pin masks
 #ifdef KINEMATICS_API
-        step_pin[idx] = kinematics.limits_get_axis_mask(idx);
+        step_pin[idx] = kinematics_limits_get_axis_mask(idx);
 #else
         step_pin[idx] = bit(idx);
 #endif
@@ -304,6 +314,10 @@ static bool homing_cycle (axes_signals_t cycle, axes_signals_t auto_square)
 
             if(bit_istrue(auto_square.mask, bit(idx)))
                 dual_motor_axis = idx;
+#if HOMING_POSITION_LATCH
+            else if(step_pin[idx] == bit(idx))
+                latch_axes.mask |= bit(idx);
+#endif
         }
     } while(idx);
 
@@ -328,6 +342,26 @@ static bool homing_cycle (axes_signals_t cycle, axes_signals_t auto_square)
         axislock = (axes_signals_t){0};
         n_active_axis = 0;
 
+        // Get per axis rates for the seek and locate phases. Axis distances are scaled by their rate so that all
+        // axes move concurrently at their own rate, axes are individually locked out as their switches triggers.
+        // Not used when kinematics override the homing rate.
+        float axis_rate[N_AXIS], travel_time = 0.0f, rate_sqr = 0.0f;
+#ifdef KINEMATICS_API
+        bool per_axis_rate = kinematics.homing_cycle_get_feedrate == NULL;
+#else
+        bool per_axis_rate = true;
+#endif
+
+        idx = N_AXIS;
+        do {
+            if(bit_istrue(cycle.mask, bit(--idx))) {
+                if(!per_axis_rate || mode == HomingMode_Pulloff || (axis_rate[idx] = hal.homing.get_feedrate((axes_signals_t){ .mask = bit(idx) }, mode)) <= 0.0f)
+                    axis_rate[idx] = homing_rate;
+                travel_time = max(travel_time, max_travel / axis_rate[idx]);
+                rate_sqr += axis_rate[idx] * axis_rate[idx];
+            }
+        } while(idx);
+
         idx = N_AXIS;
         do {
             // Set target location for active axes and setup computation for homing rate.
@@ -340,10 +374,11 @@ static bool homing_cycle (axes_signals_t cycle, axes_signals_t auto_square)
                 sys.position[idx] = 0;
 #endif
                 // Set target direction based on cycle mask and homing cycle approach state.
+                float travel = per_axis_rate && mode != HomingMode_Pulloff ? axis_rate[idx] * travel_time : max_travel;
                 if (bit_istrue(settings.homing.dir_mask.value, bit(idx)))
-                    target.values[idx] = mode == HomingMode_Pulloff ? max_travel : - max_travel;
+                    target.values[idx] = mode == HomingMode_Pulloff ? travel : - travel;
                 else
-                    target.values[idx] = mode == HomingMode_Pulloff ? - max_travel : max_travel;
+                    target.values[idx] = mode == HomingMode_Pulloff ? - travel : travel;
 
                 // Apply axislock to the step port pins active in this cycle.
                 axislock.mask |= step_pin[idx];
@@ -358,19 +393,26 @@ static bool homing_cycle (axes_signals_t cycle, axes_signals_t auto_square)
         if(grbl.on_homing_rate_set)
             grbl.on_homing_rate_set(cycle, homing_rate, mode);
 
-        homing_rate *= sqrtf(n_active_axis); // [sqrt(N_AXIS)] Adjust so individual axes all move at homing rate.
-
         // Perform homing cycle. Planner buffer should be empty, as required to initiate the homing cycle.
-        plan_data.feed_rate = homing_rate;      // Set current homing rate.
+        if(per_axis_rate && mode != HomingMode_Pulloff)
+            plan_data.feed_rate = sqrtf(rate_sqr); // Adjust so individual axes all move at their own homing rate.
+        else
+            plan_data.feed_rate = homing_rate * sqrtf(n_active_axis); // [sqrt(N_AXIS)] Adjust so individual axes all move at homing rate.
         sys.homing_axis_lock.mask = axislock.mask;
 
 #ifdef KINEMATICS_API
         coord_data_t k_target;
-        plan_buffer_line(kinematics.transform_from_cartesian(k_target.values, target.values), &plan_data);    // Bypass mc_line(). Directly plan homing motion.;
+        plan_buffer_line(kinematics_transform_from_cartesian(k_target.values, target.values), &plan_data);    // Bypass mc_line(). Directly plan homing motion.;
 #else
         plan_buffer_line(target.values, &plan_data);    // Bypass mc_line(). Directly plan homing motion.
 #endif
 
+#if HOMING_POSITION_LATCH
+        // Arm the stepper ISR latch for axes driven by their own motor, auto squared axes are handled below.
+        sys.homing_latch.latched.mask = 0;
+        sys.homing_latch.armed.mask = mode == HomingMode_Pulloff ? 0 : latch_axes.mask;
+#endif
+
         sys.step_control.flags = 0;
         sys.step_control.execute_sys_motion = On; // Set to execute homing motion and clear existing flags.
         st_prep_buffer();   // Prep and fill segment buffer from newly planned block.
@@ -382,6 +424,9 @@ static bool homing_cycle (axes_signals_t cycle, axes_signals_t auto_square)
 
                 // Check homing switches state. Lock out cycle axes when they change.
                 homing_state = homing_signals_select(signals_state = hal.homing.get_state(), auto_square, squaring_mode);
+#if HOMING_POSITION_LATCH
+                homing_state.mask |= sys.homing_latch.latched.mask; // Switch may have been released by overshoot.
+#endif
 
                 // Auto squaring check
                 if((homing_state.mask & auto_square.mask) && squaring_mode == SquaringMode_Both) {
@@ -398,7 +443,7 @@ static bool homing_cycle (axes_signals_t cycle, axes_signals_t auto_square)
                     idx--;
                     if ((axislock.mask & step_pin[idx]) && (homing_state.mask & bit(idx))) {
 #ifdef KINEMATICS_API
-                        axislock.mask &= ~kinematics.limits_get_axis_mask(idx);
+                        axislock.mask &= ~kinematics_limits_get_axis_mask(idx);
 #else
                         axislock.mask &= ~bit(idx);
 #endif
@@ -458,6 +503,9 @@ static bool homing_cycle (axes_signals_t cycle, axes_signals_t auto_square)
         } while (axislock.mask & AXES_BITMASK);
 
         st_reset(); // Immediately force kill steppers and reset step segment buffer.
+#if HOMING_POSITION_LATCH
+        sys.homing_latch.armed.mask = 0;
+#endif
         hal.delay_ms(settings.homing.debounce_delay, NULL); // Delay to allow transient dynamics to dissipate.
 
         // Reverse direction and reset homing rate for cycle(s).
@@ -649,7 +697,7 @@ static bool check_arc_travel_limits (coord_data_t *target, coord_data_t *positio
         end.y = position->values[plane.axis_1] - center.y;
     }
 
-    if(labs(turns > 1))
+    if(labs(turns) > 1)
         x.value = 0b1111;                   // Crosses all
     else if(start.y >= 0.0f) {
         if(start.x > 0.0f) {                // Starts in Q1
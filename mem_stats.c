@@ -0,0 +1,209 @@
+/*
+  mem_stats.c - tagged heap allocation wrapper for memory accounting
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Each block is prefixed by a small header holding the requested size and the tag so that it can be accounted for
+// when released. mem_realloc() and mem_free() must only be passed blocks allocated by the wrapper, memory that may
+// be allocated elsewhere, e.g. by a plugin, has to be released by free().
+// Counters are updated with interrupts disabled.
+//
+
+#include <string.h>
+
+#include "hal.h"
+
+#if MEM_ACCOUNTING_ENABLE
+
+#include "mem_stats.h"
+
+#ifndef MEM_PROBE_MAX
+#define MEM_PROBE_MAX (512 * 1024)  // Upper limit for the largest free block probe when hal.get_free_mem is not available.
+#endif
+
+typedef struct {
+    uint32_t size;
+    uint8_t tag;
+    uint8_t unused[3];
+} mem_header_t; // Keep size a multiple of 8 to preserve alignment.
+
+static mem_stats_t stats = {0};
+
+static const char *const tag_names[MemTag_N] = {
+    "OTHER",
+    "PLANNER",
+    "NVS",
+    "PARSER",
+    "NGC",
+    "IOPORTS",
+    "REPORT",
+    "SETTINGS",
+    "STREAM",
+    "TOOLS"
+};
+
+static void account_free (mem_header_t *header)
+{
+    mem_tag_stats_t *tag = &stats.tag[header->tag];
+
+    hal.irq_disable();
+
+    tag->bytes -= header->size;
+    tag->blocks--;
+    stats.bytes -= header->size;
+
+    hal.irq_enable();
+}
+
+static void *account_alloc (mem_tag_t tag, mem_header_t *header, size_t size)
+{
+    mem_tag_stats_t *ts = &stats.tag[tag < MemTag_N ? tag : MemTag_Other];
+
+    if(header == NULL) {
+        hal.irq_disable();
+        ts->failed++;
+        hal.irq_enable();
+        return NULL;
+    }
+
+    header->size = (uint32_t)size;
+    header->tag = tag < MemTag_N ? tag : MemTag_Other;
+
+    hal.irq_disable();
+
+    ts->blocks++;
+    if((ts->bytes += size) > ts->peak)
+        ts->peak = ts->bytes;
+    if((stats.bytes += size) > stats.peak)
+        stats.peak = stats.bytes;
+
+    hal.irq_enable();
+
+    if(hal.get_free_mem) {
+        uint32_t free_mem = hal.get_free_mem();
+        if(stats.free_min == 0 || free_mem < stats.free_min)
+            stats.free_min = free_mem;
+    }
+
+    return header + 1;
+}
+
+void *mem_alloc (mem_tag_t tag, size_t size)
+{
+    return account_alloc(tag, malloc(size + sizeof(mem_header_t)), size);
+}
+
+void *mem_calloc (mem_tag_t tag, size_t n, size_t size)
+{
+    void *ptr;
+
+    if(size && n > SIZE_MAX / size)
+        return account_alloc(tag, NULL, 0);
+
+    if((ptr = mem_alloc(tag, n * size)))
+        memset(ptr, 0, n * size);
+
+    return ptr;
+}
+
+void *mem_realloc (mem_tag_t tag, void *ptr, size_t size)
+{
+    mem_header_t *header, *block;
+
+    if(ptr == NULL)
+        return mem_alloc(tag, size);
+
+    header = (mem_header_t *)ptr - 1;
+
+    // Unaccount the old block first, header content is undefined after a successful realloc.
+    tag = (mem_tag_t)header->tag;
+    account_free(header);
+
+    if((block = realloc(header, size + sizeof(mem_header_t))) == NULL) {
+        // Original block is still valid, account for it again.
+        size = header->size;
+        account_alloc(tag, header, size);
+        account_alloc(tag, NULL, 0);
+        return NULL;
+    }
+
+    return account_alloc(tag, block, size);
+}
+
+void mem_free (void *ptr)
+{
+    if(ptr) {
+        mem_header_t *header = (mem_header_t *)ptr - 1;
+        account_free(header);
+        free(header);
+    }
+}
+
+const char *mem_tag_name (mem_tag_t tag)
+{
+    return tag < MemTag_N ? tag_names[tag] : "?";
+}
+
+mem_stats_t *mem_get_stats (void)
+{
+    if(hal.get_free_mem) {
+        uint32_t free_mem = hal.get_free_mem();
+        if(stats.free_min == 0 || free_mem < stats.free_min)
+            stats.free_min = free_mem;
+    }
+
+    return &stats;
+}
+
+/*! \brief Find the largest block that can be allocated by a binary search of malloc() sizes.
+\returns size of largest block in bytes, rounded down to a multiple of 16.
+*/
+uint32_t mem_get_largest_free (void)
+{
+    void *ptr;
+    uint32_t low = 0, high = hal.get_free_mem ? hal.get_free_mem() : MEM_PROBE_MAX, size;
+
+    while(high - low > 16) {
+        size = (low + (high - low) / 2) & ~0x0F;
+        if(size <= low)
+            break;
+        if((ptr = malloc(size))) {
+            free(ptr);
+            low = size;
+        } else
+            high = size;
+    }
+
+    return low;
+}
+
+//! Set peak values to the current values and clear the failed allocation counters.
+void mem_reset_stats (void)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < MemTag_N; idx++) {
+        stats.tag[idx].peak = stats.tag[idx].bytes;
+        stats.tag[idx].failed = 0;
+    }
+
+    stats.peak = stats.bytes;
+    stats.free_min = hal.get_free_mem ? hal.get_free_mem() : 0;
+}
+
+#endif // MEM_ACCOUNTING_ENABLE
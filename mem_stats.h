@@ -0,0 +1,76 @@
+/*
+  mem_stats.h - tagged heap allocation wrapper for memory accounting
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MEM_STATS_H_
+#define _MEM_STATS_H_
+
+#include <stdlib.h>
+
+#include "grbl.h"
+
+//! Subsystem tags for heap allocations.
+typedef enum {
+    MemTag_Other = 0,
+    MemTag_Planner,
+    MemTag_NVS,
+    MemTag_Parser,
+    MemTag_NGC,
+    MemTag_IOPorts,
+    MemTag_Report,
+    MemTag_Settings,
+    MemTag_Stream,
+    MemTag_Tools,
+    MemTag_N            //!< Number of tags, must be last.
+} mem_tag_t;
+
+typedef struct {
+    uint32_t bytes;     //!< Bytes currently allocated.
+    uint32_t peak;      //!< Highest number of bytes allocated.
+    uint32_t blocks;    //!< Blocks currently allocated.
+    uint32_t failed;    //!< Number of failed allocations.
+} mem_tag_stats_t;
+
+typedef struct {
+    mem_tag_stats_t tag[MemTag_N];
+    uint32_t bytes;     //!< Bytes currently allocated, all tags.
+    uint32_t peak;      //!< Highest number of bytes allocated, all tags.
+    uint32_t free_min;  //!< Lowest free heap seen, 0 if the driver does not provide hal.get_free_mem.
+} mem_stats_t;
+
+#if MEM_ACCOUNTING_ENABLE
+
+void *mem_alloc (mem_tag_t tag, size_t size);
+void *mem_calloc (mem_tag_t tag, size_t n, size_t size);
+void *mem_realloc (mem_tag_t tag, void *ptr, size_t size);
+void mem_free (void *ptr);
+const char *mem_tag_name (mem_tag_t tag);
+mem_stats_t *mem_get_stats (void);
+uint32_t mem_get_largest_free (void);
+void mem_reset_stats (void);
+
+#else
+
+#define mem_alloc(tag, size) malloc(size)
+#define mem_calloc(tag, n, size) calloc(n, size)
+#define mem_realloc(tag, ptr, size) realloc(ptr, size)
+#define mem_free(ptr) free(ptr)
+
+#endif
+
+#endif // _MEM_STATS_H_
@@ -21,14 +21,45 @@
 
 */
 
+#include "hal.h"
 #include "modbus.h"
 
 #include <string.h>
 
 #define N_MODBUS_API 2
+#define MODBUS_READ_OVERHEAD 5 // slave address, function code, byte count and CRC
+#define MODBUS_MAX_MERGE ((MODBUS_MAX_ADU_SIZE - MODBUS_READ_OVERHEAD) / 2 > 1 ? (MODBUS_MAX_ADU_SIZE - MODBUS_READ_OVERHEAD) / 2 : 1)
+
+typedef struct {
+    modbus_message_t msg;
+    const modbus_callbacks_t *callbacks;
+    modbus_priority_t priority;
+    uint32_t seq;
+    bool pending;
+    bool in_flight;
+    bool blocked;
+} modbus_request_t;
+
+typedef struct {
+    modbus_message_t msg;
+    modbus_request_t *request[MODBUS_MAX_MERGE];
+    uint_fast8_t n_requests;
+    uint_fast16_t api;  // Index of interface handling the transaction
+    uintptr_t id;       // Transaction id, passed as message context
+    uint32_t started;
+    bool active;
+} modbus_transaction_t;
 
 static uint_fast16_t n_api = 0, tcp_api = N_MODBUS_API, rtu_api = N_MODBUS_API;
 static modbus_api_t modbus[N_MODBUS_API] = {0};
+static uint32_t seq = 0;
+static uintptr_t transaction_id = 0;
+static modbus_request_t queue[MODBUS_SCHEDULER_QUEUE_LENGTH] = {0};
+static modbus_transaction_t transactions[MODBUS_SCHEDULER_MAX_IN_FLIGHT] = {0}, *building = NULL;
+static modbus_stats_t stats = {0};
+static on_execute_realtime_ptr on_execute_realtime = NULL;
+
+static void modbus_dispatch (void);
 
 bool modbus_isup (void)
 {
@@ -54,6 +85,17 @@ void modbus_flush_queue (void)
     if(idx) do {
         modbus[--idx].flush_queue();
     } while(idx);
+
+    idx = MODBUS_SCHEDULER_QUEUE_LENGTH;
+    do {
+        idx--;
+        queue[idx].pending = queue[idx].in_flight = false;
+    } while(idx);
+
+    idx = MODBUS_SCHEDULER_MAX_IN_FLIGHT;
+    do {
+        transactions[--idx].active = false;
+    } while(idx);
 }
 
 void modbus_set_silence (const modbus_silence_timeout_t *timeout)
@@ -83,6 +125,463 @@ void modbus_write_u16 (uint8_t *p, uint16_t value)
     *(p + 1) = (uint8_t)(value & 0x00FF);
 }
 
+// CRC and ADU helpers
+
+PROGMEM static const uint16_t crc_table[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+//! Returns the Modbus RTU CRC16 of the data, low byte is transmitted first.
+uint16_t modbus_crc16 (const uint8_t *data, uint_fast16_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    while(length--)
+        crc = (crc >> 8) ^ crc_table[(crc ^ *data++) & 0xFF];
+
+    return crc;
+}
+
+/*! \brief Add the CRC to the end of the ADU in place, for interfaces that transmit the ADU directly by DMA.
+\param msg pointer to a \a modbus_message_t structure, \a tx_length must include the two CRC bytes.
+*/
+void modbus_adu_set_crc (modbus_message_t *msg)
+{
+    uint16_t crc = modbus_crc16((uint8_t *)msg->adu, msg->tx_length - 2);
+
+    msg->adu[msg->tx_length - 2] = MODBUS_SET_LSB16(crc);
+    msg->adu[msg->tx_length - 1] = MODBUS_SET_MSB16(crc);
+}
+
+/*! \brief Check the CRC of a received ADU in place.
+\param adu pointer to the received data.
+\param length number of bytes received, including the CRC.
+\returns true if the CRC is valid.
+*/
+bool modbus_adu_check_crc (const char *adu, uint_fast8_t length)
+{
+    uint16_t crc;
+
+    if(length < 4)
+        return false;
+
+    crc = modbus_crc16((const uint8_t *)adu, length - 2);
+
+    return (uint8_t)adu[length - 2] == MODBUS_SET_LSB16(crc) && (uint8_t)adu[length - 1] == MODBUS_SET_MSB16(crc);
+}
+
+/*! \brief Build a read request in place.
+\param msg pointer to a \a modbus_message_t structure, \a context and \a crc_check are not changed.
+\param slave slave address.
+\param function one of the read functions, \a ModBus_ReadCoils, \a ModBus_ReadDiscreteInputs, \a ModBus_ReadHoldingRegisters or \a ModBus_ReadInputRegisters.
+\param address first coil, input or register to read.
+\param count number of coils, inputs or registers to read.
+\returns false if the response will not fit in the ADU.
+*/
+bool modbus_adu_read (modbus_message_t *msg, uint8_t slave, modbus_function_t function, uint16_t address, uint16_t count)
+{
+    uint_fast16_t rx_length = 5 + (function == ModBus_ReadCoils || function == ModBus_ReadDiscreteInputs ? (count + 7) / 8 : count * 2);
+
+    if(count == 0 || rx_length > MODBUS_MAX_ADU_SIZE)
+        return false;
+
+    msg->adu[0] = slave;
+    msg->adu[1] = function;
+    modbus_write_u16((uint8_t *)&msg->adu[2], address);
+    modbus_write_u16((uint8_t *)&msg->adu[4], count);
+    msg->tx_length = 8;
+    msg->rx_length = rx_length;
+
+    return true;
+}
+
+/*! \brief Build a single coil or register write request in place.
+\param msg pointer to a \a modbus_message_t structure, \a context and \a crc_check are not changed.
+\param slave slave address.
+\param function \a ModBus_WriteCoil or \a ModBus_WriteRegister.
+\param address coil or register to write.
+\param value value to write, for coils 0xFF00 is on and 0x0000 off.
+*/
+void modbus_adu_write (modbus_message_t *msg, uint8_t slave, modbus_function_t function, uint16_t address, uint16_t value)
+{
+    msg->adu[0] = slave;
+    msg->adu[1] = function;
+    modbus_write_u16((uint8_t *)&msg->adu[2], address);
+    modbus_write_u16((uint8_t *)&msg->adu[4], value);
+    msg->tx_length = msg->rx_length = 8; // The response echoes the request.
+}
+
+/*! \brief Get a register value from a read response.
+\param msg pointer to a \a modbus_message_t structure holding the response.
+\param idx register index, 0 is the first register read.
+\returns register value, 0 if the index is outside the response.
+*/
+uint16_t modbus_adu_get_register (modbus_message_t *msg, uint_fast8_t idx)
+{
+    return (uint_fast16_t)idx * 2 + 2 <= (uint8_t)msg->adu[2] && 5 + idx * 2 <= MODBUS_MAX_ADU_SIZE ? modbus_read_u16((uint8_t *)&msg->adu[3 + idx * 2]) : 0;
+}
+
+//! Returns true if the response is an exception response, the exception code is then in adu[2].
+bool modbus_adu_is_exception (modbus_message_t *msg)
+{
+    return !!(msg->adu[1] & 0x80);
+}
+
+// Scheduler
+
+static inline uint32_t get_ticks (void)
+{
+    return hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+}
+
+static inline bool is_register_read (modbus_message_t *msg)
+{
+    return msg->adu[1] == ModBus_ReadHoldingRegisters && msg->tx_length == 8;
+}
+
+static inline uint16_t read_start (modbus_message_t *msg)
+{
+    return modbus_read_u16((uint8_t *)&msg->adu[2]);
+}
+
+static inline uint16_t read_count (modbus_message_t *msg)
+{
+    return modbus_read_u16((uint8_t *)&msg->adu[4]);
+}
+
+static modbus_transaction_t *transaction_get (uintptr_t id)
+{
+    uint_fast8_t idx = MODBUS_SCHEDULER_MAX_IN_FLIGHT;
+
+    do {
+        if(transactions[--idx].active && transactions[idx].id == id)
+            return &transactions[idx];
+    } while(idx);
+
+    return NULL; // Late response to an abandoned transaction
+}
+
+static void transaction_end (modbus_transaction_t *transaction, bool exception)
+{
+    uint32_t latency = get_ticks() - transaction->started;
+
+    if(stats.transactions == 0 || latency < stats.latency_min)
+        stats.latency_min = latency;
+    if(latency > stats.latency_max)
+        stats.latency_max = latency;
+    stats.latency_total += latency;
+    stats.transactions++;
+    if(exception)
+        stats.exceptions++;
+
+    transaction->active = false;
+}
+
+// Split the response to a merged read into responses for the original requests.
+static void on_rx_packet (modbus_message_t *msg)
+{
+    uint_fast8_t idx;
+    modbus_request_t *request;
+    modbus_transaction_t *transaction;
+
+    if((transaction = transaction_get((uintptr_t)msg->context)) == NULL)
+        return;
+
+    uint16_t start = read_start(&transaction->msg);
+
+    // The transaction is ended after the callbacks have run as these may schedule new requests.
+    for(idx = 0; idx < transaction->n_requests; idx++) {
+
+        request = transaction->request[idx];
+
+        if(transaction->n_requests > 1) {
+            uint_fast8_t len = read_count(&request->msg) * 2, offset = (read_start(&request->msg) - start) * 2;
+            request->msg.adu[2] = len;
+            memcpy(&request->msg.adu[3], &msg->adu[3 + offset], len);
+        } else
+            memcpy(request->msg.adu, msg->adu, MODBUS_MAX_ADU_SIZE);
+
+        request->pending = request->in_flight = false;
+        if(request->callbacks && request->callbacks->on_rx_packet)
+            request->callbacks->on_rx_packet(&request->msg);
+    }
+
+    transaction_end(transaction, false);
+
+    modbus_dispatch();
+}
+
+static void on_rx_exception (uint8_t code, void *context)
+{
+    uint_fast8_t idx;
+    modbus_request_t *request;
+    modbus_transaction_t *transaction;
+
+    if((transaction = transaction_get((uintptr_t)context)) == NULL)
+        return;
+
+    for(idx = 0; idx < transaction->n_requests; idx++) {
+        request = transaction->request[idx];
+        request->pending = request->in_flight = false;
+        if(request->callbacks && request->callbacks->on_rx_exception)
+            request->callbacks->on_rx_exception(code, request->msg.context);
+    }
+
+    transaction_end(transaction, true);
+
+    modbus_dispatch();
+}
+
+static const modbus_callbacks_t callbacks = {
+    .on_rx_packet = on_rx_packet,
+    .on_rx_exception = on_rx_exception
+};
+
+// Returns true if a transaction to the slave is in flight.
+static bool slave_busy (uint8_t slave)
+{
+    uint_fast8_t idx = MODBUS_SCHEDULER_MAX_IN_FLIGHT;
+
+    do {
+        idx--;
+        if(transactions[idx].active && transactions[idx].msg.adu[0] == slave && &transactions[idx] != building)
+            return true;
+    } while(idx);
+
+    return false;
+}
+
+// Returns true if a transaction is in flight on the interface.
+static bool interface_busy (uint_fast16_t api)
+{
+    uint_fast8_t idx = MODBUS_SCHEDULER_MAX_IN_FLIGHT;
+
+    do {
+        idx--;
+        if(transactions[idx].active && transactions[idx].api == api && &transactions[idx] != building)
+            return true;
+    } while(idx);
+
+    return false;
+}
+
+// Returns oldest pending request with the highest priority that is not in flight, blocked or already added to the transaction being built.
+static modbus_request_t *get_next (bool (*match)(modbus_request_t *request))
+{
+    uint_fast8_t idx = MODBUS_SCHEDULER_QUEUE_LENGTH;
+    modbus_request_t *next = NULL;
+
+    do {
+        modbus_request_t *request = &queue[--idx];
+        if(request->pending && !request->in_flight && !request->blocked && (match == NULL || match(request)) &&
+            (next == NULL || request->priority < next->priority || (request->priority == next->priority && (int32_t)(request->seq - next->seq) < 0)))
+            next = request;
+    } while(idx);
+
+    return next;
+}
+
+// Match register reads from the same slave adjacent to the registers already in the transaction.
+static bool is_adjacent_read (modbus_request_t *request)
+{
+    uint_fast8_t idx = building->n_requests;
+    uint16_t start = read_start(&building->msg), count = read_count(&building->msg);
+
+    do {
+        if(building->request[--idx] == request)
+            return false;
+    } while(idx);
+
+    return is_register_read(&request->msg) &&
+            request->msg.adu[0] == building->msg.adu[0] &&
+             request->msg.crc_check == building->msg.crc_check &&
+              MODBUS_READ_OVERHEAD + (count + read_count(&request->msg)) * 2 <= MODBUS_MAX_ADU_SIZE &&
+               (read_start(&request->msg) + read_count(&request->msg) == start || start + count == read_start(&request->msg));
+}
+
+// Send the transaction via the TCP interface if it accepts it, else via the RTU interface.
+// Only one RTU transaction may be in flight, any number of TCP transactions to different slaves may be.
+static bool transaction_send (modbus_transaction_t *transaction)
+{
+    bool ok = false;
+
+    if(tcp_api != N_MODBUS_API && (ok = modbus[tcp_api].send(&transaction->msg, &callbacks, false)))
+        transaction->api = tcp_api;
+    else if(rtu_api != N_MODBUS_API && !interface_busy(rtu_api) && (ok = modbus[rtu_api].send(&transaction->msg, &callbacks, false)))
+        transaction->api = rtu_api;
+
+    return ok;
+}
+
+static void modbus_dispatch (void)
+{
+    static bool busy = false;
+
+    uint_fast8_t idx = MODBUS_SCHEDULER_MAX_IN_FLIGHT;
+    uint32_t merged;
+    modbus_request_t *request;
+
+    // Responses delivered while sending are picked up by the loop below.
+    if(busy)
+        return;
+
+    busy = true;
+
+    do {
+        building = &transactions[--idx];
+        if(building->active && get_ticks() - building->started >= MODBUS_SCHEDULER_TIMEOUT)
+            on_rx_exception(0, (void *)building->id); // Timeout, abandon transaction.
+    } while(idx);
+
+    idx = MODBUS_SCHEDULER_QUEUE_LENGTH;
+    do {
+        queue[--idx].blocked = false;
+    } while(idx);
+
+    do {
+
+        for(building = NULL, idx = 0; idx < MODBUS_SCHEDULER_MAX_IN_FLIGHT; idx++) {
+            if(!transactions[idx].active) {
+                building = &transactions[idx];
+                break;
+            }
+        }
+
+        if(building == NULL || (request = get_next(NULL)) == NULL)
+            break;
+
+        if(slave_busy(request->msg.adu[0])) {
+            request->blocked = true; // Slaves handle one transaction at a time.
+            continue;
+        }
+
+        memcpy(&building->msg, &request->msg, sizeof(modbus_message_t));
+        building->request[0] = request;
+        building->n_requests = 1;
+        merged = 0;
+
+        if(is_register_read(&request->msg)) while(building->n_requests < MODBUS_MAX_MERGE && (request = get_next(is_adjacent_read))) {
+
+            uint16_t start = read_start(&building->msg), count = read_count(&building->msg);
+
+            if(read_start(&request->msg) < start)
+                start = read_start(&request->msg);
+            count += read_count(&request->msg);
+
+            modbus_write_u16((uint8_t *)&building->msg.adu[2], start);
+            modbus_write_u16((uint8_t *)&building->msg.adu[4], count);
+            building->msg.rx_length = MODBUS_READ_OVERHEAD + count * 2;
+            building->request[building->n_requests++] = request;
+            merged++;
+        }
+
+        building->id = ++transaction_id;
+        building->msg.context = (void *)building->id;
+        building->started = get_ticks();
+
+        // Responses may be delivered before send returns, mark transaction active first.
+        building->active = true;
+        for(idx = 0; idx < building->n_requests; idx++)
+            building->request[idx]->in_flight = true;
+
+        if(transaction_send(building))
+            stats.merged += merged;
+        else {
+            // Could not be sent now, retried on the next call.
+            building->active = false;
+            for(idx = 0; idx < building->n_requests; idx++) {
+                building->request[idx]->in_flight = false;
+                building->request[idx]->blocked = true;
+            }
+        }
+
+    } while(true);
+
+    busy = false;
+}
+
+// Retry failed sends and check for timeouts.
+static void modbus_poll (sys_state_t state)
+{
+    modbus_dispatch();
+
+    on_execute_realtime(state);
+}
+
+/*! \brief Queue a message for transmission by the scheduler.
+
+Control messages are sent ahead of telemetry and in order of submission within a priority level.
+Transactions to different slaves may be in flight concurrently via Modbus TCP, up to \ref MODBUS_SCHEDULER_MAX_IN_FLIGHT,
+only one at a time is in flight on the RTU interface. Responses are matched to transactions by an id passed as message context. Single register reads (ReadHoldingRegisters) to the same slave of adjacent registers are
+merged into one request, the response is split and returned to the callbacks of the original messages.
+Responses are delivered asynchronously, the message is copied and may be reused when the function returns.
+\param msg pointer to a \ref modbus_message_t struct.
+\param callbacks pointer to a \ref modbus_callbacks_t struct.
+\param priority a \ref modbus_priority_t enum value.
+\returns \a true if queued, \a false if the queue is full or no interface is available.
+*/
+bool modbus_schedule (modbus_message_t *msg, const modbus_callbacks_t *callbacks, modbus_priority_t priority)
+{
+    uint_fast8_t idx = MODBUS_SCHEDULER_QUEUE_LENGTH;
+    modbus_request_t *request = NULL;
+
+    if(n_api == 0)
+        return false;
+
+    do {
+        if(!queue[--idx].pending)
+            request = &queue[idx];
+    } while(idx);
+
+    if(request) {
+        memcpy(&request->msg, msg, sizeof(modbus_message_t));
+        request->callbacks = callbacks;
+        request->priority = priority;
+        request->seq = seq++;
+        request->pending = true;
+    }
+
+    modbus_dispatch();
+
+    return request != NULL;
+}
+
+modbus_stats_t *modbus_get_stats (void)
+{
+    return &stats;
+}
+
 bool modbus_register_api (const modbus_api_t *api)
 {
     bool ok;
@@ -94,6 +593,11 @@ bool modbus_register_api (const modbus_api_t *api)
         else if(api->interface == Modbus_InterfaceRTU)
             rtu_api = n_api;
         n_api++;
+
+        if(on_execute_realtime == NULL) {
+            on_execute_realtime = grbl.on_execute_realtime;
+            grbl.on_execute_realtime = modbus_poll;
+        }
     }
 
     return ok;
@@ -30,6 +30,15 @@
 #ifndef MODBUS_QUEUE_LENGTH
 #define MODBUS_QUEUE_LENGTH 8
 #endif
+#ifndef MODBUS_SCHEDULER_QUEUE_LENGTH
+#define MODBUS_SCHEDULER_QUEUE_LENGTH 8
+#endif
+#ifndef MODBUS_SCHEDULER_MAX_IN_FLIGHT
+#define MODBUS_SCHEDULER_MAX_IN_FLIGHT 4
+#endif
+#ifndef MODBUS_SCHEDULER_TIMEOUT
+#define MODBUS_SCHEDULER_TIMEOUT 1000 // ms, scheduled transactions are abandoned if no response is received within this time
+#endif
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -81,6 +90,21 @@ typedef union {
     };
 } modbus_silence_timeout_t;
 
+typedef enum {
+    ModBus_PriorityControl = 0, //!< Time critical requests such as spindle control.
+    ModBus_PriorityTelemetry    //!< Status polling.
+} modbus_priority_t;
+
+//! Statistics for transactions submitted via modbus_schedule().
+typedef struct {
+    uint32_t transactions;      //!< Number of transactions sent.
+    uint32_t merged;            //!< Number of requests merged into another request.
+    uint32_t exceptions;        //!< Number of exception responses and timeouts.
+    uint32_t latency_min;       //!< Shortest round trip time in ms.
+    uint32_t latency_max;       //!< Longest round trip time in ms.
+    uint64_t latency_total;     //!< Accumulated round trip time in ms, used for calculating the average.
+} modbus_stats_t;
+
 typedef bool (*modbus_is_up_ptr)(void);
 typedef void (*modbus_flush_queue_ptr)(void);
 typedef void (*modbus_set_silence_ptr)(const modbus_silence_timeout_t *timeout);
@@ -101,6 +125,15 @@ void modbus_set_silence (const modbus_silence_timeout_t *timeout);
 bool modbus_send (modbus_message_t *msg, const modbus_callbacks_t *callbacks, bool block);
 uint16_t modbus_read_u16 (uint8_t *p);
 void modbus_write_u16 (uint8_t *p, uint16_t value);
+uint16_t modbus_crc16 (const uint8_t *data, uint_fast16_t length);
+void modbus_adu_set_crc (modbus_message_t *msg);
+bool modbus_adu_check_crc (const char *adu, uint_fast8_t length);
+bool modbus_adu_read (modbus_message_t *msg, uint8_t slave, modbus_function_t function, uint16_t address, uint16_t count);
+void modbus_adu_write (modbus_message_t *msg, uint8_t slave, modbus_function_t function, uint16_t address, uint16_t value);
+uint16_t modbus_adu_get_register (modbus_message_t *msg, uint_fast8_t idx);
+bool modbus_adu_is_exception (modbus_message_t *msg);
 bool modbus_register_api (const modbus_api_t *api);
+bool modbus_schedule (modbus_message_t *msg, const modbus_callbacks_t *callbacks, modbus_priority_t priority);
+modbus_stats_t *modbus_get_stats (void);
 
 #endif
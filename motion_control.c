@@ -36,6 +36,12 @@
 #include "state_machine.h"
 #include "motion_control.h"
 #include "tool_change.h"
+#if HEIGHTMAP_ENABLE
+#include "heightmap.h"
+#endif
+#if PREFLIGHT_ENABLE
+#include "preflight.h"
+#endif
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
@@ -57,6 +63,9 @@ void mc_backlash_init (axes_signals_t axes)
         }
     } while(idx);
 
+    // Take-up by the step segment generator if a take-up distance is set, backlash motions are not inserted.
+    st_backlash_init(settings.backlash_takeup > 0.0f ? backlash_enabled : (axes_signals_t){0}, dir_negative);
+
     mc_sync_backlash_position();
 }
 
@@ -68,6 +77,182 @@ void mc_sync_backlash_position (void)
 
 #endif
 
+#if ENABLE_PATH_BLENDING
+
+#ifndef PATH_BLENDING_MAX_HOLD
+#define PATH_BLENDING_MAX_HOLD 50.0f    // Maximum length held back at the end of a motion, as a multiple of the path tolerance.
+#endif
+
+// The end of the last motion in G64 mode is held back until the next motion is known, a tangent arc
+// that deviates no more than the path tolerance from the corner is then inserted between them.
+static struct {
+    bool pending;
+    float target[N_AXIS];       // Programmed target of the last motion.
+    float unit_vec[N_AXIS];     // Unit vector of the last motion.
+    float length;               // Length of the part held back.
+    plan_line_data_t pl_data;   // Plan data of the last motion.
+} blend = {0};
+
+static bool blending = false;
+
+static inline bool blend_is_allowed (plan_line_data_t *pl_data)
+{
+    return pl_data->path_tolerance > 0.0f && state_get() != STATE_CHECK_MODE && pl_data->raster == NULL &&
+            !(pl_data->condition.rapid_motion || pl_data->condition.system_motion || pl_data->condition.jog_motion ||
+               pl_data->condition.inverse_time || pl_data->condition.backlash_motion || pl_data->spindle.state.synchronized);
+}
+
+// Returns true if the motion can be joined to the pending motion by a blend arc.
+static inline bool blend_is_compatible (plan_line_data_t *pl_data)
+{
+    return blend.pending && pl_data->message == NULL && pl_data->output_commands == NULL &&
+            pl_data->condition.coolant.value == blend.pl_data.condition.coolant.value &&
+             pl_data->overrides.value == blend.pl_data.overrides.value &&
+              pl_data->spindle.hal == blend.pl_data.spindle.hal &&
+               pl_data->spindle.state.value == blend.pl_data.spindle.state.value &&
+                pl_data->spindle.rpm == blend.pl_data.spindle.rpm &&
+                 pl_data->spindle.css == blend.pl_data.spindle.css;
+}
+
+/*! \brief Plans the part of the last motion held back for path blending.
+Called before motions that cannot be blended and when the planner buffer is about to run empty.
+\returns false if aborted.
+*/
+bool mc_blend_flush (void)
+{
+    bool ok = true;
+
+    if(blend.pending) {
+        bool nested = blending;
+        blend.pending = false;
+        blending = true;
+        ok = mc_line(blend.target, &blend.pl_data);
+        blending = nested;
+    }
+
+    return ok && !ABORTED;
+}
+
+// Plans a motion in G64 mode, a blend arc is inserted at the corner with the previous motion if possible.
+static bool blend_line (float *target, plan_line_data_t *pl_data)
+{
+    bool ok = true;
+    uint_fast8_t idx;
+    uint_fast16_t segments, segment;
+    float start[N_AXIS], unit_vec[N_AXIS], point[N_AXIS], length = 0.0f, hold;
+
+    if(!(blend_is_allowed(pl_data) && (blend_is_compatible(pl_data) || mc_blend_flush())))
+        return mc_blend_flush() && mc_line(target, pl_data);
+
+    memcpy(start, blend.pending ? blend.target : plan_get_position(), sizeof(start));
+#if HEIGHTMAP_ENABLE
+    if(!blend.pending && heightmap_is_active())
+        start[Z_AXIS] -= heightmap_get_z(start[X_AXIS], start[Y_AXIS]);
+#endif
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        unit_vec[idx] = target[idx] - start[idx];
+        length += unit_vec[idx] * unit_vec[idx];
+    }
+
+    if((length = sqrtf(length)) < 0.0001f)
+        return mc_blend_flush() && mc_line(target, pl_data);
+
+    for(idx = 0; idx < N_AXIS; idx++)
+        unit_vec[idx] /= length;
+
+    if(blend.pending) {
+
+        float cos_theta = 0.0f;
+
+        blend.pending = false;
+
+        for(idx = 0; idx < N_AXIS; idx++)
+            cos_theta += blend.unit_vec[idx] * unit_vec[idx];
+
+        if(cos_theta < -0.999f) // Reversal, no blend.
+            ok = mc_line(blend.target, &blend.pl_data);
+        else {
+
+            // Arc tangent to both motions with the given deviation from the corner, limited by the motion lengths.
+            float half_angle = 0.5f * acosf(min(cos_theta, 1.0f)), radius, distance, bisector = 0.0f;
+
+            distance = half_angle > 0.0001f
+                        ? pl_data->path_tolerance * cosf(half_angle) / (1.0f - cosf(half_angle)) * tanf(half_angle)
+                        : 0.0f;
+            distance = min(distance, min(blend.length, length * 0.5f));
+
+            for(idx = 0; idx < N_AXIS; idx++)
+                point[idx] = blend.target[idx] - blend.unit_vec[idx] * distance;
+
+            if(blend.length - distance > 0.0001f)
+                ok = mc_line(point, &blend.pl_data);
+            else { // Nothing left of the held motion, pass its message and output commands on to the next.
+                pl_data->message = blend.pl_data.message;
+                pl_data->output_commands = blend.pl_data.output_commands;
+            }
+
+            if(ok && distance > 0.0001f) {
+
+                float center[N_AXIS], r_start[N_AXIS], r_end[N_AXIS], angle = 2.0f * half_angle, t;
+
+                radius = distance / tanf(half_angle);
+
+                for(idx = 0; idx < N_AXIS; idx++)
+                    bisector += (unit_vec[idx] - blend.unit_vec[idx]) * (unit_vec[idx] - blend.unit_vec[idx]);
+                bisector = radius / cosf(half_angle) / sqrtf(bisector);
+
+                for(idx = 0; idx < N_AXIS; idx++) {
+                    center[idx] = blend.target[idx] + (unit_vec[idx] - blend.unit_vec[idx]) * bisector;
+                    r_start[idx] = point[idx] - center[idx];
+                    r_end[idx] = blend.target[idx] + unit_vec[idx] * distance - center[idx];
+                }
+
+                segments = 2.0f * radius > settings.arc_tolerance
+                            ? (uint_fast16_t)floorf(0.5f * angle * radius / sqrtf(settings.arc_tolerance * (2.0f * radius - settings.arc_tolerance)))
+                            : 0;
+                segments = max(segments, 1);
+
+                for(segment = 1; ok && segment <= segments; segment++) {
+                    t = (float)segment / (float)segments;
+                    for(idx = 0; idx < N_AXIS; idx++)
+                        point[idx] = center[idx] + (sinf((1.0f - t) * angle) * r_start[idx] + sinf(t * angle) * r_end[idx]) / sinf(angle);
+                    ok = mc_line(point, pl_data);
+                }
+
+                length -= distance;
+                memcpy(start, point, sizeof(start));
+            }
+        }
+    }
+
+    if(!ok)
+        return false;
+
+    // Plan the motion except for the part held back for blending with the next motion.
+    hold = min(length * 0.5f, pl_data->path_tolerance * PATH_BLENDING_MAX_HOLD);
+
+    if(length - hold > 0.0001f) {
+        for(idx = 0; idx < N_AXIS; idx++)
+            point[idx] = target[idx] - unit_vec[idx] * hold;
+        if(!mc_line(point, pl_data))
+            return false;
+    } else
+        hold = length;
+
+    blend.pending = true;
+    blend.length = hold;
+    memcpy(blend.target, target, sizeof(blend.target));
+    memcpy(blend.unit_vec, unit_vec, sizeof(blend.unit_vec));
+    memcpy(&blend.pl_data, pl_data, sizeof(plan_line_data_t));
+    pl_data->message = NULL;
+    pl_data->output_commands = NULL;
+
+    return !ABORTED;
+}
+
+#endif
+
 // Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
 // unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
 // (1 minute)/feed_rate time.
@@ -77,10 +262,39 @@ void mc_sync_backlash_position (void)
 // in the planner and to let backlash compensation or canned cycle integration simple and direct.
 bool mc_line (float *target, plan_line_data_t *pl_data)
 {
+#if PREFLIGHT_ENABLE
+    if(preflight_active()) {
+        preflight_line(target, pl_data);
+        return !sys.abort;
+    }
+#endif
+
+#if ENABLE_PATH_BLENDING
+    if(!blending) {
+        bool ok;
+        blending = true;
+        ok = blend_line(target, pl_data);
+        blending = false;
+        return ok;
+    }
+#endif
+
+#if HEIGHTMAP_ENABLE
+    static bool compensating = false;
+
+    if(!compensating && heightmap_is_active() && !(pl_data->condition.system_motion || pl_data->condition.jog_motion)) {
+        bool ok;
+        compensating = true;
+        ok = heightmap_line(target, pl_data, mc_line);
+        compensating = false;
+        return ok;
+    }
+#endif
+
 #ifdef KINEMATICS_API
     float feed_rate = pl_data->feed_rate;
     pl_data->rate_multiplier = 1.0;
-    target = kinematics.segment_line(target, plan_get_position(), pl_data, true);
+    target = kinematics_segment_line(target, plan_get_position(), pl_data, true);
 #endif
 
     // If enabled, check for soft limit violations. Placed here all line motions are picked up
@@ -106,12 +320,12 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
         // parser and planner are separate from the system machine positions, this is doable.
 
 #ifdef KINEMATICS_API
-      while(kinematics.segment_line(target, NULL, pl_data, false)) {
+      while(kinematics_segment_line(target, NULL, pl_data, false)) {
 #endif
 
 #if ENABLE_BACKLASH_COMPENSATION
 
-        if(backlash_enabled.mask) {
+        if(backlash_enabled.mask && settings.backlash_takeup == 0.0f) {
 
             bool backlash_comp = false;
             uint_fast8_t idx = N_AXIS, axismask = bit(N_AXIS - 1);
@@ -176,6 +390,9 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
         // if there is a coincident position passed.
         if(!plan_buffer_line(target, pl_data) && pl_data->spindle.hal->cap.laser && pl_data->spindle.state.on && !pl_data->spindle.state.ccw) {
             protocol_buffer_synchronize();
+#if SPINDLE_COMMAND_CACHE
+            spindle_command_invalidate(pl_data->spindle.hal);
+#endif
             pl_data->spindle.hal->set_state(pl_data->spindle.hal, pl_data->spindle.state, pl_data->spindle.rpm);
         }
 
@@ -190,7 +407,7 @@ bool mc_line (float *target, plan_line_data_t *pl_data)
         }
 
         pl_data->feed_rate = feed_rate;
-      } // while(kinematics.segment_line()
+      } // while(kinematics_segment_line()
 
       pl_data->feed_rate = feed_rate;
 #endif
@@ -342,6 +559,21 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
        This is important when there are successive arc motions.
     */
 
+#if ARC_RECURRENCE_ROTATION
+        // Exact rotation matrix, computed once per arc. The radius vector is kept in double precision
+        // so the error accumulated by the recurrence stays far below step resolution.
+        double cos_T = cos((double)theta_per_segment);
+        double sin_T = sin((double)theta_per_segment);
+        double r_axisi;
+        uint_fast16_t i;
+
+        for (i = 1; i < segments; i++) { // Increment (segments-1).
+
+            // Apply vector rotation matrix.
+            r_axisi = rv.x * sin_T + rv.y * cos_T;
+            rv.x = rv.x * cos_T - rv.y * sin_T;
+            rv.y = r_axisi;
+#else
         // Computes: cos_T = 1 - theta_per_segment^2/2, sin_T = theta_per_segment - theta_per_segment^3/6) in ~52usec
         float cos_T = 2.0f - theta_per_segment * theta_per_segment;
         float sin_T = theta_per_segment * 0.16666667f * (cos_T + 4.0f);
@@ -369,6 +601,7 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
                 rv.y = -offset[plane.axis_0] * sin_Ti - offset[plane.axis_1] * cos_Ti;
                 count = 0;
             }
+#endif
 
             // Update arc_target location
             position[plane.axis_0] = center.x + rv.x;
@@ -397,164 +630,72 @@ void mc_arc (float *target, plan_line_data_t *pl_data, float *position, float *o
 // Bezier splines, from a pull request for Marlin
 // By Giovanni Mascellani - https://github.com/giomasce/Marlin
 
-// Compute the linear interpolation between two real numbers.
-static inline float interp (const float a, const float b, const float t)
-{
-    return (1.0f - t) * a + t * b;
-}
-
-/**
- * Compute a B�zier curve using the De Casteljau's algorithm (see
- * https://en.wikipedia.org/wiki/De_Casteljau's_algorithm), which is
- * easy to code and has good numerical stability (very important,
- * since Arudino works with limited precision real numbers).
- */
-static inline float eval_bezier (const float a, const float b, const float c, const float d, const float t)
-{
-    const float iab = interp(a, b, t),
-                ibc = interp(b, c, t),
-                icd = interp(c, d, t),
-                iabc = interp(iab, ibc, t),
-                ibcd = interp(ibc, icd, t);
-
-    return interp(iabc, ibcd, t);
-}
-
-/**
- * We approximate Euclidean distance with the sum of the coordinates
- * offset (so-called "norm 1"), which is quicker to compute.
- */
-static inline float dist1 (const float x1, const float y1, const float x2, const float y2)
-{
-    return fabsf(x1 - x2) + fabsf(y1 - y2);
-}
-
-/**
- * The algorithm for computing the step is loosely based on the one in Kig
- * (See https://sources.debian.net/src/kig/4:15.08.3-1/misc/kigpainter.cpp/#L759)
- * However, we do not use the stack.
- *
- * The algorithm goes as it follows: the parameters t runs from 0.0 to
- * 1.0 describing the curve, which is evaluated by eval_bezier(). At
- * each iteration we have to choose a step, i.e., the increment of the
- * t variable. By default the step of the previous iteration is taken,
- * and then it is enlarged or reduced depending on how straight the
- * curve locally is. The step is always clamped between MIN_STEP/2 and
- * 2*MAX_STEP. MAX_STEP is taken at the first iteration.
- *
- * For some t, the step value is considered acceptable if the curve in
- * the interval [t, t+step] is sufficiently straight, i.e.,
- * sufficiently close to linear interpolation. In practice the
- * following test is performed: the distance between eval_bezier(...,
- * t+step/2) is evaluated and compared with 0.5*(eval_bezier(...,
- * t)+eval_bezier(..., t+step)). If it is smaller than SIGMA, then the
- * step value is considered acceptable, otherwise it is not. The code
- * seeks to find the larger step value which is considered acceptable.
- *
- * At every iteration the recorded step value is considered and then
- * iteratively halved until it becomes acceptable. If it was already
- * acceptable in the beginning (i.e., no halving were done), then
- * maybe it was necessary to enlarge it; then it is iteratively
- * doubled while it remains acceptable. The last acceptable value
- * found is taken, provided that it is between MIN_STEP and MAX_STEP
- * and does not bring t over 1.0.
- *
- * Caveat: this algorithm is not perfect, since it can happen that a
- * step is considered acceptable even when the curve is not linear at
- * all in the interval [t, t+step] (but its mid point coincides "by
- * chance" with the midpoint according to the parametrization). This
- * kind of glitches can be eliminated with proper first derivative
- * estimates; however, given the improbability of such configurations,
- * the mitigation offered by MIN_STEP and the small computational
- * power available on Arduino, I think it is not wise to implement it.
+/*
+ * The spline is evaluated by forward differencing at uniform parameter steps, each point costs three
+ * additions per axis. The number of steps is chosen so that the chord error stays within BEZIER_SIGMA:
+ * the second derivative of a cubic Bezier is bounded by 6 * max(|P0 - 2P1 + P2|, |P1 - 2P2 + P3|) and
+ * the chord error of a step h is at most h^2/8 times that bound. The step is then clamped between
+ * BEZIER_MIN_STEP and BEZIER_MAX_STEP.
  */
 
 void mc_cubic_b_spline (float *target, plan_line_data_t *pl_data, float *position, float *first, float *second)
 {
-    float bez_target[N_AXIS];
+    uint_fast8_t idx;
+    uint_fast16_t segments;
+    float bez_target[N_AXIS], delta[2], d2 = 0.0f, h, h2, h3;
+    float f[2], df[2], ddf[2], dddf[2];
+    static const uint_fast8_t axis[2] = { X_AXIS, Y_AXIS };
 
     memcpy(bez_target, position, sizeof(float) * N_AXIS);
 
-    float t = 0.0f, step = BEZIER_MAX_STEP;
-
-    while (t < 1.0f) {
-
-        // First try to reduce the step in order to make it sufficiently
-        // close to a linear interpolation.
-        bool did_reduce = false;
-        float new_t = t + step;
-
-        if(new_t > 1.0f)
-            new_t = 1.0f;
-
-        float new_pos0 = eval_bezier(position[X_AXIS], first[X_AXIS], second[X_AXIS], target[X_AXIS], new_t),
-              new_pos1 = eval_bezier(position[Y_AXIS], first[Y_AXIS], second[Y_AXIS], target[Y_AXIS], new_t);
-
-        while(new_t - t >= (BEZIER_MIN_STEP)) {
-
-//            if (new_t - t < (BEZIER_MIN_STEP))
-//                break;
-
-            const float candidate_t = 0.5f * (t + new_t),
-                      candidate_pos0 = eval_bezier(position[X_AXIS], first[X_AXIS], second[X_AXIS], target[X_AXIS], candidate_t),
-                      candidate_pos1 = eval_bezier(position[Y_AXIS], first[Y_AXIS], second[Y_AXIS], target[Y_AXIS], candidate_t),
-                      interp_pos0 = 0.5f * (bez_target[X_AXIS] + new_pos0),
-                      interp_pos1 = 0.5f * (bez_target[Y_AXIS] + new_pos1);
-
-            if (dist1(candidate_pos0, candidate_pos1, interp_pos0, interp_pos1) <= (BEZIER_SIGMA))
-                break;
-
-            new_t = candidate_t;
-            new_pos0 = candidate_pos0;
-            new_pos1 = candidate_pos1;
-            did_reduce = true;
-        }
+    // Bound of the second derivative.
+    for(idx = 0; idx < 2; idx++) {
+        delta[0] = position[axis[idx]] - 2.0f * first[axis[idx]] + second[axis[idx]];
+        delta[1] = first[axis[idx]] - 2.0f * second[axis[idx]] + target[axis[idx]];
+        d2 += max(delta[0] * delta[0], delta[1] * delta[1]);
+    }
 
-        // If we did not reduce the step, maybe we should enlarge it.
-        if (!did_reduce) while (new_t - t <= BEZIER_MAX_STEP) {
+    segments = (uint_fast16_t)ceilf(sqrtf(6.0f * sqrtf(d2) / (8.0f * BEZIER_SIGMA)));
+    segments = max(segments, (uint_fast16_t)ceilf(1.0f / BEZIER_MAX_STEP));
+    segments = min(segments, (uint_fast16_t)(1.0f / BEZIER_MIN_STEP));
 
-//            if (new_t - t > BEZIER_MAX_STEP)
-//                break;
+    h = 1.0f / (float)segments;
+    h2 = h * h;
+    h3 = h2 * h;
 
-            const float candidate_t = t + 2.0f * (new_t - t);
+    // Power basis coefficients a*t^3 + b*t^2 + c*t + d converted to forward differences.
+    for(idx = 0; idx < 2; idx++) {
 
-            if (candidate_t >= 1.0f)
-                break;
+        float p0 = position[axis[idx]], p1 = first[axis[idx]], p2 = second[axis[idx]], p3 = target[axis[idx]],
+              a = p3 - 3.0f * p2 + 3.0f * p1 - p0,
+              b = 3.0f * (p2 - 2.0f * p1 + p0),
+              c = 3.0f * (p1 - p0);
 
-            const float candidate_pos0 = eval_bezier(position[X_AXIS], first[X_AXIS], second[X_AXIS], target[X_AXIS], candidate_t),
-                      candidate_pos1 = eval_bezier(position[Y_AXIS], first[Y_AXIS], second[Y_AXIS], target[Y_AXIS], candidate_t),
-                      interp_pos0 = 0.5f * (bez_target[X_AXIS] + candidate_pos0),
-                      interp_pos1 = 0.5f * (bez_target[Y_AXIS] + candidate_pos1);
+        f[idx] = p0;
+        df[idx] = a * h3 + b * h2 + c * h;
+        ddf[idx] = 6.0f * a * h3 + 2.0f * b * h2;
+        dddf[idx] = 6.0f * a * h3;
+    }
 
-            if (dist1(new_pos0, new_pos1, interp_pos0, interp_pos1) > (BEZIER_SIGMA))
-                break;
+    while(--segments) {
 
-            new_t = candidate_t;
-            new_pos0 = candidate_pos0;
-            new_pos1 = candidate_pos1;
+        for(idx = 0; idx < 2; idx++) {
+            f[idx] += df[idx];
+            df[idx] += ddf[idx];
+            ddf[idx] += dddf[idx];
+            bez_target[axis[idx]] = f[idx];
         }
 
-        // Check some postcondition; they are disabled in the actual
-        // Marlin build, but if you test the same code on a computer you
-        // may want to check they are respect.
-        /*
-          assert(new_t <= 1.0);
-          if (new_t < 1.0) {
-            assert(new_t - t >= (MIN_STEP) / 2.0);
-            assert(new_t - t <= (MAX_STEP) * 2.0);
-          }
-        */
-
-        step = new_t - t;
-        t = new_t;
-
-        bez_target[X_AXIS] = new_pos0;
-        bez_target[Y_AXIS] = new_pos1;
-
         // Bail mid-spline on system abort. Runtime command check already performed by mc_line.
         if(!mc_line(bez_target, pl_data))
             return;
     }
+
+    // Ensure last segment arrives at target location.
+    bez_target[X_AXIS] = target[X_AXIS];
+    bez_target[Y_AXIS] = target[Y_AXIS];
+
+    mc_line(bez_target, pl_data);
 }
 
 // end Bezier splines
@@ -592,6 +733,18 @@ void mc_canned_drill (motion_mode_t motion, float *target, plan_line_data_t *pl_
 
         while(position_linear > canned->xyz[plane.axis_linear]) {
 
+#if CANNED_CYCLE_RAPID_REENTRY
+            // rapid move to just above the previous peck depth
+            // NOTE: the retract to re-entry junction is a reversal along the same axis and is planned to a stop,
+            //       the re-entry to drill junction is colinear and is blended by the planner as-is.
+            if(motion == MotionMode_CannedCycle83 && position[plane.axis_linear] > position_linear + settings.g73_retract) {
+                pl_data->condition.rapid_motion = On;
+                position[plane.axis_linear] = position_linear + settings.g73_retract;
+                if(!mc_line(position, pl_data))
+                    return;
+            }
+#endif
+
             position_linear -= canned->delta;
             if(position_linear < canned->xyz[plane.axis_linear])
                 position_linear = canned->xyz[plane.axis_linear];
@@ -605,8 +758,13 @@ void mc_canned_drill (motion_mode_t motion, float *target, plan_line_data_t *pl_
             if(canned->dwell > 0.0f)
                 mc_dwell(canned->dwell);
 
-            if(canned->spindle_off)
+            if(canned->spindle_off) {
+                protocol_buffer_synchronize(); // Wait for the drill motion, and a planned dwell, to complete.
+#if SPINDLE_COMMAND_CACHE
+                spindle_command_invalidate(pl_data->spindle.hal);
+#endif
                 pl_data->spindle.hal->set_state(pl_data->spindle.hal, (spindle_state_t){0}, 0.0f);
+            }
 
             // rapid retract
             switch(motion) {
@@ -701,6 +859,10 @@ void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thre
     }
 
     while(--passes) {
+#if THREADING_PIPELINE_ENABLE
+      uint_fast16_t start = 0, starts = max(thread->starts, 1);
+      do {
+#endif
 
         if(thread->end_taper_type & Taper_Entry)
             target[X_AXIS] = position[X_AXIS] + (thread->peak + doc - thread->depth) * thread->cut_direction;
@@ -710,8 +872,20 @@ void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thre
         if(!mc_line(target, pl_data))
             return;
 
+#if THREADING_PIPELINE_ENABLE
+        // Hold motion in the stepper module until the spindle passes the start angle, subsequent moves stay buffered.
+        while(plan_check_full_buffer()) {
+            protocol_auto_cycle_start();
+            if(!protocol_execute_realtime())
+                return;
+        }
+
+        if(!plan_buffer_index_wait((float)start / (float)starts, pl_data))
+            return;
+#else
         if(!protocol_buffer_synchronize() && state_get() != STATE_IDLE) // Wait until any previous moves are finished.
             return;
+#endif
 
         pl_data->condition.rapid_motion = Off;      // Clear rapid motion condition flag,
         pl_data->spindle.state.synchronized = On;   // enable spindle sync for cut
@@ -745,11 +919,21 @@ void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thre
         pl_data->condition.rapid_motion = On;       // Set rapid motion condition flag and
         pl_data->spindle.state.synchronized = Off;  // disable spindle sync for retract & reposition
 
+#if THREADING_PIPELINE_ENABLE
+        if(++start < starts || passes > 1) {
+
+            // Get DOC of next pass, the remaining starts are cut at the same depth.
+            if(start == starts) {
+                doc = calc_thread_doc(++pass, thread->initial_depth, inv_degression);
+                doc = min(doc, thread->depth);
+            }
+#else
         if(passes > 1) {
 
             // Get DOC of next pass.
             doc = calc_thread_doc(++pass, thread->initial_depth, inv_degression);
             doc = min(doc, thread->depth);
+#endif
 
             // 4. Retract
             target[X_AXIS] = position[X_AXIS] + (doc - thread->depth) * thread->cut_direction;
@@ -771,9 +955,25 @@ void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thre
             if(!mc_line(target, pl_data))
                 return;
         }
+#if THREADING_PIPELINE_ENABLE
+      } while(start < starts);
+#endif
     }
 }
 
+#if CONTINUOUS_JOG_ENABLE
+
+#ifndef CONTINUOUS_JOG_DISTANCE
+#define CONTINUOUS_JOG_DISTANCE 1000.0f  // Length of a continuous jog motion, it is clipped by soft limits if jog soft limits are enabled.
+#endif
+
+static struct {
+    bool active;
+    float direction[N_AXIS];    // Unit vector.
+} cjog = {0};
+
+#endif
+
 // Sets up valid jog motion received from g-code parser, checks for soft-limits, and executes the jog.
 status_code_t mc_jog_execute (plan_line_data_t *pl_data, parser_block_t *gc_block, float *position)
 {
@@ -786,6 +986,10 @@ status_code_t mc_jog_execute (plan_line_data_t *pl_data, parser_block_t *gc_bloc
     pl_data->condition.target_validated = On;
     pl_data->line_number = gc_block->values.n;
 
+#if CONTINUOUS_JOG_ENABLE
+    cjog.active = false;
+#endif
+
     if(settings.limits.flags.jog_soft_limited)
         grbl.apply_jog_limits(gc_block->values.xyz, position);
     else if(sys.soft_limits.mask && !grbl.check_travel_limits(gc_block->values.xyz, sys.soft_limits, true))
@@ -806,10 +1010,135 @@ status_code_t mc_jog_execute (plan_line_data_t *pl_data, parser_block_t *gc_bloc
     return Status_OK;
 }
 
+#if CONTINUOUS_JOG_ENABLE
+
+/*! \brief Start, update or stop a continuous jog.
+If the continuous jog being executed has the same direction only the rate is changed, this is done in place without adding planner blocks.
+Otherwise any jog being executed is cancelled and the new one started when the machine has come to a stop.
+\param direction pointer to float array with the direction vector, it does not have to be normalized.
+\param feed_rate new rate in mm/min, 0 stops the jog.
+\returns status code.
+*/
+status_code_t mc_jog_continuous (float *direction, float feed_rate)
+{
+    uint_fast8_t idx = N_AXIS;
+    float length = 0.0f, cosine = 0.0f, target[N_AXIS];
+    sys_state_t state = state_get();
+    plan_line_data_t plan_data;
+
+    if(!(state == STATE_IDLE || state == STATE_JOG))
+        return Status_IdleError;
+
+    do {
+        idx--;
+        length += direction[idx] * direction[idx];
+    } while(idx);
+
+    if(length == 0.0f || feed_rate <= 0.0f) {
+        if(state == STATE_JOG)
+            system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+        return Status_OK;
+    }
+
+    length = sqrtf(length);
+    idx = N_AXIS;
+    do {
+        idx--;
+        direction[idx] /= length;
+        cosine += direction[idx] * cjog.direction[idx];
+    } while(idx);
+
+    if(state == STATE_JOG) {
+
+        if(cjog.active && cosine > 0.9999f && plan_update_jog_rate(feed_rate))
+            return Status_OK;
+
+        // Direction changed or a $J= jog is executing, wait for it to stop.
+        system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+        while(state_get() == STATE_JOG) {
+            if(!protocol_execute_realtime())
+                return Status_Reset;
+        }
+        if(state_get() != STATE_IDLE)
+            return Status_IdleError;
+    }
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        target[idx] = gc_state.position[idx] + direction[idx] * CONTINUOUS_JOG_DISTANCE;
+    } while(idx);
+
+    if(settings.limits.flags.jog_soft_limited)
+        grbl.apply_jog_limits(target, gc_state.position);
+    else if(sys.soft_limits.mask && !grbl.check_travel_limits(target, sys.soft_limits, true))
+        return Status_TravelExceeded;
+
+    plan_data_init(&plan_data);
+    memcpy(&plan_data.spindle, &gc_state.spindle, sizeof(spindle_t));
+    plan_data.spindle.state = gc_state.modal.spindle.state;
+    plan_data.condition.coolant = gc_state.modal.coolant;
+    plan_data.condition.is_rpm_rate_adjusted = gc_state.is_rpm_rate_adjusted || (gc_state.modal.spindle.state.ccw && gc_state.spindle.hal->cap.laser);
+    plan_data.feed_rate = feed_rate;
+    plan_data.condition.no_feed_override =
+    plan_data.condition.jog_motion =
+    plan_data.condition.target_valid =
+    plan_data.condition.target_validated = On;
+
+    if(!mc_line(target, &plan_data))
+        return Status_Reset;
+
+    memcpy(gc_state.position, target, sizeof(gc_state.position));
+    memcpy(cjog.direction, direction, sizeof(cjog.direction));
+    cjog.active = true;
+
+#ifndef KINEMATICS_API
+    if((state = state_get()) == STATE_IDLE && plan_get_current_block() != NULL) {
+        state_set(STATE_JOG);
+        st_prep_buffer();
+        st_wake_up();
+    }
+#endif
+
+    return Status_OK;
+}
+
+#endif
+
 // Execute dwell in seconds.
 void mc_dwell (float seconds)
 {
+#if PREFLIGHT_ENABLE
+    if(preflight_active())
+        preflight_dwell(seconds);
+#endif
+
     if (state_get() != STATE_CHECK_MODE) {
+#if PLANNER_DWELL_ENABLE
+        plan_line_data_t plan_data;
+
+        plan_data_init(&plan_data);
+        memcpy(&plan_data.spindle, &gc_state.spindle, sizeof(spindle_t));
+        plan_data.spindle.state = gc_state.modal.spindle.state;
+        plan_data.condition.coolant = gc_state.modal.coolant;
+        plan_data.condition.is_rpm_rate_adjusted = gc_state.is_rpm_rate_adjusted;
+        plan_data.line_number = gc_state.line_number;
+
+  #if ENABLE_PATH_BLENDING
+        if(!mc_blend_flush())
+            return;
+  #endif
+
+        while(plan_check_full_buffer()) {
+            protocol_auto_cycle_start();     // Auto-cycle start when buffer is full.
+            if(!protocol_execute_realtime()) // Check for any run-time commands
+                return;                      // Bail, if system abort.
+        }
+
+        // Dwell is executed by the stepper module, fall back to a synchronized delay if it could not be buffered.
+        if(plan_buffer_dwell(seconds, &plan_data))
+            return;
+#endif
         protocol_buffer_synchronize();
         delay_sec(seconds, DelayMode_Dwell);
     }
@@ -1080,6 +1409,53 @@ gc_probe_t mc_probe_cycle (float *target, plan_line_data_t *pl_data, gc_parser_f
 }
 
 
+// Two-stage probing for tool setting and batch part probing. Probes toward target at the programmed feed rate,
+// on contact backs off by the retract distance along the probing direction and reprobes at feed_rate.
+// The reprobe travel is limited to twice the retract distance, the result of the reprobe is returned.
+// NOTE: target is returned with the reprobe target, the parser updates its position from it as for mc_probe_cycle().
+gc_probe_t mc_probe_reprobe (float *target, plan_line_data_t *pl_data, gc_parser_flags_t parser_flags, float retract, float feed_rate)
+{
+    gc_probe_t status;
+    uint_fast8_t idx = N_AXIS;
+    float position[N_AXIS], unit_vec[N_AXIS], travel;
+    plan_line_data_t plan_data;
+
+    // Unit vector of the probing direction.
+    do {
+        idx--;
+        unit_vec[idx] = target[idx] - gc_state.position[idx];
+    } while(idx);
+
+    if((travel = convert_delta_vector_to_unit_vector(unit_vec)) <= retract)
+        return mc_probe_cycle(target, pl_data, parser_flags);
+
+    // Message and output commands are executed with the first move only.
+    memcpy(&plan_data, pl_data, sizeof(plan_line_data_t));
+    plan_data.message = NULL;
+    plan_data.output_commands = NULL;
+    plan_data.raster = NULL;
+
+    if((status = mc_probe_cycle(target, pl_data, parser_flags)) != GCProbe_Found)
+        return status;
+
+    // Back off from contact position at the approach feed rate.
+    system_convert_array_steps_to_mpos(position, sys.probe_position);
+
+    idx = N_AXIS;
+    do {
+        idx--;
+        position[idx] -= unit_vec[idx] * retract;
+        target[idx] = position[idx] + unit_vec[idx] * retract * 2.0f;
+    } while(idx);
+
+    if(!mc_line(position, &plan_data))
+        return GCProbe_Abort;
+
+    plan_data.feed_rate = feed_rate;
+
+    return mc_probe_cycle(target, &plan_data, parser_flags);
+}
+
 // Plans and executes the single special motion case for parking. Independent of main planner buffer.
 // NOTE: Uses the always free planner ring buffer head to store motion parameters for execution.
 bool mc_parking_motion (float *parking_target, plan_line_data_t *pl_data)
@@ -1120,6 +1496,21 @@ ISR_CODE void ISR_FUNC(mc_reset)(void)
 
         system_set_exec_state_flag(EXEC_RESET);
 
+#if ENABLE_PATH_BLENDING
+        if(blend.pending) {
+            blend.pending = false;
+            // Release the message and output commands of the dropped motion.
+            if(blend.pl_data.message) {
+                gc_message_free(blend.pl_data.message);
+                blend.pl_data.message = NULL;
+            }
+            if(blend.pl_data.output_commands) {
+                gc_output_commands_free(blend.pl_data.output_commands);
+                blend.pl_data.output_commands = NULL;
+            }
+        }
+#endif
+
         if(hal.stream.suspend_read)
             hal.stream.suspend_read(false);
 
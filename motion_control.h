@@ -38,6 +38,11 @@
 // (1 minute)/feed_rate time.
 bool mc_line(float *target, plan_line_data_t *pl_data);
 
+#if ENABLE_PATH_BLENDING
+// Plan the motion held back for path blending.
+bool mc_blend_flush (void);
+#endif
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
 // offset == offset from current xyz, axis_XXX defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, is_clockwise_arc boolean. Used
@@ -53,6 +58,9 @@ void mc_thread (plan_line_data_t *pl_data, float *position, gc_thread_data *thre
 
 // Sets up valid jog motion received from g-code parser, checks for soft-limits, and executes the jog.
 status_code_t mc_jog_execute(plan_line_data_t *pl_data, parser_block_t *gc_block, float *position);
+#if CONTINUOUS_JOG_ENABLE
+status_code_t mc_jog_continuous(float *direction, float feed_rate);
+#endif
 
 // Dwell for a specific number of seconds
 void mc_dwell(float seconds);
@@ -63,6 +71,9 @@ status_code_t mc_homing_cycle(axes_signals_t cycle);
 // Perform tool length probe cycle. Requires probe switch.
 gc_probe_t mc_probe_cycle(float *target, plan_line_data_t *pl_data, gc_parser_flags_t parser_flags);
 
+// Two-stage probing, fast approach followed by a retract and a slow reprobe.
+gc_probe_t mc_probe_reprobe (float *target, plan_line_data_t *pl_data, gc_parser_flags_t parser_flags, float retract, float feed_rate);
+
 // Handles updating the override control state.
 void mc_override_ctrl_update(gc_override_flags_t override_state);
 
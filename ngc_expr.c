@@ -30,9 +30,15 @@
 #include "errors.h"
 #include "ngc_expr.h"
 #include "ngc_params.h"
+#include "mem_stats.h"
 
 #define MAX_STACK 7
 
+#ifndef NGC_EXPR_CODE_SIZE
+#define NGC_EXPR_CODE_SIZE 128  // Max size of compiled expression code
+#endif
+#define NGC_EXPR_MAX_SLOTS (MAX_STACK * 3)
+
 typedef enum {
     NGCBinaryOp_NoOp = 0,
     NGCBinaryOp_DividedBy,
@@ -73,6 +79,28 @@ typedef enum {
     NGCUnaryOp_Exists,  // Not implemented
 } ngc_unary_op_t;
 
+typedef enum {
+    NGCExprCode_End = 0,
+    NGCExprCode_Const,      //!< slot, float value
+    NGCExprCode_Param,      //!< slot, ngc_param_id_t
+    NGCExprCode_NamedRO,    //!< slot, ncg_name_param_id_t
+    NGCExprCode_Named,      //!< slot, zero terminated name
+    NGCExprCode_Exists,     //!< slot, zero terminated name
+    NGCExprCode_Negate,     //!< slot
+    NGCExprCode_Unary,      //!< slot, ngc_unary_op_t - operand in slot
+    NGCExprCode_Atan,       //!< slot - operands in slot, slot + 1
+    NGCExprCode_Binary,     //!< slot, ngc_binary_op_t - operands in slot, slot + 1
+    NGCExprCode_Check       //!< slot - fail if value is not a number or infinite
+} ngc_expr_opcode_t;
+
+struct ngc_expr_code {
+    uint16_t size;
+    uint8_t code[];
+};
+
+static uint8_t code_buf[NGC_EXPR_CODE_SIZE];
+static uint_fast16_t code_len;
+
 /*! \brief Executes the operations: /, MOD, ** (POW), *.
 
 \param lhs pointer to the left hand side operand and result.
@@ -804,4 +832,288 @@ status_code_t ngc_eval_expression (char *line, uint_fast8_t *pos, float *value)
     return Status_OK;
 }
 
+/*
+ * Expression compiler.
+ *
+ * Compiles expressions to a compact code that is executed against an array of value slots,
+ * the slots are allocated as the values[] stack in ngc_eval_expression() is and the compiler
+ * mirrors the parsing logic of the expression reader functions above,
+ * this to ensure that compiled code yields exactly the same results as an interpreted expression.
+ * Numbered parameters and predefined named parameters are resolved at compile time.
+ */
+
+static bool emit (const void *data, uint_fast16_t len)
+{
+    bool ok;
+
+    if((ok = code_len + len <= NGC_EXPR_CODE_SIZE)) {
+        memcpy(code_buf + code_len, data, len);
+        code_len += len;
+    }
+
+    return ok;
+}
+
+static bool emit_op (ngc_expr_opcode_t opcode, uint_fast8_t slot)
+{
+    uint8_t op[2] = { (uint8_t)opcode, (uint8_t)slot };
+
+    return slot < NGC_EXPR_MAX_SLOTS - 1 && emit(op, 2);
+}
+
+static bool emit_op_arg (ngc_expr_opcode_t opcode, uint_fast8_t slot, uint8_t arg)
+{
+    return emit_op(opcode, slot) && emit(&arg, 1);
+}
+
+static bool compile_expression (char *line, uint_fast8_t *pos, uint_fast8_t slot);
+
+static bool compile_parameter (char *line, uint_fast8_t *pos, uint_fast8_t slot)
+{
+    bool ok = false;
+    float value;
+
+    if(*(line + *pos) == '#') {
+
+        (*pos)++;
+
+        if(*(line + *pos) == '<') {
+
+            (*pos)++;
+            char c, *param = line + *pos, *arg = line + *pos, name[MAX_PARAM_LENGTH + 1];
+            uint_fast8_t len = 0;
+            ncg_name_param_id_t id;
+
+            while((c = *arg) && c != '>') {
+                if(len < MAX_PARAM_LENGTH)
+                    name[len++] = LCAPS(c);
+                arg++;
+            }
+
+            *pos += arg - param + 1;
+            name[len++] = '\0';
+
+            if((ok = *arg == '>' && arg - param < MAX_PARAM_LENGTH)) {
+                if(*name == '_' && ngc_named_param_get_ro_id(name, &id))
+                    ok = emit_op_arg(NGCExprCode_NamedRO, slot, (uint8_t)id);
+                else
+                    ok = emit_op(NGCExprCode_Named, slot) && emit(name, len);
+            }
+
+        } else if(read_float(line, pos, &value)) {
+            ngc_param_id_t id = (ngc_param_id_t)value;
+            ok = emit_op(NGCExprCode_Param, slot) && emit(&id, sizeof(ngc_param_id_t));
+        }
+    }
+
+    return ok;
+}
+
+static bool compile_unary (char *line, uint_fast8_t *pos, uint_fast8_t slot)
+{
+    bool ok;
+    ngc_unary_op_t operation;
+
+    if((ok = read_operation_unary(line, pos, &operation) == Status_OK && line[*pos] == '[')) {
+
+        if(operation == NGCUnaryOp_Exists) {
+
+            char *arg = &line[++(*pos)], *s;
+
+            s = arg;
+            while(*s && *s != ']')
+                s++;
+
+            if((ok = *s == ']')) {
+                uint8_t eos = '\0';
+                ok = emit_op(NGCExprCode_Exists, slot) && emit(arg, s - arg) && emit(&eos, 1);
+                *pos = *pos + s - arg + 1;
+            }
+
+        } else if((ok = compile_expression(line, pos, slot))) {
+            if(operation == NGCUnaryOp_ATAN) {
+                if((ok = line[*pos] == '/' && line[++(*pos)] == '['))
+                    ok = compile_expression(line, pos, slot + 1) && emit_op(NGCExprCode_Atan, slot);
+            } else
+                ok = emit_op_arg(NGCExprCode_Unary, slot, (uint8_t)operation);
+        }
+    }
+
+    return ok;
+}
+
+static bool compile_real_value (char *line, uint_fast8_t *pos, uint_fast8_t slot)
+{
+    bool ok;
+    float value;
+    char c = line[*pos], c1;
+
+    if(c == '\0')
+        return false;
+
+    c1 = line[*pos + 1];
+
+    if(c == '[')
+        ok = compile_expression(line, pos, slot);
+    else if(c == '#')
+        ok = compile_parameter(line, pos, slot);
+    else if(c == '+' && c1 && !isdigit(c1) && c1 != '.') {
+        (*pos)++;
+        ok = compile_real_value(line, pos, slot);
+    } else if(c == '-' && c1 && !isdigit(c1) && c1 != '.') {
+        (*pos)++;
+        ok = compile_real_value(line, pos, slot) && emit_op(NGCExprCode_Negate, slot);
+    } else if ((c >= 'A') && (c <= 'Z'))
+        ok = compile_unary(line, pos, slot);
+    else
+        ok = read_float(line, pos, &value) && emit_op(NGCExprCode_Const, slot) && emit(&value, sizeof(float));
+
+    return ok && emit_op(NGCExprCode_Check, slot);
+}
+
+static bool compile_expression (char *line, uint_fast8_t *pos, uint_fast8_t slot)
+{
+    ngc_binary_op_t operators[MAX_STACK];
+    uint_fast8_t stack_index = 1;
+
+    if(line[*pos] != '[')
+        return false;
+
+    (*pos)++;
+
+    if(!compile_real_value(line, pos, slot) || read_operation(line, pos, operators) != Status_OK)
+        return false;
+
+    for(; operators[0] != NGCBinaryOp_RightBracket;) {
+
+        if(stack_index >= MAX_STACK)
+            return false;
+
+        if(!compile_real_value(line, pos, slot + stack_index) || read_operation(line, pos, operators + stack_index) != Status_OK)
+            return false;
+
+        if (precedence(operators[stack_index]) > precedence(operators[stack_index - 1]))
+            stack_index++;
+        else { // precedence of latest operator is <= previous precedence
+            for(; precedence(operators[stack_index]) <= precedence(operators[stack_index - 1]);) {
+
+                if(!emit_op_arg(NGCExprCode_Binary, slot + stack_index - 1, (uint8_t)operators[stack_index - 1]))
+                    return false;
+
+                operators[stack_index - 1] = operators[stack_index];
+                if((stack_index > 1) && precedence(operators[stack_index - 1] <= precedence(operators[stack_index - 2])))
+                    stack_index--;
+                else
+                    break;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*! \brief Compile expression for repeated evaluation by ngc_expr_execute().
+
+\param line pointer to RS274/NGC code (block).
+\param pos offset into line where expression starts.
+\returns pointer to allocated code if successful, NULL if not. Free the code with mem_free() when no longer needed.
+*/
+ngc_expr_code_t *ngc_expr_compile (char *line, uint_fast8_t *pos)
+{
+    uint8_t end = NGCExprCode_End;
+    ngc_expr_code_t *code = NULL;
+
+    code_len = 0;
+
+    if(compile_expression(line, pos, 0) && emit(&end, 1) && (code = mem_alloc(MemTag_NGC, sizeof(ngc_expr_code_t) + code_len))) {
+        code->size = code_len;
+        memcpy(code->code, code_buf, code_len);
+    }
+
+    return code;
+}
+
+/*! \brief Evaluate compiled expression and set result if successful.
+
+\param code pointer to code returned from ngc_expr_compile().
+\param value pointer to float where result is to be stored.
+\returns #Status_OK enum value if evaluated without error, appropriate \ref status_code_t enum value if not.
+*/
+status_code_t ngc_expr_execute (ngc_expr_code_t *code, float *value)
+{
+    float values[NGC_EXPR_MAX_SLOTS];
+    uint8_t *ip = code->code, slot;
+    size_t len;
+    ngc_param_id_t id;
+    ngc_expr_opcode_t opcode;
+    status_code_t status = Status_OK;
+
+    while(status == Status_OK && (opcode = (ngc_expr_opcode_t)*ip++) != NGCExprCode_End) {
+
+        slot = *ip++;
+
+        switch(opcode) {
+
+            case NGCExprCode_Const:
+                memcpy(&values[slot], ip, sizeof(float));
+                ip += sizeof(float);
+                break;
+
+            case NGCExprCode_Param:
+                memcpy(&id, ip, sizeof(ngc_param_id_t));
+                ip += sizeof(ngc_param_id_t);
+                if(!ngc_param_get(id, &values[slot]))
+                    status = Status_BadNumberFormat;
+                break;
+
+            case NGCExprCode_NamedRO:
+                values[slot] = ngc_named_param_get_by_id((ncg_name_param_id_t)*ip++);
+                break;
+
+            case NGCExprCode_Named:
+                len = strlen((char *)ip) + 1;
+                if(!ngc_named_param_get((char *)ip, &values[slot]))
+                    status = Status_BadNumberFormat;
+                ip += len;
+                break;
+
+            case NGCExprCode_Exists:
+                len = strlen((char *)ip) + 1;
+                values[slot] = ngc_named_param_exists((char *)ip) ? 1.0f : 0.0f;
+                ip += len;
+                break;
+
+            case NGCExprCode_Negate:
+                values[slot] = -values[slot];
+                break;
+
+            case NGCExprCode_Unary:
+                status = execute_unary(&values[slot], (ngc_unary_op_t)*ip++);
+                break;
+
+            case NGCExprCode_Atan:
+                values[slot] = atan2f(values[slot], values[slot + 1]) * DEGRAD;  /* value in radians, convert to degrees */
+                break;
+
+            case NGCExprCode_Binary:
+                status = execute_binary(&values[slot], (ngc_binary_op_t)*ip++, &values[slot + 1]);
+                break;
+
+            case NGCExprCode_Check:
+                if(isnanf(values[slot]) || isinff(values[slot]))
+                    status = Status_ExpressionInvalidResult; // Calculation resulted in 'not a number'
+                break;
+
+            default:
+                status = Status_ExpressionSyntaxError;
+                break;
+        }
+    }
+
+    if(status == Status_OK)
+        *value = values[0];
+
+    return status;
+}
+
 #endif
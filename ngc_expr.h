@@ -3,6 +3,10 @@
 #ifndef _NGC_EXPR_H_
 #define _NGC_EXPR_H_
 
+typedef struct ngc_expr_code ngc_expr_code_t;
+
 status_code_t ngc_eval_expression (char *line, uint_fast8_t *pos, float *value);
+ngc_expr_code_t *ngc_expr_compile (char *line, uint_fast8_t *pos);
+status_code_t ngc_expr_execute (ngc_expr_code_t *code, float *value);
 
 #endif
@@ -30,11 +30,20 @@
 #include "errors.h"
 #include "ngc_expr.h"
 #include "ngc_params.h"
+#include "mem_stats.h"
+#include "protocol.h"
 
 #ifndef NGC_STACK_DEPTH
 #define NGC_STACK_DEPTH 10
 #endif
 
+#ifndef NGC_MACRO_CACHE_SIZE
+#define NGC_MACRO_CACHE_SIZE 1024 // Size of loop body line cache, set to 0 to disable.
+#endif
+
+#define NGC_SUB_PARAMS 30       // Number of subroutine call parameters, #1 - #30
+#define NGC_SUB_ALLOC_SIZE 128  // Subroutine body memory allocation increment
+
 typedef enum {
     NGCFlowCtrl_NoOp = 0,
     NGCFlowCtrl_If,
@@ -50,16 +59,32 @@ typedef enum {
     NGCFlowCtrl_EndRepeat,
     NGCFlowCtrl_Return,
     NGCFlowCtrl_RaiseAlarm,
-    NGCFlowCtrl_RaiseError
+    NGCFlowCtrl_RaiseError,
+    NGCFlowCtrl_Sub,
+    NGCFlowCtrl_EndSub,
+    NGCFlowCtrl_Call
 } ngc_cmd_t;
 
+typedef struct ngc_sub {
+    uint32_t o_label;
+    vfs_file_t *file;       //!< File the subroutine is defined in, NULL if not defined in a file
+    uint_fast16_t length;   //!< Length of body
+    uint_fast16_t size;     //!< Size of allocated body
+    uint8_t *body;          //!< Body lines, each line is stored as a uint16_t length followed by the line
+    struct ngc_sub *next;
+} ngc_sub_t;
+
 typedef struct {
     uint32_t o_label;
     ngc_cmd_t operation;
     vfs_file_t *file;
     size_t file_pos;
     char *expr;
+    ngc_expr_code_t *code;              //!< Compiled loop condition, used instead of expr when available
     uint32_t repeats;
+    ngc_sub_t *sub;                     //!< Subroutine executing, for calls and loops in subroutine bodies file_pos is the offset into the body
+    float *params;                      //!< Saved caller parameters #1 - #30, for calls
+    char eol;                           //!< End of line character of call statement, for calls
     bool skip;
     bool handled;
     bool brk;
@@ -67,6 +92,538 @@ typedef struct {
 
 static volatile int_fast8_t stack_idx = -1;
 static ngc_stack_entry_t stack[NGC_STACK_DEPTH] = {0};
+static char last_eol = '\0';
+
+static status_code_t stack_push (uint32_t o_label, ngc_cmd_t operation);
+static bool stack_pull (void);
+static void stack_clear (void);
+
+/*
+ * Subroutines.
+ *
+ * Subroutine bodies are stored in RAM when the definition is read, lines are stored unparsed
+ * except O-word statements that are passed to the parser for detecting the end of the body.
+ * Calls replays the body via the stream read_line handler, status reports for lines executed
+ * are suppressed until the call returns so that the caller gets a single response for the call statement.
+ */
+
+static ngc_sub_t *subs = NULL, *sub_def = NULL;
+static bool sub_def_failed = false;
+static struct {
+    bool active;
+    stream_read_line_ptr read_line;
+    stream_release_line_ptr release_line;
+    status_message_ptr status_message;
+    char line[LINE_BUFFER_SIZE];
+} sub_replay = {0};
+
+static ngc_stack_entry_t *current_call (void)
+{
+    int_fast8_t idx = stack_idx;
+
+    while(idx >= 0 && stack[idx].operation != NGCFlowCtrl_Call)
+        idx--;
+
+    return idx >= 0 ? &stack[idx] : NULL;
+}
+
+static void sub_free (ngc_sub_t *sub)
+{
+    if(sub->body)
+        mem_free(sub->body);
+    mem_free(sub);
+}
+
+static ngc_sub_t *sub_find (uint32_t o_label)
+{
+    ngc_sub_t *sub = subs, *global = NULL;
+
+    while(sub) {
+        if(sub->o_label == o_label) {
+            if(sub->file == hal.stream.file)
+                break;
+            if(sub->file == NULL)
+                global = sub;
+        }
+        sub = sub->next;
+    }
+
+    return sub ? sub : global;
+}
+
+static bool sub_append (const char *line)
+{
+    uint_fast16_t length = strlen(line);
+
+    if(sub_def->length + sizeof(uint16_t) + length > sub_def->size) {
+
+        uint8_t *body;
+        uint_fast16_t size = sub_def->size + max(NGC_SUB_ALLOC_SIZE, sizeof(uint16_t) + length);
+
+        if(size > UINT16_MAX || (body = mem_realloc(MemTag_NGC, sub_def->body, size)) == NULL)
+            return false;
+
+        sub_def->body = body;
+        sub_def->size = size;
+    }
+
+    uint16_t len = (uint16_t)length;
+
+    memcpy(sub_def->body + sub_def->length, &len, sizeof(uint16_t));
+    memcpy(sub_def->body + sub_def->length + sizeof(uint16_t), line, length);
+    sub_def->length += sizeof(uint16_t) + length;
+
+    return true;
+}
+
+static status_code_t sub_define_start (uint32_t o_label)
+{
+    if((sub_def = mem_alloc(MemTag_NGC, sizeof(ngc_sub_t))) == NULL)
+        return Status_FlowControlOutOfMemory;
+
+    memset(sub_def, 0, sizeof(ngc_sub_t));
+    sub_def->o_label = o_label;
+    sub_def->file = hal.stream.file;
+    sub_def_failed = false;
+
+    return Status_OK;
+}
+
+// Returns true if the subroutine is executing, either called or in a loop in a called body.
+static bool sub_active (ngc_sub_t *sub)
+{
+    int_fast8_t idx = stack_idx;
+
+    while(idx >= 0 && stack[idx].sub != sub)
+        idx--;
+
+    return idx >= 0;
+}
+
+// Add end of subroutine statement to the body and add subroutine to list, replacing earlier definition if present.
+// Redefinition of a subroutine that is executing is refused.
+static status_code_t sub_define_end (char *line)
+{
+    ngc_sub_t *sub = subs, *prev = NULL, *def = sub_def;
+    bool ok = !sub_def_failed && sub_append(line);
+
+    sub_def = NULL;
+
+    if(!ok) {
+        sub_free(def);
+        return Status_FlowControlOutOfMemory;
+    }
+
+    while(sub && !(sub->o_label == def->o_label && sub->file == def->file)) {
+        prev = sub;
+        sub = sub->next;
+    }
+
+    if(sub && sub_active(sub)) {
+        sub_free(def);
+        return Status_FlowControlSyntaxError;
+    }
+
+    if(sub) {
+        if(prev)
+            prev->next = sub->next;
+        else
+            subs = sub->next;
+        sub_free(sub);
+    }
+
+    def->next = subs;
+    subs = def;
+
+    return Status_OK;
+}
+
+static void sub_release_line (void)
+{
+    // NOOP
+}
+
+static int_fast16_t sub_read_line (char **line);
+static status_code_t sub_status_message (status_code_t status_code);
+
+static void sub_replay_stop (void)
+{
+    if(sub_replay.active) {
+
+        sub_replay.active = false;
+
+        if(hal.stream.read_line == sub_read_line) {
+            hal.stream.read_line = sub_replay.read_line;
+            if(hal.stream.release_line == sub_release_line)
+                hal.stream.release_line = sub_replay.release_line;
+        }
+
+        if(grbl.report.status_message == sub_status_message)
+            grbl.report.status_message = sub_replay.status_message;
+    }
+}
+
+static void sub_replay_start (void)
+{
+    if(!sub_replay.active) {
+
+        sub_replay.active = true;
+        sub_replay.read_line = hal.stream.read_line;
+        sub_replay.release_line = hal.stream.release_line;
+        sub_replay.status_message = grbl.report.status_message;
+
+        hal.stream.read_line = sub_read_line;
+        if(hal.stream.release_line == NULL)
+            hal.stream.release_line = sub_release_line;
+        grbl.report.status_message = sub_status_message;
+    }
+}
+
+// Unwind stack up to and including the topmost call.
+static void sub_unwind (void)
+{
+    while(stack_idx >= 0 && stack[stack_idx].operation != NGCFlowCtrl_Call)
+        stack_pull();
+
+    stack_pull();
+}
+
+static int_fast16_t sub_read_line (char **line)
+{
+    uint16_t length;
+    ngc_stack_entry_t *call = current_call();
+
+    if(call && call->file_pos >= call->sub->length)
+        sub_unwind(); // End of body reached without executing the end of subroutine statement, should not happen.
+
+    if((call = current_call()) == NULL) {
+        sub_replay_stop();
+        return stream_read_line_valid() ? hal.stream.read_line(line) : -1;
+    }
+
+    memcpy(&length, call->sub->body + call->file_pos, sizeof(uint16_t));
+    memcpy(sub_replay.line, call->sub->body + call->file_pos + sizeof(uint16_t), length);
+    sub_replay.line[length] = call->eol;
+    call->file_pos += sizeof(uint16_t) + length;
+
+    *line = sub_replay.line;
+
+    return (int_fast16_t)length;
+}
+
+// Suppress ok responses while a subroutine is executing, on errors the call is aborted.
+static status_code_t sub_status_message (status_code_t status_code)
+{
+    status_message_ptr status_message = sub_replay.status_message;
+
+    if(status_code == Status_OK)
+        return status_code;
+
+    stack_clear();
+
+    return status_message(status_code);
+}
+
+static status_code_t sub_call (uint32_t o_label, char *line, uint_fast8_t *pos)
+{
+    float args[NGC_SUB_PARAMS];
+    uint_fast8_t n_args = 0, idx;
+    ngc_sub_t *sub;
+    status_code_t status;
+
+    if((sub = sub_find(o_label)) == NULL)
+        return Status_FlowControlSyntaxError; // Subroutine not defined
+
+    while(line[*pos] == '[') {
+        if(n_args == NGC_SUB_PARAMS)
+            return Status_FlowControlSyntaxError; // Too many arguments
+        if((status = ngc_eval_expression(line, pos, &args[n_args++])) != Status_OK)
+            return status;
+    }
+
+    if((status = stack_push(o_label, NGCFlowCtrl_Call)) != Status_OK)
+        return status;
+
+    if((stack[stack_idx].params = mem_alloc(MemTag_NGC, sizeof(float) * NGC_SUB_PARAMS)) == NULL) {
+        stack_pull();
+        return Status_FlowControlOutOfMemory;
+    }
+
+    for(idx = 0; idx < NGC_SUB_PARAMS; idx++) {
+        ngc_param_get((ngc_param_id_t)(idx + 1), &stack[stack_idx].params[idx]);
+        ngc_param_set((ngc_param_id_t)(idx + 1), idx < n_args ? args[idx] : 0.0f);
+    }
+
+    stack[stack_idx].sub = sub;
+    stack[stack_idx].file_pos = 0;
+    stack[stack_idx].eol = last_eol;
+
+    sub_replay_start();
+
+    return Status_OK;
+}
+
+// Return from subroutine, sets _value and _value_returned named parameters.
+static status_code_t sub_return (char *line, uint_fast8_t *pos)
+{
+    float value;
+    bool returned = line[*pos] == '[' && ngc_eval_expression(line, pos, &value) == Status_OK;
+
+    sub_unwind();
+
+    if(returned) {
+        ngc_named_param_set("_value", value);
+        ngc_named_param_set("_value_returned", 1.0f);
+    } else
+        ngc_named_param_set("_value_returned", 0.0f);
+
+    return Status_OK;
+}
+
+// Called by stack_pull() for subroutine calls and definitions.
+static void sub_pull (ngc_stack_entry_t *entry)
+{
+    uint_fast8_t idx;
+
+    if(entry->operation == NGCFlowCtrl_Call && entry->params) {
+        for(idx = 0; idx < NGC_SUB_PARAMS; idx++)
+            ngc_param_set((ngc_param_id_t)(idx + 1), entry->params[idx]);
+        mem_free(entry->params);
+        entry->params = NULL;
+    } else if(entry->operation == NGCFlowCtrl_Sub && sub_def) {
+        sub_free(sub_def);
+        sub_def = NULL;
+    }
+}
+
+#if NGC_MACRO_CACHE_SIZE
+
+/*
+ * Loop body line cache.
+ *
+ * Lines read from a macro file while a loop is active are stored in normalised form along with
+ * the file position following them. Loops jumping back to a position within the cache are replayed
+ * from RAM via the stream read_line handler, the file is only read again when replay runs past the
+ * end of the cache. The cache is invalidated when the last loop in the file ends.
+ */
+
+typedef struct {
+    uint32_t end_pos;   //!< File position after line
+    uint16_t length;    //!< Line length, excluding terminator
+    char eol;           //!< End of line character
+} cache_line_t;
+
+typedef struct {
+    vfs_file_t *file;
+    size_t start_pos;           //!< File position of first line in cache
+    size_t end_pos;             //!< File position after last line in cache
+    size_t replay_pos;          //!< File position of next line to replay
+    uint_fast16_t length;
+    uint_fast16_t replay;       //!< Offset of next line to replay
+    bool full;
+    bool replaying;
+    stream_read_line_ptr read_line;
+    stream_release_line_ptr release_line;
+    uint8_t *data;
+    char *line;
+} line_cache_t;
+
+static line_cache_t cache = {0};
+
+static int_fast16_t cache_read_line (char **line);
+
+static void cache_release_line (void)
+{
+    // NOOP
+}
+
+static void cache_stop_replay (bool sync)
+{
+    if(cache.replaying) {
+
+        cache.replaying = false;
+
+        if(hal.stream.read_line == cache_read_line) {
+            hal.stream.read_line = cache.read_line;
+            hal.stream.release_line = cache.release_line;
+        }
+
+        if(sync && vfs_tell(cache.file) != cache.replay_pos)
+            vfs_seek(cache.file, cache.replay_pos);
+    }
+}
+
+static void cache_invalidate (bool sync)
+{
+    cache_stop_replay(sync);
+    cache.file = NULL;
+}
+
+static void cache_reset (vfs_file_t *file, size_t pos)
+{
+    cache_stop_replay(false);
+
+    cache.file = file;
+    cache.start_pos = cache.end_pos = pos;
+    cache.length = 0;
+    cache.full = false;
+}
+
+// Find offset of line starting at file position pos, returns false if not found.
+static bool cache_find (size_t pos, uint_fast16_t *offset)
+{
+    cache_line_t hdr;
+    size_t line_pos = cache.start_pos;
+    uint_fast16_t idx = 0;
+
+    while(line_pos != pos && idx < cache.length) {
+        memcpy(&hdr, cache.data + idx, sizeof(cache_line_t));
+        idx += sizeof(cache_line_t) + hdr.length;
+        line_pos = hdr.end_pos;
+    }
+
+    *offset = idx;
+
+    return line_pos == pos;
+}
+
+// Called on loop start, restarts the cache unless already recording the part of the file the loop starts in.
+static void cache_start (vfs_file_t *file, size_t pos)
+{
+    uint_fast16_t offset;
+
+    if(cache.data == NULL && (cache.data = mem_alloc(MemTag_NGC, NGC_MACRO_CACHE_SIZE + LINE_BUFFER_SIZE)))
+        cache.line = (char *)cache.data + NGC_MACRO_CACHE_SIZE;
+
+    if(cache.data && !(cache.file == file && cache_find(pos, &offset)))
+        cache_reset(file, pos);
+}
+
+// Start replay from file position pos, returns false if the position is not cached.
+static bool cache_seek (vfs_file_t *file, size_t pos)
+{
+    uint_fast16_t offset;
+
+    if(cache.file != file || !cache_find(pos, &offset)) {
+        if(cache.data)
+            cache_reset(file, pos);
+        return false;
+    }
+
+    if(offset == cache.length) {
+        cache_stop_replay(false);
+        return false;
+    }
+
+    if(!cache.replaying) {
+        cache.replaying = true;
+        cache.read_line = hal.stream.read_line;
+        cache.release_line = hal.stream.release_line;
+        hal.stream.read_line = cache_read_line;
+        hal.stream.release_line = cache_release_line;
+    }
+
+    cache.replay = offset;
+    cache.replay_pos = pos;
+
+    return true;
+}
+
+static int_fast16_t cache_read_line (char **line)
+{
+    cache_line_t hdr;
+
+    if(hal.stream.file != cache.file || cache.replay >= cache.length) {
+        cache_stop_replay(true); // Seek back to the replay position, a G65 call may continue reading from another file.
+        return stream_read_line_valid() ? hal.stream.read_line(line) : -1;
+    }
+
+    memcpy(&hdr, cache.data + cache.replay, sizeof(cache_line_t));
+    memcpy(cache.line, cache.data + cache.replay + sizeof(cache_line_t), hdr.length);
+    cache.line[hdr.length] = hdr.eol;
+    cache.replay += sizeof(cache_line_t) + hdr.length;
+    cache.replay_pos = hdr.end_pos;
+
+    *line = cache.line;
+
+    return (int_fast16_t)hdr.length;
+}
+
+#endif // NGC_MACRO_CACHE_SIZE
+
+static inline bool is_loop (ngc_cmd_t operation)
+{
+    return operation == NGCFlowCtrl_Do || operation == NGCFlowCtrl_While || operation == NGCFlowCtrl_Repeat;
+}
+
+#if NGC_MACRO_CACHE_SIZE
+
+static bool loop_active (vfs_file_t *file)
+{
+    int_fast8_t idx = stack_idx;
+
+    while(idx >= 0 && !(stack[idx].file == file && is_loop(stack[idx].operation)))
+        idx--;
+
+    return idx >= 0;
+}
+
+#endif
+
+// Returns current file position, replay position is returned when replaying lines from the cache.
+static size_t file_tell (vfs_file_t *file)
+{
+#if NGC_MACRO_CACHE_SIZE
+    if(cache.replaying && file == cache.file)
+        return cache.replay_pos;
+#endif
+
+    return vfs_tell(file);
+}
+
+// Returns true if a loop, conditional or subroutine call is being executed.
+bool ngc_flowctrl_active (void)
+{
+    return stack_idx >= 0;
+}
+
+static inline bool loop_allowed (void)
+{
+    return hal.stream.file || current_call();
+}
+
+static void loop_start (ngc_stack_entry_t *entry)
+{
+    ngc_stack_entry_t *call;
+
+    if((call = current_call())) {
+        entry->sub = call->sub;
+        entry->file_pos = call->file_pos;
+        return;
+    }
+
+    entry->file = hal.stream.file;
+    entry->file_pos = file_tell(hal.stream.file);
+#if NGC_MACRO_CACHE_SIZE
+    cache_start(entry->file, entry->file_pos);
+#endif
+}
+
+static void loop_seek (ngc_stack_entry_t *entry)
+{
+    ngc_stack_entry_t *call;
+
+    if(entry->sub) {
+        if((call = current_call()))
+            call->file_pos = entry->file_pos;
+        return;
+    }
+
+#if NGC_MACRO_CACHE_SIZE
+    if(!cache_seek(entry->file, entry->file_pos))
+#endif
+    vfs_seek(entry->file, entry->file_pos);
+}
 
 static status_code_t read_command (char *line, uint_fast8_t *pos, ngc_cmd_t *operation)
 {
@@ -97,6 +654,9 @@ static status_code_t read_command (char *line, uint_fast8_t *pos, ngc_cmd_t *ope
             if (!strncmp(line + *pos, "ONTINUE", 7)) {
                 *operation = NGCFlowCtrl_Continue;
                 *pos += 7;
+            } else if (!strncmp(line + *pos, "ALL", 3)) {
+                *operation = NGCFlowCtrl_Call;
+                *pos += 3;
             } else
                 status = Status_FlowControlSyntaxError; // Unknown statement name starting with C
             break;
@@ -125,6 +685,9 @@ static status_code_t read_command (char *line, uint_fast8_t *pos, ngc_cmd_t *ope
             } else if (!strncmp(line + *pos, "NDREPEAT", 8)) {
                 *operation = NGCFlowCtrl_EndRepeat;
                 *pos += 8;
+            } else if (!strncmp(line + *pos, "NDSUB", 5)) {
+                *operation = NGCFlowCtrl_EndSub;
+                *pos += 5;
             } else if (!strncmp(line + *pos, "RROR", 4)) {
                 *operation = NGCFlowCtrl_RaiseError;
                 *pos += 4;
@@ -151,6 +714,14 @@ static status_code_t read_command (char *line, uint_fast8_t *pos, ngc_cmd_t *ope
                 *operation = Status_FlowControlSyntaxError; // Unknown statement name starting with R
             break;
 
+        case 'S':
+            if (!strncmp(line + *pos, "UB", 2)) {
+                *operation = NGCFlowCtrl_Sub;
+                *pos += 2;
+            } else
+                status = Status_FlowControlSyntaxError; // Unknown statement name starting with S
+            break;
+
         case 'W':
             if (!strncmp(line + *pos, "HILE", 4)) {
                 *operation = NGCFlowCtrl_While;
@@ -183,22 +754,106 @@ static bool stack_pull (void)
     bool ok;
 
     if((ok = stack_idx >= 0)) {
+        sub_pull(&stack[stack_idx]);
         if(stack[stack_idx].expr)
-            free(stack[stack_idx].expr);
+            mem_free(stack[stack_idx].expr);
+        if(stack[stack_idx].code)
+            mem_free(stack[stack_idx].code);
         memset(&stack[stack_idx], 0, sizeof(ngc_stack_entry_t));
         stack_idx--;
+#if NGC_MACRO_CACHE_SIZE
+        if(cache.file && !loop_active(cache.file))
+            cache_invalidate(true);
+#endif
+        if(!current_call())
+            sub_replay_stop();
     }
 
     return ok;
 }
 
+static void stack_clear (void)
+{
+#if NGC_MACRO_CACHE_SIZE
+    cache_invalidate(false);
+#endif
+
+    while(stack_idx >= 0)
+        stack_pull();
+}
+
+// Evaluate loop condition from the compiled code if available, else from the saved expression.
+static status_code_t eval_loop_condition (ngc_stack_entry_t *entry, float *value)
+{
+    uint_fast8_t pos = 0;
+
+    return entry->code ? ngc_expr_execute(entry->code, value) : ngc_eval_expression(entry->expr, &pos, value);
+}
+
+// Evaluate do-while condition, the expression is compiled on first use and cached in the stack entry.
+static status_code_t eval_do_condition (ngc_stack_entry_t *entry, char *line, uint_fast8_t *pos, float *value)
+{
+    if(entry->code == NULL) {
+        uint_fast8_t cpos = *pos;
+        entry->code = ngc_expr_compile(line, &cpos);
+    }
+
+    return entry->code ? ngc_expr_execute(entry->code, value) : ngc_eval_expression(line, pos, value);
+}
 
 // Public functions
 
 void ngc_flowctrl_init (void)
 {
-    while(stack_idx >= 0)
-        stack_pull();
+    stack_clear();
+
+    while(subs) {
+        ngc_sub_t *next = subs->next;
+        sub_free(subs);
+        subs = next;
+    }
+}
+
+/*! \brief Called for each line received before it is executed.
+
+\param line pointer to the line, NULL if the line overflowed the input buffer.
+\param eol end of line character.
+\returns true if the line was stored in a subroutine body and should not be executed.
+*/
+bool ngc_flowctrl_line_received (char *line, char eol)
+{
+    bool stored = false;
+
+    last_eol = eol;
+
+    if(sub_def && line && *line != 'O' && *line != 'o') {  // O-word statements are passed to the parser
+        if(*line && !sub_append(line))
+            sub_def_failed = true;
+        stored = true;
+    }
+
+#if NGC_MACRO_CACHE_SIZE
+    if(cache.file && cache.file == hal.stream.file && !cache.replaying && !cache.full && !sub_replay.active) {
+
+        cache_line_t hdr;
+        size_t length = line ? strlen(line) : LINE_BUFFER_SIZE;
+
+        // Lines already cached are read from the file again if replay was stopped before the end of the cache.
+        if((hdr.end_pos = (uint32_t)vfs_tell(cache.file)) > cache.end_pos) {
+            if(length < LINE_BUFFER_SIZE - 1 && cache.length + sizeof(cache_line_t) + length <= NGC_MACRO_CACHE_SIZE) {
+                hdr.length = (uint16_t)length;
+                hdr.eol = eol;
+                memcpy(cache.data + cache.length, &hdr, sizeof(cache_line_t));
+                memcpy(cache.data + cache.length + sizeof(cache_line_t), line, length);
+                cache.length += sizeof(cache_line_t) + length;
+                cache.end_pos = hdr.end_pos;
+            } else
+                cache.full = true;
+        }
+    }
+#endif
+
+    return stored;
 }
 
 status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, bool *skip)
@@ -207,14 +862,25 @@ status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, boo
     bool skipping;
     ngc_cmd_t operation, last_op;
 
-    status_code_t status;
-
-    if((status = read_command(line, pos, &operation)) != Status_OK)
-        return status;
+    status_code_t status = read_command(line, pos, &operation);
 
     skipping = stack_idx >= 0 && stack[stack_idx].skip;
     last_op = stack_idx >= 0 ? stack[stack_idx].operation : NGCFlowCtrl_NoOp;
 
+    if(sub_def && last_op == NGCFlowCtrl_Sub) {
+        // Capturing subroutine body, store statement unless end of subroutine.
+        if(status == Status_OK && operation == NGCFlowCtrl_EndSub && o_label == stack[stack_idx].o_label) {
+            status = sub_define_end(line);
+            stack_pull();
+        } else if(!sub_append(line))
+            sub_def_failed = true;
+        *skip = stack_idx >= 0 && stack[stack_idx].skip;
+        return status;
+    }
+
+    if(status != Status_OK)
+        return status;
+
     switch(operation) {
 
         case NGCFlowCtrl_If:
@@ -259,9 +925,9 @@ status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, boo
             break;
 
         case NGCFlowCtrl_Do:
-            if(hal.stream.file) {
+            if(loop_allowed()) {
                 if(!skipping && (status = stack_push(o_label, operation)) == Status_OK) {
-                    stack[stack_idx].file_pos = vfs_tell(hal.stream.file);
+                    loop_start(&stack[stack_idx]);
                     stack[stack_idx].skip = false;
                 }
             } else
@@ -269,25 +935,28 @@ status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, boo
             break;
 
         case NGCFlowCtrl_While:
-            if(hal.stream.file) {
+            if(loop_allowed()) {
                 char *expr = line + *pos;
                 if(stack_idx >= 0 && stack[stack_idx].brk) {
                     if(last_op == NGCFlowCtrl_Do && o_label == stack[stack_idx].o_label)
                         stack_pull();
-                } else if(!skipping && (status = ngc_eval_expression(line, pos, &value)) == Status_OK) {
+                } else if(!skipping && (status = last_op == NGCFlowCtrl_Do && o_label == stack[stack_idx].o_label
+                                                   ? eval_do_condition(&stack[stack_idx], line, pos, &value)
+                                                   : ngc_eval_expression(line, pos, &value)) == Status_OK) {
                     if(last_op == NGCFlowCtrl_Do) {
                         if(o_label == stack[stack_idx].o_label) {
                             if(value != 0.0f)
-                                vfs_seek(stack[stack_idx].file, stack[stack_idx].file_pos);
+                                loop_seek(&stack[stack_idx]);
                             else
                                 stack_pull();
                         }
                     } else if((status = stack_push(o_label, operation)) == Status_OK) {
                         if(!(stack[stack_idx].skip = value == 0.0f)) {
-                            if((stack[stack_idx].expr = malloc(strlen(expr) + 1))) {
-                                strcpy(stack[stack_idx].expr, expr);
-                                stack[stack_idx].file = hal.stream.file;
-                                stack[stack_idx].file_pos = vfs_tell(hal.stream.file);
+                            uint_fast8_t cpos = 0;
+                            if((stack[stack_idx].code = ngc_expr_compile(expr, &cpos)) || (stack[stack_idx].expr = mem_alloc(MemTag_NGC, strlen(expr) + 1))) {
+                                if(stack[stack_idx].expr)
+                                    strcpy(stack[stack_idx].expr, expr);
+                                loop_start(&stack[stack_idx]);
                             } else
                                 status = Status_FlowControlOutOfMemory;
                         }
@@ -298,13 +967,12 @@ status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, boo
             break;
 
         case NGCFlowCtrl_EndWhile:
-            if(hal.stream.file) {
+            if(loop_allowed()) {
                 if(last_op == NGCFlowCtrl_While) {
                     if(o_label == stack[stack_idx].o_label) {
-                        uint_fast8_t pos = 0;
-                        if(!stack[stack_idx].skip && (status = ngc_eval_expression(stack[stack_idx].expr, &pos, &value)) == Status_OK) {
+                        if(!stack[stack_idx].skip && (status = eval_loop_condition(&stack[stack_idx], &value)) == Status_OK) {
                             if(!(stack[stack_idx].skip = value == 0))
-                                vfs_seek(stack[stack_idx].file, stack[stack_idx].file_pos);
+                                loop_seek(&stack[stack_idx]);
                         }
                         if(stack[stack_idx].skip)
                             stack_pull();
@@ -316,12 +984,11 @@ status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, boo
             break;
 
         case NGCFlowCtrl_Repeat:
-            if(hal.stream.file) {
+            if(loop_allowed()) {
                 if(!skipping && (status = ngc_eval_expression(line, pos, &value)) == Status_OK) {
                     if((status = stack_push(o_label, operation)) == Status_OK) {
                         if(!(stack[stack_idx].skip = value == 0.0f)) {
-                            stack[stack_idx].file = hal.stream.file;
-                            stack[stack_idx].file_pos = vfs_tell(hal.stream.file);
+                            loop_start(&stack[stack_idx]);
                             stack[stack_idx].repeats = (uint32_t)value;
                         }
                     }
@@ -331,11 +998,11 @@ status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, boo
             break;
 
         case NGCFlowCtrl_EndRepeat:
-            if(hal.stream.file) {
+            if(loop_allowed()) {
                 if(last_op == NGCFlowCtrl_Repeat) {
                     if(o_label == stack[stack_idx].o_label) {
                         if(stack[stack_idx].repeats && --stack[stack_idx].repeats)
-                            vfs_seek(stack[stack_idx].file, stack[stack_idx].file_pos);
+                            loop_seek(&stack[stack_idx]);
                         else
                             stack_pull();
                     }
@@ -346,7 +1013,7 @@ status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, boo
             break;
 
         case NGCFlowCtrl_Break:
-            if(hal.stream.file) {
+            if(loop_allowed()) {
                 if(!skipping) {
                     while(o_label != stack[stack_idx].o_label && stack_pull());
                     last_op = stack_idx >= 0 ? stack[stack_idx].operation : NGCFlowCtrl_NoOp;
@@ -363,32 +1030,31 @@ status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, boo
             break;
 
         case NGCFlowCtrl_Continue:
-            if(hal.stream.file) {
+            if(loop_allowed()) {
                 if(!skipping) {
                     while(o_label != stack[stack_idx].o_label && stack_pull());
                     if(stack_idx >= 0 && o_label == stack[stack_idx].o_label) switch(stack[stack_idx].operation) {
 
                         case NGCFlowCtrl_Repeat:
                             if(stack[stack_idx].repeats && --stack[stack_idx].repeats)
-                                vfs_seek(stack[stack_idx].file, stack[stack_idx].file_pos);
+                                loop_seek(&stack[stack_idx]);
                             else
                                 stack_pull();
                             break;
 
                         case NGCFlowCtrl_Do:
-                            vfs_seek(stack[stack_idx].file, stack[stack_idx].file_pos);
+                            loop_seek(&stack[stack_idx]);
                             break;
 
                         case NGCFlowCtrl_While:
                             {
-                                uint_fast8_t pos = 0;
-                                if(!stack[stack_idx].skip && (status = ngc_eval_expression(stack[stack_idx].expr, &pos, &value)) == Status_OK) {
+                                if(!stack[stack_idx].skip && (status = eval_loop_condition(&stack[stack_idx], &value)) == Status_OK) {
                                     if(!(stack[stack_idx].skip = value == 0))
-                                        vfs_seek(stack[stack_idx].file, stack[stack_idx].file_pos);
+                                        loop_seek(&stack[stack_idx]);
                                 }
                                 if(stack[stack_idx].skip) {
                                     if(stack[stack_idx].expr) {
-                                        free(stack[stack_idx].expr);
+                                        mem_free(stack[stack_idx].expr);
                                         stack[stack_idx].expr = NULL;
                                     }
                                     stack_pull();
@@ -416,8 +1082,36 @@ status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, boo
                 status = (status_code_t)value;
             break;
 
+        case NGCFlowCtrl_Sub:
+            if(!skipping) {
+                if((status = stack_push(o_label, operation)) == Status_OK) {
+                    if((status = sub_define_start(o_label)) == Status_OK)
+                        stack[stack_idx].skip = true;
+                    else
+                        stack_pull();
+                }
+            }
+            break;
+
+        case NGCFlowCtrl_EndSub:
+            {
+                ngc_stack_entry_t *call = current_call();
+                if(call && o_label == call->o_label)
+                    status = sub_return(line, pos);
+                else if(!skipping)
+                    status = Status_FlowControlSyntaxError;
+            }
+            break;
+
+        case NGCFlowCtrl_Call:
+            if(!skipping)
+                status = sub_call(o_label, line, pos);
+            break;
+
         case NGCFlowCtrl_Return:
-            if(!skipping && grbl.on_macro_return) {
+            if(!skipping && current_call())
+                status = sub_return(line, pos);
+            else if(!skipping && grbl.on_macro_return) {
                 vfs_file_t *file = stack[stack_idx].file;
                 while(stack_idx >= 0 && file == stack[stack_idx].file)
                     stack_pull();
@@ -436,7 +1130,7 @@ status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, boo
     }
 
     if(status != Status_OK) {
-        ngc_flowctrl_init();
+        stack_clear();
         *skip = false;
     } else
         *skip = stack_idx >= 0 && stack[stack_idx].skip;
@@ -25,6 +25,8 @@
 #define _NGC_FLOWCTRL_H_
 
 void ngc_flowctrl_init (void);
+bool ngc_flowctrl_line_received (char *line, char eol);
 status_code_t ngc_flowctrl (uint32_t o_label, char *line, uint_fast8_t *pos, bool *skip);
+bool ngc_flowctrl_active (void);
 
 #endif
@@ -33,8 +33,15 @@
 #include "system.h"
 #include "settings.h"
 #include "ngc_params.h"
+#include "mem_stats.h"
 
-#define MAX_PARAM_LENGTH 20
+
+#ifndef NGC_PARAM_HASH_SIZE
+#define NGC_PARAM_HASH_SIZE 64  // Number of hash buckets for read/write parameters, must be a power of 2
+#endif
+#ifndef NGC_PARAM_POOL_BLOCK
+#define NGC_PARAM_POOL_BLOCK 16 // Number of parameters allocated per memory block
+#endif
 
 typedef float (*ngc_param_get_ptr)(ngc_param_id_t id);
 typedef float (*ngc_named_param_get_ptr)(void);
@@ -63,8 +70,84 @@ typedef struct ngc_named_rw_param {
     struct ngc_named_rw_param *next;
 } ngc_named_rw_param_t;
 
-ngc_rw_param_t *rw_params = NULL;
-ngc_named_rw_param_t *rw_global_params = NULL;
+typedef struct ngc_rw_param_block {
+    struct ngc_rw_param_block *next;
+    ngc_rw_param_t param[NGC_PARAM_POOL_BLOCK];
+} ngc_rw_param_block_t;
+
+typedef struct ngc_named_rw_param_block {
+    struct ngc_named_rw_param_block *next;
+    ngc_named_rw_param_t param[NGC_PARAM_POOL_BLOCK];
+} ngc_named_rw_param_block_t;
+
+// Read/write parameters are allocated from pooled memory blocks and indexed by hash buckets,
+// the next member of the parameter structs is used for chaining parameters in the same bucket.
+static ngc_rw_param_t *rw_params[NGC_PARAM_HASH_SIZE] = {0};
+static ngc_named_rw_param_t *rw_global_params[NGC_PARAM_HASH_SIZE] = {0};
+static ngc_rw_param_block_t *rw_param_blocks = NULL;
+static ngc_named_rw_param_block_t *rw_named_param_blocks = NULL;
+static ngc_param_stats_t stats = {0};
+
+static inline uint_fast8_t param_hash (ngc_param_id_t id)
+{
+    return id & (NGC_PARAM_HASH_SIZE - 1);
+}
+
+static inline uint_fast8_t named_param_hash (const char *name)
+{
+    uint32_t hash = 5381;
+
+    while(*name)
+        hash = ((hash << 5) + hash) ^ (uint8_t)*name++;
+
+    return hash & (NGC_PARAM_HASH_SIZE - 1);
+}
+
+static ngc_rw_param_t *rw_param_alloc (void)
+{
+    ngc_rw_param_block_t *block;
+    uint_fast8_t idx = stats.params % NGC_PARAM_POOL_BLOCK;
+
+    if(idx == 0) {
+        if((block = mem_alloc(MemTag_NGC, sizeof(ngc_rw_param_block_t))) == NULL)
+            return NULL;
+        block->next = rw_param_blocks;
+        rw_param_blocks = block;
+        stats.memory_used += sizeof(ngc_rw_param_block_t);
+    }
+
+    stats.params++;
+
+    return &rw_param_blocks->param[idx];
+}
+
+static ngc_named_rw_param_t *rw_named_param_alloc (void)
+{
+    ngc_named_rw_param_block_t *block;
+    uint_fast8_t idx = stats.named_params % NGC_PARAM_POOL_BLOCK;
+
+    if(idx == 0) {
+        if((block = mem_alloc(MemTag_NGC, sizeof(ngc_named_rw_param_block_t))) == NULL)
+            return NULL;
+        block->next = rw_named_param_blocks;
+        rw_named_param_blocks = block;
+        stats.memory_used += sizeof(ngc_named_rw_param_block_t);
+    }
+
+    stats.named_params++;
+
+    return &rw_named_param_blocks->param[idx];
+}
+
+static ngc_named_rw_param_t *rw_named_param_find (const char *name)
+{
+    ngc_named_rw_param_t *rw_param = rw_global_params[named_param_hash(name)];
+
+    while(rw_param && strcmp(rw_param->name, name))
+        rw_param = rw_param->next;
+
+    return rw_param;
+}
 
 static float _relative_pos (uint_fast8_t axis)
 {
@@ -239,7 +322,7 @@ bool ngc_param_get (ngc_param_id_t id, float *value)
     *value = 0.0f;
 
     if(found) {
-        ngc_rw_param_t *rw_param = rw_params;
+        ngc_rw_param_t *rw_param = rw_params[param_hash(id)];
         while(rw_param) {
             if(rw_param->id == id) {
                 *value = rw_param->value;
@@ -272,24 +355,16 @@ bool ngc_param_set (ngc_param_id_t id, float value)
 
     if(ok) {
 
-        ngc_rw_param_t *rw_param = rw_params, *rw_param_last = rw_params;
+        uint_fast8_t bucket = param_hash(id);
+        ngc_rw_param_t *rw_param = rw_params[bucket];
 
-        while(rw_param) {
-            if(rw_param->id == id) {
-                break;
-            } else {
-                rw_param_last = rw_param;
-                rw_param = rw_param->next;
-            }
-        }
+        while(rw_param && rw_param->id != id)
+            rw_param = rw_param->next;
 
-        if(rw_param == NULL && value != 0.0f && (rw_param = malloc(sizeof(ngc_rw_param_t)))) {
+        if(rw_param == NULL && value != 0.0f && (rw_param = rw_param_alloc())) {
             rw_param->id = id;
-            rw_param->next = NULL;
-            if(rw_params == NULL)
-                rw_params = rw_param;
-            else
-                rw_param_last->next = rw_param;
+            rw_param->next = rw_params[bucket];
+            rw_params[bucket] = rw_param;
         }
 
         if(rw_param)
@@ -478,7 +553,7 @@ float ngc_named_param_get_by_id (ncg_name_param_id_t id)
             break;
 
         case NGCParam_adaptive_feed:
-            value = 0.0f;
+            value = gc_state.modal.override_ctrl.adaptive_feed ? 1.0f : 0.0f;
             break;
 
         case NGCParam_feed_hold:
@@ -555,18 +630,29 @@ bool ngc_named_param_get (char *name, float *value)
     } while(idx && !found);
 
     if(!found) {
-        ngc_named_rw_param_t *rw_param = rw_global_params;
-        while(rw_param && !found) {
-            if((found = !strcmp(rw_param->name, name)))
-                *value = rw_param->value;
-            else
-                rw_param = rw_param->next;
-        }
+        ngc_named_rw_param_t *rw_param = rw_named_param_find(name);
+        if((found = rw_param != NULL))
+            *value = rw_param->value;
     }
 
     return found;
 }
 
+// Get id of predefined (read only) named parameter, name must be in lowercase.
+bool ngc_named_param_get_ro_id (char *name, ncg_name_param_id_t *id)
+{
+    bool found = false;
+    uint_fast8_t idx = sizeof(ngc_named_ro_param) / sizeof(ngc_named_ro_param_t);
+
+    if(*name == '_') do {
+        idx--;
+        if((found = !strcmp(name, ngc_named_ro_param[idx].name)))
+            *id = ngc_named_ro_param[idx].id;
+    } while(idx && !found);
+
+    return found;
+}
+
 bool ngc_named_param_exists (char *name)
 {
     char c, *s1 = name, *s2 = name;
@@ -590,16 +676,8 @@ bool ngc_named_param_exists (char *name)
     } while(idx && !ok);
 
     // If not predefined attempt to find it.
-    if(!ok && rw_global_params && strlen(name) < MAX_PARAM_LENGTH) {
-
-        ngc_named_rw_param_t *rw_param = rw_global_params;
-
-        while(rw_param) {
-            if((ok = !strcmp(rw_param->name, name)))
-                break;
-            rw_param = rw_param->next;
-         }
-     }
+    if(!ok && stats.named_params && strlen(name) < MAX_PARAM_LENGTH)
+        ok = rw_named_param_find(name) != NULL;
 
     return ok;
 }
@@ -629,24 +707,13 @@ bool ngc_named_param_set (char *name, float value)
     // If not predefined attempt to set it.
     if(!ok && (ok = strlen(name) < MAX_PARAM_LENGTH)) {
 
-        ngc_named_rw_param_t *rw_param = rw_global_params, *rw_param_last = rw_global_params;
+        ngc_named_rw_param_t *rw_param = rw_named_param_find(name);
 
-         while(rw_param) {
-             if(!strcmp(rw_param->name, name)) {
-                 break;
-             } else {
-                 rw_param_last = rw_param;
-                 rw_param = rw_param->next;
-             }
-         }
-
-         if(rw_param == NULL && (rw_param = malloc(sizeof(ngc_named_rw_param_t)))) {
+         if(rw_param == NULL && (rw_param = rw_named_param_alloc())) {
+             uint_fast8_t bucket = named_param_hash(name);
              strcpy(rw_param->name, name);
-             rw_param->next = NULL;
-             if(rw_global_params == NULL)
-                 rw_global_params = rw_param;
-             else
-                 rw_param_last->next = rw_param;
+             rw_param->next = rw_global_params[bucket];
+             rw_global_params[bucket] = rw_param;
          }
 
          if((ok = rw_param != NULL))
@@ -655,3 +722,28 @@ bool ngc_named_param_set (char *name, float value)
 
     return ok;
 }
+
+// Release all read/write parameters, called on program end.
+void ngc_params_free (void)
+{
+    while(rw_param_blocks) {
+        ngc_rw_param_block_t *next = rw_param_blocks->next;
+        mem_free(rw_param_blocks);
+        rw_param_blocks = next;
+    }
+
+    while(rw_named_param_blocks) {
+        ngc_named_rw_param_block_t *next = rw_named_param_blocks->next;
+        mem_free(rw_named_param_blocks);
+        rw_named_param_blocks = next;
+    }
+
+    memset(rw_params, 0, sizeof(rw_params));
+    memset(rw_global_params, 0, sizeof(rw_global_params));
+    memset(&stats, 0, sizeof(ngc_param_stats_t));
+}
+
+ngc_param_stats_t *ngc_params_get_stats (void)
+{
+    return &stats;
+}
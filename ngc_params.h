@@ -28,6 +28,8 @@
 #ifndef _NGC_PARAMS_H_
 #define _NGC_PARAMS_H_
 
+#define MAX_PARAM_LENGTH 20
+
 typedef uint16_t ngc_param_id_t;
 
 typedef struct {
@@ -35,6 +37,12 @@ typedef struct {
     float value;
 } ngc_param_t;
 
+typedef struct {
+    uint32_t params;        //!< Number of numbered read/write parameters allocated.
+    uint32_t named_params;  //!< Number of named read/write parameters allocated.
+    uint32_t memory_used;   //!< Memory allocated for parameter storage in bytes.
+} ngc_param_stats_t;
+
 typedef enum {
     NGCParam_vmajor,
     NGCParam_vminor,
@@ -92,5 +100,8 @@ bool ngc_named_param_get (char *name, float *value);
 float ngc_named_param_get_by_id (ncg_name_param_id_t id);
 bool ngc_named_param_set (char *name, float value);
 bool ngc_named_param_exists (char *name);
+bool ngc_named_param_get_ro_id (char *name, ncg_name_param_id_t *id);
+void ngc_params_free (void);
+ngc_param_stats_t *ngc_params_get_stats (void);
 
 #endif
@@ -92,40 +92,92 @@ char const *const axis_letter[N_AXIS] = {
 #endif
 };
 
-// Converts an uint32 variable to string.
-char *uitoa (uint32_t n)
+// Two digit lookup table, halves the number of divisions needed.
+static const char digit_pairs[200] = {
+    '0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+    '1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+    '2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+    '3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+    '4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+    '5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+    '6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+    '7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+    '8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+    '9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9'
+};
+
+// Writes the digits of n to the buffer ending at end, if width is > 0 exactly width digits are written, zero padded.
+// Returns pointer to the first digit written.
+static inline char *put_digits (char *end, uint32_t n, uint_fast8_t width)
 {
-    char *bptr = buf + sizeof(buf);
+    uint32_t q;
+    const char *pair;
+
+    if(width) {
+        for(; width >= 2; width -= 2) {
+            q = n / 100;    // Division by a constant, compiled to a multiply by the reciprocal.
+            pair = &digit_pairs[(n - q * 100) << 1];
+            *--end = pair[1];
+            *--end = pair[0];
+            n = q;
+        }
+        if(width)
+            *--end = '0' + n % 10;
+    } else {
+        for(; n >= 100; n = q) {
+            q = n / 100;
+            pair = &digit_pairs[(n - q * 100) << 1];
+            *--end = pair[1];
+            *--end = pair[0];
+        }
+        if(n >= 10) {
+            pair = &digit_pairs[n << 1];
+            *--end = pair[1];
+            *--end = pair[0];
+        } else
+            *--end = '0' + n;
+    }
 
-    *--bptr = '\0';
+    return end;
+}
 
-    if (n == 0)
-        *--bptr = '0';
-    else while (n) {
-        *--bptr = '0' + (n % 10);
-        n /= 10;
-    }
+// Converts an uint32 variable to string in the buffer pointed to by s, returns pointer to the terminating null.
+char *uitoa_r (uint32_t n, char *s)
+{
+    char digits[10], *end = digits + sizeof(digits), *bptr = put_digits(end, n, 0);
+
+    while(bptr < end)
+        *s++ = *bptr++;
+    *s = '\0';
 
-    return bptr;
+    return s;
 }
 
-// Convert float to string by immediately converting to integers.
-// Number of decimal places, which are tracked by a counter, must be set by the user.
-// The integers is then efficiently converted to a string.
-char *ftoa (float n, uint8_t decimal_places)
+// Converts an uint32 variable to string.
+char *uitoa (uint32_t n)
 {
-    bool isNegative;
-    char *bptr = buf + sizeof(buf);
+    uitoa_r(n, buf);
 
-    *--bptr = '\0';
+    return buf;
+}
 
-    if ((isNegative = n < 0.0f))
+// Convert float to string by immediately converting to integers, in the buffer pointed to by s.
+// Number of decimal places, which are tracked by a counter, must be set by the user.
+// The integers are then efficiently converted to a string. Returns pointer to the terminating null.
+char *ftoa_r (float n, uint8_t decimal_places, char *s)
+{
+    if (n < 0.0f) {
         n = -n;
+        *s++ = '-';
+    }
 
     n += froundvalues[decimal_places];
 
     uint32_t a = (uint32_t)n;
 
+    s = uitoa_r(a, s);
+    *s++ = '.'; // Always add decimal point (TODO: is this really needed?)
+
     if (decimal_places) {
 
         n -= (float)a;
@@ -139,31 +191,21 @@ char *ftoa (float n, uint8_t decimal_places)
         if (decimals)
             n *= 10.0f;
 
-        uint32_t b = (uint32_t)n;
-
-        while(decimal_places--) {
-            if(b) {
-                *--bptr = (b % 10) + '0'; // Get digit
-                b /= 10;
-            } else
-                *--bptr = '0';
-        }
+        s += decimal_places;
+        put_digits(s, (uint32_t)n, decimal_places);
     }
 
-    *--bptr = '.'; // Always add decimal point (TODO: is this really needed?)
-
-    if(a == 0)
-        *--bptr = '0';
+    *s = '\0';
 
-    else while(a) {
-        *--bptr = (a % 10) + '0'; // Get digit
-        a /= 10;
-    }
+    return s;
+}
 
-    if(isNegative)
-        *--bptr = '-';
+// Converts a float variable to string with the specified number of decimal places.
+char *ftoa (float n, uint8_t decimal_places)
+{
+    ftoa_r(n, decimal_places, buf);
 
-    return bptr;
+    return buf;
 }
 
 // Extracts an unsigned integer value from a string.
@@ -227,38 +269,54 @@ status_code_t read_uint (char *line, uint_fast8_t *char_counter, uint32_t *uint_
 // NOTE: Thanks to Radu-Eosif Mihailescu for identifying the issues with using strtod().
 bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
 {
-    char *ptr = line + *char_counter;
+    char *ptr = line + *char_counter, *start;
     int_fast8_t exp = 0;
     uint_fast8_t ndigit = 0, c;
     uint32_t intval = 0;
-    bool isnegative, isdecimal = false, ok = false;
+    bool isnegative, ok;
+
+    // Capture initial sign character. No spaces assumed in line.
+    if((isnegative = (*ptr == '-')) || *ptr == '+')
+        ptr++;
+
+    start = ptr;
+
+    // Skip leading zeros, they are not significant.
+    while(*ptr == '0')
+        ptr++;
+
+    // Extract integer part into fast integer, drop overflow digits while tracking them in the exponent.
+    while((c = (uint_fast8_t)(*ptr - '0')) <= 9) {
+        if(ndigit < MAX_INT_DIGITS) {
+            intval = (((intval << 2) + intval) << 1) + c; // intval * 10 + c
+            ndigit++;
+        } else
+            exp++;
+        ptr++;
+    }
 
-    // Grab first character and increment pointer. No spaces assumed in line.
-    c = *ptr++;
+    ok = ptr != start;
 
-    // Capture initial sign character
-    if ((isnegative = (c == '-')) || c == '+')
-        c = *ptr++;
+    // Extract fractional part, leading zeros are only tracked in the exponent.
+    if(*ptr == '.') {
 
-    // Extract number into fast integer. Track decimal in terms of exponent value.
-    while(c) {
-        c -= '0';
-        if (c <= 9) {
-            ok = true;
-            if(c != 0 || intval)
-                ndigit++;
-            if (ndigit <= MAX_INT_DIGITS) {
-                if (isdecimal)
-                    exp--;
+        start = ++ptr;
+
+        if(intval == 0) while(*ptr == '0') {
+            exp--;
+            ptr++;
+        }
+
+        while((c = (uint_fast8_t)(*ptr - '0')) <= 9) {
+            if(ndigit < MAX_INT_DIGITS) {
                 intval = (((intval << 2) + intval) << 1) + c; // intval * 10 + c
-            } else if (!isdecimal)
-                exp++;  // Drop overflow digits
-        } else if (c == (uint_fast8_t)('.' - '0') && !isdecimal)
-            isdecimal = true;
-         else
-            break;
+                ndigit++;
+                exp--;
+            }
+            ptr++;
+        }
 
-        c = *ptr++;
+        ok |= ptr != start;
     }
 
     // Return if no digits have been read.
@@ -284,7 +342,7 @@ bool read_float (char *line, uint_fast8_t *char_counter, float *float_ptr)
 
     // Assign floating point value with correct sign.
     *float_ptr = isnegative ? - fval : fval;
-    *char_counter = ptr - line - 1; // Set char_counter to next statement
+    *char_counter = ptr - line; // Set char_counter to next statement
 
     return true;
 }
@@ -212,6 +212,11 @@ char *uitoa (uint32_t n);
 // Converts a float variable to string with the specified number of decimal places.
 char *ftoa (float n, uint8_t decimal_places);
 
+// As uitoa() and ftoa() but the string is written to the buffer pointed to by s, returns pointer to the terminating null.
+// The buffer must be large enough for the result, STRLEN_COORDVALUE + 1 bytes for coordinate values.
+char *uitoa_r (uint32_t n, char *s);
+char *ftoa_r (float n, uint8_t decimal_places, char *s);
+
 // Returns true if float value is a whole number (integer)
 bool isintf (float value);
 
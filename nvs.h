@@ -42,6 +42,11 @@ Minimum 1024 bytes required.
 //! Number of bytes used for storing CRC values. Do not change this!
 #define NVS_CRC_BYTES 1
 
+#ifndef NVS_JOURNAL_ALIGN
+//! Flash programming granularity in bytes for journaled storage, must be a power of 2 and at least 8.
+#define NVS_JOURNAL_ALIGN 8
+#endif
+
 /*! @name Define persistent storage memory address location values for core settings and parameters.
 The upper half is reserved for parameters and the startup script.
 The lower half contains the global settings and space for future developments.
@@ -124,6 +129,39 @@ typedef bool (*memcpy_from_flash_ptr)(uint8_t *dest);
 */
 typedef bool (*memcpy_to_flash_ptr)(uint8_t *source);
 
+/*! \brief Pointer to function for erasing a sector of journaled flash based NVS storage.
+\param sector sector number, 0 to number of sectors - 1.
+\returns true if successful, false otherwise.
+*/
+typedef bool (*flash_erase_sector_ptr)(uint_fast8_t sector);
+
+/*! \brief Pointer to function for programming data to an erased part of a sector of journaled flash based NVS storage.
+\param sector sector number, 0 to number of sectors - 1.
+\param offset offset into the sector, aligned to \ref NVS_JOURNAL_ALIGN.
+\param source pointer to source data.
+\param size number of bytes to write, a multiple of \ref NVS_JOURNAL_ALIGN.
+\returns true if successful, false otherwise.
+*/
+typedef bool (*flash_program_ptr)(uint_fast8_t sector, uint32_t offset, const uint8_t *source, uint32_t size);
+
+/*! \brief Pointer to function for reading data from a sector of journaled flash based NVS storage.
+\param dest pointer to destination of data.
+\param sector sector number, 0 to number of sectors - 1.
+\param offset offset into the sector.
+\param size number of bytes to read.
+\returns true if successful, false otherwise.
+*/
+typedef bool (*flash_read_ptr)(uint8_t *dest, uint_fast8_t sector, uint32_t offset, uint32_t size);
+
+//! \brief Optional handlers for wear-levelled journaled flash based storage, see nvs_journal.c.
+typedef struct {
+    uint8_t n_sectors;                          //!< Number of flash sectors reserved for the journal, minimum 2.
+    uint32_t sector_size;                       //!< Size of each sector in bytes.
+    flash_erase_sector_ptr erase_sector;        //!< Handler for erasing a sector.
+    flash_program_ptr program;                  //!< Handler for programming data to a sector.
+    flash_read_ptr read;                        //!< Handler for reading data from a sector.
+} nvs_journal_io_t;
+
 //! \brief Handler functions and variables for NVS storage of settings and data.
 typedef struct {
     nvs_type type;                              //!< Type of NVS storage.
@@ -141,6 +179,7 @@ typedef struct {
 //@{
     memcpy_from_flash_ptr memcpy_from_flash;    //!< Handler for reading a block of data from flash.
     memcpy_to_flash_ptr memcpy_to_flash;        //!< Handler for writing a block of data to flash.
+    nvs_journal_io_t journal;                   //!< Optional handlers for journaled flash storage, used instead of memcpy_to_flash() when provided.
 //@}
 } nvs_io_t;
 
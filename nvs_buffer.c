@@ -31,14 +31,34 @@
 
 #include "hal.h"
 #include "nvs_buffer.h"
+#include "mem_stats.h"
 #include "protocol.h"
 #include "settings.h"
 #include "gcode.h"
 #include "nvs.h"
+#if NVS_JOURNAL_ENABLE
+#include "nvs_journal.h"
+#endif
 
 static uint8_t *nvsbuffer = NULL;
 static nvs_io_t physical_nvs;
 static bool dirty;
+static volatile bool sync_suspended = false;
+#if NVS_JOURNAL_ENABLE
+static bool journaled = false;  // Flash storage is journaled.
+#else
+#define journaled false
+#endif
+
+#ifndef NVS_SYNC_DELAY
+#define NVS_SYNC_DELAY 500          // Time in ms without changes before they are written when idle.
+#endif
+#ifndef NVS_SYNC_TIMEOUT
+#define NVS_SYNC_TIMEOUT 30000      // Time in ms after which changes are written in any state without motion.
+#endif
+#ifndef NVS_SYNC_CHUNK_SIZE
+#define NVS_SYNC_CHUNK_SIZE 64      // Maximum number of bytes written per realtime cycle.
+#endif
 
 settings_dirty_t settings_dirty;
 
@@ -123,6 +143,14 @@ static const emap_t target[] = {
     {0, 0, 0} // list termination - do not remove
 };
 
+#define N_REGIONS (sizeof(target) / sizeof(emap_t) + 1) // Version byte, target table entries and driver area.
+
+static struct {
+    uint_fast8_t region;    // Region being written.
+    uint32_t offset;        // Number of bytes of the region written.
+    uint32_t changed;       // Time of last change to the RAM copy (ms).
+} sync = {0};
+
 inline static uint8_t ram_get_byte (uint32_t addr)
 {
     return nvsbuffer[addr];
@@ -160,6 +188,9 @@ static nvs_transfer_result_t memcpy_to_ram (uint32_t destination, uint8_t *sourc
         uint8_t idx = 0;
 
         settings_dirty.is_dirty = true;
+        sync.offset = 0; // Restart writing of a partially written region.
+        if(hal.get_elapsed_ticks)
+            sync.changed = hal.get_elapsed_ticks();
 
         if(hal.nvs.driver_area.address && destination >= hal.nvs.driver_area.address)
             settings_dirty.driver_settings = true;
@@ -217,7 +248,7 @@ bool nvs_buffer_alloc (void)
 {
     assert(NVS_SIZE >= GRBL_NVS_SIZE);
 
-    if((nvsbuffer = malloc(NVS_SIZE)))
+    if((nvsbuffer = mem_alloc(MemTag_NVS, NVS_SIZE)))
         memset(nvsbuffer, 0xFF, NVS_SIZE);
 
     return nvsbuffer != NULL;
@@ -226,8 +257,9 @@ bool nvs_buffer_alloc (void)
 void nvs_buffer_free (void)
 {
     if(nvsbuffer) {
+        sync_suspended = false;
         nvs_buffer_sync_physical();
-        free(nvsbuffer);
+        mem_free(nvsbuffer);
     }
 }
 //
@@ -242,9 +274,13 @@ bool nvs_buffer_init (void)
         memcpy(&physical_nvs, &hal.nvs, sizeof(nvs_io_t)); // save pointers to physical storage handler functions
 
         // Copy physical storage content to RAM when available
-        if(physical_nvs.type == NVS_Flash)
+        if(physical_nvs.type == NVS_Flash) {
+#if NVS_JOURNAL_ENABLE
+            // If no journal is found import the image written by memcpy_to_flash(), the journal is created on the first write.
+            if(!((journaled = nvs_journal_init(&physical_nvs.journal, nvsbuffer, NVS_SIZE)) && nvs_journal_load()) && physical_nvs.memcpy_from_flash)
+#endif
             physical_nvs.memcpy_from_flash(nvsbuffer);
-        else if(physical_nvs.type != NVS_None)
+        } else if(physical_nvs.type != NVS_None)
             physical_nvs.memcpy_from_nvs(nvsbuffer, 0, GRBL_NVS_SIZE + hal.nvs.driver_area.size, false);
 
         // Switch hal to use RAM version of non-volatile storage data
@@ -260,6 +296,11 @@ bool nvs_buffer_init (void)
         // and write out to physical storage when available.
         if(physical_nvs.type == NVS_None || ram_get_byte(0) != SETTINGS_VERSION) {
             settings_restore(settings_all);
+#if NVS_JOURNAL_ENABLE
+            if(journaled)
+                nvs_journal_compact();
+            else
+#endif
             if(physical_nvs.type == NVS_Flash)
                 physical_nvs.memcpy_to_flash(nvsbuffer);
             else if(physical_nvs.memcpy_to_nvs)
@@ -305,80 +346,188 @@ nvs_address_t nvs_alloc (size_t size)
     return addr;
 }
 
-// Write RAM changes to physical storage
-void nvs_buffer_sync_physical (void)
+// Write a region of the RAM copy to physical storage.
+static bool sync_region (uint32_t addr, uint32_t size)
 {
-    if(!settings_dirty.is_dirty)
-        return;
+#if NVS_JOURNAL_ENABLE
+    if(journaled)
+        return nvs_journal_write(addr, size);
+#endif
 
-    if(physical_nvs.memcpy_to_nvs) {
+    return physical_nvs.memcpy_to_nvs(addr, (uint8_t *)(nvsbuffer + addr), size, false) == NVS_TransferResult_OK;
+}
 
-        if(settings_dirty.version)
-            settings_dirty.version = physical_nvs.memcpy_to_nvs(0, nvsbuffer, 1, false) != NVS_TransferResult_OK;
+// Gets address and size of a region of the RAM copy and returns its dirty flag, the flag is cleared if requested.
+// Region 0 is the version byte, regions 1 to N_REGIONS - 2 are the target table entries and the last is the driver area.
+static bool get_region (uint_fast8_t idx, uint32_t *addr, uint32_t *size, bool clear)
+{
+    bool is_dirty;
+
+    if(idx == 0) {
+        *addr = 0;
+        *size = 1;
+        is_dirty = settings_dirty.version;
+        if(clear)
+            settings_dirty.version = false;
+    } else if(target[--idx].addr) {
+        *addr = target[idx].addr;
+        switch(target[idx].type) {
+
+            case NVS_GROUP_GLOBAL:
+                *size = sizeof(settings_t);
+                is_dirty = settings_dirty.global_settings;
+                if(clear)
+                    settings_dirty.global_settings = false;
+                break;
+#if N_TOOLS
+            case NVS_GROUP_TOOLS:
+                *size = sizeof(tool_data_t);
+                is_dirty = bit_istrue(settings_dirty.tool_data, bit(target[idx].offset));
+                if(clear)
+                    bit_false(settings_dirty.tool_data, bit(target[idx].offset));
+                break;
+#endif
+            case NVS_GROUP_PARAMETERS:
+                *size = sizeof(coord_data_t);
+                is_dirty = bit_istrue(settings_dirty.coord_data, bit(target[idx].offset));
+                if(clear)
+                    bit_false(settings_dirty.coord_data, bit(target[idx].offset));
+                break;
+
+            case NVS_GROUP_STARTUP:
+                *size = sizeof(stored_line_t);
+                is_dirty = bit_istrue(settings_dirty.startup_lines, bit(target[idx].offset));
+                if(clear)
+                    bit_false(settings_dirty.startup_lines, bit(target[idx].offset));
+                break;
+
+            default: // NVS_GROUP_BUILD
+                *size = sizeof(stored_line_t);
+                is_dirty = settings_dirty.build_info;
+                if(clear)
+                    settings_dirty.build_info = false;
+                break;
+        }
+        *size += NVS_CRC_BYTES;
+    } else {
+        *addr = hal.nvs.driver_area.address;
+        *size = hal.nvs.driver_area.size;
+        is_dirty = settings_dirty.driver_settings && *size > 0;
+        if(clear || *size == 0)
+            settings_dirty.driver_settings = false;
+    }
 
-        if(settings_dirty.global_settings)
-            settings_dirty.global_settings = physical_nvs.memcpy_to_nvs(NVS_ADDR_GLOBAL, (uint8_t *)(nvsbuffer + NVS_ADDR_GLOBAL), sizeof(settings_t) + NVS_CRC_BYTES, false) != NVS_TransferResult_OK;
+    return is_dirty;
+}
+
+// Writes the next chunk of the dirty regions, a region that fails to write is retried on the next pass.
+// Returns false when a pass over all regions is completed.
+static bool sync_step (uint32_t chunk_size)
+{
+    uint32_t addr, size;
 
-        if(settings_dirty.build_info)
-            settings_dirty.build_info = physical_nvs.memcpy_to_nvs(NVS_ADDR_BUILD_INFO, (uint8_t *)(nvsbuffer + NVS_ADDR_BUILD_INFO), sizeof(stored_line_t) + NVS_CRC_BYTES, false) != NVS_TransferResult_OK;
+    while(sync.region < N_REGIONS) {
 
-        uint_fast8_t idx = N_STARTUP_LINE, offset;
-        if(settings_dirty.startup_lines) do {
-            idx--;
-            if(bit_istrue(settings_dirty.startup_lines, bit(idx))) {
-                bit_false(settings_dirty.startup_lines, bit(idx));
-                offset = NVS_ADDR_STARTUP_BLOCK + idx * (sizeof(stored_line_t) + NVS_CRC_BYTES);
-                if(physical_nvs.memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(stored_line_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
-                    bit_false(settings_dirty.startup_lines, bit(idx));
-            }
-        } while(idx);
-
-        idx = N_CoordinateSystems;
-        if(settings_dirty.coord_data) do {
-            if(bit_istrue(settings_dirty.coord_data, bit(idx))) {
-                offset = NVS_ADDR_PARAMETERS + idx * (sizeof(coord_data_t) + NVS_CRC_BYTES);
-                if(physical_nvs.memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(coord_data_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
-                    bit_false(settings_dirty.coord_data, bit(idx));
+        if(get_region(sync.region, &addr, &size, false)) {
+
+            uint32_t length = min(size - sync.offset, chunk_size);
+
+            if(sync_region(addr + sync.offset, length)) {
+                if((sync.offset += length) >= size) {
+                    get_region(sync.region++, &addr, &size, true);
+                    sync.offset = 0;
+                }
+            } else {
+                sync.region++;
+                sync.offset = 0;
             }
-        } while(idx--);
 
-        if(settings_dirty.driver_settings) {
-            if(hal.nvs.driver_area.size > 0)
-                settings_dirty.driver_settings = physical_nvs.memcpy_to_nvs(hal.nvs.driver_area.address, (uint8_t *)(nvsbuffer + hal.nvs.driver_area.address), hal.nvs.driver_area.size, false) != NVS_TransferResult_OK;
-            else
-                settings_dirty.driver_settings = false;
+            return true;
         }
 
+        sync.region++;
+        sync.offset = 0;
+    }
+
+    sync.region = 0;
+
+    settings_dirty.is_dirty = settings_dirty.coord_data ||
+                               settings_dirty.global_settings ||
+                                settings_dirty.driver_settings ||
+                                 settings_dirty.startup_lines ||
 #if N_TOOLS
-        idx = N_TOOLS;
-        if(settings_dirty.tool_data) do {
-            idx--;
-            if(bit_istrue(settings_dirty.tool_data, bit(idx))) {
-                offset = NVS_ADDR_TOOL_TABLE + idx * (sizeof(tool_data_t) + NVS_CRC_BYTES);
-                if(physical_nvs.memcpy_to_nvs(offset, (uint8_t *)(nvsbuffer + offset), sizeof(tool_data_t) + NVS_CRC_BYTES, false) == NVS_TransferResult_OK)
-                    bit_false(settings_dirty.tool_data, bit(idx));
-            }
-        } while(idx);
-#endif
-        settings_dirty.is_dirty = settings_dirty.coord_data ||
-                                   settings_dirty.global_settings ||
-                                    settings_dirty.driver_settings ||
-                                     settings_dirty.startup_lines ||
-#if N_TOOLS
-                                      settings_dirty.tool_data ||
+                                  settings_dirty.tool_data ||
 #endif
-                                       settings_dirty.build_info;
-
-    } else if(physical_nvs.memcpy_to_flash) {
-        uint_fast8_t retries = 4;
-        do {
-            if(physical_nvs.memcpy_to_flash(nvsbuffer))
-                retries = 0;
-            else if(--retries == 0)
-                report_message("Settings write failed!", Message_Warning);
-        } while(retries);
-        memset(&settings_dirty, 0, sizeof(settings_dirty_t));
-    }
+                                   settings_dirty.version ||
+                                    settings_dirty.build_info;
+
+    return false;
+}
+
+static void sync_flash (void)
+{
+    uint_fast8_t retries = 4;
+
+    do {
+        if(physical_nvs.memcpy_to_flash(nvsbuffer))
+            retries = 0;
+        else if(--retries == 0)
+            report_message("Settings write failed!", Message_Warning);
+    } while(retries);
+
+    memset(&settings_dirty, 0, sizeof(settings_dirty_t));
+}
+
+// Write RAM changes to physical storage
+void nvs_buffer_sync_physical (void)
+{
+    if(!settings_dirty.is_dirty || sync_suspended)
+        return;
+
+    if(physical_nvs.memcpy_to_nvs || journaled) {
+        sync.region = sync.offset = 0; // Restart from the first region and write all in one pass.
+        while(sync_step(UINT32_MAX));
+    } else if(physical_nvs.memcpy_to_flash)
+        sync_flash();
+}
+
+/*! \brief Write RAM changes to physical storage when the machine state allows, called on each realtime cycle.
+
+Changes are coalesced until there has been no changes for \ref NVS_SYNC_DELAY ms, they are then written when idle
+or in alarm or E-stop state. Pending changes are written in other states after \ref NVS_SYNC_TIMEOUT ms, but never
+while motion is executing. Data is written in chunks of \ref NVS_SYNC_CHUNK_SIZE bytes, one chunk per call,
+journaled flash storage is written one region per call and flash storage without journaling in one go.
+\param state current state of the machine.
+*/
+void nvs_buffer_sync_poll (sys_state_t state)
+{
+    if(!settings_dirty.is_dirty || sync_suspended || (state & (STATE_CYCLE|STATE_HOLD|STATE_JOG|STATE_HOMING|STATE_SAFETY_DOOR)))
+        return;
+
+    uint32_t elapsed = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() - sync.changed : NVS_SYNC_TIMEOUT;
+
+    if(elapsed < NVS_SYNC_TIMEOUT &&
+        !(elapsed >= NVS_SYNC_DELAY && ((state == STATE_IDLE && !gc_state.file_run) || (state & (STATE_ALARM|STATE_ESTOP)))))
+        return;
+
+    if(physical_nvs.memcpy_to_nvs || journaled)
+        sync_step(journaled ? UINT32_MAX : NVS_SYNC_CHUNK_SIZE); // Journal records must hold whole regions.
+    else if(physical_nvs.memcpy_to_flash)
+        sync_flash();
+}
+
+// Suspend or resume writing RAM changes to physical storage, pending changes are written on resume.
+void nvs_buffer_sync_suspend (bool suspend)
+{
+    if(!(sync_suspended = suspend))
+        nvs_buffer_sync_physical();
+}
+
+// Resume writing RAM changes to physical storage, pending changes are left to nvs_buffer_sync_poll().
+// May be called from interrupt context.
+void nvs_buffer_sync_resume_deferred (void)
+{
+    sync_suspended = false;
 }
 
 nvs_io_t *nvs_buffer_get_physical (void)
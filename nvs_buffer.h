@@ -49,6 +49,9 @@ bool nvs_buffer_alloc (void);
 void nvs_buffer_free (void);
 nvs_address_t nvs_alloc (size_t size);
 void nvs_buffer_sync_physical (void);
+void nvs_buffer_sync_poll (sys_state_t state);
+void nvs_buffer_sync_suspend (bool suspend);
+void nvs_buffer_sync_resume_deferred (void);
 nvs_io_t *nvs_buffer_get_physical (void);
 void nvs_memmap (void);
 
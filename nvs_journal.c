@@ -0,0 +1,290 @@
+/*
+  nvs_journal.c - wear-levelled journaled flash storage of the NVS buffer
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Each sector starts with a header followed by a record holding the full NVS image, changed regions are
+// appended as records. The header is programmed after the image record so a sector with a valid header
+// always contains a complete image. On load the records of the sector with the highest sequence number
+// are replayed, stopping at the first erased or invalid record.
+//
+
+#include <string.h>
+#include <stddef.h>
+
+#include "hal.h"
+
+#if NVS_JOURNAL_ENABLE
+
+#include "nvs_journal.h"
+#include "nvs_buffer.h"
+#include "protocol.h"
+#include "state_machine.h"
+
+#ifndef NVS_JOURNAL_COMPACT_LEVEL
+#define NVS_JOURNAL_COMPACT_LEVEL 75    // Sector fill in percent above which the image is compacted when idle.
+#endif
+#ifndef NVS_JOURNAL_POLL_PERIOD
+#define NVS_JOURNAL_POLL_PERIOD 1000    // Time in ms between checks for background work.
+#endif
+
+#define JOURNAL_MAGIC 0x4A535647        // "GVSJ"
+#define JOURNAL_ALIGN(n) (((n) + NVS_JOURNAL_ALIGN - 1) & ~(NVS_JOURNAL_ALIGN - 1))
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // Incremented on each compaction, the valid sector with the highest sequence number is active.
+} sector_header_t;
+
+typedef struct {
+    uint16_t addr;          // Address of the data in the NVS image.
+    uint16_t size;          // Size of the data in bytes.
+    uint16_t check;         // Inverted size, guards against partially programmed headers.
+    uint16_t crc;           // CRC of the header fields above and the data.
+} record_header_t;
+
+#define SECTOR_HEADER_SIZE JOURNAL_ALIGN(sizeof(sector_header_t))
+#define RECORD_SIZE(size) (JOURNAL_ALIGN(sizeof(record_header_t)) + JOURNAL_ALIGN(size))
+
+static struct {
+    const nvs_journal_io_t *io;
+    uint8_t *image;
+    uint32_t size;
+    uint_fast8_t active;    // Active sector.
+    uint32_t seq;           // Sequence number of the active sector.
+    uint32_t head;          // Offset of the next record in the active sector, sector size if a compaction is required.
+    bool spare_erased;      // Next sector in rotation is erased.
+    bool hooked;
+} journal = {0};
+
+static uint16_t crc16 (uint16_t crc, const uint8_t *data, uint32_t size)
+{
+    uint_fast8_t bit;
+
+    while(size--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for(bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+// Programs data, the last partial word is padded with the erased value.
+static bool program (uint_fast8_t sector, uint32_t offset, const uint8_t *source, uint32_t size)
+{
+    uint8_t tail[NVS_JOURNAL_ALIGN];
+    uint32_t aligned = size & ~(NVS_JOURNAL_ALIGN - 1);
+
+    if(aligned && !journal.io->program(sector, offset, source, aligned))
+        return false;
+
+    if((size -= aligned)) {
+        memset(tail, 0xFF, sizeof(tail));
+        memcpy(tail, source + aligned, size);
+        return journal.io->program(sector, offset + aligned, tail, NVS_JOURNAL_ALIGN);
+    }
+
+    return true;
+}
+
+// Appends a region of the image as a record, the header is programmed first so an interrupted write fails the CRC check.
+static bool append (uint_fast8_t sector, uint32_t offset, uint32_t addr, uint32_t size)
+{
+    record_header_t record = {
+        .addr = (uint16_t)addr,
+        .size = (uint16_t)size,
+        .check = (uint16_t)~size
+    };
+
+    record.crc = crc16(crc16(0xFFFF, (uint8_t *)&record, offsetof(record_header_t, crc)), journal.image + addr, size);
+
+    return program(sector, offset, (uint8_t *)&record, sizeof(record_header_t)) &&
+            program(sector, offset + JOURNAL_ALIGN(sizeof(record_header_t)), journal.image + addr, size);
+}
+
+static bool record_is_valid (uint_fast8_t sector, uint32_t offset, record_header_t *record)
+{
+    uint8_t buf[32];
+    uint32_t size = record->size, n;
+    uint16_t crc = crc16(0xFFFF, (uint8_t *)record, offsetof(record_header_t, crc));
+
+    offset += JOURNAL_ALIGN(sizeof(record_header_t));
+
+    while(size) {
+        n = min(size, sizeof(buf));
+        if(!journal.io->read(buf, sector, offset, n))
+            return false;
+        crc = crc16(crc, buf, n);
+        offset += n;
+        size -= n;
+    }
+
+    return crc == record->crc;
+}
+
+// Erases the next sector and compacts nearly full sectors when idle.
+static void journal_poll (sys_state_t state)
+{
+    if(state != STATE_IDLE || journal.io == NULL)
+        return;
+
+    if(!journal.spare_erased)
+        journal.spare_erased = journal.io->erase_sector((journal.active + 1) % journal.io->n_sectors);
+    else if(journal.head > journal.io->sector_size / 100 * NVS_JOURNAL_COMPACT_LEVEL && !settings_dirty.is_dirty)
+        nvs_journal_compact();
+}
+
+/*! \brief Initialize journaled storage.
+\param io pointer to a \a nvs_journal_io_t structure with the flash handlers, must stay valid.
+\param image pointer to the NVS image in RAM.
+\param size size of the NVS image in bytes.
+\returns true if the handlers are available and the sectors are large enough for the image.
+*/
+bool nvs_journal_init (const nvs_journal_io_t *io, uint8_t *image, uint32_t size)
+{
+    journal.io = NULL;
+
+    if(io->n_sectors < 2 || io->erase_sector == NULL || io->program == NULL || io->read == NULL ||
+        size > 0xFFFF || SECTOR_HEADER_SIZE + RECORD_SIZE(size) > io->sector_size)
+        return false;
+
+    journal.io = io;
+    journal.image = image;
+    journal.size = size;
+
+    if(!journal.hooked)
+        journal.hooked = protocol_register_realtime_hook("nvs journal", journal_poll, NVS_JOURNAL_POLL_PERIOD, false);
+
+    return true;
+}
+
+/*! \brief Load the NVS image by replaying the records of the active sector.
+\returns false if no valid sector was found, the image is then not changed.
+*/
+bool nvs_journal_load (void)
+{
+    bool found = false;
+    uint_fast8_t sector;
+    uint32_t offset = SECTOR_HEADER_SIZE;
+    sector_header_t header;
+    record_header_t record;
+
+    if(journal.io == NULL)
+        return false;
+
+    for(sector = 0; sector < journal.io->n_sectors; sector++) {
+        if(journal.io->read((uint8_t *)&header, sector, 0, sizeof(sector_header_t)) && header.magic == JOURNAL_MAGIC &&
+            (!found || (int32_t)(header.seq - journal.seq) > 0)) {
+            found = true;
+            journal.active = sector;
+            journal.seq = header.seq;
+        }
+    }
+
+    journal.spare_erased = false;
+
+    if(!found) {
+        journal.active = journal.io->n_sectors - 1;
+        journal.seq = 0;
+        journal.head = journal.io->sector_size; // Create the journal on the first write.
+        return false;
+    }
+
+    journal.head = offset;
+
+    while(offset + RECORD_SIZE(0) <= journal.io->sector_size) {
+
+        if(!journal.io->read((uint8_t *)&record, journal.active, offset, sizeof(record_header_t))) {
+            journal.head = journal.io->sector_size;
+            break;
+        }
+
+        if(record.addr == 0xFFFF && record.size == 0xFFFF && record.check == 0xFFFF && record.crc == 0xFFFF)
+            break; // Erased, end of journal.
+
+        // Interrupted write, ignore the record and compact on the next write.
+        if(record.check != (uint16_t)~record.size || (uint32_t)record.addr + record.size > journal.size ||
+            offset + RECORD_SIZE(record.size) > journal.io->sector_size || !record_is_valid(journal.active, offset, &record) ||
+             !journal.io->read(journal.image + record.addr, journal.active, offset + JOURNAL_ALIGN(sizeof(record_header_t)), record.size)) {
+            journal.head = journal.io->sector_size;
+            break;
+        }
+
+        journal.head = offset += RECORD_SIZE(record.size);
+    }
+
+    return true;
+}
+
+/*! \brief Write the full image to the next sector in rotation, it then becomes the active sector.
+\returns true if successful.
+*/
+bool nvs_journal_compact (void)
+{
+    uint_fast8_t sector, attempts;
+    sector_header_t header = { .magic = JOURNAL_MAGIC };
+
+    if(journal.io == NULL)
+        return false;
+
+    sector = (journal.active + 1) % journal.io->n_sectors;
+    attempts = journal.io->n_sectors - 1;
+    header.seq = journal.seq + 1;
+
+    // Try each of the other sectors, the active sector is kept until the new one is complete.
+    do {
+        if((journal.spare_erased || journal.io->erase_sector(sector)) &&
+            append(sector, SECTOR_HEADER_SIZE, 0, journal.size) &&
+             program(sector, 0, (uint8_t *)&header, sizeof(sector_header_t))) {
+            journal.active = sector;
+            journal.seq = header.seq;
+            journal.head = SECTOR_HEADER_SIZE + RECORD_SIZE(journal.size);
+            journal.spare_erased = false;
+            return true;
+        }
+        journal.spare_erased = false;
+        sector = (sector + 1) % journal.io->n_sectors;
+    } while(--attempts);
+
+    return false;
+}
+
+/*! \brief Append a changed region of the image to the journal, the image is compacted if the active sector is full.
+\param addr address of the region in the image.
+\param size size of the region in bytes.
+\returns true if successful.
+*/
+bool nvs_journal_write (uint32_t addr, uint32_t size)
+{
+    if(journal.io == NULL || addr + size > journal.size)
+        return false;
+
+    if(journal.head + RECORD_SIZE(size) <= journal.io->sector_size) {
+        if(append(journal.active, journal.head, addr, size)) {
+            journal.head += RECORD_SIZE(size);
+            return true;
+        }
+        journal.head = journal.io->sector_size; // Programming failed, do not append to the sector again.
+    }
+
+    // Sector full, the compacted image includes the region.
+    return nvs_journal_compact();
+}
+
+#endif // NVS_JOURNAL_ENABLE
@@ -0,0 +1,34 @@
+/*
+  nvs_journal.h - wear-levelled journaled flash storage of the NVS buffer
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _NVS_JOURNAL_H_
+#define _NVS_JOURNAL_H_
+
+#include "hal.h"
+
+#if NVS_JOURNAL_ENABLE
+
+bool nvs_journal_init (const nvs_journal_io_t *io, uint8_t *image, uint32_t size);
+bool nvs_journal_load (void);
+bool nvs_journal_write (uint32_t addr, uint32_t size);
+bool nvs_journal_compact (void);
+
+#endif
+
+#endif
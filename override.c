@@ -24,84 +24,82 @@
 #include "grbl.h"
 #include "override.h"
 
+typedef struct {
+    uint8_t cmd;
+    uint8_t count;  // Number of times the command was received, repeated commands are coalesced.
+} override_cmd_t;
+
 typedef struct {
     volatile uint_fast8_t head;
     volatile uint_fast8_t tail;
-    uint8_t buf[OVERRIDE_BUFSIZE];
+    override_cmd_t buf[OVERRIDE_BUFSIZE];
 } override_queue_t;
 
 static override_queue_t feed = {0}, spindle = {0}, coolant = {0};
 
-ISR_CODE void ISR_FUNC(enqueue_feed_override)(uint8_t cmd)
+// Add command to queue. A command identical to the last queued one is coalesced with it by incrementing
+// its count, this avoids dropping commands when e.g. a jog-wheel pendant is spun fast.
+// NOTE: the last entry is only modified if it is not at the tail, the consumer may be reading that one.
+ISR_CODE static inline void ISR_FUNC(override_enqueue)(override_queue_t *queue, uint8_t cmd)
 {
-    uint_fast8_t bptr = (feed.head + 1) & (OVERRIDE_BUFSIZE - 1);    // Get next head pointer
+    uint_fast8_t last = (queue->head - 1) & (OVERRIDE_BUFSIZE - 1), bptr;
+
+    if(queue->head != queue->tail && last != queue->tail && queue->buf[last].cmd == cmd && queue->buf[last].count < 255)
+        queue->buf[last].count++;
 
-    if(bptr != feed.tail) {         // If not buffer full
-        feed.buf[feed.head] = cmd;  // add data to buffer
-        feed.head = bptr;           // and update pointer
+    else if((bptr = (queue->head + 1) & (OVERRIDE_BUFSIZE - 1)) != queue->tail) { // If not buffer full
+        queue->buf[queue->head].cmd = cmd;                                        // add data to buffer
+        queue->buf[queue->head].count = 1;
+        queue->head = bptr;                                                       // and update pointer
     }
 }
 
 // Returns 0 if no commands enqueued
-uint8_t get_feed_override (void)
+static inline uint8_t override_get (override_queue_t *queue)
 {
     uint8_t data = 0;
-    uint_fast8_t bptr = feed.tail;
+    uint_fast8_t bptr = queue->tail;
 
-    if(bptr != feed.head) {
-        data = feed.buf[bptr++];                    // Get next character, increment tmp pointer
-        feed.tail = bptr & (OVERRIDE_BUFSIZE - 1);  // and update pointer
+    if(bptr != queue->head) {
+        data = queue->buf[bptr].cmd;                        // Get next command
+        if(--queue->buf[bptr].count == 0)                   // and if all repeats are consumed
+            queue->tail = (bptr + 1) & (OVERRIDE_BUFSIZE - 1);  // update pointer
     }
 
     return data;
 }
 
-ISR_CODE void ISR_FUNC(enqueue_spindle_override)(uint8_t cmd)
+ISR_CODE void ISR_FUNC(enqueue_feed_override)(uint8_t cmd)
 {
-    uint_fast8_t bptr = (spindle.head + 1) & (OVERRIDE_BUFSIZE - 1);    // Get next head pointer
-
-    if(bptr != spindle.tail) {              // If not buffer full
-        spindle.buf[spindle.head] = cmd;    // add data to buffer
-        spindle.head = bptr;                // and update pointer
-    }
+    override_enqueue(&feed, cmd);
 }
 
 // Returns 0 if no commands enqueued
-uint8_t get_spindle_override (void)
+uint8_t get_feed_override (void)
 {
-    uint8_t data = 0;
-    uint_fast8_t bptr = spindle.tail;
+    return override_get(&feed);
+}
 
-    if(bptr != spindle.head) {
-        data = spindle.buf[bptr++];                     // Get next character, increment tmp pointer
-        spindle.tail = bptr & (OVERRIDE_BUFSIZE - 1);   // and update pointer
-    }
+ISR_CODE void ISR_FUNC(enqueue_spindle_override)(uint8_t cmd)
+{
+    override_enqueue(&spindle, cmd);
+}
 
-    return data;
+// Returns 0 if no commands enqueued
+uint8_t get_spindle_override (void)
+{
+    return override_get(&spindle);
 }
 
 ISR_CODE void ISR_FUNC(enqueue_coolant_override)(uint8_t cmd)
 {
-    uint_fast8_t bptr = (coolant.head + 1) & (OVERRIDE_BUFSIZE - 1);    // Get next head pointer
-
-    if(bptr != coolant.tail) {              // If not buffer full
-        coolant.buf[coolant.head] = cmd;    // add data to buffer
-        coolant.head = bptr;                // and update pointer
-    }
+    override_enqueue(&coolant, cmd);
 }
 
 // Returns 0 if no commands enqueued
 uint8_t get_coolant_override (void)
 {
-    uint8_t data = 0;
-    uint_fast8_t bptr = coolant.tail;
-
-    if(bptr != coolant.head) {
-        data = coolant.buf[bptr++];                   // Get next character, increment tmp pointer
-        coolant.tail = bptr & (OVERRIDE_BUFSIZE - 1); // and update pointer
-    }
-
-    return data;
+    return override_get(&coolant);
 }
 
 void flush_override_buffers (void)
@@ -29,11 +29,16 @@
 #include "hal.h"
 #include "nuts_bolts.h"
 #include "planner.h"
+#include "mem_stats.h"
 #include "protocol.h"
+#include "profile.h"
 
 #ifndef ROTARY_FIX
 #define ROTARY_FIX 0
 #endif
+#ifndef PLANNER_SPINDLE_TABLE_SIZE
+#define PLANNER_SPINDLE_TABLE_SIZE 8    // Number of different block spindle parameters that can be queued in the planner buffer.
+#endif
 
 #if ENABLE_BACKLASH_COMPENSATION
 void mc_sync_backlash_position (void);
@@ -45,8 +50,99 @@ static plan_block_t *block_buffer_tail = NULL;          // Pointer to the block
 static plan_block_t *block_buffer_head;                 // Pointer to the next block to be pushed
 static plan_block_t *next_buffer_head;                  // Pointer to the next buffer head
 static plan_block_t *block_buffer_planned;              // Pointer to the optimally planned block
+static plan_block_data_t *block_data;                   // Block data not used by the planner, indexed as the block buffer
+
+// Ring of spindle parameters referenced by the blocks in the planner buffer, used in the same order as
+// the blocks. The last entry is reserved for system motions.
+static plan_spindle_t spindle_table[PLANNER_SPINDLE_TABLE_SIZE + 1];
+static plan_spindle_t *spindle_head;                    // Spindle parameters of the last block pushed
 
 static planner_t pl;
+static planner_stats_t stats = {0};
+static uint32_t profile_gen = 0;                        // Incremented on override changes, see plan_update_velocity_profile_parameters()
+
+static inline void plan_refresh_profile_parameters (plan_block_t *block);
+
+static inline plan_block_t *block_next (plan_block_t *block)
+{
+    return block == &block_buffer[block_buffer_size] ? block_buffer : block + 1;
+}
+
+static inline plan_block_t *block_prev (plan_block_t *block)
+{
+    return block == block_buffer ? &block_buffer[block_buffer_size] : block - 1;
+}
+
+static inline plan_spindle_t *spindle_next (plan_spindle_t *spindle)
+{
+    return spindle == &spindle_table[PLANNER_SPINDLE_TABLE_SIZE - 1] ? spindle_table : spindle + 1;
+}
+
+// Returns true if all spindle table entries are referenced by blocks in the buffer.
+static inline bool spindle_table_full (void)
+{
+    return block_buffer_tail != block_buffer_head && spindle_next(spindle_head) == block_buffer_tail->spindle;
+}
+
+// Returns the spindle table entry for a new block, the entry of the previous block is shared if unchanged.
+// Returns NULL if the table is full.
+static plan_spindle_t *spindle_entry (spindle_t *spindle, bool system_motion)
+{
+    plan_spindle_t *entry = spindle_head;
+
+    if(entry->hal != spindle->hal || entry->css != spindle->css || entry->state.value != spindle->state.value) {
+
+        if(system_motion)
+            entry = &spindle_table[PLANNER_SPINDLE_TABLE_SIZE];
+        else if(spindle_table_full())
+            return NULL;
+        else
+            entry = spindle_next(spindle_head);
+
+        entry->state = spindle->state;
+        entry->css = spindle->css;
+        entry->hal = spindle->hal;
+    }
+
+    return entry;
+}
+
+#if PLANNER_DIRECTION_CACHE_SIZE
+
+#if PLANNER_DIRECTION_CACHE_SIZE & (PLANNER_DIRECTION_CACHE_SIZE - 1)
+#error "PLANNER_DIRECTION_CACHE_SIZE must be a power of 2!"
+#endif
+
+#define DIRECTION_CACHE_MASK (PLANNER_DIRECTION_CACHE_SIZE - 1)
+
+// Entries are identified by a tag that changes each time the entry is replaced. Tags are used
+// as keys for the junction cache so that stale unit vector pairs are never matched.
+typedef struct {
+    uint32_t tag;                   // Entry tag, 0 if entry is unused.
+    float unit_vec[N_AXIS];
+    float acceleration;             // Axis-limit adjusted acceleration for the unit vector.
+    float rapid_rate;               // Axis-limit adjusted maximum rate for the unit vector.
+#if ENABLE_JERK_ACCELERATION
+    float jerk;                     // Axis-limit adjusted jerk for the unit vector.
+#endif
+} plan_direction_t;
+
+typedef struct {
+    uint32_t prev_tag;
+    uint32_t tag;
+    float max_junction_speed_sqr;
+} plan_junction_t;
+
+typedef struct {
+    uint32_t next_tag;
+    uint32_t prev_tag;              // Tag of previous path line segment unit vector, 0 if none.
+    plan_direction_t direction[PLANNER_DIRECTION_CACHE_SIZE];
+    plan_junction_t junction[PLANNER_DIRECTION_CACHE_SIZE];
+} plan_cache_t;
+
+static plan_cache_t cache = {0};
+
+#endif
 
 /*                            PLANNER SPEED DEFINITION
                                      +--------+   <- current->nominal_speed
@@ -113,10 +209,26 @@ static planner_t pl;
   look-ahead blocks numbering up to a hundred or more.
 
 */
+#if PROFILING_ENABLE
+
+static void recalculate (void);
+
 static void planner_recalculate (void)
+{
+    uint32_t t = profile_start();
+
+    recalculate();
+
+    profile_end(Profile_PlannerRecalculate, t);
+}
+
+static void recalculate (void)
+#else
+static void planner_recalculate (void)
+#endif
 {
     // Initialize block pointer to the last block in the planner buffer.
-    plan_block_t *block = block_buffer_head->prev;
+    plan_block_t *block = block_prev(block_buffer_head);
 
     // Bail. Can't do anything with one only one plan-able block.
     if (block == block_buffer_planned)
@@ -129,24 +241,42 @@ static void planner_recalculate (void)
     plan_block_t *next;
     plan_block_t *current = block;
 
+    plan_refresh_profile_parameters(current);
+
     // Calculate maximum entry speed for last block in buffer, where the exit speed is always zero.
     current->entry_speed_sqr = min(current->max_entry_speed_sqr, 2.0f * current->acceleration * current->millimeters);
 
-    block = block->prev;
+    uint_fast16_t n_blocks = 1;
+
+    block = block_prev(block);
     if (block == block_buffer_planned) { // Only two plannable blocks in buffer. Reverse pass complete.
         // Check if the first block is the tail. If so, notify stepper to update its current parameters.
         if (block == block_buffer_tail)
             st_update_plan_block_parameters();
     } else while (block != block_buffer_planned) { // Three or more plan-able blocks
 
+#if PLANNER_RECALC_MAX_BLOCKS > 0
+        // Bounded reverse pass: stop when the limit is reached and freeze the blocks behind the window.
+        // The block where the pass stopped keeps its entry speed, which is always feasible since
+        // adding blocks can only increase entry speeds. The forward pass below starts from it and
+        // corrects its exit speed for acceleration limits.
+        if (n_blocks >= PLANNER_RECALC_MAX_BLOCKS) {
+            block_buffer_planned = block;
+            stats.recalc_truncated++;
+            break;
+        }
+#endif
+        n_blocks++;
         next = current;
         current = block;
-        block = block->prev;
+        block = block_prev(block);
 
         // Check if next block is the tail block(=planned block). If so, update current stepper parameters.
         if (block == block_buffer_tail)
             st_update_plan_block_parameters();
 
+        plan_refresh_profile_parameters(current);
+
         // Compute maximum entry speed decelerating over the current block from its exit speed.
         if (current->entry_speed_sqr != current->max_entry_speed_sqr) {
             entry_speed_sqr = next->entry_speed_sqr + 2.0f * current->acceleration * current->millimeters;
@@ -154,16 +284,21 @@ static void planner_recalculate (void)
         }
     }
 
+    if(n_blocks > stats.recalc_max_blocks)
+        stats.recalc_max_blocks = n_blocks;
+
     // Forward Pass: Forward plan the acceleration curve from the planned pointer onward.
     // Also scans for optimal plan breakpoints and appropriately updates the planned pointer.
     next = block_buffer_planned; // Begin at buffer planned pointer
-    block = block_buffer_planned->next;
+    block = block_next(block_buffer_planned);
 
     while (block != block_buffer_head) {
 
         current = next;
         next = block;
 
+        plan_refresh_profile_parameters(next);
+
         // Any acceleration detected in the forward pass automatically moves the optimal planned
         // pointer forward, since everything before this is all optimal. In other words, nothing
         // can improve the plan from the buffer tail to the planned pointer by logic.
@@ -183,21 +318,27 @@ static void planner_recalculate (void)
         if (next->entry_speed_sqr == next->max_entry_speed_sqr)
             block_buffer_planned = block;
 
-        block = block->next;
+        block = block_next(block);
     }
 }
 
 inline static void plan_cleanup (plan_block_t *block)
 {
-    if(block->message) {
-        free(block->message);
-        block->message = NULL;
+    plan_block_data_t *data = plan_get_block_data(block);
+
+    if(data->message) {
+        gc_message_free(data->message);
+        data->message = NULL;
     }
 
-    while(block->output_commands) {
-        output_command_t *next = block->output_commands->next;
-        free(block->output_commands);
-        block->output_commands = next;
+    if(data->output_commands) {
+        gc_output_commands_free(data->output_commands);
+        data->output_commands = NULL;
+    }
+
+    if(data->raster) {
+        mem_free(data->raster);
+        data->raster = NULL;
     }
 }
 
@@ -208,13 +349,20 @@ inline static void plan_reset_buffer (void)
         // Free memory for any pending messages and output commands after soft reset
         while(block_buffer_tail != block_buffer_head) {
             plan_cleanup(block_buffer_tail);
-            block_buffer_tail = block_buffer_tail->next;
+            block_buffer_tail = block_next(block_buffer_tail);
         }
     }
 
     block_buffer_tail = block_buffer_head = block_buffer;   // Empty = tail == head
-    next_buffer_head = block_buffer_head->next;             // = next block
+    next_buffer_head = block_next(block_buffer_head);             // = next block
     block_buffer_planned = block_buffer_tail;               // = block_buffer_tail
+
+    memset(spindle_table, 0, sizeof(spindle_table));
+    spindle_head = spindle_table;
+
+#if PLANNER_SEGMENT_MERGE_ENABLE && !defined(KINEMATICS_API)
+    merge.valid = false;
+#endif
 }
 
 uint_fast16_t plan_get_buffer_size (void)
@@ -228,7 +376,7 @@ bool plan_reset (void)
 
         block_buffer_size = settings.planner_buffer_blocks;
 
-        while((block_buffer = malloc((block_buffer_size + 1) * sizeof(plan_block_t))) == NULL) {
+        while((block_buffer = mem_alloc(MemTag_Planner, (block_buffer_size + 1) * (sizeof(plan_block_t) + sizeof(plan_block_data_t)))) == NULL) {
             if(block_buffer_size > 40)
                 block_buffer_size -= block_buffer_size >= 250 ? 100 : 10;
             else
@@ -242,26 +390,27 @@ bool plan_reset (void)
     if(block_buffer == NULL)
         return false;
 
+    block_data = (plan_block_data_t *)&block_buffer[block_buffer_size + 1];
+
+    st_prep_lock(true);
+
     if(block_buffer_tail) {
         // Free memory for any pending messages and output commands after soft reset
         while(block_buffer_tail != block_buffer_head) {
             plan_cleanup(block_buffer_tail);
-            block_buffer_tail = block_buffer_tail->next;
+            block_buffer_tail = block_next(block_buffer_tail);
         }
         block_buffer_tail = NULL;
     }
 
     memset(&pl, 0, sizeof(planner_t)); // Clear planner struct
-
-    // Set up stepper block ringbuffer as circular doubly linked list
-    uint_fast8_t idx;
-    for(idx = 0 ; idx <= block_buffer_size ; idx++) {
-        block_buffer[idx].prev = &block_buffer[idx == 0 ? block_buffer_size : idx - 1];
-        block_buffer[idx].next = &block_buffer[idx == block_buffer_size ? 0 : idx + 1];
-    }
+    memset(block_data, 0, (block_buffer_size + 1) * sizeof(plan_block_data_t));
+    plan_cache_invalidate();
 
     plan_reset_buffer();
 
+    st_prep_lock(false);
+
     return true;
 }
 
@@ -272,8 +421,8 @@ void plan_discard_current_block (void)
         plan_cleanup(block_buffer_tail);
         // Push block_buffer_planned pointer, if encountered.
         if (block_buffer_tail == block_buffer_planned)
-            block_buffer_planned = block_buffer_tail->next;
-        block_buffer_tail = block_buffer_tail->next;
+            block_buffer_planned = block_next(block_buffer_tail);
+        block_buffer_tail = block_next(block_buffer_tail);
     }
 }
 
@@ -292,9 +441,53 @@ plan_block_t *plan_get_current_block (void)
 }
 
 
+// Returns address of the message, output commands and raster data of a planner block.
+plan_block_data_t *plan_get_block_data (plan_block_t *block)
+{
+    return &block_data[block - block_buffer];
+}
+
+#if SYNCED_STATE_CHANGES_ENABLE
+
+// Adds state changes to be performed when the last block in the buffer is completed. Returns false if less
+// than two blocks are buffered as the stepper module may have loaded the last block, or if another spindle
+// is to be stopped by the block.
+bool plan_add_state_change (plan_state_change_t *change)
+{
+    bool ok;
+    plan_block_t *block;
+    plan_state_change_t *end_state;
+
+    st_prep_lock(true);
+
+    block = block_prev(block_buffer_head);
+
+    if((ok = block_buffer_head != block_buffer_tail && block != block_buffer_tail)) {
+
+        end_state = &plan_get_block_data(block)->end_state;
+
+        if(change->spindle_off) {
+            if((ok = end_state->spindle_off == NULL || end_state->spindle_off == change->spindle_off))
+                end_state->spindle_off = change->spindle_off;
+        }
+
+        if(ok && change->set_coolant) {
+            end_state->set_coolant = true;
+            end_state->coolant = change->coolant;
+        }
+    }
+
+    st_prep_lock(false);
+
+    return ok;
+}
+
+#endif
+
+
 inline float plan_get_exec_block_exit_speed_sqr (void)
 {
-    plan_block_t *block = block_buffer_tail->next;
+    plan_block_t *block = block_next(block_buffer_tail);
     return block == block_buffer_head ? 0.0f : block->entry_speed_sqr;
 }
 
@@ -302,7 +495,7 @@ inline float plan_get_exec_block_exit_speed_sqr (void)
 // Returns the availability status of the block ring buffer. True, if full.
 bool plan_check_full_buffer (void)
 {
-    return block_buffer_tail == next_buffer_head;
+    return block_buffer_tail == next_buffer_head || spindle_table_full();
 }
 
 
@@ -310,7 +503,7 @@ bool plan_check_full_buffer (void)
 // NOTE: All system motion commands, such as homing/parking, are not subject to overrides.
 float plan_compute_profile_nominal_speed (plan_block_t *block)
 {
-    float nominal_speed = block->spindle.state.synchronized ? block->programmed_rate * block->spindle.hal->get_data(SpindleData_RPM)->rpm : block->programmed_rate;
+    float nominal_speed = block->spindle->state.synchronized ? block->programmed_rate * block->spindle->hal->get_data(SpindleData_RPM)->rpm : block->programmed_rate;
 
     if (block->condition.rapid_motion)
         nominal_speed *= (0.01f * (float)sys.override.rapid_rate);
@@ -337,6 +530,17 @@ inline static float plan_compute_profile_parameters (plan_block_t *block, float
     return nominal_speed;
 }
 
+// Recomputes the max entry speed (sqr) of a block if the override values have changed since it was last computed.
+// Called when the planner touches a block, so that an override change does not have to update the whole buffer.
+static inline void plan_refresh_profile_parameters (plan_block_t *block)
+{
+    if(block->profile_gen != profile_gen) {
+        block->profile_gen = profile_gen;
+        plan_compute_profile_parameters(block, plan_compute_profile_nominal_speed(block),
+                                         block == block_buffer_tail ? SOME_LARGE_VALUE : plan_compute_profile_nominal_speed(block_prev(block)));
+    }
+}
+
 static inline float limit_acceleration_by_axis_maximum (float *unit_vec)
 {
     uint_fast8_t idx = N_AXIS;
@@ -350,6 +554,23 @@ static inline float limit_acceleration_by_axis_maximum (float *unit_vec)
     return limit_value;
 }
 
+#if ENABLE_JERK_ACCELERATION
+
+static inline float limit_jerk_by_axis_maximum (float *unit_vec)
+{
+    uint_fast8_t idx = N_AXIS;
+    float limit_value = SOME_LARGE_VALUE;
+
+    do {
+        if (unit_vec[--idx] != 0.0f)  // Avoid divide by zero.
+            limit_value = min(limit_value, fabsf(settings.axis[idx].jerk / unit_vec[idx]));
+    } while(idx);
+
+    return limit_value;
+}
+
+#endif
+
 static inline float limit_max_rate_by_axis_maximum (float *unit_vec)
 {
     uint_fast8_t idx = N_AXIS;
@@ -364,6 +585,190 @@ static inline float limit_max_rate_by_axis_maximum (float *unit_vec)
 }
 
 
+#if PLANNER_DIRECTION_CACHE_SIZE
+
+// Returns the cache entry for the unit vector, the entry is replaced with computed limits on misses.
+// The quantised unit vector is only used for indexing, hits require an exact match.
+static plan_direction_t *plan_cache_direction (float *unit_vec)
+{
+    uint32_t hash = 0;
+    uint_fast8_t idx = N_AXIS;
+
+    do {
+        idx--;
+        hash = hash * 31 + (uint32_t)(int32_t)(unit_vec[idx] * 1024.0f);
+    } while(idx);
+
+    plan_direction_t *entry = &cache.direction[(hash ^ (hash >> 7)) & DIRECTION_CACHE_MASK];
+
+    if(entry->tag && !memcmp(entry->unit_vec, unit_vec, sizeof(entry->unit_vec)))
+        stats.direction_hits++;
+    else {
+        stats.direction_misses++;
+        if(++cache.next_tag == 0)
+            cache.next_tag = 1;
+        entry->tag = cache.next_tag;
+        memcpy(entry->unit_vec, unit_vec, sizeof(entry->unit_vec));
+        entry->acceleration = limit_acceleration_by_axis_maximum(unit_vec);
+        entry->rapid_rate = limit_max_rate_by_axis_maximum(unit_vec);
+#if ENABLE_JERK_ACCELERATION
+        entry->jerk = limit_jerk_by_axis_maximum(unit_vec);
+#endif
+    }
+
+    return entry;
+}
+
+void plan_cache_invalidate (void)
+{
+    memset(&cache, 0, sizeof(plan_cache_t));
+}
+
+#else
+
+void plan_cache_invalidate (void)
+{
+}
+
+#endif
+
+#if PLANNER_SEGMENT_MERGE_ENABLE && !defined(KINEMATICS_API)
+
+#ifndef PLANNER_MERGE_TOLERANCE
+#define PLANNER_MERGE_TOLERANCE 0.002f  // Maximum deviation in mm of merged segment end points from the resulting line.
+#endif
+#ifndef PLANNER_MERGE_MAX_SEGMENTS
+#define PLANNER_MERGE_MAX_SEGMENTS 16   // Maximum number of segments merged into a block.
+#endif
+
+// State of the last block in the buffer, used to replan it when the next segment is merged into it.
+static struct {
+    bool valid;                                     // Last block in the buffer may be extended.
+    uint_fast8_t n_points;                          // Number of merged segment end points.
+    int32_t start[N_AXIS];                          // Planner position at the start of the block in steps.
+    float previous_unit_vec[N_AXIS];                // Planner unit vector before the block.
+    float previous_nominal_speed;                   // Planner nominal speed before the block.
+#if PLANNER_DIRECTION_CACHE_SIZE
+    uint32_t prev_tag;                              // Direction cache tag before the block.
+#endif
+    float point[PLANNER_MERGE_MAX_SEGMENTS][N_AXIS]; // End points of the merged segments in mm.
+} merge = {0};
+
+// Returns true if the end points of the merged segments are within the tolerance of the line from start to target.
+static bool merge_check_deviation (float *start, float *target)
+{
+    uint_fast8_t idx, point;
+    float line[N_AXIS], length = 0.0f, dot, deviation, delta;
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        line[idx] = target[idx] - start[idx];
+        length += line[idx] * line[idx];
+    }
+
+    if(length == 0.0f)
+        return false;
+
+    length = sqrtf(length);
+    for(idx = 0; idx < N_AXIS; idx++)
+        line[idx] /= length;
+
+    for(point = 0; point < merge.n_points; point++) {
+
+        dot = deviation = 0.0f;
+        for(idx = 0; idx < N_AXIS; idx++)
+            dot += (merge.point[point][idx] - start[idx]) * line[idx];
+
+        if(dot <= 0.0f || dot >= length)
+            return false;
+
+        for(idx = 0; idx < N_AXIS; idx++) {
+            delta = merge.point[point][idx] - start[idx] - dot * line[idx];
+            deviation += delta * delta;
+        }
+
+        if(deviation > PLANNER_MERGE_TOLERANCE * PLANNER_MERGE_TOLERANCE)
+            return false;
+    }
+
+    return true;
+}
+
+// Removes the last block from the buffer and restores the planner state if the segment can be merged into it,
+// the block is then replanned to the end of the segment. Otherwise the planner state is saved for the next segment.
+// Segments are merged only when all block parameters except the distance are the same, and not across line numbers.
+static bool merge_segment (float *target, plan_line_data_t *pl_data)
+{
+    bool ok;
+    uint_fast8_t idx = N_AXIS;
+    float start[N_AXIS];
+    plan_block_t *block = block_prev(block_buffer_head);
+    planner_cond_t mask = {
+        .rapid_motion = On,
+        .jog_motion = On,
+        .backlash_motion = On,
+        .no_feed_override = On,
+        .inverse_time = On,
+        .is_rpm_rate_adjusted = On,
+        .is_laser_ppi_mode = On,
+        .coolant.value = 0xFF
+    };
+
+    if(pl_data->condition.system_motion)
+        return false;
+
+    ok = merge.valid && merge.n_points < PLANNER_MERGE_MAX_SEGMENTS &&
+          block_buffer_head != block_buffer_tail && block != block_buffer_tail && !sys.step_control.execute_sys_motion &&
+           (pl_data->condition.value & mask.value) == (block->condition.value & mask.value) &&
+            pl_data->overrides.value == block->overrides.value &&
+             pl_data->line_number == block->line_number &&
+              pl_data->feed_rate == block->programmed_rate &&
+               pl_data->spindle.rpm == block->spindle_rpm &&
+                pl_data->spindle.hal == block->spindle->hal &&
+                 pl_data->spindle.state.value == block->spindle->state.value &&
+                  pl_data->spindle.css == NULL &&
+                   pl_data->message == NULL && pl_data->output_commands == NULL && pl_data->raster == NULL;
+
+    if(ok) {
+        do {
+            idx--;
+            start[idx] = (float)merge.start[idx] / settings.axis[idx].steps_per_mm;
+            merge.point[merge.n_points][idx] = (float)pl.position[idx] / settings.axis[idx].steps_per_mm;
+        } while(idx);
+
+        merge.n_points++;
+
+        if(!(ok = merge_check_deviation(start, target)))
+            merge.n_points--;
+    }
+
+    if(ok) {
+        block_buffer_head = block;
+        next_buffer_head = block_next(block_buffer_head);
+        if(block_buffer_planned == next_buffer_head)
+            block_buffer_planned = block_buffer_head;
+        memcpy(pl.position, merge.start, sizeof(pl.position));
+        memcpy(pl.previous_unit_vec, merge.previous_unit_vec, sizeof(pl.previous_unit_vec));
+        pl.previous_nominal_speed = merge.previous_nominal_speed;
+#if PLANNER_DIRECTION_CACHE_SIZE
+        cache.prev_tag = merge.prev_tag;
+#endif
+        stats.segments_merged++;
+    } else {
+        merge.valid = false;
+        merge.n_points = 0;
+        memcpy(merge.start, pl.position, sizeof(pl.position));
+        memcpy(merge.previous_unit_vec, pl.previous_unit_vec, sizeof(pl.previous_unit_vec));
+        merge.previous_nominal_speed = pl.previous_nominal_speed;
+#if PLANNER_DIRECTION_CACHE_SIZE
+        merge.prev_tag = cache.prev_tag;
+#endif
+    }
+
+    return ok;
+}
+
+#endif
+
 /* Add a new linear movement to the buffer. target[N_AXIS] is the signed, absolute target position
    in millimeters. Feed rate specifies the speed of the motion. If feed rate is inverted, the feed
    rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
@@ -378,10 +783,36 @@ static inline float limit_max_rate_by_axis_maximum (float *unit_vec)
    head. It avoids changing the planner state and preserves the buffer to ensure subsequent gcode
    motions are still planned correctly, while the stepper module only points to the block buffer head
    to execute the special system motion. */
+
+static bool buffer_line (float *target, plan_line_data_t *pl_data);
+
 bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
 {
+    bool ok;
+#if PROFILING_ENABLE
+    uint32_t t = profile_start();
+#endif
+
+    st_prep_lock(true);
+    ok = buffer_line(target, pl_data);
+    st_prep_lock(false);
+
+#if PROFILING_ENABLE
+    profile_end(Profile_PlanBufferLine, t);
+#endif
+
+    return ok;
+}
+
+static bool buffer_line (float *target, plan_line_data_t *pl_data)
+{
+#if PLANNER_SEGMENT_MERGE_ENABLE && !defined(KINEMATICS_API)
+    bool merged = merge_segment(target, pl_data); // NOTE: may rewind the buffer head, must be called before the block is fetched.
+#endif
     // Prepare and initialize new block. Copy relevant pl_data for block execution.
     plan_block_t *block = block_buffer_head;
+    plan_block_data_t *data = plan_get_block_data(block);
+    plan_spindle_t *spindle;
     int32_t target_steps[N_AXIS], position_steps[N_AXIS], delta_steps;
     uint_fast8_t idx;
     float unit_vec[N_AXIS];
@@ -389,14 +820,31 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
     axes_signals_t motion = {0};
 #endif
 
+    // Spindle table is full, should not happen as callers check that the buffer is not full before adding a block.
+    if((spindle = spindle_entry(&pl_data->spindle, pl_data->condition.system_motion)) == NULL)
+        return false;
+
 //    plan_cleanup(block);
-    memset(block, 0, sizeof(plan_block_t) - 2 * sizeof(plan_block_t *));    // Zero all block values (except linked list pointers).
-    memcpy(&block->spindle, &pl_data->spindle, sizeof(spindle_t));          // Copy spindle data (RPM etc)
+    memset(block, 0, sizeof(plan_block_t));                                 // Zero all block values.
+    block->spindle = spindle;                                               // Set spindle data
+    block->spindle_rpm = pl_data->spindle.rpm;
     block->condition = pl_data->condition;
     block->overrides = pl_data->overrides;
     block->line_number = pl_data->line_number;
-    block->output_commands = pl_data->output_commands;
-    block->message = pl_data->message;
+#if JOB_RESUME_ENABLE
+    block->job_block = pl_data->job_block;
+#endif
+#if PLANNER_SEGMENT_MERGE_ENABLE && !defined(KINEMATICS_API)
+    if(!merged) // Keep message and output commands of the block merged into.
+#endif
+    {
+        data->output_commands = pl_data->output_commands;
+        data->message = pl_data->message;
+        data->raster = pl_data->raster;
+#if SYNCED_STATE_CHANGES_ENABLE
+        memset(&data->end_state, 0, sizeof(plan_state_change_t));
+#endif
+    }
 
     // Copy position data based on type of motion being planned.
     memcpy(position_steps, block->condition.system_motion ? sys.position : pl.position, sizeof(position_steps));
@@ -430,27 +878,28 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
     } while(idx);
 
     // Calculate RPMs to be used for Constant Surface Speed (CSS) calculations.
-    if(block->spindle.css) {
+    if(block->spindle->css) {
 
         float pos;
 
-        if((pos = (float)position_steps[block->spindle.css->axis] / settings.axis[block->spindle.css->axis].steps_per_mm - block->spindle.css->tool_offset) > 0.0f) {
-            if((block->spindle.rpm = block->spindle.css->surface_speed / (pos * (float)(2.0f * M_PI))) > block->spindle.css->max_rpm)
-                block->spindle.rpm = block->spindle.css->max_rpm;
+        if((pos = (float)position_steps[block->spindle->css->axis] / settings.axis[block->spindle->css->axis].steps_per_mm - block->spindle->css->tool_offset) > 0.0f) {
+            if((block->spindle_rpm = block->spindle->css->surface_speed / (pos * (float)(2.0f * M_PI))) > block->spindle->css->max_rpm)
+                block->spindle_rpm = block->spindle->css->max_rpm;
         } else
-            block->spindle.rpm = block->spindle.css->max_rpm;
+            block->spindle_rpm = block->spindle->css->max_rpm;
 
-        if((pos = target[block->spindle.css->axis] - block->spindle.css->tool_offset) > 0.0f) {
-            if((block->spindle.css->target_rpm = block->spindle.css->surface_speed / (pos * (float)(2.0f * M_PI))) > block->spindle.css->max_rpm)
-                block->spindle.css->target_rpm = block->spindle.css->max_rpm;
+        if((pos = target[block->spindle->css->axis] - block->spindle->css->tool_offset) > 0.0f) {
+            if((block->spindle->css->target_rpm = block->spindle->css->surface_speed / (pos * (float)(2.0f * M_PI))) > block->spindle->css->max_rpm)
+                block->spindle->css->target_rpm = block->spindle->css->max_rpm;
         } else
-            block->spindle.css->target_rpm = block->spindle.css->max_rpm;
+            block->spindle->css->target_rpm = block->spindle->css->max_rpm;
 
-        block->spindle.css->delta_rpm = block->spindle.css->target_rpm - block->spindle.rpm;
+        block->spindle->css->delta_rpm = block->spindle->css->target_rpm - block->spindle_rpm;
     }
 
     pl_data->message = NULL;         // Indicate message is already queued for display on execution
     pl_data->output_commands = NULL; // Indicate commands are already queued for execution
+    pl_data->raster = NULL;          // Indicate raster data is consumed, only the first part of a split motion gets it
 
     // Bail if this is a zero-length block. Highly unlikely to occur.
     if(block->step_event_count == 0) {
@@ -499,8 +948,20 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
 #endif
 
     block->millimeters = convert_delta_vector_to_unit_vector(unit_vec);
+#if PLANNER_DIRECTION_CACHE_SIZE
+    plan_direction_t *direction = plan_cache_direction(unit_vec);
+    block->acceleration = direction->acceleration;
+    block->rapid_rate = direction->rapid_rate;
+#if ENABLE_JERK_ACCELERATION
+    block->jerk = direction->jerk;
+#endif
+#else
     block->acceleration = limit_acceleration_by_axis_maximum(unit_vec);
     block->rapid_rate = limit_max_rate_by_axis_maximum(unit_vec);
+#if ENABLE_JERK_ACCELERATION
+    block->jerk = limit_jerk_by_axis_maximum(unit_vec);
+#endif
+#endif
 
     // Store programmed rate.
     if (block->condition.rapid_motion)
@@ -564,11 +1025,25 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
             // Junction is a straight line or 180 degrees. Junction speed is infinite.
             block->max_junction_speed_sqr = SOME_LARGE_VALUE;
         } else {
+#if PLANNER_DIRECTION_CACHE_SIZE
+            plan_junction_t *junction = &cache.junction[(cache.prev_tag * 31 + direction->tag) & DIRECTION_CACHE_MASK];
+            if(cache.prev_tag && junction->prev_tag == cache.prev_tag && junction->tag == direction->tag) {
+                stats.junction_hits++;
+                block->max_junction_speed_sqr = junction->max_junction_speed_sqr;
+            } else {
+                stats.junction_misses++;
+#endif
             convert_delta_vector_to_unit_vector(junction_unit_vec);
             float junction_acceleration = limit_acceleration_by_axis_maximum(junction_unit_vec);
             float sin_theta_d2 = sqrtf(0.5f * (1.0f - junction_cos_theta)); // Trig half angle identity. Always positive.
             block->max_junction_speed_sqr = max(MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED,
                                                   (junction_acceleration * settings.junction_deviation * sin_theta_d2) / (1.0f - sin_theta_d2));
+#if PLANNER_DIRECTION_CACHE_SIZE
+                junction->prev_tag = cache.prev_tag;
+                junction->tag = direction->tag;
+                junction->max_junction_speed_sqr = block->max_junction_speed_sqr;
+            }
+#endif
         }
     }
 
@@ -576,23 +1051,145 @@ bool plan_buffer_line (float *target, plan_line_data_t *pl_data)
     if (!block->condition.system_motion) {
 
         pl.previous_nominal_speed = plan_compute_profile_parameters(block, plan_compute_profile_nominal_speed(block), pl.previous_nominal_speed);
+        block->profile_gen = profile_gen;
 
         if(!block->condition.backlash_motion) {
             // Update previous path unit_vector and planner position.
             memcpy(pl.previous_unit_vec, unit_vec, sizeof(unit_vec)); // pl.previous_unit_vec[] = unit_vec[]
             memcpy(pl.position, target_steps, sizeof(target_steps)); // pl.position[] = target_steps[]
+#if PLANNER_DIRECTION_CACHE_SIZE
+            cache.prev_tag = direction->tag;
+#endif
         }
+#if PLANNER_SEGMENT_MERGE_ENABLE && !defined(KINEMATICS_API)
+        merge.valid = !(block->condition.rapid_motion || block->condition.jog_motion || block->condition.backlash_motion ||
+                         block->condition.inverse_time || block->spindle->css || data->raster);
+#endif
+
         // New block is all set. Update buffer head and next buffer head indices.
         block_buffer_head = next_buffer_head;
-        next_buffer_head = block_buffer_head->next;
+        next_buffer_head = block_next(block_buffer_head);
+        spindle_head = spindle;
 
         // Finish up by recalculating the plan with the new block.
-        planner_recalculate();
+        if(hal.get_micros) {
+            uint32_t t = (uint32_t)hal.get_micros();
+            planner_recalculate();
+            if((t = (uint32_t)hal.get_micros() - t) > stats.recalc_max_us)
+                stats.recalc_max_us = t;
+        } else
+            planner_recalculate();
+
+        stats.recalc_count++;
     }
 
     return true;
 }
 
+#if PLANNER_DWELL_ENABLE
+
+/*! \brief Add a dwell to the buffer, the parser may then continue to fill the buffer while the dwell is executed.
+The stepper module executes the dwell block as a sequence of segments without steps. The block has zero
+acceleration, the look-ahead passes then enforce a stop before and after it.
+\param seconds dwell time.
+\param pl_data pointer to a \a plan_line_data_t structure with the spindle and coolant state.
+\returns false if the block could not be buffered.
+*/
+#if THREADING_PIPELINE_ENABLE
+static bool buffer_dwell (float seconds, float index_offset, plan_line_data_t *pl_data)
+#else
+bool plan_buffer_dwell (float seconds, plan_line_data_t *pl_data)
+#endif
+{
+    plan_block_t *block = block_buffer_head;
+    plan_block_data_t *data = plan_get_block_data(block);
+    plan_spindle_t *spindle;
+
+    if(seconds <= 0.0f)
+        return false;
+
+    st_prep_lock(true);
+
+    if((spindle = spindle_entry(&pl_data->spindle, false)) == NULL) {
+        st_prep_lock(false);
+        return false;
+    }
+
+    memset(block, 0, sizeof(plan_block_t)); // Zero all block values, entry and junction speeds included.
+    block->spindle = spindle;
+    block->spindle_rpm = pl_data->spindle.rpm;
+    block->condition = pl_data->condition;
+    block->condition.dwell = On;
+#if THREADING_PIPELINE_ENABLE
+    if(block->condition.index_wait)
+        block->programmed_rate = index_offset; // Holds the spindle index offset in revolutions.
+#endif
+    block->overrides = pl_data->overrides;
+    block->line_number = pl_data->line_number;
+#if JOB_RESUME_ENABLE
+    block->job_block = pl_data->job_block;
+#endif
+    block->direction_bits = block_prev(block)->direction_bits; // Keep direction outputs of the preceding motion.
+    block->millimeters = seconds / 60.0f;
+    block->profile_gen = profile_gen;
+
+    data->output_commands = pl_data->output_commands;
+    data->message = pl_data->message;
+    data->raster = NULL;
+#if SYNCED_STATE_CHANGES_ENABLE
+    memset(&data->end_state, 0, sizeof(plan_state_change_t));
+#endif
+
+    pl_data->message = NULL;
+    pl_data->output_commands = NULL;
+
+    pl.previous_nominal_speed = 0.0f; // Next motion starts from rest.
+#if PLANNER_SEGMENT_MERGE_ENABLE && !defined(KINEMATICS_API)
+    merge.valid = false;
+#endif
+
+    block_buffer_head = next_buffer_head;
+    next_buffer_head = block_next(block_buffer_head);
+    spindle_head = spindle;
+
+    planner_recalculate();
+
+    st_prep_lock(false);
+
+    return true;
+}
+
+#if THREADING_PIPELINE_ENABLE
+
+bool plan_buffer_dwell (float seconds, plan_line_data_t *pl_data)
+{
+    pl_data->condition.index_wait = Off;
+
+    return buffer_dwell(seconds, 0.0f, pl_data);
+}
+
+/*! \brief Add a spindle index wait to the buffer, used for pipelining of spindle synchronized motions.
+The stepper module holds motion at the block until the spindle has passed the index and the offset angle,
+the next motion then starts at a known spindle angle.
+\param offset angle after the index in revolutions, 0 - 1.
+\param pl_data pointer to a \a plan_line_data_t structure with the spindle and coolant state.
+\returns false if the block could not be buffered.
+*/
+bool plan_buffer_index_wait (float offset, plan_line_data_t *pl_data)
+{
+    bool ok;
+
+    pl_data->condition.index_wait = On;
+    ok = buffer_dwell(1.0f, offset - floorf(offset), pl_data);
+    pl_data->condition.index_wait = Off;
+
+    return ok;
+}
+
+#endif
+
+#endif
+
 
 // Get the planner position vectors.
 float *plan_get_position (void)
@@ -614,6 +1211,9 @@ float *plan_get_position (void)
 void plan_sync_position (void)
 {
     memcpy(pl.position, sys.position, sizeof(pl.position));
+#if PLANNER_SEGMENT_MERGE_ENABLE && !defined(KINEMATICS_API)
+    merge.valid = false;
+#endif
 #if ENABLE_BACKLASH_COMPENSATION
     mc_sync_backlash_position();
 #endif
@@ -628,31 +1228,50 @@ uint_fast16_t plan_get_block_buffer_available (void)
                             : ((block_buffer_tail - block_buffer_head) - 1));
 }
 
+#if REPORT_AXIS_VELOCITY
+
+// Returns the distance in mm remaining of the blocks in the planner buffer,
+// the executing block is updated with the distance remaining by the step segment generator.
+float plan_get_lookahead_distance (void)
+{
+    float distance = 0.0f;
+    plan_block_t *block = block_buffer_tail;
+
+    if(block) while(block != block_buffer_head) {
+        distance += block->millimeters;
+        block = block_next(block);
+    }
+
+    return distance;
+}
+
+#endif
+
 
 // Re-initialize buffer plan with a partially completed block, assumed to exist at the buffer tail.
 // Called after a steppers have come to a complete stop for a feed hold and the cycle is stopped.
 void plan_cycle_reinitialize (void)
 {
     // Re-plan from a complete stop. Reset planner entry speeds and buffer planned pointer.
+    st_prep_lock(true);
     st_update_plan_block_parameters();
     block_buffer_planned = block_buffer_tail;
     planner_recalculate();
+    st_prep_lock(false);
 }
 
 // Re-calculates buffered motions profile parameters upon a motion-based override change.
+// Blocks are marked as outdated by bumping the profile generation, each block is then recomputed
+// when next touched by planner_recalculate() instead of walking the whole buffer here.
+// The stepper module computes the nominal speed of the block being executed on each profile update.
 static bool plan_update_velocity_profile_parameters (void)
 {
     if(block_buffer_tail != block_buffer_head) {
 
-        plan_block_t *block = block_buffer_tail;
-        float prev_nominal_speed = SOME_LARGE_VALUE; // Set high for first block nominal speed calculation.
-
-        while (block != block_buffer_head) {
-            prev_nominal_speed = plan_compute_profile_parameters(block, plan_compute_profile_nominal_speed(block), prev_nominal_speed);
-            block = block->next;
-        }
+        profile_gen++;
 
-        pl.previous_nominal_speed = prev_nominal_speed; // Update prev nominal speed for next incoming block.
+        // Update prev nominal speed for next incoming block.
+        pl.previous_nominal_speed = plan_compute_profile_nominal_speed(block_prev(block_buffer_head));
     }
 
     return block_buffer_tail != block_buffer_head;
@@ -684,6 +1303,32 @@ void plan_feed_override (override_t feed_override, override_t rapid_override)
     }
 }
 
+#if CONTINUOUS_JOG_ENABLE
+
+/*! \brief Change the rate of the jog motion being executed, the stepper module accelerates or decelerates to the new rate.
+\param feed_rate new rate in mm/min.
+\returns false if the planner does not hold a single jog motion.
+*/
+bool plan_update_jog_rate (float feed_rate)
+{
+    bool ok;
+    plan_block_t *block;
+
+    st_prep_lock(true);
+
+    if((ok = (block = plan_get_current_block()) && block->condition.jog_motion && block_next(block) == block_buffer_head)) {
+        block->programmed_rate = feed_rate;
+        if(plan_update_velocity_profile_parameters())
+            plan_cycle_reinitialize();
+    }
+
+    st_prep_lock(false);
+
+    return ok;
+}
+
+#endif
+
 void plan_data_init (plan_line_data_t *plan_data)
 {
     memset(plan_data, 0, sizeof(plan_line_data_t));
@@ -693,3 +1338,8 @@ void plan_data_init (plan_line_data_t *plan_data)
     plan_data->rate_multiplier = 1.0;
 #endif
 }
+
+planner_stats_t *plan_get_stats (void)
+{
+    return &stats;
+}
@@ -24,6 +24,14 @@
 #ifndef _PLANNER_H_
 #define _PLANNER_H_
 
+//! Laser raster data, a row of pixels to be output along a linear motion.
+typedef struct {
+    uint_fast16_t length;           // Number of pixels.
+    uint_fast16_t off_pwm;          // PWM value to output after the last pixel.
+    uint32_t pixel_steps;           // Number of step events per pixel, set by the stepper module.
+    uint_fast16_t pwm[];            // Pixel power levels (0-255), converted to PWM values by the stepper module.
+} raster_data_t;
+
 typedef union {
     uint32_t value;
     struct {
@@ -37,25 +45,46 @@ typedef union {
                  is_laser_ppi_mode    :1,
                  target_valid         :1,
                  target_validated     :1,
-                 unassigned           :6;
+                 dwell                :1,
+                 index_wait           :1,
+                 unassigned           :4;
         coolant_state_t coolant;
     };
 } planner_cond_t;
 
+//! Block spindle parameters, shared by consecutive blocks with the same spindle, spindle state and CSS mode.
+typedef struct {
+    spindle_state_t state;
+    spindle_css_data_t *css;        // Data used for Constant Surface Speed Mode calculations.
+    spindle_ptrs_t *hal;
+} plan_spindle_t;
+
+#if SYNCED_STATE_CHANGES_ENABLE
+
+//! Coolant and spindle changes to be performed when a block has been executed.
+typedef struct {
+    bool set_coolant;
+    coolant_state_t coolant;
+    spindle_ptrs_t *spindle_off;    // Spindle to be stopped, NULL if none.
+} plan_state_change_t;
+
+#endif
+
+//! Block data not used by the planner calculations, stored in an array separate from the blocks.
+typedef struct {
+    char *message;                  // Message to be displayed when block is executed.
+    output_command_t *output_commands;
+    raster_data_t *raster;          // Laser raster data to be output when block is executed.
+#if SYNCED_STATE_CHANGES_ENABLE
+    plan_state_change_t end_state;  // Coolant and spindle changes to be performed when block is completed.
+#endif
+} plan_block_data_t;
+
 // This struct stores a linear movement of a g-code block motion with its critical "nominal" values
 // are as specified in the source g-code.
+// NOTE: Fields used by the planner look-ahead passes are placed first, blocks are stored in an array
+//       and neighbouring blocks are found by index arithmetic.
 typedef struct plan_block {
-    // Fields used by the bresenham algorithm for tracing the line
-    // NOTE: Used by stepper algorithm to execute the block correctly. Do not alter these values.
-    uint32_t steps[N_AXIS];         // Step count along each axis
-    uint32_t step_event_count;      // The maximum step axis count and number of steps required to complete this block.
-    axes_signals_t direction_bits;  // The direction bit set for this block (refers to *_DIRECTION_PIN in config.h)
-
-    // Block condition data to ensure correct execution depending on states and overrides.
-    gc_override_flags_t overrides;  // Block bitfield variable for overrides
-    planner_cond_t condition;       // Block bitfield variable defining block run conditions. Copied from pl_line_data.
-    int32_t line_number;            // Block line number for real-time reporting. Copied from pl_line_data.
-
     // Fields used by the motion planner to manage acceleration. Some of these values may be updated
     // by the stepper module during execution of special motion cases for replanning purposes.
     float entry_speed_sqr;          // The current planned entry speed at block junction in (mm/min)^2
@@ -64,20 +93,38 @@ typedef struct plan_block {
     float acceleration;             // Axis-limit adjusted line acceleration in (mm/min^2). Does not change.
     float millimeters;              // The remaining distance for this block to be executed in (mm).
                                     // NOTE: This value may be altered by stepper algorithm during execution.
+                                    //       Holds the remaining dwell time in (min) for dwell blocks.
+    uint32_t profile_gen;           // Override generation the max entry speed was computed for.
 
     // Stored rate limiting data used by planner when changes occur.
     float max_junction_speed_sqr;   // Junction entry speed limit based on direction vectors in (mm/min)^2
     float rapid_rate;               // Axis-limit adjusted maximum rate for this block direction in (mm/min)
     float programmed_rate;          // Programmed rate of this block (mm/min).
+#if ENABLE_JERK_ACCELERATION
+    float jerk;                     // Axis-limit adjusted line jerk in (mm/min^3). Does not change.
+#endif
 #ifdef KINEMATICS_API
     float rate_multiplier;          // Rate multiplier of this block.
 #endif
-    // Stored spindle speed data used by spindle overrides and resuming methods.
-    spindle_t spindle;              // Block spindle parameters. Copied from pl_line_data.
 
-    char *message;                  // Message to be displayed when block is executed.
-    output_command_t *output_commands;
-    struct plan_block *prev, *next; // Linked list pointers, DO NOT MOVE - these MUST be the last elements in the struct!
+    // Block condition data to ensure correct execution depending on states and overrides.
+    planner_cond_t condition;       // Block bitfield variable defining block run conditions. Copied from pl_line_data.
+    gc_override_flags_t overrides;  // Block bitfield variable for overrides
+    axes_signals_t direction_bits;  // The direction bit set for this block (refers to *_DIRECTION_PIN in config.h)
+
+    // Fields used by the bresenham algorithm for tracing the line
+    // NOTE: Used by stepper algorithm to execute the block correctly. Do not alter these values.
+    uint32_t steps[N_AXIS];         // Step count along each axis
+    uint32_t step_event_count;      // The maximum step axis count and number of steps required to complete this block.
+
+    int32_t line_number;            // Block line number for real-time reporting. Copied from pl_line_data.
+#if JOB_RESUME_ENABLE
+    uint32_t job_block;             // File job block number, 0 if not from a file job. Copied from pl_line_data.
+#endif
+
+    // Stored spindle speed data used by spindle overrides and resuming methods.
+    float spindle_rpm;              // Block spindle speed, calculated per block in CSS mode. Copied from pl_line_data.
+    plan_spindle_t *spindle;        // Block spindle parameters, shared with neighbouring blocks. Copied from pl_line_data.
 } plan_block_t;
 
 
@@ -95,9 +142,13 @@ typedef struct {
     planner_cond_t condition;       // Bitfield variable to indicate planner conditions. See defines above.
     gc_override_flags_t overrides;  // Block bitfield variable for overrides
     int32_t line_number;            // Desired line number to report when executing.
+#if JOB_RESUME_ENABLE
+    uint32_t job_block;             // File job block number used for checkpointing, 0 if not from a file job.
+#endif
 //    void *parameters;               // TODO: pointer to extra parameters, for canned cycles and threading?
     char *message;                  // Message to be displayed when block is executed.
     output_command_t *output_commands;
+    raster_data_t *raster;          // Laser raster data to be output when block is executed.
 } plan_line_data_t;
 
 
@@ -110,6 +161,23 @@ typedef struct {
   float previous_nominal_speed;     // Nominal speed of previous path line segment
 } planner_t;
 
+// Planner statistics, collected for diagnostics.
+typedef struct {
+    uint32_t recalc_count;          // Number of plan recalculations performed
+    uint32_t recalc_truncated;      // Number of reverse passes stopped by PLANNER_RECALC_MAX_BLOCKS
+    uint32_t recalc_max_blocks;     // Maximum number of blocks visited by a reverse pass
+    uint32_t recalc_max_us;         // Worst case recalculation time in microseconds, requires hal.get_micros
+#if PLANNER_DIRECTION_CACHE_SIZE
+    uint32_t direction_hits;        // Direction cache hits
+    uint32_t direction_misses;      // Direction cache misses
+    uint32_t junction_hits;         // Junction cache hits
+    uint32_t junction_misses;       // Junction cache misses
+#endif
+#if PLANNER_SEGMENT_MERGE_ENABLE
+    uint32_t segments_merged;       // Number of segments merged into the previous block
+#endif
+} planner_stats_t;
+
 // Initialize and reset the motion plan subsystem
 bool plan_reset (void); // Reset all
 
@@ -120,6 +188,14 @@ uint_fast16_t plan_get_buffer_size (void);
 // rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
 bool plan_buffer_line (float *target, plan_line_data_t *pl_data);
 
+#if PLANNER_DWELL_ENABLE
+// Add a dwell to the buffer, executed by the stepper module as a timed stop.
+bool plan_buffer_dwell (float seconds, plan_line_data_t *pl_data);
+#if THREADING_PIPELINE_ENABLE
+bool plan_buffer_index_wait (float offset, plan_line_data_t *pl_data);
+#endif
+#endif
+
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // available for new blocks.
 void plan_discard_current_block (void);
@@ -130,6 +206,14 @@ plan_block_t *plan_get_system_motion_block (void);
 // Gets the current block. Returns NULL if buffer empty
 plan_block_t *plan_get_current_block (void);
 
+// Gets the message, output commands and raster data of a block.
+plan_block_data_t *plan_get_block_data (plan_block_t *block);
+
+#if SYNCED_STATE_CHANGES_ENABLE
+// Adds state changes to be performed when the last block in the buffer is completed.
+bool plan_add_state_change (plan_state_change_t *change);
+#endif
+
 // Called by step segment buffer when computing executing block velocity profile.
 float plan_get_exec_block_exit_speed_sqr (void);
 
@@ -148,11 +232,25 @@ void plan_cycle_reinitialize (void);
 // Returns the number of available blocks in the planner buffer.
 uint_fast16_t plan_get_block_buffer_available (void);
 
+#if REPORT_AXIS_VELOCITY
+// Returns the distance remaining of the blocks in the planner buffer.
+float plan_get_lookahead_distance (void);
+#endif
+
 // Returns the status of the block ring buffer. True, if buffer is full.
 bool plan_check_full_buffer (void);
 
 void plan_feed_override (override_t feed_override, override_t rapid_override);
+#if CONTINUOUS_JOG_ENABLE
+bool plan_update_jog_rate (float feed_rate);
+#endif
 
 void plan_data_init (plan_line_data_t *plan_data);
 
+// Returns pointer to the planner statistics.
+planner_stats_t *plan_get_stats (void);
+
+// Invalidates planner direction and junction caches, called on settings changes.
+void plan_cache_invalidate (void);
+
 #endif
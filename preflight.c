@@ -0,0 +1,363 @@
+/*
+  preflight.c - fast check mode validation of files
+
+  Reads a file directly from the VFS and runs it through the g-code parser in check mode
+  at full speed, without stream I/O or planner pacing.
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "hal.h"
+
+#if PREFLIGHT_ENABLE
+
+#include "preflight.h"
+#include "vfs.h"
+#include "protocol.h"
+#include "state_machine.h"
+#include "report.h"
+#include "planner.h"
+#if PROGRAM_CACHE_ENABLE
+#include "program_cache.h"
+#endif
+
+#ifndef PREFLIGHT_READ_SIZE
+#define PREFLIGHT_READ_SIZE 128 // Number of bytes read from the file between calls to protocol_execute_realtime().
+#endif
+
+#ifndef PREFLIGHT_PROGRESS_POINTS
+#define PREFLIGHT_PROGRESS_POINTS 128 // Number of file offset/run time points kept for time remaining reporting, must be even.
+#endif
+
+typedef struct {
+    uint32_t size;      // Size of validated file, 0 if none.
+    uint32_t lines;
+    uint32_t stride;    // Number of lines between points.
+    uint_fast16_t points;
+    float total;        // Estimated run time in seconds.
+    struct {
+        uint32_t offset;
+        float time;
+    } point[PREFLIGHT_PROGRESS_POINTS];
+} preflight_progress_t;
+
+static bool active = false, limit_error;
+static preflight_summary_t *pf;
+static preflight_progress_t progress = {0};
+static on_realtime_report_ptr on_realtime_report = NULL;
+
+//! Returns true while a file is being validated.
+bool preflight_active (void)
+{
+    return active;
+}
+
+// Returns execution time in seconds of the oldest block in the planner buffer and discards it.
+static float block_time (void)
+{
+    float time, v_peak, d_accel, d_decel;
+    plan_block_t *block = plan_get_current_block();
+    float v_entry = sqrtf(block->entry_speed_sqr), v_exit_sqr = plan_get_exec_block_exit_speed_sqr(), v_exit = sqrtf(v_exit_sqr);
+    float v_nominal = plan_compute_profile_nominal_speed(block), accel = block->acceleration;
+
+    d_accel = (v_nominal * v_nominal - block->entry_speed_sqr) / (2.0f * accel);
+    d_decel = (v_nominal * v_nominal - v_exit_sqr) / (2.0f * accel);
+
+    if(d_accel + d_decel <= block->millimeters) // Trapezoid
+        time = (v_nominal - v_entry + v_nominal - v_exit) / accel + (block->millimeters - d_accel - d_decel) / v_nominal;
+    else { // Triangle
+        v_peak = sqrtf((2.0f * accel * block->millimeters + block->entry_speed_sqr + v_exit_sqr) * 0.5f);
+        time = (v_peak - v_entry + v_peak - v_exit) / accel;
+    }
+
+    plan_discard_current_block();
+
+    return time * 60.0f;
+}
+
+// Adds the blocks in the planner buffer to the run time estimate, the last block decelerates to a stop.
+static void planner_drain (void)
+{
+    while(plan_get_current_block())
+        pf->run_time += block_time();
+}
+
+/*! \brief Called by mc_line() for all motions while a file is being validated.
+Checks soft limits, updates the bounding box and adds the motion to the run time estimate.
+The motion is buffered in the planner, blocks are removed from the buffer when it is full and their
+execution time calculated from the planned trapezoidal velocity profile.
+\param target pointer to float array with target position in machine coordinates.
+\param pl_data pointer to \a plan_line_data_t structure.
+*/
+void preflight_line (float *target, plan_line_data_t *pl_data)
+{
+    uint_fast8_t idx = N_AXIS;
+
+    if(sys.soft_limits.mask && !(pl_data->condition.target_validated ? pl_data->condition.target_valid : grbl.check_travel_limits(target, sys.soft_limits, true)))
+        limit_error = true;
+
+    do {
+        idx--;
+        pf->min[idx] = min(pf->min[idx], target[idx]);
+        pf->max[idx] = max(pf->max[idx], target[idx]);
+    } while(idx);
+
+#if PROGRAM_CACHE_ENABLE
+    program_cache_line(target, pl_data);
+#endif
+
+    if(plan_check_full_buffer())
+        pf->run_time += block_time();
+
+    plan_buffer_line(target, pl_data);
+}
+
+//! Called by mc_dwell() while a file is being validated, adds the dwell time to the run time estimate.
+void preflight_dwell (float seconds)
+{
+#if PROGRAM_CACHE_ENABLE
+    program_cache_dwell(seconds);
+#endif
+
+    planner_drain();
+    pf->run_time += seconds;
+}
+
+//! Called by protocol_buffer_synchronize() while a file is being validated, motion comes to a stop.
+void preflight_synchronize (void)
+{
+    planner_drain();
+}
+
+// Records estimated run time at a file offset for time remaining reporting.
+static void progress_add (uint32_t offset)
+{
+    uint_fast16_t idx;
+
+    if(++progress.lines % progress.stride)
+        return;
+
+    if(progress.points == PREFLIGHT_PROGRESS_POINTS) { // Table full, drop every other point and double the stride.
+        for(idx = 0; idx < PREFLIGHT_PROGRESS_POINTS / 2; idx++)
+            progress.point[idx] = progress.point[idx * 2 + 1];
+        progress.points = PREFLIGHT_PROGRESS_POINTS / 2;
+        progress.stride <<= 1;
+    }
+
+    progress.point[progress.points].offset = offset;
+    progress.point[progress.points++].time = pf->run_time;
+}
+
+// Returns estimated run time to reach a file offset.
+static float progress_time (uint32_t offset)
+{
+    uint_fast16_t idx = 0;
+    uint32_t offset0 = 0;
+    float time0 = 0.0f;
+
+    while(idx < progress.points && progress.point[idx].offset < offset) {
+        offset0 = progress.point[idx].offset;
+        time0 = progress.point[idx++].time;
+    }
+
+    if(idx == progress.points)
+        return idx ? time0 + (progress.total - time0) * (float)(offset - offset0) / (float)max(1, progress.size - offset0) : 0.0f;
+
+    return time0 + (progress.point[idx].time - time0) * (float)(offset - offset0) / (float)max(1, progress.point[idx].offset - offset0);
+}
+
+// Adds estimated time remaining to the real time report when running the validated file.
+static void report_time_remaining (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+    if(hal.stream.file && progress.size && hal.stream.file->size == progress.size) {
+
+        float remaining = progress.total - progress_time(vfs_tell(hal.stream.file));
+
+        stream_write("|ETR:");
+        stream_write(uitoa((uint32_t)(remaining > 0.0f ? remaining : 0.0f)));
+    }
+
+    if(on_realtime_report)
+        on_realtime_report(stream_write, report);
+}
+
+static status_code_t execute_line (char *line, uint_fast16_t length)
+{
+    status_code_t status = Status_OK;
+
+    line[length] = '\0';
+
+    if(length && *line != '$' && *line != '%' && (status = gc_execute_block(line)) == Status_OK && limit_error)
+        status = Status_SoftLimitError;
+
+    return status;
+}
+
+/*! \brief Validate a file by running it through the g-code parser in check mode.
+Soft limits are checked for all motions, the first error stops validation.
+Run time is estimated by buffering all motions in the planner and integrating the planned
+trapezoidal velocity profiles, at the current override values. After successful validation the
+estimated time remaining is added to the real time report as `|ETR:<seconds>` when the file is run.
+Parser state is restored on completion.
+__NOTE:__ requires idle state. Lines starting with $ are skipped. NGC flow control
+statements that loop or call subroutines by seeking in the streamed file are not supported.
+\param filename path to the file.
+\param summary pointer to a \a preflight_summary_t structure to receive the result.
+\returns status code of the first error, or Status_OK.
+*/
+status_code_t preflight_file (const char *filename, preflight_summary_t *summary)
+{
+    char c, prev = '\0', line[LINE_BUFFER_SIZE], buf[PREFLIGHT_READ_SIZE];
+    size_t n, pos;
+    uint32_t offset = 0;
+    uint_fast16_t length = 0;
+    vfs_file_t *file;
+    parser_state_t parser_state;
+    status_code_t status = Status_OK;
+    uint32_t started = hal.get_elapsed_ticks();
+
+    if(state_get() != STATE_IDLE)
+        return Status_IdleError;
+
+    if((file = vfs_open(filename, "r")) == NULL)
+        return Status_SDFailedOpenDir;
+
+    memset(summary, 0, sizeof(preflight_summary_t));
+    memcpy(&parser_state, &gc_state, sizeof(parser_state_t));
+    system_convert_array_steps_to_mpos(summary->min, sys.position);
+    memcpy(summary->max, summary->min, sizeof(summary->max));
+
+    progress.size = progress.lines = progress.points = 0;
+    progress.stride = 1;
+
+    if(!on_realtime_report) {
+        on_realtime_report = grbl.on_realtime_report;
+        grbl.on_realtime_report = report_time_remaining;
+    }
+
+    plan_sync_position();
+
+    pf = summary;
+    active = true;
+    limit_error = false;
+    state_set(STATE_CHECK_MODE);
+
+    while(status == Status_OK && (n = vfs_read(buf, 1, sizeof(buf), file))) {
+
+        for(pos = 0; pos < n && status == Status_OK; pos++) {
+            offset++;
+            if((c = buf[pos]) == '\n' || c == '\r') {
+                // A lone CR or LF ends a line, the LF of a CRLF pair is skipped.
+                if(!(c == '\n' && prev == '\r') && (status = execute_line(line, length)) == Status_OK) {
+                    summary->lines++;
+                    progress_add(offset);
+                }
+                length = 0;
+            } else if(length < LINE_BUFFER_SIZE - 1)
+                line[length++] = c;
+            else
+                status = Status_LineLengthExceeded;
+            prev = c;
+        }
+
+        if(status == Status_OK && !protocol_execute_realtime())
+            status = Status_Reset;
+    }
+
+    // Last line may not be terminated.
+    if(status == Status_OK && length && (status = execute_line(line, length)) == Status_OK)
+        summary->lines++;
+
+    if(status == Status_OK) {
+        planner_drain();
+        progress.size = file->size;
+        progress.total = summary->run_time;
+#if PROGRAM_CACHE_ENABLE
+        program_cache_end();
+#endif
+    } else while(plan_get_current_block())
+        plan_discard_current_block();
+
+    vfs_close(file);
+
+    active = false;
+    if(state_get() == STATE_CHECK_MODE)
+        state_set(STATE_IDLE);
+    memcpy(&gc_state, &parser_state, sizeof(parser_state_t));
+    plan_sync_position();
+
+    if(status != Status_OK) {
+        summary->error = status;
+        summary->error_line = summary->lines + 1;
+    }
+    summary->elapsed = hal.get_elapsed_ticks() - started;
+
+    return status;
+}
+
+static void report_axis_values (const char *prefix, float *values)
+{
+    uint_fast8_t idx;
+
+    hal.stream.write(prefix);
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(idx)
+            hal.stream.write(",");
+        hal.stream.write(ftoa(values[idx], N_DECIMAL_COORDVALUE_MM));
+    }
+    hal.stream.write("]" ASCII_EOL);
+}
+
+/*! \brief $PRE=<filename> command handler, validates a file and outputs a summary.
+[PRE:<lines>,<elapsed ms>,<estimated run time s>], [PREMIN:<axis values>], [PREMAX:<axis values>]
+and, if an error was found, [PREERR:<line>,<status code>].
+*/
+status_code_t preflight_command (sys_state_t state, char *args)
+{
+    status_code_t status;
+    preflight_summary_t summary;
+
+    if(args == NULL)
+        return Status_InvalidStatement;
+
+    if((status = preflight_file(args, &summary)) == Status_IdleError || status == Status_SDFailedOpenDir)
+        return status;
+
+    hal.stream.write("[PRE:");
+    hal.stream.write(uitoa(summary.lines));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(summary.elapsed));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(summary.run_time, 1));
+    hal.stream.write("]" ASCII_EOL);
+    report_axis_values("[PREMIN:", summary.min);
+    report_axis_values("[PREMAX:", summary.max);
+
+    if(summary.error_line) {
+        hal.stream.write("[PREERR:");
+        hal.stream.write(uitoa(summary.error_line));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(summary.error));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    return Status_OK;
+}
+
+#endif // PREFLIGHT_ENABLE
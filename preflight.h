@@ -0,0 +1,47 @@
+/*
+  preflight.h - fast check mode validation of files
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PREFLIGHT_H_
+#define _PREFLIGHT_H_
+
+#include "hal.h"
+
+#if PREFLIGHT_ENABLE
+
+//! Preflight summary.
+typedef struct {
+    uint32_t lines;             //!< Number of lines read.
+    uint32_t elapsed;           //!< Time spent in ms.
+    float run_time;             //!< Estimated run time in seconds.
+    float min[N_AXIS];          //!< Bounding box of all motions, machine coordinates.
+    float max[N_AXIS];          //!< Bounding box of all motions, machine coordinates.
+    uint32_t error_line;        //!< Line number of first error, 0 if none.
+    status_code_t error;        //!< Status code of first error.
+} preflight_summary_t;
+
+bool preflight_active (void);
+void preflight_line (float *target, plan_line_data_t *pl_data);
+void preflight_dwell (float seconds);
+void preflight_synchronize (void);
+status_code_t preflight_file (const char *filename, preflight_summary_t *summary);
+status_code_t preflight_command (sys_state_t state, char *args);
+
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+/*
+  probe_scan.c - continuous digitising probe mode with position logging
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// When started the probe state, an optional analog probe value and the machine position are sampled
+// at a fixed rate in interrupt context while motion is executing, the samples are logged to a ring
+// buffer for streaming out with $SCAN or writing to a file with $SCANW.
+// Drivers with a spare timer may call probe_scan_sample() from its interrupt at the rate set by
+// probe_scan_use_timer(), sampling is otherwise done from the stepper interrupt by elapsed time.
+//
+
+#include <string.h>
+
+#include "hal.h"
+
+#if PROBE_SCAN_LOG_SIZE
+
+#if PROBE_SCAN_LOG_SIZE & (PROBE_SCAN_LOG_SIZE - 1)
+#error "PROBE_SCAN_LOG_SIZE must be a power of 2!"
+#endif
+
+#include "probe_scan.h"
+#include "state_machine.h"
+#include "vfs.h"
+
+// Single producer (interrupt), single consumer (foreground) ring buffer.
+static struct {
+    volatile bool active;
+    volatile uint_fast16_t head;    // Written by the sampling interrupt only.
+    volatile uint_fast16_t tail;    // Written by the foreground only.
+    uint32_t timer_rate;            // Rate of driver timer calling probe_scan_sample(), 0 if none.
+    uint32_t divider;               // Timer interrupts per sample.
+    uint32_t count;
+    uint32_t interval;              // Microseconds between samples when sampling from the stepper interrupt.
+    uint32_t next;                  // Time of next sample, compared wrap-safe as the microsecond counter rolls over.
+    probe_scan_analog_ptr analog;
+    stepper_interrupt_callback_ptr interrupt_callback;
+    probe_scan_stats_t stats;
+    probe_scan_sample_t sample[PROBE_SCAN_LOG_SIZE];
+} scan = {0};
+
+static inline void log_sample (uint32_t now)
+{
+    uint_fast16_t head = scan.head, next = (head + 1) & (PROBE_SCAN_LOG_SIZE - 1);
+
+    if(next == scan.tail)
+        scan.stats.overruns++;
+    else {
+        probe_scan_sample_t *sample = &scan.sample[head];
+        memcpy(sample->position, (void *)sys.position, sizeof(sample->position));
+        sample->time = now;
+        sample->triggered = hal.probe.get_state && hal.probe.get_state().triggered;
+        sample->analog = scan.analog ? scan.analog() : 0;
+        scan.head = next;
+        scan.stats.samples++;
+    }
+}
+
+/*! \brief Take a sample if started and motion is executing, to be called by the driver from a timer interrupt.
+Must be called at the rate set by probe_scan_use_timer().
+*/
+void ISR_FUNC(probe_scan_sample)(void)
+{
+    if(scan.active && (state_get() & (STATE_CYCLE|STATE_JOG)) && ++scan.count >= scan.divider) {
+        scan.count = 0;
+        log_sample(hal.get_micros ? (uint32_t)hal.get_micros() : 0);
+    }
+}
+
+// Samples by elapsed time from the stepper interrupt, the sample rate is limited by the step timer rate.
+static void ISR_FUNC(stepper_interrupt_handler)(void)
+{
+    scan.interrupt_callback();
+
+    if(scan.active && scan.timer_rate == 0) {
+        uint32_t now = (uint32_t)hal.get_micros();
+        if((int32_t)(now - scan.next) >= 0) {
+            scan.next += scan.interval;
+            if((int32_t)(scan.next - now) <= 0)
+                scan.next = now + scan.interval;
+            log_sample(now);
+        }
+    }
+}
+
+//! Set by the driver if it calls probe_scan_sample() from a timer interrupt at a fixed rate.
+void probe_scan_use_timer (uint32_t rate)
+{
+    scan.timer_rate = rate;
+}
+
+//! Set a function for reading an analog probe value, the function is called from interrupt context.
+void probe_scan_set_analog (probe_scan_analog_ptr fn)
+{
+    scan.analog = fn;
+}
+
+/*! \brief Start sampling, logged samples are discarded.
+\param rate sample rate in Hz, the actual rate is limited by the timer or step rate.
+\returns \a true if started, \a false if no time base is available.
+*/
+bool probe_scan_start (uint32_t rate)
+{
+    if(rate == 0 || !(scan.timer_rate || (hal.get_micros && scan.interrupt_callback)))
+        return false;
+
+    scan.active = false;
+    probe_scan_reset();
+
+    scan.stats.rate = rate;
+    scan.count = 0;
+    scan.divider = scan.timer_rate ? max(scan.timer_rate / rate, 1) : 1;
+    scan.interval = max(1000000UL / rate, 1);
+    scan.next = hal.get_micros ? (uint32_t)hal.get_micros() : 0;
+    scan.active = true;
+
+    return true;
+}
+
+//! Stop sampling, logged samples are kept.
+void probe_scan_stop (void)
+{
+    scan.active = false;
+    scan.stats.rate = 0;
+}
+
+/*! \brief Read logged samples, must be called from the foreground process.
+\param samples pointer to array to receive the samples.
+\param max_samples maximum number of samples to read.
+\returns number of samples read.
+*/
+uint_fast16_t probe_scan_read (probe_scan_sample_t *samples, uint_fast16_t max_samples)
+{
+    uint_fast16_t count = 0, tail = scan.tail, head = scan.head;
+
+    while(tail != head && count < max_samples) {
+        samples[count++] = scan.sample[tail];
+        tail = (tail + 1) & (PROBE_SCAN_LOG_SIZE - 1);
+    }
+
+    scan.tail = tail;
+
+    return count;
+}
+
+//! Discard logged samples and clear statistics.
+void probe_scan_reset (void)
+{
+    scan.tail = scan.head;
+    scan.stats.samples = scan.stats.overruns = 0;
+}
+
+//! Returns pointer to log statistics.
+probe_scan_stats_t *probe_scan_get_stats (void)
+{
+    return &scan.stats;
+}
+
+/*! \brief Write logged samples to a file as comma separated values, samples written are removed from the log.
+Each line contains time in microseconds, machine position in mm, probe state and analog value.
+\param filename pointer to the file name, the file is appended to if it exists.
+\returns \a Status_OK if successful, an error code if not.
+*/
+status_code_t probe_scan_write_file (const char *filename)
+{
+    char line[16 * (N_AXIS + 3)];
+    uint_fast8_t idx;
+    float position[N_AXIS];
+    vfs_file_t *file;
+    probe_scan_sample_t *sample;
+    status_code_t status = Status_OK;
+
+    if((file = vfs_open(filename, "a")) == NULL)
+        return Status_SDMountError;
+
+    // Samples are peeked and only removed from the log when written.
+    while(status == Status_OK && scan.tail != scan.head) {
+        sample = &scan.sample[scan.tail];
+        system_convert_array_steps_to_mpos(position, sample->position);
+        strcpy(line, uitoa(sample->time));
+        for(idx = 0; idx < N_AXIS; idx++) {
+            strcat(line, ",");
+            strcat(line, ftoa(position[idx], N_DECIMAL_COORDVALUE_MM));
+        }
+        strcat(line, sample->triggered ? ",1," : ",0,");
+        strcat(line, uitoa(sample->analog));
+        strcat(line, "\n");
+        if(vfs_puts(line, file) < 0)
+            status = Status_SDWriteError;
+        else
+            scan.tail = (scan.tail + 1) & (PROBE_SCAN_LOG_SIZE - 1);
+    }
+
+    vfs_close(file);
+
+    return status;
+}
+
+//! Hooks sampling into the stepper interrupt, to be called after the driver is initialized.
+void probe_scan_init (void)
+{
+    if(scan.timer_rate == 0 && hal.get_micros && scan.interrupt_callback == NULL) {
+        scan.interrupt_callback = hal.stepper.interrupt_callback;
+        hal.stepper.interrupt_callback = stepper_interrupt_handler;
+    }
+}
+
+#endif // PROBE_SCAN_LOG_SIZE
@@ -0,0 +1,56 @@
+/*
+  probe_scan.h - continuous digitising probe mode with position logging
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PROBE_SCAN_H_
+#define _PROBE_SCAN_H_
+
+#include "hal.h"
+
+#if PROBE_SCAN_LOG_SIZE
+
+//! Pointer to function for reading an analog probe value, called from interrupt context.
+typedef uint32_t (*probe_scan_analog_ptr)(void);
+
+typedef struct {
+    uint32_t time;                  //!< Time in microseconds, 0 if hal.get_micros is not available.
+    int32_t position[N_AXIS];       //!< Machine position in steps.
+    uint32_t analog;                //!< Analog probe value, 0 if no analog source is set.
+    bool triggered;                 //!< Probe input state.
+} probe_scan_sample_t;
+
+typedef struct {
+    uint32_t rate;                  //!< Requested sample rate in Hz, 0 when stopped.
+    uint32_t samples;               //!< Number of samples logged.
+    uint32_t overruns;              //!< Number of samples dropped due to ring buffer full.
+} probe_scan_stats_t;
+
+void probe_scan_init (void);
+void probe_scan_use_timer (uint32_t rate);
+void probe_scan_set_analog (probe_scan_analog_ptr fn);
+void probe_scan_sample (void);
+bool probe_scan_start (uint32_t rate);
+void probe_scan_stop (void);
+uint_fast16_t probe_scan_read (probe_scan_sample_t *samples, uint_fast16_t max_samples);
+void probe_scan_reset (void);
+probe_scan_stats_t *probe_scan_get_stats (void);
+status_code_t probe_scan_write_file (const char *filename);
+
+#endif
+
+#endif
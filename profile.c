@@ -0,0 +1,222 @@
+/*
+  profile.c - hot path execution time profiling
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#if PROFILING_ENABLE
+
+#include <string.h>
+
+#include "profile.h"
+#include "state_machine.h"
+
+static const char *const names[Profile_N] = {
+    "protocol_execute_realtime",
+    "st_prep_buffer",
+    "plan_buffer_line",
+    "planner_recalculate",
+    "gc_execute_block",
+    "report_realtime_status",
+    "stepper_driver_interrupt_handler"
+};
+
+static profile_data_t data[Profile_N] = {0};
+
+static void record (profile_data_t *entry, uint32_t elapsed)
+{
+    if(entry->count == 0 || elapsed < entry->min)
+        entry->min = elapsed;
+    if(elapsed > entry->max)
+        entry->max = elapsed;
+
+    entry->total += elapsed;
+    entry->count++;
+}
+
+// NOTE: may be called from interrupt context, each function is only profiled from one context.
+void profile_record (profile_id_t id, uint32_t elapsed)
+{
+    record(&data[id], elapsed);
+}
+
+void profile_reset (void)
+{
+    memset(data, 0, sizeof(data));
+}
+
+profile_data_t *profile_get_data (profile_id_t id)
+{
+    return id < Profile_N ? &data[id] : NULL;
+}
+
+const char *profile_get_name (profile_id_t id)
+{
+    return id < Profile_N ? names[id] : NULL;
+}
+
+// Realtime command latency tracking
+
+static const char *const latency_names[Latency_N] = {
+    "feed hold",
+    "reset",
+    "stop",
+    "cycle start",
+    "safety door",
+    "jog cancel",
+    "status report"
+};
+
+static const rt_exec_t latency_flags[Latency_N] = {
+    EXEC_FEED_HOLD,
+    EXEC_RESET,
+    EXEC_STOP,
+    EXEC_CYCLE_START,
+    EXEC_SAFETY_DOOR,
+    EXEC_MOTION_CANCEL,
+    EXEC_STATUS_REPORT
+};
+
+static struct {
+    volatile rt_exec_t pending;     // Flags of commands received and not yet handled.
+    volatile rt_exec_t flagged;     // Flags of pending commands with the flag set stage recorded.
+    latency_id_t received;          // Command received by the current call of protocol_enqueue_realtime_command().
+    uint32_t timestamp[Latency_N];  // Time of receipt.
+    latency_data_t data[Latency_N];
+} latency = { .received = Latency_N };
+
+static inline void latency_record (profile_data_t *entry, latency_id_t id)
+{
+    record(entry, PROFILE_TIMESTAMP() - latency.timestamp[id]);
+}
+
+//! Called from protocol_enqueue_realtime_command() on entry.
+void latency_received (char c)
+{
+    latency_id_t id;
+
+    switch((unsigned char)c) {
+        case CMD_FEED_HOLD:
+        case CMD_FEED_HOLD_LEGACY:
+            id = Latency_FeedHold;
+            break;
+        case CMD_RESET:
+            id = Latency_Reset;
+            break;
+        case CMD_STOP:
+            id = Latency_Stop;
+            break;
+        case CMD_CYCLE_START:
+        case CMD_CYCLE_START_LEGACY:
+            id = Latency_CycleStart;
+            break;
+        case CMD_SAFETY_DOOR:
+            id = Latency_SafetyDoor;
+            break;
+        case CMD_JOG_CANCEL:
+            id = state_get() == STATE_JOG ? Latency_JogCancel : Latency_N;
+            break;
+        case CMD_STATUS_REPORT:
+        case CMD_STATUS_REPORT_ALL:
+        case CMD_STATUS_REPORT_LEGACY:
+        case 0x05:
+            id = Latency_StatusReport;
+            break;
+        default:
+            id = Latency_N;
+            break;
+    }
+
+    // Repeated commands are timed from the first one if its flag has not yet been read.
+    if((latency.received = id) != Latency_N && PROFILE_AVAILABLE() && !(sys.rt_exec_state & latency_flags[id])) {
+        latency.timestamp[id] = PROFILE_TIMESTAMP();
+        latency.pending |= latency_flags[id];
+        latency.flagged &= ~latency_flags[id];
+    }
+}
+
+//! Called from protocol_enqueue_realtime_command() on exit.
+void latency_flagged (void)
+{
+    latency_id_t id = latency.received;
+
+    if(id != Latency_N && (latency.pending & latency_flags[id]) && !(latency.flagged & latency_flags[id])) {
+        if(sys.rt_exec_state & latency_flags[id]) {
+            latency_record(&latency.data[id].flagged, id);
+            latency.flagged |= latency_flags[id];
+        } else if(id != Latency_JogCancel) // Command ignored, jog cancel is flagged later by the foreground process.
+            latency.pending &= ~latency_flags[id];
+    }
+
+    latency.received = Latency_N;
+}
+
+//! Called by protocol_exec_rt_system() when the flags have been read.
+void latency_picked_up (rt_exec_t rt_exec)
+{
+    latency_id_t id;
+
+    hal.irq_disable(); // The pending and flagged bits are updated from interrupt context as well.
+
+    if((rt_exec &= latency.pending)) for(id = (latency_id_t)0; id < Latency_N; id++) {
+        if(rt_exec & latency_flags[id]) {
+            if(!(latency.flagged & latency_flags[id]))
+                latency_record(&latency.data[id].flagged, id);
+            latency_record(&latency.data[id].picked_up, id);
+            latency.flagged |= latency_flags[id];
+        }
+    }
+
+    hal.irq_enable();
+}
+
+//! Called by protocol_exec_rt_system() when the commands have been handled.
+void latency_handled (rt_exec_t rt_exec)
+{
+    latency_id_t id;
+
+    hal.irq_disable();
+
+    if((rt_exec &= latency.pending & latency.flagged)) {
+        for(id = (latency_id_t)0; id < Latency_N; id++) {
+            if(rt_exec & latency_flags[id])
+                latency_record(&latency.data[id].handled, id);
+        }
+        latency.flagged &= ~rt_exec;
+        latency.pending &= ~rt_exec;
+    }
+
+    hal.irq_enable();
+}
+
+void latency_reset (void)
+{
+    memset(latency.data, 0, sizeof(latency.data));
+}
+
+latency_data_t *latency_get_data (latency_id_t id)
+{
+    return id < Latency_N ? &latency.data[id] : NULL;
+}
+
+const char *latency_get_name (latency_id_t id)
+{
+    return id < Latency_N ? latency_names[id] : NULL;
+}
+
+#endif // PROFILING_ENABLE
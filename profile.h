@@ -0,0 +1,99 @@
+/*
+  profile.h - hot path execution time profiling
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include "hal.h"
+
+#if PROFILING_ENABLE
+
+typedef enum {
+    Profile_ProtocolExecuteRealtime = 0,
+    Profile_StPrepBuffer,
+    Profile_PlanBufferLine,
+    Profile_PlannerRecalculate,
+    Profile_GcExecuteBlock,
+    Profile_ReportRealtimeStatus,
+    Profile_StepperInterrupt,
+    Profile_N //!< Number of profiled functions, must be last.
+} profile_id_t;
+
+typedef struct {
+    uint32_t count;     //!< Number of calls.
+    uint32_t min;       //!< Shortest execution time.
+    uint32_t max;       //!< Longest execution time.
+    uint64_t total;     //!< Accumulated execution time, used for calculating the average.
+} profile_data_t;
+
+// Drivers may define PROFILE_TIMESTAMP() to read a cycle counter, e.g. DWT->CYCCNT on Cortex-M.
+// If not defined hal.get_micros() is used, profiling is then disabled if not provided by the driver.
+#ifdef PROFILE_TIMESTAMP
+#define PROFILE_AVAILABLE() true
+#else
+#define PROFILE_TIMESTAMP() ((uint32_t)hal.get_micros())
+#define PROFILE_AVAILABLE() (hal.get_micros != NULL)
+#endif
+
+void profile_record (profile_id_t id, uint32_t elapsed);
+void profile_reset (void);
+profile_data_t *profile_get_data (profile_id_t id);
+const char *profile_get_name (profile_id_t id);
+
+//! Realtime commands tracked for latency.
+typedef enum {
+    Latency_FeedHold = 0,
+    Latency_Reset,
+    Latency_Stop,
+    Latency_CycleStart,
+    Latency_SafetyDoor,
+    Latency_JogCancel,
+    Latency_StatusReport,
+    Latency_N //!< Number of tracked commands, must be last.
+} latency_id_t;
+
+//! Latencies from receipt of a realtime command character, times are in the same unit as for profiling.
+typedef struct {
+    profile_data_t flagged;     //!< Receipt to flag set in sys.rt_exec_state.
+    profile_data_t picked_up;   //!< Receipt to flag read by protocol_exec_rt_system().
+    profile_data_t handled;     //!< Receipt to command handled, for feed hold this is when deceleration starts.
+} latency_data_t;
+
+void latency_received (char c);
+void latency_flagged (void);
+void latency_picked_up (rt_exec_t rt_exec);
+void latency_handled (rt_exec_t rt_exec);
+void latency_reset (void);
+latency_data_t *latency_get_data (latency_id_t id);
+const char *latency_get_name (latency_id_t id);
+
+static inline uint32_t profile_start (void)
+{
+    return PROFILE_AVAILABLE() ? PROFILE_TIMESTAMP() : 0;
+}
+
+static inline void profile_end (profile_id_t id, uint32_t start)
+{
+    if(PROFILE_AVAILABLE())
+        profile_record(id, PROFILE_TIMESTAMP() - start);
+}
+
+#endif // PROFILING_ENABLE
+
+#endif // _PROFILE_H_
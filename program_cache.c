@@ -0,0 +1,559 @@
+/*
+  program_cache.c - recording and replay of parsed programs
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// The program is recorded while it is validated by the preflight module: motions passed to mc_line(), dwells and
+// spindle and coolant changes are written to the cache file as records. Line records only contain the target
+// coordinates and planner data that changed from the previous record. On replay the records are fed directly to
+// mc_line(), mc_dwell(), spindle_sync() and coolant_sync() and the parser state at the end of the program is restored.
+// Programs using commands that depend on the machine at run time, such as probing, tool changes, program pauses,
+// user M-codes, I/O commands and persistent offset changes, are not cached.
+// The cache is only valid until restart and for the machine state it was recorded at: position, modal state,
+// coordinate systems and offsets must match when replayed and any setting change invalidates it.
+//
+
+#include <string.h>
+
+#include "hal.h"
+
+#if PROGRAM_CACHE_ENABLE
+
+#if !PREFLIGHT_ENABLE
+#error "Program cache requires PREFLIGHT_ENABLE!"
+#endif
+
+#include "program_cache.h"
+#include "preflight.h"
+#include "vfs.h"
+#include "protocol.h"
+#include "motion_control.h"
+#include "state_machine.h"
+#include "report.h"
+
+#ifndef PROGRAM_CACHE_FILE
+#define PROGRAM_CACHE_FILE "/program.pgc"
+#endif
+#ifndef PROGRAM_CACHE_BUFFER_SIZE
+#define PROGRAM_CACHE_BUFFER_SIZE 256   // Size of the file read and write buffer.
+#endif
+#ifndef PROGRAM_CACHE_NAME_LENGTH
+#define PROGRAM_CACHE_NAME_LENGTH 64    // Maximum length of the cached program path.
+#endif
+
+typedef enum {
+    Record_Line = 0,
+    Record_Dwell,
+    Record_Spindle,
+    Record_Coolant,
+    Record_Completed,
+    Record_End
+} record_type_t;
+
+// Line record flags, the type is in the lower bits of the tag.
+#define RECORD_TYPE_MASK    0x07
+#define LINE_FEED_RATE      0x08    // Feed rate follows.
+#define LINE_SPINDLE        0x10    // Planner spindle data follows.
+#define LINE_CONDITION      0x20    // Planner condition and override flags follow.
+#define LINE_NUMBER         0x40    // Line number follows.
+#define LINE_TOLERANCE      0x80    // Path blending tolerances follow.
+
+#if defined(ESP_PLATFORM)
+#define ST_MTIME st_mtim
+#else
+#define ST_MTIME st_mtime
+#endif
+
+static struct {
+    bool hooked;
+    bool recording;
+    bool rejected;
+    bool write_error;
+    bool valid;
+    char filename[PROGRAM_CACHE_NAME_LENGTH];
+    size_t source_size;
+    time_t source_mtime;
+    uint32_t signature;         // Machine state the program was recorded at.
+    uint32_t records;
+    uint32_t size;              // Size of the cache file in bytes.
+    vfs_file_t *file;
+    uint_fast16_t length;       // Number of bytes in the buffer.
+    uint_fast16_t pos;          // Read position in the buffer.
+    float target[N_AXIS];       // Target of the previous line record.
+    plan_line_data_t pl_data;   // Planner data of the previous line record.
+    parser_state_t end_state;   // Parser state at end of program.
+    uint8_t buffer[PROGRAM_CACHE_BUFFER_SIZE];
+} cache = {0};
+
+static settings_changed_ptr settings_changed;
+static on_program_completed_ptr on_program_completed;
+
+static uint32_t fnv1a (uint32_t hash, const void *data, size_t size)
+{
+    const uint8_t *byte = (const uint8_t *)data;
+
+    while(size--)
+        hash = (hash ^ *byte++) * 16777619UL;
+
+    return hash;
+}
+
+// Returns a hash of the machine and parser state replayed motions depend on.
+static uint32_t get_signature (void)
+{
+    uint_fast8_t idx;
+    float coord_data[N_AXIS];
+    uint32_t hash = 2166136261UL;
+
+    hash = fnv1a(hash, &gc_state.modal, sizeof(gc_modal_t));
+    hash = fnv1a(hash, &gc_state.spindle, sizeof(spindle_t));
+    hash = fnv1a(hash, &gc_state.feed_rate, sizeof(float));
+    hash = fnv1a(hash, gc_state.position, sizeof(gc_state.position));
+    hash = fnv1a(hash, gc_state.g92_coord_offset, sizeof(gc_state.g92_coord_offset));
+    hash = fnv1a(hash, gc_state.tool_length_offset, sizeof(gc_state.tool_length_offset));
+    hash = fnv1a(hash, gc_state.tool, sizeof(tool_data_t));
+
+    for(idx = 0; idx < N_CoordinateSystems; idx++) {
+        if(settings_read_coord_data((coord_system_id_t)idx, &coord_data))
+            hash = fnv1a(hash, coord_data, sizeof(coord_data));
+    }
+
+    if(grbl.tool_table.tool && grbl.tool_table.get == NULL)
+        hash = fnv1a(hash, grbl.tool_table.tool, sizeof(tool_data_t) * (grbl.tool_table.n_tools + 1));
+
+    return hash;
+}
+
+static void invalidate (void)
+{
+    if(cache.valid) {
+        cache.valid = false;
+        vfs_unlink(PROGRAM_CACHE_FILE);
+    }
+}
+
+static void cache_settings_changed (settings_t *settings, settings_changed_flags_t changed)
+{
+    if(settings_changed)
+        settings_changed(settings, changed);
+
+    invalidate();
+}
+
+// Buffered write to the cache file.
+static void put (const void *data, size_t size)
+{
+    size_t n;
+    const uint8_t *src = (const uint8_t *)data;
+
+    cache.size += size;
+
+    while(size && !cache.write_error) {
+        if(cache.length == sizeof(cache.buffer)) {
+            cache.write_error = vfs_write(cache.buffer, 1, cache.length, cache.file) != cache.length;
+            cache.length = 0;
+        }
+        n = min(size, sizeof(cache.buffer) - cache.length);
+        memcpy(&cache.buffer[cache.length], src, n);
+        cache.length += n;
+        src += n;
+        size -= n;
+    }
+}
+
+// Buffered read from the cache file, returns false at end of file.
+static bool get (void *data, size_t size)
+{
+    size_t n;
+    uint8_t *dst = (uint8_t *)data;
+
+    while(size) {
+        if(cache.pos == cache.length) {
+            cache.pos = 0;
+            if((cache.length = vfs_read(cache.buffer, 1, sizeof(cache.buffer), cache.file)) == 0)
+                return false;
+        }
+        n = min(size, cache.length - cache.pos);
+        memcpy(dst, &cache.buffer[cache.pos], n);
+        cache.pos += n;
+        dst += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+static void cache_program_completed (program_flow_t program_flow, bool check_mode)
+{
+    uint8_t record[2] = { Record_Completed, (uint8_t)program_flow };
+
+    if(program_cache_recording()) {
+        put(record, sizeof(record));
+        cache.records++;
+    }
+
+    if(on_program_completed)
+        on_program_completed(program_flow, check_mode);
+}
+
+//! Returns true while a program is being recorded and no uncacheable command has been found.
+bool program_cache_recording (void)
+{
+    return cache.recording && !cache.rejected;
+}
+
+//! Called by the parser for commands that cannot be replayed from the cache, recording is stopped.
+void program_cache_reject (void)
+{
+    if(cache.recording)
+        cache.rejected = true;
+}
+
+/*! \brief Record a motion, called by preflight_line().
+\param target pointer to float array with target position in machine coordinates.
+\param pl_data pointer to \a plan_line_data_t structure.
+*/
+void program_cache_line (float *target, plan_line_data_t *pl_data)
+{
+    uint_fast8_t idx;
+    uint8_t tag = Record_Line, axes = 0;
+
+    if(!program_cache_recording())
+        return;
+
+    if(pl_data->message || pl_data->output_commands || pl_data->raster || pl_data->spindle.css ||
+        pl_data->condition.system_motion || pl_data->condition.jog_motion || pl_data->overrides.sync) {
+        cache.rejected = true;
+        return;
+    }
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(memcmp(&target[idx], &cache.target[idx], sizeof(float)))
+            axes |= bit(idx);
+    }
+
+    if(memcmp(&pl_data->feed_rate, &cache.pl_data.feed_rate, sizeof(float)))
+        tag |= LINE_FEED_RATE;
+    if(memcmp(&pl_data->spindle, &cache.pl_data.spindle, sizeof(spindle_t)))
+        tag |= LINE_SPINDLE;
+    if(pl_data->condition.value != cache.pl_data.condition.value || pl_data->overrides.value != cache.pl_data.overrides.value)
+        tag |= LINE_CONDITION;
+    if(pl_data->line_number != cache.pl_data.line_number)
+        tag |= LINE_NUMBER;
+#if ENABLE_PATH_BLENDING
+    if(pl_data->path_tolerance != cache.pl_data.path_tolerance || pl_data->cam_tolerance != cache.pl_data.cam_tolerance)
+        tag |= LINE_TOLERANCE;
+#endif
+
+    put(&tag, 1);
+    put(&axes, 1);
+
+    for(idx = 0; idx < N_AXIS; idx++) {
+        if(axes & bit(idx))
+            put(&target[idx], sizeof(float));
+    }
+
+    if(tag & LINE_FEED_RATE)
+        put(&pl_data->feed_rate, sizeof(float));
+    if(tag & LINE_SPINDLE)
+        put(&pl_data->spindle, sizeof(spindle_t));
+    if(tag & LINE_CONDITION) {
+        put(&pl_data->condition.value, sizeof(uint32_t));
+        put(&pl_data->overrides.value, sizeof(uint8_t));
+    }
+    if(tag & LINE_NUMBER)
+        put(&pl_data->line_number, sizeof(int32_t));
+#if ENABLE_PATH_BLENDING
+    if(tag & LINE_TOLERANCE) {
+        put(&pl_data->path_tolerance, sizeof(float));
+        put(&pl_data->cam_tolerance, sizeof(float));
+    }
+#endif
+
+    memcpy(cache.target, target, sizeof(cache.target));
+    memcpy(&cache.pl_data, pl_data, sizeof(plan_line_data_t));
+    cache.records++;
+}
+
+//! Record a dwell, called by preflight_dwell().
+void program_cache_dwell (float seconds)
+{
+    uint8_t tag = Record_Dwell;
+
+    if(program_cache_recording()) {
+        put(&tag, 1);
+        put(&seconds, sizeof(float));
+        cache.records++;
+    }
+}
+
+//! Record a spindle change, called by spindle_sync() in check mode.
+void program_cache_spindle (spindle_ptrs_t *spindle, spindle_state_t state, float rpm)
+{
+    uint8_t tag = Record_Spindle;
+
+    if(program_cache_recording()) {
+        put(&tag, 1);
+        put(&spindle, sizeof(spindle_ptrs_t *));
+        put(&state.value, sizeof(uint8_t));
+        put(&rpm, sizeof(float));
+        cache.records++;
+    }
+}
+
+//! Record a coolant change, called by coolant_sync() in check mode.
+void program_cache_coolant (coolant_state_t state)
+{
+    uint8_t tag = Record_Coolant;
+
+    if(program_cache_recording()) {
+        put(&tag, 1);
+        put(&state.value, sizeof(uint8_t));
+        cache.records++;
+    }
+}
+
+//! Called by preflight_file() when the program has been validated, before the parser state is restored.
+void program_cache_end (void)
+{
+    uint8_t tag = Record_End;
+
+    if(program_cache_recording()) {
+        put(&tag, 1);
+        memcpy(&cache.end_state, &gc_state, sizeof(parser_state_t));
+    }
+}
+
+/*! \brief $PGC=<filename> command handler, validates a file and records it to the cache.
+Outputs [PGC:<records>,<bytes>] if the program was cached.
+Without a filename the cached program is output as [PGC:<filename>,<records>,<bytes>], or [PGC:] if none.
+*/
+status_code_t program_cache_command (sys_state_t state, char *args)
+{
+    vfs_stat_t st;
+    status_code_t status;
+    preflight_summary_t summary;
+
+    if(args == NULL) {
+        hal.stream.write("[PGC:");
+        if(cache.valid) {
+            hal.stream.write(cache.filename);
+            hal.stream.write(",");
+            hal.stream.write(uitoa(cache.records));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(cache.size));
+        }
+        hal.stream.write("]" ASCII_EOL);
+        return Status_OK;
+    }
+
+    if(state != STATE_IDLE)
+        return Status_IdleError;
+
+    if(strlen(args) >= sizeof(cache.filename))
+        return Status_InvalidStatement;
+
+    if(vfs_stat(args, &st) != 0)
+        return Status_SDFailedOpenDir;
+
+    invalidate();
+
+    if((cache.file = vfs_open(PROGRAM_CACHE_FILE, "w")) == NULL)
+        return Status_SDFailedOpenDir;
+
+    if(!cache.hooked) {
+        cache.hooked = true;
+
+        settings_changed = hal.settings_changed;
+        hal.settings_changed = cache_settings_changed;
+
+        on_program_completed = grbl.on_program_completed;
+        grbl.on_program_completed = cache_program_completed;
+    }
+
+    strcpy(cache.filename, args);
+    cache.source_size = st.st_size;
+    cache.source_mtime = st.ST_MTIME;
+    cache.signature = get_signature();
+    cache.records = cache.size = 0;
+    cache.length = 0;
+    cache.rejected = cache.write_error = false;
+    memcpy(cache.target, gc_state.position, sizeof(cache.target));
+    memset(&cache.pl_data, 0, sizeof(plan_line_data_t));
+    cache.recording = true;
+
+    status = preflight_file(args, &summary);
+
+    cache.recording = false;
+
+    if(cache.length && !cache.write_error)
+        cache.write_error = vfs_write(cache.buffer, 1, cache.length, cache.file) != cache.length;
+    vfs_close(cache.file);
+
+    if(status == Status_OK && !cache.rejected && !cache.write_error) {
+        cache.valid = true;
+        hal.stream.write("[PGC:");
+        hal.stream.write(uitoa(cache.records));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(cache.size));
+        hal.stream.write("]" ASCII_EOL);
+    } else {
+        vfs_unlink(PROGRAM_CACHE_FILE);
+        if(status == Status_OK)
+            report_message(cache.write_error ? "Program cache write failed" : "Program not cacheable", Message_Warning);
+    }
+
+    return status;
+}
+
+// Executes the records in the cache file, returns false on abort or end of file without an end record.
+static bool replay (void)
+{
+    uint8_t tag, value;
+    uint_fast8_t idx;
+    float rpm, seconds, target[N_AXIS], point[N_AXIS];
+    coolant_state_t coolant;
+    spindle_state_t spindle_state;
+    spindle_ptrs_t *spindle;
+    plan_line_data_t pl_data, plan_data;
+
+    memcpy(target, gc_state.position, sizeof(target));
+    memset(&pl_data, 0, sizeof(plan_line_data_t));
+
+    while(!ABORTED && get(&tag, 1)) {
+
+        switch(tag & RECORD_TYPE_MASK) {
+
+            case Record_Line:
+                if(!get(&value, 1))
+                    return false;
+                for(idx = 0; idx < N_AXIS; idx++) {
+                    if((value & bit(idx)) && !get(&target[idx], sizeof(float)))
+                        return false;
+                }
+                if((tag & LINE_FEED_RATE) && !get(&pl_data.feed_rate, sizeof(float)))
+                    return false;
+                if((tag & LINE_SPINDLE) && !get(&pl_data.spindle, sizeof(spindle_t)))
+                    return false;
+                if((tag & LINE_CONDITION) && !(get(&pl_data.condition.value, sizeof(uint32_t)) && get(&pl_data.overrides.value, sizeof(uint8_t))))
+                    return false;
+                if((tag & LINE_NUMBER) && !get(&pl_data.line_number, sizeof(int32_t)))
+                    return false;
+#if ENABLE_PATH_BLENDING
+                if((tag & LINE_TOLERANCE) && !(get(&pl_data.path_tolerance, sizeof(float)) && get(&pl_data.cam_tolerance, sizeof(float))))
+                    return false;
+#endif
+                // mc_line() may modify the planner data and the target.
+                memcpy(&plan_data, &pl_data, sizeof(plan_line_data_t));
+                memcpy(point, target, sizeof(point));
+                if(!mc_line(point, &plan_data))
+                    return false;
+                break;
+
+            case Record_Dwell:
+                if(!get(&seconds, sizeof(float)))
+                    return false;
+                mc_dwell(seconds);
+                break;
+
+            case Record_Spindle:
+                if(!(get(&spindle, sizeof(spindle_ptrs_t *)) && get(&spindle_state.value, sizeof(uint8_t)) && get(&rpm, sizeof(float))))
+                    return false;
+                spindle->param->rpm = rpm;
+                if(spindle_sync(spindle, spindle_state, rpm))
+                    spindle->param->state = spindle_state;
+                break;
+
+            case Record_Coolant:
+                if(!get(&coolant.value, sizeof(uint8_t)))
+                    return false;
+                coolant_sync(coolant);
+                break;
+
+            case Record_Completed:
+                if(!get(&value, 1) || !protocol_buffer_synchronize())
+                    return false;
+                if(value != ProgramFlow_Return) {
+                    spindle_all_off();
+                    hal.coolant.set_state((coolant_state_t){0});
+                    system_add_rt_report(Report_Spindle);
+                    system_add_rt_report(Report_Coolant);
+                }
+                if(grbl.on_program_completed)
+                    grbl.on_program_completed((program_flow_t)value, false);
+                break;
+
+            case Record_End:
+                return protocol_buffer_synchronize();
+
+            default:
+                return false;
+        }
+    }
+
+    return false;
+}
+
+/*! \brief $PGR=<filename> command handler, runs a program from the cache.
+The cache must have been recorded from the same, unchanged, file by the `$PGC` command and the machine and parser
+state must be the same as when it was recorded. The parser state at the end of the program is restored on completion.
+*/
+status_code_t program_cache_run_command (sys_state_t state, char *args)
+{
+    bool ok;
+    vfs_stat_t st;
+
+    if(args == NULL)
+        return Status_InvalidStatement;
+
+    if(state != STATE_IDLE)
+        return Status_IdleError;
+
+    if(!(cache.valid && !strcmp(args, cache.filename) && vfs_stat(args, &st) == 0 &&
+          st.st_size == cache.source_size && st.ST_MTIME == cache.source_mtime && get_signature() == cache.signature)) {
+        report_message("Program cache not valid", Message_Warning);
+        return Status_InvalidStatement;
+    }
+
+    if((cache.file = vfs_open(PROGRAM_CACHE_FILE, "r")) == NULL)
+        return Status_SDFailedOpenDir;
+
+    cache.length = cache.pos = 0;
+
+    ok = replay();
+
+    vfs_close(cache.file);
+
+    if(ABORTED)
+        return Status_Reset;
+
+    if(!ok) {
+        invalidate();
+        return Status_SDReadError;
+    }
+
+    // Restore parser state at end of program, coordinate data is not reloaded on program end in check mode.
+    memcpy(&gc_state, &cache.end_state, sizeof(parser_state_t));
+    if(!settings_read_coord_data(gc_state.modal.coord_system.id, &gc_state.modal.coord_system.xyz))
+        return Status_SettingReadFail;
+    system_flag_wco_change();
+
+    return Status_OK;
+}
+
+#endif // PROGRAM_CACHE_ENABLE
@@ -0,0 +1,39 @@
+/*
+  program_cache.h - recording and replay of parsed programs
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PROGRAM_CACHE_H_
+#define _PROGRAM_CACHE_H_
+
+#include "hal.h"
+
+#if PROGRAM_CACHE_ENABLE
+
+bool program_cache_recording (void);
+void program_cache_reject (void);
+void program_cache_line (float *target, plan_line_data_t *pl_data);
+void program_cache_dwell (float seconds);
+void program_cache_spindle (spindle_ptrs_t *spindle, spindle_state_t state, float rpm);
+void program_cache_coolant (coolant_state_t state);
+void program_cache_end (void);
+status_code_t program_cache_command (sys_state_t state, char *args);
+status_code_t program_cache_run_command (sys_state_t state, char *args);
+
+#endif
+
+#endif
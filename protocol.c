@@ -33,11 +33,34 @@
 #include "sleep.h"
 #include "protocol.h"
 #include "machine_limits.h"
+#include "profile.h"
+
+#if NGC_EXPRESSIONS_ENABLE
+#include "ngc_flowctrl.h"
+#endif
+
+#if PREFLIGHT_ENABLE
+#include "preflight.h"
+#endif
 
 #ifndef RT_QUEUE_SIZE
 #define RT_QUEUE_SIZE 16 // must be a power of 2
 #endif
 
+#ifndef REALTIME_HOOKS_MAX
+#define REALTIME_HOOKS_MAX 16       // Maximum number of registered realtime hooks
+#endif
+#ifndef BOOT_PHASES_MAX
+#define BOOT_PHASES_MAX 16          // Maximum number of recorded boot phases
+#endif
+#ifndef DEFERRED_INIT_MAX
+#define DEFERRED_INIT_MAX 8         // Maximum number of registered deferred init functions
+#endif
+
+#ifndef DELAYED_TASK_WHEEL_SIZE
+#define DELAYED_TASK_WHEEL_SIZE 16  // Number of 1 ms timer wheel slots, must be a power of 2
+#endif
+
 // Define line flags. Includes comment type tracking and line overflow detection.
 typedef union {
     uint8_t value;
@@ -69,8 +92,63 @@ static char xcommand[LINE_BUFFER_SIZE];
 static bool keep_rt_commands = false;
 static realtime_queue_t realtime_queue = {0};
 
+static uint_fast8_t n_realtime_hooks = 0;
+static realtime_hook_t realtime_hooks[REALTIME_HOOKS_MAX];
+static on_execute_realtime_ptr on_execute_delay = NULL;
+
+static uint_fast8_t n_boot_phases = 0;
+static boot_phase_t boot_phases[BOOT_PHASES_MAX];
+
+static struct {
+    uint_fast8_t n;
+    uint_fast8_t next;              // Next function to call.
+    bool started;
+    struct {
+        const char *name;
+        foreground_task_ptr fn;
+        void *data;
+    } init[DEFERRED_INIT_MAX];
+} deferred = {0};
+
+#if DELAYED_TASK_POOL_SIZE
+
+typedef struct timer_task {
+    struct timer_task *next;
+    uint32_t expires;           // Tick (ms) when task is to be executed.
+    foreground_task_ptr fn;
+    void *data;
+} timer_task_t;
+
+typedef struct {
+    uint32_t tick;              // Last tick processed.
+    volatile uint_fast8_t pending;
+    timer_task_t *free;
+    timer_task_t *slot[DELAYED_TASK_WHEEL_SIZE];
+    timer_task_t task[DELAYED_TASK_POOL_SIZE];
+} timer_wheel_t;
+
+static timer_wheel_t timer_wheel = {0};
+
+static void protocol_execute_delayed_tasks (void);
+
+#endif
+
 static void protocol_exec_rt_suspend (sys_state_t state);
+
+#if IDLE_WAIT_ENABLE
+
+#ifndef IDLE_WAIT_MAX_MS
+#define IDLE_WAIT_MAX_MS 10 // ms, maximum time to sleep, bounds the call interval of grbl.on_execute_realtime handlers.
+#endif
+
+static uint_fast8_t idle_inhibit = 0;
+
+static void protocol_idle_wait (void);
+
+#endif
 static void protocol_execute_rt_commands (void);
+static void protocol_execute_realtime_hooks (sys_state_t state, bool delay);
+static void deferred_init_start (void);
 
 // add gcode to execute not originating from normal input stream
 bool protocol_enqueue_gcode (char *gcode)
@@ -88,6 +166,76 @@ bool protocol_enqueue_gcode (char *gcode)
     return ok;
 }
 
+// Directs and executes one line of formatted input, execution status is stored in gc_state.last_error.
+// Returns false if aborted.
+static bool protocol_execute_line (char *line, line_flags_t line_flags, char eol)
+{
+  #if REPORT_ECHO_LINE_RECEIVED
+    report_echo_line_received(line);
+  #endif
+
+#if NGC_EXPRESSIONS_ENABLE
+    if(ngc_flowctrl_line_received(line_flags.overflow ? NULL : line, eol)) // Line was stored in a subroutine definition.
+        gc_state.last_error = Status_OK;
+    else
+#endif
+    if (line_flags.overflow) // Report line overflow error.
+        gc_state.last_error = Status_Overflow;
+    else if(*line == '\0') // Empty line. For syncing purposes.
+        gc_state.last_error = Status_OK;
+    else if(*line == '$') {// Grbl '$' system command
+        if((gc_state.last_error = system_execute_line(line)) == Status_LimitsEngaged) {
+            system_raise_alarm(Alarm_LimitsEngaged);
+            grbl.report.feedback_message(Message_CheckLimits);
+        }
+    } else if(*line == '[' && grbl.on_user_command)
+        gc_state.last_error = grbl.on_user_command(line);
+    else if (state_get() & (STATE_ALARM|STATE_ESTOP|STATE_JOG)) // Everything else is gcode. Block if in alarm, eStop or jog mode.
+        gc_state.last_error = Status_SystemGClock;
+#if COMPATIBILITY_LEVEL == 0
+    else if(gc_state.last_error == Status_OK || gc_state.last_error == Status_GcodeToolChangePending) { // Parse and execute g-code block.
+#else
+    else { // Parse and execute g-code block.
+
+#endif
+#if MOTION_FRAMES_ENABLE
+        gc_state.last_error = *line == ':' && sys.flags.motion_frames ? gc_execute_motion_frame(line) : gc_execute_block(line);
+#else
+        gc_state.last_error = gc_execute_block(line);
+#endif
+    }
+
+    // Add a short delay for each block processed in Check Mode to
+    // avoid overwhelming the sender with fast reply messages.
+    // This is likely to happen when streaming is done via a protocol where
+    // the speed is not limited to 115200 baud. An example is native USB streaming.
+#if CHECK_MODE_DELAY
+    if(state_get() == STATE_CHECK_MODE)
+        hal.delay_ms(CHECK_MODE_DELAY, NULL);
+#endif
+
+    return !ABORTED;
+}
+
+// Strips control characters and leading whitespace and applies backspaces in place
+// for a line handed out by the stream read_line handler. Returns the new length.
+static uint_fast16_t filter_line (char *line, uint_fast16_t length)
+{
+    char c, *s = line, *d = line, *end = line + length;
+
+    while(s < end) {
+        if((c = *s++) == ASCII_BS || c == ASCII_DEL) {
+            if(d > line)
+                d--;
+        } else if(c > (d > line ? ' ' - 1 : ' '))
+            *d++ = c;
+    }
+
+    *d = '\0';
+
+    return (uint_fast16_t)(d - line);
+}
+
 static bool recheck_line (char *line, line_flags_t *flags)
 {
     bool keep_rt_commands = false, first_char = true;
@@ -195,11 +343,19 @@ bool protocol_main_loop (void)
     if(sys.cold_start) {
         spindle_all_off();
         hal.coolant.set_state((coolant_state_t){0});
+        protocol_boot_phase("ready");
+        deferred_init_start();
         if(realtime_queue.head != realtime_queue.tail)
             system_set_exec_state_flag(EXEC_RT_COMMAND);  // execute any boot up commands
         sys.cold_start = false;
-    } else // TODO: if flushing entries from the queue that has allocated data associated then these will be orphaned/leaked.
+    } else { // TODO: if flushing entries from the queue that has allocated data associated then these will be orphaned/leaked.
         memset(&realtime_queue, 0, sizeof(realtime_queue_t));
+#if DELAYED_TASK_POOL_SIZE
+        timer_wheel.pending = 0;
+        timer_wheel.free = NULL;
+#endif
+        deferred_init_start();
+    }
 
     // ---------------------------------------------------------------------------------
     // Primary loop! Upon a system abort, this exits back to main() to reset the system.
@@ -207,7 +363,8 @@ bool protocol_main_loop (void)
     // ---------------------------------------------------------------------------------
 
     int16_t c;
-    char eol = '\0';
+    char eol = '\0', *span;
+    int_fast16_t span_length;
     line_flags_t line_flags = {0};
 
     xcommand[0] = '\0';
@@ -218,7 +375,43 @@ bool protocol_main_loop (void)
 
         // Process one line of incoming stream data, as the data becomes available. Performs an
         // initial filtering by removing leading spaces and control characters.
-        while((c = hal.stream.read()) != SERIAL_NO_DATA) {
+        // Complete lines are parsed in place in the input buffer if the stream supports that.
+        while(true) {
+
+            if(char_counter == 0 && stream_read_line_valid() && (span_length = hal.stream.read_line(&span)) >= 0) {
+
+                c = span[span_length];
+
+                // Check for possible secondary end of line character, see below.
+                if(span_length == 0 && eol && eol != c) {
+                    eol = '\0';
+                    hal.stream.release_line();
+                    continue;
+                } else
+                    eol = (char)c;
+
+                if(!protocol_execute_realtime()) { // Runtime command check point.
+                    hal.stream.release_line();
+                    return !sys.flags.exit;        // Bail to calling function upon system abort
+                }
+
+                line_flags.overflow = filter_line(span, span_length) >= LINE_BUFFER_SIZE;
+
+                bool ok = protocol_execute_line(span, line_flags, eol);
+
+                hal.stream.release_line();
+
+                if(!ok)
+                    break;
+
+                grbl.report.status_message(gc_state.last_error);
+
+                line_flags.value = 0;
+                continue;
+            }
+
+            if((c = hal.stream.read()) == SERIAL_NO_DATA)
+                break;
 
             if(c == ASCII_CAN) {
 
@@ -245,45 +438,10 @@ bool protocol_main_loop (void)
 
                 line[char_counter] = '\0'; // Set string termination character.
 
-              #if REPORT_ECHO_LINE_RECEIVED
-                report_echo_line_received(line);
-              #endif
-
-                // Direct and execute one line of formatted input, and report status of execution.
-                if (line_flags.overflow) // Report line overflow error.
-                    gc_state.last_error = Status_Overflow;
-                else if(*line == '\0') // Empty line. For syncing purposes.
-                    gc_state.last_error = Status_OK;
-                else if(*line == '$') {// Grbl '$' system command
-                    if((gc_state.last_error = system_execute_line(line)) == Status_LimitsEngaged) {
-                        system_raise_alarm(Alarm_LimitsEngaged);
-                        grbl.report.feedback_message(Message_CheckLimits);
-                    }
-                } else if(*line == '[' && grbl.on_user_command)
-                    gc_state.last_error = grbl.on_user_command(line);
-                else if (state_get() & (STATE_ALARM|STATE_ESTOP|STATE_JOG)) // Everything else is gcode. Block if in alarm, eStop or jog mode.
-                    gc_state.last_error = Status_SystemGClock;
-#if COMPATIBILITY_LEVEL == 0
-                else if(gc_state.last_error == Status_OK || gc_state.last_error == Status_GcodeToolChangePending) { // Parse and execute g-code block.
-#else
-                else { // Parse and execute g-code block.
-
-#endif
-                    gc_state.last_error = gc_execute_block(line);
-                }
-
-                // Add a short delay for each block processed in Check Mode to
-                // avoid overwhelming the sender with fast reply messages.
-                // This is likely to happen when streaming is done via a protocol where
-                // the speed is not limited to 115200 baud. An example is native USB streaming.
-#if CHECK_MODE_DELAY
-                if(state_get() == STATE_CHECK_MODE)
-                    hal.delay_ms(CHECK_MODE_DELAY, NULL);
-#endif
-                if(ABORTED)
+                if(!protocol_execute_line(line, line_flags, eol))
                     break;
-                else
-                    grbl.report.status_message(gc_state.last_error);
+
+                grbl.report.status_message(gc_state.last_error);
 
                 // Reset tracking data for next line.
                 keep_rt_commands = false;
@@ -346,6 +504,11 @@ bool protocol_main_loop (void)
         // If there are no more characters in the input stream buffer to be processed and executed,
         // this indicates that g-code streaming has either filled the planner buffer or has
         // completed. In either case, auto-cycle start, if enabled, any queued moves.
+#if ENABLE_PATH_BLENDING
+        // Plan the motion held back for path blending when the planner buffer is about to run empty.
+        if(plan_get_block_buffer_available() + 1 >= plan_get_buffer_size())
+            mc_blend_flush();
+#endif
         protocol_auto_cycle_start();
 
         if(!protocol_execute_realtime() && sys.abort) // Runtime command check point.
@@ -356,6 +519,11 @@ bool protocol_main_loop (void)
         // Check for sleep conditions and execute auto-park, if timeout duration elapses.
         if(settings.flags.sleep_enable)
             sleep_check();
+
+#if IDLE_WAIT_ENABLE
+        if(hal.idle_wait)
+            protocol_idle_wait();
+#endif
     }
 }
 
@@ -365,6 +533,17 @@ bool protocol_main_loop (void)
 bool protocol_buffer_synchronize (void)
 {
     bool ok = true;
+
+#if PREFLIGHT_ENABLE
+    if(preflight_active()) {
+        preflight_synchronize();
+        return protocol_execute_realtime();
+    }
+#endif
+#if ENABLE_PATH_BLENDING
+    if(!mc_blend_flush())
+        return false;
+#endif
     // If system is queued, ensure cycle resumes if the auto start flag is present.
     protocol_auto_cycle_start();
     while ((ok = protocol_execute_realtime()) && (plan_get_current_block() || state_get() == STATE_CYCLE));
@@ -398,7 +577,24 @@ void protocol_auto_cycle_start (void)
 // NOTE: The sys_rt_exec_state variable flags are set by any process, step or input stream events, pinouts,
 // limit switches, or the main program.
 // Returns false if aborted
+#if PROFILING_ENABLE
+
+static bool execute_realtime (void);
+
 bool protocol_execute_realtime (void)
+{
+    uint32_t t = profile_start();
+    bool ok = execute_realtime();
+
+    profile_end(Profile_ProtocolExecuteRealtime, t);
+
+    return ok;
+}
+
+static bool execute_realtime (void)
+#else
+bool protocol_execute_realtime (void)
+#endif
 {
     if(protocol_exec_rt_system()) {
 
@@ -408,8 +604,7 @@ bool protocol_execute_realtime (void)
             protocol_exec_rt_suspend(state);
 
 #if NVSDATA_BUFFER_ENABLE
-        if((state == STATE_IDLE || (state & (STATE_ALARM|STATE_ESTOP))) && settings_dirty.is_dirty && !gc_state.file_run)
-            nvs_buffer_sync_physical();
+        nvs_buffer_sync_poll(state);
 #endif
     }
 
@@ -507,6 +702,7 @@ bool protocol_exec_rt_system (void)
 
                 protocol_poll_cmd();
                 grbl.on_execute_realtime(STATE_ESTOP);
+                protocol_execute_realtime_hooks(STATE_ESTOP, false);
             }
 
             system_clear_exec_alarm(); // Clear alarm
@@ -515,6 +711,11 @@ bool protocol_exec_rt_system (void)
 
     if (sys.rt_exec_state && (rt_exec = system_clear_exec_states())) { // Get and clear volatile sys.rt_exec_state atomically.
 
+#if PROFILING_ENABLE
+        rt_exec_t picked_up = rt_exec;
+        latency_picked_up(rt_exec);
+#endif
+
         // Execute system abort.
         if((sys.reset_pending = !!(rt_exec & EXEC_RESET))) {
 
@@ -539,6 +740,10 @@ bool protocol_exec_rt_system (void)
             if(!killed) // Tell driver/plugins about reset.
                 hal.driver_reset();
 
+#if PROFILING_ENABLE
+            latency_handled(EXEC_RESET);
+#endif
+
             return !sys.abort; // Nothing else to do but exit.
         }
 
@@ -610,10 +815,22 @@ bool protocol_exec_rt_system (void)
         // Let state machine handle any remaining requests
         if(rt_exec)
             state_update(rt_exec);
+
+#if PROFILING_ENABLE
+        latency_handled(picked_up);
+#endif
     }
 
+#if DELAYED_TASK_POOL_SIZE
+    if(timer_wheel.pending)
+        protocol_execute_delayed_tasks();
+#endif
+
     grbl.on_execute_realtime(state_get());
 
+    if(n_realtime_hooks)
+        protocol_execute_realtime_hooks(state_get(), false);
+
     // Execute overrides.
 
     if(!sys.override_delay.feedrate && (rt_exec = get_feed_override())) {
@@ -761,8 +978,8 @@ bool protocol_exec_rt_system (void)
 
     // End execute overrides.
 
-    // Reload step segment buffer
-    if (state_get() & (STATE_CYCLE | STATE_HOLD | STATE_SAFETY_DOOR | STATE_HOMING | STATE_SLEEP| STATE_JOG))
+    // Reload step segment buffer, unless executed on a separate core by the driver.
+    if (hal.stepper.prep_lock == NULL && (state_get() & (STATE_CYCLE | STATE_HOLD | STATE_SAFETY_DOOR | STATE_HOMING | STATE_SLEEP| STATE_JOG)))
         st_prep_buffer();
 
     return !ABORTED;
@@ -816,6 +1033,10 @@ ISR_CODE bool ISR_FUNC(protocol_enqueue_realtime_command)(char c)
 
     bool drop = false;
 
+#if PROFILING_ENABLE
+    latency_received(c);
+#endif
+
     // 1. Process characters in the ranges 0x - 1x and 8x-Ax
     // Characters with functions assigned are always acted upon even when the input stream
     // is redirected to a non-interactive stream such as from a SD card.
@@ -934,6 +1155,13 @@ ISR_CODE bool ISR_FUNC(protocol_enqueue_realtime_command)(char c)
                 protocol_enqueue_foreground_task(stream_mpg_set_mode, NULL);
             break;
 
+#if MOTION_FRAMES_ENABLE
+        case CMD_MOTION_FRAMES_TOGGLE:
+            sys.flags.motion_frames = !sys.flags.motion_frames;
+            drop = true;
+            break;
+#endif
+
         case CMD_AUTO_REPORTING_TOGGLE:
             if(settings.report_interval)
                 sys.flags.auto_reporting = !sys.flags.auto_reporting;
@@ -1015,6 +1243,10 @@ ISR_CODE bool ISR_FUNC(protocol_enqueue_realtime_command)(char c)
 
     esc = c == ASCII_ESC;
 
+#if PROFILING_ENABLE
+    latency_flagged();
+#endif
+
     return drop;
 }
 
@@ -1029,18 +1261,156 @@ static const uint32_t dummy_data = 0;
 bool protocol_enqueue_foreground_task (foreground_task_ptr fn, void *data)
 {
     bool ok;
+
+    hal.irq_disable(); // Claim buffer slot, may be called from several interrupt handlers.
+
     uint_fast8_t bptr = (realtime_queue.head + 1) & (RT_QUEUE_SIZE - 1);    // Get next head pointer
 
     if((ok = bptr != realtime_queue.tail)) {                    // If not buffer full
         realtime_queue.task[realtime_queue.head].data = data;
         realtime_queue.task[realtime_queue.head].fn = fn;       // add function pointer to buffer,
         realtime_queue.head = bptr;                             // update pointer and
+    }
+
+    hal.irq_enable();
+
+    if(ok)
         system_set_exec_state_flag(EXEC_RT_COMMAND);            // flag it for execute
+
+    return ok;
+}
+
+#if DELAYED_TASK_POOL_SIZE
+
+/*! \brief Enqueue a function to be called once by the foreground process after a delay.
+\param fn pointer to a \a foreground_task_ptr type of function.
+\param data pointer to data to be passed to the callee.
+\param ms_delay delay in milliseconds, if 0 the function is enqueued for immediate execution.
+\returns true if successful, false otherwise.
+__NOTE:__ May be called from interrupt context. Requires the optional \a hal.get_elapsed_ticks handler.
+*/
+bool protocol_enqueue_delayed_task (foreground_task_ptr fn, void *data, uint32_t ms_delay)
+{
+    if(ms_delay == 0)
+        return protocol_enqueue_foreground_task(fn, data);
+
+    if(hal.get_elapsed_ticks == NULL)
+        return false;
+
+    timer_task_t *task;
+
+    hal.irq_disable();
+
+    if(timer_wheel.pending == 0 && timer_wheel.free == NULL) {
+        // Initialize free list and sync with system tick.
+        uint_fast8_t idx = DELAYED_TASK_POOL_SIZE;
+        memset(timer_wheel.slot, 0, sizeof(timer_wheel.slot));
+        do {
+            idx--;
+            timer_wheel.task[idx].next = timer_wheel.free;
+            timer_wheel.free = &timer_wheel.task[idx];
+        } while(idx);
+        timer_wheel.tick = hal.get_elapsed_ticks();
+    }
+
+    if((task = timer_wheel.free)) {
+        timer_wheel.free = task->next;
+        task->fn = fn;
+        task->data = data;
+        task->expires = hal.get_elapsed_ticks() + ms_delay;
+        task->next = timer_wheel.slot[task->expires & (DELAYED_TASK_WHEEL_SIZE - 1)];
+        timer_wheel.slot[task->expires & (DELAYED_TASK_WHEEL_SIZE - 1)] = task;
+        timer_wheel.pending++;
     }
 
+    hal.irq_enable();
+
+    return task != NULL;
+}
+
+/*! \brief Cancel pending delayed execution of a function.
+\param fn pointer to a \a foreground_task_ptr type of function.
+\param data pointer to data that was passed when the function was enqueued.
+\returns true if a pending task was found and cancelled, false otherwise.
+*/
+bool protocol_cancel_delayed_task (foreground_task_ptr fn, void *data)
+{
+    bool ok = false;
+    uint_fast8_t idx = DELAYED_TASK_WHEEL_SIZE;
+    timer_task_t *task, **prev;
+
+    hal.irq_disable();
+
+    if(timer_wheel.pending) do {
+        prev = &timer_wheel.slot[--idx];
+        while((task = *prev)) {
+            if(task->fn == fn && task->data == data) {
+                *prev = task->next;
+                task->next = timer_wheel.free;
+                timer_wheel.free = task;
+                timer_wheel.pending--;
+                ok = true;
+            } else
+                prev = &task->next;
+        }
+    } while(idx);
+
+    hal.irq_enable();
+
     return ok;
 }
 
+// Execute delayed functions that are due, called from the realtime loop when tasks are pending.
+// Only the wheel slots for the ticks elapsed since the last call are visited.
+static void protocol_execute_delayed_tasks (void)
+{
+    uint32_t now = hal.get_elapsed_ticks(), ticks = now - timer_wheel.tick;
+
+    if(ticks == 0)
+        return;
+
+    if(ticks > DELAYED_TASK_WHEEL_SIZE)
+        ticks = DELAYED_TASK_WHEEL_SIZE;
+
+    do {
+        timer_task_t *task, **prev, *due = NULL;
+
+        hal.irq_disable();
+
+        prev = &timer_wheel.slot[(now - --ticks) & (DELAYED_TASK_WHEEL_SIZE - 1)];
+        while((task = *prev)) {
+            if((int32_t)(task->expires - now) <= 0) {
+                *prev = task->next;
+                task->next = due;
+                due = task;
+            } else
+                prev = &task->next;
+        }
+
+        hal.irq_enable();
+
+        while((task = due)) {
+
+            foreground_task_ptr call = task->fn;
+            void *data = task->data;
+
+            due = task->next;
+
+            hal.irq_disable();
+            task->next = timer_wheel.free;
+            timer_wheel.free = task;
+            timer_wheel.pending--;
+            hal.irq_enable();
+
+            call(data);
+        }
+    } while(ticks);
+
+    timer_wheel.tick = now;
+}
+
+#endif // DELAYED_TASK_POOL_SIZE
+
 /*! \brief Enqueue a function to be called once by the foreground process.
 \param fn pointer to a \a on_execute_realtime_ptr type of function.
 \returns true if successful, false otherwise.
@@ -1078,3 +1448,216 @@ void protocol_execute_noop (sys_state_t state)
 {
     (void)state;
 }
+
+// Call registered realtime hooks that are due, maintains execution time statistics if hal.get_micros is available.
+static void protocol_execute_realtime_hooks (sys_state_t state, bool delay)
+{
+    uint_fast8_t idx;
+    realtime_hook_t *hook = realtime_hooks;
+    uint32_t now = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0, t = 0, elapsed;
+
+    for(idx = 0; idx < n_realtime_hooks; idx++, hook++) {
+
+        if((delay && !hook->on_delay) || (hook->period && now - hook->last < hook->period))
+            continue;
+
+        hook->last = now;
+
+        if(hal.get_micros)
+            t = hal.get_micros();
+
+        hook->fn(state);
+
+        if(hal.get_micros) {
+            elapsed = hal.get_micros() - t;
+            hook->total += elapsed;
+            if(elapsed > hook->max)
+                hook->max = elapsed;
+        }
+
+        hook->calls++;
+    }
+}
+
+static void protocol_execute_delay_hooks (sys_state_t state)
+{
+    on_execute_delay(state);
+
+    protocol_execute_realtime_hooks(state, true);
+}
+
+/*! \brief Register a function to be called from the main loop, an alternative to chaining \a grbl.on_execute_realtime.
+Registered functions are called in a flat loop after the \a grbl.on_execute_realtime chain and the execution time
+of each is accounted for, output with the <i>$RTH</i> command.
+\param name pointer to a zero terminated string with the name of the hook, used for reporting.
+\param fn pointer to a \a on_execute_realtime_ptr type of function.
+\param period_ms minimum time in milliseconds between calls, 0 to call on every iteration.
+Requires the optional hal.get_elapsed_ticks handler, ignored if not available.
+\param on_delay \a true to also call the function from delay loops via \a grbl.on_execute_delay.
+\returns true if successful, false otherwise.
+*/
+bool protocol_register_realtime_hook (const char *name, on_execute_realtime_ptr fn, uint16_t period_ms, bool on_delay)
+{
+    realtime_hook_t *hook;
+
+    if(fn == NULL || n_realtime_hooks == REALTIME_HOOKS_MAX)
+        return false;
+
+    hook = &realtime_hooks[n_realtime_hooks];
+    memset(hook, 0, sizeof(realtime_hook_t));
+    hook->name = name;
+    hook->fn = fn;
+    hook->period = hal.get_elapsed_ticks ? period_ms : 0;
+    hook->on_delay = on_delay;
+
+    if(on_delay && on_execute_delay == NULL) {
+        on_execute_delay = grbl.on_execute_delay;
+        grbl.on_execute_delay = protocol_execute_delay_hooks;
+    }
+
+    n_realtime_hooks++;
+
+    return true;
+}
+
+#if IDLE_WAIT_ENABLE
+
+/*! \brief Inhibit sleeping in the main loop, for plugins that need to be polled continuously.
+Calls are counted, each call with \a on set to \a true must be matched by a call with \a on set to \a false.
+Plugins that only need to be called periodically should rather register a realtime hook with a period,
+see protocol_register_realtime_hook(), the main loop is then woken when the hook is due.
+\param on \a true to inhibit, \a false to release.
+*/
+void protocol_idle_inhibit (bool on)
+{
+    if(on)
+        idle_inhibit++;
+    else if(idle_inhibit)
+        idle_inhibit--;
+}
+
+// Sleeps via hal.idle_wait() when there is no input, no pending realtime or foreground work and
+// the segment buffer is full or there is nothing to execute. The timeout is set to when the
+// next periodic realtime hook or delayed task is due.
+static void protocol_idle_wait (void)
+{
+    uint_fast8_t idx;
+    uint32_t timeout = IDLE_WAIT_MAX_MS, now;
+
+    if(idle_inhibit || sys.rt_exec_state || sys.rt_exec_alarm || sys.abort || realtime_queue.head != realtime_queue.tail)
+        return;
+
+    if(hal.stream.get_rx_buffer_count && hal.stream.get_rx_buffer_count())
+        return;
+
+    if(plan_get_current_block() && st_get_segment_buffer_fill() < SEGMENT_BUFFER_SIZE - 1)
+        return;
+
+#if DELAYED_TASK_POOL_SIZE
+    if(timer_wheel.pending)
+        timeout = 1;
+#endif
+
+    if(n_realtime_hooks) {
+        realtime_hook_t *hook = realtime_hooks;
+        now = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+        for(idx = 0; idx < n_realtime_hooks; idx++, hook++) {
+            if(hook->period == 0 || now - hook->last >= hook->period)
+                return;
+            timeout = min(timeout, hook->period - (now - hook->last));
+        }
+    }
+
+    hal.idle_wait(timeout);
+}
+
+#endif
+
+/*! \brief Get registered realtime hook data.
+\param idx index of the hook.
+\returns pointer to a \a realtime_hook_t structure, NULL if idx is out of range.
+*/
+realtime_hook_t *protocol_get_realtime_hook (uint_fast8_t idx)
+{
+    return idx < n_realtime_hooks ? &realtime_hooks[idx] : NULL;
+}
+
+//! Reset execution time statistics for all registered realtime hooks.
+void protocol_reset_realtime_hook_stats (void)
+{
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < n_realtime_hooks; idx++)
+        realtime_hooks[idx].calls = realtime_hooks[idx].total = realtime_hooks[idx].max = 0;
+}
+
+/*! \brief Record the end of a boot phase, for reporting with the <i>$BOOT</i> command.
+Times are from hal.get_micros(), or from hal.get_elapsed_ticks() in ms resolution if not available.
+\param name pointer to a zero terminated string with the name of the phase, must stay valid.
+*/
+void protocol_boot_phase (const char *name)
+{
+    if(n_boot_phases < BOOT_PHASES_MAX && (hal.get_micros || hal.get_elapsed_ticks)) {
+        boot_phases[n_boot_phases].name = name;
+        boot_phases[n_boot_phases++].time = hal.get_micros ? (uint32_t)hal.get_micros() : hal.get_elapsed_ticks() * 1000;
+    }
+}
+
+/*! \brief Get recorded boot phase.
+\param idx index of the phase.
+\returns pointer to a \a boot_phase_t structure, NULL if idx is out of range.
+*/
+boot_phase_t *protocol_get_boot_phase (uint_fast8_t idx)
+{
+    return idx < n_boot_phases ? &boot_phases[idx] : NULL;
+}
+
+// Calls the next deferred init function and enqueues itself for the next,
+// the input stream is serviced between calls.
+static void deferred_init_next (void *data)
+{
+    if(deferred.next < deferred.n) {
+        deferred.init[deferred.next].fn(deferred.init[deferred.next].data);
+        protocol_boot_phase(deferred.init[deferred.next].name);
+        if(++deferred.next < deferred.n)
+            protocol_enqueue_foreground_task(deferred_init_next, NULL);
+    }
+}
+
+// Starts or, after a reset flushed the queue, restarts execution of the deferred init functions.
+static void deferred_init_start (void)
+{
+    deferred.started = true;
+
+    if(deferred.next < deferred.n)
+        protocol_enqueue_foreground_task(deferred_init_next, NULL);
+}
+
+/*! \brief Register a function to be called once by the foreground process after the main loop has started,
+an alternative to initialization from driver_init() or a plugin init function for parts that are not needed
+before the controller is ready for input, e.g. mounting file systems or connecting to network services.
+Functions are called in the order registered, one per main loop iteration.
+If called after the main loop has started the function is enqueued for execution immediately.
+\param name pointer to a zero terminated string with the name of the function, used for reporting.
+\param fn pointer to a \a foreground_task_ptr type of function.
+\param data pointer to data to be passed to the callee.
+\returns true if successful, false otherwise.
+*/
+bool protocol_register_deferred_init (const char *name, foreground_task_ptr fn, void *data)
+{
+    if(fn == NULL)
+        return false;
+
+    if(deferred.started)
+        return protocol_enqueue_foreground_task(fn, data);
+
+    if(deferred.n == DEFERRED_INIT_MAX)
+        return false;
+
+    deferred.init[deferred.n].name = name;
+    deferred.init[deferred.n].fn = fn;
+    deferred.init[deferred.n++].data = data;
+
+    return true;
+}
+
@@ -35,6 +35,24 @@
 
 typedef void (*foreground_task_ptr)(void *data);
 
+//! Realtime hook registration and execution time statistics, see protocol_register_realtime_hook().
+typedef struct {
+    const char *name;               //!< Name of hook, for reporting.
+    on_execute_realtime_ptr fn;     //!< Function to call.
+    uint16_t period;                //!< Minimum time between calls in milliseconds, 0 for every iteration.
+    bool on_delay;                  //!< Call from delay loops too.
+    uint32_t last;                  //!< Tick (ms) of last call.
+    uint32_t calls;                 //!< Number of calls.
+    uint32_t max;                   //!< Maximum execution time in microseconds.
+    uint64_t total;                 //!< Total execution time in microseconds.
+} realtime_hook_t;
+
+//! Boot phase timestamp, see protocol_boot_phase().
+typedef struct {
+    const char *name;               //!< Name of phase, for reporting.
+    uint32_t time;                  //!< Time in microseconds at the end of the phase.
+} boot_phase_t;
+
 // Starts Grbl main loop. It handles all incoming characters from the input stream and executes
 // them as they complete. It is also responsible for finishing the initialization procedures.
 bool protocol_main_loop (void);
@@ -45,6 +63,19 @@ bool protocol_exec_rt_system (void);
 void protocol_execute_noop (uint_fast16_t state);
 bool protocol_enqueue_rt_command (on_execute_realtime_ptr fn);
 bool protocol_enqueue_foreground_task (foreground_task_ptr fn, void *data);
+#if DELAYED_TASK_POOL_SIZE
+bool protocol_enqueue_delayed_task (foreground_task_ptr fn, void *data, uint32_t ms_delay);
+bool protocol_cancel_delayed_task (foreground_task_ptr fn, void *data);
+#endif
+bool protocol_register_realtime_hook (const char *name, on_execute_realtime_ptr fn, uint16_t period_ms, bool on_delay);
+realtime_hook_t *protocol_get_realtime_hook (uint_fast8_t idx);
+void protocol_reset_realtime_hook_stats (void);
+void protocol_boot_phase (const char *name);
+boot_phase_t *protocol_get_boot_phase (uint_fast8_t idx);
+bool protocol_register_deferred_init (const char *name, foreground_task_ptr fn, void *data);
+#if IDLE_WAIT_ENABLE
+void protocol_idle_inhibit (bool on);
+#endif
 
 // Executes the auto cycle feature, if enabled.
 void protocol_auto_cycle_start (void);
@@ -36,9 +36,23 @@
 #include "hal.h"
 #include "report.h"
 #include "nvs_buffer.h"
+#include "mem_stats.h"
+#include "job_stats.h"
 #include "machine_limits.h"
 #include "state_machine.h"
 #include "regex.h"
+#include "profile.h"
+#include "modbus.h"
+#include "protocol.h"
+#include "vfs.h"
+#include "job_resume.h"
+#include "spindle_sync.h"
+#include "probe_scan.h"
+#include "input_events.h"
+
+#if NGC_EXPRESSIONS_ENABLE
+#include "ngc_params.h"
+#endif
 
 #if ENABLE_SPINDLE_LINEARIZATION
 #include <stdio.h>
@@ -52,6 +66,10 @@ static uint8_t override_counter = 0; // Tracks when to add override data to stat
 static uint8_t wco_counter = 0;      // Tracks when to add work coordinate offset data to status reports.
 static const char vbar[2] = { '|', '\0' };
 
+#ifndef REPORT_RT_BUFFER_SIZE
+#define REPORT_RT_BUFFER_SIZE 256
+#endif
+
 // Append a number of strings to the static buffer
 // NOTE: do NOT use for several int/float conversions as these share the same underlying buffer!
 static char *appendbuf (int argc, ...)
@@ -74,6 +92,23 @@ static char *appendbuf (int argc, ...)
     return buf;
 }
 
+// Outputs a 32 bit hash value in hex, followed by a closing bracket and end-of-line
+static void write_hash (const char *prefix, uint32_t value)
+{
+    char hex[9];
+    uint_fast8_t idx = 8;
+
+    hex[idx] = '\0';
+    do {
+        hex[--idx] = "0123456789ABCDEF"[value & 0x0F];
+        value >>= 4;
+    } while(idx);
+
+    hal.stream.write(prefix);
+    hal.stream.write(hex);
+    hal.stream.write("]" ASCII_EOL);
+}
+
 static char *map_coord_system (coord_system_id_t id)
 {
     uint8_t g5x = id + 54;
@@ -91,16 +126,15 @@ static char *map_coord_system (coord_system_id_t id)
 static char *get_axis_values_mm (float *axis_values)
 {
     uint_fast32_t idx;
-
-    buf[0] = '\0';
+    char *s = buf;
 
     for (idx = 0; idx < N_AXIS; idx++) {
         if(idx == X_AXIS && gc_state.modal.diameter_mode)
-            strcat(buf, ftoa(axis_values[idx] * 2.0f, N_DECIMAL_COORDVALUE_MM));
+            s = ftoa_r(axis_values[idx] * 2.0f, N_DECIMAL_COORDVALUE_MM, s);
         else
-            strcat(buf, ftoa(axis_values[idx], N_DECIMAL_COORDVALUE_MM));
+            s = ftoa_r(axis_values[idx], N_DECIMAL_COORDVALUE_MM, s);
         if (idx < (N_AXIS - 1))
-            strcat(buf, ",");
+            *s++ = ',';
     }
 
     return buf;
@@ -110,20 +144,19 @@ static char *get_axis_values_mm (float *axis_values)
 static char *get_axis_values_inches (float *axis_values)
 {
     uint_fast32_t idx;
-
-    buf[0] = '\0';
+    char *s = buf;
 
     for (idx = 0; idx < N_AXIS; idx++) {
         if(idx == X_AXIS && gc_state.modal.diameter_mode)
-            strcat(buf, ftoa(axis_values[idx] * INCH_PER_MM * 2.0f, N_DECIMAL_COORDVALUE_INCH));
+            s = ftoa_r(axis_values[idx] * INCH_PER_MM * 2.0f, N_DECIMAL_COORDVALUE_INCH, s);
 #if N_AXIS > 3
         else if(idx > Z_AXIS && bit_istrue(settings.steppers.is_rotational.mask, bit(idx)))
-            strcat(buf, ftoa(axis_values[idx], N_DECIMAL_COORDVALUE_MM));
+            s = ftoa_r(axis_values[idx], N_DECIMAL_COORDVALUE_MM, s);
 #endif
         else
-             strcat(buf, ftoa(axis_values[idx] * INCH_PER_MM, N_DECIMAL_COORDVALUE_INCH));
+            s = ftoa_r(axis_values[idx] * INCH_PER_MM, N_DECIMAL_COORDVALUE_INCH, s);
         if (idx < (N_AXIS - 1))
-            strcat(buf, ",");
+            *s++ = ',';
     }
 
     return buf;
@@ -132,13 +165,17 @@ static char *get_axis_values_inches (float *axis_values)
 // Convert rate value to null terminated string (mm).
 static char *get_axis_value_mm (float value)
 {
-    return strcpy(buf, ftoa(value, N_DECIMAL_COORDVALUE_MM));
+    ftoa_r(value, N_DECIMAL_COORDVALUE_MM, buf);
+
+    return buf;
 }
 
 // Convert rate value to null terminated string (mm).
 static char *get_axis_value_inches (float value)
 {
-    return strcpy(buf, ftoa(value * INCH_PER_MM, N_DECIMAL_COORDVALUE_INCH));
+    ftoa_r(value * INCH_PER_MM, N_DECIMAL_COORDVALUE_INCH, buf);
+
+    return buf;
 }
 
 // Convert rate value to null terminated string (mm).
@@ -211,6 +248,123 @@ inline static char *control_signals_tostring (char *buf, control_signals_t signa
     return buf;
 }
 
+#if FLOW_CREDITS_ENABLE
+
+#ifndef FLOW_CREDITS_RX_STEP
+#define FLOW_CREDITS_RX_STEP 128    // Minimum increase of free RX buffer bytes for sending an unsolicited credit update.
+#endif
+#ifndef FLOW_CREDITS_BLOCK_STEP
+#define FLOW_CREDITS_BLOCK_STEP 4   // Minimum increase of free planner blocks for sending an unsolicited credit update.
+#endif
+#ifndef FLOW_CREDITS_INTERVAL
+#define FLOW_CREDITS_INTERVAL 20    // ms, minimum time between unsolicited credit updates.
+#endif
+
+static struct {
+    volatile bool enabled;
+    bool hooked;
+    bool pending;
+    uint16_t rx_free;
+    uint16_t blocks_free;
+    uint32_t sent;
+    on_execute_realtime_ptr on_execute_realtime;
+    on_stream_changed_ptr on_stream_changed;
+    on_reset_ptr on_reset;
+} credits = {0};
+
+static void credits_update (void)
+{
+    credits.blocks_free = (uint16_t)plan_get_block_buffer_available();
+    credits.rx_free = (uint16_t)hal.stream.get_rx_buffer_free();
+    credits.sent = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+}
+
+// Appends the credits, free planner blocks and RX buffer bytes, to the string.
+static char *credits_append (char *s)
+{
+    credits_update();
+
+    s = strcat(s, uitoa(credits.blocks_free));
+    s = strcat(s, ",");
+
+    return strcat(s, uitoa(credits.rx_free));
+}
+
+// Sends the unsolicited credit update, executed as a foreground task since the poll may be called from
+// stream_tx_blocking() while a line is partially written.
+static void credits_send (void *data)
+{
+    credits.pending = false;
+
+    if(credits.enabled) {
+        char buf[20] = "[Bf:";
+        hal.stream.write(credits_append(buf));
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+// Queues an unsolicited credit update if free space has increased enough since last reported, a sender
+// waiting for credits may otherwise stall since no ok is sent until a new line is received.
+static void credits_poll (sys_state_t state)
+{
+    credits.on_execute_realtime(state);
+
+    if(credits.enabled && !credits.pending && hal.get_elapsed_ticks && hal.get_elapsed_ticks() - credits.sent >= FLOW_CREDITS_INTERVAL) {
+
+        uint16_t blocks_free = (uint16_t)plan_get_block_buffer_available(), rx_free = (uint16_t)hal.stream.get_rx_buffer_free();
+
+        if(blocks_free >= credits.blocks_free + FLOW_CREDITS_BLOCK_STEP || rx_free >= credits.rx_free + FLOW_CREDITS_RX_STEP)
+            credits.pending = protocol_enqueue_foreground_task(credits_send, NULL);
+        else {
+            // Track decreases so that later increases are measured from the lowest level.
+            credits.blocks_free = min(credits.blocks_free, blocks_free);
+            credits.rx_free = min(credits.rx_free, rx_free);
+        }
+    }
+}
+
+// Credit mode is enabled by the sender for the current stream, it is ended when the stream changes
+// so that a sender not aware of credits does not get them, and on soft reset.
+static void credits_stream_changed (stream_type_t type)
+{
+    credits.enabled = false;
+
+    if(credits.on_stream_changed)
+        credits.on_stream_changed(type);
+}
+
+static void credits_reset (void)
+{
+    credits.enabled = credits.pending = false;
+
+    if(credits.on_reset)
+        credits.on_reset();
+}
+
+//! Enables or disables credit mode, when enabled ok responses are sent as <i>ok|Bf:<free blocks>,<free RX bytes></i>.
+void report_flow_credits (bool enable)
+{
+    if(enable && !credits.hooked) {
+        credits.hooked = true;
+        credits.on_execute_realtime = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = credits_poll;
+        credits.on_stream_changed = grbl.on_stream_changed;
+        grbl.on_stream_changed = credits_stream_changed;
+        credits.on_reset = grbl.on_reset;
+        grbl.on_reset = credits_reset;
+    }
+
+    if((credits.enabled = enable))
+        credits_update();
+}
+
+bool report_flow_credits_enabled (void)
+{
+    return credits.enabled;
+}
+
+#endif
+
 void report_init (void)
 {
     get_axis_value = settings.flags.report_inches ? get_axis_value_inches : get_axis_value_mm;
@@ -229,6 +383,13 @@ static status_code_t report_status_message (status_code_t status_code)
     switch(status_code) {
 
         case Status_OK: // STATUS_OK
+#if FLOW_CREDITS_ENABLE
+            if(credits.enabled) {
+                char buf[24] = "ok|Bf:";
+                hal.stream.write(credits_append(buf));
+                hal.stream.write(ASCII_EOL);
+            } else
+#endif
             hal.stream.write("ok" ASCII_EOL);
             break;
 
@@ -244,6 +405,9 @@ static status_code_t report_status_message (status_code_t status_code)
 static alarm_code_t report_alarm_message (alarm_code_t alarm_code)
 {
     hal.stream.write_all(appendbuf(3, "ALARM:", uitoa((uint32_t)alarm_code), ASCII_EOL));
+#if VFS_LOG_BUFFER_SIZE
+    vfs_log_message("ALARM:", uitoa((uint32_t)alarm_code));
+#endif
     hal.delay_ms(100, NULL); // Force delay to ensure message clears output stream buffer.
 
     return alarm_code;
@@ -270,6 +434,10 @@ void report_message (const char *msg, message_type_t type)
 
     hal.stream.write(msg);
     hal.stream.write("]" ASCII_EOL);
+
+#if VFS_LOG_BUFFER_SIZE
+    vfs_log_message(type == Message_Warning ? "MSG:Warning: " : (type == Message_Info ? "MSG:Info: " : "MSG:"), msg);
+#endif
 }
 
 // Message helper to be run as foreground task
@@ -453,16 +621,27 @@ void report_grbl_settings (bool all, void *data)
 {
     uint_fast16_t idx, n_settings = 0;
     const setting_detail_t *setting;
+    const setting_index_entry_t *index;
     setting_detail_t **all_settings, **psetting;
     setting_details_t *details = settings_get_details();
 
+    if((n_settings = settings_get_index(&index))) {
+        for(idx = 0; idx < n_settings; idx++) {
+            setting = index[idx].setting;
+            if((all || (index[idx].details == details && (setting->type == Setting_IsLegacy || setting->type == Setting_IsLegacyFn))) &&
+                  (setting->is_available == NULL || setting->is_available(setting)))
+                settings_iterator(setting, print_setting, data);
+        }
+        return;
+    }
+
     do {
         n_settings += details->n_settings;
     } while((details = details->next));
 
     details = settings_get_details();
 
-    if((all_settings = psetting = calloc(n_settings, sizeof(setting_detail_t *)))) {
+    if((all_settings = psetting = mem_calloc(MemTag_Report, n_settings, sizeof(setting_detail_t *)))) {
 
         n_settings = 0;
 
@@ -492,7 +671,7 @@ void report_grbl_settings (bool all, void *data)
         for(idx = 0; idx < n_settings; idx++)
             settings_iterator(all_settings[idx], print_setting, data);
 
-        free(all_settings);
+        mem_free(all_settings);
 
     } else do {
         for(idx = 0; idx < n_settings; idx++)
@@ -624,13 +803,16 @@ void report_ngc_parameters (void)
     hal.stream.write(get_axis_values(gc_state.g92_coord_offset));
     hal.stream.write("]" ASCII_EOL);
 
-    for (idx = 1; idx <= grbl.tool_table.n_tools; idx++) {
+    for (tool_id_t tool_id = 1; tool_id <= grbl.tool_table.n_tools; tool_id++) {
+        tool_data_t *tool = grbl.tool_table.get ? grbl.tool_table.get(tool_id, false) : &grbl.tool_table.tool[tool_id];
+        if(tool == NULL) // Not in sparse tool table
+            continue;
         hal.stream.write("[T:");
-        hal.stream.write(uitoa((uint32_t)idx));
+        hal.stream.write(uitoa((uint32_t)tool_id));
         hal.stream.write("|");
-        hal.stream.write(get_axis_values(grbl.tool_table.tool[idx].offset));
+        hal.stream.write(get_axis_values(tool->offset));
         hal.stream.write("|");
-        hal.stream.write(get_axis_value(grbl.tool_table.tool[idx].radius));
+        hal.stream.write(get_axis_value(tool->radius));
         hal.stream.write("]" ASCII_EOL);
     }
 
@@ -1062,6 +1244,8 @@ void report_build_info (char *line, bool extended)
             hal.stream.write("]" ASCII_EOL);
         }
 
+        write_hash("[SCHEMA:", report_settings_schema_hash());
+
         grbl.on_report_options(false);
     }
 }
@@ -1077,12 +1261,115 @@ void report_echo_line_received (char *line)
 }
 
 
+// Real-time report assembly buffer, the report is output to all streams with a single
+// call when complete in order to reduce the number of calls to the stream drivers.
+static struct {
+    uint_fast16_t length;
+    char data[REPORT_RT_BUFFER_SIZE];
+} rt_report = {0};
+
+static void rt_report_flush (void)
+{
+    if(rt_report.length) {
+        hal.stream.write_all(rt_report.data);
+        rt_report.length = 0;
+    }
+}
+
+// Append string to the real-time report buffer, flushes the buffer first if the string does not fit.
+static void rt_report_write (const char *s)
+{
+    size_t length = strlen(s);
+
+    if(rt_report.length + length >= sizeof(rt_report.data))
+        rt_report_flush();
+
+    if(length >= sizeof(rt_report.data))
+        hal.stream.write_all(s);
+    else {
+        memcpy(&rt_report.data[rt_report.length], s, length + 1);
+        rt_report.length += length;
+    }
+}
+
+#if REPORT_DELTA_FULL_INTERVAL
+
+static struct {
+    bool enabled;
+    bool hooked;
+    uint8_t counter;
+    on_stream_changed_ptr on_stream_changed;
+    struct {
+        char pos[sizeof(buf) + 7];
+        char bf[14];
+        char ln[16];
+        char fs[STRLEN_COORDVALUE * 3 + 8];
+    } last;
+} delta = {0};
+
+// Append real-time report element to the report buffer if changed since last output or a full report is due.
+// Elements longer than the last value buffer are always output.
+static void rt_report_changed (const char *s, char *last, size_t size, bool full_report)
+{
+    if(full_report || strncmp(s, last, size)) {
+        rt_report_write(s);
+        strncpy(last, s, size - 1);
+    }
+}
+
+// Change-only reports are enabled by the sender for the current stream, the mode is ended and the last reported
+// values are discarded when the stream changes.
+static void delta_stream_changed (stream_type_t type)
+{
+    delta.enabled = false;
+    memset(&delta.last, 0, sizeof(delta.last));
+
+    if(delta.on_stream_changed)
+        delta.on_stream_changed(type);
+}
+
+//! Enables or disables change-only real-time reports, a full report is sent first.
+void report_delta (bool enable)
+{
+    if(enable && !delta.hooked) {
+        delta.hooked = true;
+        delta.on_stream_changed = grbl.on_stream_changed;
+        grbl.on_stream_changed = delta_stream_changed;
+    }
+
+    delta.enabled = enable;
+    delta.counter = 0;
+}
+
+bool report_delta_enabled (void)
+{
+    return delta.enabled;
+}
+
+#endif
+
  // Prints real-time data. This function grabs a real-time snapshot of the stepper subprogram
  // and the actual location of the CNC machine. Users may change the following function to their
  // specific needs, but the desired real-time data report must be as short as possible. This is
  // requires as it minimizes the computational overhead and allows grbl to keep running smoothly,
  // especially during g-code programs with fast, short line segments and high frequency reports (5-20Hz).
+#if PROFILING_ENABLE
+
+static void realtime_status (void);
+
+void report_realtime_status (void)
+{
+    uint32_t t = profile_start();
+
+    realtime_status();
+
+    profile_end(Profile_ReportRealtimeStatus, t);
+}
+
+static void realtime_status (void)
+#else
 void report_realtime_status (void)
+#endif
 {
     static bool probing = false;
 
@@ -1099,62 +1386,62 @@ void report_realtime_status (void)
         probe_state = hal.probe.get_state();
 
     // Report current machine state and sub-states
-    hal.stream.write_all("<");
+    rt_report_write("<");
 
     sys_state_t state = state_get();
 
     switch (gc_state.tool_change && state == STATE_CYCLE ? STATE_TOOL_CHANGE : state) {
 
         case STATE_IDLE:
-            hal.stream.write_all("Idle");
+            rt_report_write("Idle");
             break;
 
         case STATE_CYCLE:
-            hal.stream.write_all("Run");
+            rt_report_write("Run");
             if(sys.probing_state == Probing_Active && settings.status_report.run_substate)
                 probing = true;
             else if (probing)
                 probing = probe_state.triggered;
             if(sys.flags.feed_hold_pending)
-                hal.stream.write_all(":1");
+                rt_report_write(":1");
             else if(probing)
-                hal.stream.write_all(":2");
+                rt_report_write(":2");
             break;
 
         case STATE_HOLD:
-            hal.stream.write_all(appendbuf(2, "Hold:", uitoa((uint32_t)(sys.holding_state - 1))));
+            rt_report_write(appendbuf(2, "Hold:", uitoa((uint32_t)(sys.holding_state - 1))));
             break;
 
         case STATE_JOG:
-            hal.stream.write_all("Jog");
+            rt_report_write("Jog");
             break;
 
         case STATE_HOMING:
-            hal.stream.write_all("Home");
+            rt_report_write("Home");
             break;
 
         case STATE_ESTOP:
         case STATE_ALARM:
             if((report.all || settings.status_report.alarm_substate) && sys.alarm)
-                hal.stream.write_all(appendbuf(2, "Alarm:", uitoa((uint32_t)sys.alarm)));
+                rt_report_write(appendbuf(2, "Alarm:", uitoa((uint32_t)sys.alarm)));
             else
-                hal.stream.write_all("Alarm");
+                rt_report_write("Alarm");
             break;
 
         case STATE_CHECK_MODE:
-            hal.stream.write_all("Check");
+            rt_report_write("Check");
             break;
 
         case STATE_SAFETY_DOOR:
-            hal.stream.write_all(appendbuf(2, "Door:", uitoa((uint32_t)sys.parking_state)));
+            rt_report_write(appendbuf(2, "Door:", uitoa((uint32_t)sys.parking_state)));
             break;
 
         case STATE_SLEEP:
-            hal.stream.write_all("Sleep");
+            rt_report_write("Sleep");
             break;
 
         case STATE_TOOL_CHANGE:
-            hal.stream.write_all("Tool");
+            rt_report_write("Tool");
             break;
     }
 
@@ -1169,26 +1456,59 @@ void report_realtime_status (void)
         }
     }
 
+#if REPORT_DELTA_FULL_INTERVAL
+
+    char element[sizeof(buf) + 7];
+    bool full_report = !delta.enabled || report.all || delta.counter == 0;
+
+    delta.counter = full_report ? REPORT_DELTA_FULL_INTERVAL - 1 : delta.counter - 1;
+
+    // Report position
+    strcpy(element, settings.status_report.machine_position ? "|MPos:" : "|WPos:");
+    strcat(element, get_axis_values(print_position));
+    rt_report_changed(element, delta.last.pos, sizeof(delta.last.pos), full_report);
+
+    // Returns planner and output stream buffer states.
+
+    if (settings.status_report.buffer_state) {
+        strcpy(element, "|Bf:");
+        strcat(element, uitoa((uint32_t)plan_get_block_buffer_available()));
+        strcat(element, ",");
+        strcat(element, uitoa(hal.stream.get_rx_buffer_free()));
+        rt_report_changed(element, delta.last.bf, sizeof(delta.last.bf), full_report);
+    }
+
+    if(settings.status_report.line_numbers) {
+        // Report current line number
+        plan_block_t *cur_block = plan_get_current_block();
+        if (cur_block != NULL && cur_block->line_number > 0)
+            rt_report_changed(appendbuf(2, "|Ln:", uitoa((uint32_t)cur_block->line_number)), delta.last.ln, sizeof(delta.last.ln), full_report);
+    }
+
+#else
+
     // Report position
-    hal.stream.write_all(settings.status_report.machine_position ? "|MPos:" : "|WPos:");
-    hal.stream.write_all(get_axis_values(print_position));
+    rt_report_write(settings.status_report.machine_position ? "|MPos:" : "|WPos:");
+    rt_report_write(get_axis_values(print_position));
 
     // Returns planner and output stream buffer states.
 
     if (settings.status_report.buffer_state) {
-        hal.stream.write_all("|Bf:");
-        hal.stream.write_all(uitoa((uint32_t)plan_get_block_buffer_available()));
-        hal.stream.write_all(",");
-        hal.stream.write_all(uitoa(hal.stream.get_rx_buffer_free()));
+        rt_report_write("|Bf:");
+        rt_report_write(uitoa((uint32_t)plan_get_block_buffer_available()));
+        rt_report_write(",");
+        rt_report_write(uitoa(hal.stream.get_rx_buffer_free()));
     }
 
     if(settings.status_report.line_numbers) {
         // Report current line number
         plan_block_t *cur_block = plan_get_current_block();
         if (cur_block != NULL && cur_block->line_number > 0)
-            hal.stream.write_all(appendbuf(2, "|Ln:", uitoa((uint32_t)cur_block->line_number)));
+            rt_report_write(appendbuf(2, "|Ln:", uitoa((uint32_t)cur_block->line_number)));
     }
 
+#endif
+
     spindle_ptrs_t *spindle_0;
     spindle_state_t spindle_0_state;
 
@@ -1197,13 +1517,24 @@ void report_realtime_status (void)
 
     // Report realtime feed speed
     if(settings.status_report.feed_speed) {
+#if REPORT_DELTA_FULL_INTERVAL
+        if(spindle_0->cap.variable) {
+            strcpy(element, appendbuf(2, "|FS:", get_rate_value(st_get_realtime_rate())));
+            strcat(element, appendbuf(2, ",", uitoa(spindle_0_state.on ? lroundf(spindle_0->param->rpm_overridden) : 0)));
+            if(spindle_0->get_data /* && sys.mpg_mode */)
+                strcat(element, appendbuf(2, ",", uitoa(lroundf(spindle_0->get_data(SpindleData_RPM)->rpm))));
+        } else
+            strcpy(element, appendbuf(2, "|F:", get_rate_value(st_get_realtime_rate())));
+        rt_report_changed(element, delta.last.fs, sizeof(delta.last.fs), full_report);
+#else
         if(spindle_0->cap.variable) {
-            hal.stream.write_all(appendbuf(2, "|FS:", get_rate_value(st_get_realtime_rate())));
-            hal.stream.write_all(appendbuf(2, ",", uitoa(spindle_0_state.on ? lroundf(spindle_0->param->rpm_overridden) : 0)));
+            rt_report_write(appendbuf(2, "|FS:", get_rate_value(st_get_realtime_rate())));
+            rt_report_write(appendbuf(2, ",", uitoa(spindle_0_state.on ? lroundf(spindle_0->param->rpm_overridden) : 0)));
             if(spindle_0->get_data /* && sys.mpg_mode */)
-                hal.stream.write_all(appendbuf(2, ",", uitoa(lroundf(spindle_0->get_data(SpindleData_RPM)->rpm))));
+                rt_report_write(appendbuf(2, ",", uitoa(lroundf(spindle_0->get_data(SpindleData_RPM)->rpm))));
         } else
-            hal.stream.write_all(appendbuf(2, "|F:", get_rate_value(st_get_realtime_rate())));
+            rt_report_write(appendbuf(2, "|F:", get_rate_value(st_get_realtime_rate())));
+#endif
     }
 
 #if N_SYS_SPINDLE > 1
@@ -1215,10 +1546,10 @@ void report_realtime_status (void)
 
         if((spindle_n = spindle_get(idx))) {
             spindle_n_state = spindle_n->get_state(spindle_n);
-            hal.stream.write_all(appendbuf(3, "|SP", uitoa(idx), ":"));
-            hal.stream.write_all(appendbuf(3, uitoa(spindle_n_state.on ? lroundf(spindle_n->param->rpm_overridden) : 0), ",,", spindle_n_state.on ? (spindle_n_state.ccw ? "C" : "S") : ""));
+            rt_report_write(appendbuf(3, "|SP", uitoa(idx), ":"));
+            rt_report_write(appendbuf(3, uitoa(spindle_n_state.on ? lroundf(spindle_n->param->rpm_overridden) : 0), ",,", spindle_n_state.on ? (spindle_n_state.ccw ? "C" : "S") : ""));
             if(settings.status_report.overrides)
-                hal.stream.write_all(appendbuf(2, ",", uitoa(spindle_n->param->override_pct)));
+                rt_report_write(appendbuf(2, ",", uitoa(spindle_n->param->override_pct)));
         }
     }
 
@@ -1260,7 +1591,7 @@ void report_realtime_status (void)
                 append = control_signals_tostring(append, ctrl_pin_state);
 
             *append = '\0';
-            hal.stream.write_all(buf);
+            rt_report_write(buf);
         }
     }
 
@@ -1294,19 +1625,19 @@ void report_realtime_status (void)
     if(report.value || gc_state.tool_change) {
 
         if(report.wco) {
-            hal.stream.write_all("|WCO:");
-            hal.stream.write_all(get_axis_values(wco));
+            rt_report_write("|WCO:");
+            rt_report_write(get_axis_values(wco));
         }
 
         if(report.gwco) {
-            hal.stream.write_all("|WCS:G");
-            hal.stream.write_all(map_coord_system(gc_state.modal.coord_system.id));
+            rt_report_write("|WCS:G");
+            rt_report_write(map_coord_system(gc_state.modal.coord_system.id));
         }
 
         if(report.overrides) {
-            hal.stream.write_all(appendbuf(2, "|Ov:", uitoa((uint32_t)sys.override.feed_rate)));
-            hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)sys.override.rapid_rate)));
-            hal.stream.write_all(appendbuf(2, ",", uitoa((uint32_t)spindle_0->param->override_pct)));
+            rt_report_write(appendbuf(2, "|Ov:", uitoa((uint32_t)sys.override.feed_rate)));
+            rt_report_write(appendbuf(2, ",", uitoa((uint32_t)sys.override.rapid_rate)));
+            rt_report_write(appendbuf(2, ",", uitoa((uint32_t)spindle_0->param->override_pct)));
         }
 
         if(report.spindle || report.coolant || report.tool || gc_state.tool_change) {
@@ -1336,58 +1667,83 @@ void report_realtime_status (void)
                 *append++ = 'T';
 
             *append = '\0';
-            hal.stream.write_all(buf);
+            rt_report_write(buf);
         }
 
         if(report.scaling) {
             axis_signals_tostring(buf, gc_get_g51_state());
-            hal.stream.write_all("|Sc:");
-            hal.stream.write_all(buf);
+            rt_report_write("|Sc:");
+            rt_report_write(buf);
         }
 
 #if COMPATIBILITY_LEVEL <= 1
         if((report.all || report.mpg_mode) && settings.report_interval) {
-            hal.stream.write_all(sys.flags.auto_reporting ? "|AR:" : "|AR");
+            rt_report_write(sys.flags.auto_reporting ? "|AR:" : "|AR");
             if(sys.flags.auto_reporting)
-                hal.stream.write_all(uitoa(settings.report_interval));
+                rt_report_write(uitoa(settings.report_interval));
         }
 #endif
 
         if(report.mpg_mode)
-            hal.stream.write_all(sys.mpg_mode ? "|MPG:1" : "|MPG:0");
+            rt_report_write(sys.mpg_mode ? "|MPG:1" : "|MPG:0");
+
+#if MOTION_FRAMES_ENABLE
+        if(report.all)
+            rt_report_write(sys.flags.motion_frames ? "|MF:1" : "|MF:0");
+#endif
 
         if(report.homed && (sys.homing.mask || settings.homing.flags.single_axis_commands || settings.homing.flags.manual)) {
             axes_signals_t homing = {sys.homing.mask ? sys.homing.mask : AXES_BITMASK};
-            hal.stream.write_all(appendbuf(2, "|H:", (homing.mask & sys.homed.mask) == homing.mask ? "1" : "0"));
+            rt_report_write(appendbuf(2, "|H:", (homing.mask & sys.homed.mask) == homing.mask ? "1" : "0"));
             if(settings.homing.flags.single_axis_commands)
-                hal.stream.write_all(appendbuf(2, ",", uitoa(sys.homed.mask)));
+                rt_report_write(appendbuf(2, ",", uitoa(sys.homed.mask)));
         }
 
         if(report.xmode && settings.mode == Mode_Lathe)
-            hal.stream.write_all(gc_state.modal.diameter_mode ? "|D:1" : "|D:0");
+            rt_report_write(gc_state.modal.diameter_mode ? "|D:1" : "|D:0");
 
         if(report.tool)
-            hal.stream.write_all(appendbuf(2, "|T:", uitoa((uint32_t)gc_state.tool->tool_id)));
+            rt_report_write(appendbuf(2, "|T:", uitoa((uint32_t)gc_state.tool->tool_id)));
 
         if(report.tlo_reference)
-            hal.stream.write_all(appendbuf(2, "|TLR:", uitoa(sys.tlo_reference_set.mask != 0)));
+            rt_report_write(appendbuf(2, "|TLR:", uitoa(sys.tlo_reference_set.mask != 0)));
 
         if(report.m66result && sys.var5399 > -2) { // M66 result
             if(sys.var5399 >= 0)
-                hal.stream.write_all(appendbuf(2, "|In:", uitoa(sys.var5399)));
+                rt_report_write(appendbuf(2, "|In:", uitoa(sys.var5399)));
             else
-                hal.stream.write_all("|In:-1");
+                rt_report_write("|In:-1");
         }
     }
 
+#if REPORT_AXIS_VELOCITY
+    if(report.all || (state_get() & (STATE_CYCLE|STATE_HOLD|STATE_JOG|STATE_SAFETY_DOOR))) {
+        uint_fast8_t idx;
+        float rates[N_AXIS];
+        st_get_realtime_axis_rates(rates);
+        for(idx = 0; idx < N_AXIS; idx++)
+            rt_report_write(appendbuf(2, idx ? "," : "|AV:", get_rate_value(rates[idx])));
+        rt_report_write(appendbuf(2, "|LA:", get_axis_value(plan_get_lookahead_distance())));
+    }
+#endif
+
+#if SEGMENT_BUFFER_MONITOR
+    if(report.all || (state_get() & (STATE_CYCLE|STATE_HOLD|STATE_JOG|STATE_SAFETY_DOOR))) {
+        st_buffer_stats_t *stats = st_get_buffer_stats();
+        rt_report_write(appendbuf(2, "|SB:", uitoa(stats->min_fill)));
+        rt_report_write(appendbuf(2, ",", uitoa(stats->underruns)));
+        rt_report_write(appendbuf(2, ",", stats->underruns && hal.get_elapsed_ticks ? uitoa(hal.get_elapsed_ticks() - stats->last_underrun) : "-"));
+    }
+#endif
+
     if(grbl.on_realtime_report)
-        grbl.on_realtime_report(hal.stream.write_all, sys.report);
+        grbl.on_realtime_report(rt_report_write, sys.report); // NOTE: handlers must output via the stream_write argument to keep output in order.
 
 #if COMPATIBILITY_LEVEL <= 1
     if(report.all) {
-        hal.stream.write_all("|FW:grblHAL");
+        rt_report_write("|FW:grblHAL");
         if(sys.blocking_event)
-            hal.stream.write_all("|$C:1");
+            rt_report_write("|$C:1");
     } else
 #endif
 
@@ -1418,7 +1774,8 @@ void report_realtime_status (void)
             system_set_exec_state_flag(EXEC_TLO_REPORT);
     }
 
-    hal.stream.write_all(">" ASCII_EOL);
+    rt_report_write(">" ASCII_EOL);
+    rt_report_flush();
 
     system_add_rt_report(Report_ClearAll);
     if(settings.status_report.work_coord_offset && wco_counter == 0)
@@ -1432,7 +1789,7 @@ static void report_bitfield (const char *format, bool bitmap)
     uint_fast16_t val = 1;
 
     // Copy string from Flash to RAM, strtok cannot be used unless doing so.
-    if((s = (char *)malloc(strlen(format) + 1))) {
+    if((s = (char *)mem_alloc(MemTag_Report, strlen(format) + 1))) {
 
         strcpy(s, format);
         char *element = strtok(s, ",");
@@ -1456,7 +1813,7 @@ static void report_bitfield (const char *format, bool bitmap)
             element = strtok(NULL, ",");
         }
 
-        free(s);
+        mem_free(s);
     }
 }
 
@@ -1777,9 +2134,24 @@ static bool print_unsorted (const setting_detail_t *setting, uint_fast16_t offse
     return true;
 }
 
-static status_code_t print_settings_details (settings_format_t format, setting_group_t group)
+#ifndef SETTINGS_REPORT_YIELD
+#define SETTINGS_REPORT_YIELD 8 // Number of settings output between calls to protocol_execute_realtime().
+#endif
+
+static bool hashing = false;
+static uint32_t hash;
+
+// Keeps the realtime loop running while long setting lists are output, returns false on abort.
+static inline bool details_yield (uint_fast16_t n_reported)
 {
-    uint_fast16_t idx, n_settings = 0;
+    return hashing || (n_reported % SETTINGS_REPORT_YIELD) || protocol_execute_realtime();
+}
+
+// Outputs settings details in id order, starting from the first setting with id >= first.
+// If count is > 0 output is limited to count settings and is followed by the id to start the next page from if more remains.
+static status_code_t print_settings_details (settings_format_t format, setting_group_t group, setting_id_t first, uint_fast16_t count)
+{
+    uint_fast16_t idx, n_settings = 0, n_reported = 0;
     bool reported = group == Group_All;
     const setting_detail_t *setting;
     report_args_t args;
@@ -1799,9 +2171,31 @@ static status_code_t print_settings_details (settings_format_t format, setting_g
     else if(format == SettingsFormat_grblHAL)
         hal.stream.write("$-Code\tSetting\tUnits\tDatatype\tData format\tSetting Description\tMin\tMax" ASCII_EOL);
 
+    const setting_index_entry_t *index;
+
+    if((n_settings = settings_get_index(&index))) {
+        for(idx = 0; idx < n_settings; idx++) {
+            setting = index[idx].setting;
+            if(setting->id >= first && (group == Group_All || setting->group == args.group) && (setting->is_available == NULL || setting->is_available(setting))) {
+                if(count && n_reported == count) {
+                    hal.stream.write("[SETTINGSNEXT:");
+                    hal.stream.write(uitoa(setting->id));
+                    hal.stream.write("]" ASCII_EOL);
+                    break;
+                }
+                if(settings_iterator(setting, print_sorted, &args))
+                    reported = true;
+                if(!details_yield(++n_reported))
+                    break;
+            }
+        }
+
+        return reported ? Status_OK : Status_SettingDisabled;
+    }
+
     details = settings_get_details();
 
-    if((all_settings = psetting = calloc(n_settings, sizeof(setting_detail_t *)))) {
+    if((all_settings = psetting = mem_calloc(MemTag_Report, n_settings, sizeof(setting_detail_t *)))) {
 
         n_settings = 0;
 
@@ -1818,20 +2212,32 @@ static status_code_t print_settings_details (settings_format_t format, setting_g
         qsort(all_settings, n_settings, sizeof(setting_detail_t *), cmp_settings);
 
         for(idx = 0; idx < n_settings; idx++) {
+            if(all_settings[idx]->id < first)
+                continue;
+            if(count && n_reported == count) {
+                hal.stream.write("[SETTINGSNEXT:");
+                hal.stream.write(uitoa(all_settings[idx]->id));
+                hal.stream.write("]" ASCII_EOL);
+                break;
+            }
             if(settings_iterator(all_settings[idx], print_sorted, &args))
                 reported = true;
+            if(!details_yield(++n_reported))
+                break;
         }
 
-        free(all_settings);
+        mem_free(all_settings);
 
     } else do {
         for(idx = 0; idx < details->n_settings; idx++) {
 
             setting = &details->settings[idx];
 
-            if(group == Group_All || setting->group == args.group) {
+            if(setting->id >= first && (group == Group_All || setting->group == args.group)) {
                 if(settings_iterator(setting, print_unsorted, &args))
                     reported = true;
+                if(!details_yield(++n_reported))
+                    return Status_OK;
             }
         }
     } while((details = details->next));
@@ -1854,7 +2260,108 @@ status_code_t report_settings_details (settings_format_t format, setting_id_t id
         return status;
     }
 
-    return print_settings_details(format, group);
+    return print_settings_details(format, group, (setting_id_t)0, 0);
+}
+
+/*! \brief Outputs a page of settings details, in id order.
+\param format a \a settings_format_t enum value.
+\param first id of the first setting to output, settings with lower ids are skipped.
+\param count max number of settings to output, 0 for all. If more settings remain output is ended by
+a [SETTINGSNEXT:<id>] line where id is the first setting of the next page.
+\returns \a status_code_t enum value.
+*/
+status_code_t report_settings_details_page (settings_format_t format, setting_id_t first, uint_fast16_t count)
+{
+    return print_settings_details(format, Group_All, first, count);
+}
+
+static struct {
+    stream_write_ptr write;
+    stream_write_n_ptr write_n;
+} hash_stream;
+
+static void hash_write (const char *s)
+{
+    while(*s)
+        hash = (hash ^ (uint8_t)*s++) * 16777619UL;
+}
+
+static void hash_write_n (const char *s, uint16_t length)
+{
+    while(length--)
+        hash = (hash ^ (uint8_t)*s++) * 16777619UL;
+}
+
+// Redirects stream output to the hash calculation until hash_end() is called.
+static void hash_begin (void)
+{
+    hash = 2166136261UL;
+    hashing = true;
+    hash_stream.write = hal.stream.write;
+    hash_stream.write_n = hal.stream.write_n;
+    hal.stream.write = hash_write;
+    if(hal.stream.write_n)
+        hal.stream.write_n = hash_write_n;
+}
+
+static uint32_t hash_end (void)
+{
+    hal.stream.write = hash_stream.write;
+    hal.stream.write_n = hash_stream.write_n;
+    hashing = false;
+
+    return hash;
+}
+
+/*! \brief Outputs a hash of the settings details as [SETTINGSHASH:<hex value>].
+
+The hash is calculated from the output of a full settings details report in the requested format and
+changes when settings are added or removed or their details changes. Senders may use it to decide
+whether a cached copy of the settings details is still valid.
+\param format a \a settings_format_t enum value.
+\returns \a status_code_t enum value.
+*/
+status_code_t report_settings_details_hash (settings_format_t format)
+{
+    hash_begin();
+    print_settings_details(format, Group_All, (setting_id_t)0, 0);
+    write_hash("[SETTINGSHASH:", hash_end());
+
+    return Status_OK;
+}
+
+static struct {
+    bool valid;
+    uint32_t value;
+} schema_hash = {0};
+
+/*! \brief Calculates a hash of the settings schema.
+
+The hash covers the machine readable output of the settings details, setting groups, alarms and
+error codes, as output by the $ES, $EG, $EA and $EE commands. It is reported by $I as [SCHEMA:<hex value>],
+clients may skip downloading these when the hash matches the one of a cached copy.
+The hash is cached until invalidated by report_settings_schema_invalidate().
+\returns the hash value.
+*/
+uint32_t report_settings_schema_hash (void)
+{
+    if(!schema_hash.valid) {
+        hash_begin();
+        print_settings_details(SettingsFormat_MachineReadable, Group_All, (setting_id_t)0, 0);
+        report_setting_group_details(true, NULL);
+        report_alarm_details(false);
+        report_error_details(false);
+        schema_hash.value = hash_end();
+        schema_hash.valid = true;
+    }
+
+    return schema_hash.value;
+}
+
+//! Discards the cached settings schema hash, to be called when settings, alarms or error codes are registered or settings changed.
+void report_settings_schema_invalidate (void)
+{
+    schema_hash.valid = false;
 }
 
 #ifndef NO_SETTINGS_DESCRIPTIONS
@@ -1920,7 +2427,7 @@ status_code_t report_alarm_details (bool grbl_format)
 
     details = grbl.on_get_alarms();
 
-    if((all_alarms = palarm = calloc(n_alarms, sizeof(alarm_detail_t *)))) {
+    if((all_alarms = palarm = mem_calloc(MemTag_Report, n_alarms, sizeof(alarm_detail_t *)))) {
 
         do {
             for(idx = 0; idx < details->n_alarms; idx++)
@@ -1932,7 +2439,7 @@ status_code_t report_alarm_details (bool grbl_format)
         for(idx = 0; idx < n_alarms; idx++)
             print_alarm(all_alarms[idx], grbl_format);
 
-        free(all_alarms);
+        mem_free(all_alarms);
 
     } else do {
         for(idx = 0; idx < details->n_alarms; idx++)
@@ -1980,7 +2487,7 @@ status_code_t report_error_details (bool grbl_format)
 
     details = grbl.on_get_errors();
 
-    if((all_errors = perror = calloc(n_errors, sizeof(status_detail_t *)))) {
+    if((all_errors = perror = mem_calloc(MemTag_Report, n_errors, sizeof(status_detail_t *)))) {
 
         do {
             for(idx = 0; idx < details->n_errors; idx++)
@@ -1992,7 +2499,7 @@ status_code_t report_error_details (bool grbl_format)
         for(idx = 0; idx < n_errors; idx++)
             print_error(all_errors[idx], grbl_format);
 
-        free(all_errors);
+        mem_free(all_errors);
 
     } else do {
         for(idx = 0; idx < details->n_errors; idx++)
@@ -2054,7 +2561,7 @@ status_code_t report_setting_group_details (bool by_id, char *prefix)
 
     details = settings_get_details();
 
-    if((all_groups = group = calloc(n_groups, sizeof(setting_group_detail_t *)))) {
+    if((all_groups = group = mem_calloc(MemTag_Report, n_groups, sizeof(setting_group_detail_t *)))) {
 
         uint_fast16_t idx;
 
@@ -2072,7 +2579,7 @@ status_code_t report_setting_group_details (bool by_id, char *prefix)
         for(idx = 0; idx < n_groups; idx++)
             print_setting_group(all_groups[idx], prefix);
 
-        free(all_groups);
+        mem_free(all_groups);
 
     } else do {
         for(idx = 0; idx < details->n_groups; idx++)
@@ -2442,6 +2949,578 @@ void report_pid_log (void)
 #endif
 }
 
+#if NGC_EXPRESSIONS_ENABLE
+
+status_code_t report_ngc_param_stats (sys_state_t state, char *args)
+{
+    ngc_param_stats_t *stats = ngc_params_get_stats();
+
+    hal.stream.write("[NGCPARAMS:");
+    hal.stream.write(uitoa(stats->params));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->named_params));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->memory_used));
+    hal.stream.write("]" ASCII_EOL);
+
+    return Status_OK;
+}
+
+#endif
+
+#if GC_OUTPUT_COMMAND_POOL_SIZE || GC_MESSAGE_POOL_SIZE
+
+status_code_t report_gc_pool_stats (sys_state_t state, char *args)
+{
+    gc_pool_stats_t *stats = gc_pool_get_stats();
+
+    hal.stream.write("[GCPOOL:");
+    hal.stream.write(uitoa(stats->output_commands));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->output_commands_used));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->output_commands_max));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->messages));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->messages_used));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->messages_max));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->heap_fallbacks));
+    hal.stream.write("]" ASCII_EOL);
+
+    return Status_OK;
+}
+
+#endif
+
+#if PROFILING_ENABLE
+
+void report_profile_data (void)
+{
+    profile_id_t id;
+    profile_data_t *data;
+
+    for(id = (profile_id_t)0; id < Profile_N; id++) {
+        data = profile_get_data(id);
+        hal.stream.write("[PROF:");
+        hal.stream.write(profile_get_name(id));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(data->count));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(data->min));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(data->count ? (uint32_t)(data->total / data->count) : 0));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(data->max));
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+static void report_latency_stage (profile_data_t *data)
+{
+    hal.stream.write(",");
+    hal.stream.write(uitoa(data->min));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(data->max));
+}
+
+//! Outputs count and min/max latencies from receipt to flag set, flag read and handled for each tracked realtime command.
+void report_latency_data (void)
+{
+    latency_id_t id;
+    latency_data_t *data;
+
+    for(id = (latency_id_t)0; id < Latency_N; id++) {
+        data = latency_get_data(id);
+        hal.stream.write("[LAT:");
+        hal.stream.write(latency_get_name(id));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(data->handled.count));
+        report_latency_stage(&data->flagged);
+        report_latency_stage(&data->picked_up);
+        report_latency_stage(&data->handled);
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+#endif
+
+#if MEM_ACCOUNTING_ENABLE
+
+//! Outputs planner size, heap status and current and peak allocations per subsystem.
+void report_memory_stats (void)
+{
+    mem_tag_t tag;
+    mem_stats_t *stats = mem_get_stats();
+    uint32_t free_mem = hal.get_free_mem ? hal.get_free_mem() : 0, largest = mem_get_largest_free();
+
+    hal.stream.write("[MEM:PLANNER,");
+    hal.stream.write(uitoa(plan_get_buffer_size()));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(settings.planner_buffer_blocks));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->tag[MemTag_Planner].bytes));
+    hal.stream.write("]" ASCII_EOL);
+
+    hal.stream.write("[MEM:HEAP,");
+    hal.stream.write(uitoa(free_mem));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->free_min));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(largest));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(free_mem > largest ? 100 - (uint32_t)((uint64_t)largest * 100 / free_mem) : 0));
+    hal.stream.write("]" ASCII_EOL);
+
+    for(tag = (mem_tag_t)0; tag < MemTag_N; tag++) {
+        hal.stream.write("[MEM:");
+        hal.stream.write(mem_tag_name(tag));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats->tag[tag].bytes));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats->tag[tag].peak));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats->tag[tag].blocks));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats->tag[tag].failed));
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    hal.stream.write("[MEM:TOTAL,");
+    hal.stream.write(uitoa(stats->bytes));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->peak));
+    hal.stream.write("]" ASCII_EOL);
+}
+
+#endif
+
+#if JOB_STATS_ENABLE
+
+static void report_histogram (const char *name, uint32_t *bins)
+{
+    uint_fast8_t idx;
+
+    hal.stream.write("[JOB:");
+    hal.stream.write(name);
+    for(idx = 0; idx < JOB_STATS_BINS; idx++) {
+        hal.stream.write(",");
+        hal.stream.write(uitoa(bins[idx]));
+    }
+    hal.stream.write("]" ASCII_EOL);
+}
+
+// Outputs statistics of the running or last job, times in ms and distances in mm.
+void report_job_stats (void)
+{
+    uint_fast8_t idx;
+    job_stats_t *stats = job_stats_get();
+
+    hal.stream.write("[JOB:TIME,");
+    hal.stream.write(uitoa(stats->duration));
+    hal.stream.write(stats->active ? ",1" : ",0");
+    hal.stream.write("]" ASCII_EOL);
+
+    for(idx = 0; idx < JOB_STATS_STATES; idx++) {
+        if(stats->state_time[idx]) {
+            hal.stream.write("[JOB:STATE,");
+            hal.stream.write(job_stats_state_name(idx));
+            hal.stream.write(",");
+            hal.stream.write(uitoa(stats->state_time[idx]));
+            hal.stream.write("]" ASCII_EOL);
+        }
+    }
+
+    hal.stream.write("[JOB:DIST,");
+    hal.stream.write(ftoa(stats->distance_feed, N_DECIMAL_COORDVALUE_MM));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(stats->distance_rapid, N_DECIMAL_COORDVALUE_MM));
+    hal.stream.write("]" ASCII_EOL);
+
+    hal.stream.write("[JOB:BLOCKS,");
+    hal.stream.write(uitoa(stats->blocks));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->blocks_limited));
+    hal.stream.write("]" ASCII_EOL);
+
+    report_histogram("PLANNER", stats->planner_fill);
+    report_histogram("SEGMENTS", stats->segment_fill);
+
+    hal.stream.write("[JOB:OVR,");
+    hal.stream.write(uitoa(stats->override_changes));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->override_time));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->feed_override_min));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->feed_override_max));
+    hal.stream.write("]" ASCII_EOL);
+}
+
+#endif
+
+void report_realtime_hooks (void)
+{
+    uint_fast8_t idx = 0;
+    realtime_hook_t *hook;
+
+    while((hook = protocol_get_realtime_hook(idx++))) {
+        hal.stream.write("[RTH:");
+        hal.stream.write(hook->name ? hook->name : "?");
+        hal.stream.write(",");
+        hal.stream.write(uitoa(hook->period));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(hook->calls));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(hook->calls ? (uint32_t)(hook->total / hook->calls) : 0));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(hook->max));
+        hal.stream.write("]" ASCII_EOL);
+    }
+}
+
+// Outputs boot phases with time at end of phase and duration in microseconds.
+status_code_t report_boot_phases (sys_state_t state, char *args)
+{
+    uint_fast8_t idx = 0;
+    uint32_t last = 0;
+    boot_phase_t *phase;
+
+    while((phase = protocol_get_boot_phase(idx++))) {
+        hal.stream.write("[BOOT:");
+        hal.stream.write(phase->name ? phase->name : "?");
+        hal.stream.write(",");
+        hal.stream.write(uitoa(phase->time));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(phase->time - last));
+        hal.stream.write("]" ASCII_EOL);
+        last = phase->time;
+    }
+
+    return Status_OK;
+}
+
+#if JOB_RESUME_ENABLE
+
+status_code_t report_job_checkpoint (sys_state_t state, char *args)
+{
+    job_checkpoint_t *checkpoint;
+
+    if((checkpoint = job_resume_load()) == NULL)
+        return Status_SDReadError;
+
+    hal.stream.write("[RSM:");
+    hal.stream.write(uitoa(checkpoint->block));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(checkpoint->offset));
+    hal.stream.write(",");
+    hal.stream.write(get_axis_values(checkpoint->position));
+    hal.stream.write("]" ASCII_EOL);
+
+    return Status_OK;
+}
+
+#endif
+
+#if VFS_READAHEAD_BUFFERS
+
+status_code_t report_vfs_readahead_stats (sys_state_t state, char *args)
+{
+    vfs_readahead_stats_t *stats = vfs_readahead_get_stats();
+
+    hal.stream.write("[VFSRA:");
+    hal.stream.write(uitoa(stats->refills));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->stalls));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->last_latency));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->max_latency));
+    hal.stream.write("]" ASCII_EOL);
+
+    return Status_OK;
+}
+
+#endif
+
+#if INPUT_EVENT_LOG_SIZE
+
+// Outputs an input event: [EVT:<sequence number>,<time>,<source>,<signals>,<machine position>]
+void report_input_event (uint32_t seq, const input_event_t *event)
+{
+    float position[N_AXIS];
+    char *append;
+
+    hal.stream.write("[EVT:");
+    hal.stream.write(uitoa(seq));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(event->time));
+
+    switch(event->source) {
+
+        case InputEvent_Control:
+            strcpy(buf, ",CTRL,");
+            append = control_signals_tostring(&buf[6], event->signals.control);
+            *append++ = ',';
+            *append = '\0';
+            break;
+
+        case InputEvent_Limit:
+            strcpy(buf, ",LIM,");
+            append = add_limits(&buf[5], event->signals.limits);
+            *append++ = ',';
+            *append = '\0';
+            break;
+
+        case InputEvent_Probe:
+            strcpy(buf, ",PRB,P,");
+            break;
+
+        default:
+            appendbuf(4, ",AUX", uitoa(event->port), event->signals.state ? ",1" : ",0", ",");
+            break;
+    }
+
+    hal.stream.write(buf);
+
+    system_convert_array_steps_to_mpos(position, (int32_t *)event->position);
+    hal.stream.write(get_axis_values(position));
+    hal.stream.write("]" ASCII_EOL);
+}
+
+#endif
+
+#if STREAM_TX_QUEUE_SIZE
+
+static void report_tx_queue (const io_stream_t *stream, const stream_tx_queue_stats_t *stats)
+{
+    hal.stream.write("[TXQ:");
+    hal.stream.write(uitoa(stream->type));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stream->instance));
+    hal.stream.write(stats->policy == StreamTxPolicy_Block ? ",BLOCK," : ",DROP,");
+    hal.stream.write(uitoa(stats->fill));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->max_fill));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->dropped));
+    hal.stream.write("]" ASCII_EOL);
+}
+
+// Outputs transmit queue statistics for each connection: [TXQ:<stream type>,<instance>,<policy>,<fill>,<max fill>,<dropped>]
+status_code_t report_stream_tx_queues (sys_state_t state, char *args)
+{
+    stream_enumerate_tx_queues(report_tx_queue);
+
+    return Status_OK;
+}
+
+#endif
+
+#if STEP_FIDELITY_MONITOR
+
+// Outputs step timing fidelity statistics: [STF:<segments>,<AMASS transitions>,<max period error ppm>,<mean period error ppm>,<max rate step>]
+// followed by the number of segments per AMASS level: [STF:AMASS,<level 0>,<level 1>,<level 2>,<level 3>].
+// $STF=RESET clears the statistics.
+status_code_t report_step_fidelity (sys_state_t state, char *args)
+{
+    uint_fast8_t idx;
+    st_fidelity_stats_t *stats = st_get_fidelity_stats();
+
+    if(args) {
+        if(strcmp(args, "RESET"))
+            return Status_InvalidStatement;
+        st_reset_fidelity_stats();
+        return Status_OK;
+    }
+
+    hal.stream.write("[STF:");
+    hal.stream.write(uitoa(stats->segments));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->amass_transitions));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(stats->period_error_max, 0));
+    hal.stream.write(",");
+    hal.stream.write(ftoa(stats->segments ? stats->period_error_sum / (float)stats->segments : 0.0f, 0));
+    hal.stream.write(",");
+    hal.stream.write(get_rate_value(stats->rate_step_max));
+    hal.stream.write("]" ASCII_EOL);
+
+    hal.stream.write("[STF:AMASS");
+    for(idx = 0; idx < sizeof(stats->amass_segments) / sizeof(uint32_t); idx++) {
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats->amass_segments[idx]));
+    }
+    hal.stream.write("]" ASCII_EOL);
+
+    return Status_OK;
+}
+
+#endif
+
+#if PROBE_SCAN_LOG_SIZE
+
+// Outputs pending samples in lines of up to 8 samples: [SCAN:<rate>,<logged>,<dropped>|<us>,<x>,<y>,<z>,<probe>,<analog>;...]
+// Positions are in machine coordinates. $SCAN=<rate> starts sampling at <rate> Hz, $SCAN=0 stops
+// and $SCAN=RESET discards pending samples and clears the counters.
+status_code_t report_probe_scan_log (sys_state_t state, char *args)
+{
+    uint_fast8_t axis;
+    uint_fast16_t idx, count;
+    float position[N_AXIS];
+    probe_scan_sample_t samples[8];
+    probe_scan_stats_t *stats = probe_scan_get_stats();
+
+    if(args) {
+        uint32_t rate;
+        uint_fast8_t cc = 0;
+        if(!strcmp(args, "RESET"))
+            probe_scan_reset();
+        else if(read_uint(args, &cc, &rate) != Status_OK || args[cc] != '\0')
+            return Status_BadNumberFormat;
+        else if(rate == 0)
+            probe_scan_stop();
+        else if(!probe_scan_start(rate))
+            return Status_InvalidStatement;
+        return Status_OK;
+    }
+
+    do {
+        count = probe_scan_read(samples, sizeof(samples) / sizeof(probe_scan_sample_t));
+
+        hal.stream.write("[SCAN:");
+        hal.stream.write(uitoa(stats->rate));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats->samples));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats->overruns));
+        hal.stream.write("|");
+        for(idx = 0; idx < count; idx++) {
+            if(idx)
+                hal.stream.write(";");
+            hal.stream.write(uitoa(samples[idx].time));
+            system_convert_array_steps_to_mpos(position, samples[idx].position);
+            for(axis = 0; axis < N_AXIS; axis++) {
+                hal.stream.write(",");
+                hal.stream.write(get_axis_value(position[axis]));
+            }
+            hal.stream.write(samples[idx].triggered ? ",1," : ",0,");
+            hal.stream.write(uitoa(samples[idx].analog));
+        }
+        hal.stream.write("]" ASCII_EOL);
+    } while(count == sizeof(samples) / sizeof(probe_scan_sample_t));
+
+    return Status_OK;
+}
+
+#endif
+
+#if SPINDLE_SYNC_LOG_SIZE
+
+// Outputs pending samples in lines of up to 32 samples: [SSL:<rate>,<logged>,<dropped>|<error>,<output>,...]
+// $SSL=RESET discards pending samples and clears the counters.
+status_code_t report_spindle_sync_log (sys_state_t state, char *args)
+{
+    uint_fast16_t idx, count;
+    spindle_sync_sample_t samples[32];
+    spindle_sync_log_stats_t *stats = spindle_sync_log_get_stats();
+
+    if(args) {
+        if(strcmp(args, "RESET"))
+            return Status_InvalidStatement;
+        spindle_sync_log_reset();
+        return Status_OK;
+    }
+
+    do {
+        count = spindle_sync_log_read(samples, sizeof(samples) / sizeof(spindle_sync_sample_t));
+
+        hal.stream.write("[SSL:");
+        hal.stream.write(ftoa(stats->sample_rate, 1));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats->samples));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(stats->overruns));
+        hal.stream.write("|");
+        for(idx = 0; idx < count; idx++) {
+            if(idx)
+                hal.stream.write(",");
+            hal.stream.write(ftoa(samples[idx].error, N_DECIMAL_PIDVALUE));
+            hal.stream.write(",");
+            hal.stream.write(ftoa(samples[idx].output, N_DECIMAL_PIDVALUE));
+        }
+        hal.stream.write("]" ASCII_EOL);
+    } while(count == sizeof(samples) / sizeof(spindle_sync_sample_t));
+
+    return Status_OK;
+}
+
+#endif
+
+status_code_t report_modbus_stats (sys_state_t state, char *args)
+{
+    modbus_stats_t *stats = modbus_get_stats();
+
+    if(!modbus_enabled())
+        return Status_InvalidStatement;
+
+    hal.stream.write("[MODBUS:");
+    hal.stream.write(uitoa(stats->transactions));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->merged));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->exceptions));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->latency_min));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->transactions ? (uint32_t)(stats->latency_total / stats->transactions) : 0));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->latency_max));
+    hal.stream.write("]" ASCII_EOL);
+
+    return Status_OK;
+}
+
+// Prints planner statistics.
+status_code_t report_planner_stats (sys_state_t state, char *args)
+{
+    planner_stats_t *stats = plan_get_stats();
+
+    hal.stream.write("[PLANNER:");
+    hal.stream.write(uitoa(plan_get_buffer_size()));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->recalc_count));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->recalc_max_blocks));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->recalc_truncated));
+    hal.stream.write(",");
+    hal.stream.write(hal.get_micros ? uitoa(stats->recalc_max_us) : "-");
+    hal.stream.write("]" ASCII_EOL);
+
+#if PLANNER_DIRECTION_CACHE_SIZE
+    hal.stream.write("[PLANNERCACHE:");
+    hal.stream.write(uitoa(stats->direction_hits));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->direction_misses));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->junction_hits));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats->junction_misses));
+    hal.stream.write("]" ASCII_EOL);
+#endif
+
+#if PLANNER_SEGMENT_MERGE_ENABLE
+    hal.stream.write("[PLANNERMERGE:");
+    hal.stream.write(uitoa(stats->segments_merged));
+    hal.stream.write("]" ASCII_EOL);
+#endif
+
+    return Status_OK;
+}
+
 static const report_t report_fns = {
     .init_message = report_init_message,
     .help_message = report_help_message,
@@ -93,6 +93,10 @@ status_code_t report_alarm_details (bool grbl_format);
 status_code_t report_error_details (bool grbl_format);
 status_code_t report_setting_group_details (bool by_id, char *prefix);
 status_code_t report_settings_details (settings_format_t format, setting_id_t setting, setting_group_t group);
+status_code_t report_settings_details_page (settings_format_t format, setting_id_t first, uint_fast16_t count);
+status_code_t report_settings_details_hash (settings_format_t format);
+uint32_t report_settings_schema_hash (void);
+void report_settings_schema_invalidate (void);
 #ifndef NO_SETTINGS_DESCRIPTIONS
 status_code_t report_setting_description (settings_format_t format, setting_id_t id);
 #endif
@@ -118,4 +122,65 @@ status_code_t report_time (void);
 // Prints current PID log.
 void report_pid_log (void);
 
+// Prints planner statistics.
+status_code_t report_planner_stats (sys_state_t state, char *args);
+// Prints statistics for Modbus transactions submitted via the scheduler.
+status_code_t report_modbus_stats (sys_state_t state, char *args);
+void report_realtime_hooks (void);
+status_code_t report_boot_phases (sys_state_t state, char *args);
+#if JOB_RESUME_ENABLE
+// Prints saved job checkpoint.
+status_code_t report_job_checkpoint (sys_state_t state, char *args);
+#endif
+#if VFS_READAHEAD_BUFFERS
+// Prints file read-ahead statistics.
+status_code_t report_vfs_readahead_stats (sys_state_t state, char *args);
+#endif
+#if INPUT_EVENT_LOG_SIZE
+// Prints an input event log entry.
+struct input_event;
+void report_input_event (uint32_t seq, const struct input_event *event);
+#endif
+#if STREAM_TX_QUEUE_SIZE
+// Prints transmit queue statistics of connected streams.
+status_code_t report_stream_tx_queues (sys_state_t state, char *args);
+#endif
+#if STEP_FIDELITY_MONITOR
+// Prints step timing fidelity statistics.
+status_code_t report_step_fidelity (sys_state_t state, char *args);
+#endif
+#if PROBE_SCAN_LOG_SIZE
+// Streams out pending digitising probe samples.
+status_code_t report_probe_scan_log (sys_state_t state, char *args);
+#endif
+#if SPINDLE_SYNC_LOG_SIZE
+// Streams out pending spindle sync control loop log samples.
+status_code_t report_spindle_sync_log (sys_state_t state, char *args);
+#endif
+#if NGC_EXPRESSIONS_ENABLE
+status_code_t report_ngc_param_stats (sys_state_t state, char *args);
+#endif
+#if GC_OUTPUT_COMMAND_POOL_SIZE || GC_MESSAGE_POOL_SIZE
+status_code_t report_gc_pool_stats (sys_state_t state, char *args);
+#endif
+#if PROFILING_ENABLE
+// Prints hot path profiling data.
+void report_profile_data (void);
+void report_latency_data (void);
+#endif
+#if MEM_ACCOUNTING_ENABLE
+void report_memory_stats (void);
+#endif
+#if JOB_STATS_ENABLE
+void report_job_stats (void);
+#endif
+#if REPORT_DELTA_FULL_INTERVAL
+void report_delta (bool enable);
+bool report_delta_enabled (void);
+#endif
+#if FLOW_CREDITS_ENABLE
+void report_flow_credits (bool enable);
+bool report_flow_credits_enabled (void);
+#endif
+
 #endif
@@ -31,7 +31,9 @@
 #include "config.h"
 #include "machine_limits.h"
 #include "nvs_buffer.h"
+#include "mem_stats.h"
 #include "tool_change.h"
+#include "tool_table.h"
 #include "state_machine.h"
 #if ENABLE_BACKLASH_COMPENSATION
 #include "motion_control.h"
@@ -209,6 +211,13 @@ PROGMEM const settings_t defaults = {
 #if ENABLE_BACKLASH_COMPENSATION
     .axis[X_AXIS].backlash = 0.0f,
 #endif
+#if ENABLE_JERK_ACCELERATION
+    .axis[X_AXIS].jerk = (DEFAULT_X_JERK * 60.0f * 60.0f * 60.0f),
+#endif
+#if ENABLE_INPUT_SHAPING
+    .axis[X_AXIS].shaper_frequency = DEFAULT_SHAPER_FREQUENCY,
+    .axis[X_AXIS].shaper_damping = DEFAULT_SHAPER_DAMPING,
+#endif
 
     .axis[Y_AXIS].steps_per_mm = DEFAULT_Y_STEPS_PER_MM,
     .axis[Y_AXIS].max_rate = DEFAULT_Y_MAX_RATE,
@@ -218,6 +227,13 @@ PROGMEM const settings_t defaults = {
 #if ENABLE_BACKLASH_COMPENSATION
     .axis[Y_AXIS].backlash = 0.0f,
 #endif
+#if ENABLE_JERK_ACCELERATION
+    .axis[Y_AXIS].jerk = (DEFAULT_Y_JERK * 60.0f * 60.0f * 60.0f),
+#endif
+#if ENABLE_INPUT_SHAPING
+    .axis[Y_AXIS].shaper_frequency = DEFAULT_SHAPER_FREQUENCY,
+    .axis[Y_AXIS].shaper_damping = DEFAULT_SHAPER_DAMPING,
+#endif
 
     .axis[Z_AXIS].steps_per_mm = DEFAULT_Z_STEPS_PER_MM,
     .axis[Z_AXIS].max_rate = DEFAULT_Z_MAX_RATE,
@@ -227,6 +243,13 @@ PROGMEM const settings_t defaults = {
 #if ENABLE_BACKLASH_COMPENSATION
     .axis[Z_AXIS].backlash = 0.0f,
 #endif
+#if ENABLE_JERK_ACCELERATION
+    .axis[Z_AXIS].jerk = (DEFAULT_Z_JERK * 60.0f * 60.0f * 60.0f),
+#endif
+#if ENABLE_INPUT_SHAPING
+    .axis[Z_AXIS].shaper_frequency = DEFAULT_SHAPER_FREQUENCY,
+    .axis[Z_AXIS].shaper_damping = DEFAULT_SHAPER_DAMPING,
+#endif
 
 #ifdef A_AXIS
     .axis[A_AXIS].steps_per_mm = DEFAULT_A_STEPS_PER_MM,
@@ -236,6 +259,13 @@ PROGMEM const settings_t defaults = {
     .axis[A_AXIS].dual_axis_offset = 0.0f,
 #if ENABLE_BACKLASH_COMPENSATION
     .axis[A_AXIS].backlash = 0.0f,
+#endif
+#if ENABLE_JERK_ACCELERATION
+    .axis[A_AXIS].jerk = (DEFAULT_A_JERK * 60.0f * 60.0f * 60.0f),
+#endif
+#if ENABLE_INPUT_SHAPING
+    .axis[A_AXIS].shaper_frequency = DEFAULT_SHAPER_FREQUENCY,
+    .axis[A_AXIS].shaper_damping = DEFAULT_SHAPER_DAMPING,
 #endif
     .homing.cycle[3].mask = DEFAULT_HOMING_CYCLE_3,
 #endif
@@ -248,6 +278,13 @@ PROGMEM const settings_t defaults = {
     .axis[B_AXIS].dual_axis_offset = 0.0f,
 #if ENABLE_BACKLASH_COMPENSATION
     .axis[B_AXIS].backlash = 0.0f,
+#endif
+#if ENABLE_JERK_ACCELERATION
+    .axis[B_AXIS].jerk = (DEFAULT_B_JERK * 60.0f * 60.0f * 60.0f),
+#endif
+#if ENABLE_INPUT_SHAPING
+    .axis[B_AXIS].shaper_frequency = DEFAULT_SHAPER_FREQUENCY,
+    .axis[B_AXIS].shaper_damping = DEFAULT_SHAPER_DAMPING,
 #endif
     .homing.cycle[4].mask = DEFAULT_HOMING_CYCLE_4,
 #endif
@@ -260,6 +297,13 @@ PROGMEM const settings_t defaults = {
     .axis[C_AXIS].dual_axis_offset = 0.0f,
 #if ENABLE_BACKLASH_COMPENSATION
     .axis[C_AXIS].backlash = 0.0f,
+#endif
+#if ENABLE_JERK_ACCELERATION
+    .axis[C_AXIS].jerk = (DEFAULT_C_JERK * 60.0f * 60.0f * 60.0f),
+#endif
+#if ENABLE_INPUT_SHAPING
+    .axis[C_AXIS].shaper_frequency = DEFAULT_SHAPER_FREQUENCY,
+    .axis[C_AXIS].shaper_damping = DEFAULT_SHAPER_DAMPING,
 #endif
     .homing.cycle[5].mask = DEFAULT_HOMING_CYCLE_5,
 #endif
@@ -273,6 +317,13 @@ PROGMEM const settings_t defaults = {
 #if ENABLE_BACKLASH_COMPENSATION
     .axis[U_AXIS].backlash = 0.0f,
 #endif
+#if ENABLE_JERK_ACCELERATION
+    .axis[U_AXIS].jerk = (DEFAULT_U_JERK * 60.0f * 60.0f * 60.0f),
+#endif
+#if ENABLE_INPUT_SHAPING
+    .axis[U_AXIS].shaper_frequency = DEFAULT_SHAPER_FREQUENCY,
+    .axis[U_AXIS].shaper_damping = DEFAULT_SHAPER_DAMPING,
+#endif
 #endif
 
 #ifdef V_AXIS
@@ -284,6 +335,13 @@ PROGMEM const settings_t defaults = {
 #if ENABLE_BACKLASH_COMPENSATION
     .axis[V_AXIS].backlash = 0.0f,
 #endif
+#if ENABLE_JERK_ACCELERATION
+    .axis[V_AXIS].jerk = (DEFAULT_V_JERK * 60.0f * 60.0f * 60.0f),
+#endif
+#if ENABLE_INPUT_SHAPING
+    .axis[V_AXIS].shaper_frequency = DEFAULT_SHAPER_FREQUENCY,
+    .axis[V_AXIS].shaper_damping = DEFAULT_SHAPER_DAMPING,
+#endif
 #endif
 
     .tool_change.mode = (toolchange_mode_t)DEFAULT_TOOLCHANGE_MODE,
@@ -304,7 +362,13 @@ PROGMEM const settings_t defaults = {
     .safety_door.flags.ignore_when_idle = DEFAULT_DOOR_IGNORE_WHEN_IDLE,
     .safety_door.flags.keep_coolant_on = DEFAULT_DOOR_KEEP_COOLANT_ON,
     .safety_door.spindle_on_delay = DEFAULT_SAFETY_DOOR_SPINDLE_DELAY,
-    .safety_door.coolant_on_delay = DEFAULT_SAFETY_DOOR_COOLANT_DELAY
+    .safety_door.coolant_on_delay = DEFAULT_SAFETY_DOOR_COOLANT_DELAY,
+#if ENABLE_INPUT_SHAPING
+    .input_shaper = DEFAULT_INPUT_SHAPER,
+#endif
+#if ENABLE_BACKLASH_COMPENSATION
+    .backlash_takeup = DEFAULT_BACKLASH_TAKEUP
+#endif
 };
 
 static bool group_is_available (const setting_group_detail_t *group)
@@ -387,6 +451,9 @@ static status_code_t set_force_initialization_alarm (setting_id_t id, uint_fast1
 static status_code_t set_probe_allow_feed_override (setting_id_t id, uint_fast16_t int_value);
 static status_code_t set_tool_change_mode (setting_id_t id, uint_fast16_t int_value);
 static status_code_t set_tool_change_probing_distance (setting_id_t id, float value);
+#if ENABLE_BACKLASH_COMPENSATION
+static status_code_t set_backlash_takeup (setting_id_t id, float value);
+#endif
 static status_code_t set_tool_restore_pos (setting_id_t id, uint_fast16_t int_value);
 static status_code_t set_ganged_dir_invert (setting_id_t id, uint_fast16_t int_value);
 static status_code_t set_stepper_deenergize_mask (setting_id_t id, uint_fast16_t int_value);
@@ -434,6 +501,9 @@ static char spindle_types[100] = "";
 static char axis_dist[4] = "mm";
 static char axis_rate[8] = "mm/min";
 static char axis_accel[10] = "mm/sec^2";
+#if ENABLE_JERK_ACCELERATION
+static char axis_jerk[10] = "mm/sec^3";
+#endif
 #if DELTA_ROBOT
 static char axis_steps[9] = "step/rev";
 #elif SCARA
@@ -565,6 +635,13 @@ PROGMEM static const setting_detail_t setting_detail[] = {
      { Setting_AxisMaxRate, Group_Axis0, "-axis maximum rate", axis_rate, Format_Decimal, "#####0.000", NULL, NULL, Setting_IsLegacyFn, set_axis_setting, get_float, NULL, AXIS_OPTS },
      { Setting_AxisAcceleration, Group_Axis0, "-axis acceleration", axis_accel, Format_Decimal, "#####0.000", NULL, NULL, Setting_IsLegacyFn, set_axis_setting, get_float, NULL, AXIS_OPTS },
      { Setting_AxisMaxTravel, Group_Axis0, "-axis maximum travel", axis_dist, Format_Decimal, "#####0.000", NULL, NULL, Setting_IsLegacyFn, set_axis_setting, get_float, NULL, AXIS_OPTS },
+#if ENABLE_JERK_ACCELERATION
+     { Setting_AxisJerk, Group_Axis0, "-axis jerk", axis_jerk, Format_Decimal, "#####0.000", NULL, NULL, Setting_IsExtendedFn, set_axis_setting, get_float, NULL, AXIS_OPTS },
+#endif
+#if ENABLE_INPUT_SHAPING
+     { Setting_AxisShaperFrequency, Group_Axis0, "-axis input shaper frequency", "Hz", Format_Decimal, "##0.0", "0", "500", Setting_IsExtendedFn, set_axis_setting, get_float, NULL, AXIS_OPTS },
+     { Setting_AxisShaperDamping, Group_Axis0, "-axis input shaper damping ratio", NULL, Format_Decimal, "0.000", "0", "0.5", Setting_IsExtendedFn, set_axis_setting, get_float, NULL, AXIS_OPTS },
+#endif
 #if ENABLE_BACKLASH_COMPENSATION
      { Setting_AxisBacklash, Group_Axis0, "-axis backlash compensation", axis_dist, Format_Decimal, "#####0.000", NULL, NULL, Setting_IsExtendedFn, set_axis_setting, get_float, NULL, AXIS_OPTS },
 #endif
@@ -620,7 +697,13 @@ PROGMEM static const setting_detail_t setting_detail[] = {
      { Setting_OffsetLock, Group_General, "Lock coordinate systems", NULL, Format_Bitfield, "G59.1,G59.2,G59.3", NULL, NULL, Setting_IsExtendedFn, set_offset_lock, get_int, NULL },
 #endif
      { Setting_EncoderSpindle, Group_Spindle, "Encoder spindle", NULL, Format_RadioButtons, spindle_types, NULL, NULL, Setting_IsExtendedFn, set_encoder_spindle, get_int, is_setting_available },
-     { Setting_FSOptions, Group_General, "File systems options", NULL, Format_Bitfield, fs_options, NULL, NULL, Setting_IsExtended, &settings.fs_options.mask, NULL, is_setting_available }
+     { Setting_FSOptions, Group_General, "File systems options", NULL, Format_Bitfield, fs_options, NULL, NULL, Setting_IsExtended, &settings.fs_options.mask, NULL, is_setting_available },
+#if ENABLE_INPUT_SHAPING
+     { Setting_InputShaper, Group_General, "Input shaper", NULL, Format_RadioButtons, "Off,ZV,ZVD,MZV", NULL, NULL, Setting_IsExtended, &settings.input_shaper, NULL, NULL },
+#endif
+#if ENABLE_BACKLASH_COMPENSATION
+     { Setting_BacklashTakeUp, Group_General, "Backlash take-up distance", "mm", Format_Decimal, "##0.000", "0", "100", Setting_IsExtendedFn, set_backlash_takeup, get_float, NULL }
+#endif
 };
 
 #ifndef NO_SETTINGS_DESCRIPTIONS
@@ -753,6 +836,13 @@ PROGMEM static const setting_descr_t setting_descr[] = {
     { (setting_id_t)(Setting_AxisStepsPerMM + 1), "Travel resolution in steps per degree." }, // "Hack" to get correct description for rotary axes
     { Setting_AxisMaxRate, "Maximum rate. Used as G0 rapid rate." },
     { Setting_AxisAcceleration, "Acceleration. Used for motion planning to not exceed motor torque and lose steps." },
+#if ENABLE_JERK_ACCELERATION
+    { Setting_AxisJerk, "Maximum rate of change of acceleration. Used by the step segment generator to shape acceleration ramps." },
+#endif
+#if ENABLE_INPUT_SHAPING
+    { Setting_AxisShaperFrequency, "Resonance frequency of the axis, set to 0 to disable input shaping for moves dominated by the axis." },
+    { Setting_AxisShaperDamping, "Damping ratio of the axis resonance." },
+#endif
     { Setting_AxisMaxTravel, "Maximum axis travel distance from homing switch. Determines valid machine space for soft-limits and homing search distances." },
 #if ENABLE_BACKLASH_COMPENSATION
     { Setting_AxisBacklash, "Backlash distance to compensate for." },
@@ -796,7 +886,11 @@ PROGMEM static const setting_descr_t setting_descr[] = {
     { Setting_NGCDebugOut, "Example: (debug, metric mode: #<_metric>, coord system: #5220)" },
 #endif
     { Setting_EncoderSpindle, "Specifies which spindle has the encoder attached." },
-    { Setting_FSOptions, "Auto mount SD card on startup." }
+    { Setting_FSOptions, "Auto mount SD card on startup." },
+#if ENABLE_BACKLASH_COMPENSATION
+    { Setting_BacklashTakeUp, "Motion distance over which backlash take-up steps are added to the motion following a direction reversal.\\n"
+                              "Set to 0 to insert separate backlash compensation motions instead." }
+#endif
 };
 
 #endif
@@ -836,10 +930,13 @@ static void restore_override_backup (void)
 {
     uint_fast8_t idx = N_AXIS;
 
-    if(override_backup.valid) do {
-        idx--;
-        settings.axis[idx].acceleration = override_backup.acceleration[idx];
-    } while(idx);
+    if(override_backup.valid) {
+        do {
+            idx--;
+            settings.axis[idx].acceleration = override_backup.acceleration[idx];
+        } while(idx);
+        plan_cache_invalidate(); // Cached direction limits are derived from the acceleration settings.
+    }
 }
 
 // Temporarily override acceleration, if 0 restore to setting value.
@@ -860,6 +957,8 @@ bool settings_override_acceleration (uint8_t axis, float acceleration)
         settings.axis[axis].acceleration = acceleration * 60.0f * 60.0f; // Limit max to setting value?
     }
 
+    plan_cache_invalidate(); // Cached direction limits are derived from the acceleration settings.
+
     return true;
 }
 
@@ -867,10 +966,33 @@ bool settings_override_acceleration (uint8_t axis, float acceleration)
 
 static setting_details_t *settingsd = &setting_details;
 
+#if SETTINGS_LOOKUP_INDEX
+
+static struct {
+    uint_fast16_t n_settings;
+    setting_index_entry_t *entry;
+} settings_index = {0};
+
+static void settings_index_invalidate (void)
+{
+    if(settings_index.entry) {
+        mem_free(settings_index.entry);
+        settings_index.entry = NULL;
+    }
+    settings_index.n_settings = 0;
+}
+
+#endif
+
 void settings_register (setting_details_t *details)
 {
     settingsd->next = details;
     settingsd = details;
+
+#if SETTINGS_LOOKUP_INDEX
+    settings_index_invalidate();
+#endif
+    report_settings_schema_invalidate();
 }
 
 setting_details_t *settings_get_details (void)
@@ -1298,6 +1420,20 @@ static status_code_t set_tool_change_probing_distance (setting_id_t id, float va
     return Status_OK;
 }
 
+#if ENABLE_BACKLASH_COMPENSATION
+
+static status_code_t set_backlash_takeup (setting_id_t id, float value)
+{
+    if(settings.backlash_takeup != value) {
+        settings.backlash_takeup = value;
+        mc_backlash_init((axes_signals_t){AXES_BITMASK});
+    }
+
+    return Status_OK;
+}
+
+#endif
+
 static status_code_t set_tool_restore_pos (setting_id_t id, uint_fast16_t int_value)
 {
     if(hal.driver_cap.atc)
@@ -1349,6 +1485,10 @@ static const char *set_axis_setting_unit (setting_id_t setting_id, uint_fast8_t
             unit = is_rotary ? "deg/sec^2" : "mm/sec^2";
             break;
 
+        case Setting_AxisJerk:
+            unit = is_rotary ? "deg/sec^3" : "mm/sec^3";
+            break;
+
         case Setting_AxisMaxTravel:
         case Setting_AxisBacklash:
             unit = is_rotary ? "deg" : "mm";
@@ -1457,6 +1597,22 @@ static status_code_t set_axis_setting (setting_id_t setting, float value)
             settings.axis[idx].acceleration = override_backup.acceleration[idx] = value * 60.0f * 60.0f; // Convert to mm/min^2 for grbl internal use.
             break;
 
+#if ENABLE_JERK_ACCELERATION
+        case Setting_AxisJerk:
+            settings.axis[idx].jerk = value * 60.0f * 60.0f * 60.0f; // Convert to mm/min^3 for grbl internal use.
+            break;
+#endif
+
+#if ENABLE_INPUT_SHAPING
+        case Setting_AxisShaperFrequency:
+            settings.axis[idx].shaper_frequency = value;
+            break;
+
+        case Setting_AxisShaperDamping:
+            settings.axis[idx].shaper_damping = value;
+            break;
+#endif
+
         case Setting_AxisMaxTravel:
             if(settings.axis[idx].max_travel != -value) {
                 bit_false(sys.homed.mask, bit(idx));
@@ -1502,7 +1658,11 @@ static float get_float (setting_id_t setting)
 {
     float value = 0.0f;
 
-    if (setting >= Setting_AxisSettingsBase && setting <= Setting_AxisSettingsMax) {
+    if ((setting >= Setting_AxisSettingsBase && setting <= Setting_AxisSettingsMax)
+#if ENABLE_JERK_ACCELERATION || ENABLE_INPUT_SHAPING
+         || (setting >= Setting_AxisSettingsBase2 && setting <= Setting_AxisSettingsMax2)
+#endif
+        ) {
 
         uint_fast8_t idx;
 
@@ -1524,6 +1684,22 @@ static float get_float (setting_id_t setting)
                 value = -settings.axis[idx].max_travel; // Store as negative for grbl internal use.
                 break;
 
+#if ENABLE_JERK_ACCELERATION
+            case Setting_AxisJerk:
+                value = settings.axis[idx].jerk / (60.0f * 60.0f * 60.0f); // Convert from mm/min^3 to mm/sec^3.
+                break;
+#endif
+
+#if ENABLE_INPUT_SHAPING
+            case Setting_AxisShaperFrequency:
+                value = settings.axis[idx].shaper_frequency;
+                break;
+
+            case Setting_AxisShaperDamping:
+                value = settings.axis[idx].shaper_damping;
+                break;
+#endif
+
 #if ENABLE_BACKLASH_COMPENSATION
             case Setting_AxisBacklash:
                 value = settings.axis[idx].backlash;
@@ -1543,6 +1719,12 @@ static float get_float (setting_id_t setting)
             value = settings.tool_change.probing_distance;
             break;
 
+#if ENABLE_BACKLASH_COMPENSATION
+        case Setting_BacklashTakeUp:
+            value = settings.backlash_takeup;
+            break;
+#endif
+
         default:
             break;
     }
@@ -2057,6 +2239,47 @@ bool settings_read_startup_line (uint8_t idx, char *line)
     return true;
 }
 
+// RAM mirror of coordinate data, avoids reading persistent storage on each coordinate system switch.
+static struct {
+    coord_data_t data;
+    uint8_t checksum;
+    bool valid;
+} coord_cache[N_CoordinateSystems] = {0};
+
+static void coord_cache_store (coord_system_id_t id, float (*coord_data)[N_AXIS])
+{
+    if(id < N_CoordinateSystems) {
+        memcpy(&coord_cache[id].data, coord_data, sizeof(coord_data_t));
+        coord_cache[id].checksum = calc_checksum((uint8_t *)&coord_cache[id].data, sizeof(coord_data_t));
+        coord_cache[id].valid = true;
+    }
+}
+
+static inline bool coord_cache_read (coord_system_id_t id, float (*coord_data)[N_AXIS])
+{
+    if(id < N_CoordinateSystems && coord_cache[id].valid &&
+        coord_cache[id].checksum == calc_checksum((uint8_t *)&coord_cache[id].data, sizeof(coord_data_t))) {
+        memcpy(coord_data, &coord_cache[id].data, sizeof(coord_data_t));
+        return true;
+    }
+
+    return false;
+}
+
+// Load all coordinate data from persistent storage to the RAM mirror.
+// Entries that fail the CRC check are left out and handled by settings_read_coord_data().
+void settings_load_coord_data (void)
+{
+    coord_data_t coord_data;
+    coord_system_id_t id = N_CoordinateSystems;
+
+    do {
+        coord_cache[--id].valid = false;
+        if(hal.nvs.type != NVS_None && hal.nvs.memcpy_from_nvs((uint8_t *)&coord_data, NVS_ADDR_PARAMETERS + id * (sizeof(coord_data_t) + NVS_CRC_BYTES), sizeof(coord_data_t), true) == NVS_TransferResult_OK)
+            coord_cache_store(id, &coord_data.values);
+    } while(id);
+}
+
 // Write selected coordinate data to persistent storage.
 void settings_write_coord_data (coord_system_id_t id, float (*coord_data)[N_AXIS])
 {
@@ -2066,21 +2289,29 @@ void settings_write_coord_data (coord_system_id_t id, float (*coord_data)[N_AXIS
     protocol_buffer_synchronize();
 #endif
 
-    if(hal.nvs.type != NVS_None)
+    if(hal.nvs.type != NVS_None) {
+        coord_cache_store(id, coord_data);
         hal.nvs.memcpy_to_nvs(NVS_ADDR_PARAMETERS + id * (sizeof(coord_data_t) + NVS_CRC_BYTES), (uint8_t *)coord_data, sizeof(coord_data_t), true);
+    }
 }
 
-// Read selected coordinate data from persistent storage.
+// Read selected coordinate data from the RAM mirror, or from persistent storage if not available.
 bool settings_read_coord_data (coord_system_id_t id, float (*coord_data)[N_AXIS])
 {
     assert(id <= N_CoordinateSystems);
 
+    if(coord_cache_read(id, coord_data))
+        return true;
+
     if (!(hal.nvs.type != NVS_None && hal.nvs.memcpy_from_nvs((uint8_t *)coord_data, NVS_ADDR_PARAMETERS + id * (sizeof(coord_data_t) + NVS_CRC_BYTES), sizeof(coord_data_t), true) == NVS_TransferResult_OK)) {
         // Reset with default zero vector
         memset(coord_data, 0, sizeof(coord_data_t));
         settings_write_coord_data(id, coord_data);
         return false;
     }
+
+    coord_cache_store(id, coord_data);
+
     return true;
 }
 
@@ -2188,6 +2419,8 @@ void settings_restore (settings_restore_t restore)
     memset(empty_line, 0xFF, sizeof(stored_line_t));
     *empty_line = '\0';
 
+    report_settings_schema_invalidate();
+
     hal.nvs.put_byte(0, SETTINGS_VERSION); // Forces write to physical storage
 
     if (restore.defaults) {
@@ -2215,6 +2448,8 @@ void settings_restore (settings_restore_t restore)
 
 #if N_TOOLS
         settings_clear_tool_data();
+#elif TOOL_TABLE_ENABLE
+        grbl.tool_table.clear();
 #endif
     }
 
@@ -2335,32 +2570,142 @@ bool settings_iterator (const setting_detail_t *setting, setting_output_ptr call
     return ok;
 }
 
-const setting_detail_t *setting_get_details (setting_id_t id, setting_details_t **set)
+#if SETTINGS_LOOKUP_INDEX
+
+static int cmp_index_entries (const void *a, const void *b)
 {
-    uint_fast16_t idx, offset = id - normalize_id(id);
+    return (int)((setting_index_entry_t *)a)->setting->id - (int)((setting_index_entry_t *)b)->setting->id;
+}
+
+static bool settings_index_build (void)
+{
+    uint_fast16_t idx, n_settings = 0;
+    setting_index_entry_t *entry;
     setting_details_t *details = settings_get_details();
 
-    id -= offset;
+    do {
+        n_settings += details->n_settings;
+    } while((details = details->next));
 
+    if(n_settings == 0 || (entry = settings_index.entry = mem_alloc(MemTag_Settings, n_settings * sizeof(setting_index_entry_t))) == NULL)
+        return false;
+
+    details = settings_get_details();
     do {
         for(idx = 0; idx < details->n_settings; idx++) {
-            if(details->settings[idx].id == id && is_available(&details->settings[idx])) {
+            entry->setting = &details->settings[idx];
+            entry->details = details;
+            entry++;
+        }
+    } while((details = details->next));
+
+    qsort(settings_index.entry, n_settings, sizeof(setting_index_entry_t), cmp_index_entries);
+
+    settings_index.n_settings = n_settings;
+
+    return true;
+}
+
+// Returns true if entry precedes setting in registration order, sort order is not stable for settings with the same id.
+static bool settings_index_precedes (const setting_index_entry_t *entry, setting_details_t *set, const setting_detail_t *setting)
+{
+    if(entry->details == set)
+        return entry->setting < setting;
+
+    setting_details_t *details = settings_get_details();
+
+    do {
+        if(details == entry->details)
+            return true;
+        if(details == set)
+            return false;
+    } while((details = details->next));
+
+    return false;
+}
+
+#endif
+
+/*! \brief Get the settings index, sorted by setting id. Builds the index if not available.
+\param index pointer to a variable that will receive a pointer to the first entry of the index.
+\returns number of entries in index, 0 if the index is not available.
+*/
+uint_fast16_t settings_get_index (const setting_index_entry_t **index)
+{
+#if SETTINGS_LOOKUP_INDEX
+    if(settings_index.entry || settings_index_build()) {
+        *index = settings_index.entry;
+        return settings_index.n_settings;
+    }
+#endif
+
+    *index = NULL;
+
+    return 0;
+}
+
+const setting_detail_t *setting_get_details (setting_id_t id, setting_details_t **set)
+{
+    uint_fast16_t idx, offset = id - normalize_id(id);
+    setting_details_t *details = NULL;
+    const setting_detail_t *setting = NULL;
+
+    id -= offset;
 
-                if(details->settings[idx].group == Group_Axis0 && grbl.on_set_axis_setting_unit)
-                    set_axis_unit(&details->settings[idx], grbl.on_set_axis_setting_unit(details->settings[idx].id, offset));
+#if SETTINGS_LOOKUP_INDEX
+    const setting_index_entry_t *index;
+    uint_fast16_t n_settings;
 
-                if(offset && details->iterator == NULL && offset >= (details->settings[idx].group == Group_Encoder0 ? hal.encoder.get_n_encoders() : N_AXIS))
-                    return NULL;
+    if((n_settings = settings_get_index(&index))) {
 
-                if(set)
-                    *set = details;
+        uint_fast16_t hi = n_settings;
 
-                return &details->settings[idx];
+        idx = 0;
+
+        // Binary search for the first entry with the requested id.
+        while(idx < hi) {
+            uint_fast16_t mid = (idx + hi) >> 1;
+            if(index[mid].setting->id < id)
+                idx = mid + 1;
+            else
+                hi = mid;
+        }
+
+        // Select the first available setting in registration order if there are duplicates.
+        for(; idx < n_settings && index[idx].setting->id == id; idx++) {
+            if(is_available(index[idx].setting) && (setting == NULL || settings_index_precedes(&index[idx], details, setting))) {
+                setting = index[idx].setting;
+                details = index[idx].details;
             }
         }
-    } while((details = details->next));
+    } else
+#endif
+    {
+        details = settings_get_details();
+
+        do {
+            for(idx = 0; idx < details->n_settings; idx++) {
+                if(details->settings[idx].id == id && is_available(&details->settings[idx])) {
+                    setting = &details->settings[idx];
+                    break;
+                }
+            }
+        } while(setting == NULL && (details = details->next));
+    }
+
+    if(setting) {
+
+        if(setting->group == Group_Axis0 && grbl.on_set_axis_setting_unit)
+            set_axis_unit(setting, grbl.on_set_axis_setting_unit(setting->id, offset));
+
+        if(offset && details->iterator == NULL && offset >= (setting->group == Group_Encoder0 ? hal.encoder.get_n_encoders() : N_AXIS))
+            return NULL;
 
-    return NULL;
+        if(set)
+            *set = details;
+    }
+
+    return setting;
 }
 
 const char *setting_get_description (setting_id_t id)
@@ -2693,8 +3038,16 @@ static bool settings_changed_spindle (void)
     return changed;
 }
 
+static struct {
+    volatile bool active;
+    bool hooked;
+    status_code_t status;
+    on_stream_changed_ptr on_stream_changed;
+    on_reset_ptr on_reset;
+} transaction = {0};
+
 // A helper method to set settings from command line
-status_code_t settings_store_setting (setting_id_t id, char *svalue)
+static status_code_t setting_store (setting_id_t id, char *svalue)
 {
     uint_fast8_t set_idx = 0;
     uint32_t int_value = 0;
@@ -2797,6 +3150,7 @@ status_code_t settings_store_setting (setting_id_t id, char *svalue)
     if(status == Status_OK) {
 
         xbar_set_homing_source();
+        plan_cache_invalidate();
 
         if(set->save)
             set->save();
@@ -2815,6 +3169,104 @@ status_code_t settings_store_setting (setting_id_t id, char *svalue)
     return status;
 }
 
+status_code_t settings_store_setting (setting_id_t id, char *svalue)
+{
+    status_code_t status = setting_store(id, svalue);
+
+    if(status == Status_OK)
+        report_settings_schema_invalidate(); // Setting availability may depend on the value.
+
+    if(transaction.active && status != Status_OK && transaction.status == Status_OK)
+        transaction.status = status;
+
+    return status;
+}
+
+// Ends an open transaction without committing, pending changes are then written by the regular sync.
+// May be called from interrupt context.
+static void transaction_abort (void)
+{
+    if(transaction.active) {
+        transaction.active = false;
+        transaction.status = Status_OK;
+#if NVSDATA_BUFFER_ENABLE
+        nvs_buffer_sync_resume_deferred();
+#endif
+    }
+}
+
+// A transaction is started by the sender for the current stream, ended if the stream changes.
+static void transaction_stream_changed (stream_type_t type)
+{
+    transaction_abort();
+
+    if(transaction.on_stream_changed)
+        transaction.on_stream_changed(type);
+}
+
+static void transaction_reset (void)
+{
+    transaction_abort();
+
+    if(transaction.on_reset)
+        transaction.on_reset();
+}
+
+/*! \brief Start a settings transaction.
+
+While a transaction is active changes are kept in the RAM copy of the settings and not written
+to physical storage until settings_transaction_commit() is called. The transaction is ended without
+commit on soft reset or if the current stream changes, pending changes are then written as usual.
+__NOTE:__ writes are only deferred when the NVS buffer is in use, i.e. when \a hal.nvs.type is \a NVS_Emulated.
+\returns \a Status_OK if started, \a Status_InvalidStatement if a transaction is already active.
+*/
+status_code_t settings_transaction_begin (void)
+{
+    if(transaction.active)
+        return Status_InvalidStatement;
+
+    if(!transaction.hooked) {
+        transaction.hooked = true;
+        transaction.on_stream_changed = grbl.on_stream_changed;
+        grbl.on_stream_changed = transaction_stream_changed;
+        transaction.on_reset = grbl.on_reset;
+        grbl.on_reset = transaction_reset;
+    }
+
+    transaction.active = true;
+    transaction.status = Status_OK;
+#if NVSDATA_BUFFER_ENABLE
+    nvs_buffer_sync_suspend(true);
+#endif
+
+    return Status_OK;
+}
+
+/*! \brief Commit a settings transaction, all pending changes are written to physical storage in one go.
+\returns \a Status_OK if all settings were stored ok, else the status code of the first setting that failed.
+\a Status_InvalidStatement if no transaction is active.
+*/
+status_code_t settings_transaction_commit (void)
+{
+    if(!transaction.active)
+        return Status_InvalidStatement;
+
+    status_code_t status = transaction.status;
+
+    transaction.active = false;
+    transaction.status = Status_OK;
+#if NVSDATA_BUFFER_ENABLE
+    nvs_buffer_sync_suspend(false);
+#endif
+
+    return status;
+}
+
+bool settings_transaction_active (void)
+{
+    return transaction.active;
+}
+
 bool settings_add_spindle_type (const char *type)
 {
     bool ok;
@@ -2833,6 +3285,11 @@ void settings_clear (void)
 {
     setting_details.next = NULL;
     settingsd = &setting_details;
+
+#if SETTINGS_LOOKUP_INDEX
+    settings_index_invalidate();
+#endif
+    report_settings_schema_invalidate();
 }
 
 // Initialize the config subsystem
@@ -2853,6 +3310,8 @@ void settings_init (void)
     grbl.tool_table.read = settings_read_tool_data;
     grbl.tool_table.write = settings_write_tool_data;
     grbl.tool_table.clear = settings_clear_tool_data;
+#elif TOOL_TABLE_ENABLE
+    tool_table_init();
 #else
     static tool_data_t tools;
     if(grbl.tool_table.tool == NULL) {
@@ -2881,7 +3340,7 @@ void settings_init (void)
 
         memset(grbl.tool_table.tool, 0, sizeof(tool_data_t)); // First entry is for tools not in tool table
 
-        if(grbl.tool_table.n_tools) {
+        if(grbl.tool_table.n_tools && grbl.tool_table.get == NULL) { // Sparse tool tables are loaded on demand
             uint_fast8_t idx;
             for(idx = 1; idx <= grbl.tool_table.n_tools; idx++)
                 grbl.tool_table.read(idx, &grbl.tool_table.tool[idx]);
@@ -409,6 +409,8 @@ typedef enum {
     Setting_Kinematics9         = 649,
 
     Setting_FSOptions = 650,
+    Setting_InputShaper = 651,
+    Setting_BacklashTakeUp = 652,
 
     Setting_RpmMax1 = 730,
     Setting_RpmMin1 = 731,
@@ -451,6 +453,9 @@ typedef enum {
     Setting_AxisExtended7        = Setting_AxisSettingsBase2 + 7 * AXIS_SETTINGS_INCREMENT,
     Setting_AxisExtended8        = Setting_AxisSettingsBase2 + 8 * AXIS_SETTINGS_INCREMENT,
     Setting_AxisExtended9        = Setting_AxisSettingsBase2 + 9 * AXIS_SETTINGS_INCREMENT,
+    Setting_AxisShaperFrequency  = Setting_AxisExtended7,   // Claimed by the core when ENABLE_INPUT_SHAPING is enabled.
+    Setting_AxisShaperDamping    = Setting_AxisExtended8,   // Claimed by the core when ENABLE_INPUT_SHAPING is enabled.
+    Setting_AxisJerk             = Setting_AxisExtended9,   // Claimed by the core when ENABLE_JERK_ACCELERATION is enabled.
 
     // Calculated base values for encoder settings
     Setting_EncoderModeBase           = Setting_EncoderSettingsBase + Setting_EncoderMode,
@@ -621,6 +626,13 @@ typedef struct {
 #if ENABLE_BACKLASH_COMPENSATION
     float backlash;
 #endif
+#if ENABLE_JERK_ACCELERATION
+    float jerk;
+#endif
+#if ENABLE_INPUT_SHAPING
+    float shaper_frequency;
+    float shaper_damping;
+#endif
 } axis_settings_t;
 
 typedef union {
@@ -694,6 +706,13 @@ typedef enum {
     ToolChange_Ignore
 } toolchange_mode_t;
 
+typedef enum {
+    InputShaper_Off = 0,
+    InputShaper_ZV,
+    InputShaper_ZVD,
+    InputShaper_MZV
+} input_shaper_t;
+
 typedef struct {
     float feed_rate;
     float seek_rate;
@@ -736,6 +755,12 @@ typedef struct {
     safety_door_settings_t safety_door;
     position_pid_t position;    // Used for synchronized motion
     ioport_signals_t ioport;
+#if ENABLE_INPUT_SHAPING
+    uint8_t input_shaper;       // input_shaper_t
+#endif
+#if ENABLE_BACKLASH_COMPENSATION
+    float backlash_takeup;      // Distance (mm) backlash take-up is spread over, 0 to insert backlash motions.
+#endif
 } settings_t;
 
 typedef enum {
@@ -927,6 +952,12 @@ typedef struct setting_details {
 // NOTE: this must match the signature of on_get_settings in the setting_details_t structure above!
 typedef setting_details_t *(*on_get_settings_ptr)(void);
 
+//! Settings index entry, see settings_get_index().
+typedef struct {
+    const setting_detail_t *setting;
+    setting_details_t *details;         //!< Pointer to the settings structure the setting belongs to.
+} setting_index_entry_t;
+
 extern settings_t settings;
 
 // Clear settings chain (unlinks plugin/driver settings from core settings)
@@ -944,6 +975,14 @@ void settings_restore(settings_restore_t restore_flags);
 // A helper method to set new settings from command line
 status_code_t settings_store_setting(setting_id_t setting, char *svalue);
 
+// Start a settings transaction, physical storage writes are deferred until commit
+status_code_t settings_transaction_begin (void);
+
+// Commit a settings transaction, returns status of first failed setting store
+status_code_t settings_transaction_commit (void);
+
+bool settings_transaction_active (void);
+
 // Writes the protocol line variable as a startup line in persistent storage
 void settings_write_startup_line(uint8_t idx, char *line);
 
@@ -962,6 +1001,9 @@ void settings_write_coord_data(coord_system_id_t id, float (*coord_data)[N_AXIS]
 // Reads selected coordinate data from persistent storage
 bool settings_read_coord_data(coord_system_id_t id, float (*coord_data)[N_AXIS]);
 
+// Loads all coordinate data from persistent storage to the RAM mirror used by settings_read_coord_data()
+void settings_load_coord_data(void);
+
 // Temporarily override acceleration, if 0 restore to configured setting value
 bool settings_override_acceleration (uint8_t axis, float acceleration);
 
@@ -970,6 +1012,7 @@ setting_details_t *settings_get_details (void);
 bool settings_is_group_available (setting_group_t group);
 bool settings_iterator (const setting_detail_t *setting, setting_output_ptr callback, void *data);
 const setting_detail_t *setting_get_details (setting_id_t id, setting_details_t **set);
+uint_fast16_t settings_get_index (const setting_index_entry_t **index);
 const char *setting_get_description (setting_id_t id);
 setting_datatype_t setting_datatype_to_external (setting_datatype_t datatype);
 setting_group_t settings_normalize_group (setting_group_t group);
@@ -28,6 +28,7 @@
 #include "protocol.h"
 #include "state_machine.h"
 #include "settings.h"
+#include "program_cache.h"
 
 #ifndef UNUSED
 #define UNUSED(x) (void)(x)
@@ -118,6 +119,9 @@ static bool spindle_activate (spindle_id_t spindle_id, spindle_num_t spindle_num
             if(ok) {
                 sys_spindle[spindle_num].enabled = true;
                 sys_spindle[spindle_num].param.hal = &sys_spindle[spindle_num].hal;
+#if SPINDLE_COMMAND_CACHE
+                sys_spindle[spindle_num].param.cmd.valid = false;
+#endif
                 if(sys_spindle[spindle_num].param.override_pct == 0)
                     sys_spindle[spindle_num].param.override_pct = DEFAULT_SPINDLE_RPM_OVERRIDE;
                 spindle_hal.param = &sys_spindle[spindle_num].param;
@@ -482,6 +486,58 @@ void spindle_set_override (spindle_ptrs_t *spindle, override_t speed_override)
     }
 }
 
+#if SPINDLE_COMMAND_CACHE
+
+#ifndef SPINDLE_VFD_RPM_DEADBAND
+#define SPINDLE_VFD_RPM_DEADBAND 1.0f // RPM, changes within this band are not sent to VFD spindles.
+#endif
+
+// Returns the RPM change below which commands are considered redundant, per spindle type.
+static inline float rpm_deadband (spindle_ptrs_t *spindle)
+{
+    return spindle->type == SpindleType_VFD ? SPINDLE_VFD_RPM_DEADBAND : 0.0f;
+}
+
+// Sends the state to the spindle unless it is the same as the last sent, within the RPM deadband.
+static void set_state_cached (spindle_ptrs_t *spindle, spindle_state_t state, float rpm)
+{
+    spindle_param_t *param = spindle->param;
+
+    state.value &= ((spindle_state_t){ .on = On, .ccw = On }).value;
+
+    if(param->cmd.valid && param->cmd.state.value == state.value &&
+        (!state.on || fabsf(rpm - param->cmd.rpm) <= rpm_deadband(spindle)))
+        return;
+
+    param->cmd.valid = true;
+    param->cmd.state = state;
+    param->cmd.rpm = rpm;
+
+    spindle->set_state(spindle, state, rpm);
+}
+
+/*! \brief Checks if a RPM update, as issued by the step segment generator, is redundant.
+\param spindle pointer to a \ref spindle_ptrs_t structure.
+\param rpm the spindle RPM to set.
+\returns \a true if the RPM is within the deadband of the last RPM sent to the spindle, \a false if not.
+The RPM is recorded as sent if not redundant.
+*/
+bool spindle_rpm_update_redundant (spindle_ptrs_t *spindle, float rpm)
+{
+    spindle_param_t *param = spindle->param;
+
+    if(param->cmd.valid && param->cmd.state.on && fabsf(rpm - param->cmd.rpm) <= rpm_deadband(spindle))
+        return true;
+
+    param->cmd.rpm = rpm;
+
+    return false;
+}
+
+#else
+#define set_state_cached(spindle, state, rpm) spindle->set_state(spindle, state, rpm)
+#endif
+
 /*! \internal \brief Immediately sets spindle running state with direction and spindle rpm, if enabled.
 Called by g-code parser spindle_sync(), parking retract and restore, g-code program end,
 sleep, and spindle stop override.
@@ -496,14 +552,14 @@ static bool set_state (spindle_ptrs_t *spindle, spindle_state_t state, float rpm
 
         if (!state.on) { // Halt or set spindle direction and rpm.
             spindle->param->rpm = rpm = 0.0f;
-            spindle->set_state(spindle, (spindle_state_t){0}, 0.0f);
+            set_state_cached(spindle, (spindle_state_t){0}, 0.0f);
         } else {
             // NOTE: Assumes all calls to this function is when Grbl is not moving or must remain off.
             // TODO: alarm/interlock if going from CW to CCW directly in non-laser mode?
             if (spindle->cap.laser && state.ccw)
                 rpm = 0.0f; // TODO: May need to be rpm_min*(100/MAX_SPINDLE_RPM_OVERRIDE);
 
-            spindle->set_state(spindle, state, spindle_set_rpm(spindle, rpm, spindle->param->override_pct));
+            set_state_cached(spindle, state, spindle_set_rpm(spindle, rpm, spindle->param->override_pct));
         }
 
         system_add_rt_report(Report_Spindle); // Set to report change immediately
@@ -562,6 +618,10 @@ bool spindle_sync (spindle_ptrs_t *spindle, spindle_state_t state, float rpm)
 
         ok &= at_speed;
     }
+#if PROGRAM_CACHE_ENABLE
+    else
+        program_cache_spindle(spindle, state, rpm);
+#endif
 
     return ok;
 }
@@ -638,6 +698,9 @@ void spindle_all_off (void)
         if((spindle = spindle_get(--spindle_num))) {
             spindle->param->rpm = spindle->param->rpm_overridden = 0.0f;
             spindle->param->state.value = 0;
+#if SPINDLE_COMMAND_CACHE
+            spindle->param->cmd.valid = false; // Ensure next command is sent.
+#endif
 #ifdef GRBL_ESP32
             spindle->esp32_off(spindle);
 #else
@@ -680,6 +743,31 @@ static inline uint_fast16_t invert_pwm (spindle_pwm_t *pwm_data, uint_fast16_t p
     return pwm_data->invert_pwm ? pwm_data->period - pwm_value - 1 : pwm_value;
 }
 
+// Intermediate PWM value for a RPM above min RPM, not limited or inverted.
+static inline uint_fast16_t compute_pwm_value (spindle_pwm_t *pwm_data, float rpm)
+{
+    uint_fast16_t pwm_value;
+
+  #if ENABLE_SPINDLE_LINEARIZATION
+    // Compute intermediate PWM value with linear spindle speed model via piecewise linear fit model.
+    uint_fast8_t idx = pwm_data->n_pieces;
+
+    if(idx) {
+        do {
+            idx--;
+            if(idx == 0 || rpm > pwm_data->piece[idx].rpm) {
+                pwm_value = floorf((pwm_data->piece[idx].start * rpm - pwm_data->piece[idx].end) * pwm_data->pwm_gradient);
+                break;
+            }
+        } while(idx);
+    } else
+  #endif
+    // Compute intermediate PWM value with linear spindle speed model.
+    pwm_value = (uint_fast16_t)floorf((rpm - pwm_data->rpm_min) * pwm_data->pwm_gradient) + pwm_data->min_value;
+
+    return pwm_value;
+}
+
 /*! \brief Spindle RPM to PWM conversion.
 \param pwm_data pointer t a \a spindle_pwm_t structure.
 \param rpm spindle RPM.
@@ -694,22 +782,18 @@ static uint_fast16_t spindle_compute_pwm_value (spindle_pwm_t *pwm_data, float r
     uint_fast16_t pwm_value;
 
     if(rpm > pwm_data->rpm_min) {
-      #if ENABLE_SPINDLE_LINEARIZATION
-        // Compute intermediate PWM value with linear spindle speed model via piecewise linear fit model.
-        uint_fast8_t idx = pwm_data->n_pieces;
-
-        if(idx) {
-            do {
-                idx--;
-                if(idx == 0 || rpm > pwm_data->piece[idx].rpm) {
-                    pwm_value = floorf((pwm_data->piece[idx].start * rpm - pwm_data->piece[idx].end) * pwm_data->pwm_gradient);
-                    break;
-                }
-            } while(idx);
+
+#if SPINDLE_PWM_TABLE_SIZE
+        float pos = (rpm - pwm_data->rpm_min) * pwm_data->table_scale;
+        uint_fast16_t idx = (uint_fast16_t)pos;
+
+        if(idx < SPINDLE_PWM_TABLE_SIZE) {
+            // Lookup and linear interpolation between the precomputed values.
+            int32_t delta = (int32_t)pwm_data->table[idx + 1] - (int32_t)pwm_data->table[idx];
+            pwm_value = pwm_data->table[idx] + (int32_t)((pos - (float)idx) * (float)delta);
         } else
-      #endif
-        // Compute intermediate PWM value with linear spindle speed model.
-        pwm_value = (uint_fast16_t)floorf((rpm - pwm_data->rpm_min) * pwm_data->pwm_gradient) + pwm_data->min_value;
+#endif
+        pwm_value = compute_pwm_value(pwm_data, rpm);
 
         if(pwm_value >= (pid_limit ? pwm_data->period : pwm_data->max_value))
             pwm_value = pid_limit ? pwm_data->period - 1 : pwm_data->max_value;
@@ -780,5 +864,17 @@ bool spindle_precompute_pwm_values (spindle_ptrs_t *spindle, spindle_pwm_t *pwm_
     spindle->cap.pwm_linearization = pwm_data->n_pieces > 0;
 #endif
 
+#if SPINDLE_PWM_TABLE_SIZE
+    if(spindle->cap.variable) {
+
+        uint_fast16_t idx;
+        float rpm_step = (spindle->rpm_max - spindle->rpm_min) / (float)SPINDLE_PWM_TABLE_SIZE;
+
+        pwm_data->table_scale = 1.0f / rpm_step;
+        for(idx = 0; idx <= SPINDLE_PWM_TABLE_SIZE; idx++)
+            pwm_data->table[idx] = compute_pwm_value(pwm_data, pwm_data->rpm_min + rpm_step * (float)idx);
+    }
+#endif
+
     return spindle->cap.variable;
 }
@@ -231,6 +231,13 @@ typedef struct spindle_param {
     override_t override_pct;    //!< Spindle RPM override value in percent
     spindle_css_data_t css;     //!< Data used for Constant Surface Speed Mode (CSS) calculations, NULL if not in CSS mode.
     spindle_ptrs_t *hal;
+#if SPINDLE_COMMAND_CACHE
+    struct {
+        bool valid;
+        spindle_state_t state;
+        float rpm;
+    } cmd;                      //!< Last state and RPM sent to the spindle, used for suppressing redundant commands.
+#endif
 } spindle_param_t;
 
 typedef struct {
@@ -297,6 +304,10 @@ typedef struct spindle_pwm {
     int_fast16_t offset;
     uint_fast16_t n_pieces;
     pwm_piece_t piece[SPINDLE_NPWM_PIECES];
+#if SPINDLE_PWM_TABLE_SIZE
+    float table_scale;                              //!< Table intervals per RPM.
+    uint_fast16_t table[SPINDLE_PWM_TABLE_SIZE + 1]; //!< Non inverted PWM values for RPMs from rpm_min to rpm_max.
+#endif
     uint_fast16_t (*compute_value)(struct spindle_pwm *pwm_data, float rpm, bool pid_limit);
 } spindle_pwm_t;
 
@@ -316,6 +327,18 @@ bool spindle_set_state (spindle_ptrs_t *spindle, spindle_state_t state, float rp
 // Spindle speed calculation and limit handling
 float spindle_set_rpm (spindle_ptrs_t *spindle, float rpm, override_t speed_override);
 
+#if SPINDLE_COMMAND_CACHE
+// Checks if a RPM update is redundant as within the deadband of the last RPM sent, records it as sent if not.
+bool spindle_rpm_update_redundant (spindle_ptrs_t *spindle, float rpm);
+
+// Ensures the next command is sent, to be called after the spindle state is set by a direct call to the set_state handler.
+static inline void spindle_command_invalidate (spindle_ptrs_t *spindle)
+{
+    if(spindle->param)
+        spindle->param->cmd.valid = false;
+}
+#endif
+
 // Restore spindle running state with direction, enable, spindle RPM and appropriate delay.
 bool spindle_restore (spindle_ptrs_t *spindle, spindle_state_t state, float rpm);
 
@@ -0,0 +1,278 @@
+/*
+  spindle_sync.c - An embedded CNC Controller with rs274/ngc (g-code) support
+
+  Fixed rate spindle sync control loop with lock-free logging
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "hal.h"
+#include "spindle_sync.h"
+
+#ifndef SPINDLE_ENCODER_TRACKER_ALPHA
+#define SPINDLE_ENCODER_TRACKER_ALPHA 0.2f // Default position gain of the RPM and position tracker.
+#endif
+
+#if SPINDLE_SYNC_LOG_SIZE
+
+#if SPINDLE_SYNC_LOG_SIZE & (SPINDLE_SYNC_LOG_SIZE - 1)
+#error "SPINDLE_SYNC_LOG_SIZE must be a power of 2!"
+#endif
+
+// Single producer (control loop interrupt), single consumer (foreground) ring buffer.
+typedef struct {
+    volatile uint_fast16_t head;    // Written by the control loop only.
+    volatile uint_fast16_t tail;    // Written by the foreground only.
+    spindle_sync_log_stats_t stats;
+    spindle_sync_sample_t sample[SPINDLE_SYNC_LOG_SIZE];
+} spindle_sync_log_t;
+
+static spindle_sync_log_t sync_log = {0};
+
+static inline void log_sample (float error, float output)
+{
+    uint_fast16_t head = sync_log.head, next = (head + 1) & (SPINDLE_SYNC_LOG_SIZE - 1);
+
+    if(next == sync_log.tail)
+        sync_log.stats.overruns++;
+    else {
+        sync_log.sample[head].error = error;
+        sync_log.sample[head].output = output;
+        sync_log.head = next;
+        sync_log.stats.samples++;
+    }
+}
+
+/*! \brief Read logged samples, must be called from the foreground process.
+\param samples pointer to array to receive the samples.
+\param max_samples maximum number of samples to read.
+\returns number of samples read.
+*/
+uint_fast16_t spindle_sync_log_read (spindle_sync_sample_t *samples, uint_fast16_t max_samples)
+{
+    uint_fast16_t count = 0, tail = sync_log.tail, head = sync_log.head;
+
+    while(tail != head && count < max_samples) {
+        samples[count++] = sync_log.sample[tail];
+        tail = (tail + 1) & (SPINDLE_SYNC_LOG_SIZE - 1);
+    }
+
+    sync_log.tail = tail;
+
+    return count;
+}
+
+//! Discard logged samples and clear statistics.
+void spindle_sync_log_reset (void)
+{
+    sync_log.tail = sync_log.head;
+    sync_log.stats.samples = sync_log.stats.overruns = 0;
+}
+
+//! Returns pointer to log statistics.
+spindle_sync_log_stats_t *spindle_sync_log_get_stats (void)
+{
+    return &sync_log.stats;
+}
+
+#endif // SPINDLE_SYNC_LOG_SIZE
+
+/*! \brief Initialize spindle sync control loop.
+\param sync pointer to a \a spindle_sync_t structure.
+\param config pointer to PID configuration.
+\param sample_rate rate in Hz spindle_sync_update() will be called at, typically from the spindle encoder timer interrupt.
+*/
+void spindle_sync_init (spindle_sync_t *sync, pid_values_t *config, float sample_rate)
+{
+    pidf_init(&sync->pid, config);
+    sync->sample_rate = sample_rate;
+    sync->output = 0.0f;
+#if SPINDLE_SYNC_LOG_SIZE
+    sync_log.stats.sample_rate = sample_rate;
+#endif
+}
+
+/*! \brief Execute one iteration of the spindle sync control loop.
+Must be called at the fixed rate set by spindle_sync_init(), typically from the spindle encoder timer interrupt.
+When logging is enabled the position error and PID output is added to the log.
+\param sync pointer to a \a spindle_sync_t structure.
+\param command commanded position.
+\param actual actual position.
+\returns PID output.
+*/
+float spindle_sync_update (spindle_sync_t *sync, float command, float actual)
+{
+    sync->output = pidf(&sync->pid, command, actual, sync->sample_rate);
+
+#if SPINDLE_SYNC_LOG_SIZE
+    log_sample(command - actual, sync->output);
+#endif
+
+    return sync->output;
+}
+
+/*! \brief Initialize the spindle encoder RPM and position tracker.
+\param encoder pointer to a \a spindle_encoder_t structure, \a ppr, \a pulse_distance, \a maximum_tt and \a tics_per_irq must be set.
+\param tic_rate event timer frequency in Hz.
+\param alpha position gain, 0 < alpha < 1. Lower values filters more, at the cost of a slower response.
+Set to 0 to use the default value. The velocity gain is derived from it for a critically damped response.
+*/
+void spindle_encoder_tracker_init (spindle_encoder_t *encoder, float tic_rate, float alpha)
+{
+    spindle_encoder_tracker_t *tracker = &encoder->tracker;
+
+    memset(tracker, 0, sizeof(spindle_encoder_tracker_t));
+
+    if(!(alpha > 0.0f && alpha < 1.0f))
+        alpha = SPINDLE_ENCODER_TRACKER_ALPHA;
+
+    tracker->alpha = alpha;
+    tracker->beta = alpha * alpha / (2.0f - alpha);
+    tracker->tic_rate = tic_rate;
+}
+
+/*! \brief Update the spindle encoder tracker with a new event, to be called from the encoder interrupt.
+\param encoder pointer to a \a spindle_encoder_t structure.
+\param timestamp free running timer value at the event.
+\param pulse_count total number of encoder pulses at the event, including pulses counted by the prescaler.
+With an index pulse only encoder \a ppr is 1 and the count is incremented by one per revolution.
+
+__NOTE:__ the timer must be 32 bits or extended to 32 bits by the driver.
+*/
+void spindle_encoder_event (spindle_encoder_t *encoder, uint32_t timestamp, uint32_t pulse_count)
+{
+    spindle_encoder_tracker_t *tracker = &encoder->tracker;
+    spindle_encoder_estimate_t *current = &tracker->estimate[tracker->active],
+                               *next = &tracker->estimate[tracker->active ^ 1];
+    uint32_t dt = timestamp - current->last_tic;
+    float distance = (float)(pulse_count - current->last_count) * encoder->pulse_distance, residual;
+
+    if(tracker->events && dt == 0)
+        return;
+
+    next->last_tic = timestamp;
+    next->last_count = pulse_count;
+
+    if(tracker->events == 0 || dt > encoder->maximum_tt) {
+        next->offset = next->velocity = 0.0f;
+        tracker->events = 1;
+    } else if(tracker->events == 1) {
+        next->offset = 0.0f;
+        next->velocity = distance / (float)dt;
+        tracker->events = 2;
+    } else {
+        // Residual between measured and predicted position, the new estimate is relative to the new measurement.
+        residual = distance - (current->offset + current->velocity * (float)dt);
+        next->offset = -residual * (1.0f - tracker->alpha);
+        next->velocity = current->velocity + tracker->beta * residual / (float)dt;
+    }
+
+    tracker->active ^= 1;
+}
+
+// Returns a copy of the current estimate, retried if an update completed while copying.
+static inline uint_fast8_t get_estimate (spindle_encoder_tracker_t *tracker, spindle_encoder_estimate_t *estimate)
+{
+    uint_fast8_t active, events;
+
+    do {
+        active = tracker->active;
+        events = tracker->events;
+        memcpy(estimate, &tracker->estimate[active], sizeof(spindle_encoder_estimate_t));
+    } while(active != tracker->active);
+
+    return events;
+}
+
+// Returns distance in revolutions travelled since the last event, bounded by the distance to the next event.
+static float get_advance (spindle_encoder_t *encoder, spindle_encoder_estimate_t *estimate, uint32_t now, float *velocity)
+{
+    uint32_t elapsed = now - estimate->last_tic;
+    float advance, limit = encoder->pulse_distance * (float)max(encoder->tics_per_irq, 1);
+
+    if(elapsed > encoder->maximum_tt) {
+        *velocity = 0.0f;
+        return 0.0f;
+    }
+
+    advance = estimate->offset + estimate->velocity * (float)elapsed;
+
+    // Spindle is slowing down if the next event is overdue, limit velocity to what is consistent with that.
+    if(advance > limit) {
+        advance = limit;
+        *velocity = elapsed ? (limit - estimate->offset) / (float)elapsed : estimate->velocity;
+    } else
+        *velocity = estimate->velocity;
+
+    return max(advance, 0.0f);
+}
+
+/*! \brief Get filtered spindle RPM.
+\param encoder pointer to a \a spindle_encoder_t structure.
+\param now current free running timer value.
+\returns RPM, 0 if stalled.
+*/
+float spindle_encoder_get_rpm (spindle_encoder_t *encoder, uint32_t now)
+{
+    float velocity;
+    spindle_encoder_estimate_t estimate;
+
+    if(get_estimate(&encoder->tracker, &estimate) < 2)
+        return 0.0f;
+
+    get_advance(encoder, &estimate, now, &velocity);
+
+    return velocity * encoder->tracker.tic_rate * 60.0f;
+}
+
+/*! \brief Get spindle position interpolated between encoder events.
+Suitable as actual position for spindle_sync_update().
+\param encoder pointer to a \a spindle_encoder_t structure.
+\param now current free running timer value.
+\returns position in revolutions since the pulse count was reset.
+*/
+float spindle_encoder_get_position (spindle_encoder_t *encoder, uint32_t now)
+{
+    float velocity;
+    spindle_encoder_estimate_t estimate;
+
+    if(get_estimate(&encoder->tracker, &estimate) < 2)
+        return (float)estimate.last_count * encoder->pulse_distance;
+
+    return (float)estimate.last_count * encoder->pulse_distance + get_advance(encoder, &estimate, now, &velocity);
+}
+
+/*! \brief Set RPM and angular position from the tracker, to be called from the spindle get_data() handler.
+\param encoder pointer to a \a spindle_encoder_t structure.
+\param data pointer to a \a spindle_data_t structure to update.
+\param now current free running timer value.
+*/
+void spindle_encoder_get_data (spindle_encoder_t *encoder, spindle_data_t *data, uint32_t now)
+{
+    float velocity = 0.0f;
+    uint_fast8_t events;
+    spindle_encoder_estimate_t estimate;
+
+    events = get_estimate(&encoder->tracker, &estimate);
+    data->angular_position = (float)estimate.last_count * encoder->pulse_distance;
+
+    if(events >= 2)
+        data->angular_position += get_advance(encoder, &estimate, now, &velocity);
+
+    data->rpm = velocity * encoder->tracker.tic_rate * 60.0f;
+}
@@ -3,8 +3,6 @@
 
   Spindle sync data structures
 
-  NOTE: not referenced in the core grbl code
-
   Part of grblHAL
 
   Copyright (c) 2020-2021 Terje Io
@@ -49,6 +47,25 @@ typedef struct {
     volatile uint32_t pulse_count;
 } spindle_encoder_counter_t;
 
+// Estimate relative to the last encoder event.
+typedef struct {
+    float offset;                       // Estimated minus measured position at last event, in revolutions
+    float velocity;                     // Estimated velocity in revolutions per timer tic
+    uint32_t last_tic;                  // Timer value at last event
+    uint32_t last_count;                // Encoder pulse count at last event
+} spindle_encoder_estimate_t;
+
+// Alpha-beta tracker state, updated by spindle_encoder_event().
+// The estimate is double buffered so it can be read from any interrupt priority.
+typedef struct {
+    float alpha;                        // Position gain
+    float beta;                         // Velocity gain
+    float tic_rate;                     // Event timer tics per second
+    uint_fast8_t events;                // Number of events since start or stall, saturates at 2
+    volatile uint_fast8_t active;       // Index of the current estimate
+    spindle_encoder_estimate_t estimate[2];
+} spindle_encoder_tracker_t;
+
 typedef struct {
     uint32_t ppr;                       // Encoder pulses per revolution
     float rpm_factor;                   // Inverse of event timer tics per RPM
@@ -59,6 +76,7 @@ typedef struct {
     uint32_t error_count;               // Incremented when actual PPR count differs from ppr setting
     uint32_t tics_per_irq;              // Counts per interrupt generated (prescaler value)
     volatile bool spin_lock;
+    spindle_encoder_tracker_t tracker;  // RPM and position estimator
 } spindle_encoder_t;
 
 typedef struct {
@@ -68,6 +86,8 @@ typedef struct {
     int32_t min_cycles_per_tick;    // Minimum cycles per tick for PID loop
     uint_fast8_t segment_id;        // Used for detecting start of new segment
     pidf_t pid;                     // PID data for position
+    float sample_rate;              // Fixed loop rate in Hz, set by spindle_sync_init()
+    float output;                   // Last PID output
     stepper_pulse_start_ptr stepper_pulse_start_normal; // Driver pulse function to restore after spindle sync move is completed
 #ifdef PID_LOG
     int32_t log[PID_LOG];
@@ -75,4 +95,28 @@ typedef struct {
 #endif
 } spindle_sync_t;
 
+typedef struct {
+    float error;
+    float output;
+} spindle_sync_sample_t;
+
+typedef struct {
+    float sample_rate;
+    uint32_t samples;               // Number of samples logged
+    uint32_t overruns;              // Number of samples dropped due to ring buffer full
+} spindle_sync_log_stats_t;
+
+void spindle_sync_init (spindle_sync_t *sync, pid_values_t *config, float sample_rate);
+float spindle_sync_update (spindle_sync_t *sync, float command, float actual);
+void spindle_encoder_tracker_init (spindle_encoder_t *encoder, float tic_rate, float alpha);
+void spindle_encoder_event (spindle_encoder_t *encoder, uint32_t timestamp, uint32_t pulse_count);
+float spindle_encoder_get_rpm (spindle_encoder_t *encoder, uint32_t now);
+float spindle_encoder_get_position (spindle_encoder_t *encoder, uint32_t now);
+void spindle_encoder_get_data (spindle_encoder_t *encoder, spindle_data_t *data, uint32_t now);
+#if SPINDLE_SYNC_LOG_SIZE
+uint_fast16_t spindle_sync_log_read (spindle_sync_sample_t *samples, uint_fast16_t max_samples);
+void spindle_sync_log_reset (void);
+spindle_sync_log_stats_t *spindle_sync_log_get_stats (void);
+#endif
+
 #endif
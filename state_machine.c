@@ -27,9 +27,17 @@
 
 #include "hal.h"
 #include "motion_control.h"
+#include "protocol.h"
 #include "state_machine.h"
 #include "override.h"
 
+#ifndef RESTORE_POLL_INTERVAL
+#define RESTORE_POLL_INTERVAL 10 // ms, interval between spindle at speed checks when restoring after hold or parking.
+#endif
+#ifndef RESTORE_AT_SPEED_MIN_TIME
+#define RESTORE_AT_SPEED_MIN_TIME 100 // ms, minimum time allowed for restored spindles to report at speed before alarming.
+#endif
+
 static void state_idle (uint_fast16_t new_state);
 static void state_cycle (uint_fast16_t rt_exec);
 static void state_await_hold (uint_fast16_t rt_exec);
@@ -74,10 +82,66 @@ typedef struct {
 // Declare and initialize parking local variables
 static parking_data_t park = {0};
 
+// Restore spindle state without delay, await_restored() is to be called after all spindles and coolant have been restored.
 static void state_spindle_restore (spindle_t *spindle)
 {
-    if(spindle->hal)
-        spindle_restore(spindle->hal, spindle->state, spindle->rpm);
+    if(spindle->hal) {
+        if(spindle->hal->cap.laser) // When in laser mode, ignore spindle spin-up delay. Set to turn on laser when cycle starts.
+            sys.step_control.update_spindle_rpm = On;
+        else
+            spindle_set_state(spindle->hal, spindle->state, spindle->rpm);
+    }
+}
+
+/*! \brief Waits for restored spindles to spin up and for coolant to restart.
+The waits run concurrently and spindles reporting at speed are polled every \ref RESTORE_POLL_INTERVAL ms
+so that motion resumes as soon as the longest of them is satisfied. The step segment buffer is kept filled by
+protocol_exec_rt_system() while waiting unless a parking motion is pending.
+\param spindle pointer to an array of \ref spindle_t structures for the restored spindles.
+\param n_spindles number of entries in the array.
+\param coolant \a true if coolant was restored.
+*/
+static void await_restored (spindle_t *spindle, uint_fast8_t n_spindles, bool coolant)
+{
+    bool at_speed, check_at_speed = false;
+    uint_fast8_t idx;
+    uint32_t ms = 0, delay = coolant ? (uint32_t)(settings.safety_door.coolant_on_delay * 1000.0f) : 0, timeout = 0;
+
+    for(idx = 0; idx < n_spindles; idx++) {
+        if(spindle[idx].hal && spindle[idx].state.on && !spindle[idx].hal->cap.laser) {
+            if(!spindle[idx].hal->cap.at_speed)
+                delay = max(delay, (uint32_t)(settings.safety_door.spindle_on_delay * 1000.0f));
+            else if(settings.spindle.at_speed_tolerance > 0.0f) {
+                check_at_speed = true;
+                timeout = max((uint32_t)(settings.safety_door.spindle_on_delay * 1000.0f), RESTORE_AT_SPEED_MIN_TIME);
+            }
+        }
+    }
+
+    while(!ABORTED) {
+
+        at_speed = true;
+        if(check_at_speed) for(idx = 0; idx < n_spindles; idx++) {
+            if(spindle[idx].hal && spindle[idx].state.on && !spindle[idx].hal->cap.laser && spindle[idx].hal->cap.at_speed)
+                at_speed &= spindle[idx].hal->get_state(spindle[idx].hal).at_speed;
+        }
+
+        if(at_speed && ms >= delay)
+            break;
+
+        if(!at_speed && ms >= timeout) {
+            system_raise_alarm(Alarm_Spindle);
+            break;
+        }
+
+        // Execute rt_system() only to avoid nesting suspend loops.
+        protocol_exec_rt_system();
+        if(state_door_reopened()) // Bail, if safety door reopens.
+            break;
+
+        hal.delay_ms(RESTORE_POLL_INTERVAL, NULL);
+        ms += RESTORE_POLL_INTERVAL;
+    }
 }
 
 static void state_spindle_set_state (spindle_t *spindle)
@@ -90,6 +154,7 @@ static void state_restore_conditions (restore_condition_t *condition)
 {
     if (!settings.parking.flags.enabled || !park.flags.restart) {
 
+        bool coolant;
         spindle_num_t spindle_num = N_SYS_SPINDLE;
 
         park.flags.restoring = On; //
@@ -98,12 +163,11 @@ static void state_restore_conditions (restore_condition_t *condition)
             state_spindle_restore(&condition->spindle[--spindle_num]);
         } while(spindle_num);
 
-        // Block if safety door re-opened during prior restore actions.
-        if (gc_state.modal.coolant.value != hal.coolant.get_state().value) {
-            // NOTE: Laser mode will honor this delay. An exhaust system is often controlled by this signal.
+        if ((coolant = gc_state.modal.coolant.value != hal.coolant.get_state().value))
             coolant_set_state(condition->coolant);
-            delay_sec(settings.safety_door.coolant_on_delay, DelayMode_SysSuspend);
-        }
+
+        // NOTE: Laser mode will honor the coolant delay. An exhaust system is often controlled by this signal.
+        await_restored(condition->spindle, N_SYS_SPINDLE, coolant);
 
         park.flags.restoring = Off;
 
@@ -138,11 +202,11 @@ static bool initiate_hold (uint_fast16_t new_state)
 
     do {
         if((spindle = spindle_get(--spindle_num))) {
-            if(block && block->spindle.hal == spindle) {
+            if(block && block->spindle->hal == spindle) {
                 restore_condition.spindle_num = spindle_num;
-                restore_condition.spindle[spindle_num].hal = block->spindle.hal;
-                restore_condition.spindle[spindle_num].rpm = block->spindle.rpm;
-                restore_condition.spindle[spindle_num].state = block->spindle.state;
+                restore_condition.spindle[spindle_num].hal = block->spindle->hal;
+                restore_condition.spindle[spindle_num].rpm = block->spindle_rpm;
+                restore_condition.spindle[spindle_num].state = block->spindle->state;
             } else if(gc_state.spindle.hal == spindle) {
                 restore_condition.spindle_num = spindle_num;
                 restore_condition.spindle[spindle_num].hal = gc_state.spindle.hal;
@@ -258,16 +322,16 @@ void state_set (sys_state_t new_state)
                         sys_state = new_state;
                         sys.steppers_deenergize = false;    // Cancel stepper deenergize if pending.
                         st_prep_buffer();                   // Initialize step segment buffer before beginning cycle.
-                        if (block->spindle.state.synchronized) {
+                        if (block->spindle->state.synchronized) {
 
                             uint32_t ms = hal.get_elapsed_ticks();
 
-                            if (block->spindle.hal->reset_data)
-                                block->spindle.hal->reset_data();
+                            if (block->spindle->hal->reset_data)
+                                block->spindle->hal->reset_data();
 
-                            uint32_t index = block->spindle.hal->get_data(SpindleData_Counters)->index_count + 2;
+                            uint32_t index = block->spindle->hal->get_data(SpindleData_Counters)->index_count + 2;
 
-                            while(index != block->spindle.hal->get_data(SpindleData_Counters)->index_count) {
+                            while(index != block->spindle->hal->get_data(SpindleData_Counters)->index_count) {
 
                                 if(hal.get_elapsed_ticks() - ms > 5000) {
                                     system_raise_alarm(Alarm_Spindle);
@@ -659,16 +723,19 @@ static void state_await_resume (uint_fast16_t rt_exec)
                     sys.override.spindle_stop.value = 0; // Clear spindle stop override states
                 } else {
 
-                    if (restore_condition.spindle[restore_condition.spindle_num].state.on != restore_condition.spindle[restore_condition.spindle_num].hal->get_state(restore_condition.spindle[restore_condition.spindle_num].hal).on) {
+                    bool spindle = false, coolant = false;
+
+                    if ((spindle = restore_condition.spindle[restore_condition.spindle_num].state.on != restore_condition.spindle[restore_condition.spindle_num].hal->get_state(restore_condition.spindle[restore_condition.spindle_num].hal).on)) {
                         grbl.report.feedback_message(Message_SpindleRestore);
                         state_spindle_restore(&restore_condition.spindle[restore_condition.spindle_num]);
                     }
 
-                    if (restore_condition.coolant.value != hal.coolant.get_state().value) {
-                        // NOTE: Laser mode will honor this delay. An exhaust system is often controlled by coolant signals.
+                    if ((coolant = restore_condition.coolant.value != hal.coolant.get_state().value))
                         coolant_set_state(restore_condition.coolant);
-                        delay_sec(settings.safety_door.coolant_on_delay, DelayMode_SysSuspend);
-                    }
+
+                    // NOTE: Laser mode will honor the coolant delay. An exhaust system is often controlled by coolant signals.
+                    if (spindle || coolant)
+                        await_restored(&restore_condition.spindle[restore_condition.spindle_num], spindle ? 1 : 0, coolant);
 
                     sys.override.spindle_stop.value = 0; // Clear spindle stop override states
 
@@ -747,6 +814,9 @@ static void state_await_waypoint_retract (uint_fast16_t rt_exec)
         // NOTE: Clear accessory state after retract and after an aborted restore motion.
         park.plan_data.spindle.state.value = 0;
         park.plan_data.spindle.rpm = 0.0f;
+#if SPINDLE_COMMAND_CACHE
+        spindle_command_invalidate(park.plan_data.spindle.hal);
+#endif
         park.plan_data.spindle.hal->set_state(park.plan_data.spindle.hal, park.plan_data.spindle.state, 0.0f); // De-energize
 
         if (!settings.safety_door.flags.keep_coolant_on) {
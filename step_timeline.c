@@ -0,0 +1,224 @@
+/*
+  step_timeline.c - rendering of step and direction signals to a timeline for DMA output
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// The driver streams a circular buffer of st_timeline_word_t to the step and direction outputs at a fixed tick rate
+// by DMA and calls st_timeline_render() from the half and full transfer interrupts to refill the part transmitted.
+// The renderer calls the stepper interrupt handler each time it is due, the pulse_start and cycles_per_tick handlers
+// are replaced by handlers that write to the timeline instead of to the outputs and the step timer.
+// Motion is thus identical to interrupt driven stepping but the interrupt only runs once per half buffer.
+// Axis signals are mapped to motor signals by the driver motor_iterator handler, secondary motors of ganged axes get
+// the step signal of the axis when enabled, see hal.stepper.disable_motors, and the direction signal with the ganged
+// direction invert setting applied.
+//
+
+#include <math.h>
+
+#include "hal.h"
+
+#if STEP_TIMELINE_ENABLE
+
+#include "step_timeline.h"
+
+static struct {
+    uint32_t tick_rate;             // Timeline ticks per second.
+    uint32_t period;                // Ticks between stepper interrupts.
+    uint32_t period_rem;            // Remainder of period, in step timer cycles * tick rate.
+    uint32_t rem;                   // Accumulated remainder.
+    uint32_t countdown;             // Ticks until the next stepper interrupt.
+    uint32_t delay;                 // Ticks until the step pulse starts, set on direction changes.
+    uint32_t pulse;                 // Ticks remaining of the step pulse.
+    uint16_t step;                  // Motor step signals of the current pulse.
+    uint16_t dir;                   // Motor direction signals.
+    uint16_t step_invert;           // Motor step signals inversion mask.
+    uint16_t dir_invert;            // Motor direction signals inversion mask.
+    axes_signals_t ganged;          // Axes with a secondary motor.
+    axes_signals_t motors_1;        // Axes with the primary motor step signal enabled.
+    axes_signals_t motors_2;        // Axes with the secondary motor step signal enabled.
+    uint16_t motor_2[N_AXIS];       // Motor signal bit of the secondary motor of each ganged axis.
+    volatile bool idle;
+    stepper_wake_up_ptr wake_up;
+    stepper_go_idle_ptr go_idle;
+    stepper_disable_motors_ptr disable_motors;
+} timeline = {
+    .idle = true,
+    .motors_1.mask = AXES_BITMASK,
+    .motors_2.mask = AXES_BITMASK
+};
+
+static inline uint32_t us_to_ticks (float us)
+{
+    return (uint32_t)ceilf(us * (float)timeline.tick_rate / 1000000.0f);
+}
+
+// Returns the motor signals for the given primary and secondary motor axis signals.
+static inline uint_fast16_t motor_signals (uint_fast8_t primary, uint_fast8_t secondary)
+{
+    uint_fast8_t idx = 0;
+    uint_fast16_t signals = primary;
+
+    if((secondary &= timeline.ganged.mask)) do {
+        if(secondary & 0x01)
+            signals |= timeline.motor_2[idx];
+        idx++;
+    } while(secondary >>= 1);
+
+    return signals;
+}
+
+static void timeline_cycles_per_tick (uint32_t cycles_per_tick)
+{
+    uint64_t ticks = (uint64_t)cycles_per_tick * timeline.tick_rate;
+
+    timeline.period = (uint32_t)(ticks / hal.f_step_timer);
+    timeline.period_rem = (uint32_t)(ticks % hal.f_step_timer);
+
+    if(timeline.period == 0) {
+        timeline.period = 1;
+        timeline.period_rem = 0;
+    }
+}
+
+static void timeline_pulse_start (stepper_t *stepper)
+{
+    uint_fast16_t dir;
+
+    if(stepper->dir_change && timeline.dir != (dir = motor_signals(stepper->dir_outbits.mask, stepper->dir_outbits.mask))) {
+        timeline.dir = dir;
+        timeline.delay = us_to_ticks(settings.steppers.pulse_delay_microseconds);
+    } else
+        timeline.delay = 0;
+
+    if((timeline.step = motor_signals(stepper->step_outbits.mask & timeline.motors_1.mask, stepper->step_outbits.mask & timeline.motors_2.mask)))
+        timeline.pulse = max(us_to_ticks(settings.steppers.pulse_microseconds), 1);
+}
+
+static void timeline_disable_motors (axes_signals_t axes, squaring_mode_t mode)
+{
+    timeline.motors_1.mask = (mode == SquaringMode_A || mode == SquaringMode_Both ? axes.mask : 0) ^ AXES_BITMASK;
+    timeline.motors_2.mask = (mode == SquaringMode_B || mode == SquaringMode_Both ? axes.mask : 0) ^ AXES_BITMASK;
+
+    if(timeline.disable_motors)
+        timeline.disable_motors(axes, mode);
+}
+
+static void timeline_wake_up (void)
+{
+    // Settings cannot change while motion is executing.
+    timeline.step_invert = motor_signals(settings.steppers.step_invert.mask, settings.steppers.step_invert.mask);
+    timeline.dir_invert = motor_signals(settings.steppers.dir_invert.mask, settings.steppers.dir_invert.mask ^ settings.steppers.ganged_dir_invert.mask);
+
+    timeline.countdown = timeline.delay = timeline.pulse = timeline.rem = 0;
+    timeline.step = 0;
+    timeline.idle = false;
+
+    timeline.wake_up(); // Driver starts streaming and calls st_timeline_render() to prefill the buffer.
+}
+
+static void timeline_go_idle (bool clear_signals)
+{
+    timeline.idle = true;
+
+    timeline.go_idle(clear_signals);
+}
+
+static void map_motor (motor_map_t motor)
+{
+    if(motor.id != motor.axis && motor.axis < N_AXIS && motor.id < 16) {
+        timeline.ganged.mask |= bit(motor.axis);
+        timeline.motor_2[motor.axis] = 1 << motor.id;
+    }
+}
+
+/*! \brief Install the timeline handlers, to be called by the driver from driver_setup() after the stepper handlers are set.
+The driver wake_up handler should start streaming, streaming may be stopped when st_timeline_is_idle() returns true
+after a part of the buffer has been rendered. The cycles_per_tick and pulse_start handlers are replaced.
+If the driver has ganged axes the \a hal.stepper.motor_iterator handler must be set before this is called,
+the disable_motors handler is then replaced as well.
+\param tick_rate the rate timeline words are output at in Hz.
+*/
+void st_timeline_init (uint32_t tick_rate)
+{
+    timeline.tick_rate = tick_rate;
+    timeline.ganged.mask = 0;
+
+    if(hal.stepper.motor_iterator)
+        hal.stepper.motor_iterator(map_motor);
+
+    if(timeline.ganged.mask) {
+        timeline.disable_motors = hal.stepper.disable_motors;
+        hal.stepper.disable_motors = timeline_disable_motors;
+    }
+
+    timeline.wake_up = hal.stepper.wake_up;
+    timeline.go_idle = hal.stepper.go_idle;
+
+    hal.stepper.wake_up = timeline_wake_up;
+    hal.stepper.go_idle = timeline_go_idle;
+    hal.stepper.cycles_per_tick = timeline_cycles_per_tick;
+    hal.stepper.pulse_start = timeline_pulse_start;
+}
+
+/*! \brief Render the next part of the timeline.
+To be called by the driver from the DMA transfer interrupt for the part of the buffer that has been output.
+When idle the pulse being output is completed and the rest of the buffer is filled with direction signals only.
+\param buffer pointer to the part of the buffer to fill.
+\param length number of words to fill.
+*/
+ISR_CODE void ISR_FUNC(st_timeline_render)(st_timeline_word_t *buffer, uint32_t length)
+{
+    st_timeline_word_t word;
+
+    while(length--) {
+
+        if(timeline.countdown == 0 && !timeline.idle) {
+            hal.stepper.interrupt_callback();
+            timeline.countdown = timeline.period;
+            if((timeline.rem += timeline.period_rem) >= hal.f_step_timer) {
+                timeline.rem -= hal.f_step_timer;
+                timeline.countdown++;
+            }
+        }
+
+        word.dir = timeline.dir;
+        word.step = 0;
+
+        if(timeline.delay)
+            timeline.delay--;
+        else if(timeline.pulse) {
+            word.step = timeline.step;
+            timeline.pulse--;
+        }
+
+        word.step ^= timeline.step_invert;
+        word.dir ^= timeline.dir_invert;
+        *buffer++ = word;
+
+        if(timeline.countdown)
+            timeline.countdown--;
+    }
+}
+
+//! Returns true when the stepper interrupt has stopped motion, the driver may then stop streaming when the buffer has been output.
+bool st_timeline_is_idle (void)
+{
+    return timeline.idle && timeline.pulse == 0;
+}
+
+#endif // STEP_TIMELINE_ENABLE
@@ -0,0 +1,42 @@
+/*
+  step_timeline.h - rendering of step and direction signals to a timeline for DMA output
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STEP_TIMELINE_H_
+#define _STEP_TIMELINE_H_
+
+#include "hal.h"
+
+#if STEP_TIMELINE_ENABLE
+
+//! Step and direction signals for one timeline tick, bit n is for motor n as reported by the motor iterator. Inversion settings are applied.
+typedef union {
+    uint32_t value;
+    struct {
+        uint16_t step;
+        uint16_t dir;
+    };
+} st_timeline_word_t;
+
+void st_timeline_init (uint32_t tick_rate);
+void st_timeline_render (st_timeline_word_t *buffer, uint32_t length);
+bool st_timeline_is_idle (void);
+
+#endif
+
+#endif
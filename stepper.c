@@ -28,6 +28,13 @@
 #include "hal.h"
 #include "protocol.h"
 #include "state_machine.h"
+#include "profile.h"
+#include "mem_stats.h"
+#include "job_stats.h"
+#include "motion_control.h"
+#if INPUT_EVENT_LOG_SIZE
+#include "input_events.h"
+#endif
 
 //#define MINIMIZE_PROBE_OVERSHOOT
 
@@ -38,6 +45,7 @@
 // Some useful constants.
 #define DT_SEGMENT (1.0f / (ACCELERATION_TICKS_PER_SECOND * 60.0f)) // min/segment
 #define REQ_MM_INCREMENT_SCALAR 1.25f
+#define SHAPED_RAMPS (ENABLE_JERK_ACCELERATION || ENABLE_INPUT_SHAPING)
 
 typedef enum {
     Ramp_Accel,
@@ -101,6 +109,112 @@ static plan_block_t *pl_block;     // Pointer to the planner block being prepped
 static st_block_t *st_prep_block;  // Pointer to the stepper block data being prepped
 static st_block_t st_hold_block;   // Copy of stepper block data for block put on hold during parking
 
+#if LASER_RASTER_ENABLE
+
+// Laser raster execution data, accessed only by the stepper ISR once a block is started.
+typedef struct {
+    raster_data_t *data;    // Raster data of block being executed, NULL when all pixels are output.
+    uint_fast16_t pixel;    // Index of next pixel to output.
+    uint32_t position;      // Step events executed, in block step event count units.
+    uint32_t next;          // Position of next pixel.
+} raster_t;
+
+static raster_t raster;
+
+#endif
+
+#if LASER_PPI_STEPPER_ENABLE
+
+// Laser PPI (Pulses Per Inch) execution data.
+typedef struct {
+    uint_fast16_t ppi;          // Pulses per inch, 0 when disabled. Set by foreground process.
+    uint_fast16_t pulse_length; // Pulse length in microseconds. Set by foreground process.
+    uint32_t steps;             // Step events between pulses in the block being executed, 0 if not in PPI mode.
+    int32_t remaining;          // Step events remaining until the next pulse.
+} laser_ppi_t;
+
+static laser_ppi_t laser_ppi;
+
+#endif
+
+#if ADAPTIVE_FEED_ENABLE
+static volatile float adaptive_scale = 1.0f; // Adaptive feed scale, set by st_set_adaptive_feed().
+#endif
+
+#if LASER_RASTER_ENABLE || LASER_PPI_STEPPER_ENABLE
+static uint32_t tick_events; // Block step events per ISR tick, depends on the AMASS level.
+#endif
+
+#if SEGMENT_BUFFER_MONITOR
+static st_buffer_stats_t buffer_stats;
+#endif
+
+#if STEP_FIDELITY_MONITOR
+static st_fidelity_stats_t fidelity_stats = {0};
+#endif
+
+#if THREADING_PIPELINE_ENABLE
+
+#ifndef INDEX_WAIT_TICK_RATE
+#define INDEX_WAIT_TICK_RATE 10000  // Spindle position polling rate in Hz while waiting for the index.
+#endif
+#ifndef INDEX_WAIT_TIMEOUT
+#define INDEX_WAIT_TIMEOUT 5        // Seconds to wait for the spindle index before an alarm is raised.
+#endif
+
+#if INDEX_WAIT_TICK_RATE * INDEX_WAIT_TIMEOUT > 65535
+#error "INDEX_WAIT_TICK_RATE * INDEX_WAIT_TIMEOUT must not exceed 65535!"
+#endif
+
+static float index_target; // Spindle position in revolutions that ends the index wait segment being executed.
+
+#endif
+
+#if ENABLE_BACKLASH_COMPENSATION
+
+// Backlash take-up state of the step segment generator, not cleared on reset since the mechanical state is kept.
+static struct {
+    axes_signals_t enabled;         // Axes where backlash is taken up by adding steps to motions.
+    axes_signals_t dir_negative;    // Current backlash direction of the axes.
+    uint32_t pending[N_AXIS];       // Take-up steps not yet added to a block.
+    float distance[N_AXIS];         // Remaining motion distance pending take-up steps are spread over (mm).
+} backlash = {0};
+
+// Take-up Bresenham state of the executing block, used by the stepper ISR.
+static struct {
+    uint32_t rate[N_AXIS];          // Bresenham increment adjusted by the AMASS level.
+    uint32_t counter[N_AXIS];
+    uint32_t owed[N_AXIS];          // Take-up steps due but not yet output.
+} takeup;
+
+#endif
+
+#if SEGMENT_BUFFER_PREFILL_LEVEL
+#if SEGMENT_BUFFER_PREFILL_LEVEL >= SEGMENT_BUFFER_SIZE
+#error "SEGMENT_BUFFER_PREFILL_LEVEL must be less than SEGMENT_BUFFER_SIZE!"
+#endif
+static on_execute_realtime_ptr on_execute_realtime = NULL;
+#endif
+
+#if ENABLE_INPUT_SHAPING
+
+#define SHAPER_MAX_IMPULSES 3
+
+typedef struct {
+    uint8_t type;           // Shaper type, frequency and damping ratio the impulses are computed for.
+    float frequency;
+    float damping;
+    uint_fast8_t n;         // Number of impulses, 1 if not shaping.
+    float amplitude[SHAPER_MAX_IMPULSES];
+    float time[SHAPER_MAX_IMPULSES]; // Impulse times (min)
+    float centroid;         // Amplitude weighted impulse time (min)
+} input_shaper_data_t;
+
+static input_shaper_data_t shapers[N_AXIS] = {0};
+static const input_shaper_data_t no_shaping = { .n = 1, .amplitude[0] = 1.0f };
+
+#endif
+
 // Segment preparation data struct. Contains all the necessary information to compute new segments
 // based on the current executing planner block.
 typedef struct {
@@ -131,6 +245,38 @@ typedef struct {
     float target_feed;      //
     float inv_feedrate;     // Used by PWM laser mode to speed up segment calculations.
     float current_spindle_rpm;
+#if ADAPTIVE_FEED_ENABLE
+    float adaptive_scale;   // Adaptive feed scale applied to the current velocity profile.
+#endif
+#if LASER_PPI_STEPPER_ENABLE
+    uint32_t ppi_steps;     // Step events between laser pulses of the last prepped block, 0 if not in PPI mode.
+#endif
+#if ENABLE_INPUT_SHAPING
+    const input_shaper_data_t *shaper; // Input shaper of executing block.
+#endif
+#if SHAPED_RAMPS
+    struct {
+        ramp_type_t type;   // Ramp type the shape is computed for, Ramp_Cruise if none.
+        float mm_start;     // Ramp start measured from end of block (mm)
+        float start_speed;  // (mm/min)
+        float delta_speed;  // Signed speed change over the ramp (mm/min)
+        float direction;    // Sign of speed change, 1.0 or -1.0
+        float accel;        // Peak acceleration of the base ramp in the direction of the speed change (mm/min^2)
+        float duration;     // Ramp time (min)
+        float base_duration;// Ramp time before input shaping (min)
+        float t_const;      // Constant acceleration time (min)
+        float time;         // Time elapsed since start of ramp (min)
+#if ENABLE_JERK_ACCELERATION
+        float accel_start;  // Start acceleration of the base ramp in the direction of the speed change (mm/min^2)
+        float t_up;         // Acceleration ramp up time (min)
+        float t_down;       // Acceleration ramp down time (min)
+        float carry;        // Signed acceleration at replan, start acceleration of the recomputed ramp (mm/min^2)
+#endif
+#if ENABLE_INPUT_SHAPING
+        const input_shaper_data_t *shaper;
+#endif
+    } ramp;
+#endif
 } st_prep_t;
 
 //! \endcond
@@ -192,6 +338,13 @@ void st_deenergize (void)
 // enabled. Startup init and limits call this function but shouldn't start the cycle.
 void st_wake_up (void)
 {
+#if SEGMENT_BUFFER_MONITOR
+    if(buffer_stats.restart) {
+        memset(&buffer_stats, 0, sizeof(st_buffer_stats_t));
+        buffer_stats.min_fill = SEGMENT_BUFFER_SIZE - 1;
+    }
+#endif
+
     if(sys.steppers_deenergize) {
         sys.steppers_deenergize = false;
 //        hal.delay_ms(0, st_deenergize); // Cancel any pending steppers deenergize
@@ -276,7 +429,65 @@ ISR_CODE void ISR_FUNC(st_go_idle)(void)
 
 //! \cond
 
+#if SYNCED_STATE_CHANGES_ENABLE
+
+static void set_coolant_state (void *data)
+{
+    coolant_set_state((coolant_state_t){ .value = (uint8_t)(uintptr_t)data });
+}
+
+static void set_spindle_off (void *data)
+{
+    spindle_set_state((spindle_ptrs_t *)data, (spindle_state_t){0}, 0.0f);
+}
+
+// Enqueue coolant and spindle changes to be performed by the foreground process when a block is completed.
+ISR_CODE static inline void ISR_FUNC(block_completed)(st_block_t *block)
+{
+    if(block && block->is_complete) {
+        if(block->end_state.spindle_off)
+            protocol_enqueue_foreground_task(set_spindle_off, block->end_state.spindle_off);
+        if(block->end_state.set_coolant)
+            protocol_enqueue_foreground_task(set_coolant_state, (void *)(uintptr_t)block->end_state.coolant.value);
+        block->end_state.spindle_off = NULL;
+        block->end_state.set_coolant = false;
+    }
+}
+
+#endif
+
+// Bresenham line tracer for one axis, expanded for each axis in the stepper ISR so that the
+// axis index and bit mask are compile time constants and there is no loop overhead.
+#if ENABLE_BACKLASH_COMPENSATION
+#define BRESENHAM_POSITION(idx) if(!backlash_motion) sys.position[idx] += st.dir_outbits.mask & bit(idx) ? -1 : 1;
+#else
+#define BRESENHAM_POSITION(idx) sys.position[idx] += st.dir_outbits.mask & bit(idx) ? -1 : 1;
+#endif
+
+#define BRESENHAM_AXIS(idx) \
+    if((st.counter[idx] += st.steps[idx]) > st.step_event_count) { \
+        step_outbits.mask |= bit(idx); \
+        st.counter[idx] -= st.step_event_count; \
+        BRESENHAM_POSITION(idx) \
+    }
+
+#if PROFILING_ENABLE
+
+ISR_CODE static inline void ISR_FUNC(stepper_interrupt)(void);
+
+ISR_CODE void ISR_FUNC(stepper_driver_interrupt_handler)(void)
+{
+    uint32_t t = profile_start();
+
+    stepper_interrupt();
+
+    profile_end(Profile_StepperInterrupt, t);
+}
+
+ISR_CODE static inline void ISR_FUNC(stepper_interrupt)(void)
+#else
 ISR_CODE void ISR_FUNC(stepper_driver_interrupt_handler)(void)
+#endif
 {
 #if ENABLE_BACKLASH_COMPENSATION
     static bool backlash_motion;
@@ -308,6 +519,10 @@ ISR_CODE void ISR_FUNC(stepper_driver_interrupt_handler)(void)
             // If the new segment starts a new planner block, initialize stepper variables and counters.
             if (st.exec_block != st.exec_segment->exec_block) {
 
+#if SYNCED_STATE_CHANGES_ENABLE
+                block_completed(st.exec_block);
+#endif
+
                 if((st.dir_change = st.exec_block == NULL || st.dir_outbits.value != st.exec_segment->exec_block->direction_bits.value))
                     st.dir_outbits = st.exec_segment->exec_block->direction_bits;
                 st.exec_block = st.exec_segment->exec_block;
@@ -315,6 +530,14 @@ ISR_CODE void ISR_FUNC(stepper_driver_interrupt_handler)(void)
                 st.new_block = true;
 #if ENABLE_BACKLASH_COMPENSATION
                 backlash_motion = st.exec_block->backlash_motion;
+                if(st.exec_block->backlash_axes.mask) {
+                    uint_fast8_t idx = N_AXIS;
+                    do {
+                        idx--;
+                        takeup.counter[idx] = st.exec_block->backlash_events[idx] >> 1;
+                        takeup.owed[idx] = 0;
+                    } while(idx);
+                }
 #endif
 
                 if(st.exec_block->overrides.sync)
@@ -334,28 +557,28 @@ ISR_CODE void ISR_FUNC(stepper_driver_interrupt_handler)(void)
                 // Enqueue any message to be printed (by foreground process)
                 if(st.exec_block->message) {
                     if(!protocol_enqueue_foreground_task((foreground_task_ptr)gc_output_message, st.exec_block->message))
-                        free(st.exec_block->message);
+                        gc_message_free(st.exec_block->message);
                     st.exec_block->message = NULL;
                 }
 
+#if LASER_RASTER_ENABLE
+                if((raster.data = st.exec_block->raster))
+                    raster.pixel = raster.position = raster.next = 0;
+#endif
+
+#if LASER_PPI_STEPPER_ENABLE
+                // Carry over the distance to the next pulse from the previous block, pulse immediately if none.
+                if((laser_ppi.steps = st.exec_block->ppi_steps))
+                    laser_ppi.remaining = laser_ppi.remaining > 0 ? (int32_t)(((uint64_t)laser_ppi.remaining * st.exec_block->ppi_scale) >> 16) : 0;
+                else
+                    laser_ppi.remaining = 0;
+#endif
+
                 // Initialize Bresenham line and distance counters
-                st.counter_x = st.counter_y = st.counter_z
-                #ifdef A_AXIS
-                  = st.counter_a
-                #endif
-                #ifdef B_AXIS
-                  = st.counter_b
-                #endif
-                #ifdef C_AXIS
-                  = st.counter_c
-                #endif
-                #ifdef U_AXIS
-                  = st.counter_u
-                #endif
-                #ifdef V_AXIS
-                  = st.counter_v
-                #endif
-                  = st.step_event_count >> 1;
+                uint_fast8_t idx = N_AXIS;
+                do {
+                    st.counter[--idx] = st.step_event_count >> 1;
+                } while(idx);
 
               #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
                 memcpy(st.steps, st.exec_block->steps, sizeof(st.steps));
@@ -365,34 +588,71 @@ ISR_CODE void ISR_FUNC(stepper_driver_interrupt_handler)(void)
           #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
             // With AMASS enabled, adjust Bresenham axis increment counters according to AMASS level.
             st.amass_level = st.exec_segment->amass_level;
-            st.steps[X_AXIS] = st.exec_block->steps[X_AXIS] >> st.amass_level;
-            st.steps[Y_AXIS] = st.exec_block->steps[Y_AXIS] >> st.amass_level;
-            st.steps[Z_AXIS] = st.exec_block->steps[Z_AXIS] >> st.amass_level;
-           #ifdef A_AXIS
-            st.steps[A_AXIS] = st.exec_block->steps[A_AXIS] >> st.amass_level;
-           #endif
-           #ifdef B_AXIS
-            st.steps[B_AXIS] = st.exec_block->steps[B_AXIS] >> st.amass_level;
-           #endif
-           #ifdef C_AXIS
-            st.steps[C_AXIS] = st.exec_block->steps[C_AXIS] >> st.amass_level;
-           #endif
-           #ifdef U_AXIS
-            st.steps[U_AXIS] = st.exec_block->steps[U_AXIS] >> st.amass_level;
-           #endif
-           #ifdef V_AXIS
-            st.steps[V_AXIS] = st.exec_block->steps[V_AXIS] >> st.amass_level;
-           #endif
+            uint_fast8_t idx = N_AXIS;
+            do {
+                idx--;
+                st.steps[idx] = st.exec_block->steps[idx] >> st.amass_level;
+            } while(idx);
          #endif
 
+#if ENABLE_BACKLASH_COMPENSATION
+            if(st.exec_block->backlash_axes.mask) {
+                uint_fast8_t idx = N_AXIS;
+                do {
+                    idx--;
+                  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+                    takeup.rate[idx] = st.exec_block->backlash_rate[idx] >> st.amass_level;
+                  #else
+                    takeup.rate[idx] = st.exec_block->backlash_rate[idx];
+                  #endif
+                } while(idx);
+            }
+#endif
+
+#if LASER_RASTER_ENABLE || LASER_PPI_STEPPER_ENABLE
+          #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+            tick_events = 1 << (MAX_AMASS_LEVEL - st.amass_level);
+          #else
+            tick_events = 2;
+          #endif
+#endif
+
             if(st.exec_segment->update_pwm)
                 st.exec_segment->update_pwm(st.exec_block->spindle, st.exec_segment->spindle_pwm);
             else if(st.exec_segment->update_rpm)
                 st.exec_segment->update_rpm(st.exec_block->spindle, st.exec_segment->spindle_rpm);
+
+#if THREADING_PIPELINE_ENABLE
+            // Wait for the first pass of the offset angle not immediately due, the index is at whole revolutions.
+            if(st.exec_segment->index_wait && st.exec_block->spindle->get_data) {
+                float position = st.exec_block->spindle->get_data(SpindleData_AngularPosition)->angular_position;
+                if((index_target = floorf(position) + st.exec_segment->index_offset) <= position)
+                    index_target += 1.0f;
+            }
+#endif
         } else {
             // Segment buffer empty. Shutdown.
             st_go_idle();
 
+#if SYNCED_STATE_CHANGES_ENABLE
+            block_completed(st.exec_block);
+#endif
+
+#if LASER_RASTER_ENABLE
+            if(raster.data) {
+                st.exec_block->spindle->update_pwm(st.exec_block->spindle, raster.data->off_pwm);
+                raster.data = NULL;
+            }
+#endif
+
+#if SEGMENT_BUFFER_MONITOR
+            // Buffer drained while motion is still pending?
+            if(!sys.step_control.end_motion && (pl_block || plan_get_current_block())) {
+                buffer_stats.underruns++;
+                buffer_stats.last_underrun = hal.get_elapsed_ticks ? hal.get_elapsed_ticks() : 0;
+            }
+#endif
+
             // Ensure pwm is set properly upon completion of rate-controlled motion.
             if (st.exec_block->dynamic_rpm && st.exec_block->spindle->cap.laser)
                 st.exec_block->spindle->update_pwm(st.exec_block->spindle, st.exec_block->spindle->pwm_off_value);
@@ -412,6 +672,9 @@ ISR_CODE void ISR_FUNC(stepper_driver_interrupt_handler)(void)
         sys.probing_state = Probing_Off;
         memcpy(sys.probe_position, sys.position, sizeof(sys.position));
         bit_true(sys.rt_exec_state, EXEC_MOTION_CANCEL);
+#if INPUT_EVENT_LOG_SIZE
+        input_event_log(InputEvent_Probe, 0, (input_event_signals_t){ .state = true });
+#endif
 
 #ifdef MINIMIZE_PROBE_OVERSHOOT
         // "Flush" segment buffer if full in order to start deceleration early.
@@ -428,101 +691,104 @@ ISR_CODE void ISR_FUNC(stepper_driver_interrupt_handler)(void)
 
     // Execute step displacement profile by Bresenham line algorithm
 
-    st.counter_x += st.steps[X_AXIS];
-    if (st.counter_x > st.step_event_count) {
-        step_outbits.x = On;
-        st.counter_x -= st.step_event_count;
-#if ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
+    BRESENHAM_AXIS(X_AXIS);
+    BRESENHAM_AXIS(Y_AXIS);
+    BRESENHAM_AXIS(Z_AXIS);
+#ifdef A_AXIS
+    BRESENHAM_AXIS(A_AXIS);
 #endif
-            sys.position[X_AXIS] = sys.position[X_AXIS] + (st.dir_outbits.x ? -1 : 1);
-    }
-
-    st.counter_y += st.steps[Y_AXIS];
-    if (st.counter_y > st.step_event_count) {
-        step_outbits.y = On;
-        st.counter_y -= st.step_event_count;
-#if ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
+#ifdef B_AXIS
+    BRESENHAM_AXIS(B_AXIS);
 #endif
-            sys.position[Y_AXIS] = sys.position[Y_AXIS] + (st.dir_outbits.y ? -1 : 1);
-    }
-
-    st.counter_z += st.steps[Z_AXIS];
-    if (st.counter_z > st.step_event_count) {
-        step_outbits.z = On;
-        st.counter_z -= st.step_event_count;
-#if ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
+#ifdef C_AXIS
+    BRESENHAM_AXIS(C_AXIS);
 #endif
-            sys.position[Z_AXIS] = sys.position[Z_AXIS] + (st.dir_outbits.z ? -1 : 1);
-    }
-
-  #ifdef A_AXIS
-      st.counter_a += st.steps[A_AXIS];
-      if (st.counter_a > st.step_event_count) {
-          step_outbits.a = On;
-          st.counter_a -= st.step_event_count;
-#if ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
+#ifdef U_AXIS
+    BRESENHAM_AXIS(U_AXIS);
 #endif
-              sys.position[A_AXIS] = sys.position[A_AXIS] + (st.dir_outbits.a ? -1 : 1);
-      }
-  #endif
-
-  #ifdef B_AXIS
-      st.counter_b += st.steps[B_AXIS];
-      if (st.counter_b > st.step_event_count) {
-          step_outbits.b = On;
-          st.counter_b -= st.step_event_count;
-#if ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
+#ifdef V_AXIS
+    BRESENHAM_AXIS(V_AXIS);
 #endif
-              sys.position[B_AXIS] = sys.position[B_AXIS] + (st.dir_outbits.b ? -1 : 1);
-      }
-  #endif
 
-  #ifdef C_AXIS
-      st.counter_c += st.steps[C_AXIS];
-      if (st.counter_c > st.step_event_count) {
-          step_outbits.c = On;
-          st.counter_c -= st.step_event_count;
 #if ENABLE_BACKLASH_COMPENSATION
-        if(!backlash_motion)
+    // Output backlash take-up steps on ticks where the axis is not stepped, machine position is not updated.
+    if(st.exec_block->backlash_axes.mask) {
+        uint_fast8_t idx = N_AXIS;
+        do {
+            if(st.exec_block->backlash_axes.mask & bit(--idx)) {
+                if((takeup.counter[idx] += takeup.rate[idx]) > st.exec_block->backlash_events[idx]) {
+                    takeup.counter[idx] -= st.exec_block->backlash_events[idx];
+                    takeup.owed[idx]++;
+                }
+                if(takeup.owed[idx] && !(step_outbits.mask & bit(idx))) {
+                    step_outbits.mask |= bit(idx);
+                    takeup.owed[idx]--;
+                    if(--st.exec_block->backlash_steps[idx] == 0)
+                        st.exec_block->backlash_axes.mask &= ~bit(idx);
+                }
+            }
+        } while(idx);
+    }
 #endif
-              sys.position[C_AXIS] = sys.position[C_AXIS] + (st.dir_outbits.c ? -1 : 1);
-      }
-  #endif
 
-  #ifdef U_AXIS
-    st.counter_u += st.steps[U_AXIS];
-    if (st.counter_u > st.step_event_count) {
-        step_outbits.u = On;
-        st.counter_u -= st.step_event_count;
-#if ENABLE_BACKLASH_COMPENSATION
-      if(!backlash_motion)
+    st.step_outbits.value = step_outbits.value;
+
+    // During a homing cycle, lock out and prevent desired axes from moving.
+    if (state_get() == STATE_HOMING) {
+#if HOMING_POSITION_LATCH
+        // Latch position and lock out axes immediately on home switch trigger, avoids overshoot caused by foreground latency.
+        if(sys.homing_latch.armed.mask) {
+            home_signals_t home = hal.homing.get_state();
+            axes_signals_t triggered = { .mask = (home.a.mask | home.b.mask) & sys.homing_latch.armed.mask };
+            if(triggered.mask) {
+                uint_fast8_t idx = N_AXIS;
+                do {
+                    if(triggered.mask & bit(--idx))
+                        sys.homing_latch.position[idx] = sys.position[idx];
+                } while(idx);
+                sys.homing_latch.armed.mask &= ~triggered.mask;
+                sys.homing_latch.latched.mask |= triggered.mask;
+            }
+        }
+        st.step_outbits.value &= sys.homing_axis_lock.mask & ~sys.homing_latch.latched.mask;
+#else
+        st.step_outbits.value &= sys.homing_axis_lock.mask;
 #endif
-            sys.position[U_AXIS] = sys.position[U_AXIS] + (st.dir_outbits.u ? -1 : 1);
     }
-  #endif
 
-  #ifdef V_AXIS
-    st.counter_v += st.steps[V_AXIS];
-    if (st.counter_v > st.step_event_count) {
-        step_outbits.v = On;
-        st.counter_v -= st.step_event_count;
-#if ENABLE_BACKLASH_COMPENSATION
-      if(!backlash_motion)
-#endif
-            sys.position[V_AXIS] = sys.position[V_AXIS] + (st.dir_outbits.v ? -1 : 1);
+#if LASER_RASTER_ENABLE
+    // Output the next pixel when its step position is reached, switch the laser off after the last one.
+    if(raster.data && (raster.position += tick_events) > raster.next) {
+        if(raster.pixel < raster.data->length) {
+            st.exec_block->spindle->update_pwm(st.exec_block->spindle, raster.data->pwm[raster.pixel++]);
+            raster.next += raster.data->pixel_steps;
+        } else {
+            st.exec_block->spindle->update_pwm(st.exec_block->spindle, raster.data->off_pwm);
+            raster.data = NULL;
+        }
     }
-  #endif
+#endif
 
-    st.step_outbits.value = step_outbits.value;
+#if LASER_PPI_STEPPER_ENABLE
+    // Fire a laser pulse for every PPI distance travelled along the path.
+    if(laser_ppi.steps && (laser_ppi.remaining -= tick_events) <= 0) {
+        st.exec_block->spindle->pulse_on(laser_ppi.pulse_length);
+        laser_ppi.remaining += laser_ppi.steps;
+    }
+#endif
 
-    // During a homing cycle, lock out and prevent desired axes from moving.
-    if (state_get() == STATE_HOMING)
-        st.step_outbits.value &= sys.homing_axis_lock.mask;
+#if THREADING_PIPELINE_ENABLE
+    // Hold the index wait segment until the spindle reaches the target position.
+    // On timeout motion is stopped, the synchronized motion following must not start at an unknown spindle angle.
+    if(st.exec_segment->index_wait) {
+        if(st.step_count == 1 || st.exec_block->spindle->get_data == NULL) {
+            mc_reset();
+            system_set_exec_alarm(Alarm_Spindle);
+            return;
+        } else if(st.exec_block->spindle->get_data(SpindleData_AngularPosition)->angular_position >= index_target)
+            st.step_count = 1;
+    }
+#endif
 
     if (st.step_count == 0 || --st.step_count == 0) {
         // Segment is complete. Advance segment tail pointer.
@@ -532,6 +798,82 @@ ISR_CODE void ISR_FUNC(stepper_driver_interrupt_handler)(void)
 
 //! \endcond
 
+#if LASER_RASTER_ENABLE
+
+// Converts the pixel power levels of raster data to PWM values and calculates the number of step events per pixel.
+static void raster_prepare (raster_data_t *data, plan_block_t *block, uint32_t step_event_count)
+{
+    spindle_ptrs_t *spindle = block->spindle->hal;
+    uint_fast16_t idx = data->length;
+    float rpm = block->spindle->state.on ? block->spindle_rpm * 0.01f * (float)spindle->param->override_pct / 255.0f : 0.0f;
+
+    data->off_pwm = spindle->pwm_off_value;
+    data->pixel_steps = max(step_event_count / data->length, 1);
+
+    do {
+        idx--;
+        data->pwm[idx] = data->pwm[idx] && rpm > 0.0f ? spindle->get_pwm(spindle, rpm * (float)data->pwm[idx]) : data->off_pwm;
+    } while(idx);
+}
+
+#endif
+
+#if ADAPTIVE_FEED_ENABLE
+
+/*! \brief Set adaptive feed scale, applied to feed motions when adaptive feed is enabled by M52.
+The new value is applied to the next step segment prepared, the velocity profile of the executing
+block is recomputed from the current speed without replanning.
+\param scale feed scale, 0.0 - 1.0. Values are clamped, the resulting feed rate is never below MINIMUM_FEED_RATE.
+__NOTE:__ May be called from interrupt context, e.g. an ADC conversion complete handler.
+*/
+ISR_CODE void ISR_FUNC(st_set_adaptive_feed)(float scale)
+{
+    adaptive_scale = scale < 0.0f ? 0.0f : (scale > 1.0f ? 1.0f : scale);
+}
+
+float st_get_adaptive_feed (void)
+{
+    return adaptive_scale;
+}
+
+#endif
+
+#if LASER_PPI_STEPPER_ENABLE
+
+// Sets laser PPI (Pulses Per Inch) parameters for blocks subsequently loaded into the step segment buffer.
+// Returns false if the current spindle does not support pulsing the laser.
+bool st_laser_ppi_enable (uint_fast16_t ppi, uint_fast16_t pulse_length)
+{
+    spindle_ptrs_t *spindle = gc_spindle_get();
+
+    laser_ppi.ppi = ppi;
+    laser_ppi.pulse_length = pulse_length;
+
+    return spindle && spindle->pulse_on;
+}
+
+#endif
+
+#if SEGMENT_BUFFER_PREFILL_LEVEL
+
+// Tops up the step segment buffer from the realtime execution chain when the fill level
+// drops below SEGMENT_BUFFER_PREFILL_LEVEL, e.g. while the foreground is blocked waiting for output.
+static void st_prefill (sys_state_t state)
+{
+    static bool busy = false;
+
+    if(!busy && (state & (STATE_CYCLE|STATE_HOLD|STATE_SAFETY_DOOR|STATE_JOG)) &&
+         st_get_segment_buffer_fill() < SEGMENT_BUFFER_PREFILL_LEVEL) {
+        busy = true;
+        st_prep_buffer();
+        busy = false;
+    }
+
+    on_execute_realtime(state);
+}
+
+#endif
+
 // Reset and clear stepper subsystem variables
 void st_reset (void)
 {
@@ -542,6 +884,8 @@ void st_reset (void)
     st_go_idle();
    // hal.stepper.go_idle(true);
 
+    st_prep_lock(true);
+
     // NOTE: buffer indices starts from 1 for simpler driver coding!
 
     // Set up stepper block ringbuffer as circular linked list and add id
@@ -549,6 +893,23 @@ void st_reset (void)
     for(idx = 0 ; idx <= idx_max ; idx++) {
         st_block_buffer[idx].next = &st_block_buffer[idx == idx_max ? 0 : idx + 1];
         st_block_buffer[idx].id = idx + 1;
+#if ENABLE_BACKLASH_COMPENSATION
+        // Take-up steps not output by discarded blocks are pending again since the mechanical state is kept.
+        if(st_block_buffer[idx].backlash_axes.mask) {
+            uint_fast8_t axis = N_AXIS;
+            do {
+                if(st_block_buffer[idx].backlash_axes.mask & bit(--axis))
+                    backlash.pending[axis] += st_block_buffer[idx].backlash_steps[axis];
+            } while(axis);
+            st_block_buffer[idx].backlash_axes.mask = 0;
+        }
+#endif
+#if LASER_RASTER_ENABLE
+        if(st_block_buffer[idx].raster) {
+            mem_free(st_block_buffer[idx].raster);
+            st_block_buffer[idx].raster = NULL;
+        }
+#endif
     }
 
     // Set up segments ringbuffer as circular linked list, add id and clear AMASS level
@@ -568,6 +929,29 @@ void st_reset (void)
 
     memset(&prep, 0, sizeof(st_prep_t));
     memset(&st, 0, sizeof(stepper_t));
+#if LASER_RASTER_ENABLE
+    raster.data = NULL;
+#endif
+#if LASER_PPI_STEPPER_ENABLE
+    laser_ppi.steps = 0;
+    laser_ppi.remaining = 0;
+#endif
+
+#if SEGMENT_BUFFER_MONITOR
+    memset(&buffer_stats, 0, sizeof(st_buffer_stats_t));
+    buffer_stats.min_fill = SEGMENT_BUFFER_SIZE - 1;
+#endif
+#if STEP_FIDELITY_MONITOR
+    fidelity_stats.last_rate = 0.0f;
+    fidelity_stats.last_amass_level = 0;
+#endif
+
+#if SEGMENT_BUFFER_PREFILL_LEVEL
+    if(on_execute_realtime == NULL) {
+        on_execute_realtime = grbl.on_execute_realtime;
+        grbl.on_execute_realtime = st_prefill;
+    }
+#endif
 
 #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
     // TODO: move to driver?
@@ -579,6 +963,8 @@ void st_reset (void)
 #endif
 
     cycles_per_min = (float)hal.f_step_timer * 60.0f;
+
+    st_prep_lock(false);
 }
 
 // Called by spindle_set_state() to inform about RPM changes.
@@ -591,20 +977,33 @@ void st_rpm_changed (float rpm)
 // Called by planner_recalculate() when the executing block is updated by the new plan.
 void st_update_plan_block_parameters (void)
 {
+    st_prep_lock(true);
+
     if (pl_block != NULL) { // Ignore if at start of a new block.
         prep.recalculate.velocity_profile = On;
         pl_block->entry_speed_sqr = prep.current_speed * prep.current_speed; // Update entry speed.
         pl_block = NULL; // Flag st_prep_segment() to load and check active velocity profile.
     }
+
+    st_prep_lock(false);
 }
 
 // Changes the run state of the step segment buffer to execute the special parking motion.
 void st_parking_setup_buffer (void)
 {
+    st_prep_lock(true);
+
     // Store step execution data of partially completed block, if necessary.
     if (prep.recalculate.hold_partial_block && !prep.recalculate.parking) {
         prep.last_st_block = st_prep_block;
         memcpy(&st_hold_block, st_prep_block, sizeof(st_block_t));
+#if LASER_RASTER_ENABLE
+        // Raster output is not resumed after parking, the remainder of the motion is executed at programmed power.
+        if(st_hold_block.raster) {
+            mem_free(st_hold_block.raster);
+            st_hold_block.raster = st_prep_block->raster = NULL;
+        }
+#endif
         prep.last_steps_remaining = prep.steps_remaining;
         prep.last_dt_remainder = prep.dt_remainder;
         prep.last_steps_per_mm = prep.steps_per_mm;
@@ -613,12 +1012,16 @@ void st_parking_setup_buffer (void)
     prep.recalculate.parking = On;
     prep.recalculate.velocity_profile = Off;
     pl_block = NULL; // Always reset parking motion to reload new block.
+
+    st_prep_lock(false);
 }
 
 
 // Restores the step segment buffer to the normal run state after a parking motion.
 void st_parking_restore_buffer (void)
 {
+    st_prep_lock(true);
+
     // Restore step execution data and flags of partially completed block, if necessary.
     if (prep.recalculate.hold_partial_block) {
         memcpy(prep.last_st_block, &st_hold_block, sizeof(st_block_t));
@@ -633,8 +1036,645 @@ void st_parking_restore_buffer (void)
         prep.recalculate.flags = 0;
 
     pl_block = NULL; // Set to reload next block.
+
+    st_prep_lock(false);
 }
 
+#if ENABLE_BACKLASH_COMPENSATION
+
+// Sets the axes where backlash is taken up by the step segment generator and their current backlash direction.
+// Called by mc_backlash_init(), pending take-up is discarded.
+void st_backlash_init (axes_signals_t axes, axes_signals_t dir_negative)
+{
+    backlash.enabled = axes;
+    backlash.dir_negative = dir_negative;
+    memset(backlash.pending, 0, sizeof(backlash.pending));
+    memset(backlash.distance, 0, sizeof(backlash.distance));
+}
+
+// Adds backlash take-up steps to a new block for axes that have reversed direction.
+// The take-up steps are spread over the take-up distance setting, across several blocks if needed,
+// and the block step event count is increased to make room for them so the velocity profile is kept.
+// Returns the block step event count, unshifted.
+static uint32_t backlash_fold (st_block_t *block, plan_block_t *pl_block)
+{
+    uint_fast8_t idx = N_AXIS;
+    uint32_t step_event_count = pl_block->step_event_count;
+    float window[N_AXIS];
+
+    block->backlash_axes.mask = 0;
+
+    if(backlash.enabled.mask == 0 || pl_block->condition.backlash_motion ||
+        sys.step_control.execute_sys_motion || state_get() == STATE_HOMING)
+        return step_event_count;
+
+    do {
+        idx--;
+        block->backlash_steps[idx] = 0;
+        if((backlash.enabled.mask & bit(idx)) && pl_block->steps[idx]) {
+
+            // On reversal the slack not yet taken up in the old direction is subtracted from the new take-up.
+            if(!(pl_block->direction_bits.mask & bit(idx)) != !(backlash.dir_negative.mask & bit(idx))) {
+                backlash.dir_negative.mask ^= bit(idx);
+                backlash.pending[idx] = (uint32_t)lroundf(settings.axis[idx].backlash * settings.axis[idx].steps_per_mm) - backlash.pending[idx];
+                backlash.distance[idx] = settings.backlash_takeup;
+            }
+
+            if(backlash.pending[idx]) {
+
+                uint32_t steps;
+
+                if(pl_block->millimeters >= backlash.distance[idx]) {
+                    // Remainder fits in the block, output it over the start of the block.
+                    steps = backlash.pending[idx];
+                    window[idx] = min(max(backlash.distance[idx], settings.backlash_takeup * 0.1f) / pl_block->millimeters, 1.0f);
+                    backlash.distance[idx] = 0.0f;
+                } else {
+                    steps = (uint32_t)lroundf((float)backlash.pending[idx] * pl_block->millimeters / backlash.distance[idx]);
+                    window[idx] = 1.0f;
+                    backlash.distance[idx] -= pl_block->millimeters;
+                }
+
+                if(steps) {
+                    backlash.pending[idx] -= steps;
+                    block->backlash_axes.mask |= bit(idx);
+                    block->backlash_steps[idx] = steps;
+                    // Ensure there are enough step events the axis is not stepped for the take-up steps.
+                    step_event_count = max(step_event_count, pl_block->steps[idx] + (uint32_t)ceilf((float)steps / window[idx]) + 2);
+                }
+            }
+        }
+    } while(idx);
+
+    if(block->backlash_axes.mask) {
+        idx = N_AXIS;
+        do {
+            if(block->backlash_axes.mask & bit(--idx)) {
+                uint32_t events = max((uint32_t)(window[idx] * (float)step_event_count), block->backlash_steps[idx]);
+              #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+                block->backlash_rate[idx] = block->backlash_steps[idx] << 1;
+                block->backlash_events[idx] = events << 1;
+              #else
+                block->backlash_rate[idx] = block->backlash_steps[idx] << MAX_AMASS_LEVEL;
+                block->backlash_events[idx] = events << MAX_AMASS_LEVEL;
+              #endif
+            }
+        } while(idx);
+    }
+
+    return step_event_count;
+}
+
+#endif // ENABLE_BACKLASH_COMPENSATION
+
+#if ENABLE_INPUT_SHAPING
+
+// Returns the input shaper of the axis with the longest motion in the block, impulses are recomputed after settings changes.
+static const input_shaper_data_t *shaper_get (plan_block_t *block)
+{
+    uint_fast8_t idx = N_AXIS, axis = 0;
+    float distance, max_distance = 0.0f;
+
+    do {
+        idx--;
+        if((distance = (float)block->steps[idx] / settings.axis[idx].steps_per_mm) > max_distance) {
+            max_distance = distance;
+            axis = idx;
+        }
+    } while(idx);
+
+    input_shaper_data_t *shaper = &shapers[axis];
+    float frequency = settings.axis[axis].shaper_frequency, damping = settings.axis[axis].shaper_damping;
+
+    if(shaper->type != settings.input_shaper || shaper->frequency != frequency || shaper->damping != damping) {
+
+        float df = sqrtf(1.0f - damping * damping), td = 1.0f / (frequency * df * 60.0f), k, sum; // td is damped period in minutes.
+
+        shaper->type = settings.input_shaper;
+        shaper->frequency = frequency;
+        shaper->damping = damping;
+        shaper->n = 1;
+        shaper->amplitude[0] = 1.0f;
+        shaper->time[0] = shaper->centroid = 0.0f;
+
+        if(frequency > 0.0f) switch((input_shaper_t)shaper->type) {
+
+            case InputShaper_ZV:
+                k = expf(-damping * M_PI / df);
+                shaper->n = 2;
+                shaper->amplitude[1] = k;
+                shaper->time[1] = 0.5f * td;
+                break;
+
+            case InputShaper_ZVD:
+                k = expf(-damping * M_PI / df);
+                shaper->n = 3;
+                shaper->amplitude[1] = 2.0f * k;
+                shaper->amplitude[2] = k * k;
+                shaper->time[1] = 0.5f * td;
+                shaper->time[2] = td;
+                break;
+
+            case InputShaper_MZV:
+                k = expf(-0.75f * damping * M_PI / df);
+                shaper->n = 3;
+                shaper->amplitude[0] = 1.0f - 1.0f / sqrtf(2.0f);
+                shaper->amplitude[1] = (sqrtf(2.0f) - 1.0f) * k;
+                shaper->amplitude[2] = shaper->amplitude[0] * k * k;
+                shaper->time[1] = 0.375f * td;
+                shaper->time[2] = 0.75f * td;
+                break;
+
+            default:
+                break;
+        }
+
+        for(sum = 0.0f, idx = 0; idx < shaper->n; idx++)
+            sum += shaper->amplitude[idx];
+
+        for(idx = 0; idx < shaper->n; idx++) {
+            shaper->amplitude[idx] /= sum;
+            shaper->centroid += shaper->amplitude[idx] * shaper->time[idx];
+        }
+    }
+
+    return shaper;
+}
+
+#endif
+
+#if SHAPED_RAMPS
+
+/* Shaped ramps replace the planned constant acceleration ramps, they start and end at the planned speeds.
+   The base ramp has constant acceleration or, with ENABLE_JERK_ACCELERATION, acceleration ramped up to and down
+   from a peak value at the jerk limit. The peak acceleration is searched for the ramp to end at the planned
+   distance and the velocity profile is fitted to leave room for jerk limited ramps at the block acceleration,
+   see jerk_fit_profile(). The acceleration at the time of a replan is carried over to the recomputed ramp.
+   Ramps that cannot be jerk limited within the planned distance fall back to constant acceleration.
+   With ENABLE_INPUT_SHAPING the acceleration of the base ramp is convolved with the input shaper impulses. The
+   base ramp time is adjusted for the shaped ramp to cover the planned distance, if this is not possible without
+   more than doubling the acceleration the ramp is not shaped.
+*/
+
+#if ENABLE_JERK_ACCELERATION
+
+// Sets a constant acceleration base ramp for a speed change dv over duration, used when there is not enough
+// distance for a jerk limited ramp.
+static void ramp_constant (float dv, float duration)
+{
+    prep.ramp.accel_start = 0.0f;
+    prep.ramp.t_up = prep.ramp.t_down = 0.0f;
+    prep.ramp.t_const = duration;
+    prep.ramp.accel = duration > 0.0f ? dv / duration : 0.0f;
+}
+
+// Sets the base ramp phases for a speed change dv from start acceleration a0 to peak acceleration ap, both in the
+// direction of the speed change. Returns the distance covered in excess of the start speed (mm).
+static float ramp_phases (float dv, float a0, float ap, float jerk)
+{
+    float t_up = 0.0f, t_const = 0.0f, t_down = 0.0f, dv_up = 0.0f, mm = 0.0f;
+
+    if(dv > 0.0f) {
+        if(ap > a0) {
+            t_up = (ap - a0) / jerk;
+            dv_up = 0.5f * (a0 + ap) * t_up;
+            t_down = ap / jerk;
+            t_const = max(dv - dv_up - 0.5f * ap * t_down, 0.0f) / ap;
+        } else { // Start acceleration too high for the speed change, ramp it down to land on the end speed.
+            ap = a0;
+            t_down = 2.0f * dv / ap;
+        }
+        mm = t_up * t_up * (a0 / 3.0f + ap / 6.0f) + (dv_up + 0.5f * ap * t_const) * t_const +
+              (dv_up + ap * t_const + ap * t_down / 3.0f) * t_down;
+    } else
+        ap = 0.0f;
+
+    prep.ramp.accel_start = a0;
+    prep.ramp.accel = ap;
+    prep.ramp.t_up = t_up;
+    prep.ramp.t_const = t_const;
+    prep.ramp.t_down = t_down;
+
+    return mm;
+}
+
+// Returns the distance covered by a jerk limited speed change from the signed start acceleration a0 with peak
+// acceleration accel or lower if the jerk limit is reached first. Overwrites the base ramp phases.
+static float jerk_ramp_distance (float start_speed, float end_speed, float a0, float accel, float jerk)
+{
+    float dv = fabsf(end_speed - start_speed), direction = end_speed < start_speed ? -1.0f : 1.0f, mm;
+
+    a0 *= direction;
+    mm = ramp_phases(dv, a0, min(accel, sqrtf(jerk * dv + 0.5f * a0 * a0)), jerk);
+
+    return start_speed * (prep.ramp.t_up + prep.ramp.t_const + prep.ramp.t_down) + direction * mm;
+}
+
+// Moves the ramp junctions of the velocity profile to leave room for jerk limited ramps at the block acceleration,
+// the maximum speed is lowered if they do not fit. Acceleration- and deceleration-only profiles have their speed
+// change and distance set by the planner, the peak acceleration may then be higher.
+static void jerk_fit_profile (void)
+{
+    float mm_accel = 0.0f, mm_decel = 0.0f, accel = pl_block->acceleration, jerk = pl_block->jerk;
+
+    if(prep.ramp_type == Ramp_Decel || (prep.ramp_type == Ramp_Accel && prep.accelerate_until <= 0.0f))
+        return;
+
+    if(prep.ramp_type == Ramp_Accel)
+        mm_accel = jerk_ramp_distance(prep.current_speed, prep.maximum_speed, prep.ramp.carry, accel, jerk);
+    if(prep.maximum_speed > prep.exit_speed)
+        mm_decel = jerk_ramp_distance(prep.maximum_speed, prep.exit_speed, 0.0f, accel, jerk);
+
+    if(mm_accel + mm_decel <= pl_block->millimeters) {
+        if(prep.ramp_type == Ramp_Accel)
+            prep.accelerate_until = pl_block->millimeters - mm_accel;
+        prep.decelerate_after = mm_decel;
+    } else if(prep.ramp_type == Ramp_Accel && mm_decel > 0.0f) {
+        // Lower the maximum speed until the acceleration and deceleration ramps meet.
+        float lo = max(prep.current_speed, prep.exit_speed), hi = prep.maximum_speed;
+        uint_fast8_t iterations = 16;
+        do {
+            prep.maximum_speed = 0.5f * (lo + hi);
+            mm_accel = jerk_ramp_distance(prep.current_speed, prep.maximum_speed, prep.ramp.carry, accel, jerk);
+            mm_decel = jerk_ramp_distance(prep.maximum_speed, prep.exit_speed, 0.0f, accel, jerk);
+            if(mm_accel + mm_decel > pl_block->millimeters)
+                hi = prep.maximum_speed;
+            else
+                lo = prep.maximum_speed;
+        } while(--iterations);
+        mm_accel = jerk_ramp_distance(prep.current_speed, lo, prep.ramp.carry, accel, jerk);
+        mm_decel = jerk_ramp_distance(lo, prep.exit_speed, 0.0f, accel, jerk);
+        prep.maximum_speed = lo;
+        if(mm_accel + mm_decel <= pl_block->millimeters)
+            prep.accelerate_until = prep.decelerate_after = pl_block->millimeters - mm_accel;
+        else // Start and end speeds too far apart for the block, ramp_init() may fall back to constant acceleration.
+            prep.accelerate_until = prep.decelerate_after = pl_block->millimeters * mm_decel / (mm_accel + mm_decel);
+    }
+}
+
+#endif
+
+// Initializes the ramp from start_speed at mm_start to end_speed at mm_end, distances measured from end of block.
+static void ramp_init (ramp_type_t type, float mm_start, float mm_end, float start_speed, float end_speed)
+{
+    float delta_speed = end_speed - start_speed, dv = fabsf(delta_speed), duration = dv / pl_block->acceleration;
+
+    prep.ramp.type = type;
+    prep.ramp.mm_start = mm_start;
+    prep.ramp.start_speed = start_speed;
+    prep.ramp.delta_speed = delta_speed;
+    prep.ramp.direction = delta_speed < 0.0f ? -1.0f : 1.0f;
+    prep.ramp.base_duration = prep.ramp.duration = duration;
+    prep.ramp.time = 0.0f;
+
+#if ENABLE_INPUT_SHAPING
+    prep.ramp.shaper = &no_shaping;
+    if(prep.shaper->n > 1 && duration > 0.0f) {
+        float t_last = prep.shaper->time[prep.shaper->n - 1];
+        float base_duration = (start_speed * (duration - t_last) + delta_speed * (0.5f * duration - t_last + prep.shaper->centroid)) /
+                               (0.5f * (start_speed + end_speed));
+        if(base_duration >= 0.5f * duration) {
+            prep.ramp.shaper = prep.shaper;
+            prep.ramp.base_duration = base_duration;
+            prep.ramp.duration = base_duration + t_last;
+        }
+    }
+    duration = prep.ramp.base_duration;
+#endif
+
+#if ENABLE_JERK_ACCELERATION
+    float jerk = pl_block->jerk;
+  #if ENABLE_INPUT_SHAPING
+    if(prep.ramp.shaper->n > 1) {
+        // Shaped ramps keep a point symmetric profile with the base ramp time from above. If this is too short
+        // for the jerk limit the base ramp has constant acceleration.
+        float disc = duration * duration - 4.0f * dv / jerk;
+        if(disc > 0.0f)
+            ramp_phases(dv, 0.0f, jerk * 0.5f * (duration - sqrtf(disc)), jerk);
+        else
+            ramp_constant(dv, duration);
+    } else
+  #endif
+    {
+        // The ramp distance increases as the peak acceleration is lowered. Unless the distance end is passed at
+        // the jerk limit the peak acceleration ending the ramp there is searched for. If it is passed the ramp
+        // cannot be jerk limited without ending at a different speed, constant acceleration is then used.
+        float a0 = prep.ramp.carry, mm_ramp = fabsf(mm_start - mm_end), mm_jerk;
+        float lo = max(a0 * prep.ramp.direction, 0.0f), hi = sqrtf(jerk * dv + 0.5f * a0 * a0), accel = hi;
+
+        if((mm_jerk = jerk_ramp_distance(start_speed, end_speed, a0, hi, jerk)) < mm_ramp) {
+            uint_fast8_t iterations = 16;
+            do {
+                accel = 0.5f * (lo + hi);
+                if(jerk_ramp_distance(start_speed, end_speed, a0, accel, jerk) > mm_ramp)
+                    lo = accel;
+                else
+                    hi = accel;
+            } while(--iterations);
+            accel = hi;
+        }
+        if(mm_jerk > mm_ramp)
+            ramp_constant(dv, 2.0f * mm_ramp / (start_speed + end_speed));
+        else
+            jerk_ramp_distance(start_speed, end_speed, a0, accel, jerk);
+        prep.ramp.base_duration = prep.ramp.duration = prep.ramp.t_up + prep.ramp.t_const + prep.ramp.t_down;
+    }
+    prep.ramp.carry = 0.0f;
+#else
+    UNUSED(mm_end);
+
+    prep.ramp.t_const = duration;
+    prep.ramp.accel = duration > 0.0f ? dv / duration : 0.0f;
+#endif
+}
+
+// Returns speed change and distance covered by the base ramp at time t, t may be outside the ramp.
+static float base_ramp (float t, float *mm)
+{
+    float dv = 0.0f, tp;
+
+    *mm = 0.0f;
+
+    if(t > 0.0f) {
+#if ENABLE_JERK_ACCELERATION
+        if((tp = min(t, prep.ramp.t_up)) > 0.0f) { // Acceleration ramping up.
+            float jerk = (prep.ramp.accel - prep.ramp.accel_start) / prep.ramp.t_up;
+            *mm = tp * tp * (0.5f * prep.ramp.accel_start + jerk * tp / 6.0f);
+            dv = tp * (prep.ramp.accel_start + 0.5f * jerk * tp);
+        }
+        t -= prep.ramp.t_up;
+#endif
+        if((tp = min(t, prep.ramp.t_const)) > 0.0f) { // Constant acceleration.
+            *mm += tp * (dv + 0.5f * prep.ramp.accel * tp);
+            dv += prep.ramp.accel * tp;
+        }
+        t -= prep.ramp.t_const;
+#if ENABLE_JERK_ACCELERATION
+        if((tp = min(t, prep.ramp.t_down)) > 0.0f) { // Acceleration ramping down.
+            float jerk = prep.ramp.accel / prep.ramp.t_down;
+            *mm += tp * (dv + tp * (0.5f * prep.ramp.accel - jerk * tp / 6.0f));
+            dv += tp * (prep.ramp.accel - 0.5f * jerk * tp);
+        }
+        t -= prep.ramp.t_down;
+#endif
+        if(t > 0.0f) // Past end of ramp.
+            *mm += dv * t;
+        *mm *= prep.ramp.direction;
+        dv *= prep.ramp.direction;
+    }
+
+    return dv;
+}
+
+#if ENABLE_JERK_ACCELERATION
+
+// Returns the signed acceleration of the base ramp at time t.
+static float base_accel (float t)
+{
+    float accel = 0.0f;
+
+    if(t >= 0.0f) {
+        if(t < prep.ramp.t_up)
+            accel = prep.ramp.accel_start + (prep.ramp.accel - prep.ramp.accel_start) * t / prep.ramp.t_up;
+        else if((t -= prep.ramp.t_up) < prep.ramp.t_const)
+            accel = prep.ramp.accel;
+        else if((t -= prep.ramp.t_const) < prep.ramp.t_down)
+            accel = prep.ramp.accel * (1.0f - t / prep.ramp.t_down);
+    }
+
+    return accel * prep.ramp.direction;
+}
+
+// Returns the acceleration at the current ramp time, 0 when not in a ramp.
+static float ramp_accel (void)
+{
+    float accel = 0.0f;
+
+    if(prep.ramp.type == Ramp_Accel || prep.ramp.type == Ramp_Decel) {
+#if ENABLE_INPUT_SHAPING
+        uint_fast8_t idx = prep.ramp.shaper->n;
+        do {
+            idx--;
+            accel += prep.ramp.shaper->amplitude[idx] * base_accel(prep.ramp.time - prep.ramp.shaper->time[idx]);
+        } while(idx);
+#else
+        accel = base_accel(prep.ramp.time);
+#endif
+    }
+
+    return accel;
+}
+
+#endif
+
+/* Advances the ramp by time_var, returns false at end of ramp with time_var set to the remaining ramp time.
+   Otherwise mm_remaining is set to the distance from end of block and speed to the speed at the new ramp time.
+*/
+static bool ramp_advance (float *time_var, float *mm_remaining, float *speed)
+{
+    float t = prep.ramp.time + *time_var, dv, mm;
+
+    if(t >= prep.ramp.duration) {
+        *time_var = prep.ramp.duration - prep.ramp.time;
+        prep.ramp.time = prep.ramp.duration;
+        return false;
+    }
+
+    prep.ramp.time = t;
+
+#if ENABLE_INPUT_SHAPING
+    float mm_impulse;
+    uint_fast8_t idx = prep.ramp.shaper->n;
+
+    dv = mm = 0.0f;
+    do {
+        idx--;
+        dv += prep.ramp.shaper->amplitude[idx] * base_ramp(t - prep.ramp.shaper->time[idx], &mm_impulse);
+        mm += prep.ramp.shaper->amplitude[idx] * mm_impulse;
+    } while(idx);
+#else
+    dv = base_ramp(t, &mm);
+#endif
+
+    *speed = prep.ramp.start_speed + dv;
+    *mm_remaining = prep.ramp.mm_start - (prep.ramp.start_speed * t + mm);
+
+    return true;
+}
+
+#endif
+
+#if PLANNER_DWELL_ENABLE
+
+// Loads a dwell planner block, the Bresenham data is zeroed so no steps are output.
+static void dwell_load (void)
+{
+    uint_fast8_t idx = N_AXIS;
+    plan_block_data_t *pl_block_data = plan_get_block_data(pl_block);
+
+    st_prep_block = st_prep_block->next;
+
+    do {
+        st_prep_block->steps[--idx] = 0;
+    } while(idx);
+
+    st_prep_block->step_event_count = 0;
+    st_prep_block->direction_bits = pl_block->direction_bits;
+    st_prep_block->programmed_rate = st_prep_block->millimeters = st_prep_block->steps_per_mm = 0.0f;
+    st_prep_block->spindle = pl_block->spindle->hal;
+    st_prep_block->output_commands = pl_block_data->output_commands;
+    st_prep_block->overrides = pl_block->overrides;
+    st_prep_block->backlash_motion = false;
+    st_prep_block->dynamic_rpm = false;
+    st_prep_block->message = pl_block_data->message;
+    pl_block_data->message = NULL;
+#if ENABLE_BACKLASH_COMPENSATION
+    st_prep_block->backlash_axes.mask = 0;
+#endif
+#if SYNCED_STATE_CHANGES_ENABLE
+    st_prep_block->is_complete = false;
+    st_prep_block->end_state = pl_block_data->end_state;
+#endif
+#if LASER_PPI_STEPPER_ENABLE
+    st_prep_block->ppi_steps = prep.ppi_steps = 0;
+#endif
+#if LASER_RASTER_ENABLE
+    if(st_prep_block->raster) {
+        mem_free(st_prep_block->raster); // Release raster data from the previous use of the block.
+        st_prep_block->raster = NULL;
+    }
+#endif
+
+    // Laser is off during dwell in RPM rate adjusted mode.
+    if(state_get() != STATE_HOMING)
+        sys.step_control.update_spindle_rpm |= pl_block->condition.is_rpm_rate_adjusted;
+}
+
+// Prepares a segment without steps of up to DT_SEGMENT duration if the current planner block is a dwell block.
+// Returns false if not a dwell block.
+static bool prep_dwell (void)
+{
+    plan_block_t *block = pl_block;
+
+    if(block == NULL && (sys.step_control.execute_sys_motion || (block = plan_get_current_block()) == NULL))
+        return false;
+
+    if(!block->condition.dwell)
+        return false;
+
+    if(pl_block == NULL) {
+        pl_block = block;
+        if(prep.recalculate.velocity_profile)
+            prep.recalculate.flags = 0; // Replanning and feed holds does not affect the dwell.
+        else
+            dwell_load();
+        prep.current_speed = prep.exit_speed = 0.0f;
+    }
+
+    segment_t *prep_segment = segment_buffer_head;
+    bool complete = pl_block->millimeters <= DT_SEGMENT;
+    float dt = complete ? pl_block->millimeters : DT_SEGMENT;
+
+    prep_segment->exec_block = st_prep_block;
+    prep_segment->update_rpm = NULL;
+    prep_segment->update_pwm = NULL;
+    prep_segment->n_step = 1;
+    prep_segment->cycles_per_tick = (uint32_t)ceilf(cycles_per_min * dt);
+    prep_segment->current_rate = 0.0f;
+    prep_segment->spindle_sync = false;
+  #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    prep_segment->amass_level = 0;
+  #endif
+#if THREADING_PIPELINE_ENABLE
+    // A spindle index wait is a single segment polling the spindle position, held by the ISR until the target is reached.
+    // The number of ticks sets the timeout.
+    if((prep_segment->index_wait = pl_block->condition.index_wait)) {
+        complete = true;
+        dt = pl_block->millimeters;
+        prep_segment->n_step = INDEX_WAIT_TICK_RATE * INDEX_WAIT_TIMEOUT;
+        prep_segment->cycles_per_tick = hal.f_step_timer / INDEX_WAIT_TICK_RATE;
+        prep_segment->index_offset = pl_block->programmed_rate;
+    }
+#endif
+
+    if(sys.step_control.update_spindle_rpm && !pl_block->spindle->css) {
+
+        float rpm = 0.0f;
+
+        if(pl_block->spindle->state.on && !pl_block->condition.is_rpm_rate_adjusted)
+            rpm = spindle_set_rpm(pl_block->spindle->hal, pl_block->spindle_rpm, pl_block->spindle->hal->param->override_pct);
+
+        if(rpm != prep.current_spindle_rpm) {
+            if(pl_block->spindle->hal->get_pwm != NULL) {
+                prep.current_spindle_rpm = rpm;
+                prep_segment->update_pwm = pl_block->spindle->hal->update_pwm;
+                prep_segment->spindle_pwm = pl_block->spindle->hal->get_pwm(pl_block->spindle->hal, rpm);
+            } else {
+#if SPINDLE_COMMAND_CACHE
+                if(!spindle_rpm_update_redundant(pl_block->spindle->hal, rpm))
+#endif
+                prep_segment->update_rpm = pl_block->spindle->hal->update_rpm;
+                prep.current_spindle_rpm = prep_segment->spindle_rpm = rpm;
+            }
+        }
+        sys.step_control.update_spindle_rpm = Off;
+    }
+
+    pl_block->millimeters -= dt;
+#if SYNCED_STATE_CHANGES_ENABLE
+    st_prep_block->is_complete = complete;
+#endif
+
+    segment_buffer_head = segment_next_head;
+    segment_next_head = segment_next_head->next;
+
+    if(complete) {
+        pl_block = NULL;
+        plan_discard_current_block();
+    }
+
+    return true;
+}
+
+#endif
+
+#if STEP_FIDELITY_MONITOR
+
+// Returns the deviation in ppm of the executed step period from the ideal period at the given profile speed,
+// 0 if the speed is 0.
+static inline float period_error (float cycles, float speed)
+{
+    float ideal_cycles = speed > 0.0f ? cycles_per_min / (speed * prep.steps_per_mm) : 0.0f;
+
+    return ideal_cycles > 0.0f ? fabsf(cycles - ideal_cycles) / ideal_cycles * 1000000.0f : 0.0f;
+}
+
+// Accounts for the deviation of the step period executed by the stepper ISR (after timer rounding and AMASS
+// scaling) from the ideal periods at the velocity profile speeds at segment start and end, for AMASS level
+// transitions and for the rate change at the segment boundary.
+static void fidelity_update (segment_t *segment, float start_speed, float end_speed)
+{
+    float cycles = (float)(segment->cycles_per_tick << segment->amass_level), rate_step,
+          error = max(period_error(cycles, start_speed), period_error(cycles, end_speed));
+
+    fidelity_stats.period_error_sum += error;
+    if(error > fidelity_stats.period_error_max)
+        fidelity_stats.period_error_max = error;
+
+    if((rate_step = fabsf(segment->current_rate - fidelity_stats.last_rate)) > fidelity_stats.rate_step_max)
+        fidelity_stats.rate_step_max = rate_step;
+
+    if(segment->amass_level != fidelity_stats.last_amass_level && fidelity_stats.segments)
+        fidelity_stats.amass_transitions++;
+
+    fidelity_stats.amass_segments[min(segment->amass_level, 3)]++;
+    fidelity_stats.last_amass_level = segment->amass_level;
+    fidelity_stats.last_rate = segment->current_rate;
+    fidelity_stats.segments++;
+}
+
+#endif
+
 /* Prepares step segment buffer. Continuously called from main program.
 
    The segment buffer is an intermediary buffer interface between the execution of steps
@@ -648,17 +1688,77 @@ void st_parking_restore_buffer (void)
    Currently, the segment buffer conservatively holds roughly up to 40-50 msec of steps.
    NOTE: Computation units are in steps, millimeters, and minutes.
 */
+static void prep_buffer (void);
+
 void st_prep_buffer (void)
+{
+#if PROFILING_ENABLE
+    uint32_t t = profile_start();
+#endif
+
+    if(hal.stepper.prep_lock) {
+        hal.stepper.prep_lock(true);
+        prep_buffer();
+        hal.stepper.prep_lock(false);
+    } else
+        prep_buffer();
+
+#if PROFILING_ENABLE
+    profile_end(Profile_StPrepBuffer, t);
+#endif
+}
+
+/*! \brief Reloads the step segment buffer if motion is active.
+To be called continuously by drivers executing the step segment generator on a separate core,
+the driver must then provide the \a hal.stepper.prep_lock handler.
+*/
+void st_prep_core_poll (void)
+{
+    if (state_get() & (STATE_CYCLE | STATE_HOLD | STATE_SAFETY_DOOR | STATE_HOMING | STATE_SLEEP | STATE_JOG))
+        st_prep_buffer();
+}
+
+//! Claims or releases the lock shared by the planner and the step segment generator when executed on separate cores.
+void st_prep_lock (bool lock)
+{
+    if(hal.stepper.prep_lock)
+        hal.stepper.prep_lock(lock);
+}
+
+static void prep_buffer (void)
 {
     // Block step prep buffer, while in a suspend state and there is no suspend motion to execute.
     if (sys.step_control.end_motion)
         return;
 
+#if SEGMENT_BUFFER_MONITOR
+    if(st.exec_block && (pl_block || plan_get_current_block())) {
+        uint_fast8_t fill = st_get_segment_buffer_fill();
+        if(fill < buffer_stats.min_fill)
+            buffer_stats.min_fill = fill;
+    }
+#endif
+
     while (segment_buffer_tail != segment_next_head) { // Check if we need to fill the buffer.
 
+#if PLANNER_DWELL_ENABLE
+        if(prep_dwell())
+            continue;
+#endif
+
+#if ADAPTIVE_FEED_ENABLE
+        // Recompute velocity profile of the current block from the current speed if the adaptive feed scale has changed.
+        if(pl_block && prep.adaptive_scale != adaptive_scale && sys.override.control.adaptive_feed &&
+            !(sys.step_control.execute_hold || sys.step_control.execute_sys_motion || prep.recalculate.parking))
+            st_update_plan_block_parameters();
+#endif
+
         // Determine if we need to load a new planner block or if the block needs to be recomputed.
         if (pl_block == NULL) {
 
+#if JOB_STATS_ENABLE
+            bool new_block = false, limited = false;
+#endif
             // Query planner for a queued block
 
             pl_block = sys.step_control.execute_sys_motion ? plan_get_system_motion_block() : plan_get_current_block();
@@ -666,8 +1766,15 @@ void st_prep_buffer (void)
             if (pl_block == NULL)
                 return; // No planner blocks. Exit.
 
+#if ENABLE_INPUT_SHAPING
+            prep.shaper = shaper_get(pl_block);
+#endif
+
             // Check if we need to only recompute the velocity profile or load a new block.
             if (prep.recalculate.velocity_profile) {
+#if ENABLE_JERK_ACCELERATION
+                prep.ramp.carry = ramp_accel(); // Continue from the current acceleration.
+#endif
                 if(settings.parking.flags.enabled) {
                     if (prep.recalculate.parking)
                         prep.recalculate.velocity_profile = Off;
@@ -682,6 +1789,20 @@ void st_prep_buffer (void)
                 // segment buffer finishes the prepped block, but the stepper ISR is still executing it.
 
                 st_prep_block = st_prep_block->next;
+#if JOB_STATS_ENABLE
+                new_block = true;
+#endif
+#if ENABLE_JERK_ACCELERATION
+                prep.ramp.carry = 0.0f;
+#endif
+
+                plan_block_data_t *pl_block_data = plan_get_block_data(pl_block);
+
+#if ENABLE_BACKLASH_COMPENSATION
+                uint32_t step_event_count = backlash_fold(st_prep_block, pl_block);
+#else
+                uint32_t step_event_count = pl_block->step_event_count;
+#endif
 
                 uint_fast8_t idx = N_AXIS;
               #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
@@ -689,7 +1810,7 @@ void st_prep_buffer (void)
                     idx--;
                     st_prep_block->steps[idx] = (pl_block->steps[idx] << 1);
                 } while(idx);
-                st_prep_block->step_event_count = (pl_block->step_event_count << 1);
+                st_prep_block->step_event_count = (step_event_count << 1);
               #else
                 // With AMASS enabled, simply bit-shift multiply all Bresenham data by the max AMASS
                 // level, such that we never divide beyond the original data anywhere in the algorithm.
@@ -698,24 +1819,48 @@ void st_prep_buffer (void)
                     idx--;
                     st_prep_block->steps[idx] = pl_block->steps[idx] << MAX_AMASS_LEVEL;
                 } while(idx);
-                st_prep_block->step_event_count = pl_block->step_event_count << MAX_AMASS_LEVEL;
+                st_prep_block->step_event_count = step_event_count << MAX_AMASS_LEVEL;
               #endif
 
                 st_prep_block->direction_bits = pl_block->direction_bits;
                 st_prep_block->programmed_rate = pl_block->programmed_rate;
 //                st_prep_block->r = pl_block->programmed_rate;
                 st_prep_block->millimeters = pl_block->millimeters;
-                st_prep_block->steps_per_mm = (float)pl_block->step_event_count / pl_block->millimeters;
-                st_prep_block->spindle = pl_block->spindle.hal;
-                st_prep_block->output_commands = pl_block->output_commands;
+                st_prep_block->steps_per_mm = (float)step_event_count / pl_block->millimeters;
+                st_prep_block->spindle = pl_block->spindle->hal;
+                st_prep_block->output_commands = pl_block_data->output_commands;
                 st_prep_block->overrides = pl_block->overrides;
                 st_prep_block->backlash_motion = pl_block->condition.backlash_motion;
-                st_prep_block->message = pl_block->message;
-                pl_block->message= NULL;
+                st_prep_block->message = pl_block_data->message;
+                pl_block_data->message= NULL;
+#if SYNCED_STATE_CHANGES_ENABLE
+                st_prep_block->is_complete = false;
+                st_prep_block->end_state = pl_block_data->end_state;
+#endif
+#if LASER_PPI_STEPPER_ENABLE
+                if(pl_block->condition.is_laser_ppi_mode && laser_ppi.ppi && pl_block->spindle->hal->pulse_on) {
+                    uint32_t prev_steps = prep.ppi_steps;
+                    // Pulse distance in step events as counted by the ISR, shifted by AMASS (or doubled) as the Bresenham data.
+                    st_prep_block->ppi_steps = prep.ppi_steps = max((uint32_t)((float)st_prep_block->step_event_count / pl_block->millimeters * 25.4f / (float)laser_ppi.ppi), 1);
+                    // Scale factor (16.16 fixed point) for converting remaining steps to next pulse from previous block.
+                    st_prep_block->ppi_scale = prev_steps ? (uint32_t)((float)prep.ppi_steps / (float)prev_steps * 65536.0f) : 0;
+                } else
+                    st_prep_block->ppi_steps = prep.ppi_steps = 0;
+#endif
+#if LASER_RASTER_ENABLE
+                if(st_prep_block->raster)
+                    mem_free(st_prep_block->raster); // Release raster data from the previous use of the block.
+                if((st_prep_block->raster = pl_block_data->raster)) {
+                    pl_block_data->raster = NULL;
+                    raster_prepare(st_prep_block->raster, pl_block, st_prep_block->step_event_count);
+                    // Power is set by the stepper ISR, force a spindle update on the first segment after the raster.
+                    sys.step_control.update_spindle_rpm = On;
+                }
+#endif
 
                 // Initialize segment buffer data for generating the segments.
                 prep.steps_per_mm = st_prep_block->steps_per_mm;
-                prep.steps_remaining = pl_block->step_event_count;
+                prep.steps_remaining = step_event_count;
                 prep.req_mm_increment = REQ_MM_INCREMENT_SCALAR / prep.steps_per_mm;
                 prep.dt_remainder = prep.target_position = 0.0f; // Reset for new segment block
 #ifdef KINEMATICS_API
@@ -735,7 +1880,7 @@ void st_prep_buffer (void)
                     // Pre-compute inverse programmed rate to speed up RPM updating per step segment.
                     prep.inv_feedrate = pl_block->condition.is_laser_ppi_mode ? 1.0f : 1.0f / pl_block->programmed_rate;
                 } else
-                    st_prep_block->dynamic_rpm = !!pl_block->spindle.css;
+                    st_prep_block->dynamic_rpm = !!pl_block->spindle->css;
             }
 
             /* ---------------------------------------------------------------------------------
@@ -745,6 +1890,9 @@ void st_prep_buffer (void)
              hold, override the planner velocities and decelerate to the target exit speed.
             */
             prep.mm_complete = 0.0f; // Default velocity profile complete at 0.0mm from end of block.
+#if SHAPED_RAMPS
+            prep.ramp.type = Ramp_Cruise; // Restart shaped ramp from current speed.
+#endif
             float inv_2_accel = 0.5f / pl_block->acceleration;
 
             if (sys.step_control.execute_hold) { // [Forced Deceleration to Zero Velocity]
@@ -752,7 +1900,11 @@ void st_prep_buffer (void)
                 // the planner block profile, enforcing a deceleration to zero speed.
                 prep.ramp_type = Ramp_Decel;
                 // Compute decelerate distance relative to end of block.
+#if ENABLE_JERK_ACCELERATION
+                float decel_dist = pl_block->millimeters - jerk_ramp_distance(prep.current_speed, 0.0f, prep.ramp.carry, pl_block->acceleration, pl_block->jerk);
+#else
                 float decel_dist = pl_block->millimeters - inv_2_accel * pl_block->entry_speed_sqr;
+#endif
                 if (decel_dist < 0.0f) {
                     // Deceleration through entire planner block. End of feed hold is not in this block.
                     prep.exit_speed = sqrtf(pl_block->entry_speed_sqr - 2.0f * pl_block->acceleration * pl_block->millimeters);
@@ -774,6 +1926,20 @@ void st_prep_buffer (void)
                 }
 
                 float nominal_speed = plan_compute_profile_nominal_speed(pl_block);
+#if ADAPTIVE_FEED_ENABLE
+                prep.adaptive_scale = adaptive_scale;
+                if(sys.override.control.adaptive_feed && prep.adaptive_scale < 1.0f && !(pl_block->condition.rapid_motion ||
+                     pl_block->condition.system_motion || pl_block->spindle->state.synchronized)) {
+                    // Scale cruise speed without replanning. If the planned exit speed is above the scaled speed it is
+                    // lowered, the next block is then loaded as a deceleration override starting from that speed.
+                    nominal_speed = max(nominal_speed * prep.adaptive_scale, MINIMUM_FEED_RATE);
+                    if(exit_speed_sqr > nominal_speed * nominal_speed) {
+                        prep.exit_speed = nominal_speed;
+                        exit_speed_sqr = nominal_speed * nominal_speed;
+                        prep.recalculate.decel_override = On;
+                    }
+                }
+#endif
                 float nominal_speed_sqr = nominal_speed * nominal_speed;
                 float intersect_distance = 0.5f * (pl_block->millimeters + inv_2_accel * (pl_block->entry_speed_sqr - exit_speed_sqr));
 
@@ -818,21 +1984,48 @@ void st_prep_buffer (void)
                         } else { // Triangle type
                             prep.accelerate_until = prep.decelerate_after = intersect_distance;
                             prep.maximum_speed = sqrtf(2.0f * pl_block->acceleration * intersect_distance + exit_speed_sqr);
+#if JOB_STATS_ENABLE
+                            limited = true;
+#endif
                         }
                     } else { // Deceleration-only type
                         prep.ramp_type = Ramp_Decel;
                         // prep.decelerate_after = pl_block->millimeters;
                         // prep.maximum_speed = prep.current_speed;
+#if JOB_STATS_ENABLE
+                        limited = pl_block->entry_speed_sqr < nominal_speed_sqr;
+#endif
                     }
                 } else { // Acceleration-only type
                     prep.accelerate_until = 0.0f;
                     // prep.decelerate_after = 0.0f;
                     prep.maximum_speed = prep.exit_speed;
+#if JOB_STATS_ENABLE
+                    limited = prep.exit_speed < nominal_speed;
+#endif
                 }
+#if ENABLE_JERK_ACCELERATION
+  #if ENABLE_INPUT_SHAPING
+                if(prep.shaper->n <= 1) // Shaped ramps keep the planned ramp distances.
+                    jerk_fit_profile();
+  #else
+                jerk_fit_profile();
+  #endif
+#endif
             }
 
+#if ENABLE_JERK_ACCELERATION
+            if(prep.ramp_type != Ramp_Accel && prep.ramp_type != Ramp_Decel)
+                prep.ramp.carry = 0.0f; // Not continued by a shaped ramp.
+#endif
+
+#if JOB_STATS_ENABLE
+            if(new_block)
+                job_stats_block(pl_block, limited);
+#endif
+
             if(state_get() != STATE_HOMING)
-                sys.step_control.update_spindle_rpm |= pl_block->spindle.hal->cap.laser; // Force update whenever updating block in laser mode.
+                sys.step_control.update_spindle_rpm |= pl_block->spindle->hal->cap.laser; // Force update whenever updating block in laser mode.
 
             probe_asserted = false;
         }
@@ -848,6 +2041,9 @@ void st_prep_buffer (void)
         prep_segment->exec_block = st_prep_block;
         prep_segment->update_rpm = NULL;
         prep_segment->update_pwm = NULL;
+#if STEP_FIDELITY_MONITOR
+        float start_speed = prep.current_speed;
+#endif
 
         /*------------------------------------------------------------------------------------
             Compute the average velocity of this new segment by determining the total distance
@@ -893,6 +2089,19 @@ void st_prep_buffer (void)
                     break;
 
                 case Ramp_Accel:
+#if SHAPED_RAMPS
+                    if(prep.ramp.type != Ramp_Accel)
+                        ramp_init(Ramp_Accel, mm_remaining, prep.accelerate_until, prep.current_speed, prep.maximum_speed);
+                    if(ramp_advance(&time_var, &mm_var, &speed_var) && mm_var > prep.accelerate_until) {
+                        mm_remaining = mm_var;
+                        prep.current_speed = speed_var;
+                    } else { // End of acceleration ramp.
+                        mm_remaining = prep.accelerate_until;
+                        prep.ramp_type = mm_remaining == prep.decelerate_after ? Ramp_Decel : Ramp_Cruise;
+                        prep.current_speed = prep.maximum_speed;
+                    }
+                    break;
+#endif
                     // NOTE: Acceleration ramp only computes during first do-while loop.
                     speed_var = pl_block->acceleration * time_var;
                     mm_remaining -= time_var * (prep.current_speed + 0.5f * speed_var);
@@ -921,6 +2130,18 @@ void st_prep_buffer (void)
                     break;
 
                 default: // case Ramp_Decel:
+#if SHAPED_RAMPS
+                    if(prep.ramp.type != Ramp_Decel)
+                        ramp_init(Ramp_Decel, mm_remaining, prep.mm_complete, prep.current_speed, prep.exit_speed);
+                    if(ramp_advance(&time_var, &mm_var, &speed_var) && mm_var > prep.mm_complete) {
+                        mm_remaining = mm_var;
+                        prep.current_speed = speed_var;
+                    } else { // End of block or end of forced-deceleration.
+                        mm_remaining = prep.mm_complete;
+                        prep.current_speed = prep.exit_speed;
+                    }
+                    break;
+#endif
                     // NOTE: mm_var used as a misc worker variable to prevent errors when near zero speed.
                     speed_var = pl_block->acceleration * time_var; // Used as delta speed (mm/min)
                     if (prep.current_speed > speed_var) { // Check if at or below zero speed.
@@ -962,31 +2183,39 @@ void st_prep_buffer (void)
 
             float rpm;
 
-            if (pl_block->spindle.state.on) {
-                if(pl_block->spindle.css) {
-                    float npos = (float)(pl_block->step_event_count - prep.steps_remaining) / (float)pl_block->step_event_count;
-                    rpm = spindle_set_rpm(pl_block->spindle.hal,
-                                           pl_block->spindle.rpm + pl_block->spindle.css->delta_rpm * npos,
-                                            pl_block->spindle.hal->param->override_pct);
+            if (pl_block->spindle->state.on) {
+                if(pl_block->spindle->css) {
+                    float npos = 1.0f - (float)prep.steps_remaining / (st_prep_block->steps_per_mm * st_prep_block->millimeters);
+                    rpm = spindle_set_rpm(pl_block->spindle->hal,
+                                           pl_block->spindle_rpm + pl_block->spindle->css->delta_rpm * npos,
+                                            pl_block->spindle->hal->param->override_pct);
                 } else {
                     // NOTE: Feed and rapid overrides are independent of PWM value and do not alter laser power/rate.
                     // If current_speed is zero, then may need to be rpm_min*(100/MAX_SPINDLE_RPM_OVERRIDE)
                     // but this would be instantaneous only and during a motion. May not matter at all.
-                    rpm = spindle_set_rpm(pl_block->spindle.hal,
+                    rpm = spindle_set_rpm(pl_block->spindle->hal,
                                            pl_block->condition.is_rpm_rate_adjusted && !pl_block->condition.is_laser_ppi_mode
-                                            ? pl_block->spindle.rpm * prep.current_speed * prep.inv_feedrate
-                                            : pl_block->spindle.rpm, pl_block->spindle.hal->param->override_pct);
+                                            ? pl_block->spindle_rpm * prep.current_speed * prep.inv_feedrate
+                                            : pl_block->spindle_rpm, pl_block->spindle->hal->param->override_pct);
                 }
             } else
-                pl_block->spindle.hal->param->rpm = rpm = 0.0f;
+                pl_block->spindle->hal->param->rpm = rpm = 0.0f;
 
+#if LASER_RASTER_ENABLE
+            if(st_prep_block->raster)
+                prep.current_spindle_rpm = -1.0f; // Power is set by the stepper ISR.
+            else
+#endif
             if(rpm != prep.current_spindle_rpm) {
-                if(pl_block->spindle.hal->get_pwm != NULL) {
+                if(pl_block->spindle->hal->get_pwm != NULL) {
                     prep.current_spindle_rpm = rpm;
-                    prep_segment->update_pwm = pl_block->spindle.hal->update_pwm;
-                    prep_segment->spindle_pwm = pl_block->spindle.hal->get_pwm(pl_block->spindle.hal, rpm);
+                    prep_segment->update_pwm = pl_block->spindle->hal->update_pwm;
+                    prep_segment->spindle_pwm = pl_block->spindle->hal->get_pwm(pl_block->spindle->hal, rpm);
                 } else {
-                    prep_segment->update_rpm = pl_block->spindle.hal->update_rpm;
+#if SPINDLE_COMMAND_CACHE
+                    if(!spindle_rpm_update_redundant(pl_block->spindle->hal, rpm))
+#endif
+                    prep_segment->update_rpm = pl_block->spindle->hal->update_rpm;
                     prep.current_spindle_rpm = prep_segment->spindle_rpm = rpm;
                 }
                 sys.step_control.update_spindle_rpm = Off;
@@ -1032,8 +2261,12 @@ void st_prep_buffer (void)
         // Compute timer ticks per step for the prepped segment.
         uint32_t cycles = (uint32_t)ceilf(cycles_per_min * inv_rate); // (cycles/step)
 
+#if THREADING_PIPELINE_ENABLE
+        prep_segment->index_wait = false;
+#endif
+
         // Record end position of segment relative to block if spindle synchronized motion
-        if((prep_segment->spindle_sync = pl_block->spindle.state.synchronized)) {
+        if((prep_segment->spindle_sync = pl_block->spindle->state.synchronized)) {
             prep.target_position += dt * prep.target_feed;
             prep_segment->cruising = prep.ramp_type == Ramp_Cruise;
             prep_segment->target_position = prep.target_position; //st_prep_block->millimeters - pl_block->millimeters;
@@ -1054,6 +2287,15 @@ void st_prep_buffer (void)
         prep_segment->cycles_per_tick = cycles;
         prep_segment->current_rate = prep.current_speed;
 
+#if STEP_FIDELITY_MONITOR
+        fidelity_update(prep_segment, start_speed, prep.current_speed);
+#endif
+
+#if SYNCED_STATE_CHANGES_ENABLE
+        // Flag last segment of block prepared before the segment is made available to the stepper ISR.
+        st_prep_block->is_complete = mm_remaining <= 0.0f && mm_remaining <= prep.mm_complete && !sys.step_control.execute_sys_motion;
+#endif
+
         // Segment complete! Increment segment pointers, so stepper ISR can immediately execute it.
         segment_buffer_head = segment_next_head;
         segment_next_head = segment_next_head->next;
@@ -1089,6 +2331,45 @@ void st_prep_buffer (void)
 }
 
 
+// Returns the number of segments in the step segment buffer.
+uint_fast8_t st_get_segment_buffer_fill (void)
+{
+    int_fast16_t fill = (int_fast16_t)(segment_buffer_head - (segment_t *)segment_buffer_tail);
+
+    return (uint_fast8_t)(fill < 0 ? fill + SEGMENT_BUFFER_SIZE : fill);
+}
+
+#if STEP_FIDELITY_MONITOR
+
+//! Returns pointer to the step timing fidelity statistics.
+st_fidelity_stats_t *st_get_fidelity_stats (void)
+{
+    return &fidelity_stats;
+}
+
+//! Clears the step timing fidelity statistics.
+void st_reset_fidelity_stats (void)
+{
+    float last_rate = fidelity_stats.last_rate;
+    uint_fast8_t last_amass_level = fidelity_stats.last_amass_level;
+
+    memset(&fidelity_stats, 0, sizeof(st_fidelity_stats_t));
+    fidelity_stats.last_rate = last_rate;
+    fidelity_stats.last_amass_level = last_amass_level;
+}
+
+#endif
+
+#if SEGMENT_BUFFER_MONITOR
+
+// Returns pointer to the step segment buffer statistics.
+st_buffer_stats_t *st_get_buffer_stats (void)
+{
+    return &buffer_stats;
+}
+
+#endif
+
 // Called by realtime status reporting to fetch the current speed being executed. This value
 // however is not exactly the current speed, but the speed computed in the last step segment
 // in the segment buffer. It will always be behind by up to the number of segment blocks (-1)
@@ -1103,3 +2384,33 @@ float st_get_realtime_rate (void)
 #endif
             : 0.0f;
 }
+
+#if REPORT_AXIS_VELOCITY
+
+// Splits the realtime path rate into axis velocities from the step counts and direction of the executing block.
+// Velocities are signed, for non cartesian kinematics they are motor velocities.
+void st_get_realtime_axis_rates (float *rates)
+{
+    uint_fast8_t idx = N_AXIS;
+    float rate = st_get_realtime_rate();
+    segment_t *segment = st.exec_segment;
+    st_block_t *block = segment ? segment->exec_block : NULL;
+
+    if(rate == 0.0f || block == NULL || block->step_event_count == 0) {
+        do {
+            rates[--idx] = 0.0f;
+        } while(idx);
+        return;
+    }
+
+    rate *= block->steps_per_mm / (float)block->step_event_count;
+
+    do {
+        idx--;
+        rates[idx] = rate * (float)block->steps[idx] / settings.axis[idx].steps_per_mm;
+        if(block->direction_bits.mask & bit(idx))
+            rates[idx] = -rates[idx];
+    } while(idx);
+}
+
+#endif
@@ -49,9 +49,22 @@ typedef struct st_block {
     float programmed_rate;
     char *message;                     //!< Message to be displayed when block is executed
     output_command_t *output_commands; //!< Output commands (linked list) to be performed when block is executed
+    raster_data_t *raster;             //!< Laser raster data to be output when block is executed, owned by the stepper module
+    uint32_t ppi_steps;                //!< Step events between laser pulses in PPI mode, 0 if not in PPI mode
+    uint32_t ppi_scale;                //!< Scale factor (16.16 fixed point) for carrying over the distance to the next pulse from the previous block
     bool backlash_motion;
+#if ENABLE_BACKLASH_COMPENSATION
+    axes_signals_t backlash_axes;             //!< Axes with backlash take-up steps remaining
+    uint32_t backlash_steps[N_AXIS];          //!< Backlash take-up steps remaining, output by the stepper ISR
+    uint32_t backlash_rate[N_AXIS];           //!< Backlash take-up Bresenham increment
+    uint32_t backlash_events[N_AXIS];         //!< Step events the take-up steps are spread over
+#endif
     bool dynamic_rpm;                  //!< Tracks motions that require dynamic RPM adjustment
     spindle_ptrs_t *spindle;           //!< Pointer to current spindle for motions that require dynamic RPM adjustment
+#if SYNCED_STATE_CHANGES_ENABLE
+    bool is_complete;                  //!< Set when all segments of the block has been prepared
+    plan_state_change_t end_state;     //!< Coolant and spindle changes to be performed when the block is completed
+#endif
 } st_block_t;
 
 typedef struct st_segment {
@@ -67,31 +80,17 @@ typedef struct st_segment {
     bool spindle_sync;                  //!< True if block is spindle synchronized
     bool cruising;                      //!< True when in cruising part of profile, only set for spindle synced moves
     uint_fast8_t amass_level;           //!< Indicates AMASS level for the ISR to execute this segment
+#if THREADING_PIPELINE_ENABLE
+    bool index_wait;                    //!< True if the ISR should hold the segment until the spindle index offset is reached
+    float index_offset;                 //!< Spindle angle after the index in revolutions to wait for
+#endif
     spindle_update_pwm_ptr update_pwm;  //!< Valid pointer to spindle.update_pwm() if set spindle speed at the start of the segment execution
     spindle_update_rpm_ptr update_rpm;  //!< Valid pointer to spindle.update_rpm() if set spindle speed at the start of the segment execution
 } segment_t;
 
 //! Stepper ISR data struct. Contains the running data for the main stepper ISR.
 typedef struct stepper {
-    uint32_t counter_x,             //!< Counter variable for the Bresenham line tracer, X-axis
-             counter_y,             //!< Counter variable for the Bresenham line tracer, Y-axis
-             counter_z              //!< Counter variable for the Bresenham line tracer, Z-axis
-    #ifdef A_AXIS
-           , counter_a              //!< Counter variable for the Bresenham line tracer, A-axis
-    #endif
-    #ifdef B_AXIS
-           , counter_b              //!< Counter variable for the Bresenham line tracer, B-axis
-    #endif
-    #ifdef C_AXIS
-           , counter_c              //!< Counter variable for the Bresenham line tracer, C-axis
-    #endif
-    #ifdef U_AXIS
-           , counter_u              //!< Counter variable for the Bresenham line tracer, U-axis
-    #endif
-    #ifdef V_AXIS
-           , counter_v              //!< Counter variable for the Bresenham line tracer, V-axis
-    #endif
-;
+    uint32_t counter[N_AXIS];       //!< Counter variables for the Bresenham line tracer.
     bool new_block;                 //!< Set to true when a new block is started, might be referenced by driver code for advanced functionality.
     bool dir_change;                //!< Set to true on direction changes, might be referenced by driver for advanced functionality.
     axes_signals_t step_outbits;    //!< The stepping signals to be output.
@@ -105,6 +104,26 @@ typedef struct stepper {
     segment_t *exec_segment;        //!< Pointer to the segment being executed.
 } stepper_t;
 
+//! Step segment buffer statistics, only maintained when \ref SEGMENT_BUFFER_MONITOR is enabled.
+typedef struct {
+    uint_fast8_t min_fill;          //!< Minimum number of segments in buffer found by the foreground process while running.
+    uint32_t underruns;             //!< Number of times the buffer was drained while motion was pending.
+    uint32_t last_underrun;         //!< Timestamp (ms) of last underrun, 0 if none.
+    bool restart;                   //!< Set to true to restart statistics on next cycle start.
+} st_buffer_stats_t;
+
+//! Step timing fidelity statistics, only maintained when \ref STEP_FIDELITY_MONITOR is enabled.
+typedef struct {
+    uint32_t segments;              //!< Number of segments prepared.
+    uint32_t amass_segments[4];     //!< Number of segments prepared per AMASS level.
+    uint32_t amass_transitions;     //!< Number of AMASS level changes between consecutive segments.
+    float period_error_max;         //!< Maximum deviation of the step period from the ideal period at segment start or end in ppm.
+    float period_error_sum;         //!< Sum of step period deviations in ppm, for calculating the mean.
+    float rate_step_max;            //!< Maximum rate change between consecutive segments in mm/min.
+    float last_rate;                //!< Rate of the last segment prepared.
+    uint_fast8_t last_amass_level;  //!< AMASS level of the last segment prepared.
+} st_fidelity_stats_t;
+
 // Initialize and setup the stepper motor subsystem
 void stepper_init (void);
 
@@ -129,12 +148,53 @@ void st_parking_restore_buffer (void);
 // Reloads step segment buffer. Called continuously by realtime execution system.
 void st_prep_buffer (void);
 
+// Reloads step segment buffer if motion is active. Called continuously by drivers executing the step segment generator on a separate core.
+void st_prep_core_poll (void);
+
+// Claims or releases the lock shared by the planner and the step segment generator when executed on separate cores.
+void st_prep_lock (bool lock);
+
 // Called by planner_recalculate() when the executing block is updated by the new plan.
 void st_update_plan_block_parameters (void);
 
 // Called by realtime status reporting if realtime rate reporting is enabled in config.h.
 float st_get_realtime_rate (void);
 
+#if REPORT_AXIS_VELOCITY
+// Called by realtime status reporting to get the velocity of each axis (or motor for non cartesian kinematics).
+void st_get_realtime_axis_rates (float *rates);
+#endif
+
 void stepper_driver_interrupt_handler (void);
 
+// Returns the number of segments in the step segment buffer.
+uint_fast8_t st_get_segment_buffer_fill (void);
+
+#if ADAPTIVE_FEED_ENABLE
+// Sets adaptive feed scale (0.0 - 1.0), may be called from interrupt context.
+void st_set_adaptive_feed (float scale);
+float st_get_adaptive_feed (void);
+#endif
+
+#if LASER_PPI_STEPPER_ENABLE
+// Sets laser PPI (Pulses Per Inch) parameters for the step generator driven pulse output.
+bool st_laser_ppi_enable (uint_fast16_t ppi, uint_fast16_t pulse_length);
+#endif
+
+#if ENABLE_BACKLASH_COMPENSATION
+// Sets the axes where backlash is taken up by the step segment generator and their current backlash direction.
+void st_backlash_init (axes_signals_t axes, axes_signals_t dir_negative);
+#endif
+
+#if SEGMENT_BUFFER_MONITOR
+// Returns pointer to the step segment buffer statistics.
+st_buffer_stats_t *st_get_buffer_stats (void);
+#endif
+
+#if STEP_FIDELITY_MONITOR
+// Returns pointer to the step timing fidelity statistics.
+st_fidelity_stats_t *st_get_fidelity_stats (void);
+void st_reset_fidelity_stats (void);
+#endif
+
 #endif
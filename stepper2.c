@@ -28,6 +28,7 @@
 #include <stdlib.h>
 
 #include "stepper2.h"
+#include "mem_stats.h"
 
 typedef enum {
     State_Idle = 0,     //!< 0
@@ -65,6 +66,10 @@ struct st2_motor {
     float acceleration;         // acceleration steps/s^2
     axes_signals_t dir;         // current direction
     uint64_t next_step;
+    const st2_timer_t *timer;   // hardware timer for interrupt driven step generation, NULL if polled
+    st2_motor_t *master;        // motor generating the shared ramp for a grouped move, NULL if not a follower
+    st2_motor_t *group_next;    // next follower motor in a grouped move
+    uint32_t count;             // Bresenham counter for follower motors
     st2_motor_t *next;
 };
 
@@ -85,6 +90,22 @@ static void st_motor_config (st2_motor_t *motor)
     motor->first_delay = (uint32_t)(0.676f * sqrtf(2.0f / motor->acceleration) * 1000000.0f);
 }
 
+// Release follower motors from a grouped move and restore the master motor acceleration.
+static void group_release (st2_motor_t *master)
+{
+    st2_motor_t *follower = master->group_next;
+
+    while(follower) {
+        st2_motor_t *next = follower->group_next;
+        follower->state = State_Idle;
+        follower->master = follower->group_next = NULL;
+        follower = next;
+    }
+
+    master->group_next = NULL;
+    st_motor_config(master);
+}
+
 /*! \brief Stop all motors.
  *
 This will be called on a soft reset and stops all running motors abruptly.
@@ -98,6 +119,11 @@ static void st2_reset (void)
     while(motor) {
         motor->position_lost = motor->state != State_Idle;
         motor->state = State_Idle;
+        if(motor->group_next)
+            st_motor_config(motor); // Restore acceleration of the master motor of a grouped move.
+        motor->master = motor->group_next = NULL;
+        if(motor->timer)
+            motor->timer->stop(motor->timer->timer);
         motor = motor->next;
     }
 }
@@ -212,7 +238,7 @@ st2_motor_t *st2_motor_init (uint_fast8_t axis_idx, bool is_spindle)
 {
     st2_motor_t *motor, *new = motors;
 
-    if((motor = calloc(sizeof(st2_motor_t), 1))) {
+    if((motor = mem_calloc(MemTag_Other, 1, sizeof(st2_motor_t)))) {
 
         motor->idx = axis_idx;
         motor->axis.mask = 1 << axis_idx;
@@ -250,15 +276,7 @@ st2_motor_t *st2_motor_init (uint_fast8_t axis_idx, bool is_spindle)
     return motor;
 }
 
-/*! \brief Set speed.
-
-Change speed of a running motor. Typically used for motors bound as a spindle.
-Motor will be accelerated or decelerated to the new speed.
-\param motor pointer to a \a st2_motor structure.
-\param speed new speed.
-\returns new speed in steps/s.
-*/
-float st2_motor_set_speed (st2_motor_t *motor, float speed)
+static float motor_set_speed (st2_motor_t *motor, float speed)
 {
     motor->speed = speed > settings.axis[motor->idx].max_rate ? settings.axis[motor->idx].max_rate : speed;
     motor->speed *= settings.axis[motor->idx].steps_per_mm / 60.0f;
@@ -316,12 +334,108 @@ float st2_motor_set_speed (st2_motor_t *motor, float speed)
     return motor->prev_speed;
 }
 
+/*! \brief Set speed.
+
+Change speed of a running motor. Typically used for motors bound as a spindle.
+Motor will be accelerated or decelerated to the new speed.
+\param motor pointer to a \a st2_motor structure.
+\param speed new speed.
+\returns new speed in steps/s.
+*/
+float st2_motor_set_speed (st2_motor_t *motor, float speed)
+{
+    if(motor->timer) {
+        hal.irq_disable();
+        speed = motor_set_speed(motor, speed);
+        hal.irq_enable();
+    } else
+        speed = motor_set_speed(motor, speed);
+
+    return speed;
+}
+
+static void motor_step (st2_motor_t *motor);
+
+/*! \brief Timer interrupt handler, outputs steps for all due motors bound to the timer.
+
+The timer is rearmed to timeout when the next step for any of the motors is due.
+\param context pointer to the \a st2_timer_t structure for the timer.
+*/
+static void timer_irq_handler (void *context)
+{
+    const st2_timer_t *timer = (const st2_timer_t *)context;
+    st2_motor_t *motor = motors;
+    uint32_t elapsed, delay = UINT32_MAX;
+    uint64_t t = hal.get_micros();
+
+    while(motor) {
+        if(motor->timer == timer && motor->master == NULL && motor->state != State_Idle) {
+            if(t - motor->next_step >= motor->delay) {
+                motor->next_step += motor->delay; // Step is scheduled relative to the previous to avoid accumulating interrupt latency.
+                motor_step(motor);
+            }
+            if(motor->state != State_Idle) {
+                elapsed = (uint32_t)(t - motor->next_step);
+                delay = min(delay, elapsed >= motor->delay ? 1 : motor->delay - elapsed);
+            }
+        }
+        motor = motor->next;
+    }
+
+    if(delay == UINT32_MAX)
+        timer->stop(timer->timer);
+    else
+        timer->start(timer->timer, delay);
+}
+
+// Evaluates all motors bound to timer and rearms it, called from the foreground process.
+static void timer_schedule (const st2_timer_t *timer)
+{
+    hal.irq_disable();
+    timer_irq_handler((void *)timer);
+    hal.irq_enable();
+}
+
+/*! \brief Bind a hardware timer to a motor for interrupt driven step generation.
+
+Steps are then generated from the timer interrupt and st2_motor_run() does not have to be polled,
+this allows for higher and less jittery step rates. A timer may be bound to several motors, their
+steps are then generated by a multiplexed interrupt handler.
+<br>__NOTE:__ the timer resolution is limited by hal.get_micros() to 1 microsecond.
+\param motor pointer to a \a st2_motor structure.
+\param timer pointer to a \a st2_timer_t structure, must stay valid. Set to \a NULL to revert to polled mode.
+\returns \a true if successful, \a false if not (motor is running or the timer could not be claimed).
+*/
+bool st2_motor_bind_timer (st2_motor_t *motor, const st2_timer_t *timer)
+{
+    bool attached = false;
+    st2_motor_t *other = motors;
+
+    if(motor->state != State_Idle)
+        return false;
+
+    if(timer) {
+        while(other) {
+            if(other != motor && other->timer == timer)
+                attached = true;
+            other = other->next;
+        }
+        if(!attached && !(timer->attach && timer->start && timer->stop && timer->attach(timer->timer, timer_irq_handler, (void *)timer)))
+            return false;
+    }
+
+    motor->timer = timer;
+
+    return true;
+}
+
 /*! \brief Command a motor to move.
 
 __NOTE:__ For all motions except single steps st2_motor_run() has to be called from
 the foreground process at a high frequency in order for steps to be generated.
 Typically this is done by registering a function with the hal.on_execute_realtime event
-that calls st2_motor_run().
+that calls st2_motor_run(). This is not required if a timer is bound to the motor by st2_motor_bind_timer(),
+the motor then has to be idle for the command to be accepted. Use st2_motor_set_speed() to change speed of a running motor.
 \param motor pointer to a \a st2_motor structure.
 \param move relative distance to move.
 \param speed speed
@@ -332,7 +446,7 @@ bool st2_motor_move (st2_motor_t *motor, const float move, const float speed, po
 {
     bool dir = move < 0.0f;
 
-    if(speed == 0.0f)
+    if(speed == 0.0f || motor->master || (motor->timer && motor->state != State_Idle))
         return false;
 
     if((motor->dir.mask == 0) != dir)
@@ -352,7 +466,7 @@ bool st2_motor_move (st2_motor_t *motor, const float move, const float speed, po
             break;
     }
 
-    st2_motor_set_speed(motor, speed);
+    motor_set_speed(motor, speed);
 
     if(motor->move == 1 && type == Stepper2_Steps) {
         if(motor->state == State_Idle) {
@@ -386,6 +500,9 @@ bool st2_motor_move (st2_motor_t *motor, const float move, const float speed, po
     motor->step_no   = 0;                   // step counter
     motor->next_step = hal.get_micros();
 
+    if(motor->timer)
+        timer_schedule(motor->timer);
+
 #ifdef DEBUGOUT
     uint32_t nn = motor->n;
     float cn = motor->first_delay;
@@ -406,6 +523,75 @@ bool st2_motor_move (st2_motor_t *motor, const float move, const float speed, po
     return true;
 }
 
+/*! \brief Command a group of motors to move in sync.
+
+The motor with the longest move generates the acceleration ramp, the other motors follow it
+Bresenham style so that all motors start and complete the move together. Acceleration is limited
+so that no motor exceeds its own configured acceleration.
+<br>__NOTE:__ all motors must be idle. Steps are generated by the motor with the longest move,
+by st2_motor_run() or its bound timer, calling st2_motor_run() for the other motors is not required.
+\param motors array of pointers to \a st2_motor structures.
+\param moves array of relative distances to move, one per motor.
+\param n_motors number of motors.
+\param speed speed of the motor with the longest move.
+\param type a #position_t enum, #Stepper2_InfiniteSteps is not allowed.
+\returns \a true if command is accepted, \a false if not.
+*/
+bool st2_motor_move_group (st2_motor_t **motors, const float *moves, uint_fast8_t n_motors, const float speed, position_t type)
+{
+    uint_fast8_t idx;
+    uint32_t steps[N_AXIS];
+    float acceleration;
+    st2_motor_t *master = NULL, *motor;
+
+    if(n_motors == 0 || n_motors > N_AXIS || speed == 0.0f || type == Stepper2_InfiniteSteps)
+        return false;
+
+    for(idx = 0; idx < n_motors; idx++) {
+        motor = motors[idx];
+        if(motor->state != State_Idle || motor->master || (idx && motor->timer != motors[0]->timer))
+            return false;
+        steps[idx] = type == Stepper2_mm ? (uint32_t)lroundf(fabsf(moves[idx] * settings.axis[motor->idx].steps_per_mm)) : (uint32_t)fabsf(moves[idx]);
+        if(master == NULL || steps[idx] > master->move) {
+            master = motor;
+            master->move = steps[idx];
+        }
+    }
+
+    if(master->move < 2)
+        return n_motors == 1 ? st2_motor_move(master, moves[0], speed, type) : false;
+
+    acceleration = master->acceleration;
+
+    for(idx = 0; idx < n_motors; idx++) {
+        motor = motors[idx];
+        if(motor != master) {
+            if(steps[idx] && motor->acceleration * (float)master->move / (float)steps[idx] < acceleration)
+                acceleration = motor->acceleration * (float)master->move / (float)steps[idx];
+            motor->move = steps[idx];
+            motor->dir.mask = moves[idx] < 0.0f ? 0 : motor->axis.mask;
+            motor->count = master->move >> 1;
+            motor->step_no = 0;
+            motor->state = State_Run;
+            motor->master = master;
+            motor->group_next = master->group_next;
+            master->group_next = motor;
+        }
+    }
+
+    master->acceleration = acceleration;
+    master->first_delay = (uint32_t)(0.676f * sqrtf(2.0f / acceleration) * 1000000.0f);
+
+    for(idx = 0; idx < n_motors && motors[idx] != master; idx++);
+
+    if(!st2_motor_move(master, moves[idx], speed, type)) {
+        group_release(master);
+        return false;
+    }
+
+    return true;
+}
+
 /*! \brief Get current position in steps.
 \param motor pointer to a \a st2_motor structure.
 \returns current position as number of steps.
@@ -432,19 +618,9 @@ bool st2_set_position (st2_motor_t *motor, int64_t position)
     return motor->state == State_Idle;
 }
 
-/*! \brief Execute a move commanded by st2_motor_move().
-
-This should be called from the foreground process as often as possible.
-\param motor pointer to a \a st2_motor structure.
-\returns \a true if motor is moving (steps are output), \a false if not (motion is completed).
-*/
-bool st2_motor_run (st2_motor_t *motor)
+// Output a step and calculate delay to the next.
+static void motor_step (st2_motor_t *motor)
 {
-    uint64_t t = hal.get_micros();
-
-    if(motor->state == State_Idle || t - motor->next_step < motor->delay)
-        return motor->state != State_Idle;
-
     switch(motor->state) {
 
         case State_Accel:
@@ -500,8 +676,33 @@ bool st2_motor_run (st2_motor_t *motor)
             break;
     }
 
+    axes_signals_t step = motor->axis, dir = motor->dir;
+
+    // Step follower motors of a grouped move, all complete with the master motor.
+    if(motor->group_next) {
+
+        st2_motor_t *follower = motor->group_next;
+
+        while(follower) {
+            if(follower->step_no < follower->move && ((follower->count += follower->move) >= motor->move || motor->state == State_Idle)) {
+                follower->count -= motor->move;
+                step.mask |= follower->axis.mask;
+                dir.mask |= follower->dir.mask;
+                if(follower->dir.mask)
+                    follower->position--;
+                else
+                    follower->position++;
+                follower->step_no++;
+            }
+            follower = follower->group_next;
+        }
+
+        if(motor->state == State_Idle)
+            group_release(motor);
+    }
+
     // output step;
-    hal.stepper.output_step(motor->axis, motor->dir);
+    hal.stepper.output_step(step, dir);
 
     if(motor->dir.mask)
         motor->position--;
@@ -509,6 +710,24 @@ bool st2_motor_run (st2_motor_t *motor)
         motor->position++;
 
     motor->step_no++;
+}
+
+/*! \brief Execute a move commanded by st2_motor_move().
+
+This should be called from the foreground process as often as possible.
+If a timer is bound to the motor steps are generated from the timer interrupt and
+calling this function is optional, it then only returns the motor status.
+\param motor pointer to a \a st2_motor structure.
+\returns \a true if motor is moving (steps are output), \a false if not (motion is completed).
+*/
+bool st2_motor_run (st2_motor_t *motor)
+{
+    uint64_t t;
+
+    if(motor->timer || motor->master || motor->state == State_Idle || (t = hal.get_micros()) - motor->next_step < motor->delay)
+        return motor->state != State_Idle;
+
+    motor_step(motor);
     motor->next_step = t;
 
     return motor->state != State_Idle;
@@ -521,6 +740,12 @@ This will initiate deceleration to stop the motor if it is running.
 */
 bool st2_motor_stop (st2_motor_t *motor)
 {
+    if(motor->master)
+        motor = motor->master;
+
+    if(motor->timer)
+        hal.irq_disable();
+
     switch(motor->state) {
 
         case State_Accel:
@@ -541,6 +766,9 @@ bool st2_motor_stop (st2_motor_t *motor)
             break;
     }
 
+    if(motor->timer)
+        hal.irq_enable();
+
     return motor->state != State_Idle;
 }
 
@@ -31,9 +31,25 @@ typedef enum {
 struct st2_motor; // members defined in stepper2.c
 typedef struct st2_motor st2_motor_t;
 
+typedef void (*st2_timer_irq_ptr)(void *context);
+
+/*! \brief Hardware timer provided by the driver for interrupt driven step generation.
+
+A timer may be bound to several motors, step generation for them is then multiplexed
+by the timer interrupt handler.
+*/
+typedef struct {
+    void *timer;                                                                //!< Driver timer handle, passed to the functions below.
+    bool (*attach)(void *timer, st2_timer_irq_ptr irq_handler, void *context);  //!< Claim timer and set the interrupt handler to be called with \a context on timeout.
+    void (*start)(void *timer, uint32_t delay);                                 //!< Arm timer to timeout once after \a delay microseconds, rearm if running.
+    void (*stop)(void *timer);                                                  //!< Disarm timer.
+} st2_timer_t;
+
 st2_motor_t *st2_motor_init (uint_fast8_t axis_idx, bool is_spindle);
 float st2_motor_set_speed (st2_motor_t *motor, float speed);
 bool st2_motor_move (st2_motor_t *motor, const float move, const float speed, position_t type);
+bool st2_motor_move_group (st2_motor_t **motors, const float *moves, uint_fast8_t n_motors, const float speed, position_t type);
+bool st2_motor_bind_timer (st2_motor_t *motor, const st2_timer_t *timer);
 bool st2_motor_run (st2_motor_t *motor);
 bool st2_motor_running (st2_motor_t *motor);
 bool st2_motor_cruising (st2_motor_t *motor);
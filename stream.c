@@ -25,28 +25,76 @@
 #include "hal.h"
 #include "protocol.h"
 #include "state_machine.h"
+#include "mem_stats.h"
 
 static stream_rx_buffer_t rxbackup;
 
+// Word at a time scanning of input data, a word is tested for several byte values at once by bit tricks.
+// haszero() is nonzero if any byte of the word is 0, hasless() if any byte is less than n (n <= 128).
+// Bytes above the first hit may be flagged incorrectly, the exact position is found by a byte scan of the word.
+
+#if UINTPTR_MAX > 0xFFFFFFFF
+typedef uint64_t scan_word_t;
+#else
+typedef uint32_t scan_word_t;
+#endif
+
+#define SCAN_ONES ((scan_word_t)-1 / 0xFF)
+#define SCAN_HIGHS (SCAN_ONES * 0x80)
+#define haszero(w) (((w) - SCAN_ONES) & ~(w) & SCAN_HIGHS)
+#define hasless(w, n) (((w) - SCAN_ONES * (n)) & ~(w) & SCAN_HIGHS)
+#define hasvalue(w, c) haszero((w) ^ (SCAN_ONES * (c)))
+
 typedef struct {
     enqueue_realtime_command_ptr enqueue_realtime_command;
     stream_read_ptr read;
+    stream_read_line_ptr read_line;
     stream_rx_buffer_t *rxbuffer;
 } stream_state_t;
 
+// Handlers selected together with the stream, the read_line handler is only valid for the read handler.
+typedef struct {
+    stream_read_ptr read;
+    stream_read_line_ptr read_line;
+} stream_line_pair_t;
+
 typedef union {
     uint8_t value;
     struct {
-        uint8_t is_mpg    :1,
-                is_mpg_tx :1,
-                unused    :6;
+        uint8_t is_mpg        :1,
+                is_mpg_tx     :1,
+                is_subscriber :1,
+                unused        :5;
     };
 } stream_connection_flags_t;
 
+#if STREAM_TX_QUEUE_SIZE
+
+#ifndef STREAM_TX_HIGH_WATER
+#define STREAM_TX_HIGH_WATER (TX_BUFFER_SIZE / 2)   // Max number of characters in the stream driver output buffer when fed from the queue.
+#endif
+
+typedef struct {
+    uint_fast16_t head;
+    uint_fast16_t tail;
+    bool busy;                  // Set while written to, guards against reentry from stream_tx_blocking().
+    bool discard;               // Set when a partial line has been dropped, the remainder of the line is discarded.
+    stream_tx_queue_stats_t stats;
+    char data[STREAM_TX_QUEUE_SIZE];
+} stream_tx_queue_t;
+
+#endif
+
 typedef struct stream_connection {
     const io_stream_t *stream;
     stream_is_connected_ptr is_up;
     stream_connection_flags_t flags;
+#if STREAM_MUX_ENABLE
+    enqueue_realtime_command_ptr enqueue_rt;    // Handler replaced when subscribing, restored on unsubscribe.
+#endif
+#if STREAM_TX_QUEUE_SIZE
+    stream_tx_queue_t *txq;
+#endif
     struct stream_connection *next;
 } stream_connection_t;
 
@@ -69,6 +117,7 @@ static stream_state_t stream = {0};
 static io_stream_details_t *streams = &null_streams;
 static stream_connection_t base = {0}, mpg = {0}, *connections = &base;
 static stream_write_char_ptr mpg_write_char = NULL;
+static stream_line_pair_t line_pair = {0}, mpg_line_pair = {0};
 
 void stream_register_streams (io_stream_details_t *details)
 {
@@ -121,6 +170,7 @@ ISR_CODE static bool ISR_FUNC(await_toolchange_ack)(char c)
         stream.rxbuffer->backup = true;
         stream.rxbuffer->tail = stream.rxbuffer->head;
         hal.stream.read = stream.read; // restore normal input
+        hal.stream.read_line = stream.read_line;
         hal.stream.set_enqueue_rt_handler(stream.enqueue_realtime_command);
         stream.enqueue_realtime_command = NULL;
         if(grbl.on_toolchange_ack)
@@ -131,20 +181,28 @@ ISR_CODE static bool ISR_FUNC(await_toolchange_ack)(char c)
     return true;
 }
 
+bool stream_read_line_valid (void)
+{
+    return hal.stream.read_line && (hal.stream.read_line != line_pair.read_line || hal.stream.read == line_pair.read);
+}
+
 bool stream_rx_suspend (stream_rx_buffer_t *rxbuffer, bool suspend)
 {
     if(suspend) {
         if(stream.rxbuffer == NULL) {
             stream.rxbuffer = rxbuffer;
             stream.read = hal.stream.read;
+            stream.read_line = hal.stream.read_line;
             stream.enqueue_realtime_command = hal.stream.set_enqueue_rt_handler(await_toolchange_ack);
             hal.stream.read = stream_get_null;
+            hal.stream.read_line = NULL;
         }
     } else if(stream.rxbuffer) {
         if(rxbuffer->backup)
             memcpy(rxbuffer, &rxbackup, sizeof(stream_rx_buffer_t));
         if(stream.enqueue_realtime_command) {
             hal.stream.read = stream.read; // restore normal input
+            hal.stream.read_line = stream.read_line;
             hal.stream.set_enqueue_rt_handler(stream.enqueue_realtime_command);
             stream.enqueue_realtime_command = NULL;
         }
@@ -154,6 +212,164 @@ bool stream_rx_suspend (stream_rx_buffer_t *rxbuffer, bool suspend)
     return rxbuffer->tail != rxbuffer->head;
 }
 
+// Returns true if the byte may be acted upon by the core realtime command handler or is a control character.
+static inline bool is_rt_candidate (char c)
+{
+    return (unsigned char)c < ' ' || (unsigned char)c >= 0x80 || c == ASCII_DEL || c == CMD_STATUS_REPORT_LEGACY ||
+            c == CMD_CYCLE_START_LEGACY || c == CMD_FEED_HOLD_LEGACY || c == '$';
+}
+
+// Returns the number of leading bytes that are not control characters.
+static uint_fast16_t scan_ctrl (const char *data, uint_fast16_t length)
+{
+    scan_word_t w;
+    const char *p = data, *end = data + length;
+
+    while(p < end && ((uintptr_t)p & (sizeof(scan_word_t) - 1))) {
+        if((unsigned char)*p < ' ')
+            return p - data;
+        p++;
+    }
+
+    while(end - p >= (ptrdiff_t)sizeof(scan_word_t)) {
+        memcpy(&w, p, sizeof(scan_word_t));
+        if(hasless(w, ' '))
+            break;
+        p += sizeof(scan_word_t);
+    }
+
+    while(p < end && (unsigned char)*p >= ' ')
+        p++;
+
+    return p - data;
+}
+
+/*! \brief Scans input data a word at a time for bytes that has to be passed to the realtime command handler.
+Bytes that are not control characters (line ends included), top bit set characters or the legacy realtime
+commands \ref CMD_STATUS_REPORT_LEGACY, \ref CMD_CYCLE_START_LEGACY, \ref CMD_FEED_HOLD_LEGACY
+and '$' (that controls their processing) may be copied to the input buffer without calling the handler.
+\param data pointer to the data.
+\param length number of bytes to scan.
+\returns number of leading bytes that may be copied without calling the realtime command handler.
+*/
+uint_fast16_t stream_rx_scan (const char *data, uint_fast16_t length)
+{
+    scan_word_t w;
+    const char *p = data, *end = data + length;
+
+    while(p < end && ((uintptr_t)p & (sizeof(scan_word_t) - 1))) {
+        if(is_rt_candidate(*p))
+            return p - data;
+        p++;
+    }
+
+    while(end - p >= (ptrdiff_t)sizeof(scan_word_t)) {
+        memcpy(&w, p, sizeof(scan_word_t));
+        if(((w & SCAN_HIGHS) | hasless(w, ' ') | hasvalue(w, CMD_STATUS_REPORT_LEGACY) | hasvalue(w, CMD_CYCLE_START_LEGACY) |
+              hasvalue(w, CMD_FEED_HOLD_LEGACY) | hasvalue(w, '$') | hasvalue(w, ASCII_DEL)))
+            break;
+        p += sizeof(scan_word_t);
+    }
+
+    while(p < end && !is_rt_candidate(*p))
+        p++;
+
+    return p - data;
+}
+
+/*! \brief Adds received data to an input buffer, may be used by drivers receiving data in blocks (DMA or USB packets).
+Spans without realtime command candidates, see stream_rx_scan(), are bulk copied. Other bytes are passed to the realtime
+command handler and added to the buffer if not dropped by it. Data that does not fit is dropped and the overflow flag is set.
+The byte following an ESC is always passed to the handler, so that the ESC prefix state of the handler is cleared as it
+would be by per character processing. The first byte is passed to the handler too as the previous call may have ended
+with an ESC. Bulk copied bytes are not realtime commands, latency profiling is thus not affected by skipping them.
+\param rxbuffer pointer to a stream_rx_buffer_t.
+\param data pointer to the data.
+\param length number of bytes.
+\param enqueue_realtime_command pointer to the realtime command handler of the stream.
+*/
+void stream_rx_enqueue (stream_rx_buffer_t *rxbuffer, const char *data, uint_fast16_t length, enqueue_realtime_command_ptr enqueue_realtime_command)
+{
+    bool esc = true; // The previous call may have ended with an ESC.
+    uint_fast16_t span, chunk, skip, head = rxbuffer->head, space;
+
+    while(length) {
+
+        if(!esc && (span = stream_rx_scan(data, length))) {
+
+            space = (RX_BUFFER_SIZE - 1) - BUFCOUNT(head, rxbuffer->tail, RX_BUFFER_SIZE);
+
+            if((skip = span > space ? span - space : 0)) {
+                rxbuffer->overflow = On;
+                span = space;
+            }
+
+            length -= span + skip;
+
+            while(span) {
+                chunk = min(span, RX_BUFFER_SIZE - head);
+                memcpy(&rxbuffer->data[head], data, chunk);
+                head = (head + chunk) & (RX_BUFFER_SIZE - 1);
+                data += chunk;
+                span -= chunk;
+            }
+
+            rxbuffer->head = head;
+            data += skip; // Drop the part that did not fit.
+        }
+
+        if(length) {
+            length--;
+            esc = *data == ASCII_ESC;
+            if(!enqueue_realtime_command(*data)) {
+                // The handler may have flushed the buffer.
+                head = rxbuffer->head;
+                if(BUFNEXT(head, (*rxbuffer)) == rxbuffer->tail)
+                    rxbuffer->overflow = On;
+                else {
+                    rxbuffer->data[head] = *data;
+                    rxbuffer->head = head = BUFNEXT(head, (*rxbuffer));
+                }
+            } else
+                head = rxbuffer->head;
+            data++;
+        }
+    }
+}
+
+int_fast16_t stream_rx_get_line (stream_rx_buffer_t *rxbuffer, char **line)
+{
+    char c;
+    uint_fast16_t tail = rxbuffer->tail, head = rxbuffer->head, end = tail;
+    uint_fast16_t limit = head >= tail ? head : RX_BUFFER_SIZE;
+
+    // Scan for end of line, bail if line is incomplete, wraps around or is to be cancelled.
+    while((end += scan_ctrl(&rxbuffer->data[end], limit - end)) != limit) {
+        if((c = rxbuffer->data[end]) == '\n' || c == '\r')
+            break;
+        if(c == ASCII_CAN)
+            return -1;
+        end++;
+    }
+
+    if(end == limit)
+        return -1;
+
+    rxbuffer->line_tail = tail;
+    rxbuffer->line_next = BUFNEXT(end, (*rxbuffer));
+    *line = &rxbuffer->data[tail];
+
+    return (int_fast16_t)(end - tail);
+}
+
+void stream_rx_release_line (stream_rx_buffer_t *rxbuffer)
+{
+    if(rxbuffer->tail == rxbuffer->line_tail && rxbuffer->line_tail != rxbuffer->line_next) {
+        rxbuffer->tail = rxbuffer->line_next;
+        rxbuffer->line_tail = rxbuffer->line_next;
+    }
+}
+
 ISR_CODE bool ISR_FUNC(stream_buffer_all)(char c)
 {
     return false;
@@ -202,13 +418,213 @@ static bool connection_is_up (io_stream_t *stream)
     return false;
 }
 
+#if STREAM_TX_QUEUE_SIZE
+
+static bool txq_hooked = false;
+
+static inline uint_fast16_t txq_fill (stream_tx_queue_t *txq)
+{
+    return txq->head >= txq->tail ? txq->head - txq->tail : STREAM_TX_QUEUE_SIZE - txq->tail + txq->head;
+}
+
+static inline uint_fast16_t txq_free (stream_tx_queue_t *txq)
+{
+    return STREAM_TX_QUEUE_SIZE - 1 - txq_fill(txq);
+}
+
+// Feeds queued output to the stream driver while its output buffer is below the high water mark,
+// if block is set waits for the stream until the queue is emptied or a reset is requested.
+static void txq_drain (const io_stream_t *stream, stream_tx_queue_t *txq, bool block)
+{
+    char buf[65];
+    uint_fast16_t count, length;
+
+    while(txq->tail != txq->head) {
+
+        if((count = stream->get_tx_buffer_count()) < STREAM_TX_HIGH_WATER) {
+
+            length = min((txq->head > txq->tail ? txq->head : STREAM_TX_QUEUE_SIZE) - txq->tail, STREAM_TX_HIGH_WATER - count);
+
+            if(stream->write_n)
+                stream->write_n(&txq->data[txq->tail], length);
+            else {
+                length = min(length, sizeof(buf) - 1);
+                memcpy(buf, &txq->data[txq->tail], length);
+                buf[length] = '\0';
+                stream->write(buf);
+            }
+
+            txq->tail = (txq->tail + length) % STREAM_TX_QUEUE_SIZE;
+
+        } else if(!block || !stream_tx_blocking())
+            break;
+    }
+}
+
+// Removes complete queued real-time reports, and the trailing partial line if partial is set.
+static void txq_drop_reports (stream_tx_queue_t *txq, bool partial)
+{
+    uint_fast16_t end, rd = txq->tail, wr = txq->tail;
+
+    while(rd != txq->head) {
+
+        for(end = rd; end != txq->head && txq->data[end] != '\n'; end = (end + 1) % STREAM_TX_QUEUE_SIZE);
+
+        if(end == txq->head) { // Partial line
+            if(partial)
+                rd = end;
+        } else {
+            end = (end + 1) % STREAM_TX_QUEUE_SIZE;
+            if(txq->data[rd] == '<') {
+                txq->stats.dropped++;
+                rd = end;
+            }
+        }
+
+        while(rd != end) {
+            txq->data[wr] = txq->data[rd];
+            wr = (wr + 1) % STREAM_TX_QUEUE_SIZE;
+            rd = (rd + 1) % STREAM_TX_QUEUE_SIZE;
+        }
+    }
+
+    txq->head = wr;
+}
+
+static void txq_write (stream_connection_t *connection, const char *s)
+{
+    stream_tx_queue_t *txq = connection->txq;
+    uint_fast16_t length, count;
+
+    if(txq->busy) {
+        if(*s) {
+            txq->stats.dropped++;
+            txq->discard = s[strlen(s) - 1] != '\n';
+        }
+        return;
+    }
+
+    if(txq->discard) {
+        if((s = strchr(s, '\n')) == NULL)
+            return;
+        txq->discard = false;
+        s++;
+    }
+
+    if((length = strlen(s)) == 0)
+        return;
+
+    txq->busy = true;
+
+    if(length > txq_free(txq))
+        txq_drain(connection->stream, txq, false);
+
+    if(length > txq_free(txq) && txq->stats.policy == StreamTxPolicy_DropStatus)
+        txq_drop_reports(txq, false);
+
+    if(length > txq_free(txq) && txq->stats.policy == StreamTxPolicy_Block) {
+        txq_drain(connection->stream, txq, true);
+        if(length >= STREAM_TX_QUEUE_SIZE && txq->tail == txq->head) {
+            connection->stream->write(s); // Too large for the queue.
+            length = 0;
+        }
+    }
+
+    if(length > txq_free(txq)) {
+        txq_drop_reports(txq, true);
+        txq->stats.dropped++;
+        txq->discard = s[length - 1] != '\n';
+    } else if(length) {
+        while(length) {
+            count = min(length, STREAM_TX_QUEUE_SIZE - txq->head);
+            memcpy(&txq->data[txq->head], s, count);
+            s += count;
+            length -= count;
+            txq->head = (txq->head + count) % STREAM_TX_QUEUE_SIZE;
+        }
+        if((count = txq_fill(txq)) > txq->stats.max_fill)
+            txq->stats.max_fill = count;
+        txq_drain(connection->stream, txq, false);
+    }
+
+    txq->busy = false;
+}
+
+// Drains all queues from the foreground process.
+static void txq_poll (sys_state_t state)
+{
+    stream_connection_t *connection = connections;
+
+    while(connection) {
+        if(connection->txq && !connection->txq->busy && connection->txq->tail != connection->txq->head) {
+            if(connection->is_up())
+                txq_drain(connection->stream, connection->txq, false);
+            else
+                connection->txq->tail = connection->txq->head;
+        }
+        connection = connection->next;
+    }
+}
+
+static void txq_alloc (stream_connection_t *connection)
+{
+    if(connection->stream->get_tx_buffer_count && connection->stream->write &&
+        (connection->txq = mem_calloc(MemTag_Stream, 1, sizeof(stream_tx_queue_t))) && !txq_hooked)
+        txq_hooked = protocol_register_realtime_hook("stream tx", txq_poll, 0, false);
+}
+
+bool stream_set_tx_policy (const io_stream_t *stream, stream_tx_policy_t policy)
+{
+    stream_connection_t *connection = connections;
+
+    while(connection) {
+        if(connection->stream == stream && connection->txq) {
+            connection->txq->stats.policy = policy;
+            return true;
+        }
+        connection = connection->next;
+    }
+
+    return false;
+}
+
+void stream_enumerate_tx_queues (stream_tx_queue_callback_ptr callback)
+{
+    stream_connection_t *connection = connections;
+
+    while(connection) {
+        if(connection->txq) {
+            connection->txq->stats.fill = txq_fill(connection->txq);
+            callback(connection->stream, &connection->txq->stats);
+        }
+        connection = connection->next;
+    }
+}
+
+#endif // STREAM_TX_QUEUE_SIZE
+
 static void stream_write_all (const char *s)
 {
     stream_connection_t *connection = connections;
 
     while(connection) {
-        if(connection->is_up())
+        if(connection->is_up()) {
+#if STREAM_TX_QUEUE_SIZE
+            // Output to the active stream is not queued to keep it in order with responses.
+            if(connection->txq && connection->stream->write != hal.stream.write)
+                txq_write(connection, s);
+            else {
+                if(connection->txq && !connection->txq->busy && connection->txq->tail != connection->txq->head) {
+                    connection->txq->busy = true;
+                    txq_drain(connection->stream, connection->txq, true);
+                    connection->txq->busy = false;
+                }
+                connection->stream->write(s);
+            }
+#else
             connection->stream->write(s);
+#endif
+        }
         connection = connection->next;
     }
 }
@@ -220,13 +636,20 @@ static stream_connection_t *add_connection (const io_stream_t *stream)
     if(base.stream == NULL) {
         base.stream = stream;
         connection = &base;
-    } else if((connection = malloc(sizeof(stream_connection_t)))) {
+    } else if((connection = mem_alloc(MemTag_Stream, sizeof(stream_connection_t)))) {
         connection->stream = stream;
         connection->next = NULL;
+        connection->flags.value = 0;
+#if STREAM_MUX_ENABLE
+        connection->enqueue_rt = NULL;
+#endif
+#if STREAM_TX_QUEUE_SIZE
+        connection->txq = NULL;
+#endif
         while(last->next) {
             last = last->next;
             if(last->stream == stream) {
-                free(connection);
+                mem_free(connection);
                 return NULL;
             }
         }
@@ -237,9 +660,53 @@ static stream_connection_t *add_connection (const io_stream_t *stream)
                          stream->is_connected :
                           (stream->state.is_usb && base.stream != stream ? is_not_connected : is_connected);
 
+#if STREAM_TX_QUEUE_SIZE
+    if(connection->txq == NULL)
+        txq_alloc(connection);
+#endif
+
+    return connection;
+}
+
+#if STREAM_MUX_ENABLE
+
+static const io_stream_t *takeover = NULL;
+
+// Subscribers may only request status reports, anything else is discarded.
+ISR_CODE static bool ISR_FUNC(subscriber_enqueue_rt)(char c)
+{
+    if(c == CMD_STATUS_REPORT || c == CMD_STATUS_REPORT_LEGACY || c == CMD_STATUS_REPORT_ALL)
+        protocol_enqueue_realtime_command(c);
+
+    return true;
+}
+
+static stream_connection_t *find_connection (const io_stream_t *stream)
+{
+    stream_connection_t *connection = connections;
+
+    while(connection && connection->stream != stream)
+        connection = connection->next;
+
     return connection;
 }
 
+// Returns the last connection from the given one that is not a subscriber, the stream owning input.
+static stream_connection_t *find_owner (stream_connection_t *connection)
+{
+    stream_connection_t *owner = NULL;
+
+    while(connection) {
+        if(!connection->flags.is_subscriber)
+            owner = connection;
+        connection = connection->next;
+    }
+
+    return owner;
+}
+
+#endif // STREAM_MUX_ENABLE
+
 static bool stream_select (const io_stream_t *stream, bool add)
 {
     static const io_stream_t *active_stream = NULL;
@@ -251,7 +718,11 @@ static bool stream_select (const io_stream_t *stream, bool add)
 
     if(add) {
 
+#if STREAM_MUX_ENABLE
+        if(stream != takeover && add_connection(stream) == NULL)
+#else
         if(add_connection(stream) == NULL)
+#endif
             return false;
 
     } else { // disconnect
@@ -263,13 +734,29 @@ static bool stream_select (const io_stream_t *stream, bool add)
             last = last->next;
             if(last->stream == stream) {
                 prev->next = last->next;
-                free(last);
+#if STREAM_TX_QUEUE_SIZE
+                if(last->txq)
+                    mem_free(last->txq);
+#endif
+#if STREAM_MUX_ENABLE
+                // Select the stream owning input before the removed one if it was the owner.
+                bool is_subscriber = last->flags.is_subscriber;
+                mem_free(last);
+                if(is_subscriber || find_owner(prev->next))
+                    return false;
+                else {
+                    stream = find_owner(connections)->stream;
+                    break;
+                }
+#else
+                mem_free(last);
                 if(prev->next)
                     return false;
                 else {
                     stream = prev->stream;
                     break;
                 }
+#endif
             }
         }
     }
@@ -317,6 +804,8 @@ static bool stream_select (const io_stream_t *stream, bool add)
     }
 
     memcpy(&hal.stream, stream, sizeof(io_stream_t));
+    line_pair.read = hal.stream.read;
+    line_pair.read_line = hal.stream.read_line;
 
     if(!hal.stream.write_all)
         hal.stream.write_all = base.next != NULL ? stream_write_all : hal.stream.write;
@@ -340,6 +829,81 @@ static bool stream_select (const io_stream_t *stream, bool add)
     return true;
 }
 
+#if STREAM_MUX_ENABLE
+
+bool stream_mux_subscribe (const io_stream_t *stream)
+{
+    stream_connection_t *connection;
+
+    if(base.stream == NULL || stream->write == NULL || find_connection(stream) || (connection = add_connection(stream)) == NULL)
+        return false;
+
+    connection->flags.is_subscriber = On;
+    connection->enqueue_rt = stream->set_enqueue_rt_handler(subscriber_enqueue_rt);
+
+    hal.stream.write_all = stream_write_all;
+
+    return true;
+}
+
+bool stream_mux_unsubscribe (const io_stream_t *stream)
+{
+    stream_connection_t *connection = find_connection(stream);
+
+    if(connection == NULL || !connection->flags.is_subscriber)
+        return false;
+
+    if(connection->enqueue_rt)
+        stream->set_enqueue_rt_handler(connection->enqueue_rt);
+
+    stream_select(stream, false);
+
+    if(base.next == NULL)
+        hal.stream.write_all = hal.stream.write;
+
+    return true;
+}
+
+bool stream_mux_takeover (const io_stream_t *stream)
+{
+    sys_state_t state = state_get();
+    stream_connection_t *connection = find_connection(stream), *owner, *prev;
+
+    if(connection == NULL || !connection->flags.is_subscriber || hal.stream.file ||
+        !(state == STATE_IDLE || (state & (STATE_ALARM|STATE_ESTOP))))
+        return false;
+
+    if((owner = find_owner(connections)) != &base) {
+        owner->flags.is_subscriber = On;
+        owner->enqueue_rt = owner->stream->set_enqueue_rt_handler(subscriber_enqueue_rt);
+    }
+
+    // Discard partial input from the previous owner.
+    if(hal.stream.reset_read_buffer)
+        hal.stream.reset_read_buffer();
+
+    // Move the connection last in the list, the last connection not subscribing is the owner.
+    if(connection->next) {
+        for(prev = connections; prev->next != connection; prev = prev->next);
+        prev->next = connection->next;
+        for(prev = connections; prev->next; prev = prev->next);
+        prev->next = connection;
+        connection->next = NULL;
+    }
+
+    connection->flags.is_subscriber = Off;
+
+    takeover = stream;
+    stream_select(stream, true);
+    takeover = NULL;
+
+    hal.stream.write_all = stream_write_all;
+
+    return true;
+}
+
+#endif // STREAM_MUX_ENABLE
+
 const io_stream_t *stream_get_base (void)
 {
     return base.stream;
@@ -514,6 +1078,11 @@ bool stream_mpg_enable (bool on)
             mpg.stream->set_enqueue_rt_handler(org_stream.set_enqueue_rt_handler(NULL));
             hal.stream.type = StreamType_MPG;
             hal.stream.read = mpg.stream->read;
+            hal.stream.read_line = mpg.stream->read_line;
+            hal.stream.release_line = mpg.stream->release_line;
+            mpg_line_pair = line_pair;
+            line_pair.read = hal.stream.read;
+            line_pair.read_line = hal.stream.read_line;
             if(mpg.flags.is_mpg_tx)
                 hal.stream.write = mpg.stream->write;
             hal.stream.get_rx_buffer_free = mpg.stream->get_rx_buffer_free;
@@ -526,6 +1095,7 @@ bool stream_mpg_enable (bool on)
         else
             mpg.stream->disable_rx(true);
         memcpy(&hal.stream, &org_stream, sizeof(io_stream_t));
+        line_pair = mpg_line_pair;
         org_stream.type = StreamType_Redirected;
         if(hal.stream.disable_rx)
             hal.stream.disable_rx(false);
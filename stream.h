@@ -106,6 +106,23 @@ typedef uint16_t (*get_stream_buffer_count_ptr)(void);
 */
 typedef int16_t (*stream_read_ptr)(void);
 
+/*! \brief Pointer to function for getting the next complete line from a input stream without copying.
+
+The line is handed out as a pointer into the input buffer and stays valid until released by a call to the
+_release_line_ handler. The caller may modify the line in place, including the end-of-line character
+that immediately follows it.
+The core function stream_rx_get_line() can be used to implement this for a stream_rx_buffer_t input buffer.
+
+__NOTE:__ -1 shall be returned if the line is incomplete, wraps around the end of the buffer or contains an
+#ASCII_CAN character. The caller will then fall back to reading characters via the _read_ handler.
+\param line pointer to a \a char pointer variable that will receive the start of the line.
+\returns length of the line excluding the end-of-line character, -1 if no line is available.
+*/
+typedef int_fast16_t (*stream_read_line_ptr)(char **line);
+
+/*! \brief Pointer to function for releasing a line handed out by the _read_line_ handler back to the input buffer. */
+typedef void (*stream_release_line_ptr)(void);
+
 /*! \brief Pointer to function for writing a null terminated string to the output stream.
 \param s pointer to null terminated string.
 
@@ -248,6 +265,8 @@ typedef struct {
     flush_stream_buffer_ptr reset_write_buffer;             //!< Optional handler for flushing the output buffer. Any transmit FIFO shall be flushed as well. Required for Modbus support.
     set_baud_rate_ptr set_baud_rate;                        //!< Optional handler for setting the stream baud rate. Required for Modbus support, recommended for Bluetooth support.
     vfs_file_t *file;                                       //!< File handle, non-null if streaming from a file.
+    stream_read_line_ptr read_line;                         //!< Optional handler for getting a complete line from the input buffer without copying. Only used while _read_ is the handler selected along with it, see stream_read_line_valid().
+    stream_release_line_ptr release_line;                   //!< Handler for releasing a line got from the input buffer, required if _read_line_ is provided.
 } io_stream_t;
 
 typedef const io_stream_t *(*stream_claim_ptr)(uint32_t baud_rate);
@@ -267,6 +286,22 @@ typedef struct io_stream_details {
     struct io_stream_details *next;
 } io_stream_details_t;
 
+//! Transmit queue policy applied when the queue of a connection is full, only available when \ref STREAM_TX_QUEUE_SIZE is > 0.
+typedef enum {
+    StreamTxPolicy_DropStatus = 0,  //!< Drop the oldest queued real-time reports, drop new output if there are none.
+    StreamTxPolicy_Block            //!< Wait for the stream to catch up.
+} stream_tx_policy_t;
+
+//! Transmit queue statistics, only available when \ref STREAM_TX_QUEUE_SIZE is > 0.
+typedef struct {
+    stream_tx_policy_t policy;  //!< Policy applied when the queue is full.
+    uint16_t fill;              //!< Number of bytes queued.
+    uint16_t max_fill;          //!< Maximum number of bytes queued.
+    uint32_t dropped;           //!< Number of lines dropped.
+} stream_tx_queue_stats_t;
+
+typedef void (*stream_tx_queue_callback_ptr)(const io_stream_t *stream, const stream_tx_queue_stats_t *stats);
+
 // The following structures and functions are not referenced in the core code, may be used by drivers
 
 typedef struct {
@@ -275,6 +310,8 @@ typedef struct {
     volatile bool rts_state;
     bool overflow;
     bool backup;
+    uint_fast16_t line_tail;        //!< Tail position of line handed out by stream_rx_get_line().
+    uint_fast16_t line_next;        //!< Tail position after line handed out by stream_rx_get_line().
     char data[RX_BUFFER_SIZE];
 } stream_rx_buffer_t;
 
@@ -317,6 +354,44 @@ int16_t stream_get_null (void);
 */
 bool stream_rx_suspend (stream_rx_buffer_t *rxbuffer, bool suspend);
 
+/*! \brief Function for checking if the _read_line_ handler may be used.
+
+The _read_line_ handler of a stream is only used while _read_ is the handler selected along with it, code redirecting
+_read_, e.g. for reading from a file, does not have to know about it. A _read_line_ handler installed later is always
+used, it should call this function before chaining to the handler it replaced.
+\returns true if _read_line_ is available and may be used, false otherwise.
+*/
+bool stream_read_line_valid (void);
+
+/*! \brief Function for getting the next complete line from an input buffer without copying, may be used to implement the _read_line_ handler.
+\param rxbuffer pointer to a stream_rx_buffer_t.
+\param line pointer to a \a char pointer variable that will receive the start of the line.
+\returns length of the line excluding the end-of-line character, -1 if no contiguous complete line is available.
+*/
+int_fast16_t stream_rx_get_line (stream_rx_buffer_t *rxbuffer, char **line);
+
+/*! \brief Function for releasing a line got from stream_rx_get_line() back to the input buffer, may be used to implement the _release_line_ handler.
+
+Does nothing if the buffer has been flushed or cancelled since the line was handed out.
+\param rxbuffer pointer to a stream_rx_buffer_t.
+*/
+void stream_rx_release_line (stream_rx_buffer_t *rxbuffer);
+
+/*! \brief Function for scanning received data for bytes that has to be passed to the realtime command handler.
+\param data pointer to the data.
+\param length number of bytes to scan.
+\returns number of leading bytes that may be copied to the input buffer without calling the realtime command handler.
+*/
+uint_fast16_t stream_rx_scan (const char *data, uint_fast16_t length);
+
+/*! \brief Function for adding a block of received data to an input buffer, realtime commands are passed to the handler.
+\param rxbuffer pointer to a stream_rx_buffer_t.
+\param data pointer to the data.
+\param length number of bytes.
+\param enqueue_realtime_command pointer to the realtime command handler of the stream.
+*/
+void stream_rx_enqueue (stream_rx_buffer_t *rxbuffer, const char *data, uint_fast16_t length, enqueue_realtime_command_ptr enqueue_realtime_command);
+
 bool stream_mpg_register (const io_stream_t *stream, bool rx_only, stream_write_char_ptr write_char);
 
 /*! \brief Function for enabling/disabling input from a secondary input stream.
@@ -355,6 +430,40 @@ io_stream_t const *stream_open_instance (uint8_t instance, uint32_t baud_rate, s
 
 bool stream_set_description (const io_stream_t *stream, const char *description);
 
+/*! \brief Set the policy applied when the transmit queue of a connection is full, only available when \ref STREAM_TX_QUEUE_SIZE is > 0.
+\param stream pointer to the \a io_stream_t structure of a connected stream.
+\param policy a \a stream_tx_policy_t enum value.
+\returns \a true if the stream is connected and has a transmit queue, \a false otherwise.
+*/
+bool stream_set_tx_policy (const io_stream_t *stream, stream_tx_policy_t policy);
+
+/*! \brief Enumerate the transmit queues of connected streams, only available when \ref STREAM_TX_QUEUE_SIZE is > 0.
+\param callback pointer to a function to be called with the stream and queue statistics for each queue.
+*/
+void stream_enumerate_tx_queues (stream_tx_queue_callback_ptr callback);
+
+/*! \brief Add a stream as a status subscriber, only available when \ref STREAM_MUX_ENABLE is enabled.
+
+The stream receives output sent to all streams, input other than status report requests is discarded.
+\param stream pointer to the \a io_stream_t structure of the stream.
+\returns \a true if successful, \a false otherwise.
+*/
+bool stream_mux_subscribe (const io_stream_t *stream);
+
+/*! \brief Remove a status subscriber, only available when \ref STREAM_MUX_ENABLE is enabled.
+\param stream pointer to the \a io_stream_t structure of the stream.
+\returns \a true if successful, \a false if the stream is not a subscriber.
+*/
+bool stream_mux_unsubscribe (const io_stream_t *stream);
+
+/*! \brief Make a status subscriber the stream owning input, only available when \ref STREAM_MUX_ENABLE is enabled.
+
+The previous owner is demoted to a subscriber unless it is the base stream, it is selected again if the new owner disconnects.
+\param stream pointer to the \a io_stream_t structure of a subscribing stream.
+\returns \a true if successful, \a false if the stream is not a subscriber or the controller is not idle or in alarm state.
+*/
+bool stream_mux_takeover (const io_stream_t *stream);
+
 #ifdef DEBUGOUT
 void debug_write (const char *s);
 void debug_writeln (const char *s);
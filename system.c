@@ -29,10 +29,32 @@
 #include "tool_change.h"
 #include "state_machine.h"
 #include "machine_limits.h"
+#include "profile.h"
+#include "mem_stats.h"
+#include "probe_scan.h"
+#if HEIGHTMAP_ENABLE
+#include "heightmap.h"
+#endif
+#if PREFLIGHT_ENABLE
+#include "preflight.h"
+#endif
+#if PROGRAM_CACHE_ENABLE
+#include "program_cache.h"
+#endif
+#if INPUT_EVENT_LOG_SIZE
+#include "input_events.h"
+#endif
 #ifdef KINEMATICS_API
 #include "kinematics.h"
 #endif
 
+#ifndef SYS_COMMAND_INDEX_SIZE
+#define SYS_COMMAND_INDEX_SIZE 128  // Max number of $ commands in the dispatch index, set to 0 to disable.
+#endif
+#ifndef SYS_COMMAND_HASH_SIZE
+#define SYS_COMMAND_HASH_SIZE 64    // Number of hash buckets in the dispatch index, must be a power of 2.
+#endif
+
 /*! \internal \brief Simple hypotenuse computation function.
 \param x length
 \param y height
@@ -74,6 +96,10 @@ ISR_CODE void ISR_FUNC(control_interrupt_handler)(control_signals_t signals)
 
         sys.last_event.control.value = signals.value;
 
+#if INPUT_EVENT_LOG_SIZE
+        input_event_log(InputEvent_Control, 0, (input_event_signals_t){ .control = signals });
+#endif
+
         if ((signals.reset || signals.e_stop || signals.motor_fault) && state_get() != STATE_ESTOP)
             mc_reset();
         else {
@@ -188,6 +214,45 @@ static status_code_t jog (sys_state_t state, char *args)
     return args == NULL ? Status_InvalidStatement : gc_execute_block(args); // NOTE: $J= is ignored inside g-code parser and used to detect jog motions.
 }
 
+#if CONTINUOUS_JOG_ENABLE
+
+// $JV=X<x>Y<y>...F<rate> - start, update or stop a continuous jog. Axis words are direction vector components.
+static status_code_t jog_continuous (sys_state_t state, char *args)
+{
+    uint_fast8_t cc = 0, idx;
+    float direction[N_AXIS] = {0}, feed_rate = -1.0f, value;
+
+    if(args == NULL)
+        return Status_InvalidStatement;
+
+    while(args[cc]) {
+
+        char letter = args[cc++];
+
+        if(!read_float(args, &cc, &value))
+            return Status_BadNumberFormat;
+
+        if(letter == 'F')
+            feed_rate = value;
+        else {
+            idx = N_AXIS;
+            do {
+                idx--;
+            } while(idx && letter != *axis_letter[idx]);
+            if(letter != *axis_letter[idx])
+                return Status_GcodeUnsupportedCommand;
+            direction[idx] = value;
+        }
+    }
+
+    if(feed_rate < 0.0f)
+        return Status_GcodeUndefinedFeedRate;
+
+    return mc_jog_continuous(direction, gc_state.modal.units_imperial ? feed_rate * MM_PER_INCH : feed_rate);
+}
+
+#endif
+
 static status_code_t enumerate_alarms (sys_state_t state, char *args)
 {
     return report_alarm_details(false);
@@ -213,19 +278,46 @@ static status_code_t enumerate_groups (sys_state_t state, char *args)
     return report_setting_group_details(true, NULL);
 }
 
+// Handles optional arguments: HASH outputs a hash of the details, <first id>[,<count>] outputs a page of settings.
+static status_code_t enumerate_settings_format (settings_format_t format, char *args)
+{
+    float first, count = 0.0f;
+    uint_fast8_t counter = 0;
+
+    if(args == NULL)
+        return report_settings_details(format, Setting_SettingsAll, Group_All);
+
+    if(!strcmp(args, "HASH"))
+        return report_settings_details_hash(format);
+
+    if(!read_float(args, &counter, &first))
+        return Status_BadNumberFormat;
+
+    if(args[counter] == ',') {
+        counter++;
+        if(!read_float(args, &counter, &count))
+            return Status_BadNumberFormat;
+    }
+
+    if(args[counter] != '\0' || !isintf(first) || !isintf(count) || first < 0.0f || count < 0.0f)
+        return Status_InvalidStatement;
+
+    return report_settings_details_page(format, (setting_id_t)first, (uint_fast16_t)count);
+}
+
 static status_code_t enumerate_settings (sys_state_t state, char *args)
 {
-    return report_settings_details(SettingsFormat_MachineReadable, Setting_SettingsAll, Group_All);
+    return enumerate_settings_format(SettingsFormat_MachineReadable, args);
 }
 
 static status_code_t enumerate_settings_grblformatted (sys_state_t state, char *args)
 {
-    return report_settings_details(SettingsFormat_Grbl, Setting_SettingsAll, Group_All);
+    return enumerate_settings_format(SettingsFormat_Grbl, args);
 }
 
 static status_code_t enumerate_settings_halformatted (sys_state_t state, char *args)
 {
-    return report_settings_details(SettingsFormat_grblHAL, Setting_SettingsAll, Group_All);
+    return enumerate_settings_format(SettingsFormat_grblHAL, args);
 }
 
 static status_code_t enumerate_all (sys_state_t state, char *args)
@@ -324,6 +416,137 @@ static status_code_t toggle_single_block (sys_state_t state, char *args)
     return hal.signals_cap.single_block ? Status_InvalidStatement : Status_OK;
 }
 
+#if REPORT_DELTA_FULL_INTERVAL
+
+static status_code_t toggle_report_delta (sys_state_t state, char *args)
+{
+    report_delta(!report_delta_enabled());
+    grbl.report.feedback_message(report_delta_enabled() ? Message_Enabled : Message_Disabled);
+
+    return Status_OK;
+}
+
+#endif
+
+static status_code_t settings_begin (sys_state_t state, char *args)
+{
+    return settings_transaction_begin();
+}
+
+static status_code_t settings_commit (sys_state_t state, char *args)
+{
+    return settings_transaction_commit();
+}
+
+static status_code_t realtime_hooks_command (sys_state_t state, char *args)
+{
+    status_code_t retval = Status_OK;
+
+    if(args) {
+        if(!strcmp(args, "RESET"))
+            protocol_reset_realtime_hook_stats();
+        else
+            retval = Status_InvalidStatement;
+    } else
+        report_realtime_hooks();
+
+    return retval;
+}
+
+#if PROFILING_ENABLE
+
+static status_code_t profile_command (sys_state_t state, char *args)
+{
+    status_code_t retval = Status_OK;
+
+    if(args) {
+        if(!strcmp(args, "RESET"))
+            profile_reset();
+        else
+            retval = Status_InvalidStatement;
+    } else
+        report_profile_data();
+
+    return retval;
+}
+
+static status_code_t latency_command (sys_state_t state, char *args)
+{
+    status_code_t retval = Status_OK;
+
+    if(args) {
+        if(!strcmp(args, "RESET"))
+            latency_reset();
+        else
+            retval = Status_InvalidStatement;
+    } else
+        report_latency_data();
+
+    return retval;
+}
+
+#endif
+
+#if MEM_ACCOUNTING_ENABLE
+
+static status_code_t memory_command (sys_state_t state, char *args)
+{
+    status_code_t retval = Status_OK;
+
+    if(args) {
+        if(!strcmp(args, "RESET"))
+            mem_reset_stats();
+        else
+            retval = Status_InvalidStatement;
+    } else
+        report_memory_stats();
+
+    return retval;
+}
+
+#endif
+
+#if JOB_STATS_ENABLE
+
+static status_code_t job_stats_command (sys_state_t state, char *args)
+{
+    report_job_stats();
+
+    return Status_OK;
+}
+
+#endif
+
+#if PROBE_SCAN_LOG_SIZE
+
+static status_code_t probe_scan_write_command (sys_state_t state, char *args)
+{
+    return args ? probe_scan_write_file(args) : Status_InvalidStatement;
+}
+
+#endif
+
+#if FLOW_CREDITS_ENABLE
+
+static status_code_t flow_credits_command (sys_state_t state, char *args)
+{
+    status_code_t retval = Status_OK;
+
+    if(args) {
+        if(!strcmp(args, "1"))
+            report_flow_credits(true);
+        else if(!strcmp(args, "0"))
+            report_flow_credits(false);
+        else
+            retval = Status_InvalidStatement;
+    } else
+        hal.stream.write(report_flow_credits_enabled() ? "[CRD:1]" ASCII_EOL : "[CRD:0]" ASCII_EOL);
+
+    return retval;
+}
+
+#endif
+
 static status_code_t toggle_block_delete (sys_state_t state, char *args)
 {
     if(!hal.signals_cap.block_delete) {
@@ -829,6 +1052,9 @@ const char *help_homing (const char *cmd)
 PROGMEM static const sys_command_t sys_commands[] = {
     { "G", output_parser_state, { .noargs = On, .allow_blocking = On }, { .str = "output parser state" } },
     { "J", jog, {}, { .str = "$J=<gcode> - jog machine" } },
+#if CONTINUOUS_JOG_ENABLE
+    { "JV", jog_continuous, {}, { .str = "$JV=<axes>F<rate> - continuous jog in direction of axes vector, F0 stops" } },
+#endif
     { "#", output_ngc_parameters, { .allow_blocking = On }, {
         .str = "output offsets, tool table, probing and home position"
      ASCII_EOL "$#=<n> - output value for parameter <n>"
@@ -905,9 +1131,9 @@ PROGMEM static const sys_command_t sys_commands[] = {
     { "EE", enumerate_errors, { .noargs = On, .allow_blocking = On }, { .str = "enumerate status codes" } },
     { "EEG", enumerate_errors_grblformatted, { .noargs = On, .allow_blocking = On }, { .str = "enumerate status codes, Grbl formatted" } },
     { "EG", enumerate_groups, { .noargs = On, .allow_blocking = On }, { .str = "enumerate setting groups" } },
-    { "ES", enumerate_settings, { .noargs = On, .allow_blocking = On }, { .str = "enumerate settings" } },
-    { "ESG", enumerate_settings_grblformatted, { .noargs = On, .allow_blocking = On }, { .str = "enumerate settings, Grbl formatted" } },
-    { "ESH", enumerate_settings_halformatted, { .noargs = On, .allow_blocking = On }, { .str = "enumerate settings, grblHAL formatted" } },
+    { "ES", enumerate_settings, { .allow_blocking = On }, { .str = "enumerate settings, $ES=<first>[,<count>] outputs a page, $ES=HASH outputs a hash of the details" } },
+    { "ESG", enumerate_settings_grblformatted, { .allow_blocking = On }, { .str = "enumerate settings, Grbl formatted" } },
+    { "ESH", enumerate_settings_halformatted, { .allow_blocking = On }, { .str = "enumerate settings, grblHAL formatted" } },
     { "E*", enumerate_all, { .noargs = On, .allow_blocking = On }, { .str = "enumerate alarms, status codes and settings" } },
     { "PINS", enumerate_pins, { .noargs = On, .allow_blocking = On, .help_fn = On }, { .fn = help_pins } },
 #ifndef NO_SETTINGS_DESCRIPTIONS
@@ -918,6 +1144,67 @@ PROGMEM static const sys_command_t sys_commands[] = {
     { "SD", report_spindle_data, { .help_fn = On }, { .fn = help_spindle } },
     { "SR", spindle_reset_data, { .help_fn = On }, { .fn = help_spindle } },
     { "RTC", rtc_action, { .allow_blocking = On, .help_fn = On }, { .fn = help_rtc } },
+    { "STB", settings_begin, { .noargs = On, .allow_blocking = On }, { .str = "begin settings transaction, defer writes to storage until $STC" } },
+    { "STC", settings_commit, { .noargs = On, .allow_blocking = On }, { .str = "commit settings transaction, returns error of first failed setting" } },
+    { "PLS", report_planner_stats, { .noargs = On, .allow_blocking = On }, { .str = "output planner statistics" } },
+    { "MBSTATS", report_modbus_stats, { .noargs = On, .allow_blocking = On }, { .str = "output Modbus scheduler statistics" } },
+    { "RTH", realtime_hooks_command, { .allow_blocking = On }, { .str = "output realtime hook execution times, $RTH=RESET clears them" } },
+    { "BOOT", report_boot_phases, { .noargs = On, .allow_blocking = On }, { .str = "output boot phase times, in microseconds" } },
+#if NGC_EXPRESSIONS_ENABLE
+    { "NGCPARAMS", report_ngc_param_stats, { .noargs = On, .allow_blocking = On }, { .str = "output NGC parameter count and memory use" } },
+#endif
+#if PROFILING_ENABLE
+    { "PROF", profile_command, { .allow_blocking = On }, { .str = "output hot path profiling data, $PROF=RESET clears it" } },
+    { "LAT", latency_command, { .allow_blocking = On }, { .str = "output realtime command latencies, $LAT=RESET clears them" } },
+#endif
+#if MEM_ACCOUNTING_ENABLE
+    { "MEM", memory_command, { .allow_blocking = On }, { .str = "output heap use per subsystem, $MEM=RESET clears peak values" } },
+#endif
+#if JOB_STATS_ENABLE
+    { "JOB", job_stats_command, { .noargs = On, .allow_blocking = On }, { .str = "output statistics of the running or last job" } },
+#endif
+#if FLOW_CREDITS_ENABLE
+    { "CRD", flow_credits_command, { .allow_blocking = On }, { .str = "$CRD=1 adds free planner blocks and RX bytes to ok responses, $CRD=0 disables" } },
+#endif
+#if JOB_RESUME_ENABLE
+    { "RSM", report_job_checkpoint, { .noargs = On, .allow_blocking = On }, { .str = "output saved job checkpoint" } },
+#endif
+#if SPINDLE_SYNC_LOG_SIZE
+    { "SSL", report_spindle_sync_log, { .allow_blocking = On }, { .str = "stream out spindle sync log samples, $SSL=RESET clears the log" } },
+#endif
+#if STEP_FIDELITY_MONITOR
+    { "STF", report_step_fidelity, { .allow_blocking = On }, { .str = "output step timing fidelity statistics, $STF=RESET clears them" } },
+#endif
+#if PROBE_SCAN_LOG_SIZE
+    { "SCAN", report_probe_scan_log, { .allow_blocking = On }, { .str = "$SCAN=<rate> starts probe scan sampling at <rate> Hz, $SCAN=0 stops, $SCAN streams out samples" } },
+    { "SCANW", probe_scan_write_command, {}, { .str = "$SCANW=<file> appends pending probe scan samples to <file>" } },
+#endif
+#if PREFLIGHT_ENABLE
+    { "PRE", preflight_command, {}, { .str = "PRE=<filename> - validate file in check mode and output summary" } },
+#endif
+#if PROGRAM_CACHE_ENABLE
+    { "PGC", program_cache_command, {}, { .str = "PGC=<filename> - validate file and record it to the program cache, $PGC outputs cached program" } },
+    { "PGR", program_cache_run_command, {}, { .str = "PGR=<filename> - run program from the program cache" } },
+#endif
+#if HEIGHTMAP_ENABLE
+    { "HM", heightmap_command, { .allow_blocking = On }, { .str = "output height map, $HM=ON|OFF|SAVE|LOAD|CLEAR controls compensation" } },
+    { "HMP", heightmap_probe_command, {}, { .str = "HMP=X0,Y0,X1,Y1,NX,NY,Zclear,depth,feed - probe height map grid" } },
+#endif
+#if INPUT_EVENT_LOG_SIZE
+    { "EVL", input_events_command, { .allow_blocking = On }, { .str = "output input event log, $EVL=ON|OFF controls streaming of new events, $EVL=CLEAR clears the log" } },
+#endif
+#if VFS_READAHEAD_BUFFERS
+    { "VFSRA", report_vfs_readahead_stats, { .noargs = On, .allow_blocking = On }, { .str = "output file read-ahead statistics" } },
+#endif
+#if STREAM_TX_QUEUE_SIZE
+    { "TXQ", report_stream_tx_queues, { .noargs = On, .allow_blocking = On }, { .str = "output stream transmit queue statistics" } },
+#endif
+#if GC_OUTPUT_COMMAND_POOL_SIZE || GC_MESSAGE_POOL_SIZE
+    { "GCPOOL", report_gc_pool_stats, { .noargs = On, .allow_blocking = On }, { .str = "output command and message pool usage" } },
+#endif
+#if REPORT_DELTA_FULL_INTERVAL
+    { "RD", toggle_report_delta, { .noargs = On, .allow_blocking = On }, { .str = "toggle change-only real-time reports" } },
+#endif
 #ifdef DEBUGOUT
     { "Q", output_memmap, { .noargs = On }, { .str = "output NVS memory allocation" } },
 #endif
@@ -930,10 +1217,76 @@ static sys_commands_t core_commands = {
 
 static sys_commands_t *commands_root = &core_commands;
 
+#if SYS_COMMAND_INDEX_SIZE
+
+#define SYS_COMMAND_NONE 0xFF
+
+#if SYS_COMMAND_INDEX_SIZE >= SYS_COMMAND_NONE
+#error "SYS_COMMAND_INDEX_SIZE must be less than 255!"
+#endif
+
+typedef struct {
+    const sys_command_t *command;
+    uint8_t next;                   // Next command in the same bucket, in search order.
+} sys_command_entry_t;
+
+// Hash index of all registered commands, commands with the same name are chained in the order they are to be tried.
+static struct {
+    bool valid;
+    uint8_t bucket[SYS_COMMAND_HASH_SIZE];
+    sys_command_entry_t entry[SYS_COMMAND_INDEX_SIZE];
+} command_index = {0};
+
+static inline uint_fast8_t command_hash (const char *command)
+{
+    uint32_t hash = 5381;
+
+    while(*command)
+        hash = (hash << 5) + hash + (uint8_t)*command++;
+
+    return hash & (SYS_COMMAND_HASH_SIZE - 1);
+}
+
+// Rebuilds the index, if there is not room for all commands dispatch falls back to a linear search.
+static void command_index_build (void)
+{
+    uint8_t *tail;
+    uint_fast8_t idx, n_entries = 0, hash;
+    sys_commands_t *cmd = commands_root;
+
+    memset(command_index.bucket, SYS_COMMAND_NONE, sizeof(command_index.bucket));
+    command_index.valid = true;
+
+    do {
+        for(idx = 0; idx < cmd->n_commands; idx++) {
+
+            if(n_entries == SYS_COMMAND_INDEX_SIZE) {
+                command_index.valid = false;
+                return;
+            }
+
+            hash = command_hash(cmd->commands[idx].command);
+
+            // Append to the bucket chain to keep the search order of the command lists.
+            for(tail = &command_index.bucket[hash]; *tail != SYS_COMMAND_NONE; tail = &command_index.entry[*tail].next);
+            *tail = n_entries;
+
+            command_index.entry[n_entries].command = &cmd->commands[idx];
+            command_index.entry[n_entries++].next = SYS_COMMAND_NONE;
+        }
+    } while((cmd = cmd->next));
+}
+
+#endif // SYS_COMMAND_INDEX_SIZE
+
 void system_register_commands (sys_commands_t *commands)
 {
     commands->next = commands_root;
     commands_root = commands;
+
+#if SYS_COMMAND_INDEX_SIZE
+    command_index_build();
+#endif
 }
 
 void _system_output_help (sys_commands_t *commands, bool traverse)
@@ -1038,6 +1391,36 @@ status_code_t system_execute_line (char *line)
 
     uint_fast8_t idx;
     sys_commands_t *cmd = commands_root;
+
+#if SYS_COMMAND_INDEX_SIZE
+
+    if(!command_index.valid && commands_root == &core_commands)
+        command_index_build();
+
+    if(command_index.valid) {
+
+        const sys_command_t *command;
+
+        cmd = NULL;
+        idx = command_index.bucket[command_hash(line)];
+
+        while(idx != SYS_COMMAND_NONE) {
+            command = command_index.entry[idx].command;
+            if(!strcmp(line, command->command)) {
+                if(sys.blocking_event && !command->flags.allow_blocking) {
+                    retval = Status_NotAllowedCriticalEvent;
+                    break;
+                } else if(!command->flags.noargs || args == NULL) {
+                    if((retval = command->execute(state_get(), args)) != Status_Unhandled)
+                        break;
+                }
+            }
+            idx = command_index.entry[idx].next;
+        }
+    } else
+
+#endif // SYS_COMMAND_INDEX_SIZE
+
     do {
         for(idx = 0; idx < cmd->n_commands; idx++) {
             if(!strcmp(line, cmd->commands[idx].command)) {
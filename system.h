@@ -247,7 +247,8 @@ typedef union {
                  single_block            :1, //!< Set to true to disable M1 (optional stop), via realtime command.
                  keep_input              :1, //!< Set to true to not flush stream input buffer on executing STOP.
                  auto_reporting          :1, //!< Set to true when auto real time reporting is enabled.
-                 unused                  :6;
+                 motion_frames           :1, //!< Set to true when compact motion frames are accepted.
+                 unused                  :5;
     };
 } system_flags_t;
 
@@ -256,6 +257,13 @@ typedef struct {
     limit_signals_t limits;
 } signal_event_t;
 
+//! Home switch trigger position latch, used by the stepper ISR when \ref HOMING_POSITION_LATCH is enabled.
+typedef struct {
+    axes_signals_t armed;           //!< Axes to latch on switch trigger, set by the homing cycle.
+    axes_signals_t latched;         //!< Axes latched by the stepper ISR, step output is locked out for these.
+    int32_t position[N_AXIS];       //!< Position in steps at switch trigger.
+} homing_latch_t;
+
 typedef struct {
     coord_data_t min;
     coord_data_t max;
@@ -278,6 +286,9 @@ typedef struct system {
     step_control_t step_control;            //!< Governs the step segment generator depending on system state.
     axes_signals_t homing_axis_lock;        //!< Locks axes when limits engage. Used as an axis motion mask in the stepper ISR.
     axes_signals_t homing;                  //!< Axes with homing enabled.
+#if HOMING_POSITION_LATCH
+    volatile homing_latch_t homing_latch;   //!< Home switch trigger position latch.
+#endif
     overrides_t override;                   //!< Override values & states
     system_override_delay_t override_delay; //!< Flags for delayed overrides.
     report_tracking_flags_t report;         //!< Tracks when to add data to status reports.
@@ -0,0 +1,286 @@
+/*
+  tool_table.c - sparse tool table with hashed index and file storage
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "hal.h"
+
+#if TOOL_TABLE_ENABLE
+
+#include "tool_table.h"
+#include "mem_stats.h"
+#include "vfs.h"
+
+#ifndef TOOL_TABLE_HASH_SIZE
+#define TOOL_TABLE_HASH_SIZE 64     // Number of hash buckets, must be a power of 2
+#endif
+#ifndef TOOL_TABLE_POOL_BLOCK
+#define TOOL_TABLE_POOL_BLOCK 16    // Number of tools allocated per memory block
+#endif
+#ifndef TOOL_TABLE_FILE
+#define TOOL_TABLE_FILE "/tooltable.dat"
+#endif
+
+typedef struct tool_entry {
+    tool_data_t data;
+    bool defined;               // Set when defined by G10L1 or loaded from file, only defined tools are stored.
+    struct tool_entry *next;
+} tool_entry_t;
+
+typedef struct tool_block {
+    struct tool_block *next;
+    tool_entry_t tool[TOOL_TABLE_POOL_BLOCK];
+} tool_block_t;
+
+typedef struct {
+    tool_data_t data;
+    uint8_t checksum;
+} tool_record_t;
+
+// Tools are allocated from pooled memory blocks and indexed by hash buckets,
+// the next member of the entry struct is used for chaining tools in the same bucket.
+static tool_entry_t *tools[TOOL_TABLE_HASH_SIZE] = {0};
+static tool_entry_t *free_tools = NULL;
+static tool_block_t *tool_blocks = NULL;
+static uint_fast16_t n_allocated = 0;
+static bool load_pending = true;
+static tool_data_t no_tool = {0}; // Entry for tools not in tool table.
+static on_vfs_mount_ptr on_mount;
+
+static inline uint_fast8_t tool_hash (tool_id_t tool_id)
+{
+    return tool_id & (TOOL_TABLE_HASH_SIZE - 1);
+}
+
+static tool_entry_t *tool_alloc (void)
+{
+    tool_entry_t *entry;
+    tool_block_t *block;
+    uint_fast8_t idx = n_allocated % TOOL_TABLE_POOL_BLOCK;
+
+    if((entry = free_tools)) {
+        free_tools = entry->next;
+        return entry;
+    }
+
+    if(idx == 0) {
+        if((block = mem_alloc(MemTag_Tools, sizeof(tool_block_t))) == NULL)
+            return NULL;
+        block->next = tool_blocks;
+        tool_blocks = block;
+    }
+
+    n_allocated++;
+
+    return &tool_blocks->tool[idx];
+}
+
+static tool_entry_t *tool_find (tool_id_t tool_id)
+{
+    tool_entry_t *entry = tools[tool_hash(tool_id)];
+
+    while(entry && entry->data.tool_id != tool_id)
+        entry = entry->next;
+
+    return entry;
+}
+
+static tool_entry_t *tool_add (tool_id_t tool_id)
+{
+    tool_entry_t *entry;
+
+    if((entry = tool_alloc())) {
+        memset(&entry->data, 0, sizeof(tool_data_t));
+        entry->data.tool_id = tool_id;
+        entry->defined = false;
+        entry->next = tools[tool_hash(tool_id)];
+        tools[tool_hash(tool_id)] = entry;
+    }
+
+    return entry;
+}
+
+// Loads tools from the tool table file, tools in the file replace data of tools only referenced so far.
+static void table_load (void)
+{
+    vfs_file_t *file;
+    tool_record_t record;
+    tool_entry_t *entry;
+
+    load_pending = false;
+
+    if((file = vfs_open(TOOL_TABLE_FILE, "r"))) {
+
+        while(vfs_read(&record, sizeof(tool_record_t), 1, file) == 1) {
+            if(record.checksum == calc_checksum((uint8_t *)&record.data, sizeof(tool_data_t)) &&
+                record.data.tool_id > 0 && record.data.tool_id <= TOOL_TABLE_MAX_TOOL_NUMBER &&
+                 ((entry = tool_find(record.data.tool_id)) || (entry = tool_add(record.data.tool_id)))) {
+                if(!entry->defined)
+                    memcpy(&entry->data, &record.data, sizeof(tool_data_t));
+                entry->defined = true;
+            }
+        }
+
+        vfs_close(file);
+    }
+}
+
+static inline tool_entry_t *tool_lookup (tool_id_t tool_id)
+{
+    if(load_pending)
+        table_load();
+
+    return tool_find(tool_id);
+}
+
+// Writes all defined tools to the tool table file.
+static bool table_save (void)
+{
+    bool ok;
+    uint_fast8_t idx;
+    vfs_file_t *file;
+    tool_entry_t *entry;
+    tool_record_t record;
+
+    if((ok = (file = vfs_open(TOOL_TABLE_FILE, "w")) != NULL)) {
+
+        for(idx = 0; ok && idx < TOOL_TABLE_HASH_SIZE; idx++) {
+            for(entry = tools[idx]; ok && entry; entry = entry->next) {
+                if(entry->defined) {
+                    memcpy(&record.data, &entry->data, sizeof(tool_data_t));
+                    record.checksum = calc_checksum((uint8_t *)&record.data, sizeof(tool_data_t));
+                    ok = vfs_write(&record, sizeof(tool_record_t), 1, file) == 1;
+                }
+            }
+        }
+
+        vfs_close(file);
+    }
+
+    return ok;
+}
+
+static tool_data_t *tool_get (tool_id_t tool_id, bool add)
+{
+    tool_entry_t *entry;
+
+    if(tool_id == 0 || tool_id > TOOL_TABLE_MAX_TOOL_NUMBER)
+        return NULL;
+
+    if((entry = tool_lookup(tool_id)) == NULL && add)
+        entry = tool_add(tool_id);
+
+    return entry ? &entry->data : NULL;
+}
+
+static bool tool_read (tool_id_t tool_id, tool_data_t *tool_data)
+{
+    tool_entry_t *entry;
+
+    if(tool_id == 0 || tool_id > TOOL_TABLE_MAX_TOOL_NUMBER)
+        return false;
+
+    if((entry = tool_lookup(tool_id))) {
+        if(&entry->data != tool_data)
+            memcpy(tool_data, &entry->data, sizeof(tool_data_t));
+    } else {
+        memset(tool_data, 0, sizeof(tool_data_t));
+        tool_data->tool_id = tool_id;
+    }
+
+    return true;
+}
+
+static bool tool_write (tool_data_t *tool_data)
+{
+    tool_entry_t *entry;
+
+    if(tool_data->tool_id == 0 || tool_data->tool_id > TOOL_TABLE_MAX_TOOL_NUMBER)
+        return false;
+
+    if((entry = tool_lookup(tool_data->tool_id)) == NULL && (entry = tool_add(tool_data->tool_id)) == NULL)
+        return false;
+
+    if(&entry->data != tool_data)
+        memcpy(&entry->data, tool_data, sizeof(tool_data_t));
+    entry->defined = true;
+
+    return table_save();
+}
+
+// Removes all tools, entries may be referenced by the parser and are reset rather than released if so.
+static bool tool_clear (void)
+{
+    uint_fast8_t idx;
+    tool_entry_t *entry, *next, **link;
+
+    for(idx = 0; idx < TOOL_TABLE_HASH_SIZE; idx++) {
+        link = &tools[idx];
+        for(entry = tools[idx]; entry; entry = next) {
+            next = entry->next;
+            if(gc_state.tool == &entry->data) {
+                tool_id_t tool_id = entry->data.tool_id;
+                memset(&entry->data, 0, sizeof(tool_data_t));
+                entry->data.tool_id = tool_id;
+                entry->defined = false;
+                link = &entry->next;
+            } else {
+                *link = next;
+                entry->next = free_tools;
+                free_tools = entry;
+            }
+        }
+    }
+
+    load_pending = false;
+
+    vfs_unlink(TOOL_TABLE_FILE);
+
+    return true;
+}
+
+// Reload the tool table on the next access when a file system is mounted.
+static void tool_table_on_mount (const char *path, const vfs_t *fs)
+{
+    load_pending = true;
+
+    if(on_mount)
+        on_mount(path, fs);
+}
+
+void tool_table_init (void)
+{
+    static bool init_ok = false;
+
+    if(!init_ok) {
+        init_ok = true;
+        on_mount = vfs.on_mount;
+        vfs.on_mount = tool_table_on_mount;
+    }
+
+    grbl.tool_table.n_tools = TOOL_TABLE_MAX_TOOL_NUMBER;
+    grbl.tool_table.tool = &no_tool;
+    grbl.tool_table.read = tool_read;
+    grbl.tool_table.write = tool_write;
+    grbl.tool_table.clear = tool_clear;
+    grbl.tool_table.get = tool_get;
+}
+
+#endif // TOOL_TABLE_ENABLE
@@ -0,0 +1,31 @@
+/*
+  tool_table.h - sparse tool table with hashed index and file storage
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TOOL_TABLE_H_
+#define _TOOL_TABLE_H_
+
+#include "hal.h"
+
+#if TOOL_TABLE_ENABLE
+
+void tool_table_init (void);
+
+#endif
+
+#endif
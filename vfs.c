@@ -28,6 +28,10 @@
 
 #include "hal.h"
 #include "vfs.h"
+
+#if VFS_READAHEAD_BUFFERS
+#include "protocol.h"
+#endif
 //#include <errno.h>
 
 // NULL file system
@@ -132,6 +136,30 @@ static char cwd[100] = "/";
 int vfs_errno = 0;
 vfs_events_t vfs = {0};
 
+#ifndef VFS_MOUNT_CACHE_PATH_LENGTH
+#define VFS_MOUNT_CACHE_PATH_LENGTH 48 // Maximum length of cached paths, including terminator.
+#endif
+
+#if VFS_MOUNT_CACHE_SIZE
+
+typedef struct {
+    uint32_t hash;
+    vfs_mount_t *mount;
+    char path[VFS_MOUNT_CACHE_PATH_LENGTH];
+} mount_cache_entry_t;
+
+static uint_fast8_t mount_cache_next = 0;
+static mount_cache_entry_t mount_cache[VFS_MOUNT_CACHE_SIZE] = {0};
+
+static inline void mount_cache_invalidate (void)
+{
+    memset(mount_cache, 0, sizeof(mount_cache));
+}
+
+#else
+#define mount_cache_invalidate()
+#endif
+
 // Strip trailing directory separator, FatFS dont't like it (WinSCP adds it)
 char *vfs_fixpath (char *path)
 {
@@ -168,8 +196,27 @@ static vfs_mount_t *get_mount (const char *path)
     if(*path != '/')
         return cwdmount;
 
+    if(root.next == NULL) // Only the root file system is mounted.
+        return &root;
+
     vfs_mount_t *mount;
 
+#if VFS_MOUNT_CACHE_SIZE
+    uint_fast8_t idx;
+    uint32_t hash = 5381;
+    const char *s = path;
+
+    while(*s)
+        hash = ((hash << 5) + hash) ^ (uint8_t)*s++;
+
+    if(s - path < VFS_MOUNT_CACHE_PATH_LENGTH) {
+        for(idx = 0; idx < VFS_MOUNT_CACHE_SIZE; idx++) {
+            if(mount_cache[idx].mount && mount_cache[idx].hash == hash && !strcmp(mount_cache[idx].path, path))
+                return mount_cache[idx].mount;
+        }
+    }
+#endif
+
     if((mount = path_is_mount_dir(path)) == NULL) {
 
         mount = root.next;
@@ -183,6 +230,15 @@ static vfs_mount_t *get_mount (const char *path)
             mount = &root;
     }
 
+#if VFS_MOUNT_CACHE_SIZE
+    if(s - path < VFS_MOUNT_CACHE_PATH_LENGTH) {
+        mount_cache[mount_cache_next].hash = hash;
+        mount_cache[mount_cache_next].mount = mount;
+        strcpy(mount_cache[mount_cache_next].path, path);
+        mount_cache_next = (mount_cache_next + 1) % VFS_MOUNT_CACHE_SIZE;
+    }
+#endif
+
     return mount;
 }
 
@@ -195,6 +251,159 @@ static const char *get_filename (vfs_mount_t *mount, const char *filename)
         return filename;
 }
 
+#if VFS_READAHEAD_BUFFERS
+
+typedef struct {
+    size_t length;  // Number of bytes in buffer.
+    size_t pos;     // Read position.
+    uint8_t *data;
+} readahead_buffer_t;
+
+typedef struct {
+    vfs_file_t *file;
+    bool eof;       // Set when the underlying file is read to the end.
+    bool hooked;
+    uint_fast8_t head;  // Next buffer to refill.
+    uint_fast8_t tail;  // Buffer being read.
+    uint_fast8_t count; // Number of filled buffers.
+    readahead_buffer_t buffer[VFS_READAHEAD_BUFFERS];
+    vfs_readahead_stats_t stats;
+} readahead_t;
+
+static readahead_t readahead = {0};
+
+// Fills the next free buffer from the underlying file system, returns false if no buffer could be filled.
+static bool readahead_refill (void)
+{
+    uint32_t t = 0, elapsed;
+    readahead_buffer_t *buffer;
+
+    if(readahead.count == VFS_READAHEAD_BUFFERS || readahead.eof)
+        return false;
+
+    buffer = &readahead.buffer[readahead.head];
+
+    if(hal.get_micros)
+        t = hal.get_micros();
+
+    buffer->pos = 0;
+    buffer->length = ((vfs_t *)(readahead.file->fs))->fread(buffer->data, 1, VFS_READAHEAD_BUFFER_SIZE, readahead.file);
+
+    if(hal.get_micros) {
+        elapsed = hal.get_micros() - t;
+        readahead.stats.last_latency = elapsed;
+        if(elapsed > readahead.stats.max_latency)
+            readahead.stats.max_latency = elapsed;
+    }
+
+    readahead.stats.refills++;
+    readahead.eof = buffer->length < VFS_READAHEAD_BUFFER_SIZE;
+
+    if(buffer->length) {
+        readahead.head = (readahead.head + 1) % VFS_READAHEAD_BUFFERS;
+        readahead.count++;
+    }
+
+    return buffer->length != 0;
+}
+
+// Refills one buffer per call from the foreground realtime loop, this is where the parser waits for
+// planner buffer space so file system latency is hidden from the parser.
+static void readahead_poll (sys_state_t state)
+{
+    if(readahead.file)
+        readahead_refill();
+}
+
+static inline void readahead_flush (void)
+{
+    readahead.head = readahead.tail = readahead.count = 0;
+    readahead.eof = false;
+}
+
+static size_t readahead_read (void *buffer, size_t size, size_t count, vfs_file_t *file)
+{
+    size_t n, length = size * count, copied = 0;
+    readahead_buffer_t *rb;
+
+    while(copied < length) {
+
+        if(readahead.count == 0) {
+            if(readahead.eof)
+                break;
+            readahead.stats.stalls++; // Parser caught up with read-ahead, read synchronously.
+            if(!readahead_refill())
+                break;
+        }
+
+        rb = &readahead.buffer[readahead.tail];
+        n = min(rb->length - rb->pos, length - copied);
+        memcpy((uint8_t *)buffer + copied, rb->data + rb->pos, n);
+        copied += n;
+
+        if((rb->pos += n) == rb->length) {
+            readahead.tail = (readahead.tail + 1) % VFS_READAHEAD_BUFFERS;
+            readahead.count--;
+        }
+    }
+
+    return copied / size;
+}
+
+static void readahead_detach (void)
+{
+    if(readahead.file) {
+        readahead.file = NULL;
+        free(readahead.buffer[0].data);
+    }
+}
+
+/*! \brief Attach read-ahead buffering to a file opened for reading, typically a job streamed from a SD card.
+VFS_READAHEAD_BUFFERS buffers of VFS_READAHEAD_BUFFER_SIZE bytes are filled from the foreground realtime loop while
+the current buffer is parsed. Reads, seeks, tell and eof calls via the vfs API are transparently handled.
+Only one file can have read-ahead attached at a time, the previous one is detached.
+\param file pointer to a \a vfs_file_t structure.
+\returns true if successful, false if memory could not be allocated.
+*/
+bool vfs_readahead_attach (vfs_file_t *file)
+{
+    uint_fast8_t idx;
+    size_t pos = readahead.file ? vfs_tell(readahead.file) : 0;
+    uint8_t *data;
+
+    if(((vfs_t *)(file->fs))->fmmap)
+        return true; // Memory mapped, no need for read-ahead.
+
+    if(readahead.file) {
+        vfs_file_t *current = readahead.file;
+        readahead_detach();
+        ((vfs_t *)(current->fs))->fseek(current, pos); // Restore position of underlying file.
+    }
+
+    if((data = malloc(VFS_READAHEAD_BUFFERS * VFS_READAHEAD_BUFFER_SIZE)) == NULL)
+        return false;
+
+    for(idx = 0; idx < VFS_READAHEAD_BUFFERS; idx++)
+        readahead.buffer[idx].data = data + idx * VFS_READAHEAD_BUFFER_SIZE;
+
+    readahead_flush();
+    memset(&readahead.stats, 0, sizeof(vfs_readahead_stats_t));
+    readahead.file = file;
+
+    if(!readahead.hooked)
+        readahead.hooked = protocol_register_realtime_hook("vfs readahead", readahead_poll, 0, false);
+
+    return true;
+}
+
+//! Returns pointer to read-ahead statistics.
+vfs_readahead_stats_t *vfs_readahead_get_stats (void)
+{
+    return &readahead.stats;
+}
+
+#endif // VFS_READAHEAD_BUFFERS
+
 vfs_file_t *vfs_open (const char *filename, const char *mode)
 {
     vfs_file_t *file = NULL;
@@ -212,6 +421,11 @@ void vfs_close (vfs_file_t *file)
 {
     vfs_errno = 0;
 
+#if VFS_READAHEAD_BUFFERS
+    if(file == readahead.file)
+        readahead_detach();
+#endif
+
     ((vfs_t *)(file->fs))->fclose(file);
 
     if(file->update && vfs.on_fs_changed)
@@ -222,6 +436,11 @@ size_t vfs_read (void *buffer, size_t size, size_t count, vfs_file_t *file)
 {
     vfs_errno = 0;
 
+#if VFS_READAHEAD_BUFFERS
+    if(file == readahead.file)
+        return readahead_read(buffer, size, count, file);
+#endif
+
     return ((vfs_t *)(file->fs))->fread(buffer, size, count, file);
 }
 
@@ -248,6 +467,19 @@ size_t vfs_tell (vfs_file_t *file)
 {
     vfs_errno = 0;
 
+#if VFS_READAHEAD_BUFFERS
+    if(file == readahead.file) {
+        // Underlying position less bytes read ahead but not yet consumed.
+        size_t pos = ((vfs_t *)(file->fs))->ftell(file);
+        uint_fast8_t idx = readahead.tail, count = readahead.count;
+        while(count--) {
+            pos -= readahead.buffer[idx].length - readahead.buffer[idx].pos;
+            idx = (idx + 1) % VFS_READAHEAD_BUFFERS;
+        }
+        return pos;
+    }
+#endif
+
     return ((vfs_t *)(file->fs))->ftell(file);
 }
 
@@ -255,13 +487,38 @@ int vfs_seek (vfs_file_t *file, size_t offset)
 {
     vfs_errno = 0;
 
+#if VFS_READAHEAD_BUFFERS
+    if(file == readahead.file)
+        readahead_flush();
+#endif
+
     return ((vfs_t *)(file->fs))->fseek(file, offset);
 }
 
+/*! \brief Get direct access to file content for memory mapped file systems such as the embedded file system.
+The file position is not changed, use vfs_seek() to advance it past consumed data.
+\param file pointer to a \a vfs_file_t structure.
+\param length pointer to a \a size_t variable that receives the number of bytes available from the current position.
+\returns pointer to the file content at the current position, NULL if the file system is not memory mapped.
+*/
+const uint8_t *vfs_mmap (vfs_file_t *file, size_t *length)
+{
+    vfs_errno = 0;
+
+    *length = 0;
+
+    return ((vfs_t *)(file->fs))->fmmap ? ((vfs_t *)(file->fs))->fmmap(file, length) : NULL;
+}
+
 bool vfs_eof (vfs_file_t *file)
 {
     vfs_errno = 0;
 
+#if VFS_READAHEAD_BUFFERS
+    if(file == readahead.file && readahead.count)
+        return false;
+#endif
+
     return ((vfs_t *)(file->fs))->feof(file);
 }
 
@@ -323,6 +580,8 @@ int vfs_chdir (const char *path)
 
     vfs_errno = 0;
 
+    mount_cache_invalidate();
+
     if(*path != '/') {
         if(strcmp(path, "..")) {
             if(strlen(cwd) > 1)
@@ -513,6 +772,8 @@ bool vfs_mount (const char *path, const vfs_t *fs, vfs_st_mode_t mode)
         lmount->next = mount;
     }
 
+    mount_cache_invalidate();
+
     if(fs && vfs.on_mount)
         vfs.on_mount(path, fs);
 
@@ -543,6 +804,8 @@ bool vfs_unmount (const char *path)
         }
     }
 
+    mount_cache_invalidate();
+
     if(vfs.on_unmount)
         vfs.on_unmount(path);
 
@@ -126,6 +126,7 @@ typedef int (*vfs_utime_ptr)(const char *filename, struct tm *modified);
 
 typedef bool (*vfs_getfree_ptr)(vfs_free_t *free);
 typedef int (*vfs_format_ptr)(void);
+typedef const uint8_t *(*vfs_mmap_ptr)(vfs_file_t *file, size_t *length);
 
 typedef struct
 {
@@ -151,6 +152,7 @@ typedef struct
     vfs_getcwd_ptr fgetcwd;
     vfs_getfree_ptr fgetfree;
     vfs_format_ptr format;
+    vfs_mmap_ptr fmmap;     //!< Optional, returns pointer to file content at current position for memory mapped file systems.
 } vfs_t;
 
 typedef void (*on_vfs_changed_ptr)(const vfs_t *fs);
@@ -195,6 +197,21 @@ struct vfs_dir {
     uint8_t handle __attribute__ ((aligned (4))); // must be last!
 };
 
+//! Read-ahead statistics, only available when \ref VFS_READAHEAD_BUFFERS is > 0.
+typedef struct {
+    uint32_t refills;       //!< Number of buffer refills.
+    uint32_t stalls;        //!< Number of times a read found no data read ahead and had to wait for a refill.
+    uint32_t last_latency;  //!< Last buffer refill time in microseconds, requires hal.get_micros.
+    uint32_t max_latency;   //!< Worst buffer refill time in microseconds, requires hal.get_micros.
+} vfs_readahead_stats_t;
+
+//! Log sink statistics, only available when \ref VFS_LOG_BUFFER_SIZE is > 0.
+typedef struct {
+    uint32_t writes;        //!< Number of file writes.
+    uint32_t dropped;       //!< Number of entries dropped due to buffer overflow.
+    uint32_t max_fill;      //!< Maximum number of bytes buffered.
+} vfs_log_stats_t;
+
 extern int vfs_errno;
 extern vfs_events_t vfs;
 
@@ -229,5 +246,21 @@ void vfs_drives_close (vfs_drives_t *handle);
 vfs_free_t *vfs_drive_getfree (vfs_drive_t *drive);
 int vfs_drive_format (vfs_drive_t *drive);
 vfs_drive_t *vfs_get_drive (const char *path);
+const uint8_t *vfs_mmap (vfs_file_t *file, size_t *length);
+bool vfs_embedded_mount (const char *path, const embedded_file_t **file_list, bool hidden);
+
+#if VFS_READAHEAD_BUFFERS
+bool vfs_readahead_attach (vfs_file_t *file);
+vfs_readahead_stats_t *vfs_readahead_get_stats (void);
+#endif
+
+#if VFS_LOG_BUFFER_SIZE
+bool vfs_log_open (const char *filename);
+void vfs_log_close (void);
+void vfs_log_flush (void);
+bool vfs_log_write (const char *s);
+bool vfs_log_message (const char *prefix, const char *msg);
+vfs_log_stats_t *vfs_log_get_stats (void);
+#endif
 
 #endif // INCLUDE_VFS_H
@@ -0,0 +1,239 @@
+/*
+  vfs_embedded.c - An embedded CNC Controller with rs274/ngc (g-code) support
+
+  Read-only file system for files embedded in flash
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef ARDUINO_SAM_DUE
+
+#include "hal.h"
+#include "vfs.h"
+
+typedef struct {
+    const embedded_file_t *file;
+    size_t pos;
+} embedded_handle_t;
+
+typedef struct {
+    uint_fast16_t idx;
+} embedded_dir_t;
+
+static const embedded_file_t **files = NULL;
+
+static const embedded_file_t *fs_find (const char *filename)
+{
+    uint_fast16_t idx = 0;
+
+    if(*filename == '/')
+        filename++;
+
+    while(files[idx]) {
+        if(!strcmp(files[idx]->name, filename))
+            return files[idx];
+        idx++;
+    }
+
+    return NULL;
+}
+
+static vfs_file_t *fs_open (const char *filename, const char *mode)
+{
+    vfs_file_t *file = NULL;
+    const embedded_file_t *efile;
+
+    if(*mode == 'r' && strchr(mode, '+') == NULL && (efile = fs_find(filename)) &&
+         (file = malloc(sizeof(vfs_file_t) + sizeof(embedded_handle_t)))) {
+
+        embedded_handle_t *handle = (embedded_handle_t *)&file->handle;
+
+        file->size = efile->size;
+        handle->file = efile;
+        handle->pos = 0;
+    }
+
+    return file;
+}
+
+static void fs_close (vfs_file_t *file)
+{
+    free(file);
+}
+
+static size_t fs_read (void *buffer, size_t size, size_t count, vfs_file_t *file)
+{
+    embedded_handle_t *handle = (embedded_handle_t *)&file->handle;
+    size_t length = min(size * count, handle->file->size - handle->pos) / size;
+
+    memcpy(buffer, &handle->file->data[handle->pos], length * size);
+    handle->pos += length * size;
+
+    return length;
+}
+
+static size_t fs_write (const void *buffer, size_t size, size_t count, vfs_file_t *file)
+{
+    return 0;
+}
+
+static size_t fs_tell (vfs_file_t *file)
+{
+    return ((embedded_handle_t *)&file->handle)->pos;
+}
+
+static int fs_seek (vfs_file_t *file, size_t offset)
+{
+    embedded_handle_t *handle = (embedded_handle_t *)&file->handle;
+
+    if(offset > handle->file->size)
+        return -1;
+
+    handle->pos = offset;
+
+    return 0;
+}
+
+static bool fs_eof (vfs_file_t *file)
+{
+    embedded_handle_t *handle = (embedded_handle_t *)&file->handle;
+
+    return handle->pos >= handle->file->size;
+}
+
+static const uint8_t *fs_mmap (vfs_file_t *file, size_t *length)
+{
+    embedded_handle_t *handle = (embedded_handle_t *)&file->handle;
+
+    *length = handle->file->size - handle->pos;
+
+    return &handle->file->data[handle->pos];
+}
+
+static int fs_unlink (const char *filename)
+{
+    return -1;
+}
+
+static int fs_dirop (const char *path)
+{
+    return -1;
+}
+
+static int fs_chdir (const char *path)
+{
+    return !strcmp(path, "/") ? 0 : -1;
+}
+
+static vfs_dir_t *fs_opendir (const char *path)
+{
+    vfs_dir_t *dir = NULL;
+
+    if(!strcmp(path, "/") && (dir = malloc(sizeof(vfs_dir_t) + sizeof(embedded_dir_t))))
+        ((embedded_dir_t *)&dir->handle)->idx = 0;
+
+    return dir;
+}
+
+static char *fs_readdir (vfs_dir_t *dir, vfs_dirent_t *dirent)
+{
+    embedded_dir_t *handle = (embedded_dir_t *)&dir->handle;
+    const embedded_file_t *file = files[handle->idx];
+
+    *dirent->name = '\0';
+
+    if(file) {
+        strncpy(dirent->name, file->name, sizeof(dirent->name) - 1);
+        dirent->name[sizeof(dirent->name) - 1] = '\0';
+        dirent->size = file->size;
+        dirent->st_mode = (vfs_st_mode_t){ .read_only = true };
+        handle->idx++;
+    }
+
+    return dirent->name;
+}
+
+static void fs_closedir (vfs_dir_t *dir)
+{
+    free(dir);
+}
+
+static int fs_stat (const char *filename, vfs_stat_t *st)
+{
+    const embedded_file_t *file;
+
+    if((file = fs_find(filename)) == NULL)
+        return -1;
+
+    memset(st, 0, sizeof(vfs_stat_t));
+    st->st_size = file->size;
+    st->st_mode.read_only = true;
+
+    return 0;
+}
+
+static char *fs_getcwd (char *buf, size_t size)
+{
+    return "/";
+}
+
+static const vfs_t fs_embedded = {
+    .fs_name = "embedded",
+    .fopen = fs_open,
+    .fclose = fs_close,
+    .fread = fs_read,
+    .fwrite = fs_write,
+    .ftell = fs_tell,
+    .fseek = fs_seek,
+    .feof = fs_eof,
+    .funlink = fs_unlink,
+    .fmkdir = fs_dirop,
+    .fchdir = fs_chdir,
+    .frmdir = fs_dirop,
+    .fopendir = fs_opendir,
+    .readdir = fs_readdir,
+    .fclosedir = fs_closedir,
+    .fstat = fs_stat,
+    .fgetcwd = fs_getcwd,
+    .fmmap = fs_mmap
+};
+
+/*! \brief Mount a read-only file system containing files embedded in flash.
+Files are read straight from flash, the file system supports memory mapped access via vfs_mmap().
+\param path mount point, e.g. "/embedded".
+\param file_list NULL terminated list of pointers to \a embedded_file_t structures, must stay valid while mounted.
+\param hidden true to hide the file system from directory listings.
+\returns true if successful.
+*/
+bool vfs_embedded_mount (const char *path, const embedded_file_t **file_list, bool hidden)
+{
+    if(file_list == NULL || files != NULL)
+        return false;
+
+    files = file_list;
+
+    if(!vfs_mount(path, &fs_embedded, (vfs_st_mode_t){ .directory = true, .read_only = true, .hidden = hidden })) {
+        files = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+#endif
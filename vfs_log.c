@@ -0,0 +1,171 @@
+/*
+  vfs_log.c - An embedded CNC Controller with rs274/ngc (g-code) support
+
+  Write-behind log sink for the Virtual File System
+
+  Part of grblHAL
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "hal.h"
+
+#if VFS_LOG_BUFFER_SIZE && !defined(ARDUINO_SAM_DUE)
+
+#include "vfs.h"
+#include "protocol.h"
+#include "state_machine.h"
+
+typedef struct {
+    vfs_file_t *file;
+    bool hooked;
+    volatile uint_fast16_t head;    // Written by producers with interrupts disabled.
+    volatile uint_fast16_t tail;    // Written by the foreground drain only.
+    vfs_log_stats_t stats;
+    char data[VFS_LOG_BUFFER_SIZE];
+} vfs_log_t;
+
+static vfs_log_t logsink = {0};
+
+static inline uint_fast16_t log_fill (void)
+{
+    uint_fast16_t head = logsink.head, tail = logsink.tail;
+
+    return head >= tail ? head - tail : VFS_LOG_BUFFER_SIZE - tail + head;
+}
+
+// Writes out buffered data in (at most two) sequential writes.
+static void log_drain (void)
+{
+    uint_fast16_t head = logsink.head, tail = logsink.tail, length;
+
+    while(tail != head) {
+        length = (head > tail ? head : VFS_LOG_BUFFER_SIZE) - tail;
+        vfs_write(&logsink.data[tail], 1, length, logsink.file);
+        tail = (tail + length) % VFS_LOG_BUFFER_SIZE;
+        logsink.stats.writes++;
+    }
+
+    logsink.tail = tail;
+}
+
+// Drains the buffer when idle, or when it is more than half full while a job is running.
+static void log_poll (sys_state_t state)
+{
+    if(logsink.file && logsink.head != logsink.tail && (state == STATE_IDLE || log_fill() >= VFS_LOG_BUFFER_SIZE / 2))
+        log_drain();
+}
+
+static bool log_append (const char **parts, uint_fast8_t n_parts)
+{
+    bool ok;
+    size_t length = 0;
+    uint_fast8_t idx;
+    uint_fast16_t head, count;
+
+    if(logsink.file == NULL)
+        return false;
+
+    for(idx = 0; idx < n_parts; idx++)
+        length += strlen(parts[idx]);
+
+    hal.irq_disable();
+
+    if((ok = length < VFS_LOG_BUFFER_SIZE - 1 - log_fill())) {
+        head = logsink.head;
+        for(idx = 0; idx < n_parts; idx++) {
+            const char *s = parts[idx];
+            while(*s) {
+                count = min(strlen(s), VFS_LOG_BUFFER_SIZE - head);
+                memcpy(&logsink.data[head], s, count);
+                s += count;
+                head = (head + count) % VFS_LOG_BUFFER_SIZE;
+            }
+        }
+        logsink.head = head;
+        if(log_fill() > logsink.stats.max_fill)
+            logsink.stats.max_fill = log_fill();
+    } else
+        logsink.stats.dropped++;
+
+    hal.irq_enable();
+
+    return ok;
+}
+
+/*! \brief Start logging to a file. Data is appended to the file if it exists.
+\param filename path to the file.
+\returns true if successful.
+*/
+bool vfs_log_open (const char *filename)
+{
+    vfs_log_close();
+
+    if((logsink.file = vfs_open(filename, "a"))) {
+        logsink.head = logsink.tail = 0;
+        memset(&logsink.stats, 0, sizeof(vfs_log_stats_t));
+        if(!logsink.hooked)
+            logsink.hooked = protocol_register_realtime_hook("vfs log", log_poll, 0, false);
+    }
+
+    return logsink.file != NULL;
+}
+
+//! Flush buffered data and close the log file.
+void vfs_log_close (void)
+{
+    if(logsink.file) {
+        log_drain();
+        vfs_close(logsink.file);
+        logsink.file = NULL;
+    }
+}
+
+//! Write all buffered data to the log file, must be called from the foreground process.
+void vfs_log_flush (void)
+{
+    if(logsink.file)
+        log_drain();
+}
+
+/*! \brief Append a string to the log. Safe to call from any context, the string is dropped if there is not enough buffer space.
+\param s pointer to a null terminated string.
+\returns true if the string was appended.
+*/
+bool vfs_log_write (const char *s)
+{
+    return log_append(&s, 1);
+}
+
+/*! \brief Append a message line to the log. Safe to call from any context.
+\param prefix pointer to a null terminated prefix string, e.g. "MSG:".
+\param msg pointer to a null terminated message string.
+\returns true if the message was appended.
+*/
+bool vfs_log_message (const char *prefix, const char *msg)
+{
+    const char *parts[] = { prefix, msg, ASCII_EOL };
+
+    return log_append(parts, sizeof(parts) / sizeof(char *));
+}
+
+//! Returns pointer to log statistics.
+vfs_log_stats_t *vfs_log_get_stats (void)
+{
+    return &logsink.stats;
+}
+
+#endif